@@ -3,7 +3,19 @@
 #include "esp_check.h"
 #include "driver/gpio.h"
 #include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "Wifi.h"
+#include "wifi_ws_sync.h"
+#include "wifi_ws_rx.h"
+#include "wifi_arena.h"
+#include "wifi_assets.h"
+#include "wifi_sdlog.h"
+#include "wifi_multipart.h"
+#include "wifi_ssi.h"
+
+#include <stdlib.h>
+#include <sys/stat.h>
 
 
 // --- Define variables, classes ---
@@ -33,6 +45,25 @@ typedef struct __attribute__((packed)) {
 } ws_control_packet_t;
 
 
+// Value-sync callback: apply values batched by the browser and publish them to all dashboards
+static void ws_sync_value_cb(const wifi_ws_sync_value_t *value, void *ctx)
+{
+    if (value->type != WIFI_WS_SYNC_TYPE_INT) {
+        ESP_LOGW(TAG, "Unexpected sync value type %d for key %u", value->type, value->key);
+        return;
+    }
+    switch (value->key) {
+        case SLIDER_BINARY:
+            sliderBinaryValue = (uint8_t)(value->i & 0xFF);
+            wifi_ws_sync_set_int(SLIDER_BINARY, sliderBinaryValue);
+            ESP_LOGI(TAG, "Binary slider synced to %d", sliderBinaryValue);
+            break;
+        default:
+            ESP_LOGW(TAG, "Unknown sync key: %u, value: %ld", value->key, (long)value->i);
+            break;
+    }
+}
+
 // Helper: send a 1-byte event back to the client that sent the request
 static esp_err_t send_ws_event_to_req(httpd_req_t *req, uint8_t eventType)
 {
@@ -70,46 +101,351 @@ static esp_err_t send_ws_value_to_req(httpd_req_t *req, uint8_t type, int16_t va
     return ESP_OK;
 }
 
+// --- Application jitter probe ---
+// Stands in for real-time application work: wakes up every JITTER_PERIOD_MS on core 1 (if the chip has one)
+// and records how late each wakeup is. GET /jitter.json returns and resets the statistics, so
+// tools/probe_storm.py --jitter-path /jitter.json can compare portal latency and application jitter
+// for different task placements (wifi_set_task_placement()).
+#define JITTER_PERIOD_MS 10
+#define JITTER_TASK_PRIORITY 10
+#define JITTER_LATE_US 1000     // Wakeups later than this are counted as late
+
+static portMUX_TYPE jitter_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t jitter_cycles = 0;
+static uint32_t jitter_late = 0;
+static uint32_t jitter_max_us = 0;
+static uint64_t jitter_sum_us = 0;
+
+static void jitter_task(void *arg)
+{
+    TickType_t last_wake = xTaskGetTickCount();
+    int64_t expected = esp_timer_get_time();
+    while (1) {
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(JITTER_PERIOD_MS));
+        expected += JITTER_PERIOD_MS * 1000;
+        int64_t now = esp_timer_get_time();
+        uint32_t lateness = now > expected ? (uint32_t)(now - expected) : 0;
+        if (lateness > JITTER_PERIOD_MS * 1000) {
+            expected = now; // Missed whole periods, resynchronize instead of counting them forever
+        }
+        taskENTER_CRITICAL(&jitter_lock);
+        jitter_cycles++;
+        jitter_sum_us += lateness;
+        if (lateness > jitter_max_us) jitter_max_us = lateness;
+        if (lateness > JITTER_LATE_US) jitter_late++;
+        taskEXIT_CRITICAL(&jitter_lock);
+    }
+}
+
+esp_err_t jitter_json_handler(httpd_req_t *req) {
+    taskENTER_CRITICAL(&jitter_lock);
+    uint32_t cycles = jitter_cycles, late = jitter_late, max_us = jitter_max_us;
+    uint64_t sum_us = jitter_sum_us;
+    jitter_cycles = jitter_late = jitter_max_us = 0;
+    jitter_sum_us = 0;
+    taskEXIT_CRITICAL(&jitter_lock);
+
+    char json[160];
+    snprintf(json, sizeof(json), "{\"periodMs\": %d, \"cycles\": %lu, \"avgUs\": %lu, \"maxUs\": %lu, \"late\": %lu}",
+             JITTER_PERIOD_MS, (unsigned long)cycles, (unsigned long)(cycles ? sum_us / cycles : 0),
+             (unsigned long)max_us, (unsigned long)late);
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return httpd_resp_send(req, json, strlen(json));
+}
+
+#ifdef CONFIG_WIFI_ASSETS
+// --- Asset lookup benchmark ---
+// GET /assets-bench.json times resolving every file of the flash asset image, and the same paths on the SD card
+// (stat only, no read) when one is mounted.
+#define ASSETS_BENCH_ROUNDS 100
+#define ASSETS_BENCH_SD_ROUNDS 5
+
+esp_err_t assets_bench_handler(httpd_req_t *req) {
+    size_t count = wifi_assets_count();
+    if (count == 0) {
+        httpd_resp_set_status(req, "404 Not Found");
+        return httpd_resp_send(req, "No flash assets", HTTPD_RESP_USE_STRLEN);
+    }
+
+    wifi_asset_t asset, found;
+    int64_t start = esp_timer_get_time();
+    for (int round = 0; round < ASSETS_BENCH_ROUNDS; round++) {
+        for (size_t i = 0; i < count; i++) {
+            wifi_assets_get(i, &asset);
+            wifi_assets_find_uri(asset.path, &found);
+        }
+    }
+    int64_t flash_ns = (esp_timer_get_time() - start) * 1000 / (ASSETS_BENCH_ROUNDS * count);
+
+    start = esp_timer_get_time();
+    for (int round = 0; round < ASSETS_BENCH_ROUNDS; round++) {
+        wifi_assets_find_uri("/no-such-file.txt", &found);
+    }
+    int64_t miss_ns = (esp_timer_get_time() - start) * 1000 / ASSETS_BENCH_ROUNDS;
+
+    int64_t sd_ns = -1;
+    char *path = wifi_arena_alloc(req, 300);
+    struct stat st;
+    if (path != NULL && stat("/sdcard", &st) == 0) {
+        start = esp_timer_get_time();
+        for (int round = 0; round < ASSETS_BENCH_SD_ROUNDS; round++) {
+            for (size_t i = 0; i < count; i++) {
+                wifi_assets_get(i, &asset);
+                snprintf(path, 300, "/sdcard%s", asset.path);
+                stat(path, &st);
+            }
+        }
+        sd_ns = (esp_timer_get_time() - start) * 1000 / (ASSETS_BENCH_SD_ROUNDS * count);
+    }
+
+    char json[160];
+    snprintf(json, sizeof(json), "{\"assets\": %u, \"flashLookupNs\": %lli, \"flashMissNs\": %lli, \"sdStatNs\": %lli}",
+             (unsigned)count, flash_ns, miss_ns, sd_ns);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, strlen(json));
+}
+#endif
+
+#ifdef CONFIG_WIFI_SDLOG
+// --- SD card log statistics ---
+// GET /sdlog.json; writeAmplification is bytes written to the card per record byte x100
+esp_err_t sdlog_json_handler(httpd_req_t *req) {
+    wifi_sdlog_stats_t stats;
+    wifi_sdlog_get_stats(&stats);
+    char json[256];
+    snprintf(json, sizeof(json), "{\"records\": %lu, \"dropped\": %lu, \"bytesWritten\": %llu, \"cardBytes\": %llu, "
+             "\"writeAmplification\": %lu, \"syncs\": %lu, \"rotations\": %lu, \"writeErrors\": %lu, \"queueHighWater\": %u, \"queueSlots\": %u}",
+             (unsigned long)stats.records, (unsigned long)stats.dropped, stats.bytes_written, stats.card_bytes,
+             (unsigned long)stats.write_amplification_x100, (unsigned long)stats.syncs, (unsigned long)stats.rotations,
+             (unsigned long)stats.write_errors, stats.queue_high_water, stats.queue_slots);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, strlen(json));
+}
+#endif
+
+// --- Multipart parser benchmark ---
+// POST /multipart-bench?mode=stream parses a multipart/form-data upload with wifi_multipart_feed() while it arrives,
+// in WIFI_MULTIPART_RECV_SIZE pieces. mode=buffer first receives the whole body into one heap buffer and parses it
+// afterwards, like a hand-rolled handler would. tools/multipart_bench.py sends the same body in both modes.
+typedef struct {
+    uint32_t parts;
+    uint32_t data_bytes;
+    uint32_t sum;       // Sum of all data bytes, compared by the tool
+} multipart_bench_t;
+
+static esp_err_t bench_part_cb(const wifi_multipart_part_t *part, void *ctx) {
+    ((multipart_bench_t *)ctx)->parts++;
+    return ESP_OK;
+}
+
+static esp_err_t bench_data_cb(const wifi_multipart_part_t *part, const char *data, size_t len, void *ctx) {
+    multipart_bench_t *bench = ctx;
+    bench->data_bytes += len;
+    for (size_t i = 0; i < len; i++) {
+        bench->sum += (uint8_t)data[i];
+    }
+    return ESP_OK;
+}
+
+esp_err_t multipart_bench_handler(httpd_req_t *req) {
+    char query[32], mode[8] = "stream";
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        httpd_query_key_value(query, "mode", mode, sizeof(mode));
+    }
+    bool buffered = strcmp(mode, "buffer") == 0;
+    char content_type[128];
+    if (httpd_req_get_hdr_value_str(req, "Content-Type", content_type, sizeof(content_type)) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "No Content-Type");
+    }
+
+    static const wifi_multipart_callbacks_t callbacks = { .on_part = bench_part_cb, .on_data = bench_data_cb };
+    multipart_bench_t bench = { 0 };
+    wifi_multipart_t *mp = wifi_arena_alloc(req, sizeof(*mp));
+    size_t buf_size = buffered ? req->content_len : WIFI_MULTIPART_RECV_SIZE;
+    char *buf = buffered ? malloc(buf_size ? buf_size : 1) : wifi_arena_alloc(req, buf_size);
+    if (mp == NULL || buf == NULL) {
+        if (buffered) free(buf);
+        httpd_resp_set_status(req, "413 Payload Too Large");
+        return httpd_resp_send(req, "Not enough memory for the body", HTTPD_RESP_USE_STRLEN);
+    }
+    esp_err_t err = wifi_multipart_init(mp, content_type, &callbacks, &bench);
+
+    int64_t start = esp_timer_get_time();
+    int64_t parse_us = 0;
+    size_t received = 0;
+    int timeouts = 0;
+    while (err == ESP_OK && received < req->content_len) {
+        char *dst = buffered ? buf + received : buf;
+        size_t want = req->content_len - received;
+        if (want > buf_size) want = buf_size;
+        int ret = httpd_req_recv(req, dst, want);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < 3) continue;
+        if (ret <= 0) {
+            err = ESP_FAIL;
+            break;
+        }
+        timeouts = 0;
+        received += ret;
+        if (!buffered) {
+            int64_t t = esp_timer_get_time();
+            err = wifi_multipart_feed(mp, buf, ret);
+            parse_us += esp_timer_get_time() - t;
+        }
+    }
+    if (buffered && err == ESP_OK) {
+        int64_t t = esp_timer_get_time();
+        err = wifi_multipart_feed(mp, buf, received);
+        parse_us += esp_timer_get_time() - t;
+    }
+    if (err == ESP_OK) {
+        err = wifi_multipart_finish(mp);
+    }
+    int64_t total_us = esp_timer_get_time() - start;
+    if (buffered) free(buf);
+    if (err == ESP_FAIL) {
+        return ESP_FAIL;    // Connection lost
+    }
+    if (err != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid multipart body");
+    }
+
+    char json[256];
+    snprintf(json, sizeof(json), "{\"mode\": \"%s\", \"bytes\": %u, \"parts\": %lu, \"dataBytes\": %lu, \"sum\": %lu, "
+             "\"totalMs\": %lld, \"parseUs\": %lld, \"parseKBps\": %lld, \"bufferBytes\": %u}",
+             buffered ? "buffer" : "stream", (unsigned)received, (unsigned long)bench.parts,
+             (unsigned long)bench.data_bytes, (unsigned long)bench.sum, total_us / 1000, parse_us,
+             parse_us > 0 ? (int64_t)received * 1000000 / 1024 / parse_us : 0,
+             (unsigned)(buf_size + sizeof(*mp)));
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, strlen(json));
+}
+
 // --- Define functions ---
 esp_err_t status_json_handler(httpd_req_t *req) {
-    char json[300];
+    const size_t json_size = 384;
+    char *json = wifi_arena_alloc(req, json_size);     // Released automatically when the handler returns
+    if (json == NULL) {
+        return httpd_resp_send_500(req);
+    }
     int free_heap = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
     int total_heap = heap_caps_get_total_size(MALLOC_CAP_DEFAULT);
-    snprintf(json, sizeof(json), "{\"uptime\": %lli, \"freeHeap\": %d, \"totalHeap\": %d, \"version\": \"%s\"}",
-             (esp_timer_get_time() - bootTime) / 1000, free_heap, total_heap, "EXAMPLE");
+    int min_free_heap = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+    int largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT);
+    wifi_ws_rx_stats_t ws_stats;
+    wifi_ws_rx_get_stats(&ws_stats);
+    wifi_arena_stats_t arena_stats;
+    wifi_arena_get_stats(&arena_stats);
+    // largestFreeBlock / freeHeap close to 1 means an unfragmented heap; watch both over a long soak
+    snprintf(json, json_size, "{\"uptime\": %lli, \"freeHeap\": %d, \"totalHeap\": %d, \"minFreeHeap\": %d, \"largestFreeBlock\": %d, "
+             "\"wsFrames\": %lu, \"wsPoolExhausted\": %lu, \"arenaHighWater\": %lu, \"arenaFailures\": %lu, \"version\": \"%s\"}",
+             (esp_timer_get_time() - bootTime) / 1000, free_heap, total_heap, min_free_heap, largest_block,
+             (unsigned long)ws_stats.frames, (unsigned long)ws_stats.exhausted,
+             (unsigned long)arena_stats.high_water, (unsigned long)arena_stats.failures, "EXAMPLE");
     ESP_LOGD(TAG, "JSON data requested: %s", json);
     httpd_resp_set_type(req, "application/json");
     return httpd_resp_send(req, json, strlen(json));
 }
 
-esp_err_t control_post_handler(httpd_req_t *req) {
-    char buf[100];
-    int len = httpd_req_recv(req, buf, sizeof(buf) - 1);
-    if (len <= 0) {
-        return ESP_FAIL;
+#ifdef CONFIG_WIFI_SSI
+// <!--#var slider --> in control.html, the value last set through /control or the WebSocket
+static void slider_ssi_var(char *buf, size_t size, void *ctx) {
+    snprintf(buf, size, "%d", sliderJSONValue);
+}
+#endif
+
+// Apply one decoded field of the /control form
+static void control_apply(const char *key, const char *value) {
+    if (strcmp(key, "slider") == 0) {
+        sliderJSONValue = (uint8_t)atoi(value);
+        ESP_LOGI(TAG, "JSON slider updated to %d", sliderJSONValue);
+    } else if (strcmp(key, "text") == 0) {
+        ESP_LOGI(TAG, "Text value is %s", value);
+    } else if (strcmp(key, "number") == 0) {
+        int numberValue = (uint8_t)atoi(value);
+        ESP_LOGI(TAG, "Number value is %d", numberValue);
     }
-    buf[len] = 0; // Null-terminate the received data
+}
 
-    ESP_LOGI(TAG, "Received control data: %s", buf);
+// Field of a multipart/form-data /control form being received
+typedef struct {
+    char value[32];
+    size_t len;
+} control_part_t;
 
+static esp_err_t control_part_cb(const wifi_multipart_part_t *part, void *ctx) {
+    ((control_part_t *)ctx)->len = 0;
+    return ESP_OK;
+}
 
-    if (len > 0) {
-        buf[len] = '\0';
-        // Parse key-value pairs
-        char param[32];
-        if (httpd_query_key_value(buf, "slider", param, sizeof(param)) == ESP_OK) {
-            url_decode(param);
-            sliderJSONValue = (uint8_t)atoi(param);
-            ESP_LOGI(TAG, "JSON slider updated to %d", sliderJSONValue);
+static esp_err_t control_data_cb(const wifi_multipart_part_t *part, const char *data, size_t len, void *ctx) {
+    control_part_t *field = ctx;
+    size_t room = sizeof(field->value) - 1 - field->len;
+    if (len > room) len = room;     // Longer values are truncated
+    memcpy(field->value + field->len, data, len);
+    field->len += len;
+    return ESP_OK;
+}
+
+static esp_err_t control_part_end_cb(const wifi_multipart_part_t *part, void *ctx) {
+    control_part_t *field = ctx;
+    field->value[field->len] = '\0';
+    control_apply(part->name, field->value);
+    return ESP_OK;
+}
+
+esp_err_t control_post_handler(httpd_req_t *req) {
+    char content_type[64] = "";
+    httpd_req_get_hdr_value_str(req, "Content-Type", content_type, sizeof(content_type));
+    if (strncmp(content_type, "multipart/form-data", 19) == 0) {
+        // Forms with enctype="multipart/form-data", parsed while they arrive
+        static const wifi_multipart_callbacks_t callbacks = {
+            .on_part = control_part_cb,
+            .on_data = control_data_cb,
+            .on_part_end = control_part_end_cb,
+        };
+        control_part_t field;
+        esp_err_t err = wifi_multipart_recv(req, &callbacks, &field);
+        if (err == ESP_FAIL) {
+            return ESP_FAIL;
+        }
+        if (err != ESP_OK) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid form data");
+        }
+    } else {
+        const size_t buf_size = 256;
+        char *buf = wifi_arena_alloc(req, buf_size);
+        if (buf == NULL) {
+            return httpd_resp_send_500(req);
         }
-        if (httpd_query_key_value(buf, "text", param, sizeof(param)) == ESP_OK) {
-            url_decode(param);
-            ESP_LOGI(TAG, "Text value is %s", param);
+        if (req->content_len >= buf_size) {
+            return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Form too large");
         }
-        if (httpd_query_key_value(buf, "number", param, sizeof(param)) == ESP_OK) {
-            url_decode(param);
-            int numberValue = (uint8_t)atoi(param);
-            ESP_LOGI(TAG, "Number value is %d", numberValue);
+        // httpd_req_recv may return less than requested, read until the whole body is in
+        int len = 0;
+        while (len < (int)req->content_len) {
+            int ret = httpd_req_recv(req, buf + len, req->content_len - len);
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) continue;
+            if (ret <= 0) {
+                return ESP_FAIL;
+            }
+            len += ret;
+        }
+        buf[len] = 0;
+
+        ESP_LOGI(TAG, "Received control data: %s", buf);
+#ifdef CONFIG_WIFI_SDLOG
+        wifi_sdlog_printf("%lld control %s\n", esp_timer_get_time() / 1000, buf);
+#endif
+
+        // Parse key-value pairs
+        char param[32];
+        static const char *const keys[] = { "slider", "text", "number" };
+        for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+            if (httpd_query_key_value(buf, keys[i], param, sizeof(param)) == ESP_OK) {
+                url_decode(param);
+                control_apply(keys[i], param);
+            }
         }
     }
 
@@ -121,27 +457,16 @@ esp_err_t control_post_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
-esp_err_t ws_handler(httpd_req_t *req) {
-    if (req->method == HTTP_GET) {
-        // Upgrade to WebSocket
+// WebSocket frame callback, the payload lives in a pooled buffer and is NUL-terminated
+static esp_err_t ws_frame_cb(httpd_req_t *req, httpd_ws_frame_t *frame, void *ctx)
+{
+    if (frame->type == HTTPD_WS_TYPE_CLOSE) {
+        ESP_LOGI(TAG, "WebSocket connection closed");
         return ESP_OK;
     }
 
-    httpd_ws_frame_t ws_pkt;
-    memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
-    ws_pkt.payload = NULL;
-
-    // First, get frame metadata
-    ESP_RETURN_ON_ERROR(httpd_ws_recv_frame(req, &ws_pkt, 0), TAG, "Failed to receive WebSocket frame");
-
-    if (ws_pkt.type == HTTPD_WS_TYPE_BINARY && ws_pkt.len == 1) {
-        ws_pkt.payload = malloc(1);
-        esp_err_t ret = httpd_ws_recv_frame(req, &ws_pkt, 1);
-        if (ret != ESP_OK) {
-            free(ws_pkt.payload);
-            ESP_RETURN_ON_ERROR(ret, TAG, "Failed to receive ws event packet");
-        }
-        uint8_t event_id = ((uint8_t*)ws_pkt.payload)[0];
+    if (frame->type == HTTPD_WS_TYPE_BINARY && frame->len == 1) {
+        uint8_t event_id = frame->payload[0];
         switch (event_id) {
             case EVENT_TIMEOUT:
                 ESP_LOGV(TAG, "WebSocket timeout event received");
@@ -162,58 +487,47 @@ esp_err_t ws_handler(httpd_req_t *req) {
             default:
                 ESP_LOGW(TAG, "Unknown event id: 0x%2X", event_id);
         }
-        free(ws_pkt.payload);
         return ESP_OK;
     }
 
-    // Check if this is a binary control packet with a numerical value
-    if (ws_pkt.type == HTTPD_WS_TYPE_BINARY && ws_pkt.len == sizeof(ws_control_packet_t)) {
-        ws_pkt.payload = malloc(ws_pkt.len);
-        esp_err_t ret = httpd_ws_recv_frame(req, &ws_pkt, ws_pkt.len);
+    // Batched value-sync frame (see wifi_ws_sync.h)
+    if (frame->type == HTTPD_WS_TYPE_BINARY && wifi_ws_sync_is_frame(frame->payload, frame->len)) {
+        esp_err_t ret = wifi_ws_sync_decode(frame->payload, frame->len, ws_sync_value_cb, NULL);
         if (ret != ESP_OK) {
-            free(ws_pkt.payload);
-            ESP_RETURN_ON_ERROR(ret, TAG, "Failed to receive ws control packet");
+            ESP_LOGW(TAG, "Invalid ws sync frame: %s", esp_err_to_name(ret));
         }
-        ws_control_packet_t *packet = (ws_control_packet_t *)ws_pkt.payload;
-        switch(packet->type) {
+        return ESP_OK;
+    }
+
+    // Check if this is a binary control packet with a numerical value
+    if (frame->type == HTTPD_WS_TYPE_BINARY && frame->len == sizeof(ws_control_packet_t)) {
+        ws_control_packet_t packet;
+        memcpy(&packet, frame->payload, sizeof(packet));
+        switch(packet.type) {
             case SLIDER_BINARY:
-                sliderBinaryValue = (uint8_t)(packet->value & 0xFF);
+                sliderBinaryValue = (uint8_t)(packet.value & 0xFF);
                 ESP_LOGI(TAG, "Binary slider updated to %d", sliderBinaryValue);
                 break;
             case SLIDER_JSON:
                 ESP_LOGW(TAG, "JSON slider is not supposed to be handled in binary packets");
                 break;
             default:
-                ESP_LOGW(TAG, "Unknown packet type: 0x%2X, value: 0x%4X", packet->type, packet->value);
+                ESP_LOGW(TAG, "Unknown packet type: 0x%2X, value: 0x%4X", packet.type, packet.value);
                 break;
         }
-        free(ws_pkt.payload);
         return ESP_OK;
     }
 
-    // Handle WS packets
-    if (ws_pkt.type == HTTPD_WS_TYPE_CLOSE) {
-        ESP_LOGI(TAG, "WebSocket connection closed");
-        free(ws_pkt.payload);
+    if (frame->type != HTTPD_WS_TYPE_TEXT || frame->payload == NULL) {
+        ESP_LOGW(TAG, "Unhandled WebSocket frame, type: %d, len: %u", frame->type, (unsigned)frame->len);
         return ESP_OK;
     }
 
-    // Fallback for other messages, null terminate payload
-    ws_pkt.payload = calloc(1, ws_pkt.len + 1);
-    if (!ws_pkt.payload) return ESP_ERR_NO_MEM;
-    ws_pkt.payload[ws_pkt.len] = 0;
-
-    esp_err_t ret = httpd_ws_recv_frame(req, &ws_pkt, ws_pkt.len);
-    if (ret != ESP_OK) {
-        free(ws_pkt.payload);
-        ESP_RETURN_ON_ERROR(ret, TAG, "Failed to receive ws packet");
-    }
-
-    ESP_LOGD(TAG, "Received WebSocket text payload: %s", (char*)ws_pkt.payload);
+    ESP_LOGD(TAG, "Received WebSocket text payload: %s", (char*)frame->payload);
 
     // Try to parse as JSON
     // Basic JSON parsing for {"slider": number}
-    char *sliderPtr = strstr((char*)ws_pkt.payload, "\"slider\":");
+    char *sliderPtr = strstr((char*)frame->payload, "\"slider\":");
     if (sliderPtr != NULL) {
         char *start = strchr(sliderPtr, ':'); // Skip to colon
         if (start) {
@@ -224,18 +538,26 @@ esp_err_t ws_handler(httpd_req_t *req) {
             // Parse the number
             int value = atoi(start);
             sliderJSONValue = value & 0x3FF; // Clamp to 10 bits (0-1023)
+            wifi_ws_sync_set_int(SLIDER_JSON, sliderJSONValue); // Keep other dashboards in sync
             ESP_LOGI(TAG, "JSON slider updated to %d", sliderJSONValue);
-            free(ws_pkt.payload);
             return ESP_OK;
         }
     }
 
-    ESP_LOGI(TAG, "Received WebSocket text: %s", (char*)ws_pkt.payload);
-
-    free(ws_pkt.payload);
+    ESP_LOGI(TAG, "Received WebSocket text: %s", (char*)frame->payload);
     return ESP_OK;
 }
 
+esp_err_t ws_handler(httpd_req_t *req) {
+    if (req->method == HTTP_GET) {
+        // Upgrade to WebSocket
+        return ESP_OK;
+    }
+
+    // Receive into a pooled buffer, no heap allocation per frame
+    return wifi_ws_recv(req, ws_frame_cb, NULL);
+}
+
 
 void app_main(void)
 {
@@ -255,9 +577,20 @@ void app_main(void)
     ESP_ERROR_CHECK(gpio_config(&v_bus_config));
     ESP_ERROR_CHECK(gpio_set_level(47, 1));
 
-   
+    // Keep the portal tasks on core 0, away from the application's real-time work on core 1
+    if (portNUM_PROCESSORS > 1) {
+        wifi_set_task_placement(WIFI_TASK_LISTENER, 0, 4);
+        wifi_set_task_placement(WIFI_TASK_DNS, 0, 5);
+        wifi_set_task_placement(WIFI_TASK_HTTPD, 0, 5);
+    }
+    xTaskCreatePinnedToCore(jitter_task, "jitter", 2048, NULL, JITTER_TASK_PRIORITY, NULL, portNUM_PROCESSORS > 1 ? 1 : 0);
+
     wifi_init();
 
+#ifdef CONFIG_WIFI_SSI
+    wifi_ssi_register_var("slider", slider_ssi_var, NULL);
+#endif
+
     httpd_uri_t status_json_uri = {
         .uri = "/status.json",
         .method = HTTP_GET,
@@ -265,6 +598,31 @@ void app_main(void)
     };
     wifi_register_http_handler(&status_json_uri);
 
+    httpd_uri_t jitter_json_uri = {
+        .uri = "/jitter.json",
+        .method = HTTP_GET,
+        .handler = jitter_json_handler
+    };
+    wifi_register_http_handler(&jitter_json_uri);
+
+#ifdef CONFIG_WIFI_ASSETS
+    httpd_uri_t assets_bench_uri = {
+        .uri = "/assets-bench.json",
+        .method = HTTP_GET,
+        .handler = assets_bench_handler
+    };
+    wifi_register_http_handler(&assets_bench_uri);
+#endif
+
+#ifdef CONFIG_WIFI_SDLOG
+    httpd_uri_t sdlog_json_uri = {
+        .uri = "/sdlog.json",
+        .method = HTTP_GET,
+        .handler = sdlog_json_handler
+    };
+    wifi_register_http_handler(&sdlog_json_uri);
+#endif
+
     httpd_uri_t control_post_uri = {
         .uri = "/control",
         .method = HTTP_POST,
@@ -272,6 +630,13 @@ void app_main(void)
     };
     wifi_register_http_handler(&control_post_uri);
 
+    httpd_uri_t multipart_bench_uri = {
+        .uri = "/multipart-bench",
+        .method = HTTP_POST,
+        .handler = multipart_bench_handler
+    };
+    wifi_register_http_handler(&multipart_bench_uri);
+
     httpd_uri_t ws_uri = {
         .uri = "/ws",
         .method = HTTP_GET,
@@ -100,9 +100,12 @@ function updateFooter() {
     });
 }
 
-fetch("/nav.html")
-    .then(response => response.text())
-    .then(html => document.getElementById("nav").innerHTML = html);
+// Pages from the SD card have the navigation included already, flash assets are not expanded
+if (!document.querySelector("#nav nav")) {
+    fetch("/nav.html")
+        .then(response => response.text())
+        .then(html => document.getElementById("nav").innerHTML = html);
+}
 
 setInterval(updateFooter, 5000); // Update every 5 seconds
 updateFooter();
\ No newline at end of file
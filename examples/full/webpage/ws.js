@@ -12,6 +12,24 @@ const WS_value = {
     SLIDER_JSON: 2
 }
 
+// Batched value-sync protocol, must match include/wifi_ws_sync.h
+const WS_sync = {
+    MAGIC: 0xB5,
+    VERSION: 1,
+    HEADER_LEN: 6,
+    FLAG_DELTA: 0x01,
+    FLAG_RESYNC: 0x02,
+    TYPE_INT: 0,
+    TYPE_FLOAT: 1,
+    TICK_MS: 50         // Coalescing interval for outgoing values
+}
+
+let wsSyncPending = new Map();  // key -> {type, value}, latest value per key waiting for the next tick
+let wsSyncTimer = null;
+let wsSyncTxSeq = 0;
+let wsSyncRxSeq = null;         // Expected sequence number of the next incoming frame, null until a keyframe arrives
+let wsSyncValues = new Map();   // key -> last received integer value, base for delta frames
+
 let ws = {}
 function setupWebSocket() {
     if (ws && ws.readyState === WebSocket.OPEN) {
@@ -23,6 +41,7 @@ function setupWebSocket() {
     ws.onopen = () => {
         console.log('WebSocket connected');
         message('info', 'WebSocket connected', 3000);
+        wsSyncResync();
     };
     ws.onmessage = async (event) => {
         try {
@@ -32,7 +51,10 @@ function setupWebSocket() {
                 const view = new DataView(buffer);
 
                 // Detect message type based on size
-                if (view.byteLength === 1) {
+                if (view.byteLength >= WS_sync.HEADER_LEN && view.getUint8(0) === WS_sync.MAGIC) {
+                    // Batched value-sync frame
+                    wsSyncDecode(view);
+                } else if (view.byteLength === 1) {
                     // Event message (1 byte header only)
                     const eventType = view.getUint8(0);
                     console.log('Event received:', eventType);
@@ -66,6 +88,7 @@ function setupWebSocket() {
         message('error', 'WebSocket error: ' + error, 5000); 
     };
     ws.onclose = () => {
+        wsSyncRxSeq = null;
         console.log('WebSocket closed'); 
         message('warn', 'WebSocket closed', 5000);
         setTimeout(setupWebSocket, 10000);
@@ -98,6 +121,110 @@ function sendWSEvent(eventType) {
     }
 }
 
+// Queue a value for the next value-sync frame, only the latest value per key is sent
+function sendWSSync(key, value, type = WS_sync.TYPE_INT) {
+    wsSyncPending.set(key, { type, value: Number(value) });
+    if (wsSyncTimer === null) {
+        wsSyncTimer = setTimeout(() => wsSyncFlush(), WS_sync.TICK_MS);
+    }
+}
+
+function wsSyncFlush(flags = 0) {
+    if (wsSyncTimer !== null) {
+        clearTimeout(wsSyncTimer);
+        wsSyncTimer = null;
+    }
+    if (wsSyncPending.size === 0 && flags === 0) {
+        return;
+    }
+    if (ws.readyState !== WebSocket.OPEN) {
+        console.warn('WebSocket not open, sync values kept for later: ', wsSyncPending);
+        return;
+    }
+    // Header + worst case of 7 bytes per entry (key, type, up to 5-byte varint)
+    const buffer = new ArrayBuffer(WS_sync.HEADER_LEN + wsSyncPending.size * 7);
+    const view = new DataView(buffer);
+    let pos = WS_sync.HEADER_LEN;
+    for (const [key, entry] of wsSyncPending) {
+        view.setUint8(pos++, key);
+        view.setUint8(pos++, entry.type);
+        if (entry.type === WS_sync.TYPE_FLOAT) {
+            view.setFloat32(pos, entry.value, true);
+            pos += 4;
+        } else {
+            // zigzag LEB128 varint
+            let zz = ((entry.value << 1) ^ (entry.value >> 31)) >>> 0;
+            while (zz >= 0x80) {
+                view.setUint8(pos++, (zz & 0x7F) | 0x80);
+                zz >>>= 7;
+            }
+            view.setUint8(pos++, zz);
+        }
+    }
+    view.setUint8(0, WS_sync.MAGIC);
+    view.setUint8(1, WS_sync.VERSION);
+    view.setUint16(2, wsSyncTxSeq, true);
+    view.setUint8(4, wsSyncPending.size);
+    view.setUint8(5, flags);
+    wsSyncTxSeq = (wsSyncTxSeq + 1) & 0xFFFF;
+    wsSyncPending.clear();
+    ws.send(buffer.slice(0, pos));
+}
+
+// Ask the server for a full keyframe (on connect and after a lost frame)
+function wsSyncResync() {
+    wsSyncRxSeq = null;
+    wsSyncFlush(WS_sync.FLAG_RESYNC);
+}
+
+function wsSyncDecode(view) {
+    if (view.getUint8(1) !== WS_sync.VERSION) {
+        console.warn('Unsupported sync version:', view.getUint8(1));
+        return;
+    }
+    const seq = view.getUint16(2, true);
+    const count = view.getUint8(4);
+    const delta = (view.getUint8(5) & WS_sync.FLAG_DELTA) !== 0;
+    if (delta && wsSyncRxSeq !== seq) {
+        // No keyframe yet or a frame was lost, delta base is unknown
+        if (wsSyncRxSeq !== null) {
+            console.warn('Sync sequence gap, expected', wsSyncRxSeq, 'got', seq);
+            wsSyncResync();
+        }
+        return;
+    }
+    wsSyncRxSeq = (seq + 1) & 0xFFFF;
+
+    let pos = WS_sync.HEADER_LEN;
+    for (let i = 0; i < count; i++) {
+        const key = view.getUint8(pos++);
+        const type = view.getUint8(pos++);
+        let value;
+        if (type === WS_sync.TYPE_FLOAT) {
+            value = view.getFloat32(pos, true);
+            pos += 4;
+        } else {
+            let zz = 0;
+            let shift = 0;
+            let b;
+            do {
+                b = view.getUint8(pos++);
+                zz |= (b & 0x7F) << shift;
+                shift += 7;
+            } while (b & 0x80);
+            value = (zz >>> 1) ^ -(zz & 1);
+            if (delta) {
+                value = ((wsSyncValues.get(key) || 0) + value) | 0;
+            }
+            wsSyncValues.set(key, value);
+        }
+        console.log('Sync value received:', { key, value });
+        if (window.handleWSBinaryData) {
+            window.handleWSBinaryData(key, value);
+        }
+    }
+}
+
 function sendWSMessage(msg) {
     console.log('Sending message ', msg);
     if (ws.readyState === WebSocket.OPEN) {
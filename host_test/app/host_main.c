@@ -0,0 +1,110 @@
+/**
+ * @file host_main.c
+ * @brief The component on the host: the web server for curl and load tools.
+ *
+ *   wifi_host serve [--port N] [--dns-port-offset N] [--sta SSID PASSWORD]
+ *   wifi_host replay TRACE [--json] [--verbose]
+ *
+ * serve runs wifi_init() like app_main() does and keeps the portal up until
+ * interrupted. Without --sta there are no credentials, so the captive portal
+ * starts; with --sta the network is put on the simulated air and the
+ * component connects to it. The HTTP server listens on --port (8080 by
+ * default, 0 for any free port), the DNS server on 53 + --dns-port-offset
+ * (default 5300). /ws echoes WebSocket frames back, for the WebSocket
+ * modes of the load tools.
+ *
+ * replay runs a trace recorded on a device through the component in virtual
+ * time, see host_replay.c.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Wifi.h"
+#include "fake_host.h"
+#include "host_replay.h"
+#include "host_support.h"
+#include "wifi_ws_rx.h"
+
+static void usage(void) {
+    fprintf(stderr, "usage: wifi_host serve [--port N] [--dns-port-offset N] [--sta SSID PASSWORD]\n"
+                    "       wifi_host replay TRACE [--json] [--verbose]\n");
+    exit(2);
+}
+
+static esp_err_t ws_echo_frame(httpd_req_t *req, httpd_ws_frame_t *frame, void *ctx) {
+    if (frame->type != HTTPD_WS_TYPE_TEXT && frame->type != HTTPD_WS_TYPE_BINARY) return ESP_OK;
+    return httpd_ws_send_frame(req, frame);
+}
+
+static esp_err_t ws_echo_handler(httpd_req_t *req) {
+    if (req->method == HTTP_GET) return ESP_OK;     // Upgrade
+    return wifi_ws_recv(req, ws_echo_frame, NULL);
+}
+
+static int cmd_serve(int argc, char **argv) {
+    int port = 8080;
+    int dns_offset = 5300;
+    const char *sta_ssid = NULL;
+    const char *sta_password = NULL;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--dns-port-offset") == 0 && i + 1 < argc) {
+            dns_offset = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sta") == 0 && i + 2 < argc) {
+            sta_ssid = argv[++i];
+            sta_password = argv[++i];
+        } else {
+            usage();
+        }
+    }
+
+    // Block the signals before any task starts so they all inherit the mask and sigwait() gets them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    fake_httpd_set_port((uint16_t)port);
+    fake_lwip_set_port_offset((uint16_t)dns_offset);
+    if (!host_add_assets()) {
+        fprintf(stderr, "No asset image, serving without flash assets\n");
+    }
+    if (sta_ssid) {
+        host_add_network(sta_ssid, sta_password);
+        host_preset_sta(sta_ssid, sta_password);
+    }
+    // Before wifi_init(), so the wildcard handler does not shadow it
+    static httpd_uri_t ws_uri = {
+        .uri = "/ws", .method = HTTP_GET, .handler = ws_echo_handler, .is_websocket = true,
+    };
+    ESP_ERROR_CHECK(wifi_register_http_handler(&ws_uri));
+    ESP_ERROR_CHECK(wifi_init());
+
+    for (int waited = 0; fake_httpd_bound_port() == 0; waited++) {
+        if (waited == 5000) {
+            fprintf(stderr, "HTTP server did not start\n");
+            return 1;
+        }
+        usleep(1000);
+    }
+    printf("Serving on http://127.0.0.1:%u/ (DNS on port %u)\n", fake_httpd_bound_port(), 53 + dns_offset);
+    fflush(stdout);
+
+    int sig;
+    sigwait(&signals, &sig);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) usage();
+    if (strcmp(argv[1], "serve") == 0) return cmd_serve(argc - 2, argv + 2);
+    if (strcmp(argv[1], "replay") == 0) return host_replay_main(argc - 2, argv + 2);
+    usage();
+    return 2;
+}
@@ -0,0 +1,597 @@
+/**
+ * @file host_replay.c
+ * @brief wifi_host replay: a recorded WiFi trace run through the component's real mode-switch logic.
+ *
+ *   wifi_host replay TRACE [--json] [--verbose]
+ *
+ * The trace (GET /wifi-trace.bin, see wifi_trace.h) is replayed in virtual
+ * time against wifi_init(), wifi_event_handler and the listener task of this
+ * build: the driver runs scripted, every recorded WiFi and IP event is
+ * injected at its recorded time, and what the component does in response
+ * (connect calls, mode switches, reconnects) is observed rather than modelled.
+ * Events the driver raises by itself are not injected: START and STOP, and
+ * the STA_DISCONNECTED with reason ASSOC_LEAVE that esp_wifi_disconnect() and
+ * esp_wifi_stop() produce while connected. Mode switches that only a user
+ * requests (SWITCH_STA, SWITCH_AP, RECONNECT) are requested again at their
+ * recorded time by posting the settings form to /captive, with the STA SSID
+ * alternating so the change always applies; the other recorded actions are
+ * left to the component.
+ *
+ * The report has the time spent in each state, every transition with its
+ * cause, and the divergences from the recording: recorded events the driver
+ * could not raise any more because the component took another path (a
+ * station event after the component switched to AP mode), and mode switches
+ * done at another time or not at all. Build with another
+ * WIFI_HOST_MAX_RECONNECTS to see how a different CONFIG_WIFI_MAX_RECONNECTS
+ * would have behaved on the recording.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Wifi.h"
+#include "esp_log.h"
+#include "fake_host.h"
+#include "host_replay.h"
+#include "host_support.h"
+#include "wifi_trace.h"
+
+#define TRACE_HEADER_SIZE 16
+#define MAX_OBSERVATIONS 4096
+#define MAX_STATES 16
+#define REPLAY_SSID "replay"
+#define REPLAY_PASSWORD "replay-password"
+
+/// Something the component or the driver did during the replay
+typedef enum {
+    OBS_ACTION,         ///< Listener task action, id is a wifi_trace_action_t
+    OBS_EVENT,          ///< Injected event the driver accepted
+    OBS_DROPPED,        ///< Injected event the driver could not raise in its state
+    OBS_CONNECT,        ///< esp_wifi_connect() call
+    OBS_REQUEST_FAILED, ///< Settings form for a recorded action not accepted, id is the action
+} obs_kind_t;
+
+typedef struct {
+    uint32_t t;                 ///< Trace time (ms)
+    obs_kind_t kind;
+    uint8_t source;             ///< wifi_trace_source_t of events
+    uint8_t id;
+    uint16_t reason;            ///< STA_DISCONNECTED reason
+    wifi_mode_t mode;           ///< Driver mode when a dropped event was injected
+    bool started;               ///< Driver started when a dropped event was injected
+} observation_t;
+
+typedef struct {
+    const char *name;
+    uint64_t ms;
+} state_time_t;
+
+typedef struct {
+    uint32_t t;
+    char what[96];
+} divergence_t;
+
+static pthread_mutex_t obs_lock = PTHREAD_MUTEX_INITIALIZER;
+static observation_t observations[MAX_OBSERVATIONS];
+static size_t observation_count;
+static bool replaying;
+static uint32_t trace_t0;
+
+#pragma region Names
+
+static const char *action_name(uint8_t id) {
+    static const char *const names[] = { "BOOT", "SWITCH_STA", "SWITCH_AP", "SWITCH_CAPTIVE", "RECONNECT",
+                                         "MDNS_UPDATE" };
+    return id < sizeof(names) / sizeof(names[0]) ? names[id] : "ACTION_?";
+}
+
+static const char *event_name(uint8_t source, uint8_t id) {
+    if (source == WIFI_TRACE_SOURCE_IP) {
+        switch (id) {
+        case IP_EVENT_STA_GOT_IP: return "STA_GOT_IP";
+        case IP_EVENT_STA_LOST_IP: return "STA_LOST_IP";
+        case IP_EVENT_AP_STAIPASSIGNED: return "AP_STAIPASSIGNED";
+        default: return "IP_EVENT_?";
+        }
+    }
+    switch (id) {
+    case WIFI_EVENT_SCAN_DONE: return "SCAN_DONE";
+    case WIFI_EVENT_STA_START: return "STA_START";
+    case WIFI_EVENT_STA_STOP: return "STA_STOP";
+    case WIFI_EVENT_STA_CONNECTED: return "STA_CONNECTED";
+    case WIFI_EVENT_STA_DISCONNECTED: return "STA_DISCONNECTED";
+    case WIFI_EVENT_AP_START: return "AP_START";
+    case WIFI_EVENT_AP_STOP: return "AP_STOP";
+    case WIFI_EVENT_AP_STACONNECTED: return "AP_STACONNECTED";
+    case WIFI_EVENT_AP_STADISCONNECTED: return "AP_STADISCONNECTED";
+    case WIFI_EVENT_AP_PROBEREQRECVED: return "AP_PROBEREQRECVED";
+    case WIFI_EVENT_STA_BSS_RSSI_LOW: return "STA_BSS_RSSI_LOW";
+    case WIFI_EVENT_STA_BEACON_TIMEOUT: return "STA_BEACON_TIMEOUT";
+    default: return "WIFI_EVENT_?";
+    }
+}
+
+static const char *mode_name(wifi_mode_t mode, bool started) {
+    if (!started) return "stopped";
+    switch (mode) {
+    case WIFI_MODE_STA: return "STA";
+    case WIFI_MODE_AP: return "AP";
+    case WIFI_MODE_APSTA: return "AP+STA";
+    default: return "off";
+    }
+}
+
+#pragma endregion
+
+#pragma region Observation
+
+static uint32_t trace_now(void) {
+    return trace_t0 + (uint32_t)(fake_kernel_now_us() / 1000);
+}
+
+/**
+ * @brief Append an observation at the current trace time.
+ *
+ * @return its index, MAX_OBSERVATIONS when it was not kept
+ */
+static size_t observe(const observation_t *obs) {
+    size_t index = MAX_OBSERVATIONS;
+    pthread_mutex_lock(&obs_lock);
+    if (replaying && observation_count < MAX_OBSERVATIONS) {
+        index = observation_count++;
+        observations[index] = *obs;
+        observations[index].t = trace_now();
+    }
+    pthread_mutex_unlock(&obs_lock);
+    return index;
+}
+
+void __real_wifi_trace_action(wifi_trace_action_t action, uint8_t arg, uint32_t bits, int sta_fails);
+
+/**
+ * @brief Every action of the listener task passes here (linked with --wrap=wifi_trace_action).
+ */
+void __wrap_wifi_trace_action(wifi_trace_action_t action, uint8_t arg, uint32_t bits, int sta_fails) {
+    observe(&(observation_t){ .kind = OBS_ACTION, .id = (uint8_t)action });
+    __real_wifi_trace_action(action, arg, bits, sta_fails);
+}
+
+static void driver_observer(const char *call, const fake_wifi_state_t *state, void *ctx) {
+    if (strcmp(call, "connect") == 0) observe(&(observation_t){ .kind = OBS_CONNECT });
+}
+
+static int discard_log(const char *format, va_list args) {
+    return 0;
+}
+
+#pragma endregion
+
+#pragma region Trace
+
+/**
+ * @brief Read a dump, checking the header against this build's record layout.
+ */
+static wifi_trace_record_t *load_trace(const char *path, size_t *count, uint32_t *uptime_ms) {
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Cannot open %s\n", path);
+        return NULL;
+    }
+    uint8_t header[TRACE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), f) != sizeof(header) || memcmp(header, "WTRC", 4) != 0) {
+        fprintf(stderr, "%s is not a WiFi trace dump\n", path);
+        fclose(f);
+        return NULL;
+    }
+    if (header[4] != WIFI_TRACE_VERSION || header[5] != sizeof(wifi_trace_record_t)) {
+        fprintf(stderr, "Unsupported trace format %u / record size %u, this build reads %u / %u\n", header[4],
+                header[5], WIFI_TRACE_VERSION, (unsigned)sizeof(wifi_trace_record_t));
+        fclose(f);
+        return NULL;
+    }
+    uint16_t declared;
+    memcpy(&declared, &header[6], sizeof(declared));
+    memcpy(uptime_ms, &header[12], sizeof(*uptime_ms));
+    wifi_trace_record_t *records = calloc(declared > 0 ? declared : 1, sizeof(*records));
+    *count = records ? fread(records, sizeof(*records), declared, f) : 0;
+    fclose(f);
+    return records;
+}
+
+/**
+ * @brief Whether the driver raises this event by itself when the component makes the same call.
+ */
+static bool driver_generated(const wifi_trace_record_t *rec) {
+    if (rec->source != WIFI_TRACE_SOURCE_WIFI) return false;
+    switch (rec->id) {
+    case WIFI_EVENT_STA_START:
+    case WIFI_EVENT_STA_STOP:
+    case WIFI_EVENT_AP_START:
+    case WIFI_EVENT_AP_STOP:
+        return true;
+    case WIFI_EVENT_STA_DISCONNECTED: {
+        uint16_t reason;
+        memcpy(&reason, rec->payload, sizeof(reason));
+        return reason == WIFI_REASON_ASSOC_LEAVE;
+    }
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Inject a recorded event with its payload rebuilt from the record.
+ */
+static void inject(const wifi_trace_record_t *rec) {
+    union {
+        wifi_event_sta_connected_t sta_connected;
+        wifi_event_sta_disconnected_t sta_disconnected;
+        wifi_event_ap_staconnected_t ap_staconnected;
+        wifi_event_ap_stadisconnected_t ap_stadisconnected;
+        ip_event_ap_staipassigned_t ap_staipassigned;
+    } data;
+    memset(&data, 0, sizeof(data));
+    size_t size = 0;
+    uint16_t reason = 0;
+    esp_event_base_t base = rec->source == WIFI_TRACE_SOURCE_IP ? IP_EVENT : WIFI_EVENT;
+
+    if (base == WIFI_EVENT && rec->id == WIFI_EVENT_STA_CONNECTED) {
+        memcpy(data.sta_connected.ssid, REPLAY_SSID, strlen(REPLAY_SSID));
+        data.sta_connected.ssid_len = strlen(REPLAY_SSID);
+        data.sta_connected.channel = rec->payload[0];
+        data.sta_connected.authmode = rec->payload[1];
+        size = sizeof(data.sta_connected);
+    } else if (base == WIFI_EVENT && rec->id == WIFI_EVENT_STA_DISCONNECTED) {
+        memcpy(&reason, rec->payload, sizeof(reason));
+        memcpy(data.sta_disconnected.ssid, REPLAY_SSID, strlen(REPLAY_SSID));
+        data.sta_disconnected.ssid_len = strlen(REPLAY_SSID);
+        data.sta_disconnected.reason = (uint8_t)reason;
+        data.sta_disconnected.rssi = (int8_t)rec->payload[2];
+        size = sizeof(data.sta_disconnected);
+    } else if (base == WIFI_EVENT && rec->id == WIFI_EVENT_AP_STACONNECTED) {
+        memcpy(data.ap_staconnected.mac, rec->payload, 6);
+        data.ap_staconnected.aid = rec->payload[6];
+        size = sizeof(data.ap_staconnected);
+    } else if (base == WIFI_EVENT && rec->id == WIFI_EVENT_AP_STADISCONNECTED) {
+        memcpy(data.ap_stadisconnected.mac, rec->payload, 6);
+        memcpy(&data.ap_stadisconnected.reason, &rec->payload[6], sizeof(uint16_t));
+        size = sizeof(data.ap_stadisconnected);
+    } else if (base == IP_EVENT && rec->id == IP_EVENT_AP_STAIPASSIGNED) {
+        memcpy(&data.ap_staipassigned.ip.addr, rec->payload, 4);
+        size = sizeof(data.ap_staipassigned);
+    }
+
+    // Observed before it is posted, so it comes before whatever the component does about it
+    size_t index = observe(&(observation_t){ .kind = OBS_EVENT, .source = rec->source, .id = rec->id, .reason = reason });
+    if (!fake_wifi_inject(base, rec->id, size ? &data : NULL, size)) {
+        fake_wifi_state_t state;
+        fake_wifi_get_state(&state);
+        pthread_mutex_lock(&obs_lock);
+        if (index < observation_count) {
+            observations[index].kind = OBS_DROPPED;
+            observations[index].mode = state.mode;
+            observations[index].started = state.started;
+        }
+        pthread_mutex_unlock(&obs_lock);
+    }
+}
+
+/**
+ * @brief Whether a recorded action is requested by a user rather than taken by the component.
+ */
+static bool user_requested(uint8_t action) {
+    return action == WIFI_TRACE_ACTION_SWITCH_STA || action == WIFI_TRACE_ACTION_SWITCH_AP ||
+           action == WIFI_TRACE_ACTION_RECONNECT;
+}
+
+/**
+ * @brief Request a recorded action the way the settings page does.
+ */
+static void request(const wifi_trace_record_t *rec) {
+    static int submissions;
+    char body[160];
+    if (rec->id == WIFI_TRACE_ACTION_SWITCH_AP) {
+        snprintf(body, sizeof(body), "wifi_mode=%d", WIFI_MODE_AP);
+    } else {
+        // A new SSID each time, so the form is a change both in AP mode (switch) and in STA mode (reconnect)
+        snprintf(body, sizeof(body), "wifi_mode=%d&ssid=%s-%d&authmode=1&password=%s", WIFI_MODE_STA, REPLAY_SSID,
+                 ++submissions, REPLAY_PASSWORD);
+    }
+    httpd_handle_t server = wifi_get_http_server();
+    fake_httpd_response_t resp;
+    esp_err_t err = ESP_FAIL;
+    if (server) {
+        err = fake_httpd_invoke(server, HTTP_POST, "/captive", "Content-Type: application/x-www-form-urlencoded\r\n",
+                                body, strlen(body), &resp);
+        if (err == ESP_OK && resp.status >= 400) err = ESP_FAIL;     // The page answers with a redirect
+        fake_httpd_response_free(&resp);
+    }
+    if (err != ESP_OK) observe(&(observation_t){ .kind = OBS_REQUEST_FAILED, .id = rec->id });
+}
+
+#pragma endregion
+
+#pragma region Report
+
+static bool is_mode_action(uint8_t id) {
+    return id == WIFI_TRACE_ACTION_SWITCH_STA || id == WIFI_TRACE_ACTION_SWITCH_AP ||
+           id == WIFI_TRACE_ACTION_SWITCH_CAPTIVE || id == WIFI_TRACE_ACTION_RECONNECT;
+}
+
+static void add_state_time(state_time_t *times, size_t *count, const char *state, uint64_t ms) {
+    for (size_t i = 0; i < *count; i++) {
+        if (strcmp(times[i].name, state) == 0) {
+            times[i].ms += ms;
+            return;
+        }
+    }
+    if (*count < MAX_STATES) times[(*count)++] = (state_time_t){ state, ms };
+}
+
+/**
+ * @brief State after an observation, or NULL when it does not change the state.
+ */
+static const char *next_state(const char *state, const observation_t *obs, wifi_mode_t boot_mode) {
+    bool sta = strncmp(state, "sta_", 4) == 0;
+    switch (obs->kind) {
+    case OBS_ACTION:
+        switch (obs->id) {
+        case WIFI_TRACE_ACTION_BOOT: return boot_mode == WIFI_MODE_STA ? "sta_connecting" : "ap";
+        case WIFI_TRACE_ACTION_SWITCH_STA: return "sta_connecting";
+        case WIFI_TRACE_ACTION_RECONNECT: return "sta_connecting";
+        case WIFI_TRACE_ACTION_SWITCH_AP: return "ap";
+        case WIFI_TRACE_ACTION_SWITCH_CAPTIVE: return "captive";
+        default: return NULL;
+        }
+    case OBS_EVENT:
+        if (!sta || obs->source == WIFI_TRACE_SOURCE_ACTION) return NULL;
+        if (obs->source == WIFI_TRACE_SOURCE_WIFI && obs->id == WIFI_EVENT_STA_CONNECTED) return "sta_associated";
+        if (obs->source == WIFI_TRACE_SOURCE_WIFI && obs->id == WIFI_EVENT_STA_DISCONNECTED) return "sta_disconnected";
+        if (obs->source == WIFI_TRACE_SOURCE_IP && obs->id == IP_EVENT_STA_GOT_IP) return "sta_online";
+        if (obs->source == WIFI_TRACE_SOURCE_IP && obs->id == IP_EVENT_STA_LOST_IP) return "sta_associated";
+        return NULL;
+    case OBS_CONNECT:
+        return strcmp(state, "sta_disconnected") == 0 ? "sta_retrying" : NULL;
+    default:
+        return NULL;
+    }
+}
+
+static void describe_cause(const observation_t *obs, char *buf, size_t size) {
+    switch (obs->kind) {
+    case OBS_ACTION:
+        snprintf(buf, size, "%s", action_name(obs->id));
+        break;
+    case OBS_EVENT:
+        if (obs->source == WIFI_TRACE_SOURCE_WIFI && obs->id == WIFI_EVENT_STA_DISCONNECTED) {
+            snprintf(buf, size, "STA_DISCONNECTED (reason %u)", obs->reason);
+        } else {
+            snprintf(buf, size, "%s", event_name(obs->source, obs->id));
+        }
+        break;
+    case OBS_CONNECT:
+        snprintf(buf, size, "esp_wifi_connect()");
+        break;
+    default:
+        snprintf(buf, size, "?");
+        break;
+    }
+}
+
+static void add_divergence(divergence_t *list, size_t *count, uint32_t t, const char *what) {
+    if (*count == MAX_OBSERVATIONS) return;
+    list[*count].t = t;
+    snprintf(list[*count].what, sizeof(list[*count].what), "%s", what);
+    (*count)++;
+}
+
+static int compare_divergences(const void *a, const void *b) {
+    const divergence_t *x = a, *y = b;
+    return x->t < y->t ? -1 : x->t > y->t;
+}
+
+static void report(const wifi_trace_record_t *records, size_t count, uint32_t end_t, wifi_mode_t boot_mode,
+                   bool json) {
+    state_time_t times[MAX_STATES];
+    size_t time_count = 0;
+    const char *state = "boot";
+    uint32_t since = trace_t0;
+    int transitions = 0;
+    int injected = 0;
+    int dropped = 0;
+    int connects = 0;
+
+    printf(json ? "{\n  \"transitions\": [" : "Transitions:\n");
+    for (size_t i = 0; i < observation_count; i++) {
+        const observation_t *obs = &observations[i];
+        injected += obs->kind == OBS_EVENT || obs->kind == OBS_DROPPED;
+        dropped += obs->kind == OBS_DROPPED;
+        connects += obs->kind == OBS_CONNECT;
+        const char *next = next_state(state, obs, boot_mode);
+        if (next == NULL || strcmp(next, state) == 0) continue;
+        char cause[48];
+        describe_cause(obs, cause, sizeof(cause));
+        if (json) {
+            printf("%s\n    {\"t\": %" PRIu32 ", \"from\": \"%s\", \"to\": \"%s\", \"cause\": \"%s\"}",
+                   transitions ? "," : "", obs->t, state, next, cause);
+        } else {
+            printf("  %10.3fs  %-18s -> %-18s %s\n", obs->t / 1000.0, state, next, cause);
+        }
+        add_state_time(times, &time_count, state, obs->t - since);
+        state = next;
+        since = obs->t;
+        transitions++;
+    }
+    add_state_time(times, &time_count, state, end_t > since ? end_t - since : 0);
+    uint64_t total = end_t > trace_t0 ? end_t - trace_t0 : 1;
+
+    printf(json ? "\n  ],\n  \"time_in_state_ms\": {" : "\nTime in state:\n");
+    for (size_t i = 0; i < time_count; i++) {
+        if (json) {
+            printf("%s\"%s\": %" PRIu64, i ? ", " : "", times[i].name, times[i].ms);
+        } else {
+            printf("  %-18s %10.3f s  %5.1f %%\n", times[i].name, times[i].ms / 1000.0, 100.0 * times[i].ms / total);
+        }
+    }
+
+    // Divergences: recorded events the driver could not raise, and mode switches that differ
+    printf(json ? "},\n  \"divergences\": [" : "\nDivergences from the recording:\n");
+    static divergence_t divergences[MAX_OBSERVATIONS];
+    size_t divergence_count = 0;
+    for (size_t i = 0; i < observation_count; i++) {
+        const observation_t *obs = &observations[i];
+        char what[128];
+        if (obs->kind == OBS_DROPPED) {
+            snprintf(what, sizeof(what), "recorded %s dropped, the driver is in %s mode",
+                     event_name(obs->source, obs->id), mode_name(obs->mode, obs->started));
+        } else if (obs->kind == OBS_REQUEST_FAILED) {
+            snprintf(what, sizeof(what), "settings form for the recorded %s not accepted", action_name(obs->id));
+        } else {
+            continue;
+        }
+        add_divergence(divergences, &divergence_count, obs->t, what);
+    }
+    // Mode switches in order, matched one to one; a switch more than a second off counts as well
+    size_t r = 0, o = 0;
+    while (true) {
+        while (r < count && !(records[r].source == WIFI_TRACE_SOURCE_ACTION && is_mode_action(records[r].id))) r++;
+        while (o < observation_count && !(observations[o].kind == OBS_ACTION && is_mode_action(observations[o].id))) o++;
+        if (r == count && o == observation_count) break;
+        char what[128];
+        if (r < count && o < observation_count && records[r].id == observations[o].id) {
+            int32_t shift = (int32_t)(observations[o].t - records[r].time_ms);
+            if (shift < -1000 || shift > 1000) {
+                snprintf(what, sizeof(what), "%s %+.3f s from the recorded one at %.3f s", action_name(records[r].id),
+                         shift / 1000.0, records[r].time_ms / 1000.0);
+                add_divergence(divergences, &divergence_count, observations[o].t, what);
+            }
+            r++;
+            o++;
+        } else if (r < count && (o == observation_count || records[r].time_ms <= observations[o].t)) {
+            snprintf(what, sizeof(what), "recorded %s not taken", action_name(records[r].id));
+            add_divergence(divergences, &divergence_count, records[r].time_ms, what);
+            r++;
+        } else {
+            snprintf(what, sizeof(what), "%s taken, not in the recording", action_name(observations[o].id));
+            add_divergence(divergences, &divergence_count, observations[o].t, what);
+            o++;
+        }
+    }
+    qsort(divergences, divergence_count, sizeof(divergences[0]), compare_divergences);
+    for (size_t i = 0; i < divergence_count; i++) {
+        if (json) {
+            printf("%s\n    {\"t\": %" PRIu32 ", \"what\": \"%s\"}", i ? "," : "", divergences[i].t,
+                   divergences[i].what);
+        } else {
+            printf("  %10.3fs  %s\n", divergences[i].t / 1000.0, divergences[i].what);
+        }
+    }
+    if (json) {
+        printf("\n  ],\n  \"records\": %zu, \"injected\": %d, \"dropped\": %d, \"connect_calls\": %d, "
+               "\"max_reconnects\": %d\n}\n", count, injected, dropped, connects, CONFIG_WIFI_MAX_RECONNECTS);
+    } else {
+        if (divergence_count == 0) printf("  none\n");
+        printf("\n%zu records, %d events injected (%d dropped), %d esp_wifi_connect() calls, "
+               "CONFIG_WIFI_MAX_RECONNECTS %d\n", count, injected, dropped, connects, CONFIG_WIFI_MAX_RECONNECTS);
+    }
+}
+
+#pragma endregion
+
+int host_replay_main(int argc, char **argv) {
+    const char *path = NULL;
+    bool json = false;
+    bool verbose = false;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "--verbose") == 0) {
+            verbose = true;
+        } else if (argv[i][0] != '-' && !path) {
+            path = argv[i];
+        } else {
+            fprintf(stderr, "usage: wifi_host replay TRACE [--json] [--verbose]\n");
+            return 2;
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "usage: wifi_host replay TRACE [--json] [--verbose]\n");
+        return 2;
+    }
+
+    size_t count;
+    uint32_t uptime_ms;
+    wifi_trace_record_t *records = load_trace(path, &count, &uptime_ms);
+    if (!records) return 1;
+    if (count == 0) {
+        fprintf(stderr, "%s has no records\n", path);
+        free(records);
+        return 1;
+    }
+
+    // Boot like the device did: the mode saved at the BOOT record, or the mode of the first event
+    wifi_mode_t boot_mode = WIFI_MODE_AP;
+    size_t first = 0;
+    if (records[0].source == WIFI_TRACE_SOURCE_ACTION && records[0].id == WIFI_TRACE_ACTION_BOOT) {
+        boot_mode = records[0].payload[0] == WIFI_MODE_STA ? WIFI_MODE_STA : WIFI_MODE_AP;
+        first = 1;
+    } else {
+        for (size_t i = 0; i < count && records[i].source != WIFI_TRACE_SOURCE_ACTION; i++) {
+            if (records[i].source == WIFI_TRACE_SOURCE_IP ? records[i].id != IP_EVENT_AP_STAIPASSIGNED
+                                                          : records[i].id <= WIFI_EVENT_STA_AUTHMODE_CHANGE) {
+                boot_mode = WIFI_MODE_STA;
+                break;
+            }
+        }
+        fprintf(stderr, "The trace starts after boot, booting in %s mode\n", boot_mode == WIFI_MODE_STA ? "STA" : "AP");
+    }
+    trace_t0 = records[0].time_ms;
+
+    if (!verbose) esp_log_set_vprintf(discard_log);
+    fake_kernel_set_virtual_time(true);
+    fake_wifi_set_scripted(true);
+    fake_wifi_set_observer(driver_observer, NULL);
+    fake_httpd_set_port(0);
+    host_preset_mode(boot_mode);
+    if (boot_mode == WIFI_MODE_STA) host_preset_sta(REPLAY_SSID, REPLAY_PASSWORD);
+
+    pthread_mutex_lock(&obs_lock);
+    replaying = true;
+    pthread_mutex_unlock(&obs_lock);
+    ESP_ERROR_CHECK(wifi_init());
+    fake_kernel_wait_idle();
+
+    // wifi_init() takes the first mode switch after BOOT on its own, only later ones came from the form
+    bool boot_switch_pending = first == 1;
+    for (size_t i = first; i < count; i++) {
+        const wifi_trace_record_t *rec = &records[i];
+        if (rec->time_ms > trace_now()) fake_kernel_advance_to((uint64_t)(rec->time_ms - trace_t0) * 1000);
+        if (rec->source == WIFI_TRACE_SOURCE_ACTION) {
+            if (rec->id == WIFI_TRACE_ACTION_BOOT) {
+                boot_switch_pending = true;
+            } else if (boot_switch_pending && is_mode_action(rec->id)) {
+                boot_switch_pending = false;
+            } else if (user_requested(rec->id)) {
+                request(rec);
+            }
+        } else if (!driver_generated(rec)) {
+            inject(rec);
+        }
+        fake_kernel_wait_idle();
+    }
+    uint32_t end_t = uptime_ms > records[count - 1].time_ms ? uptime_ms : records[count - 1].time_ms;
+    fake_kernel_advance_to((uint64_t)(end_t - trace_t0) * 1000);
+
+    pthread_mutex_lock(&obs_lock);
+    replaying = false;
+    pthread_mutex_unlock(&obs_lock);
+    report(records, count, end_t, boot_mode, json);
+    fflush(stdout);
+    free(records);
+    return 0;
+}
@@ -0,0 +1,13 @@
+/**
+ * @file host_replay.h
+ * @brief wifi_host replay, see host_replay.c.
+ */
+
+#pragma once
+
+/**
+ * @brief Run `wifi_host replay` with the arguments after the command name.
+ *
+ * @return process exit status
+ */
+int host_replay_main(int argc, char **argv);
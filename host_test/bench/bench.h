@@ -0,0 +1,50 @@
+/**
+ * @file bench.h
+ * @brief Benchmark runner of the host build.
+ *
+ * A case runs one operation per call. The runner warms it up, calibrates the
+ * iteration count to the minimum run time (or takes it from --iterations)
+ * and reports the mean time, throughput and heap allocations per operation.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// One benchmark case
+typedef struct {
+    const char *name;           ///< Name, "group/case"
+    void (*setup)(void);        ///< Called once before the first run, may be NULL
+    size_t (*run)(void);        ///< One operation, returns the bytes of input it processed
+} bench_case_t;
+
+/// Cases of one source file
+typedef struct {
+    const bench_case_t *cases;
+    size_t count;
+} bench_group_t;
+
+/**
+ * @brief Keep a result alive so the compiler cannot drop the work producing it.
+ */
+void bench_consume(uintptr_t value);
+
+/**
+ * @brief Start the component in captive portal mode with a full scan list, once per process.
+ */
+void bench_start_captive(void);
+
+/// Cases of bench_kernels.c: parsers, MIME lookup, JSON building, client table
+extern const bench_group_t bench_kernel_cases;
+
+/// Cases of bench_http.c: requests through the handlers and the server
+extern const bench_group_t bench_http_cases;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,110 @@
+/**
+ * @file bench_http.c
+ * @brief Requests through the component's handlers, in process and over loopback.
+ *
+ * The component runs in captive portal mode, like a device without saved
+ * credentials. The invoke cases measure the handlers alone, the loopback case
+ * adds the POSIX server and the kernel's TCP stack.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Wifi.h"
+#include "bench.h"
+#include "fake_host.h"
+#include "host_support.h"
+#include "sdkconfig.h"
+
+static int loopback_fd = -1;
+
+static bool portal_up(void *ctx) {
+    return host_ap_started(ctx) && wifi_get_http_server() != NULL && fake_httpd_bound_port() != 0;
+}
+
+void bench_start_captive(void) {
+    static bool started;
+    if (started) return;
+    started = true;
+    fake_httpd_set_port(0);
+    host_add_assets();
+    // A full scan list, with names that need escaping
+    for (int i = 0; i < CONFIG_WIFI_SCAN_MAX_APS; i++) {
+        char ssid[33];
+        snprintf(ssid, sizeof(ssid), i % 2 ? "Guest \"%d\" \\ 5GHz" : "Network-%d", i);
+        host_add_network(ssid, "password");
+    }
+    ESP_ERROR_CHECK(wifi_init());
+    if (!host_wait_until(portal_up, NULL, 5000)) {
+        fprintf(stderr, "Captive portal did not start\n");
+        exit(1);
+    }
+}
+
+static size_t invoke_get(const char *uri) {
+    fake_httpd_response_t resp;
+    fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, uri, NULL, NULL, 0, &resp);
+    size_t len = resp.body_len;
+    fake_httpd_response_free(&resp);
+    return len;
+}
+
+static size_t run_captive_page(void) {
+    return invoke_get("/captive");
+}
+
+static size_t run_probe_redirect(void) {
+    return invoke_get("/generate_204");
+}
+
+static void setup_loopback(void) {
+    bench_start_captive();
+    loopback_fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(fake_httpd_bound_port()),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (connect(loopback_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("connect");
+        exit(1);
+    }
+}
+
+/**
+ * @brief GET /wifi-status.json on a keep-alive connection, reading the whole response.
+ */
+static size_t run_loopback_status(void) {
+    static const char request[] = "GET /wifi-status.json HTTP/1.1\r\nHost: 192.168.4.1\r\n\r\n";
+    char buf[1024];
+    if (send(loopback_fd, request, sizeof(request) - 1, MSG_NOSIGNAL) != (ssize_t)sizeof(request) - 1) abort();
+    size_t len = 0;
+    const char *body = NULL;
+    size_t total = 0;
+    while (!body || len < total) {
+        ssize_t ret = recv(loopback_fd, buf + len, sizeof(buf) - 1 - len, 0);
+        if (ret <= 0) abort();
+        len += (size_t)ret;
+        buf[len] = '\0';
+        const char *end = strstr(buf, "\r\n\r\n");
+        if (!body && end) {
+            body = end + 4;
+            const char *length = strstr(buf, "Content-Length: ");
+            total = (size_t)(body - buf) + (length ? strtoul(length + 16, NULL, 10) : 0);
+        }
+    }
+    return len;
+}
+
+static const bench_case_t cases[] = {
+    { "http/captive_page", bench_start_captive, run_captive_page },
+    { "http/probe_redirect", bench_start_captive, run_probe_redirect },
+    { "http/loopback_status", setup_loopback, run_loopback_status },
+};
+
+const bench_group_t bench_http_cases = { cases, sizeof(cases) / sizeof(cases[0]) };
@@ -0,0 +1,140 @@
+/**
+ * @file bench_kernels.c
+ * @brief The component's small hot functions: DNS parsing, url_decode, MIME lookup, JSON building.
+ *
+ * Inputs are built once in the setup functions, so a run measures the
+ * function alone. Cases that change their input in place (url_decode) copy
+ * it first; the copy is part of the measurement and the same in every
+ * version being compared.
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "Wifi.h"
+#include "bench.h"
+#include "dns_parse.h"
+#include "fake_host.h"
+#include "wifi_util.h"
+
+#pragma region DNS
+
+static char dns_query[512];
+static size_t dns_query_len;
+static char dns_reply[512];
+static dns_server_handle_t dns_handle;
+
+/**
+ * @brief Build a query for one A record, as phones send them right after joining.
+ */
+static void setup_dns(void) {
+    static const char *const labels[] = { "connectivitycheck", "gstatic", "com" };
+    const uint16_t header[6] = { htons(0x1234), htons(0x0100), htons(1), 0, 0, 0 };
+    memcpy(dns_query, header, sizeof(header));
+    size_t len = sizeof(header);
+    for (size_t i = 0; i < sizeof(labels) / sizeof(labels[0]); i++) {
+        size_t n = strlen(labels[i]);
+        dns_query[len++] = (char)n;
+        memcpy(dns_query + len, labels[i], n);
+        len += n;
+    }
+    dns_query[len++] = 0;
+    const uint16_t question[2] = { htons(1), htons(1) };
+    memcpy(dns_query + len, question, sizeof(question));
+    dns_query_len = len + sizeof(question);
+    dns_handle = host_dns_wildcard_handle(inet_addr("192.168.4.1"));
+}
+
+static size_t run_dns_name(void) {
+    char name[128];
+    bench_consume((uintptr_t)host_parse_dns_name(dns_query + 12, dns_query + dns_query_len, name, sizeof(name)));
+    return dns_query_len - 12 - 4;
+}
+
+static size_t run_dns_request(void) {
+    int len = host_parse_dns_request(dns_query, dns_query_len, dns_reply, sizeof(dns_reply), dns_handle, 0);
+    bench_consume((uintptr_t)len);
+    return dns_query_len;
+}
+
+#pragma endregion
+
+#pragma region url_decode
+
+static const char form_plain[] = "wifi_mode=1&ap_ssid=ESP32-Portal&ap_password=&ssid=HomeNetwork&authmode=1"
+                                 "&password=correcthorsebatterystaple&use_static_ip=false&static_ip=192.168.1.50"
+                                 "&use_mDNS=true&mDNS_hostname=esp32&service_name=ESP32+Web+Server";
+static const char form_escaped[] = "%E2%9C%93+Caf%C3%A9+%22Guest%22+%26+Friends+%2F+2.4GHz+%28%C3%A9t%C3%A9%29"
+                                   "+p%40ss%3Dw%C3%B6rd%21%3F%23%25%5E%26%2A%28%29";
+
+static size_t decode(const char *src, size_t len) {
+    char buf[512];
+    memcpy(buf, src, len + 1);
+    url_decode(buf);
+    bench_consume((uintptr_t)buf[0]);
+    return len;
+}
+
+static size_t run_url_plain(void) {
+    return decode(form_plain, sizeof(form_plain) - 1);
+}
+
+static size_t run_url_escaped(void) {
+    return decode(form_escaped, sizeof(form_escaped) - 1);
+}
+
+#pragma endregion
+
+#pragma region MIME
+
+/// Paths as a browser requests them loading the example page, cycled through
+static const char *const mime_paths[] = {
+    "/index.html", "/css/styles.css", "/js/app.js", "/status.json", "/img/logo.png", "/favicon.ico",
+    "/fonts/roboto-regular.woff2", "/video/intro.webm", "/docs/README", "/captive",
+};
+static size_t mime_next;
+
+static size_t run_mime(void) {
+    const char *path = mime_paths[mime_next];
+    mime_next = (mime_next + 1) % (sizeof(mime_paths) / sizeof(mime_paths[0]));
+    bench_consume((uintptr_t)wifi_mime_type_for_path(path));
+    return strlen(path);
+}
+
+#pragma endregion
+
+#pragma region JSON
+
+static size_t invoke_get(const char *uri) {
+    fake_httpd_response_t resp;
+    fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, uri, NULL, NULL, 0, &resp);
+    size_t len = resp.body_len;
+    fake_httpd_response_free(&resp);
+    return len;
+}
+
+/**
+ * @brief scan_json_handler with a full scan list; includes the fake driver's scan.
+ */
+static size_t run_scan_json(void) {
+    return invoke_get("/scan.json");
+}
+
+static size_t run_captive_json(void) {
+    return invoke_get("/captive.json");
+}
+
+#pragma endregion
+
+static const bench_case_t cases[] = {
+    { "dns/parse_dns_name", setup_dns, run_dns_name },
+    { "dns/parse_dns_request", setup_dns, run_dns_request },
+    { "url/decode_plain", NULL, run_url_plain },
+    { "url/decode_escaped", NULL, run_url_escaped },
+    { "mime/type_for_path", NULL, run_mime },
+    { "json/scan_json", bench_start_captive, run_scan_json },
+    { "json/captive_json", bench_start_captive, run_captive_json },
+};
+
+const bench_group_t bench_kernel_cases = { cases, sizeof(cases) / sizeof(cases[0]) };
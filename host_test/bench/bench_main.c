@@ -0,0 +1,274 @@
+/**
+ * @file bench_main.c
+ * @brief Benchmark runner: calibration, timing, allocation counting and the report.
+ *
+ *   wifi_bench [--filter TEXT] [--warmup-ms N] [--min-time-ms N] [--iterations N]
+ *              [--json FILE] [--baseline FILE] [--threshold PCT] [--list]
+ *
+ * Each case is warmed up for --warmup-ms (default 100), then run for
+ * --iterations, or for as many iterations as fill --min-time-ms (default
+ * 500). Cases whose name does not contain --filter are skipped.
+ *
+ * Per operation the report has the mean time (ns/op), the input throughput
+ * (MB/s), and the heap bytes and allocations (B/op, allocs/op), counted by
+ * the malloc wrappers below on every thread. --json writes the results;
+ * --baseline reads such a file and prints the change of ns/op per case. The
+ * exit status is 3 when a case got slower than --threshold percent (default
+ * 10), so a script can compare a change against a saved run.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define MAX_BASELINE 64
+
+typedef struct {
+    const char *filter;
+    uint64_t warmup_ns;
+    uint64_t min_time_ns;
+    uint64_t iterations;
+    const char *json_path;
+    const char *baseline_path;
+    double threshold_pct;
+} bench_options_t;
+
+typedef struct {
+    uint64_t iterations;
+    double ns_per_op;
+    double mb_per_s;
+    double bytes_per_op;
+    double allocs_per_op;
+} bench_result_t;
+
+typedef struct {
+    char name[64];
+    double ns_per_op;
+} baseline_entry_t;
+
+static volatile uintptr_t bench_sink;
+static uint64_t alloc_bytes;
+static uint64_t alloc_count;
+
+void bench_consume(uintptr_t value) {
+    bench_sink = value;
+}
+
+#pragma region Allocation counting
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static void count_alloc(size_t size) {
+    __atomic_fetch_add(&alloc_bytes, size, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size) {
+    count_alloc(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    count_alloc(n * size);
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    count_alloc(size);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+
+#pragma endregion
+
+#pragma region Running
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Run a case @p iterations times and fill in the per-operation numbers.
+ *
+ * @return elapsed nanoseconds
+ */
+static uint64_t run_batch(const bench_case_t *bc, uint64_t iterations, bench_result_t *result) {
+    size_t processed = 0;
+    uint64_t bytes_before = __atomic_load_n(&alloc_bytes, __ATOMIC_RELAXED);
+    uint64_t count_before = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+    uint64_t start = now_ns();
+    for (uint64_t i = 0; i < iterations; i++) {
+        processed += bc->run();
+    }
+    uint64_t elapsed = now_ns() - start;
+    bench_consume(processed);
+    result->iterations = iterations;
+    result->ns_per_op = (double)elapsed / (double)iterations;
+    result->mb_per_s = elapsed ? (double)processed * 1e3 / (double)elapsed : 0;
+    result->bytes_per_op = (double)(__atomic_load_n(&alloc_bytes, __ATOMIC_RELAXED) - bytes_before) / (double)iterations;
+    result->allocs_per_op = (double)(__atomic_load_n(&alloc_count, __ATOMIC_RELAXED) - count_before) / (double)iterations;
+    return elapsed;
+}
+
+static void run_case(const bench_case_t *bc, const bench_options_t *opts, bench_result_t *result) {
+    if (bc->setup) bc->setup();
+    uint64_t iterations = 1;
+    for (uint64_t start = now_ns(); now_ns() - start < opts->warmup_ns;) {
+        run_batch(bc, iterations, result);
+        if (iterations < 1024) iterations *= 2;
+    }
+
+    if (opts->iterations) {
+        run_batch(bc, opts->iterations, result);
+        return;
+    }
+    // Grow the batch until it fills the minimum time, then the last batch is the measurement
+    iterations = 1;
+    uint64_t elapsed;
+    while ((elapsed = run_batch(bc, iterations, result)) < opts->min_time_ns) {
+        uint64_t scale = elapsed ? opts->min_time_ns * 12 / 10 / elapsed : 10;
+        iterations *= scale < 2 ? 2 : scale > 10 ? 10 : scale;
+    }
+}
+
+#pragma endregion
+
+#pragma region Results
+
+/**
+ * @brief Read the ns/op of each case from a file written with --json.
+ *
+ * @return number of entries read, -1 when the file cannot be opened
+ */
+static int baseline_load(const char *path, baseline_entry_t *entries, int max) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    int count = 0;
+    char line[256];
+    while (count < max && fgets(line, sizeof(line), f)) {
+        // One case per line, as json_write_case() puts it
+        baseline_entry_t *entry = &entries[count];
+        const char *ns = strstr(line, "\"ns_per_op\": ");
+        if (sscanf(line, " {\"name\": \"%63[^\"]\"", entry->name) == 1 && ns &&
+            sscanf(ns + 13, "%lf", &entry->ns_per_op) == 1) {
+            count++;
+        }
+    }
+    fclose(f);
+    return count;
+}
+
+static const baseline_entry_t *baseline_find(const baseline_entry_t *entries, int count, const char *name) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(entries[i].name, name) == 0) return &entries[i];
+    }
+    return NULL;
+}
+
+static void json_write_case(FILE *f, bool first, const char *name, const bench_result_t *r) {
+    fprintf(f, "%s    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.2f, \"mb_per_s\": %.2f, "
+               "\"bytes_per_op\": %.2f, \"allocs_per_op\": %.2f}",
+            first ? "" : ",\n", name, (unsigned long long)r->iterations, r->ns_per_op, r->mb_per_s, r->bytes_per_op,
+            r->allocs_per_op);
+}
+
+#pragma endregion
+
+static void usage(void) {
+    fprintf(stderr, "usage: wifi_bench [--filter TEXT] [--warmup-ms N] [--min-time-ms N] [--iterations N]\n"
+                    "                  [--json FILE] [--baseline FILE] [--threshold PCT] [--list]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    bench_options_t opts = {
+        .warmup_ns = 100 * 1000000ull,
+        .min_time_ns = 500 * 1000000ull,
+        .threshold_pct = 10,
+    };
+    bool list = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            opts.filter = argv[++i];
+        } else if (strcmp(argv[i], "--warmup-ms") == 0 && i + 1 < argc) {
+            opts.warmup_ns = strtoull(argv[++i], NULL, 10) * 1000000ull;
+        } else if (strcmp(argv[i], "--min-time-ms") == 0 && i + 1 < argc) {
+            opts.min_time_ns = strtoull(argv[++i], NULL, 10) * 1000000ull;
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            opts.iterations = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            opts.json_path = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            opts.baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            opts.threshold_pct = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--list") == 0) {
+            list = true;
+        } else {
+            usage();
+        }
+    }
+
+    static baseline_entry_t baseline[MAX_BASELINE];
+    int baseline_count = 0;
+    if (opts.baseline_path && (baseline_count = baseline_load(opts.baseline_path, baseline, MAX_BASELINE)) < 0) {
+        fprintf(stderr, "Cannot read baseline %s\n", opts.baseline_path);
+        return 2;
+    }
+    FILE *json = NULL;
+    if (opts.json_path && !list && !(json = fopen(opts.json_path, "w"))) {
+        fprintf(stderr, "Cannot write %s\n", opts.json_path);
+        return 2;
+    }
+    if (json) fprintf(json, "{\n  \"cases\": [\n");
+    if (!list) {
+        printf("%-24s %12s %12s %10s %10s %10s%s\n", "case", "iter", "ns/op", "MB/s", "B/op", "allocs/op",
+               opts.baseline_path ? "   baseline   change" : "");
+    }
+
+    const bench_group_t *groups[] = { &bench_kernel_cases, &bench_http_cases };
+    bool first = true;
+    int regressions = 0;
+    for (size_t g = 0; g < sizeof(groups) / sizeof(groups[0]); g++) {
+        for (size_t i = 0; i < groups[g]->count; i++) {
+            const bench_case_t *bc = &groups[g]->cases[i];
+            if (opts.filter && !strstr(bc->name, opts.filter)) continue;
+            if (list) {
+                printf("%s\n", bc->name);
+                continue;
+            }
+            bench_result_t r;
+            run_case(bc, &opts, &r);
+            printf("%-24s %12llu %12.1f %10.1f %10.1f %10.2f", bc->name, (unsigned long long)r.iterations,
+                   r.ns_per_op, r.mb_per_s, r.bytes_per_op, r.allocs_per_op);
+            const baseline_entry_t *base = baseline_find(baseline, baseline_count, bc->name);
+            if (base && base->ns_per_op > 0) {
+                double change = (r.ns_per_op - base->ns_per_op) * 100 / base->ns_per_op;
+                bool regressed = change > opts.threshold_pct;
+                regressions += regressed;
+                printf(" %10.1f %+7.1f%%%s", base->ns_per_op, change, regressed ? " SLOWER" : "");
+            }
+            printf("\n");
+            fflush(stdout);
+            if (json) json_write_case(json, first, bc->name, &r);
+            first = false;
+        }
+    }
+    if (json) {
+        fprintf(json, "\n  ]\n}\n");
+        fclose(json);
+    }
+    return regressions ? 3 : 0;
+}
@@ -0,0 +1,103 @@
+/**
+ * @file sdkconfig.h
+ * @brief Configuration of the host build.
+ *
+ * Kconfig defaults of the component, with every optional feature enabled so
+ * the host build compiles and exercises all of it. CONFIG_WIFI_STATIC_ALLOCATION
+ * comes from the WIFI_HOST_STATIC_ALLOCATION CMake option,
+ * CONFIG_WIFI_MAX_RECONNECTS from WIFI_HOST_MAX_RECONNECTS.
+ */
+
+#pragma once
+
+// ESP-IDF options the component reads
+#define CONFIG_IDF_FIRMWARE_CHIP_ID 0x0009
+#define CONFIG_FREERTOS_HZ 1000
+#define CONFIG_LOG_DEFAULT_LEVEL 3
+#define CONFIG_LWIP_MAX_SOCKETS 10
+#define CONFIG_LWIP_STATS 1
+#define CONFIG_HTTPD_MAX_URI_LEN 512
+#define CONFIG_HTTPD_MAX_REQ_HDR_LEN 1024
+#define CONFIG_HTTPD_WS_SUPPORT 1
+
+// WiFi Component Configuration
+#define CONFIG_LOG_LEVEL_WIFI 3
+#ifndef CONFIG_WIFI_MAX_RECONNECTS
+#define CONFIG_WIFI_MAX_RECONNECTS 5     // WIFI_HOST_MAX_RECONNECTS CMake option
+#endif
+#define CONFIG_WIFI_SCAN_MAX_APS 8
+#define CONFIG_WIFI_MAX_CUSTOM_HTTP_HANDLERS 8
+#define CONFIG_WIFI_HTTPD_STACK_SIZE 4096
+#define CONFIG_WIFI_ARENA_BLOCK_SIZE 1536
+#define CONFIG_WIFI_ARENA_BLOCKS 1
+#define CONFIG_WIFI_ASSETS 1
+#define CONFIG_WIFI_ASSETS_PARTITION_LABEL "www"
+#define CONFIG_WIFI_ASSETS_FALLBACK 1
+#define CONFIG_WIFI_EVENT_TRACE 1
+#define CONFIG_WIFI_EVENT_TRACE_ENTRIES 128
+#define CONFIG_WIFI_CAPTIVE_DHCP_URI 1
+#define CONFIG_WIFI_PROBE_RAW_RESPONSE 1
+#define CONFIG_WIFI_RESTART_DRAIN_TIMEOUT_MS 5000
+#define CONFIG_WIFI_HTTPD_MAX_SOCKETS_PER_CLIENT 4
+#define CONFIG_WIFI_HTTPD_HEADER_TIMEOUT_MS 5000
+#define CONFIG_WIFI_HTTPD_MIN_BODY_RATE 128
+#define CONFIG_WIFI_HTTPD_BODY_RATE_WINDOW_MS 5000
+
+// WebSocket helpers
+#define CONFIG_WIFI_WS_SYNC_MAX_KEYS 16
+#define CONFIG_WIFI_WS_SYNC_TICK_MS 50
+#define CONFIG_WIFI_WS_RX_SMALL_SIZE 32
+#define CONFIG_WIFI_WS_RX_SMALL_COUNT 2
+#define CONFIG_WIFI_WS_RX_MEDIUM_SIZE 256
+#define CONFIG_WIFI_WS_RX_MEDIUM_COUNT 2
+#define CONFIG_WIFI_WS_RX_LARGE_SIZE 1024
+#define CONFIG_WIFI_WS_RX_LARGE_COUNT 1
+
+// Task placement
+#define CONFIG_WIFI_LISTENER_TASK_PRIORITY 4
+#define CONFIG_WIFI_LISTENER_TASK_CORE -1
+#define CONFIG_WIFI_DNS_TASK_PRIORITY 5
+#define CONFIG_WIFI_DNS_TASK_CORE -1
+#define CONFIG_WIFI_HTTPD_TASK_PRIORITY 5
+#define CONFIG_WIFI_HTTPD_TASK_CORE -1
+#define CONFIG_WIFI_WORKER_TASK_PRIORITY 4
+#define CONFIG_WIFI_WORKER_TASK_CORE -1
+
+// SD card, never mounts on the host
+#define CONFIG_PIN_WIFI_SD_MOSI 11
+#define CONFIG_PIN_WIFI_SD_MISO 13
+#define CONFIG_PIN_WIFI_SD_SCK 12
+#define CONFIG_PIN_WIFI_SD_CS 10
+#define CONFIG_WIFI_SD_SPI_FREQ_KHZ 20000
+#define CONFIG_WIFI_SD_HOTPLUG 1
+#define CONFIG_WIFI_SD_CD_PIN -1
+#define CONFIG_WIFI_SD_CD_ACTIVE_LOW 1
+#define CONFIG_WIFI_SD_PROBE_INTERVAL_MS 2000
+
+// Upload and firmware update, with tokens so the endpoints are registered
+#define CONFIG_WIFI_UPLOAD 1
+#define CONFIG_WIFI_UPLOAD_TOKEN "host-upload-token"
+#define CONFIG_WIFI_UPLOAD_BUFFER_SIZE 8192
+#define CONFIG_WIFI_OTA 1
+#define CONFIG_WIFI_OTA_TOKEN "host-ota-token"
+#define CONFIG_WIFI_OTA_BUFFER_SIZE 4096
+
+// Server-side includes
+#define CONFIG_WIFI_SSI 1
+#define CONFIG_WIFI_SSI_CACHE_ENTRIES 4
+#define CONFIG_WIFI_SSI_MAX_DIRECTIVES 16
+#define CONFIG_WIFI_SSI_MAX_VARS 16
+
+// SD card log
+#define CONFIG_WIFI_SDLOG 1
+#define CONFIG_WIFI_SDLOG_DIR "logs"
+#define CONFIG_WIFI_SDLOG_SLOT_SIZE 64
+#define CONFIG_WIFI_SDLOG_SLOTS 64
+#define CONFIG_WIFI_SDLOG_BATCH_SIZE 4096
+#define CONFIG_WIFI_SDLOG_SYNC_INTERVAL_MS 2000
+#define CONFIG_WIFI_SDLOG_FILE_SIZE_KB 1024
+#define CONFIG_WIFI_SDLOG_FILE_COUNT 4
+
+// Status LED
+#define CONFIG_WIFI_USE_SK6812_STATUS_LED 1
+#define CONFIG_PIN_WIFI_STATUS_LED 45
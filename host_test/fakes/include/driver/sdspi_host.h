@@ -0,0 +1,49 @@
+/**
+ * @file sdspi_host.h
+ * @brief Host fake of the SD SPI host driver.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "driver/spi_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t flags;
+    int slot;
+    int max_freq_khz;
+} sdmmc_host_t;
+
+#define SDMMC_FREQ_DEFAULT 20000
+#define SDSPI_HOST_DEFAULT() { .flags = 0, .slot = SPI2_HOST, .max_freq_khz = SDMMC_FREQ_DEFAULT }
+
+#define SDSPI_SLOT_NO_CS -1
+#define SDSPI_SLOT_NO_CD -1
+#define SDSPI_SLOT_NO_WP -1
+#define SDSPI_SLOT_NO_INT -1
+
+typedef struct {
+    spi_host_device_t host_id;
+    int gpio_cs;
+    int gpio_cd;
+    int gpio_wp;
+    int gpio_int;
+} sdspi_device_config_t;
+
+#define SDSPI_DEVICE_CONFIG_DEFAULT() {     \
+        .host_id = SPI2_HOST,               \
+        .gpio_cs = 13,                      \
+        .gpio_cd = SDSPI_SLOT_NO_CD,        \
+        .gpio_wp = SDSPI_SLOT_NO_WP,        \
+        .gpio_int = SDSPI_SLOT_NO_INT,      \
+    }
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,16 @@
+/**
+ * @file esp_attr.h
+ * @brief Host fake of the ESP-IDF memory placement attributes.
+ *
+ * Host memory has no IRAM or DMA regions, the attributes only keep the
+ * alignment the real ones guarantee.
+ */
+
+#pragma once
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+#define WORD_ALIGNED_ATTR __attribute__((aligned(4)))
+#define DMA_ATTR WORD_ALIGNED_ATTR
@@ -0,0 +1,134 @@
+/**
+ * @file esp_netif.h
+ * @brief Host fake of the ESP-IDF network interface layer.
+ *
+ * Two interfaces exist: the softAP with 192.168.4.1/24 and the station,
+ * which gets 192.168.1.100/24 from the fake DHCP client when the fake driver
+ * connects (see fake_wifi.c). Addresses only exist in memory, the host
+ * stack is not configured.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct {
+    uint32_t addr[4];
+    uint8_t zone;
+} esp_ip6_addr_t;
+
+typedef struct {
+    esp_ip4_addr_t ip;
+    esp_ip4_addr_t netmask;
+    esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+typedef struct esp_netif_obj esp_netif_t;
+
+#define IP4ADDR_STRLEN_MAX 16
+
+#define esp_netif_ip4_makeu32(a, b, c, d) (((uint32_t)((a) & 0xff) << 24) | \
+                                           ((uint32_t)((b) & 0xff) << 16) | \
+                                           ((uint32_t)((c) & 0xff) << 8) |  \
+                                           (uint32_t)((d) & 0xff))
+
+#define esp_netif_htonl(x) ((uint32_t)((((x) & 0xffUL) << 24) | (((x) & 0xff00UL) << 8) | \
+                                       (((x) & 0xff0000UL) >> 8) | (((x) & 0xff000000UL) >> 24)))
+
+#define ESP_IP4TOADDR(a, b, c, d) esp_netif_htonl(esp_netif_ip4_makeu32(a, b, c, d))
+#define ESP_IP4TOUINT32(a, b, c, d) ESP_IP4TOADDR(a, b, c, d)
+#define IP4_ADDR(ipaddr, a, b, c, d) (ipaddr)->addr = ESP_IP4TOADDR(a, b, c, d)
+
+#define esp_ip4_addr_get_byte(ipaddr, idx) (((const uint8_t *)(&(ipaddr)->addr))[idx])
+#define esp_ip4_addr1(ipaddr) esp_ip4_addr_get_byte(ipaddr, 0)
+#define esp_ip4_addr2(ipaddr) esp_ip4_addr_get_byte(ipaddr, 1)
+#define esp_ip4_addr3(ipaddr) esp_ip4_addr_get_byte(ipaddr, 2)
+#define esp_ip4_addr4(ipaddr) esp_ip4_addr_get_byte(ipaddr, 3)
+#define esp_ip4_addr1_16(ipaddr) ((uint16_t)esp_ip4_addr1(ipaddr))
+#define esp_ip4_addr2_16(ipaddr) ((uint16_t)esp_ip4_addr2(ipaddr))
+#define esp_ip4_addr3_16(ipaddr) ((uint16_t)esp_ip4_addr3(ipaddr))
+#define esp_ip4_addr4_16(ipaddr) ((uint16_t)esp_ip4_addr4(ipaddr))
+
+#define IPSTR "%d.%d.%d.%d"
+#define IP2STR(ipaddr) esp_ip4_addr1_16(ipaddr), esp_ip4_addr2_16(ipaddr), \
+                       esp_ip4_addr3_16(ipaddr), esp_ip4_addr4_16(ipaddr)
+
+typedef enum {
+    ESP_NETIF_OP_START = 0,
+    ESP_NETIF_OP_SET,
+    ESP_NETIF_OP_GET,
+    ESP_NETIF_OP_MAX
+} esp_netif_dhcp_option_mode_t;
+
+typedef enum {
+    ESP_NETIF_SUBNET_MASK = 1,
+    ESP_NETIF_DOMAIN_NAME_SERVER = 6,
+    ESP_NETIF_ROUTER_SOLICITATION_ADDRESS = 32,
+    ESP_NETIF_VENDOR_SPECIFIC_INFO = 43,
+    ESP_NETIF_REQUESTED_IP_ADDRESS = 50,
+    ESP_NETIF_IP_ADDRESS_LEASE_TIME = 51,
+    ESP_NETIF_IP_REQUEST_RETRY_TIME = 52,
+    ESP_NETIF_VENDOR_CLASS_IDENTIFIER = 60,
+    ESP_NETIF_CAPTIVEPORTAL_URI = 114,
+} esp_netif_dhcp_option_id_t;
+
+#define ESP_ERR_ESP_NETIF_BASE 0x5000
+#define ESP_ERR_ESP_NETIF_INVALID_PARAMS (ESP_ERR_ESP_NETIF_BASE + 0x01)
+#define ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED (ESP_ERR_ESP_NETIF_BASE + 0x04)
+#define ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED (ESP_ERR_ESP_NETIF_BASE + 0x05)
+
+/** @brief IP events */
+typedef enum {
+    IP_EVENT_STA_GOT_IP,
+    IP_EVENT_STA_LOST_IP,
+    IP_EVENT_AP_STAIPASSIGNED,
+    IP_EVENT_GOT_IP6,
+} ip_event_t;
+
+ESP_EVENT_DECLARE_BASE(IP_EVENT);
+
+typedef struct {
+    esp_netif_t *esp_netif;
+    esp_netif_ip_info_t ip_info;
+    bool ip_changed;
+} ip_event_got_ip_t;
+
+typedef struct {
+    esp_netif_t *esp_netif;
+    esp_ip4_addr_t ip;
+    uint8_t mac[6];
+} ip_event_ap_staipassigned_t;
+
+typedef esp_err_t (*esp_netif_callback_fn)(void *ctx);
+
+esp_err_t esp_netif_init(void);
+esp_netif_t *esp_netif_create_default_wifi_ap(void);
+esp_netif_t *esp_netif_create_default_wifi_sta(void);
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key);
+esp_err_t esp_netif_get_ip_info(esp_netif_t *esp_netif, esp_netif_ip_info_t *ip_info);
+esp_err_t esp_netif_set_ip_info(esp_netif_t *esp_netif, const esp_netif_ip_info_t *ip_info);
+esp_err_t esp_netif_dhcpc_start(esp_netif_t *esp_netif);
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *esp_netif);
+esp_err_t esp_netif_dhcps_start(esp_netif_t *esp_netif);
+esp_err_t esp_netif_dhcps_stop(esp_netif_t *esp_netif);
+esp_err_t esp_netif_dhcps_option(esp_netif_t *esp_netif, esp_netif_dhcp_option_mode_t opt_op,
+                                 esp_netif_dhcp_option_id_t opt_id, void *opt_val, uint32_t opt_len);
+esp_err_t esp_netif_tcpip_exec(esp_netif_callback_fn fn, void *ctx);
+char *esp_ip4addr_ntoa(const esp_ip4_addr_t *addr, char *buf, int buflen);
+uint32_t esp_ip4addr_aton(const char *addr);
+
+#ifdef __cplusplus
+}
+#endif
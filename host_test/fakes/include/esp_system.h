@@ -0,0 +1,28 @@
+/**
+ * @file esp_system.h
+ * @brief Host fake of the ESP-IDF system API.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*shutdown_handler_t)(void);
+
+/**
+ * @brief Run the shutdown handlers and the restart hook (see fake_host.h), exits the process without a hook.
+ */
+void esp_restart(void) __attribute__((noreturn));
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler);
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+
+#ifdef __cplusplus
+}
+#endif
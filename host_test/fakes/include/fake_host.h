@@ -0,0 +1,314 @@
+/**
+ * @file fake_host.h
+ * @brief Control interface of the host fakes.
+ *
+ * The component code only sees the ESP-IDF API the fakes implement. Tests,
+ * the benchmark and the host application drive the fakes through the
+ * functions below: the FreeRTOS clock (real or virtual), the heap budget,
+ * the WiFi driver, the flash partitions, the HTTP server and esp_restart().
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_http_server.h"
+#include "esp_wifi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#pragma region Kernel
+
+/**
+ * @brief Switch the scheduler clock to virtual time.
+ *
+ * Must be called before the first task is created. In virtual time the clock
+ * only moves through fake_kernel_advance_to(), so timeouts, delays and
+ * esp_timer callbacks fire exactly when the driver says so.
+ */
+void fake_kernel_set_virtual_time(bool enable);
+
+/**
+ * @brief Block until every FreeRTOS task is blocked in the kernel.
+ *
+ * Only meaningful in virtual time; in real time it returns immediately.
+ */
+void fake_kernel_wait_idle(void);
+
+/**
+ * @brief Earliest timeout of a blocked task, UINT64_MAX when none is pending.
+ */
+uint64_t fake_kernel_next_deadline(void);
+
+/**
+ * @brief Move the virtual clock forward, firing each deadline on the way.
+ *
+ * Steps through every pending deadline up to @p time_us and waits for the
+ * tasks it wakes to settle before taking the next step.
+ */
+void fake_kernel_advance_to(uint64_t time_us);
+
+/**
+ * @brief Scheduler clock in microseconds since start.
+ */
+uint64_t fake_kernel_now_us(void);
+
+/**
+ * @brief Number of FreeRTOS tasks currently alive.
+ */
+int fake_kernel_task_count(void);
+
+/**
+ * @brief Core a live task was created on and its current priority.
+ *
+ * @param name Task name, compared up to the 15 characters the kernel keeps
+ * @param[out] core Core ID or tskNO_AFFINITY, may be NULL
+ * @param[out] priority Priority, may be NULL
+ * @return true if a task of that name is alive
+ */
+bool fake_kernel_task_placement(const char *name, int *core, int *priority);
+
+#pragma endregion
+
+#pragma region Heap
+
+/**
+ * @brief Size of the simulated internal heap, defaults to 320 KiB.
+ *
+ * Free size is this budget minus what the process allocated since start, so
+ * leaks and high-water marks of the component show up in
+ * esp_get_free_heap_size() and esp_get_minimum_free_heap_size().
+ */
+void fake_heap_set_size(size_t size);
+
+/**
+ * @brief Restart the minimum free heap tracking from the current value.
+ */
+void fake_heap_reset_minimum(void);
+
+#pragma endregion
+
+#pragma region System
+
+/**
+ * @brief Called by esp_restart() instead of exiting the process.
+ *
+ * The calling task is parked after the hook returns, like a device that is
+ * going down. Without a hook esp_restart() exits the process with status 0.
+ */
+void fake_system_set_restart_hook(void (*hook)(void));
+
+/**
+ * @brief Number of esp_restart() calls so far.
+ */
+int fake_system_restart_count(void);
+
+#pragma endregion
+
+#pragma region WiFi driver
+
+/// Outcome of a connection attempt to a network added with fake_wifi_add_network()
+typedef struct {
+    char ssid[33];
+    char password[65];
+    wifi_auth_mode_t authmode;
+    int8_t rssi;
+} fake_wifi_network_t;
+
+/// Driver state, as configured by the component through the esp_wifi API
+typedef struct {
+    bool initialized;
+    bool started;
+    wifi_mode_t mode;
+    char ap_ssid[33];
+    char sta_ssid[33];
+    bool sta_connected;
+    int connect_calls;
+    int scan_calls;
+    int start_calls;
+    int stop_calls;
+    int8_t max_tx_power;
+    int stations;
+} fake_wifi_state_t;
+
+/**
+ * @brief Add a network to the simulated air.
+ *
+ * Connecting with a matching SSID and password succeeds, anything else fails
+ * with WIFI_REASON_NO_AP_FOUND or WIFI_REASON_AUTH_FAIL. Networks are also
+ * returned by scans.
+ */
+void fake_wifi_add_network(const fake_wifi_network_t *network);
+
+/**
+ * @brief Remove all networks and reset the connection delay.
+ */
+void fake_wifi_clear_networks(void);
+
+/**
+ * @brief Delay between esp_wifi_connect() and its outcome, default 50 ms.
+ */
+void fake_wifi_set_connect_delay_ms(uint32_t delay_ms);
+
+/**
+ * @brief Scripted mode: connect and scan calls produce no events of their own.
+ *
+ * START and STOP events are still generated by the driver. Everything else
+ * comes from fake_wifi_inject(), which is how recorded traces are replayed.
+ */
+void fake_wifi_set_scripted(bool scripted);
+
+/**
+ * @brief Post an event as if the driver or the TCP/IP stack raised it.
+ *
+ * Events the driver could not raise in its current state (a station event
+ * while the AP is down, GOT_IP while the station is stopped) are dropped.
+ *
+ * @return true when the event was posted
+ */
+bool fake_wifi_inject(esp_event_base_t base, int32_t id, const void *data, size_t size);
+
+/**
+ * @brief Number of events fake_wifi_inject() dropped.
+ */
+int fake_wifi_dropped_events(void);
+
+/**
+ * @brief Associate a station with the softAP and assign it an address.
+ *
+ * @return station address in network byte order, 0 when the AP is not running
+ */
+uint32_t fake_wifi_station_join(const uint8_t mac[6]);
+
+/**
+ * @brief Disassociate a station from the softAP.
+ */
+void fake_wifi_station_leave(const uint8_t mac[6]);
+
+/**
+ * @brief Snapshot of the driver state.
+ */
+void fake_wifi_get_state(fake_wifi_state_t *state);
+
+/// Called on every esp_wifi API call the component makes, by name
+typedef void (*fake_wifi_observer_t)(const char *call, const fake_wifi_state_t *state, void *ctx);
+
+/**
+ * @brief Install an observer of driver calls, NULL to remove it.
+ */
+void fake_wifi_set_observer(fake_wifi_observer_t observer, void *ctx);
+
+#pragma endregion
+
+#pragma region Storage
+
+/**
+ * @brief Back a data partition with a file, mapped by esp_partition_mmap().
+ *
+ * @return ESP_OK, or ESP_ERR_NOT_FOUND when the file cannot be opened
+ */
+esp_err_t fake_partition_add_file(const char *label, const char *path);
+
+/**
+ * @brief Bytes written to the OTA partition by the last completed update.
+ */
+size_t fake_ota_last_image_size(void);
+
+/**
+ * @brief Label of the partition esp_ota_set_boot_partition() selected last.
+ */
+const char *fake_ota_boot_label(void);
+
+#pragma endregion
+
+#pragma region Network
+
+/**
+ * @brief Offset added to privileged ports (below 1024) on bind().
+ *
+ * Lets the DNS server bind next to a resolver already listening on port 53,
+ * or run without root.
+ */
+void fake_lwip_set_port_offset(uint16_t offset);
+
+#pragma endregion
+
+#pragma region HTTP server
+
+/**
+ * @brief Port of the next httpd_start(), overriding the configured one.
+ *
+ * Port 0 lets the kernel pick a free port, see fake_httpd_bound_port().
+ */
+void fake_httpd_set_port(uint16_t port);
+
+/**
+ * @brief Port the running server listens on, 0 when none runs.
+ */
+uint16_t fake_httpd_bound_port(void);
+
+/// Response of a request run with fake_httpd_invoke()
+typedef struct {
+    int status;                     ///< Status code, 200 unless the handler set another
+    char content_type[64];          ///< Content-Type of the response
+    char *body;                     ///< Body, NUL-terminated, owned by the response; httpd_send() bytes as is
+    size_t body_len;                ///< Body length
+    char headers[512];              ///< Extra headers as "Name: value\r\n" lines
+} fake_httpd_response_t;
+
+/**
+ * @brief Run a request through the registered handlers on the calling thread.
+ *
+ * The request never touches a socket: the body is served from memory and the
+ * response is collected into @p resp. Used by the unit tests and the
+ * benchmark, which want handler cost without the network stack.
+ *
+ * @param server Server started with httpd_start()
+ * @param method HTTP method
+ * @param uri Request URI including the query string
+ * @param headers Extra request headers as "Name: value\r\n" lines, or NULL
+ * @param body Request body, or NULL
+ * @param body_len Body length
+ * @param resp Collected response, release with fake_httpd_response_free()
+ * @return result of the handler, ESP_ERR_NOT_FOUND when no handler matched
+ */
+esp_err_t fake_httpd_invoke(httpd_handle_t server, httpd_method_t method, const char *uri, const char *headers,
+                            const void *body, size_t body_len, fake_httpd_response_t *resp);
+
+/**
+ * @brief Free the body of a response returned by fake_httpd_invoke().
+ */
+void fake_httpd_response_free(fake_httpd_response_t *resp);
+
+/**
+ * @brief Peer address fake_httpd_invoke() reports for its requests.
+ *
+ * @param ip IPv4 address in network byte order
+ */
+void fake_httpd_set_invoke_peer(uint32_t ip);
+
+#pragma endregion
+
+#pragma region Peripherals
+
+/**
+ * @brief Blink pattern the status LED plays, -1 when none is running.
+ *
+ * Like the real component the running pattern with the lowest index in the
+ * blink list wins.
+ *
+ * @param changes Set to the number of led_indicator_start() and
+ *                led_indicator_stop() calls so far, may be NULL
+ */
+int fake_led_pattern(int *changes);
+
+#pragma endregion
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,32 @@
+/**
+ * @file fake_newlib.h
+ * @brief newlib functions the component uses that glibc lacks.
+ *
+ * Force-included into the component sources (-include) so they compile
+ * unchanged. glibc 2.38 and later declare strlcpy/strlcat themselves.
+ */
+
+#pragma once
+
+#include <string.h>
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+static inline size_t fake_strlcpy(char *dst, const char *src, size_t size) {
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t copy = len < size - 1 ? len : size - 1;
+        memcpy(dst, src, copy);
+        dst[copy] = '\0';
+    }
+    return len;
+}
+
+static inline size_t fake_strlcat(char *dst, const char *src, size_t size) {
+    size_t used = strnlen(dst, size);
+    if (used == size) return size + strlen(src);
+    return used + fake_strlcpy(dst + used, src, size - used);
+}
+
+#define strlcpy fake_strlcpy
+#define strlcat fake_strlcat
+#endif
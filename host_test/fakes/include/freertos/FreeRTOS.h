@@ -0,0 +1,96 @@
+/**
+ * @file FreeRTOS.h
+ * @brief Host fake of the FreeRTOS kernel types and port layer.
+ *
+ * Tasks are POSIX threads scheduled by the host. The kernel objects
+ * (tasks, queues, semaphores, event groups) are implemented in
+ * fake_freertos.c on one kernel lock, with a tick clock that is either the
+ * monotonic clock or a virtual clock driven by the test (see fake_host.h).
+ * Critical sections map to one process-wide recursive mutex.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/param.h>      // MIN/MAX, which the target's port headers pull in
+
+#include "sdkconfig.h"
+#include "esp_attr.h"
+#include "esp_bit_defs.h"
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint8_t StackType_t;
+
+typedef void (*TaskFunction_t)(void *);
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+#define configMAX_PRIORITIES 25
+#define configMINIMAL_STACK_SIZE 768
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portNUM_PROCESSORS 2
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000U))
+#define pdTICKS_TO_MS(ticks) ((uint32_t)(((uint64_t)(ticks) * 1000U) / configTICK_RATE_HZ))
+
+#define tskNO_AFFINITY ((BaseType_t)0x7fffffff)
+#define tskIDLE_PRIORITY ((UBaseType_t)0)
+
+/**
+ * @brief Critical section lock; all of them share one recursive host mutex.
+ */
+typedef struct {
+    uint32_t owner;
+    uint32_t count;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0, 0 }
+
+void fake_port_enter_critical(portMUX_TYPE *mux);
+void fake_port_exit_critical(portMUX_TYPE *mux);
+BaseType_t xPortInIsrContext(void);
+
+#define portENTER_CRITICAL(mux) fake_port_enter_critical(mux)
+#define portEXIT_CRITICAL(mux) fake_port_exit_critical(mux)
+#define portENTER_CRITICAL_ISR(mux) fake_port_enter_critical(mux)
+#define portEXIT_CRITICAL_ISR(mux) fake_port_exit_critical(mux)
+#define taskENTER_CRITICAL(mux) fake_port_enter_critical(mux)
+#define taskEXIT_CRITICAL(mux) fake_port_exit_critical(mux)
+#define taskENTER_CRITICAL_ISR(mux) fake_port_enter_critical(mux)
+#define taskEXIT_CRITICAL_ISR(mux) fake_port_exit_critical(mux)
+#define portYIELD_FROM_ISR(...) do { } while (0)
+
+/** @brief Storage of a statically allocated task, large enough for the fake TCB */
+typedef struct {
+    uint64_t opaque[48];
+} StaticTask_t;
+
+/** @brief Storage of a statically allocated queue or semaphore */
+typedef struct {
+    uint64_t opaque[16];
+} StaticQueue_t;
+
+typedef StaticQueue_t StaticSemaphore_t;
+
+/** @brief Storage of a statically allocated event group */
+typedef struct {
+    uint64_t opaque[8];
+} StaticEventGroup_t;
+
+#ifdef __cplusplus
+}
+#endif
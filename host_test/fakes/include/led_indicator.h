@@ -0,0 +1,119 @@
+/**
+ * @file led_indicator.h
+ * @brief Host fake of the led_indicator component.
+ *
+ * Blink patterns are not played; started and stopped patterns, color and
+ * brightness are recorded for tests (see fake_host.h).
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void *led_indicator_handle_t;
+
+typedef enum {
+    LED_BLINK_STOP = -1,
+    LED_BLINK_HOLD,
+    LED_BLINK_BREATHE,
+    LED_BLINK_BRIGHTNESS,
+    LED_BLINK_RGB,
+    LED_BLINK_RGB_RING,
+    LED_BLINK_HSV,
+    LED_BLINK_HSV_RING,
+    LED_BLINK_LOOP,
+} blink_step_type_t;
+
+typedef struct {
+    blink_step_type_t type;
+    uint32_t value;
+    uint32_t hold_time_ms;
+} blink_step_t;
+
+#define LED_STATE_OFF 0
+#define LED_STATE_25_PERCENT 64
+#define LED_STATE_50_PERCENT 128
+#define LED_STATE_75_PERCENT 191
+#define LED_STATE_ON UINT8_MAX
+
+#define MAX_HUE 360
+#define MAX_SATURATION 255
+#define MAX_BRIGHTNESS 255
+#define SET_HSV(h, s, v) ((((h) & 0x1FF) << 16) | (((s) & 0xFF) << 8) | ((v) & 0xFF))
+
+typedef enum {
+    LED_PIXEL_FORMAT_GRB,
+    LED_PIXEL_FORMAT_GRBW,
+} led_pixel_format_t;
+
+typedef enum {
+    LED_MODEL_WS2812,
+    LED_MODEL_SK6812,
+} led_model_t;
+
+typedef enum {
+    LED_STRIP_RMT,
+    LED_STRIP_SPI,
+} led_strip_driver_t;
+
+typedef enum {
+    SPI_CLK_SRC_DEFAULT,
+} spi_clock_source_t;
+
+typedef struct {
+    int strip_gpio_num;
+    uint32_t max_leds;
+    led_pixel_format_t led_pixel_format;
+    led_model_t led_model;
+    struct {
+        uint32_t invert_out: 1;
+    } flags;
+} led_strip_config_t;
+
+typedef struct {
+    spi_clock_source_t clk_src;
+    int spi_bus;
+    struct {
+        uint32_t with_dma: 1;
+    } flags;
+} led_strip_spi_config_t;
+
+typedef struct {
+    led_strip_config_t led_strip_cfg;
+    led_strip_driver_t led_strip_driver;
+    led_strip_spi_config_t led_strip_spi_cfg;
+} led_indicator_strips_config_t;
+
+typedef enum {
+    LED_GPIO_MODE,
+    LED_LEDC_MODE,
+    LED_RGB_MODE,
+    LED_STRIPS_MODE,
+} led_indicator_mode_t;
+
+typedef struct {
+    led_indicator_mode_t mode;
+    union {
+        void *led_indicator_gpio_config;
+        led_indicator_strips_config_t *led_indicator_strips_config;
+    };
+    const blink_step_t **blink_lists;
+    uint16_t blink_list_num;
+} led_indicator_config_t;
+
+led_indicator_handle_t led_indicator_create(const led_indicator_config_t *config);
+esp_err_t led_indicator_delete(led_indicator_handle_t handle);
+esp_err_t led_indicator_start(led_indicator_handle_t handle, int blink_type);
+esp_err_t led_indicator_stop(led_indicator_handle_t handle, int blink_type);
+esp_err_t led_indicator_set_rgb(led_indicator_handle_t handle, uint32_t rgb_value);
+esp_err_t led_indicator_set_brightness(led_indicator_handle_t handle, uint32_t brightness);
+
+#ifdef __cplusplus
+}
+#endif
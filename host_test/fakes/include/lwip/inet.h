@@ -0,0 +1,37 @@
+/**
+ * @file inet.h
+ * @brief lwIP address conversion helpers of the host fake.
+ *
+ * Like lwIP, inet_ntoa(), inet_ntoa_r() and inet6_ntoa_r() are macros taking
+ * the address object itself, so a struct in_addr, a u32_t and an esp_ip4_addr_t
+ * field all work.
+ */
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lwip/opt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// From lwip/ip4_addr.h
+#define IPADDR_ANY ((uint32_t)0x00000000UL)
+#define IPADDR_NONE ((uint32_t)0xffffffffUL)
+
+char *fake_lwip_ntoa(const void *addr);
+char *fake_lwip_ntoa_r(const void *addr, char *buf, int buflen);
+char *fake_lwip_ntoa6_r(const void *addr, char *buf, int buflen);
+
+#define inet_ntoa(addr) fake_lwip_ntoa(&(addr))
+#define inet_ntoa_r(addr, buf, buflen) fake_lwip_ntoa_r(&(addr), buf, buflen)
+#define inet6_ntoa_r(addr, buf, buflen) fake_lwip_ntoa6_r(&(addr), buf, buflen)
+
+#ifdef __cplusplus
+}
+#endif
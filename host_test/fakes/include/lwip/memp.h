@@ -0,0 +1,14 @@
+/**
+ * @file memp.h
+ * @brief lwIP memory pool identifiers of the host fake.
+ */
+
+#pragma once
+
+#include "lwip/opt.h"
+
+typedef enum {
+#define LWIP_MEMPOOL(name, num, size, desc) MEMP_##name,
+#include "lwip/priv/memp_std.h"
+    MEMP_MAX
+} memp_t;
@@ -0,0 +1,10 @@
+/**
+ * @file netdb.h
+ * @brief lwIP name resolution API of the host fake.
+ */
+
+#pragma once
+
+#include <netdb.h>
+
+#include "lwip/opt.h"
@@ -0,0 +1,17 @@
+/**
+ * @file opt.h
+ * @brief lwIP options of the host fake, matching the ESP-IDF lwIP port.
+ */
+
+#pragma once
+
+#include "sdkconfig.h"
+
+#define LWIP_SOCKET_OFFSET 0
+#define LWIP_IPV4 1
+#define LWIP_IPV6 1
+#define LWIP_STATS CONFIG_LWIP_STATS
+#define MEMP_STATS LWIP_STATS
+#define TCP_STATS LWIP_STATS
+#define UDP_STATS LWIP_STATS
+#define TCP_LISTEN_BACKLOG 1
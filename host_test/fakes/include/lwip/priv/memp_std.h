@@ -0,0 +1,17 @@
+/**
+ * @file memp_std.h
+ * @brief Memory pools of the host fake, included with LWIP_MEMPOOL defined like in lwIP.
+ *
+ * No include guard: the file is included several times to build tables.
+ */
+
+LWIP_MEMPOOL(RAW_PCB, 16, 32, "RAW_PCB")
+LWIP_MEMPOOL(UDP_PCB, 16, 32, "UDP_PCB")
+LWIP_MEMPOOL(TCP_PCB, 16, 160, "TCP_PCB")
+LWIP_MEMPOOL(TCP_PCB_LISTEN, 16, 32, "TCP_PCB_LISTEN")
+LWIP_MEMPOOL(TCP_SEG, 16, 24, "TCP_SEG")
+LWIP_MEMPOOL(NETBUF, 2, 16, "NETBUF")
+LWIP_MEMPOOL(NETCONN, 10, 48, "NETCONN")
+LWIP_MEMPOOL(PBUF, 16, 16, "PBUF_REF/ROM")
+
+#undef LWIP_MEMPOOL
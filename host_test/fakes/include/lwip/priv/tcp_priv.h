@@ -0,0 +1,44 @@
+/**
+ * @file tcp_priv.h
+ * @brief lwIP TCP PCB lists of the host fake.
+ *
+ * Only the fields the component reads exist. The lists are empty unless the
+ * test links PCBs into them (see fake_host.h).
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "lwip/opt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct tcp_pcb {
+    struct tcp_pcb *next;
+    uint16_t local_port;
+    uint8_t nrtx;
+    uint16_t snd_queuelen;
+};
+
+struct tcp_pcb_listen {
+    struct tcp_pcb_listen *next;
+    uint16_t local_port;
+    uint8_t accepts_pending;
+    uint8_t backlog;
+};
+
+union tcp_listen_pcbs_t {
+    struct tcp_pcb_listen *listen_pcbs;
+    struct tcp_pcb *pcbs;
+};
+
+extern union tcp_listen_pcbs_t tcp_listen_pcbs;
+extern struct tcp_pcb *tcp_active_pcbs;
+extern struct tcp_pcb *tcp_tw_pcbs;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,44 @@
+/**
+ * @file sockets.h
+ * @brief lwIP socket API of the host fake, on top of the host sockets.
+ *
+ * Calls that block are routed through fake_lwip.c, which tells the fake
+ * kernel that the calling task is waiting so virtual-time replays keep
+ * running (see fake_host.h). Ports below 1024 are shifted by the port
+ * offset from fake_lwip_set_port_offset(), so the server runs unprivileged.
+ * getpeername() also answers for the requests fake_httpd_invoke() runs
+ * without a socket.
+ * The macros mirror lwIP's LWIP_COMPAT_SOCKETS names.
+ */
+
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "lwip/opt.h"
+#include "lwip/inet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int fake_lwip_bind(int s, const struct sockaddr *name, socklen_t namelen);
+int fake_lwip_setsockopt(int s, int level, int optname, const void *optval, socklen_t optlen);
+ssize_t fake_lwip_recvfrom(int s, void *mem, size_t len, int flags, struct sockaddr *from, socklen_t *fromlen);
+int fake_lwip_getpeername(int s, struct sockaddr *name, socklen_t *namelen);
+int lwip_fcntl(int s, int cmd, int val);
+
+#define bind(s, name, namelen) fake_lwip_bind(s, name, namelen)
+#define setsockopt(s, level, optname, opval, optlen) fake_lwip_setsockopt(s, level, optname, opval, optlen)
+#define recvfrom(s, mem, len, flags, from, fromlen) fake_lwip_recvfrom(s, mem, len, flags, from, fromlen)
+#define getpeername(s, name, namelen) fake_lwip_getpeername(s, name, namelen)
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,56 @@
+/**
+ * @file stats.h
+ * @brief lwIP statistics of the host fake.
+ *
+ * The counters are plain memory the test can set (see fake_host.h); the
+ * host stack does not update them.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "lwip/opt.h"
+#include "lwip/memp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t STAT_COUNTER;
+
+struct stats_proto {
+    STAT_COUNTER xmit;
+    STAT_COUNTER recv;
+    STAT_COUNTER fw;
+    STAT_COUNTER drop;
+    STAT_COUNTER chkerr;
+    STAT_COUNTER lenerr;
+    STAT_COUNTER memerr;
+    STAT_COUNTER rterr;
+    STAT_COUNTER proterr;
+    STAT_COUNTER opterr;
+    STAT_COUNTER err;
+    STAT_COUNTER cachehit;
+};
+
+struct stats_mem {
+    const char *name;
+    STAT_COUNTER err;
+    uint32_t avail;
+    uint32_t used;
+    uint32_t max;
+    STAT_COUNTER illegal;
+};
+
+struct stats_ {
+    struct stats_proto tcp;
+    struct stats_proto udp;
+    struct stats_mem *memp[MEMP_MAX];
+};
+
+extern struct stats_ lwip_stats;
+
+#ifdef __cplusplus
+}
+#endif
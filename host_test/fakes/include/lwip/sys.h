@@ -0,0 +1,12 @@
+/**
+ * @file sys.h
+ * @brief lwIP system abstraction of the host fake.
+ */
+
+#pragma once
+
+#include "lwip/opt.h"
+
+// sys_arch.h of the ESP-IDF port, which users of lwip/sys.h rely on
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
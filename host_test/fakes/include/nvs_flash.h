@@ -0,0 +1,21 @@
+/**
+ * @file nvs_flash.h
+ * @brief Host fake of the ESP-IDF NVS flash initialization.
+ */
+
+#pragma once
+
+#include "esp_err.h"
+#include "nvs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t nvs_flash_init(void);
+esp_err_t nvs_flash_erase(void);
+esp_err_t nvs_flash_deinit(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,37 @@
+/**
+ * @file sdmmc_cmd.h
+ * @brief Host fake of the SD/MMC protocol layer.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "driver/sdspi_host.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    char name[8];
+} sdmmc_cid_t;
+
+typedef struct {
+    int capacity;
+    int sector_size;
+} sdmmc_csd_t;
+
+typedef struct {
+    sdmmc_host_t host;
+    sdmmc_cid_t cid;
+    sdmmc_csd_t csd;
+    int real_freq_khz;
+} sdmmc_card_t;
+
+esp_err_t sdmmc_get_status(sdmmc_card_t *card);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,121 @@
+/**
+ * @file fake_esp_event.c
+ * @brief Default event loop: a queue and a "sys_evt" task running the handlers.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_event.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#define EVENT_QUEUE_LENGTH 32
+#define MAX_EVENT_HANDLERS 32
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    void *data;
+} posted_event_t;
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} event_handler_t;
+
+static QueueHandle_t event_queue;
+static TaskHandle_t event_task;
+static pthread_mutex_t handlers_lock = PTHREAD_MUTEX_INITIALIZER;
+static event_handler_t handlers[MAX_EVENT_HANDLERS];
+static size_t handler_count;
+
+static void event_task_fn(void *arg) {
+    (void)arg;
+    posted_event_t event;
+    for (;;) {
+        if (xQueueReceive(event_queue, &event, portMAX_DELAY) != pdTRUE) continue;
+        event_handler_t matching[MAX_EVENT_HANDLERS];
+        size_t count = 0;
+        pthread_mutex_lock(&handlers_lock);
+        for (size_t i = 0; i < handler_count; i++) {
+            bool base_match = handlers[i].base == ESP_EVENT_ANY_BASE || handlers[i].base == event.base;
+            bool id_match = handlers[i].id == ESP_EVENT_ANY_ID || handlers[i].id == event.id;
+            if (base_match && id_match) matching[count++] = handlers[i];
+        }
+        pthread_mutex_unlock(&handlers_lock);
+        for (size_t i = 0; i < count; i++) {
+            matching[i].handler(matching[i].arg, event.base, event.id, event.data);
+        }
+        free(event.data);
+    }
+}
+
+esp_err_t esp_event_loop_create_default(void) {
+    if (event_queue) return ESP_ERR_INVALID_STATE;
+    event_queue = xQueueCreate(EVENT_QUEUE_LENGTH, sizeof(posted_event_t));
+    if (!event_queue) return ESP_ERR_NO_MEM;
+    if (xTaskCreate(event_task_fn, "sys_evt", 2304, NULL, 20, &event_task) != pdPASS) {
+        vQueueDelete(event_queue);
+        event_queue = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_event_loop_delete_default(void) {
+    if (!event_queue) return ESP_ERR_INVALID_STATE;
+    vTaskDelete(event_task);
+    event_task = NULL;
+    posted_event_t event;
+    while (xQueueReceive(event_queue, &event, 0) == pdTRUE) {
+        free(event.data);
+    }
+    vQueueDelete(event_queue);
+    event_queue = NULL;
+    pthread_mutex_lock(&handlers_lock);
+    handler_count = 0;
+    pthread_mutex_unlock(&handlers_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t event_handler, void *event_handler_arg) {
+    return esp_event_handler_instance_register(event_base, event_id, event_handler, event_handler_arg, NULL);
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t event_base, int32_t event_id,
+                                              esp_event_handler_t event_handler, void *event_handler_arg,
+                                              esp_event_handler_instance_t *instance) {
+    if (!event_handler) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&handlers_lock);
+    if (handler_count == MAX_EVENT_HANDLERS) {
+        pthread_mutex_unlock(&handlers_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    handlers[handler_count] = (event_handler_t){ event_base, event_id, event_handler, event_handler_arg };
+    if (instance) *instance = &handlers[handler_count];
+    handler_count++;
+    pthread_mutex_unlock(&handlers_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id, const void *event_data,
+                         size_t event_data_size, TickType_t ticks_to_wait) {
+    if (!event_queue) return ESP_ERR_INVALID_STATE;
+    posted_event_t event = { event_base, event_id, NULL };
+    if (event_data && event_data_size) {
+        event.data = malloc(event_data_size);
+        if (!event.data) return ESP_ERR_NO_MEM;
+        memcpy(event.data, event_data, event_data_size);
+    }
+    if (xQueueSend(event_queue, &event, ticks_to_wait) != pdTRUE) {
+        free(event.data);
+        return ESP_ERR_TIMEOUT;
+    }
+    return ESP_OK;
+}
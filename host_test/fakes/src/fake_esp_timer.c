@@ -0,0 +1,138 @@
+/**
+ * @file fake_esp_timer.c
+ * @brief esp_timer on the fake kernel clock.
+ *
+ * Callbacks run in one "esp_timer" task, like ESP_TIMER_TASK dispatch on the
+ * target, which blocks in the kernel until the earliest expiry. In virtual
+ * time that deadline is what fake_kernel_advance_to() steps to.
+ */
+
+#include <stdlib.h>
+
+#include "esp_timer.h"
+#include "fake_kernel.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    uint64_t expiry;
+    uint64_t period;        ///< 0 for one-shot timers
+    bool active;
+    struct esp_timer *next;
+};
+
+static struct esp_timer *timers;
+static TaskHandle_t timer_task;
+static const int timers_changed = 0;    ///< Wait object of the timer task
+
+static void timer_task_fn(void *arg) {
+    (void)arg;
+    k_lock();
+    for (;;) {
+        struct esp_timer *due = NULL;
+        for (struct esp_timer *t = timers; t; t = t->next) {
+            if (t->active && (!due || t->expiry < due->expiry)) due = t;
+        }
+        if (!due) {
+            k_block(&timers_changed, K_FOREVER);
+            continue;
+        }
+        if (due->expiry > k_now_us()) {
+            k_block(&timers_changed, due->expiry);
+            continue;
+        }
+        if (due->period) {
+            due->expiry += due->period;
+        } else {
+            due->active = false;
+        }
+        esp_timer_cb_t callback = due->callback;
+        void *cb_arg = due->arg;
+        k_unlock();
+        callback(cb_arg);
+        k_lock();
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle) {
+    if (!create_args || !create_args->callback || !out_handle) return ESP_ERR_INVALID_ARG;
+    struct esp_timer *timer = calloc(1, sizeof(*timer));
+    if (!timer) return ESP_ERR_NO_MEM;
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    k_lock();
+    bool start_task = timer_task == NULL;
+    timer->next = timers;
+    timers = timer;
+    k_unlock();
+    if (start_task) {
+        xTaskCreate(timer_task_fn, "esp_timer", 4096, NULL, 22, &timer_task);
+    }
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period) {
+    if (!timer) return ESP_ERR_INVALID_ARG;
+    k_lock();
+    if (timer->active) {
+        k_unlock();
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->expiry = k_now_us() + timeout_us;
+    timer->period = period;
+    timer->active = true;
+    k_notify(&timers_changed);
+    k_unlock();
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+    if (period == 0) return ESP_ERR_INVALID_ARG;
+    return timer_start(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer) return ESP_ERR_INVALID_ARG;
+    k_lock();
+    bool was_active = timer->active;
+    timer->active = false;
+    k_notify(&timers_changed);
+    k_unlock();
+    return was_active ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (!timer) return ESP_ERR_INVALID_ARG;
+    k_lock();
+    if (timer->active) {
+        k_unlock();
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (struct esp_timer **p = &timers; *p; p = &(*p)->next) {
+        if (*p == timer) {
+            *p = timer->next;
+            break;
+        }
+    }
+    k_unlock();
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    k_lock();
+    bool active = timer && timer->active;
+    k_unlock();
+    return active;
+}
+
+int64_t esp_timer_get_time(void) {
+    return (int64_t)k_now_us();
+}
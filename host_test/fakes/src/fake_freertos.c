@@ -0,0 +1,813 @@
+/**
+ * @file fake_freertos.c
+ * @brief FreeRTOS tasks, queues, semaphores and event groups on pthreads.
+ *
+ * There is no preemption model: tasks run concurrently like on a multi-core
+ * target and priorities and core affinity are recorded but not enforced.
+ * What the fake does model is blocking: every wait goes through k_block(),
+ * so the kernel knows at any time how many tasks could still make progress.
+ * In virtual time (fake_kernel_set_virtual_time()) that is what lets the
+ * driver advance the clock only once the system settled.
+ *
+ * vTaskDelete() of another task takes effect when that task next enters the
+ * kernel, or immediately when it is blocked. A task blocked in a socket call
+ * (k_io_begin()) is cancelled.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "fake_kernel.h"
+#include "fake_host.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#pragma region Kernel
+
+struct fake_task {
+    pthread_t thread;
+    pthread_cond_t cond;
+    char name[16];
+    TaskFunction_t fn;
+    void *arg;
+    UBaseType_t priority;
+    BaseType_t core_id;
+    uint32_t stack_depth;
+    void *stack;                ///< Heap block standing in for the stack of a dynamic task
+    bool is_static;             ///< Control block lives in a StaticTask_t
+    bool counted;               ///< Created through the FreeRTOS API, counts for idle detection
+    bool blocked;
+    bool woken;                 ///< Woken while blocked, the waker already counted it as running
+    bool delete_pending;
+    bool in_io;
+    bool suspended;
+    const void *wait_obj;
+    uint64_t deadline;
+    uint32_t notify;
+    struct fake_task *next;
+};
+
+_Static_assert(sizeof(struct fake_task) <= sizeof(StaticTask_t), "StaticTask_t too small for the fake TCB");
+
+static pthread_mutex_t kernel_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond;
+static pthread_key_t task_key;
+static struct fake_task *tasks;
+static int running;
+static int task_count;
+static bool virtual_time;
+static uint64_t virtual_now;
+static struct timespec start_time;
+
+static void foreign_task_free(void *arg);
+
+__attribute__((constructor)) static void kernel_init(void) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&idle_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_key_create(&task_key, foreign_task_free);
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+}
+
+void k_lock(void) {
+    k_current();    // Threads the kernel did not start get their control block outside the lock
+    pthread_mutex_lock(&kernel_mutex);
+}
+
+void k_unlock(void) {
+    pthread_mutex_unlock(&kernel_mutex);
+}
+
+bool k_virtual(void) {
+    return virtual_time;
+}
+
+uint64_t k_now_us(void) {
+    if (virtual_time) {
+        return __atomic_load_n(&virtual_now, __ATOMIC_ACQUIRE);
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - start_time.tv_sec) * 1000000ULL +
+           (uint64_t)((now.tv_nsec - start_time.tv_nsec) / 1000);
+}
+
+uint64_t k_deadline_ticks(TickType_t ticks) {
+    if (ticks == portMAX_DELAY) return K_FOREVER;
+    return k_now_us() + (uint64_t)ticks * 1000000ULL / configTICK_RATE_HZ;
+}
+
+static void task_init_cond(struct fake_task *t) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&t->cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static void task_link(struct fake_task *t) {
+    t->next = tasks;
+    tasks = t;
+}
+
+static void task_unlink(struct fake_task *t) {
+    for (struct fake_task **p = &tasks; *p; p = &(*p)->next) {
+        if (*p == t) {
+            *p = t->next;
+            return;
+        }
+    }
+}
+
+static void foreign_task_free(void *arg) {
+    struct fake_task *t = arg;
+    pthread_mutex_lock(&kernel_mutex);
+    task_unlink(t);
+    pthread_mutex_unlock(&kernel_mutex);
+    pthread_cond_destroy(&t->cond);
+    free(t);
+}
+
+struct fake_task *k_current(void) {
+    struct fake_task *t = pthread_getspecific(task_key);
+    if (t) return t;
+    t = calloc(1, sizeof(*t));
+    if (!t) abort();
+    strcpy(t->name, "host");
+    t->thread = pthread_self();
+    t->deadline = K_FOREVER;
+    task_init_cond(t);
+    pthread_setspecific(task_key, t);
+    pthread_mutex_lock(&kernel_mutex);
+    task_link(t);
+    pthread_mutex_unlock(&kernel_mutex);
+    return t;
+}
+
+static void running_dec(void) {
+    if (--running == 0) pthread_cond_broadcast(&idle_cond);
+}
+
+static void task_wake(struct fake_task *t) {
+    if (t->blocked && !t->woken) {
+        t->woken = true;
+        if (t->counted) running++;
+        pthread_cond_signal(&t->cond);
+    }
+}
+
+/**
+ * @brief Remove a running task from the kernel, kernel lock held.
+ *
+ * Releases the kernel lock. The caller exits the thread afterwards.
+ */
+static void task_retire(struct fake_task *t) {
+    task_unlink(t);
+    task_count--;
+    if (t->counted) running_dec();
+    pthread_setspecific(task_key, NULL);
+    k_unlock();
+    free(t->stack);
+    pthread_cond_destroy(&t->cond);
+    if (!t->is_static) free(t);
+}
+
+static void task_check_delete(struct fake_task *t) {
+    if (t->delete_pending) {
+        task_retire(t);
+        pthread_exit(NULL);
+    }
+}
+
+bool k_block(const void *obj, uint64_t deadline_us) {
+    struct fake_task *t = k_current();
+    task_check_delete(t);
+    if (deadline_us != K_FOREVER && k_now_us() >= deadline_us) return false;
+    fake_heap_sample();
+    t->wait_obj = obj;
+    t->deadline = deadline_us;
+    t->blocked = true;
+    t->woken = false;
+    if (t->counted) running_dec();
+    while (!t->woken) {
+        if (virtual_time || deadline_us == K_FOREVER) {
+            pthread_cond_wait(&t->cond, &kernel_mutex);
+        } else {
+            uint64_t abs_us = (uint64_t)start_time.tv_sec * 1000000ULL + start_time.tv_nsec / 1000 + deadline_us;
+            struct timespec ts = { .tv_sec = abs_us / 1000000ULL, .tv_nsec = (abs_us % 1000000ULL) * 1000 };
+            if (pthread_cond_timedwait(&t->cond, &kernel_mutex, &ts) == ETIMEDOUT) break;
+        }
+    }
+    if (!t->woken && t->counted) running++;
+    t->blocked = false;
+    t->woken = false;
+    t->wait_obj = NULL;
+    t->deadline = K_FOREVER;
+    task_check_delete(t);
+    return deadline_us == K_FOREVER || k_now_us() < deadline_us;
+}
+
+void k_notify(const void *obj) {
+    for (struct fake_task *t = tasks; t; t = t->next) {
+        if (t->blocked && !t->in_io && t->wait_obj == obj) task_wake(t);
+    }
+}
+
+void k_io_begin(uint64_t deadline_us) {
+    struct fake_task *t = k_current();
+    k_lock();
+    task_check_delete(t);
+    t->in_io = true;
+    t->blocked = true;
+    t->woken = false;
+    t->wait_obj = NULL;
+    t->deadline = deadline_us;
+    if (t->counted) running_dec();
+    k_unlock();
+}
+
+bool k_io_expired(void) {
+    struct fake_task *t = k_current();
+    k_lock();
+    bool expired = t->woken;
+    k_unlock();
+    return expired;
+}
+
+bool k_io_end(void) {
+    struct fake_task *t = k_current();
+    k_lock();
+    bool expired = t->woken;
+    if (!t->woken && t->counted) running++;
+    t->in_io = false;
+    t->blocked = false;
+    t->woken = false;
+    t->deadline = K_FOREVER;
+    task_check_delete(t);
+    k_unlock();
+    return !expired;
+}
+
+/**
+ * @brief Cancellation cleanup of a task deleted inside a socket call.
+ */
+void k_io_cancelled(void *arg) {
+    (void)arg;
+    struct fake_task *t = pthread_getspecific(task_key);
+    k_lock();
+    if (!t->woken && t->counted) running++;
+    t->in_io = false;
+    t->blocked = false;
+    task_retire(t);
+}
+
+static uint64_t next_deadline_locked(void) {
+    uint64_t next = K_FOREVER;
+    for (struct fake_task *t = tasks; t; t = t->next) {
+        if (t->blocked && !t->woken && t->deadline < next) next = t->deadline;
+    }
+    return next;
+}
+
+void fake_kernel_set_virtual_time(bool enable) {
+    k_lock();
+    virtual_time = enable;
+    virtual_now = 0;
+    k_unlock();
+}
+
+void fake_kernel_wait_idle(void) {
+    if (!virtual_time) return;
+    k_lock();
+    while (running > 0) {
+        pthread_cond_wait(&idle_cond, &kernel_mutex);
+    }
+    k_unlock();
+}
+
+uint64_t fake_kernel_next_deadline(void) {
+    k_lock();
+    uint64_t next = next_deadline_locked();
+    k_unlock();
+    return next;
+}
+
+void fake_kernel_advance_to(uint64_t time_us) {
+    for (;;) {
+        fake_kernel_wait_idle();
+        k_lock();
+        uint64_t next = next_deadline_locked();
+        uint64_t step = next < time_us ? next : time_us;
+        if (step > virtual_now) __atomic_store_n(&virtual_now, step, __ATOMIC_RELEASE);
+        for (struct fake_task *t = tasks; t; t = t->next) {
+            if (t->blocked && t->deadline <= virtual_now) task_wake(t);
+        }
+        bool done = next > time_us;
+        k_unlock();
+        if (done) break;
+    }
+    fake_kernel_wait_idle();
+}
+
+uint64_t fake_kernel_now_us(void) {
+    return k_now_us();
+}
+
+int fake_kernel_task_count(void) {
+    k_lock();
+    int count = task_count;
+    k_unlock();
+    return count;
+}
+
+bool fake_kernel_task_placement(const char *name, int *core, int *priority) {
+    bool found = false;
+    k_lock();
+    for (struct fake_task *t = tasks; t; t = t->next) {
+        // Names are truncated like configMAX_TASK_NAME_LEN does on the target
+        if (t->delete_pending || strncmp(t->name, name, sizeof(t->name) - 1) != 0) continue;
+        if (core) *core = t->core_id;
+        if (priority) *priority = t->priority;
+        found = true;
+        break;
+    }
+    k_unlock();
+    return found;
+}
+
+#pragma endregion
+
+#pragma region Critical sections
+
+static pthread_mutex_t critical_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+void fake_port_enter_critical(portMUX_TYPE *mux) {
+    (void)mux;
+    pthread_mutex_lock(&critical_mutex);
+}
+
+void fake_port_exit_critical(portMUX_TYPE *mux) {
+    (void)mux;
+    pthread_mutex_unlock(&critical_mutex);
+}
+
+BaseType_t xPortInIsrContext(void) {
+    return pdFALSE;
+}
+
+#pragma endregion
+
+#pragma region Tasks
+
+static void *task_main(void *arg) {
+    struct fake_task *t = arg;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    pthread_setspecific(task_key, t);
+    k_lock();
+    task_check_delete(t);
+    k_unlock();
+    t->fn(t->arg);
+    // Returning from a task function is an error on the target; treat it as a self-delete
+    k_lock();
+    task_retire(t);
+    return NULL;
+}
+
+static struct fake_task *task_start(struct fake_task *t, TaskFunction_t fn, const char *name, uint32_t stack_depth,
+                                    void *arg, UBaseType_t priority, BaseType_t core_id) {
+    t->fn = fn;
+    t->arg = arg;
+    t->priority = priority;
+    t->core_id = core_id;
+    t->stack_depth = stack_depth;
+    t->counted = true;
+    t->deadline = K_FOREVER;
+    strncpy(t->name, name ? name : "", sizeof(t->name) - 1);
+    task_init_cond(t);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    k_lock();
+    task_link(t);
+    task_count++;
+    running++;
+    int rc = pthread_create(&t->thread, &attr, task_main, t);
+    if (rc != 0) {
+        task_unlink(t);
+        task_count--;
+        running_dec();
+    }
+    k_unlock();
+    pthread_attr_destroy(&attr);
+    return rc == 0 ? t : NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core_id) {
+    struct fake_task *t = calloc(1, sizeof(*t));
+    void *stack = malloc(stack_depth);
+    if (!t || !stack) {
+        free(t);
+        free(stack);
+        return pdFAIL;
+    }
+    t->stack = stack;
+    if (!task_start(t, fn, name, stack_depth, arg, priority, core_id)) {
+        free(stack);
+        free(t);
+        return pdFAIL;
+    }
+    if (created_task) *created_task = t;
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg, UBaseType_t priority,
+                       TaskHandle_t *created_task) {
+    return xTaskCreatePinnedToCore(fn, name, stack_depth, arg, priority, created_task, tskNO_AFFINITY);
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                                           UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb,
+                                           BaseType_t core_id) {
+    if (!stack || !tcb) return NULL;
+    struct fake_task *t = (struct fake_task *)tcb;
+    memset(t, 0, sizeof(*t));
+    t->is_static = true;
+    return task_start(t, fn, name, stack_depth, arg, priority, core_id);
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                               UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb) {
+    return xTaskCreateStaticPinnedToCore(fn, name, stack_depth, arg, priority, stack, tcb, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    struct fake_task *self = k_current();
+    if (!task || task == self) {
+        k_lock();
+        task_retire(self);
+        pthread_exit(NULL);
+    }
+    k_lock();
+    task->delete_pending = true;
+    if (task->in_io) {
+        pthread_cancel(task->thread);
+    } else if (task->blocked) {
+        task_wake(task);
+    }
+    k_unlock();
+}
+
+void vTaskSuspend(TaskHandle_t task) {
+    struct fake_task *self = k_current();
+    struct fake_task *t = task ? task : self;
+    k_lock();
+    t->suspended = true;
+    if (t == self) {
+        while (t->suspended) {
+            k_block(&t->suspended, K_FOREVER);
+        }
+    }
+    k_unlock();
+}
+
+void vTaskResume(TaskHandle_t task) {
+    k_lock();
+    task->suspended = false;
+    k_notify(&task->suspended);
+    k_unlock();
+}
+
+void vTaskDelay(TickType_t ticks) {
+    struct fake_task *t = k_current();
+    if (ticks == 0) {
+        k_lock();
+        task_check_delete(t);
+        k_unlock();
+        sched_yield();
+        return;
+    }
+    uint64_t deadline = k_deadline_ticks(ticks);
+    k_lock();
+    while (k_block(t, deadline)) {
+    }
+    k_unlock();
+}
+
+void vTaskDelayUntil(TickType_t *previous_wake, TickType_t increment) {
+    struct fake_task *t = k_current();
+    *previous_wake += increment;
+    uint64_t deadline = (uint64_t)*previous_wake * 1000000ULL / configTICK_RATE_HZ;
+    k_lock();
+    while (k_block(t, deadline)) {
+    }
+    k_unlock();
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(k_now_us() * configTICK_RATE_HZ / 1000000ULL);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return k_current();
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority) {
+    struct fake_task *t = task ? task : k_current();
+    t->priority = priority;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    struct fake_task *t = task ? task : k_current();
+    return t->priority;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    // Host stacks say nothing about target stacks; report half the stack as headroom
+    struct fake_task *t = task ? task : k_current();
+    return t->stack_depth / 2;
+}
+
+char *pcTaskGetName(TaskHandle_t task) {
+    struct fake_task *t = task ? task : k_current();
+    return t->name;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    k_lock();
+    task->notify++;
+    k_notify(&task->notify);
+    k_unlock();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken) {
+    xTaskNotifyGive(task);
+    if (higher_priority_task_woken) *higher_priority_task_woken = pdFALSE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait) {
+    struct fake_task *t = k_current();
+    uint64_t deadline = k_deadline_ticks(ticks_to_wait);
+    k_lock();
+    while (t->notify == 0) {
+        if (!k_block(&t->notify, deadline) && t->notify == 0) {
+            k_unlock();
+            return 0;
+        }
+    }
+    uint32_t value = t->notify;
+    t->notify = clear_on_exit ? 0 : value - 1;
+    k_unlock();
+    return value;
+}
+
+#pragma endregion
+
+#pragma region Queues and semaphores
+
+struct fake_queue {
+    uint8_t *storage;
+    size_t item_size;
+    size_t length;
+    size_t count;
+    size_t head;
+    bool is_static;
+};
+
+_Static_assert(sizeof(struct fake_queue) <= sizeof(StaticQueue_t), "StaticQueue_t too small for the fake queue");
+
+#define RECEIVERS(q) ((const void *)(q))
+#define SENDERS(q) ((const void *)((const uint8_t *)(q) + 1))
+
+static void queue_init(struct fake_queue *q, size_t length, size_t item_size, uint8_t *storage, bool is_static) {
+    memset(q, 0, sizeof(*q));
+    q->storage = storage;
+    q->item_size = item_size;
+    q->length = length;
+    q->is_static = is_static;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    struct fake_queue *q = malloc(sizeof(*q) + (size_t)length * item_size);
+    if (!q) return NULL;
+    queue_init(q, length, item_size, (uint8_t *)(q + 1), false);
+    return q;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *queue) {
+    if (!queue || (item_size > 0 && !storage)) return NULL;
+    struct fake_queue *q = (struct fake_queue *)queue;
+    queue_init(q, length, item_size, storage, true);
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    if (queue && !queue->is_static) free(queue);
+}
+
+static BaseType_t queue_send(QueueHandle_t q, const void *item, TickType_t ticks_to_wait, bool front) {
+    uint64_t deadline = k_deadline_ticks(ticks_to_wait);
+    k_lock();
+    while (q->count == q->length) {
+        if (!k_block(SENDERS(q), deadline) && q->count == q->length) {
+            k_unlock();
+            return pdFAIL;
+        }
+    }
+    if (q->item_size > 0) {
+        size_t slot;
+        if (front) {
+            q->head = (q->head + q->length - 1) % q->length;
+            slot = q->head;
+        } else {
+            slot = (q->head + q->count) % q->length;
+        }
+        memcpy(q->storage + slot * q->item_size, item, q->item_size);
+    }
+    q->count++;
+    k_notify(RECEIVERS(q));
+    k_unlock();
+    return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait) {
+    return queue_send(queue, item, ticks_to_wait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks_to_wait) {
+    return queue_send(queue, item, ticks_to_wait, true);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higher_priority_task_woken) {
+    if (higher_priority_task_woken) *higher_priority_task_woken = pdFALSE;
+    return queue_send(queue, item, 0, false);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks_to_wait) {
+    uint64_t deadline = k_deadline_ticks(ticks_to_wait);
+    k_lock();
+    while (q->count == 0) {
+        if (!k_block(RECEIVERS(q), deadline) && q->count == 0) {
+            k_unlock();
+            return pdFAIL;
+        }
+    }
+    if (q->item_size > 0) {
+        memcpy(item, q->storage + q->head * q->item_size, q->item_size);
+        q->head = (q->head + 1) % q->length;
+    }
+    q->count--;
+    k_notify(SENDERS(q));
+    k_unlock();
+    return pdPASS;
+}
+
+BaseType_t xQueueReset(QueueHandle_t q) {
+    k_lock();
+    q->count = 0;
+    q->head = 0;
+    k_notify(SENDERS(q));
+    k_unlock();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+    k_lock();
+    UBaseType_t count = q->count;
+    k_unlock();
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q) {
+    k_lock();
+    UBaseType_t spaces = q->length - q->count;
+    k_unlock();
+    return spaces;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count) {
+    SemaphoreHandle_t sem = xQueueCreate(max_count, 0);
+    if (sem) sem->count = initial_count;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer) {
+    return xQueueCreateStatic(1, 0, NULL, buffer);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer) {
+    SemaphoreHandle_t sem = xQueueCreateStatic(1, 0, NULL, buffer);
+    if (sem) sem->count = 1;
+    return sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks_to_wait) {
+    return xQueueReceive(sem, NULL, ticks_to_wait);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    return queue_send(sem, NULL, 0, false);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *higher_priority_task_woken) {
+    if (higher_priority_task_woken) *higher_priority_task_woken = pdFALSE;
+    return xSemaphoreGive(sem);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    vQueueDelete(sem);
+}
+
+#pragma endregion
+
+#pragma region Event groups
+
+struct fake_event_group {
+    EventBits_t bits;
+    bool is_static;
+};
+
+_Static_assert(sizeof(struct fake_event_group) <= sizeof(StaticEventGroup_t),
+               "StaticEventGroup_t too small for the fake event group");
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    return calloc(1, sizeof(struct fake_event_group));
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buffer) {
+    if (!buffer) return NULL;
+    struct fake_event_group *group = (struct fake_event_group *)buffer;
+    memset(group, 0, sizeof(*group));
+    group->is_static = true;
+    return group;
+}
+
+void vEventGroupDelete(EventGroupHandle_t group) {
+    if (group && !group->is_static) free(group);
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    k_lock();
+    group->bits |= bits;
+    EventBits_t result = group->bits;
+    k_notify(group);
+    k_unlock();
+    return result;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    k_lock();
+    EventBits_t result = group->bits;
+    group->bits &= ~bits;
+    k_unlock();
+    return result;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    k_lock();
+    EventBits_t result = group->bits;
+    k_unlock();
+    return result;
+}
+
+static bool bits_match(EventBits_t current, EventBits_t bits, BaseType_t wait_for_all) {
+    return wait_for_all ? (current & bits) == bits : (current & bits) != 0;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks_to_wait) {
+    uint64_t deadline = k_deadline_ticks(ticks_to_wait);
+    k_lock();
+    while (!bits_match(group->bits, bits, wait_for_all)) {
+        if (!k_block(group, deadline) && !bits_match(group->bits, bits, wait_for_all)) {
+            EventBits_t result = group->bits;
+            k_unlock();
+            return result;
+        }
+    }
+    EventBits_t result = group->bits;
+    if (clear_on_exit) group->bits &= ~bits;
+    k_unlock();
+    return result;
+}
+
+#pragma endregion
@@ -0,0 +1,1494 @@
+/**
+ * @file fake_httpd.c
+ * @brief The ESP-IDF HTTP server on POSIX sockets.
+ *
+ * Follows esp_http_server closely enough for the component to behave as on
+ * the target: one server task multiplexes the listening socket, a control
+ * pipe and the sessions with select() and runs handlers one at a time.
+ * Headers are read in 128 byte blocks and what is read past them is kept as
+ * the session's pending data, exactly like httpd_unrecv(). Session hooks
+ * (open_fn, close_fn, send/recv overrides), LRU purge, error handlers,
+ * chunked responses, async handlers, queued work and WebSocket sessions are
+ * supported; HTTP/1.1 only, no chunked request bodies.
+ *
+ * In virtual time the server opens no socket. Its task only runs queued
+ * work, blocking in the kernel, so replays stay deterministic.
+ *
+ * fake_httpd_invoke() runs a request on the calling thread with the body in
+ * memory and the response captured, for tests and benchmarks.
+ */
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "esp_http_server.h"
+#include "fake_host.h"
+#include "fake_internal.h"
+#include "fake_kernel.h"
+#include "freertos/semphr.h"
+
+/// Size of the blocks headers are read in, and of the pending data of a session
+#define PARSER_BLOCK_SIZE 128
+/// Request line and headers, like the scratch buffer of esp_http_server
+#define SCRATCH_SIZE (HTTPD_MAX_URI_LEN + HTTPD_MAX_REQ_HDR_LEN)
+/// Socket of requests run by fake_httpd_invoke(), beyond any real descriptor
+#define INVOKE_SOCKFD 0x7ff0
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+typedef struct {
+    bool in_use;
+    int fd;
+    bool for_async_req;         ///< Detached by httpd_req_async_handler_begin(), the server leaves it alone
+    bool close_pending;         ///< httpd_sess_trigger_close() was called
+    bool websocket;
+    const httpd_uri_t *ws_handler;
+    uint64_t lru;
+    httpd_send_func_t send_fn;
+    httpd_recv_func_t recv_fn;
+    void *ctx;
+    httpd_free_ctx_fn_t free_ctx;
+    char pending[PARSER_BLOCK_SIZE];
+    size_t pending_len;
+} session_t;
+
+typedef struct work_item {
+    httpd_work_fn_t fn;
+    void *arg;
+    struct work_item *next;
+} work_item_t;
+
+typedef struct {
+    httpd_config_t config;
+    httpd_uri_t *handlers;          ///< max_uri_handlers slots, uri NULL when free
+    httpd_err_handler_func_t err_handlers[HTTPD_ERR_CODE_MAX];
+    session_t *sessions;            ///< max_open_sockets slots
+    pthread_mutex_t lock;           ///< Protects sessions and the work list against other tasks
+    work_item_t *work_head;
+    work_item_t *work_tail;
+    SemaphoreHandle_t work_sem;     ///< Wakes the server task in virtual time
+    SemaphoreHandle_t stopped;      ///< Given by the server task when it exits
+    int listen_fd;
+    int ctrl[2];                    ///< Pipe that wakes select()
+    uint16_t port;
+    bool stop;
+    uint64_t lru_counter;
+    char scratch[SCRATCH_SIZE + 1];
+} server_t;
+
+/**
+ * @brief What esp_http_server keeps in req->aux.
+ */
+typedef struct {
+    server_t *server;
+    session_t *session;             ///< NULL for fake_httpd_invoke()
+    int fd;
+    const char *headers;            ///< Header lines, "Name: value\r\n" each
+    char *headers_copy;             ///< Owned copy for async requests
+    size_t remaining;               ///< Body bytes not received yet
+    bool detached;                  ///< Handed over to an async copy
+    // Response
+    const char *status;
+    const char *content_type;
+    const char **resp_hdrs;         ///< max_resp_headers field/value pairs
+    size_t resp_hdr_count;
+    bool chunked;                   ///< Headers of a chunked response were sent
+    bool responded;
+    // WebSocket frame being received
+    bool ws_frame;
+    bool ws_fin;
+    uint8_t ws_type;
+    uint8_t ws_mask[4];
+    bool ws_masked;
+    uint64_t ws_len;
+    bool ws_payload_read;
+    // In-memory request
+    fake_httpd_response_t *capture;
+    const uint8_t *body;
+} request_aux_t;
+
+static pthread_mutex_t servers_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool port_override_set;
+static uint16_t port_override;
+static uint16_t bound_port;
+static uint32_t invoke_peer = 0x0204a8c0;      // 192.168.4.2
+
+static const char *const err_status[HTTPD_ERR_CODE_MAX] = {
+    [HTTPD_500_INTERNAL_SERVER_ERROR] = "500 Internal Server Error",
+    [HTTPD_501_METHOD_NOT_IMPLEMENTED] = "501 Method Not Implemented",
+    [HTTPD_505_VERSION_NOT_SUPPORTED] = "505 Version Not Supported",
+    [HTTPD_400_BAD_REQUEST] = "400 Bad Request",
+    [HTTPD_401_UNAUTHORIZED] = "401 Unauthorized",
+    [HTTPD_403_FORBIDDEN] = "403 Forbidden",
+    [HTTPD_404_NOT_FOUND] = "404 Not Found",
+    [HTTPD_405_METHOD_NOT_ALLOWED] = "405 Method Not Allowed",
+    [HTTPD_408_REQ_TIMEOUT] = "408 Request Timeout",
+    [HTTPD_411_LENGTH_REQUIRED] = "411 Length Required",
+    [HTTPD_413_CONTENT_TOO_LARGE] = "413 Content Too Large",
+    [HTTPD_414_URI_TOO_LONG] = "414 URI Too Long",
+    [HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE] = "431 Request Header Fields Too Large",
+};
+
+static const char *const err_message[HTTPD_ERR_CODE_MAX] = {
+    [HTTPD_500_INTERNAL_SERVER_ERROR] = "Server has encountered an unexpected error",
+    [HTTPD_501_METHOD_NOT_IMPLEMENTED] = "Server does not support this method",
+    [HTTPD_505_VERSION_NOT_SUPPORTED] = "HTTP version not supported by server",
+    [HTTPD_400_BAD_REQUEST] = "Bad request syntax",
+    [HTTPD_401_UNAUTHORIZED] = "No permission -- see authorization schemes",
+    [HTTPD_403_FORBIDDEN] = "Request forbidden -- authorization will not help",
+    [HTTPD_404_NOT_FOUND] = "Nothing matches the given URI",
+    [HTTPD_405_METHOD_NOT_ALLOWED] = "Specified method is invalid for this resource",
+    [HTTPD_408_REQ_TIMEOUT] = "Server closed this connection",
+    [HTTPD_411_LENGTH_REQUIRED] = "Client must specify Content-Length",
+    [HTTPD_413_CONTENT_TOO_LARGE] = "Content is too large",
+    [HTTPD_414_URI_TOO_LONG] = "URI is too long",
+    [HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE] = "Header fields are too long",
+};
+
+#pragma region Sessions
+
+static int default_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags) {
+    (void)hd;
+    if (buf == NULL) return HTTPD_SOCK_ERR_INVALID;
+    ssize_t ret = send(sockfd, buf, buf_len, flags | MSG_NOSIGNAL);
+    if (ret < 0) return (errno == EAGAIN || errno == EINTR) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    return (int)ret;
+}
+
+static int default_recv(httpd_handle_t hd, int sockfd, char *buf, size_t buf_len, int flags) {
+    (void)hd;
+    if (buf == NULL) return HTTPD_SOCK_ERR_INVALID;
+    ssize_t ret = recv(sockfd, buf, buf_len, flags);
+    if (ret < 0) return (errno == EAGAIN || errno == EINTR) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    return (int)ret;
+}
+
+static session_t *session_find(server_t *srv, int sockfd) {
+    for (int i = 0; i < srv->config.max_open_sockets; i++) {
+        if (srv->sessions[i].in_use && srv->sessions[i].fd == sockfd) return &srv->sessions[i];
+    }
+    return NULL;
+}
+
+static int session_count(server_t *srv) {
+    int count = 0;
+    for (int i = 0; i < srv->config.max_open_sockets; i++) {
+        if (srv->sessions[i].in_use) count++;
+    }
+    return count;
+}
+
+/**
+ * @brief Close a session, server task only.
+ */
+static void session_close(server_t *srv, session_t *s) {
+    if (s->free_ctx) {
+        s->free_ctx(s->ctx);
+    } else {
+        free(s->ctx);
+    }
+    int fd = s->fd;
+    pthread_mutex_lock(&srv->lock);
+    memset(s, 0, sizeof(*s));
+    pthread_mutex_unlock(&srv->lock);
+    if (srv->config.close_fn) {
+        srv->config.close_fn(srv, fd);
+    } else {
+        close(fd);
+    }
+}
+
+/**
+ * @brief Receive from a session, pending data first.
+ */
+static int session_recv(server_t *srv, session_t *s, char *buf, size_t len) {
+    if (s->pending_len > 0) {
+        size_t n = len < s->pending_len ? len : s->pending_len;
+        memcpy(buf, s->pending, n);
+        memmove(s->pending, s->pending + n, s->pending_len - n);
+        s->pending_len -= n;
+        return (int)n;
+    }
+    return s->recv_fn(srv, s->fd, buf, len, 0);
+}
+
+static int session_recv_all(server_t *srv, session_t *s, char *buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        int ret = session_recv(srv, s, buf + got, len - got);
+        if (ret <= 0) return ret == 0 ? HTTPD_SOCK_ERR_FAIL : ret;
+        got += (size_t)ret;
+    }
+    return (int)got;
+}
+
+static int session_send_all(server_t *srv, session_t *s, const char *buf, size_t len) {
+    size_t sent = 0;
+    while (sent < len) {
+        int ret = s->send_fn(srv, s->fd, buf + sent, len - sent, 0);
+        if (ret < 0) return ret;
+        sent += (size_t)ret;
+    }
+    return (int)sent;
+}
+
+static void session_unrecv(session_t *s, const char *buf, size_t len) {
+    memmove(s->pending + len, s->pending, s->pending_len);
+    memcpy(s->pending, buf, len);
+    s->pending_len += len;
+}
+
+#pragma endregion
+
+#pragma region Requests
+
+static request_aux_t *aux_of(httpd_req_t *r) {
+    return r ? (request_aux_t *)r->aux : NULL;
+}
+
+static void capture_append(fake_httpd_response_t *resp, const char *buf, size_t len) {
+    char *body = realloc(resp->body, resp->body_len + len + 1);
+    if (!body) abort();
+    memcpy(body + resp->body_len, buf, len);
+    resp->body = body;
+    resp->body_len += len;
+    resp->body[resp->body_len] = '\0';
+}
+
+/**
+ * @brief Send raw bytes of a response.
+ *
+ * @return bytes sent or a negative HTTPD_SOCK_ERR_ code
+ */
+static int req_send_raw(request_aux_t *ra, const char *buf, size_t len) {
+    if (ra->capture) {
+        capture_append(ra->capture, buf, len);
+        return (int)len;
+    }
+    if (!ra->session) return HTTPD_SOCK_ERR_INVALID;
+    return session_send_all(ra->server, ra->session, buf, len);
+}
+
+/**
+ * @brief Send the status line and headers of a response in one piece.
+ */
+static esp_err_t req_send_headers(request_aux_t *ra, const char *length_header) {
+    const char *status = ra->status ? ra->status : HTTPD_200;
+    const char *type = ra->content_type ? ra->content_type : HTTPD_TYPE_TEXT;
+    if (ra->capture) {
+        ra->capture->status = atoi(status);
+        snprintf(ra->capture->content_type, sizeof(ra->capture->content_type), "%s", type);
+        size_t used = 0;
+        ra->capture->headers[0] = '\0';
+        for (size_t i = 0; i < ra->resp_hdr_count; i++) {
+            int n = snprintf(ra->capture->headers + used, sizeof(ra->capture->headers) - used, "%s: %s\r\n",
+                             ra->resp_hdrs[2 * i], ra->resp_hdrs[2 * i + 1]);
+            if (n < 0 || (size_t)n >= sizeof(ra->capture->headers) - used) break;
+            used += (size_t)n;
+        }
+        return ESP_OK;
+    }
+    size_t cap = 256 + strlen(status) + strlen(type);
+    for (size_t i = 0; i < ra->resp_hdr_count; i++) {
+        cap += strlen(ra->resp_hdrs[2 * i]) + strlen(ra->resp_hdrs[2 * i + 1]) + 4;
+    }
+    char *buf = malloc(cap);
+    if (!buf) return ESP_ERR_HTTPD_ALLOC_MEM;
+    int len = snprintf(buf, cap, "HTTP/1.1 %s\r\nContent-Type: %s\r\n%s", status, type, length_header);
+    for (size_t i = 0; i < ra->resp_hdr_count; i++) {
+        len += snprintf(buf + len, cap - (size_t)len, "%s: %s\r\n", ra->resp_hdrs[2 * i], ra->resp_hdrs[2 * i + 1]);
+    }
+    len += snprintf(buf + len, cap - (size_t)len, "\r\n");
+    int ret = req_send_raw(ra, buf, (size_t)len);
+    free(buf);
+    return ret < 0 ? ESP_ERR_HTTPD_RESP_HDR : ESP_OK;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r) {
+    request_aux_t *ra = aux_of(r);
+    return ra ? ra->fd : -1;
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len) {
+    request_aux_t *ra = aux_of(r);
+    if (!ra || !buf) return HTTPD_SOCK_ERR_INVALID;
+    if (ra->remaining == 0) return 0;
+    size_t want = buf_len < ra->remaining ? buf_len : ra->remaining;
+    if (ra->capture) {
+        memcpy(buf, ra->body + (r->content_len - ra->remaining), want);
+        ra->remaining -= want;
+        return (int)want;
+    }
+    int ret = session_recv(ra->server, ra->session, buf, want);
+    if (ret > 0) ra->remaining -= (size_t)ret;
+    return ret;
+}
+
+/**
+ * @brief Find a header line, case-insensitive.
+ *
+ * @param value Set to the start of the value
+ * @return length of the value, -1 when the header is missing
+ */
+static int header_find(const char *headers, const char *field, const char **value) {
+    size_t field_len = strlen(field);
+    for (const char *line = headers; line && *line;) {
+        const char *end = strstr(line, "\r\n");
+        size_t line_len = end ? (size_t)(end - line) : strlen(line);
+        if (line_len > field_len && line[field_len] == ':' && strncasecmp(line, field, field_len) == 0) {
+            const char *v = line + field_len + 1;
+            while (*v == ' ' || *v == '\t') v++;
+            size_t v_len = line_len - (size_t)(v - line);
+            while (v_len > 0 && (v[v_len - 1] == ' ' || v[v_len - 1] == '\t')) v_len--;
+            *value = v;
+            return (int)v_len;
+        }
+        line = end ? end + 2 : NULL;
+    }
+    return -1;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field) {
+    request_aux_t *ra = aux_of(r);
+    const char *value;
+    if (!ra || !field) return 0;
+    int len = header_find(ra->headers, field, &value);
+    return len < 0 ? 0 : (size_t)len;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size) {
+    request_aux_t *ra = aux_of(r);
+    if (!ra || !field || !val) return ESP_ERR_INVALID_ARG;
+    const char *value;
+    int len = header_find(ra->headers, field, &value);
+    if (len < 0) return ESP_ERR_NOT_FOUND;
+    if (val_size == 0) return ESP_ERR_HTTPD_RESULT_TRUNC;
+    size_t copy = (size_t)len < val_size - 1 ? (size_t)len : val_size - 1;
+    memcpy(val, value, copy);
+    val[copy] = '\0';
+    return (size_t)len >= val_size ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r) {
+    if (!r) return 0;
+    const char *query = strchr(r->uri, '?');
+    return query ? strcspn(query + 1, "#") : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len) {
+    if (!r || !buf) return ESP_ERR_INVALID_ARG;
+    const char *query = strchr(r->uri, '?');
+    if (!query) return ESP_ERR_NOT_FOUND;
+    size_t len = strcspn(query + 1, "#");
+    if (buf_len == 0) return ESP_ERR_HTTPD_RESULT_TRUNC;
+    size_t copy = len < buf_len - 1 ? len : buf_len - 1;
+    memcpy(buf, query + 1, copy);
+    buf[copy] = '\0';
+    return len >= buf_len ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size) {
+    if (!qry || !key || !val) return ESP_ERR_INVALID_ARG;
+    const char *qry_ptr = qry;
+    size_t key_len = strlen(key);
+    while (*qry_ptr) {
+        const char *val_ptr = strchr(qry_ptr, '=');
+        if (!val_ptr) break;
+        size_t offset = (size_t)(val_ptr - qry_ptr);
+        if (offset != key_len || strncasecmp(qry_ptr, key, offset) != 0) {
+            qry_ptr = strchr(val_ptr, '&');
+            if (!qry_ptr) break;
+            qry_ptr++;
+            continue;
+        }
+        val_ptr++;
+        const char *end = strchr(val_ptr, '&');
+        if (!end) end = val_ptr + strlen(val_ptr);
+        size_t needed = (size_t)(end - val_ptr) + 1;
+        if (val_size > 0) {
+            size_t copy = needed < val_size ? needed - 1 : val_size - 1;
+            memcpy(val, val_ptr, copy);
+            val[copy] = '\0';
+        }
+        return val_size < needed ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status) {
+    request_aux_t *ra = aux_of(r);
+    if (!ra || !status) return ESP_ERR_INVALID_ARG;
+    ra->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type) {
+    request_aux_t *ra = aux_of(r);
+    if (!ra || !type) return ESP_ERR_INVALID_ARG;
+    ra->content_type = type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value) {
+    request_aux_t *ra = aux_of(r);
+    if (!ra || !field || !value) return ESP_ERR_INVALID_ARG;
+    if (ra->resp_hdr_count >= ra->server->config.max_resp_headers) return ESP_ERR_HTTPD_RESP_HDR;
+    ra->resp_hdrs[2 * ra->resp_hdr_count] = field;
+    ra->resp_hdrs[2 * ra->resp_hdr_count + 1] = value;
+    ra->resp_hdr_count++;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    request_aux_t *ra = aux_of(r);
+    if (!ra) return ESP_ERR_INVALID_ARG;
+    size_t len = buf == NULL ? 0 : buf_len == HTTPD_RESP_USE_STRLEN ? strlen(buf) : (size_t)buf_len;
+    char length_header[48];
+    snprintf(length_header, sizeof(length_header), "Content-Length: %zu\r\n", len);
+    ra->responded = true;
+    esp_err_t err = req_send_headers(ra, length_header);
+    if (err != ESP_OK) return err;
+    if (len > 0 && req_send_raw(ra, buf, len) < 0) return ESP_ERR_HTTPD_RESP_SEND;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+    request_aux_t *ra = aux_of(r);
+    if (!ra) return ESP_ERR_INVALID_ARG;
+    size_t len = buf == NULL ? 0 : buf_len == HTTPD_RESP_USE_STRLEN ? strlen(buf) : (size_t)buf_len;
+    if (!ra->chunked) {
+        ra->chunked = true;
+        ra->responded = true;
+        esp_err_t err = req_send_headers(ra, "Transfer-Encoding: chunked\r\n");
+        if (err != ESP_OK) return err;
+    }
+    if (ra->capture) {
+        if (len > 0) capture_append(ra->capture, buf, len);
+        return ESP_OK;
+    }
+    char size_line[16];
+    int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+    if (req_send_raw(ra, size_line, (size_t)n) < 0) return ESP_ERR_HTTPD_RESP_SEND;
+    if (len > 0 && req_send_raw(ra, buf, len) < 0) return ESP_ERR_HTTPD_RESP_SEND;
+    if (req_send_raw(ra, "\r\n", 2) < 0) return ESP_ERR_HTTPD_RESP_SEND;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *msg) {
+    request_aux_t *ra = aux_of(req);
+    if (!ra || error < 0 || error >= HTTPD_ERR_CODE_MAX) return ESP_ERR_INVALID_ARG;
+    ra->status = err_status[error];
+    ra->content_type = HTTPD_TYPE_TEXT;
+    return httpd_resp_send(req, msg ? msg : err_message[error], HTTPD_RESP_USE_STRLEN);
+}
+
+int httpd_send(httpd_req_t *r, const char *buf, size_t buf_len) {
+    request_aux_t *ra = aux_of(r);
+    if (!ra || !buf) return HTTPD_SOCK_ERR_INVALID;
+    ra->responded = true;
+    if (ra->capture) {
+        capture_append(ra->capture, buf, buf_len);
+        return (int)buf_len;
+    }
+    return ra->session->send_fn(ra->server, ra->fd, buf, buf_len, 0);
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out) {
+    request_aux_t *ra = aux_of(r);
+    if (!ra || !out) return ESP_ERR_INVALID_ARG;
+    httpd_req_t *copy = malloc(sizeof(*copy));
+    request_aux_t *aux = malloc(sizeof(*aux));
+    const char **hdrs = calloc(2 * (size_t)ra->server->config.max_resp_headers + 2, sizeof(*hdrs));
+    char *headers = strdup(ra->headers ? ra->headers : "");
+    if (!copy || !aux || !hdrs || !headers) {
+        free(copy);
+        free(aux);
+        free(hdrs);
+        free(headers);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, r, sizeof(*copy));
+    memcpy(aux, ra, sizeof(*aux));
+    memcpy(hdrs, ra->resp_hdrs, 2 * ra->resp_hdr_count * sizeof(*hdrs));
+    aux->resp_hdrs = hdrs;
+    aux->headers = headers;
+    aux->headers_copy = headers;
+    copy->aux = aux;
+    ra->detached = true;
+    if (ra->session) {
+        pthread_mutex_lock(&ra->server->lock);
+        ra->session->for_async_req = true;
+        pthread_mutex_unlock(&ra->server->lock);
+    }
+    *out = copy;
+    return ESP_OK;
+}
+
+static void server_wake(server_t *srv);
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r) {
+    request_aux_t *ra = aux_of(r);
+    if (!ra) return ESP_ERR_INVALID_ARG;
+    if (ra->session) {
+        pthread_mutex_lock(&ra->server->lock);
+        ra->session->for_async_req = false;
+        pthread_mutex_unlock(&ra->server->lock);
+        server_wake(ra->server);
+    }
+    free(ra->headers_copy);
+    free((void *)ra->resp_hdrs);
+    free(ra);
+    free(r);
+    return ESP_OK;
+}
+
+#pragma endregion
+
+#pragma region WebSocket
+
+static void sha1(const uint8_t *data, size_t len, uint8_t digest[20]) {
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    size_t total = ((len + 8) / 64 + 1) * 64;
+    uint8_t *msg = calloc(1, total);
+    if (!msg) abort();
+    memcpy(msg, data, len);
+    msg[len] = 0x80;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; i++) msg[total - 1 - i] = (uint8_t)(bits >> (8 * i));
+    for (size_t block = 0; block < total; block += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            const uint8_t *p = msg + block + 4 * i;
+            w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+        }
+        for (int i = 16; i < 80; i++) {
+            uint32_t x = w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16];
+            w[i] = x << 1 | x >> 31;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            uint32_t t = (a << 5 | a >> 27) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = b << 30 | b >> 2;
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    free(msg);
+    for (int i = 0; i < 20; i++) digest[i] = (uint8_t)(h[i / 4] >> (24 - 8 * (i % 4)));
+}
+
+static void base64(const uint8_t *in, size_t len, char *out) {
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t o = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)in[i] << 16 | (i + 1 < len ? (uint32_t)in[i + 1] << 8 : 0) | (i + 2 < len ? in[i + 2] : 0);
+        out[o++] = table[v >> 18 & 63];
+        out[o++] = table[v >> 12 & 63];
+        out[o++] = i + 1 < len ? table[v >> 6 & 63] : '=';
+        out[o++] = i + 2 < len ? table[v & 63] : '=';
+    }
+    out[o] = '\0';
+}
+
+/**
+ * @brief Answer the upgrade request of a WebSocket handler.
+ */
+static esp_err_t ws_handshake(request_aux_t *ra) {
+    const char *key;
+    int key_len = header_find(ra->headers, "Sec-WebSocket-Key", &key);
+    const char *upgrade;
+    int upgrade_len = header_find(ra->headers, "Upgrade", &upgrade);
+    if (key_len <= 0 || key_len > 64 || upgrade_len != 9 || strncasecmp(upgrade, "websocket", 9) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    char accept_src[64 + sizeof(WS_GUID)];
+    memcpy(accept_src, key, (size_t)key_len);
+    memcpy(accept_src + key_len, WS_GUID, sizeof(WS_GUID));
+    uint8_t digest[20];
+    sha1((const uint8_t *)accept_src, (size_t)key_len + sizeof(WS_GUID) - 1, digest);
+    char accept[32];
+    base64(digest, sizeof(digest), accept);
+    char response[160];
+    int len = snprintf(response, sizeof(response),
+                       "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                       "Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+    return req_send_raw(ra, response, (size_t)len) < 0 ? ESP_FAIL : ESP_OK;
+}
+
+/**
+ * @brief Read the header of the next frame of a WebSocket session.
+ */
+static esp_err_t ws_read_header(request_aux_t *ra) {
+    uint8_t head[2];
+    if (session_recv_all(ra->server, ra->session, (char *)head, 2) < 0) return ESP_FAIL;
+    ra->ws_fin = head[0] & 0x80;
+    ra->ws_type = head[0] & 0x0f;
+    ra->ws_masked = head[1] & 0x80;
+    uint64_t len = head[1] & 0x7f;
+    if (len >= 126) {
+        uint8_t ext[8];
+        size_t ext_len = len == 126 ? 2 : 8;
+        if (session_recv_all(ra->server, ra->session, (char *)ext, ext_len) < 0) return ESP_FAIL;
+        len = 0;
+        for (size_t i = 0; i < ext_len; i++) len = len << 8 | ext[i];
+    }
+    ra->ws_len = len;
+    if (ra->ws_masked && session_recv_all(ra->server, ra->session, (char *)ra->ws_mask, 4) < 0) return ESP_FAIL;
+    ra->ws_frame = true;
+    ra->ws_payload_read = false;
+    return ESP_OK;
+}
+
+static esp_err_t ws_read_payload(request_aux_t *ra, uint8_t *buf) {
+    if (ra->ws_len > 0 && session_recv_all(ra->server, ra->session, (char *)buf, (size_t)ra->ws_len) < 0) {
+        return ESP_FAIL;
+    }
+    if (ra->ws_masked) {
+        for (uint64_t i = 0; i < ra->ws_len; i++) buf[i] ^= ra->ws_mask[i % 4];
+    }
+    ra->ws_payload_read = true;
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *pkt, size_t max_len) {
+    request_aux_t *ra = aux_of(req);
+    if (!ra || !pkt || !ra->session || !ra->session->websocket) return ESP_ERR_INVALID_ARG;
+    if (!ra->ws_frame && ws_read_header(ra) != ESP_OK) return ESP_FAIL;
+    pkt->final = ra->ws_fin;
+    pkt->type = (httpd_ws_type_t)ra->ws_type;
+    pkt->fragmented = !ra->ws_fin || ra->ws_type == HTTPD_WS_TYPE_CONTINUE;
+    pkt->len = (size_t)ra->ws_len;
+    if (max_len == 0) return ESP_OK;
+    if (!pkt->payload) return ESP_ERR_INVALID_ARG;
+    if (max_len < pkt->len) return ESP_ERR_INVALID_SIZE;
+    if (ra->ws_payload_read) return ESP_ERR_INVALID_STATE;
+    return ws_read_payload(ra, pkt->payload);
+}
+
+/**
+ * @brief Build and send a server frame, never masked.
+ */
+static esp_err_t ws_send(server_t *srv, session_t *s, const httpd_ws_frame_t *frame) {
+    uint8_t head[10];
+    size_t head_len = 2;
+    head[0] = (uint8_t)frame->type | ((!frame->fragmented || frame->final) ? 0x80 : 0);
+    if (frame->len < 126) {
+        head[1] = (uint8_t)frame->len;
+    } else if (frame->len <= 0xffff) {
+        head[1] = 126;
+        head[2] = (uint8_t)(frame->len >> 8);
+        head[3] = (uint8_t)frame->len;
+        head_len = 4;
+    } else {
+        head[1] = 127;
+        for (int i = 0; i < 8; i++) head[2 + i] = (uint8_t)((uint64_t)frame->len >> (56 - 8 * i));
+        head_len = 10;
+    }
+    if (session_send_all(srv, s, (const char *)head, head_len) < 0) return ESP_FAIL;
+    if (frame->len > 0 && session_send_all(srv, s, (const char *)frame->payload, frame->len) < 0) return ESP_FAIL;
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *pkt) {
+    request_aux_t *ra = aux_of(req);
+    if (!ra || !pkt || !ra->session) return ESP_ERR_INVALID_ARG;
+    return ws_send(ra->server, ra->session, pkt);
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame) {
+    server_t *srv = hd;
+    if (!srv || !frame) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&srv->lock);
+    session_t *s = session_find(srv, fd);
+    pthread_mutex_unlock(&srv->lock);
+    if (!s || !s->websocket) return ESP_ERR_INVALID_ARG;
+    return ws_send(srv, s, frame);
+}
+
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd) {
+    server_t *srv = hd;
+    if (!srv) return HTTPD_WS_CLIENT_INVALID;
+    pthread_mutex_lock(&srv->lock);
+    session_t *s = session_find(srv, fd);
+    httpd_ws_client_info_t info = !s ? HTTPD_WS_CLIENT_INVALID : s->websocket ? HTTPD_WS_CLIENT_WEBSOCKET
+                                                                              : HTTPD_WS_CLIENT_HTTP;
+    pthread_mutex_unlock(&srv->lock);
+    return info;
+}
+
+#pragma endregion
+
+#pragma region URI handlers
+
+bool httpd_uri_match_wildcard(const char *uri_template, const char *uri_to_match, size_t match_upto) {
+    const size_t tpl_len = strlen(uri_template);
+    size_t exact_match_chars = tpl_len;
+    const char last = tpl_len > 0 ? uri_template[tpl_len - 1] : 0;
+    const char prevlast = tpl_len > 1 ? uri_template[tpl_len - 2] : 0;
+    const bool asterisk = last == '*' || (prevlast == '*' && last == '?');
+    const bool quest = last == '?' || (prevlast == '?' && last == '*');
+    if (exact_match_chars < (size_t)(asterisk + quest * 2)) return false;
+    exact_match_chars -= asterisk + quest * 2;
+    if (match_upto < exact_match_chars) return false;
+    if (!quest) {
+        if (!asterisk && match_upto != exact_match_chars) return false;
+        return strncmp(uri_template, uri_to_match, exact_match_chars) == 0;
+    }
+    if (match_upto > exact_match_chars && uri_template[exact_match_chars] != uri_to_match[exact_match_chars]) {
+        return false;
+    }
+    if (strncmp(uri_template, uri_to_match, exact_match_chars) != 0) return false;
+    return asterisk || match_upto <= exact_match_chars + 1;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler) {
+    server_t *srv = handle;
+    if (!srv || !uri_handler || !uri_handler->uri) return ESP_ERR_INVALID_ARG;
+    httpd_uri_t *free_slot = NULL;
+    for (int i = 0; i < srv->config.max_uri_handlers; i++) {
+        httpd_uri_t *h = &srv->handlers[i];
+        if (!h->uri) {
+            if (!free_slot) free_slot = h;
+        } else if (h->method == uri_handler->method && strcmp(h->uri, uri_handler->uri) == 0) {
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    if (!free_slot) return ESP_ERR_HTTPD_HANDLERS_FULL;
+    char *uri = strdup(uri_handler->uri);
+    if (!uri) return ESP_ERR_HTTPD_ALLOC_MEM;
+    *free_slot = *uri_handler;
+    free_slot->uri = uri;
+    return ESP_OK;
+}
+
+esp_err_t httpd_unregister_uri_handler(httpd_handle_t handle, const char *uri, httpd_method_t method) {
+    server_t *srv = handle;
+    if (!srv || !uri) return ESP_ERR_INVALID_ARG;
+    for (int i = 0; i < srv->config.max_uri_handlers; i++) {
+        httpd_uri_t *h = &srv->handlers[i];
+        if (h->uri && h->method == method && strcmp(h->uri, uri) == 0) {
+            free((char *)h->uri);
+            memset(h, 0, sizeof(*h));
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_unregister_uri(httpd_handle_t handle, const char *uri) {
+    server_t *srv = handle;
+    if (!srv || !uri) return ESP_ERR_INVALID_ARG;
+    bool found = false;
+    for (int i = 0; i < srv->config.max_uri_handlers; i++) {
+        httpd_uri_t *h = &srv->handlers[i];
+        if (h->uri && strcmp(h->uri, uri) == 0) {
+            free((char *)h->uri);
+            memset(h, 0, sizeof(*h));
+            found = true;
+        }
+    }
+    return found ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_register_err_handler(httpd_handle_t handle, httpd_err_code_t error, httpd_err_handler_func_t handler_fn) {
+    server_t *srv = handle;
+    if (!srv || error < 0 || error >= HTTPD_ERR_CODE_MAX) return ESP_ERR_INVALID_ARG;
+    srv->err_handlers[error] = handler_fn;
+    return ESP_OK;
+}
+
+/**
+ * @brief Answer a request the server cannot route, like httpd_req_handle_err().
+ *
+ * @return ESP_OK when a custom error handler took care of it and the session stays open
+ */
+static esp_err_t handle_err(server_t *srv, httpd_req_t *req, httpd_err_code_t error) {
+    if (srv->err_handlers[error]) return srv->err_handlers[error](req, error);
+    httpd_resp_send_err(req, error, NULL);
+    return ESP_FAIL;
+}
+
+/**
+ * @brief Find the handler of a request.
+ *
+ * @param method_mismatch Set when a handler matched the URI but not the method
+ */
+static const httpd_uri_t *find_handler(server_t *srv, const char *uri, int method, bool *method_mismatch) {
+    size_t match_upto = strcspn(uri, "?");
+    *method_mismatch = false;
+    for (int i = 0; i < srv->config.max_uri_handlers; i++) {
+        const httpd_uri_t *h = &srv->handlers[i];
+        if (!h->uri) continue;
+        bool match = srv->config.uri_match_fn ? srv->config.uri_match_fn(h->uri, uri, match_upto)
+                                              : strlen(h->uri) == match_upto && strncmp(h->uri, uri, match_upto) == 0;
+        if (!match) continue;
+        if ((int)h->method == method || h->method == HTTP_ANY) return h;
+        *method_mismatch = true;
+    }
+    return NULL;
+}
+
+#pragma endregion
+
+#pragma region Server
+
+static void server_wake(server_t *srv) {
+    if (k_virtual()) {
+        xSemaphoreGive(srv->work_sem);
+    } else {
+        char c = 0;
+        ssize_t ignored = write(srv->ctrl[1], &c, 1);
+        (void)ignored;
+    }
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg) {
+    server_t *srv = handle;
+    if (!srv || !work) return ESP_ERR_INVALID_ARG;
+    work_item_t *item = malloc(sizeof(*item));
+    if (!item) return ESP_ERR_NO_MEM;
+    item->fn = work;
+    item->arg = arg;
+    item->next = NULL;
+    pthread_mutex_lock(&srv->lock);
+    bool stopping = srv->stop;
+    if (!stopping) {
+        if (srv->work_tail) {
+            srv->work_tail->next = item;
+        } else {
+            srv->work_head = item;
+        }
+        srv->work_tail = item;
+    }
+    pthread_mutex_unlock(&srv->lock);
+    if (stopping) {
+        free(item);
+        return ESP_FAIL;
+    }
+    server_wake(srv);
+    return ESP_OK;
+}
+
+static void run_work(server_t *srv) {
+    for (;;) {
+        pthread_mutex_lock(&srv->lock);
+        work_item_t *item = srv->work_head;
+        if (item) {
+            srv->work_head = item->next;
+            if (!srv->work_head) srv->work_tail = NULL;
+        }
+        pthread_mutex_unlock(&srv->lock);
+        if (!item) return;
+        item->fn(item->arg);
+        free(item);
+    }
+}
+
+static void request_init(server_t *srv, httpd_req_t *req, request_aux_t *ra, const char **resp_hdrs) {
+    memset(req, 0, sizeof(*req));
+    memset(ra, 0, sizeof(*ra));
+    ra->server = srv;
+    ra->resp_hdrs = resp_hdrs;
+    req->handle = srv;
+    req->aux = ra;
+}
+
+/**
+ * @brief Run a routed request through its handler.
+ *
+ * @return false to close the session
+ */
+static bool dispatch(server_t *srv, httpd_req_t *req, request_aux_t *ra) {
+    bool method_mismatch;
+    const httpd_uri_t *h = find_handler(srv, req->uri, req->method, &method_mismatch);
+    if (!h) return handle_err(srv, req, method_mismatch ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND) == ESP_OK;
+    req->user_ctx = h->user_ctx;
+    if (ra->session) {
+        req->sess_ctx = ra->session->ctx;
+        req->free_ctx = ra->session->free_ctx;
+    }
+    if (h->is_websocket) {
+        if (!ra->session || req->method != HTTP_GET || ws_handshake(ra) != ESP_OK) {
+            handle_err(srv, req, HTTPD_400_BAD_REQUEST);
+            return false;
+        }
+        pthread_mutex_lock(&srv->lock);
+        ra->session->websocket = true;
+        ra->session->ws_handler = h;
+        pthread_mutex_unlock(&srv->lock);
+    }
+    esp_err_t ret = h->handler(req);
+    if (ra->session && !ra->detached) {
+        ra->session->ctx = req->sess_ctx;
+        ra->session->free_ctx = req->free_ctx;
+    }
+    return ret == ESP_OK;
+}
+
+/**
+ * @brief Read and parse the request line and headers into the scratch buffer.
+ *
+ * @return false to close the session, after answering with an error where the server would
+ */
+static bool read_request(server_t *srv, session_t *s, httpd_req_t *req, request_aux_t *ra) {
+    size_t len = 0;
+    char *end = NULL;
+    while (!end) {
+        if (len == SCRATCH_SIZE) {
+            handle_err(srv, req, HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE);
+            return false;
+        }
+        size_t block = SCRATCH_SIZE - len < PARSER_BLOCK_SIZE ? SCRATCH_SIZE - len : PARSER_BLOCK_SIZE;
+        int ret = session_recv(srv, s, srv->scratch + len, block);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            handle_err(srv, req, HTTPD_408_REQ_TIMEOUT);
+            return false;
+        }
+        if (ret <= 0) return false;
+        len += (size_t)ret;
+        srv->scratch[len] = '\0';
+        end = strstr(srv->scratch, "\r\n\r\n");
+    }
+    size_t used = (size_t)(end - srv->scratch) + 4;
+    if (used < len) session_unrecv(s, srv->scratch + used, len - used);
+    end[2] = '\0';
+
+    static const struct {
+        const char *name;
+        int method;
+    } methods[] = {
+        { "GET", HTTP_GET }, { "POST", HTTP_POST }, { "PUT", HTTP_PUT }, { "DELETE", HTTP_DELETE },
+        { "HEAD", HTTP_HEAD }, { "OPTIONS", HTTP_OPTIONS }, { "PATCH", HTTP_PATCH },
+    };
+    char *line_end = strstr(srv->scratch, "\r\n");
+    *line_end = '\0';
+    ra->headers = line_end + 2;
+    if (strlen(ra->headers) > HTTPD_MAX_REQ_HDR_LEN) {
+        handle_err(srv, req, HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE);
+        return false;
+    }
+    char *sp1 = strchr(srv->scratch, ' ');
+    char *sp2 = sp1 ? strchr(sp1 + 1, ' ') : NULL;
+    if (!sp1 || !sp2) {
+        handle_err(srv, req, HTTPD_400_BAD_REQUEST);
+        return false;
+    }
+    *sp1 = '\0';
+    *sp2 = '\0';
+    req->method = -1;
+    for (size_t i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        if (strcmp(srv->scratch, methods[i].name) == 0) req->method = methods[i].method;
+    }
+    if (req->method < 0) {
+        handle_err(srv, req, HTTPD_501_METHOD_NOT_IMPLEMENTED);
+        return false;
+    }
+    if (strcmp(sp2 + 1, "HTTP/1.1") != 0) {
+        handle_err(srv, req, HTTPD_505_VERSION_NOT_SUPPORTED);
+        return false;
+    }
+    if (strlen(sp1 + 1) > HTTPD_MAX_URI_LEN) {
+        handle_err(srv, req, HTTPD_414_URI_TOO_LONG);
+        return false;
+    }
+    strcpy((char *)req->uri, sp1 + 1);
+    const char *value;
+    if (header_find(ra->headers, "Content-Length", &value) >= 0) {
+        req->content_len = strtoul(value, NULL, 10);
+    }
+    ra->remaining = req->content_len;
+    return true;
+}
+
+/**
+ * @brief Serve one request of a plain session.
+ *
+ * @return false to close the session
+ */
+static bool serve_request(server_t *srv, session_t *s) {
+    httpd_req_t req;
+    request_aux_t ra;
+    const char *resp_hdrs[2 * 32];
+    request_init(srv, &req, &ra, resp_hdrs);
+    ra.session = s;
+    ra.fd = s->fd;
+    if (!read_request(srv, s, &req, &ra)) return false;
+    bool keep = dispatch(srv, &req, &ra);
+    if (ra.detached) return true;
+    // Discard the part of the body the handler did not read
+    char discard[PARSER_BLOCK_SIZE];
+    while (keep && ra.remaining > 0) {
+        int ret = httpd_req_recv(&req, discard, sizeof(discard));
+        if (ret <= 0) keep = false;
+    }
+    return keep;
+}
+
+/**
+ * @brief Serve one frame of a WebSocket session.
+ *
+ * @return false to close the session
+ */
+static bool serve_frame(server_t *srv, session_t *s) {
+    httpd_req_t req;
+    request_aux_t ra;
+    const char *resp_hdrs[2 * 32];
+    request_init(srv, &req, &ra, resp_hdrs);
+    ra.session = s;
+    ra.fd = s->fd;
+    req.method = 0;     // Only the handshake is a GET
+    snprintf((char *)req.uri, sizeof(req.uri), "%s", s->ws_handler->uri);
+    req.user_ctx = s->ws_handler->user_ctx;
+    req.sess_ctx = s->ctx;
+    req.free_ctx = s->free_ctx;
+    if (ws_read_header(&ra) != ESP_OK) return false;
+
+    if (!s->ws_handler->handle_ws_control_frames && ra.ws_type >= HTTPD_WS_TYPE_CLOSE) {
+        uint8_t payload[125];
+        if (ra.ws_len > sizeof(payload) || ws_read_payload(&ra, payload) != ESP_OK) return false;
+        httpd_ws_frame_t reply = { .final = true, .payload = payload, .len = (size_t)ra.ws_len };
+        if (ra.ws_type == HTTPD_WS_TYPE_PING) {
+            reply.type = HTTPD_WS_TYPE_PONG;
+            return ws_send(srv, s, &reply) == ESP_OK;
+        }
+        if (ra.ws_type == HTTPD_WS_TYPE_CLOSE) {
+            reply.type = HTTPD_WS_TYPE_CLOSE;
+            ws_send(srv, s, &reply);
+            return false;
+        }
+        return true;    // Unsolicited PONG
+    }
+
+    esp_err_t ret = s->ws_handler->handler(&req);
+    s->ctx = req.sess_ctx;
+    s->free_ctx = req.free_ctx;
+    if (ret != ESP_OK) return false;
+    // Skip a payload the handler left unread, the stream must stay aligned on frames
+    if (!ra.ws_payload_read && ra.ws_len > 0) {
+        char discard[PARSER_BLOCK_SIZE];
+        uint64_t left = ra.ws_len;
+        while (left > 0) {
+            size_t n = left < sizeof(discard) ? (size_t)left : sizeof(discard);
+            if (session_recv_all(srv, s, discard, n) < 0) return false;
+            left -= n;
+        }
+    }
+    return true;
+}
+
+static void accept_session(server_t *srv) {
+    if (session_count(srv) >= srv->config.max_open_sockets) {
+        // Only reached with the LRU purge on: make room, accept on the next round
+        session_t *lru = NULL;
+        for (int i = 0; i < srv->config.max_open_sockets; i++) {
+            session_t *s = &srv->sessions[i];
+            if (s->in_use && !s->for_async_req && (!lru || s->lru < lru->lru)) lru = s;
+        }
+        if (lru) session_close(srv, lru);
+        return;
+    }
+    int fd = accept(srv->listen_fd, NULL, NULL);
+    if (fd < 0) return;
+    struct timeval recv_tv = { .tv_sec = srv->config.recv_wait_timeout };
+    struct timeval send_tv = { .tv_sec = srv->config.send_wait_timeout };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &recv_tv, sizeof(recv_tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_tv, sizeof(send_tv));
+    // Headers and body go out in separate sends; with Nagle the body would wait for the delayed ACK
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    session_t *s = NULL;
+    pthread_mutex_lock(&srv->lock);
+    for (int i = 0; i < srv->config.max_open_sockets && !s; i++) {
+        if (!srv->sessions[i].in_use) s = &srv->sessions[i];
+    }
+    if (!s) {
+        pthread_mutex_unlock(&srv->lock);
+        close(fd);
+        return;
+    }
+    memset(s, 0, sizeof(*s));
+    s->in_use = true;
+    s->fd = fd;
+    s->send_fn = default_send;
+    s->recv_fn = default_recv;
+    s->lru = ++srv->lru_counter;
+    pthread_mutex_unlock(&srv->lock);
+    if (srv->config.open_fn && srv->config.open_fn(srv, fd) != ESP_OK) session_close(srv, s);
+}
+
+static void serve_sockets(server_t *srv) {
+    fd_set readable;
+    FD_ZERO(&readable);
+    int max_fd = srv->ctrl[0];
+    FD_SET(srv->ctrl[0], &readable);
+    bool pending = false;
+    pthread_mutex_lock(&srv->lock);
+    if (srv->config.lru_purge_enable || session_count(srv) < srv->config.max_open_sockets) {
+        FD_SET(srv->listen_fd, &readable);
+        if (srv->listen_fd > max_fd) max_fd = srv->listen_fd;
+    }
+    for (int i = 0; i < srv->config.max_open_sockets; i++) {
+        session_t *s = &srv->sessions[i];
+        if (!s->in_use || s->for_async_req || s->close_pending) continue;
+        if (s->pending_len > 0) pending = true;
+        FD_SET(s->fd, &readable);
+        if (s->fd > max_fd) max_fd = s->fd;
+    }
+    pthread_mutex_unlock(&srv->lock);
+
+    struct timeval zero = { 0 };
+    k_io_begin(K_FOREVER);
+    int ready = select(max_fd + 1, &readable, NULL, NULL, pending ? &zero : NULL);
+    k_io_end();
+    if (ready < 0) {
+        FD_ZERO(&readable);
+    }
+
+    if (FD_ISSET(srv->ctrl[0], &readable)) {
+        char drain[64];
+        ssize_t ignored = read(srv->ctrl[0], drain, sizeof(drain));
+        (void)ignored;
+    }
+    run_work(srv);
+
+    for (int i = 0; i < srv->config.max_open_sockets && !srv->stop; i++) {
+        session_t *s = &srv->sessions[i];
+        if (!s->in_use || s->for_async_req) continue;
+        if (s->close_pending) {
+            session_close(srv, s);
+            continue;
+        }
+        if (!FD_ISSET(s->fd, &readable) && s->pending_len == 0) continue;
+        s->lru = ++srv->lru_counter;
+        bool keep = s->websocket ? serve_frame(srv, s) : serve_request(srv, s);
+        if (!keep || s->close_pending) {
+            if (s->in_use && !s->for_async_req) session_close(srv, s);
+        }
+    }
+    if (!srv->stop && FD_ISSET(srv->listen_fd, &readable)) accept_session(srv);
+}
+
+static void server_task(void *arg) {
+    server_t *srv = arg;
+    while (!srv->stop) {
+        if (k_virtual()) {
+            xSemaphoreTake(srv->work_sem, portMAX_DELAY);
+            run_work(srv);
+        } else {
+            serve_sockets(srv);
+        }
+    }
+    for (int i = 0; i < srv->config.max_open_sockets; i++) {
+        if (srv->sessions[i].in_use) session_close(srv, &srv->sessions[i]);
+    }
+    xSemaphoreGive(srv->stopped);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t server_listen(server_t *srv) {
+    srv->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (srv->listen_fd < 0) return ESP_ERR_HTTPD_TASK;
+    int on = 1;
+    setsockopt(srv->listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(srv->port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    socklen_t addr_len = sizeof(addr);
+    if (bind(srv->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(srv->listen_fd, srv->config.backlog_conn) != 0 ||
+        getsockname(srv->listen_fd, (struct sockaddr *)&addr, &addr_len) != 0 || pipe(srv->ctrl) != 0) {
+        fprintf(stderr, "httpd: cannot listen on port %u: %s\n", srv->port, strerror(errno));
+        close(srv->listen_fd);
+        return ESP_ERR_HTTPD_TASK;
+    }
+    fcntl(srv->ctrl[1], F_SETFL, O_NONBLOCK);
+    srv->port = ntohs(addr.sin_port);
+    return ESP_OK;
+}
+
+static void server_free(server_t *srv) {
+    for (int i = 0; i < srv->config.max_uri_handlers; i++) {
+        free((char *)srv->handlers[i].uri);
+    }
+    if (srv->work_sem) vSemaphoreDelete(srv->work_sem);
+    if (srv->stopped) vSemaphoreDelete(srv->stopped);
+    pthread_mutex_destroy(&srv->lock);
+    free(srv->handlers);
+    free(srv->sessions);
+    free(srv);
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+    if (!handle || !config) return ESP_ERR_INVALID_ARG;
+    if (config->max_open_sockets > CONFIG_LWIP_MAX_SOCKETS - 3) return ESP_ERR_INVALID_ARG;
+    signal(SIGPIPE, SIG_IGN);
+    server_t *srv = calloc(1, sizeof(*srv));
+    if (!srv) return ESP_ERR_HTTPD_ALLOC_MEM;
+    srv->config = *config;
+    srv->handlers = calloc(config->max_uri_handlers, sizeof(*srv->handlers));
+    srv->sessions = calloc(config->max_open_sockets, sizeof(*srv->sessions));
+    srv->work_sem = xSemaphoreCreateCounting(UINT32_MAX, 0);
+    srv->stopped = xSemaphoreCreateBinary();
+    pthread_mutex_init(&srv->lock, NULL);
+    srv->listen_fd = -1;
+    srv->ctrl[0] = srv->ctrl[1] = -1;
+    if (config->max_resp_headers > 32 || !srv->handlers || !srv->sessions || !srv->work_sem || !srv->stopped) {
+        server_free(srv);
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    pthread_mutex_lock(&servers_lock);
+    srv->port = port_override_set ? port_override : config->server_port;
+    pthread_mutex_unlock(&servers_lock);
+    if (!k_virtual()) {
+        esp_err_t err = server_listen(srv);
+        if (err != ESP_OK) {
+            server_free(srv);
+            return err;
+        }
+    }
+    if (xTaskCreatePinnedToCore(server_task, "httpd", config->stack_size, srv, config->task_priority, NULL,
+                                config->core_id) != pdPASS) {
+        if (srv->listen_fd >= 0) {
+            close(srv->listen_fd);
+            close(srv->ctrl[0]);
+            close(srv->ctrl[1]);
+        }
+        server_free(srv);
+        return ESP_ERR_HTTPD_TASK;
+    }
+    pthread_mutex_lock(&servers_lock);
+    bound_port = k_virtual() ? 0 : srv->port;
+    pthread_mutex_unlock(&servers_lock);
+    *handle = srv;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+    server_t *srv = handle;
+    if (!srv) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&srv->lock);
+    srv->stop = true;
+    work_item_t *work = srv->work_head;
+    srv->work_head = srv->work_tail = NULL;
+    pthread_mutex_unlock(&srv->lock);
+    server_wake(srv);
+    xSemaphoreTake(srv->stopped, portMAX_DELAY);
+    while (work) {
+        work_item_t *next = work->next;
+        free(work);
+        work = next;
+    }
+    if (srv->listen_fd >= 0) {
+        close(srv->listen_fd);
+        close(srv->ctrl[0]);
+        close(srv->ctrl[1]);
+    }
+    if (srv->config.global_user_ctx_free_fn) {
+        srv->config.global_user_ctx_free_fn(srv->config.global_user_ctx);
+    } else {
+        free(srv->config.global_user_ctx);
+    }
+    if (srv->config.global_transport_ctx_free_fn) {
+        srv->config.global_transport_ctx_free_fn(srv->config.global_transport_ctx);
+    } else {
+        free(srv->config.global_transport_ctx);
+    }
+    pthread_mutex_lock(&servers_lock);
+    bound_port = 0;
+    pthread_mutex_unlock(&servers_lock);
+    server_free(srv);
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_set_recv_override(httpd_handle_t hd, int sockfd, httpd_recv_func_t recv_func) {
+    server_t *srv = hd;
+    if (!srv) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&srv->lock);
+    session_t *s = session_find(srv, sockfd);
+    if (s) s->recv_fn = recv_func;
+    pthread_mutex_unlock(&srv->lock);
+    return s ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_sess_set_send_override(httpd_handle_t hd, int sockfd, httpd_send_func_t send_func) {
+    server_t *srv = hd;
+    if (!srv) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&srv->lock);
+    session_t *s = session_find(srv, sockfd);
+    if (s) s->send_fn = send_func;
+    pthread_mutex_unlock(&srv->lock);
+    return s ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+    server_t *srv = handle;
+    if (!srv) return ESP_ERR_INVALID_ARG;
+    if (sockfd == INVOKE_SOCKFD) return ESP_OK;
+    pthread_mutex_lock(&srv->lock);
+    session_t *s = session_find(srv, sockfd);
+    if (s) s->close_pending = true;
+    pthread_mutex_unlock(&srv->lock);
+    if (!s) return ESP_ERR_NOT_FOUND;
+    server_wake(srv);
+    return ESP_OK;
+}
+
+esp_err_t httpd_sess_update_lru_counter(httpd_handle_t handle, int sockfd) {
+    server_t *srv = handle;
+    if (!srv) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&srv->lock);
+    session_t *s = session_find(srv, sockfd);
+    if (s) s->lru = ++srv->lru_counter;
+    pthread_mutex_unlock(&srv->lock);
+    return s ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+void *httpd_sess_get_ctx(httpd_handle_t handle, int sockfd) {
+    server_t *srv = handle;
+    if (!srv) return NULL;
+    pthread_mutex_lock(&srv->lock);
+    session_t *s = session_find(srv, sockfd);
+    void *ctx = s ? s->ctx : NULL;
+    pthread_mutex_unlock(&srv->lock);
+    return ctx;
+}
+
+void httpd_sess_set_ctx(httpd_handle_t handle, int sockfd, void *ctx, httpd_free_ctx_fn_t free_fn) {
+    server_t *srv = handle;
+    if (!srv) return;
+    pthread_mutex_lock(&srv->lock);
+    session_t *s = session_find(srv, sockfd);
+    if (s) {
+        s->ctx = ctx;
+        s->free_ctx = free_fn;
+    }
+    pthread_mutex_unlock(&srv->lock);
+}
+
+void *httpd_get_global_user_ctx(httpd_handle_t handle) {
+    server_t *srv = handle;
+    return srv ? srv->config.global_user_ctx : NULL;
+}
+
+esp_err_t httpd_get_client_list(httpd_handle_t handle, size_t *fds, int *client_fds) {
+    server_t *srv = handle;
+    if (!srv || !fds || !client_fds) return ESP_ERR_INVALID_ARG;
+    size_t max = *fds;
+    size_t count = 0;
+    pthread_mutex_lock(&srv->lock);
+    for (int i = 0; i < srv->config.max_open_sockets; i++) {
+        if (!srv->sessions[i].in_use) continue;
+        if (count == max) {
+            pthread_mutex_unlock(&srv->lock);
+            return ESP_ERR_INVALID_ARG;
+        }
+        client_fds[count++] = srv->sessions[i].fd;
+    }
+    pthread_mutex_unlock(&srv->lock);
+    *fds = count;
+    return ESP_OK;
+}
+
+#pragma endregion
+
+#pragma region Host control
+
+void fake_httpd_set_port(uint16_t port) {
+    pthread_mutex_lock(&servers_lock);
+    port_override_set = true;
+    port_override = port;
+    pthread_mutex_unlock(&servers_lock);
+}
+
+uint16_t fake_httpd_bound_port(void) {
+    pthread_mutex_lock(&servers_lock);
+    uint16_t port = bound_port;
+    pthread_mutex_unlock(&servers_lock);
+    return port;
+}
+
+void fake_httpd_set_invoke_peer(uint32_t ip) {
+    __atomic_store_n(&invoke_peer, ip, __ATOMIC_RELAXED);
+}
+
+bool fake_httpd_invoke_peer(int sockfd, uint32_t *ip) {
+    if (sockfd != INVOKE_SOCKFD) return false;
+    *ip = __atomic_load_n(&invoke_peer, __ATOMIC_RELAXED);
+    return true;
+}
+
+esp_err_t fake_httpd_invoke(httpd_handle_t server, httpd_method_t method, const char *uri, const char *headers,
+                            const void *body, size_t body_len, fake_httpd_response_t *resp) {
+    server_t *srv = server;
+    if (!srv || !uri || !resp || strlen(uri) > HTTPD_MAX_URI_LEN) return ESP_ERR_INVALID_ARG;
+    memset(resp, 0, sizeof(*resp));
+    resp->status = 200;
+    snprintf(resp->content_type, sizeof(resp->content_type), "%s", HTTPD_TYPE_TEXT);
+    capture_append(resp, "", 0);
+
+    httpd_req_t req;
+    request_aux_t ra;
+    const char *resp_hdrs[2 * 32];
+    request_init(srv, &req, &ra, resp_hdrs);
+    ra.fd = INVOKE_SOCKFD;
+    ra.headers = headers ? headers : "";
+    ra.capture = resp;
+    ra.body = body;
+    ra.remaining = body ? body_len : 0;
+    req.method = method;
+    req.content_len = ra.remaining;
+    strcpy((char *)req.uri, uri);
+
+    bool method_mismatch;
+    const httpd_uri_t *h = find_handler(srv, uri, method, &method_mismatch);
+    if (!h) {
+        handle_err(srv, &req, method_mismatch ? HTTPD_405_METHOD_NOT_ALLOWED : HTTPD_404_NOT_FOUND);
+        return ESP_ERR_NOT_FOUND;
+    }
+    req.user_ctx = h->user_ctx;
+    return h->handler(&req);
+}
+
+void fake_httpd_response_free(fake_httpd_response_t *resp) {
+    if (!resp) return;
+    free(resp->body);
+    resp->body = NULL;
+    resp->body_len = 0;
+}
+
+#pragma endregion
@@ -0,0 +1,47 @@
+/**
+ * @file fake_internal.h
+ * @brief Links between the fakes that the component never sees.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_netif.h"
+
+/**
+ * @brief Netif of the softAP, NULL before esp_netif_create_default_wifi_ap().
+ */
+esp_netif_t *fake_netif_ap(void);
+
+/**
+ * @brief Netif of the station, NULL before esp_netif_create_default_wifi_sta().
+ */
+esp_netif_t *fake_netif_sta(void);
+
+/**
+ * @brief Give the station its address: the static one, or a DHCP lease.
+ *
+ * @param ip_info Filled with the address the station ended up with
+ */
+void fake_netif_sta_up(esp_netif_ip_info_t *ip_info);
+
+/**
+ * @brief Clear the station address after a disconnect, unless it is static.
+ */
+void fake_netif_sta_down(void);
+
+/**
+ * @brief Hand out the next DHCP lease of the softAP, network byte order.
+ */
+uint32_t fake_netif_ap_lease(void);
+
+/**
+ * @brief Peer address of a request run by fake_httpd_invoke().
+ *
+ * @param sockfd Socket of the request
+ * @param ip Set to the address in network byte order
+ * @return false when @p sockfd is a real socket
+ */
+bool fake_httpd_invoke_peer(int sockfd, uint32_t *ip);
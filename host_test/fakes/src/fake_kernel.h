@@ -0,0 +1,100 @@
+/**
+ * @file fake_kernel.h
+ * @brief Internals of the fake FreeRTOS kernel shared by the other fakes.
+ *
+ * Every FreeRTOS task is a pthread. One kernel lock protects all kernel
+ * objects; a task waits on its own condition variable for the object it
+ * blocks on (wait_obj) or for its deadline. The kernel counts the tasks that
+ * are not blocked, which is how fake_kernel_wait_idle() knows the system
+ * settled in virtual time.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/// No deadline
+#define K_FOREVER UINT64_MAX
+
+/**
+ * @brief Take the kernel lock.
+ */
+void k_lock(void);
+
+/**
+ * @brief Release the kernel lock.
+ */
+void k_unlock(void);
+
+/**
+ * @brief Task control block of the caller, created on first use for threads
+ * the kernel did not start (main, the HTTP server thread).
+ */
+struct fake_task *k_current(void);
+
+/**
+ * @brief Scheduler clock in microseconds, kernel lock not required.
+ */
+uint64_t k_now_us(void);
+
+/**
+ * @brief Absolute deadline for a FreeRTOS timeout in ticks.
+ */
+uint64_t k_deadline_ticks(TickType_t ticks);
+
+/**
+ * @brief Block the caller on @p obj until woken or @p deadline_us passes.
+ *
+ * Called with the kernel lock held; the lock is released while blocked.
+ *
+ * @return false when the deadline passed
+ */
+bool k_block(const void *obj, uint64_t deadline_us);
+
+/**
+ * @brief Wake every task blocked on @p obj, kernel lock held.
+ */
+void k_notify(const void *obj);
+
+/**
+ * @brief Mark the caller blocked in a host call that the kernel cannot see.
+ *
+ * Used around blocking socket calls. The task no longer counts as running,
+ * and a vTaskDelete() from another task cancels the host call.
+ *
+ * @param deadline_us Virtual deadline after which the call should give up
+ */
+void k_io_begin(uint64_t deadline_us);
+
+/**
+ * @brief End of a host call started with k_io_begin().
+ *
+ * @return false when the virtual clock passed the deadline meanwhile
+ */
+bool k_io_end(void);
+
+/**
+ * @brief Cancellation cleanup handler for host calls between k_io_begin() and
+ * k_io_end(), push it with pthread_cleanup_push().
+ */
+void k_io_cancelled(void *arg);
+
+/**
+ * @brief Whether the caller has been woken out of k_io_begin() by the clock.
+ */
+bool k_io_expired(void);
+
+/**
+ * @brief Whether the scheduler runs on virtual time.
+ */
+bool k_virtual(void);
+
+/**
+ * @brief Update the minimum free heap, called by the kernel when a task blocks.
+ */
+void fake_heap_sample(void);
@@ -0,0 +1,155 @@
+/**
+ * @file fake_lwip.c
+ * @brief lwIP socket wrappers, statistics and address helpers on host sockets.
+ *
+ * recvfrom() is the one blocking socket call the component makes from a
+ * FreeRTOS task (the DNS server). The wrapper tells the kernel the task is
+ * waiting, and in virtual time it polls the socket and gives up with EAGAIN
+ * once the virtual clock passes the SO_RCVTIMEO the task configured.
+ */
+
+#include <arpa/inet.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "fake_host.h"
+#include "fake_internal.h"
+#include "fake_kernel.h"
+#include "lwip/inet.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/sockets.h"
+#include "lwip/stats.h"
+
+#undef bind
+#undef setsockopt
+#undef recvfrom
+#undef getpeername
+
+#define MAX_TRACKED_FDS 1024
+
+static uint16_t port_offset;
+static uint64_t receive_timeout_us[MAX_TRACKED_FDS];
+
+#pragma region Sockets
+
+void fake_lwip_set_port_offset(uint16_t offset) {
+    port_offset = offset;
+}
+
+int fake_lwip_bind(int s, const struct sockaddr *name, socklen_t namelen) {
+    if (name && name->sa_family == AF_INET && namelen >= sizeof(struct sockaddr_in)) {
+        struct sockaddr_in addr;
+        memcpy(&addr, name, sizeof(addr));
+        uint16_t port = ntohs(addr.sin_port);
+        if (port != 0 && port < 1024) addr.sin_port = htons(port + port_offset);
+        return bind(s, (const struct sockaddr *)&addr, sizeof(addr));
+    }
+    return bind(s, name, namelen);
+}
+
+int fake_lwip_setsockopt(int s, int level, int optname, const void *optval, socklen_t optlen) {
+    if (level == SOL_SOCKET && optname == SO_RCVTIMEO && optlen >= sizeof(struct timeval) && s >= 0 &&
+        s < MAX_TRACKED_FDS) {
+        const struct timeval *tv = optval;
+        receive_timeout_us[s] = (uint64_t)tv->tv_sec * 1000000ULL + (uint64_t)tv->tv_usec;
+    }
+    return setsockopt(s, level, optname, optval, optlen);
+}
+
+ssize_t fake_lwip_recvfrom(int s, void *mem, size_t len, int flags, struct sockaddr *from, socklen_t *fromlen) {
+    uint64_t timeout = s >= 0 && s < MAX_TRACKED_FDS ? receive_timeout_us[s] : 0;
+    uint64_t deadline = (flags & MSG_DONTWAIT) ? k_now_us() : timeout ? k_now_us() + timeout : K_FOREVER;
+    ssize_t ret;
+    int old_state;
+    k_io_begin(deadline);
+    pthread_cleanup_push(k_io_cancelled, NULL);
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, &old_state);
+    if (!k_virtual()) {
+        ret = recvfrom(s, mem, len, flags, from, fromlen);
+    } else {
+        for (;;) {
+            struct pollfd pfd = { .fd = s, .events = POLLIN };
+            if (poll(&pfd, 1, 1) > 0) {
+                ret = recvfrom(s, mem, len, flags | MSG_DONTWAIT, from, fromlen);
+                if (ret >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) break;
+            }
+            if (deadline != K_FOREVER && k_io_expired()) {
+                errno = EAGAIN;
+                ret = -1;
+                break;
+            }
+        }
+    }
+    pthread_setcancelstate(old_state, NULL);
+    pthread_cleanup_pop(0);
+    int saved_errno = errno;
+    k_io_end();
+    errno = saved_errno;
+    return ret;
+}
+
+int fake_lwip_getpeername(int s, struct sockaddr *name, socklen_t *namelen) {
+    uint32_t ip;
+    if (!fake_httpd_invoke_peer(s, &ip)) return getpeername(s, name, namelen);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = ip };
+    if (*namelen < sizeof(addr)) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(name, &addr, sizeof(addr));
+    *namelen = sizeof(addr);
+    return 0;
+}
+
+int lwip_fcntl(int s, int cmd, int val) {
+    struct stat st;
+    if (fstat(s, &st) != 0 || !S_ISSOCK(st.st_mode)) {
+        errno = EBADF;
+        return -1;
+    }
+    return fcntl(s, cmd, val);
+}
+
+#pragma endregion
+
+#pragma region Statistics
+
+#define LWIP_MEMPOOL(pool, num, size, desc) static struct stats_mem memp_stats_##pool = { .name = desc, .avail = num };
+#include "lwip/priv/memp_std.h"
+
+struct stats_ lwip_stats = {
+    .memp = {
+#define LWIP_MEMPOOL(name, num, size, desc) [MEMP_##name] = &memp_stats_##name,
+#include "lwip/priv/memp_std.h"
+    },
+};
+
+union tcp_listen_pcbs_t tcp_listen_pcbs;
+struct tcp_pcb *tcp_active_pcbs;
+struct tcp_pcb *tcp_tw_pcbs;
+
+#pragma endregion
+
+#pragma region Addresses
+
+char *fake_lwip_ntoa(const void *addr) {
+    static char buf[INET_ADDRSTRLEN];     // Shared like lwIP's
+    return fake_lwip_ntoa_r(addr, buf, sizeof(buf));
+}
+
+char *fake_lwip_ntoa_r(const void *addr, char *buf, int buflen) {
+    struct in_addr in;
+    memcpy(&in, addr, sizeof(in));
+    if (!inet_ntop(AF_INET, &in, buf, (socklen_t)buflen)) return NULL;
+    return buf;
+}
+
+char *fake_lwip_ntoa6_r(const void *addr, char *buf, int buflen) {
+    if (!inet_ntop(AF_INET6, addr, buf, (socklen_t)buflen)) return NULL;
+    return buf;
+}
+
+#pragma endregion
@@ -0,0 +1,174 @@
+/**
+ * @file fake_netif.c
+ * @brief esp_netif for the two WiFi interfaces.
+ *
+ * The softAP starts as 192.168.4.1/24 and leases 192.168.4.2 and up. The
+ * station gets 192.168.1.100/24 from "DHCP" unless a static address is set.
+ */
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_netif.h"
+#include "fake_internal.h"
+
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+
+struct esp_netif_obj {
+    const char *if_key;
+    esp_netif_ip_info_t ip_info;
+    bool dhcp_running;          ///< DHCP server on the AP, DHCP client on the station
+    bool created;
+    char captive_uri[128];
+};
+
+static pthread_mutex_t netif_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct esp_netif_obj ap_netif = { .if_key = "WIFI_AP_DEF" };
+static struct esp_netif_obj sta_netif = { .if_key = "WIFI_STA_DEF" };
+static uint8_t next_lease = 2;
+
+esp_netif_t *fake_netif_ap(void) {
+    return ap_netif.created ? &ap_netif : NULL;
+}
+
+esp_netif_t *fake_netif_sta(void) {
+    return sta_netif.created ? &sta_netif : NULL;
+}
+
+void fake_netif_sta_up(esp_netif_ip_info_t *ip_info) {
+    pthread_mutex_lock(&netif_lock);
+    if (sta_netif.dhcp_running || sta_netif.ip_info.ip.addr == 0) {
+        IP4_ADDR(&sta_netif.ip_info.ip, 192, 168, 1, 100);
+        IP4_ADDR(&sta_netif.ip_info.netmask, 255, 255, 255, 0);
+        IP4_ADDR(&sta_netif.ip_info.gw, 192, 168, 1, 1);
+    }
+    *ip_info = sta_netif.ip_info;
+    pthread_mutex_unlock(&netif_lock);
+}
+
+void fake_netif_sta_down(void) {
+    pthread_mutex_lock(&netif_lock);
+    if (sta_netif.dhcp_running) memset(&sta_netif.ip_info, 0, sizeof(sta_netif.ip_info));
+    pthread_mutex_unlock(&netif_lock);
+}
+
+uint32_t fake_netif_ap_lease(void) {
+    pthread_mutex_lock(&netif_lock);
+    uint32_t ip = (ap_netif.ip_info.ip.addr & ap_netif.ip_info.netmask.addr) | htonl(next_lease);
+    next_lease = next_lease == 254 ? 2 : next_lease + 1;
+    pthread_mutex_unlock(&netif_lock);
+    return ip;
+}
+
+esp_err_t esp_netif_init(void) {
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_ap(void) {
+    pthread_mutex_lock(&netif_lock);
+    ap_netif.created = true;
+    ap_netif.dhcp_running = true;
+    IP4_ADDR(&ap_netif.ip_info.ip, 192, 168, 4, 1);
+    IP4_ADDR(&ap_netif.ip_info.netmask, 255, 255, 255, 0);
+    IP4_ADDR(&ap_netif.ip_info.gw, 192, 168, 4, 1);
+    pthread_mutex_unlock(&netif_lock);
+    return &ap_netif;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void) {
+    pthread_mutex_lock(&netif_lock);
+    sta_netif.created = true;
+    sta_netif.dhcp_running = true;
+    pthread_mutex_unlock(&netif_lock);
+    return &sta_netif;
+}
+
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key) {
+    if (!if_key) return NULL;
+    if (ap_netif.created && strcmp(if_key, ap_netif.if_key) == 0) return &ap_netif;
+    if (sta_netif.created && strcmp(if_key, sta_netif.if_key) == 0) return &sta_netif;
+    return NULL;
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t *esp_netif, esp_netif_ip_info_t *ip_info) {
+    if (!esp_netif || !ip_info) return ESP_ERR_ESP_NETIF_INVALID_PARAMS;
+    pthread_mutex_lock(&netif_lock);
+    *ip_info = esp_netif->ip_info;
+    pthread_mutex_unlock(&netif_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_ip_info(esp_netif_t *esp_netif, const esp_netif_ip_info_t *ip_info) {
+    if (!esp_netif || !ip_info) return ESP_ERR_ESP_NETIF_INVALID_PARAMS;
+    pthread_mutex_lock(&netif_lock);
+    esp_err_t err = ESP_OK;
+    if (esp_netif->dhcp_running) {
+        // Like on the target, the address is owned by the running DHCP client or server
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        esp_netif->ip_info = *ip_info;
+    }
+    pthread_mutex_unlock(&netif_lock);
+    return err;
+}
+
+static esp_err_t dhcp_set(esp_netif_t *esp_netif, bool run) {
+    if (!esp_netif) return ESP_ERR_ESP_NETIF_INVALID_PARAMS;
+    pthread_mutex_lock(&netif_lock);
+    esp_err_t err = ESP_OK;
+    if (esp_netif->dhcp_running == run) {
+        err = run ? ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED : ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED;
+    }
+    esp_netif->dhcp_running = run;
+    pthread_mutex_unlock(&netif_lock);
+    return err;
+}
+
+esp_err_t esp_netif_dhcpc_start(esp_netif_t *esp_netif) {
+    return dhcp_set(esp_netif, true);
+}
+
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t *esp_netif) {
+    return dhcp_set(esp_netif, false);
+}
+
+esp_err_t esp_netif_dhcps_start(esp_netif_t *esp_netif) {
+    return dhcp_set(esp_netif, true);
+}
+
+esp_err_t esp_netif_dhcps_stop(esp_netif_t *esp_netif) {
+    return dhcp_set(esp_netif, false);
+}
+
+esp_err_t esp_netif_dhcps_option(esp_netif_t *esp_netif, esp_netif_dhcp_option_mode_t opt_op,
+                                 esp_netif_dhcp_option_id_t opt_id, void *opt_val, uint32_t opt_len) {
+    if (!esp_netif || !opt_val) return ESP_ERR_ESP_NETIF_INVALID_PARAMS;
+    if (opt_id != ESP_NETIF_CAPTIVEPORTAL_URI) return ESP_OK;
+    pthread_mutex_lock(&netif_lock);
+    if (opt_op == ESP_NETIF_OP_SET) {
+        size_t len = opt_len < sizeof(esp_netif->captive_uri) - 1 ? opt_len : sizeof(esp_netif->captive_uri) - 1;
+        memcpy(esp_netif->captive_uri, opt_val, len);
+        esp_netif->captive_uri[len] = '\0';
+    } else if (opt_op == ESP_NETIF_OP_GET) {
+        snprintf(opt_val, opt_len, "%s", esp_netif->captive_uri);
+    }
+    pthread_mutex_unlock(&netif_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_tcpip_exec(esp_netif_callback_fn fn, void *ctx) {
+    // The TCP/IP core lock of the fake is the caller itself
+    return fn(ctx);
+}
+
+char *esp_ip4addr_ntoa(const esp_ip4_addr_t *addr, char *buf, int buflen) {
+    if (!inet_ntop(AF_INET, &addr->addr, buf, (socklen_t)buflen)) return NULL;
+    return buf;
+}
+
+uint32_t esp_ip4addr_aton(const char *addr) {
+    struct in_addr in;
+    return inet_pton(AF_INET, addr, &in) == 1 ? in.s_addr : 0;
+}
@@ -0,0 +1,269 @@
+/**
+ * @file fake_nvs.c
+ * @brief In-memory NVS with the type checks and error codes of the real one.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#define MAX_NVS_ENTRIES 64
+#define MAX_NVS_HANDLES 8
+
+typedef enum {
+    NVS_TYPE_U8,
+    NVS_TYPE_U32,
+    NVS_TYPE_STR,
+} nvs_type_t;
+
+typedef struct {
+    bool used;
+    char ns[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    nvs_type_t type;
+    uint32_t value;
+    char *str;
+} nvs_entry_t;
+
+typedef struct {
+    bool open;
+    bool read_only;
+    char ns[NVS_KEY_NAME_MAX_SIZE];
+} nvs_open_handle_t;
+
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool initialized;
+static nvs_entry_t entries[MAX_NVS_ENTRIES];
+static nvs_open_handle_t handles[MAX_NVS_HANDLES];
+
+static bool namespace_exists(const char *ns) {
+    for (int i = 0; i < MAX_NVS_ENTRIES; i++) {
+        if (entries[i].used && strcmp(entries[i].ns, ns) == 0) return true;
+    }
+    return false;
+}
+
+static nvs_open_handle_t *handle_get(nvs_handle_t handle) {
+    if (handle == 0 || handle > MAX_NVS_HANDLES || !handles[handle - 1].open) return NULL;
+    return &handles[handle - 1];
+}
+
+static nvs_entry_t *entry_find(const char *ns, const char *key) {
+    for (int i = 0; i < MAX_NVS_ENTRIES; i++) {
+        if (entries[i].used && strcmp(entries[i].ns, ns) == 0 && strcmp(entries[i].key, key) == 0) return &entries[i];
+    }
+    return NULL;
+}
+
+static void entry_clear(nvs_entry_t *entry) {
+    free(entry->str);
+    memset(entry, 0, sizeof(*entry));
+}
+
+esp_err_t nvs_flash_init(void) {
+    pthread_mutex_lock(&nvs_lock);
+    initialized = true;
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    pthread_mutex_lock(&nvs_lock);
+    for (int i = 0; i < MAX_NVS_ENTRIES; i++) {
+        entry_clear(&entries[i]);
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_deinit(void) {
+    pthread_mutex_lock(&nvs_lock);
+    initialized = false;
+    pthread_mutex_unlock(&nvs_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    if (!namespace_name || !out_handle) return ESP_ERR_INVALID_ARG;
+    if (strlen(namespace_name) >= NVS_KEY_NAME_MAX_SIZE) return ESP_ERR_NVS_KEY_TOO_LONG;
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t err = ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    if (!initialized) {
+        err = ESP_ERR_NVS_NOT_INITIALIZED;
+    } else if (open_mode == NVS_READONLY && !namespace_exists(namespace_name)) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else {
+        for (int i = 0; i < MAX_NVS_HANDLES; i++) {
+            if (!handles[i].open) {
+                handles[i].open = true;
+                handles[i].read_only = open_mode == NVS_READONLY;
+                strcpy(handles[i].ns, namespace_name);
+                *out_handle = (nvs_handle_t)(i + 1);
+                err = ESP_OK;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    pthread_mutex_lock(&nvs_lock);
+    nvs_open_handle_t *h = handle_get(handle);
+    if (h) h->open = false;
+    pthread_mutex_unlock(&nvs_lock);
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    pthread_mutex_lock(&nvs_lock);
+    esp_err_t err = handle_get(handle) ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    pthread_mutex_lock(&nvs_lock);
+    nvs_open_handle_t *h = handle_get(handle);
+    esp_err_t err = ESP_ERR_NVS_INVALID_HANDLE;
+    if (h && h->read_only) {
+        err = ESP_ERR_NVS_READ_ONLY;
+    } else if (h) {
+        nvs_entry_t *entry = entry_find(h->ns, key);
+        err = entry ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+        if (entry) entry_clear(entry);
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    pthread_mutex_lock(&nvs_lock);
+    nvs_open_handle_t *h = handle_get(handle);
+    esp_err_t err = ESP_ERR_NVS_INVALID_HANDLE;
+    if (h && h->read_only) {
+        err = ESP_ERR_NVS_READ_ONLY;
+    } else if (h) {
+        for (int i = 0; i < MAX_NVS_ENTRIES; i++) {
+            if (entries[i].used && strcmp(entries[i].ns, h->ns) == 0) entry_clear(&entries[i]);
+        }
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+/**
+ * @brief Find or create the entry for a write, nvs_lock held.
+ */
+static esp_err_t entry_for_write(nvs_handle_t handle, const char *key, nvs_type_t type, nvs_entry_t **out) {
+    nvs_open_handle_t *h = handle_get(handle);
+    if (!h) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (h->read_only) return ESP_ERR_NVS_READ_ONLY;
+    if (!key || !*key) return ESP_ERR_NVS_INVALID_NAME;
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) return ESP_ERR_NVS_KEY_TOO_LONG;
+    nvs_entry_t *entry = entry_find(h->ns, key);
+    if (entry) {
+        entry_clear(entry);
+    } else {
+        for (int i = 0; i < MAX_NVS_ENTRIES && !entry; i++) {
+            if (!entries[i].used) entry = &entries[i];
+        }
+        if (!entry) return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    entry->used = true;
+    strcpy(entry->ns, h->ns);
+    strcpy(entry->key, key);
+    entry->type = type;
+    *out = entry;
+    return ESP_OK;
+}
+
+/**
+ * @brief Find the entry for a read, nvs_lock held.
+ */
+static esp_err_t entry_for_read(nvs_handle_t handle, const char *key, nvs_type_t type, nvs_entry_t **out) {
+    nvs_open_handle_t *h = handle_get(handle);
+    if (!h) return ESP_ERR_NVS_INVALID_HANDLE;
+    nvs_entry_t *entry = entry_find(h->ns, key);
+    if (!entry || entry->type != type) return ESP_ERR_NVS_NOT_FOUND;
+    *out = entry;
+    return ESP_OK;
+}
+
+static esp_err_t set_int(nvs_handle_t handle, const char *key, nvs_type_t type, uint32_t value) {
+    pthread_mutex_lock(&nvs_lock);
+    nvs_entry_t *entry;
+    esp_err_t err = entry_for_write(handle, key, type, &entry);
+    if (err == ESP_OK) entry->value = value;
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+static esp_err_t get_int(nvs_handle_t handle, const char *key, nvs_type_t type, uint32_t *value) {
+    pthread_mutex_lock(&nvs_lock);
+    nvs_entry_t *entry;
+    esp_err_t err = entry_for_read(handle, key, type, &entry);
+    if (err == ESP_OK) *value = entry->value;
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value) {
+    return set_int(handle, key, NVS_TYPE_U8, value);
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value) {
+    uint32_t value;
+    esp_err_t err = get_int(handle, key, NVS_TYPE_U8, &value);
+    if (err == ESP_OK) *out_value = (uint8_t)value;
+    return err;
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    return set_int(handle, key, NVS_TYPE_U32, value);
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value) {
+    return get_int(handle, key, NVS_TYPE_U32, out_value);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value) {
+    if (!value) return ESP_ERR_INVALID_ARG;
+    char *copy = strdup(value);
+    if (!copy) return ESP_ERR_NO_MEM;
+    pthread_mutex_lock(&nvs_lock);
+    nvs_entry_t *entry;
+    esp_err_t err = entry_for_write(handle, key, NVS_TYPE_STR, &entry);
+    if (err == ESP_OK) {
+        entry->str = copy;
+        copy = NULL;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    free(copy);
+    return err;
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out_value, size_t *length) {
+    if (!length) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&nvs_lock);
+    nvs_entry_t *entry;
+    esp_err_t err = entry_for_read(handle, key, NVS_TYPE_STR, &entry);
+    if (err == ESP_OK) {
+        size_t needed = strlen(entry->str) + 1;
+        if (!out_value) {
+            *length = needed;
+        } else if (*length < needed) {
+            err = ESP_ERR_NVS_INVALID_LENGTH;
+        } else {
+            memcpy(out_value, entry->str, needed);
+            *length = needed;
+        }
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return err;
+}
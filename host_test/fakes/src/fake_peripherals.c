@@ -0,0 +1,132 @@
+/**
+ * @file fake_peripherals.c
+ * @brief Status LED recorder and mDNS stubs.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fake_host.h"
+#include "led_indicator.h"
+#include "mdns.h"
+
+#pragma region LED indicator
+
+#define MAX_BLINK_PATTERNS 32
+
+typedef struct {
+    uint16_t blink_list_num;
+    bool running[MAX_BLINK_PATTERNS];
+    uint32_t rgb;
+    uint32_t brightness;
+} fake_led_t;
+
+static pthread_mutex_t led_lock = PTHREAD_MUTEX_INITIALIZER;
+static fake_led_t *led;
+static int led_changes;
+
+led_indicator_handle_t led_indicator_create(const led_indicator_config_t *config) {
+    if (!config || config->blink_list_num > MAX_BLINK_PATTERNS) return NULL;
+    fake_led_t *created = calloc(1, sizeof(*created));
+    if (!created) return NULL;
+    created->blink_list_num = config->blink_list_num;
+    pthread_mutex_lock(&led_lock);
+    led = created;
+    pthread_mutex_unlock(&led_lock);
+    return created;
+}
+
+esp_err_t led_indicator_delete(led_indicator_handle_t handle) {
+    if (!handle) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&led_lock);
+    if (led == handle) led = NULL;
+    pthread_mutex_unlock(&led_lock);
+    free(handle);
+    return ESP_OK;
+}
+
+static esp_err_t set_running(led_indicator_handle_t handle, int blink_type, bool running) {
+    fake_led_t *l = handle;
+    if (!l || blink_type < 0 || blink_type >= l->blink_list_num) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&led_lock);
+    l->running[blink_type] = running;
+    led_changes++;
+    pthread_mutex_unlock(&led_lock);
+    return ESP_OK;
+}
+
+esp_err_t led_indicator_start(led_indicator_handle_t handle, int blink_type) {
+    return set_running(handle, blink_type, true);
+}
+
+esp_err_t led_indicator_stop(led_indicator_handle_t handle, int blink_type) {
+    return set_running(handle, blink_type, false);
+}
+
+esp_err_t led_indicator_set_rgb(led_indicator_handle_t handle, uint32_t rgb_value) {
+    fake_led_t *l = handle;
+    if (!l) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&led_lock);
+    l->rgb = rgb_value;
+    pthread_mutex_unlock(&led_lock);
+    return ESP_OK;
+}
+
+esp_err_t led_indicator_set_brightness(led_indicator_handle_t handle, uint32_t brightness) {
+    fake_led_t *l = handle;
+    if (!l) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&led_lock);
+    l->brightness = brightness;
+    pthread_mutex_unlock(&led_lock);
+    return ESP_OK;
+}
+
+int fake_led_pattern(int *changes) {
+    int pattern = -1;
+    pthread_mutex_lock(&led_lock);
+    for (int i = 0; led && i < led->blink_list_num && pattern < 0; i++) {
+        if (led->running[i]) pattern = i;
+    }
+    if (changes) *changes = led_changes;
+    pthread_mutex_unlock(&led_lock);
+    return pattern;
+}
+
+#pragma endregion
+
+#pragma region mDNS
+
+static bool mdns_running;
+
+esp_err_t mdns_init(void) {
+    if (mdns_running) return ESP_ERR_INVALID_STATE;
+    mdns_running = true;
+    return ESP_OK;
+}
+
+void mdns_free(void) {
+    mdns_running = false;
+}
+
+esp_err_t mdns_hostname_set(const char *hostname) {
+    if (!mdns_running) return ESP_ERR_INVALID_STATE;
+    return hostname && *hostname ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t mdns_instance_name_set(const char *instance_name) {
+    if (!mdns_running) return ESP_ERR_INVALID_STATE;
+    return instance_name && *instance_name ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t mdns_service_add(const char *instance_name, const char *service_type, const char *proto, uint16_t port,
+                           mdns_txt_item_t txt[], size_t num_items) {
+    (void)instance_name;
+    (void)port;
+    (void)txt;
+    (void)num_items;
+    if (!mdns_running) return ESP_ERR_INVALID_STATE;
+    return service_type && proto ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+#pragma endregion
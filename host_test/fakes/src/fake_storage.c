@@ -0,0 +1,363 @@
+/**
+ * @file fake_storage.c
+ * @brief Flash partitions, OTA, SD card and the buses it hangs off.
+ *
+ * App partitions (factory, ota_0, ota_1) exist from the start; the factory
+ * app is the one running. Data partitions are host files added with
+ * fake_partition_add_file() and mapped read-only. OTA images go to an
+ * anonymous temporary file so the simulated heap does not pay for them. The
+ * SD card is never present: mounting fails like an empty slot.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "driver/gpio.h"
+#include "driver/spi_common.h"
+#include "esp_app_format.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_vfs_fat.h"
+#include "fake_host.h"
+#include "sdmmc_cmd.h"
+
+#define MAX_PARTITIONS 8
+#define APP_PARTITION_SIZE (1536 * 1024)
+#define MAX_MAPPINGS 4
+
+typedef struct {
+    esp_partition_t partition;
+    int fd;                     ///< Backing file of a data partition, -1 for app partitions
+} fake_partition_t;
+
+static pthread_mutex_t storage_lock = PTHREAD_MUTEX_INITIALIZER;
+static fake_partition_t partitions[MAX_PARTITIONS] = {
+    { { NULL, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_FACTORY, 0x10000, APP_PARTITION_SIZE, 4096, "factory", false, false }, -1 },
+    { { NULL, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x190000, APP_PARTITION_SIZE, 4096, "ota_0", false, false }, -1 },
+    { { NULL, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, 0x310000, APP_PARTITION_SIZE, 4096, "ota_1", false, false }, -1 },
+};
+static size_t partition_count = 3;
+static uint32_t next_data_address = 0x490000;
+
+static struct {
+    void *ptr;
+    size_t len;
+} mappings[MAX_MAPPINGS];
+
+#pragma region Partitions
+
+esp_err_t fake_partition_add_file(const char *label, const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return ESP_ERR_NOT_FOUND;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return ESP_ERR_NOT_FOUND;
+    }
+    pthread_mutex_lock(&storage_lock);
+    if (partition_count == MAX_PARTITIONS) {
+        pthread_mutex_unlock(&storage_lock);
+        close(fd);
+        return ESP_ERR_NO_MEM;
+    }
+    fake_partition_t *p = &partitions[partition_count++];
+    memset(p, 0, sizeof(*p));
+    p->partition.type = ESP_PARTITION_TYPE_DATA;
+    p->partition.subtype = ESP_PARTITION_SUBTYPE_DATA_SPIFFS;
+    p->partition.address = next_data_address;
+    p->partition.size = (uint32_t)((st.st_size + 4095) & ~4095);
+    p->partition.erase_size = 4096;
+    p->partition.readonly = true;
+    snprintf(p->partition.label, sizeof(p->partition.label), "%s", label);
+    p->fd = fd;
+    next_data_address += p->partition.size;
+    pthread_mutex_unlock(&storage_lock);
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label) {
+    const esp_partition_t *found = NULL;
+    pthread_mutex_lock(&storage_lock);
+    for (size_t i = 0; i < partition_count && !found; i++) {
+        const esp_partition_t *p = &partitions[i].partition;
+        if (type != ESP_PARTITION_TYPE_ANY && p->type != type) continue;
+        if (subtype != ESP_PARTITION_SUBTYPE_ANY && p->subtype != subtype) continue;
+        if (label && strcmp(p->label, label) != 0) continue;
+        found = p;
+    }
+    pthread_mutex_unlock(&storage_lock);
+    return found;
+}
+
+static fake_partition_t *partition_entry(const esp_partition_t *partition) {
+    for (size_t i = 0; i < partition_count; i++) {
+        if (&partitions[i].partition == partition) return &partitions[i];
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size) {
+    if (!partition || !dst) return ESP_ERR_INVALID_ARG;
+    if (src_offset > partition->size || size > partition->size - src_offset) return ESP_ERR_INVALID_SIZE;
+    fake_partition_t *p = partition_entry(partition);
+    if (!p) return ESP_ERR_INVALID_ARG;
+    if (p->fd < 0) {
+        memset(dst, 0xff, size);
+        return ESP_OK;
+    }
+    ssize_t got = pread(p->fd, dst, size, (off_t)src_offset);
+    if (got < 0) return ESP_FAIL;
+    // Flash past the end of the file reads as erased
+    if ((size_t)got < size) memset((uint8_t *)dst + got, 0xff, size - (size_t)got);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t memory, const void **out_ptr,
+                             esp_partition_mmap_handle_t *out_handle) {
+    (void)memory;
+    if (!partition || !out_ptr || !out_handle) return ESP_ERR_INVALID_ARG;
+    if (offset > partition->size || size > partition->size - offset) return ESP_ERR_INVALID_SIZE;
+    fake_partition_t *p = partition_entry(partition);
+    if (!p || p->fd < 0) return ESP_ERR_NOT_SUPPORTED;
+    pthread_mutex_lock(&storage_lock);
+    int slot = -1;
+    for (int i = 0; i < MAX_MAPPINGS; i++) {
+        if (!mappings[i].ptr) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        pthread_mutex_unlock(&storage_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    long page = sysconf(_SC_PAGESIZE);
+    size_t aligned = offset & ~(size_t)(page - 1);
+    size_t len = size + (offset - aligned);
+    void *base = mmap(NULL, len, PROT_READ, MAP_PRIVATE, p->fd, (off_t)aligned);
+    if (base == MAP_FAILED) {
+        pthread_mutex_unlock(&storage_lock);
+        return ESP_FAIL;
+    }
+    mappings[slot].ptr = base;
+    mappings[slot].len = len;
+    pthread_mutex_unlock(&storage_lock);
+    *out_ptr = (const uint8_t *)base + (offset - aligned);
+    *out_handle = (esp_partition_mmap_handle_t)(slot + 1);
+    return ESP_OK;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle) {
+    if (handle == 0 || handle > MAX_MAPPINGS) return;
+    pthread_mutex_lock(&storage_lock);
+    if (mappings[handle - 1].ptr) {
+        munmap(mappings[handle - 1].ptr, mappings[handle - 1].len);
+        mappings[handle - 1].ptr = NULL;
+    }
+    pthread_mutex_unlock(&storage_lock);
+}
+
+#pragma endregion
+
+#pragma region OTA
+
+static const esp_partition_t *boot_partition = &partitions[0].partition;
+static FILE *ota_image;
+static size_t ota_written;
+static size_t ota_last_size;
+static esp_ota_handle_t ota_next_handle = 1;
+static esp_ota_handle_t ota_active;
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle) {
+    if (!partition || !out_handle || partition->type != ESP_PARTITION_TYPE_APP) return ESP_ERR_INVALID_ARG;
+    if (partition == esp_ota_get_running_partition()) return ESP_ERR_OTA_PARTITION_CONFLICT;
+    if (image_size != OTA_SIZE_UNKNOWN && image_size != OTA_WITH_SEQUENTIAL_WRITES && image_size > partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    pthread_mutex_lock(&storage_lock);
+    if (ota_image) fclose(ota_image);
+    ota_image = tmpfile();
+    ota_written = 0;
+    ota_active = ota_next_handle++;
+    *out_handle = ota_active;
+    esp_err_t err = ota_image ? ESP_OK : ESP_FAIL;
+    pthread_mutex_unlock(&storage_lock);
+    return err;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size) {
+    if (!data) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&storage_lock);
+    esp_err_t err = ESP_OK;
+    if (handle != ota_active || !ota_image) {
+        err = ESP_ERR_INVALID_ARG;
+    } else if (ota_written == 0 && size > 0 && ((const uint8_t *)data)[0] != ESP_IMAGE_HEADER_MAGIC) {
+        err = ESP_ERR_OTA_VALIDATE_FAILED;
+    } else if (ota_written + size > APP_PARTITION_SIZE) {
+        err = ESP_ERR_INVALID_SIZE;
+    } else if (fwrite(data, 1, size, ota_image) != size) {
+        err = ESP_FAIL;
+    } else {
+        ota_written += size;
+    }
+    pthread_mutex_unlock(&storage_lock);
+    return err;
+}
+
+static void ota_close(void) {
+    if (ota_image) fclose(ota_image);
+    ota_image = NULL;
+    ota_active = 0;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle) {
+    pthread_mutex_lock(&storage_lock);
+    esp_err_t err = ESP_OK;
+    if (handle != ota_active || !ota_image) {
+        err = ESP_ERR_NOT_FOUND;
+    } else if (ota_written < sizeof(esp_image_header_t)) {
+        err = ESP_ERR_OTA_VALIDATE_FAILED;
+    } else {
+        ota_last_size = ota_written;
+    }
+    if (err != ESP_ERR_NOT_FOUND) ota_close();
+    pthread_mutex_unlock(&storage_lock);
+    return err;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle) {
+    pthread_mutex_lock(&storage_lock);
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    if (handle == ota_active) {
+        ota_close();
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&storage_lock);
+    return err;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition) {
+    if (!partition || partition->type != ESP_PARTITION_TYPE_APP) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&storage_lock);
+    boot_partition = partition;
+    pthread_mutex_unlock(&storage_lock);
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_boot_partition(void) {
+    return boot_partition;
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void) {
+    return &partitions[0].partition;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from) {
+    (void)start_from;
+    // Alternate between the OTA slots, starting with ota_0 while the factory app runs
+    return boot_partition == &partitions[1].partition ? &partitions[2].partition : &partitions[1].partition;
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *ota_state) {
+    if (!partition || !ota_state) return ESP_ERR_INVALID_ARG;
+    // The factory app has no OTA state, like on the target
+    if (partition->subtype == ESP_PARTITION_SUBTYPE_APP_FACTORY) return ESP_ERR_NOT_SUPPORTED;
+    *ota_state = ESP_OTA_IMG_VALID;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void) {
+    return ESP_OK;
+}
+
+size_t fake_ota_last_image_size(void) {
+    pthread_mutex_lock(&storage_lock);
+    size_t size = ota_last_size;
+    pthread_mutex_unlock(&storage_lock);
+    return size;
+}
+
+const char *fake_ota_boot_label(void) {
+    return boot_partition->label;
+}
+
+#pragma endregion
+
+#pragma region SD card
+
+esp_err_t spi_bus_initialize(spi_host_device_t host_id, const spi_bus_config_t *bus_config, spi_dma_chan_t dma_chan) {
+    (void)host_id;
+    (void)dma_chan;
+    return bus_config ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t spi_bus_free(spi_host_device_t host_id) {
+    (void)host_id;
+    return ESP_OK;
+}
+
+esp_err_t esp_vfs_fat_sdspi_mount(const char *base_path, const sdmmc_host_t *host_config,
+                                  const sdspi_device_config_t *slot_config,
+                                  const esp_vfs_fat_mount_config_t *mount_config, sdmmc_card_t **out_card) {
+    (void)base_path;
+    (void)host_config;
+    (void)slot_config;
+    (void)mount_config;
+    (void)out_card;
+    return ESP_ERR_NOT_FOUND;       // Empty slot
+}
+
+esp_err_t esp_vfs_fat_sdcard_unmount(const char *base_path, sdmmc_card_t *card) {
+    (void)base_path;
+    (void)card;
+    return ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_vfs_fat_info(const char *base_path, uint64_t *out_total_bytes, uint64_t *out_free_bytes) {
+    (void)base_path;
+    (void)out_total_bytes;
+    (void)out_free_bytes;
+    return ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t sdmmc_get_status(sdmmc_card_t *card) {
+    (void)card;
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t gpio_config(const gpio_config_t *config) {
+    return config ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level) {
+    (void)gpio_num;
+    (void)level;
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+    (void)gpio_num;
+    return 1;       // Card detect switches are active low: no card
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags) {
+    (void)intr_alloc_flags;
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args) {
+    (void)gpio_num;
+    (void)isr_handler;
+    (void)args;
+    return ESP_OK;
+}
+
+#pragma endregion
@@ -0,0 +1,375 @@
+/**
+ * @file fake_system.c
+ * @brief Logging, error names, restart, heap accounting and chip identity.
+ *
+ * The heap fake keeps the real allocator and accounts for it: the free size of
+ * the simulated internal heap is the configured budget minus the bytes the
+ * process allocated since start (mallinfo2). Allocations made by the
+ * component, by its tasks (the fake kernel allocates their stacks) and by the
+ * fakes all count, so leaks show up as a falling free size.
+ */
+
+#include <malloc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "esp_app_desc.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "esp_system.h"
+#include "fake_host.h"
+#include "fake_kernel.h"
+#include "esp_http_server.h"
+#include "esp_netif.h"
+#include "esp_ota_ops.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs.h"
+
+#pragma region Errors
+
+#define ERR_NAME(code) { code, #code }
+
+static const struct {
+    esp_err_t code;
+    const char *name;
+} err_names[] = {
+    ERR_NAME(ESP_OK),
+    ERR_NAME(ESP_FAIL),
+    ERR_NAME(ESP_ERR_NO_MEM),
+    ERR_NAME(ESP_ERR_INVALID_ARG),
+    ERR_NAME(ESP_ERR_INVALID_STATE),
+    ERR_NAME(ESP_ERR_INVALID_SIZE),
+    ERR_NAME(ESP_ERR_NOT_FOUND),
+    ERR_NAME(ESP_ERR_NOT_SUPPORTED),
+    ERR_NAME(ESP_ERR_TIMEOUT),
+    ERR_NAME(ESP_ERR_INVALID_RESPONSE),
+    ERR_NAME(ESP_ERR_INVALID_CRC),
+    ERR_NAME(ESP_ERR_INVALID_VERSION),
+    ERR_NAME(ESP_ERR_INVALID_MAC),
+    ERR_NAME(ESP_ERR_NOT_FINISHED),
+    ERR_NAME(ESP_ERR_NOT_ALLOWED),
+    ERR_NAME(ESP_ERR_NVS_NOT_INITIALIZED),
+    ERR_NAME(ESP_ERR_NVS_NOT_FOUND),
+    ERR_NAME(ESP_ERR_NVS_TYPE_MISMATCH),
+    ERR_NAME(ESP_ERR_NVS_READ_ONLY),
+    ERR_NAME(ESP_ERR_NVS_NOT_ENOUGH_SPACE),
+    ERR_NAME(ESP_ERR_NVS_INVALID_NAME),
+    ERR_NAME(ESP_ERR_NVS_INVALID_HANDLE),
+    ERR_NAME(ESP_ERR_NVS_KEY_TOO_LONG),
+    ERR_NAME(ESP_ERR_NVS_INVALID_LENGTH),
+    ERR_NAME(ESP_ERR_NVS_NO_FREE_PAGES),
+    ERR_NAME(ESP_ERR_NVS_NEW_VERSION_FOUND),
+    ERR_NAME(ESP_ERR_ESP_NETIF_INVALID_PARAMS),
+    ERR_NAME(ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED),
+    ERR_NAME(ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED),
+    ERR_NAME(ESP_ERR_WIFI_NOT_INIT),
+    ERR_NAME(ESP_ERR_WIFI_NOT_STARTED),
+    ERR_NAME(ESP_ERR_WIFI_NOT_STOPPED),
+    ERR_NAME(ESP_ERR_WIFI_IF),
+    ERR_NAME(ESP_ERR_WIFI_MODE),
+    ERR_NAME(ESP_ERR_WIFI_STATE),
+    ERR_NAME(ESP_ERR_WIFI_CONN),
+    ERR_NAME(ESP_ERR_WIFI_SSID),
+    ERR_NAME(ESP_ERR_WIFI_PASSWORD),
+    ERR_NAME(ESP_ERR_OTA_PARTITION_CONFLICT),
+    ERR_NAME(ESP_ERR_OTA_SELECT_INFO_INVALID),
+    ERR_NAME(ESP_ERR_OTA_VALIDATE_FAILED),
+    ERR_NAME(ESP_ERR_OTA_SMALL_SEC_VER),
+    ERR_NAME(ESP_ERR_OTA_ROLLBACK_FAILED),
+    ERR_NAME(ESP_ERR_OTA_ROLLBACK_INVALID_STATE),
+    ERR_NAME(ESP_ERR_HTTPD_HANDLERS_FULL),
+    ERR_NAME(ESP_ERR_HTTPD_HANDLER_EXISTS),
+    ERR_NAME(ESP_ERR_HTTPD_INVALID_REQ),
+    ERR_NAME(ESP_ERR_HTTPD_RESULT_TRUNC),
+    ERR_NAME(ESP_ERR_HTTPD_RESP_HDR),
+    ERR_NAME(ESP_ERR_HTTPD_RESP_SEND),
+    ERR_NAME(ESP_ERR_HTTPD_ALLOC_MEM),
+    ERR_NAME(ESP_ERR_HTTPD_TASK),
+};
+
+const char *esp_err_to_name(esp_err_t code) {
+    for (size_t i = 0; i < sizeof(err_names) / sizeof(err_names[0]); i++) {
+        if (err_names[i].code == code) return err_names[i].name;
+    }
+    return "UNKNOWN ERROR";
+}
+
+void _esp_error_check_failed(esp_err_t rc, const char *file, int line, const char *function, const char *expression) {
+    fprintf(stderr, "ESP_ERROR_CHECK failed: esp_err_t 0x%x (%s) at %s:%d\nfunction: %s\nexpression: %s\n", rc,
+            esp_err_to_name(rc), file, line, function, expression);
+    abort();
+}
+
+#pragma endregion
+
+#pragma region Logging
+
+#define MAX_LOG_TAGS 32
+
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static vprintf_like_t log_vprintf = vprintf;
+static esp_log_level_t log_default_level = CONFIG_LOG_DEFAULT_LEVEL;
+static struct {
+    char tag[32];
+    esp_log_level_t level;
+} log_levels[MAX_LOG_TAGS];
+static size_t log_level_count;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    pthread_mutex_lock(&log_lock);
+    if (strcmp(tag, "*") == 0) {
+        log_default_level = level;
+        log_level_count = 0;
+    } else {
+        size_t i;
+        for (i = 0; i < log_level_count && strcmp(log_levels[i].tag, tag) != 0; i++) {
+        }
+        if (i < MAX_LOG_TAGS) {
+            snprintf(log_levels[i].tag, sizeof(log_levels[i].tag), "%s", tag);
+            log_levels[i].level = level;
+            if (i == log_level_count) log_level_count++;
+        }
+    }
+    pthread_mutex_unlock(&log_lock);
+}
+
+static esp_log_level_t log_level_locked(const char *tag) {
+    for (size_t i = 0; i < log_level_count; i++) {
+        if (strcmp(log_levels[i].tag, tag) == 0) return log_levels[i].level;
+    }
+    return log_default_level;
+}
+
+esp_log_level_t esp_log_level_get(const char *tag) {
+    pthread_mutex_lock(&log_lock);
+    esp_log_level_t level = log_level_locked(tag);
+    pthread_mutex_unlock(&log_lock);
+    return level;
+}
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func) {
+    pthread_mutex_lock(&log_lock);
+    vprintf_like_t previous = log_vprintf;
+    log_vprintf = func;
+    pthread_mutex_unlock(&log_lock);
+    return previous;
+}
+
+uint32_t esp_log_timestamp(void) {
+    return (uint32_t)(k_now_us() / 1000);
+}
+
+void esp_log_writev(esp_log_level_t level, const char *tag, const char *format, va_list args) {
+    pthread_mutex_lock(&log_lock);
+    bool enabled = level <= log_level_locked(tag);
+    vprintf_like_t func = log_vprintf;
+    pthread_mutex_unlock(&log_lock);
+    if (enabled) func(format, args);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    esp_log_writev(level, tag, format, args);
+    va_end(args);
+}
+
+#pragma endregion
+
+#pragma region Restart
+
+#define MAX_SHUTDOWN_HANDLERS 5
+
+static shutdown_handler_t shutdown_handlers[MAX_SHUTDOWN_HANDLERS];
+static void (*restart_hook)(void);
+static int restart_count;
+
+void fake_system_set_restart_hook(void (*hook)(void)) {
+    restart_hook = hook;
+}
+
+int fake_system_restart_count(void) {
+    return __atomic_load_n(&restart_count, __ATOMIC_ACQUIRE);
+}
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler) {
+    for (int i = 0; i < MAX_SHUTDOWN_HANDLERS; i++) {
+        if (shutdown_handlers[i] == handler) return ESP_ERR_INVALID_STATE;
+        if (!shutdown_handlers[i]) {
+            shutdown_handlers[i] = handler;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void esp_restart(void) {
+    for (int i = MAX_SHUTDOWN_HANDLERS - 1; i >= 0; i--) {
+        if (shutdown_handlers[i]) shutdown_handlers[i]();
+    }
+    __atomic_add_fetch(&restart_count, 1, __ATOMIC_ACQ_REL);
+    if (!restart_hook) {
+        fflush(NULL);
+        exit(0);
+    }
+    restart_hook();
+    // The device is going down: the caller never runs again
+    for (;;) {
+        vTaskSuspend(NULL);
+    }
+}
+
+#pragma endregion
+
+#pragma region Heap
+
+#define DEFAULT_HEAP_SIZE (320 * 1024)
+
+static size_t heap_size = DEFAULT_HEAP_SIZE;
+static size_t heap_baseline;
+static size_t heap_minimum = DEFAULT_HEAP_SIZE;
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+__attribute__((constructor)) static void heap_init(void) {
+    // One arena, so every thread's allocations land in the totals below
+    mallopt(M_ARENA_MAX, 1);
+    struct mallinfo2 info = mallinfo2();
+    heap_baseline = info.uordblks + info.hblkhd;
+}
+
+static size_t heap_free_now(void) {
+    struct mallinfo2 info = mallinfo2();
+    size_t used = info.uordblks + info.hblkhd;
+    used = used > heap_baseline ? used - heap_baseline : 0;
+    return used < heap_size ? heap_size - used : 0;
+}
+
+void fake_heap_sample(void) {
+    size_t free_size = heap_free_now();
+    pthread_mutex_lock(&heap_lock);
+    if (free_size < heap_minimum) heap_minimum = free_size;
+    pthread_mutex_unlock(&heap_lock);
+}
+
+void fake_heap_set_size(size_t size) {
+    pthread_mutex_lock(&heap_lock);
+    heap_size = size;
+    pthread_mutex_unlock(&heap_lock);
+    fake_heap_reset_minimum();
+}
+
+void fake_heap_reset_minimum(void) {
+    size_t free_size = heap_free_now();
+    pthread_mutex_lock(&heap_lock);
+    heap_minimum = free_size;
+    pthread_mutex_unlock(&heap_lock);
+}
+
+static bool heap_caps_internal(uint32_t caps) {
+    return (caps & MALLOC_CAP_SPIRAM) == 0;
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+    return heap_caps_internal(caps) ? malloc(size) : NULL;
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    return heap_caps_internal(caps) ? calloc(n, size) : NULL;
+}
+
+void heap_caps_free(void *ptr) {
+    free(ptr);
+}
+
+size_t heap_caps_get_total_size(uint32_t caps) {
+    return heap_caps_internal(caps) ? heap_size : 0;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    if (!heap_caps_internal(caps)) return 0;
+    fake_heap_sample();
+    return heap_free_now();
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    if (!heap_caps_internal(caps)) return 0;
+    fake_heap_sample();
+    pthread_mutex_lock(&heap_lock);
+    size_t minimum = heap_minimum;
+    pthread_mutex_unlock(&heap_lock);
+    return minimum;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+    // No fragmentation model: the whole free size is one block
+    return heap_caps_get_free_size(caps);
+}
+
+uint32_t esp_get_free_heap_size(void) {
+    return heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+}
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+    return heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+}
+
+#pragma endregion
+
+#pragma region Chip
+
+static uint64_t random_state = 0x9e3779b97f4a7c15ULL;
+
+uint32_t esp_random(void) {
+    // xorshift64*, fixed seed so runs are reproducible
+    uint64_t x = __atomic_load_n(&random_state, __ATOMIC_RELAXED);
+    uint64_t next;
+    do {
+        next = x;
+        next ^= next >> 12;
+        next ^= next << 25;
+        next ^= next >> 27;
+    } while (!__atomic_compare_exchange_n(&random_state, &x, next, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return (uint32_t)((next * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+void esp_fill_random(void *buf, size_t len) {
+    uint8_t *out = buf;
+    while (len > 0) {
+        uint32_t value = esp_random();
+        size_t n = len < sizeof(value) ? len : sizeof(value);
+        memcpy(out, &value, n);
+        out += n;
+        len -= n;
+    }
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type) {
+    if (!mac) return ESP_ERR_INVALID_ARG;
+    static const uint8_t base_mac[6] = { 0x24, 0x0a, 0xc4, 0x12, 0x34, 0x50 };
+    memcpy(mac, base_mac, sizeof(base_mac));
+    mac[5] += (uint8_t)type;
+    return ESP_OK;
+}
+
+const esp_app_desc_t *esp_app_get_description(void) {
+    static esp_app_desc_t desc = {
+        .magic_word = ESP_APP_DESC_MAGIC_WORD,
+        .version = "host",
+        .project_name = "wifi_host",
+        .time = __TIME__,
+        .date = __DATE__,
+        .idf_ver = "host-fake",
+    };
+    return &desc;
+}
+
+#pragma endregion
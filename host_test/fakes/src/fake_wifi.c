@@ -0,0 +1,597 @@
+/**
+ * @file fake_wifi.c
+ * @brief WiFi driver fake: a state machine posting the events of the real one.
+ *
+ * The driver keeps the mode and configurations the component sets, raises
+ * STA/AP START and STOP events on esp_wifi_start() and esp_wifi_stop(), and
+ * resolves esp_wifi_connect() against the networks added with
+ * fake_wifi_add_network() after a configurable delay (an esp_timer, so it
+ * runs on the virtual clock too). In scripted mode the connect outcome is
+ * left to fake_wifi_inject(), which is how recorded traces are replayed.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "fake_host.h"
+#include "fake_internal.h"
+
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+
+#define MAX_NETWORKS 16
+#define MAX_PENDING_EVENTS 4
+#define DEFAULT_CONNECT_DELAY_MS 50
+#define DEFAULT_MAX_TX_POWER 80
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    size_t size;
+    union {
+        wifi_event_sta_connected_t sta_connected;
+        wifi_event_sta_disconnected_t sta_disconnected;
+        wifi_event_sta_scan_done_t scan_done;
+        wifi_event_ap_staconnected_t ap_staconnected;
+        wifi_event_ap_stadisconnected_t ap_stadisconnected;
+        ip_event_got_ip_t got_ip;
+        ip_event_ap_staipassigned_t ap_staipassigned;
+    } data;
+} pending_event_t;
+
+typedef struct {
+    pending_event_t events[MAX_PENDING_EVENTS];
+    size_t count;
+} pending_events_t;
+
+typedef struct {
+    uint8_t mac[6];
+    uint8_t aid;
+} station_t;
+
+static pthread_mutex_t wifi_lock = PTHREAD_MUTEX_INITIALIZER;
+static fake_wifi_state_t state = { .max_tx_power = DEFAULT_MAX_TX_POWER };
+static wifi_config_t ap_config;
+static wifi_config_t sta_config;
+static fake_wifi_network_t networks[MAX_NETWORKS];
+static size_t network_count;
+static uint32_t connect_delay_ms = DEFAULT_CONNECT_DELAY_MS;
+static bool scripted;
+static int dropped_events;
+static esp_timer_handle_t connect_timer;
+static station_t stations[ESP_WIFI_MAX_CONN_NUM];
+static uint8_t next_aid = 1;
+static wifi_ap_record_t scan_results[MAX_NETWORKS];
+static uint16_t scan_result_count;
+static fake_wifi_observer_t observer;
+static void *observer_ctx;
+
+#pragma region Helpers
+
+static bool has_sta(void) {
+    return state.started && (state.mode == WIFI_MODE_STA || state.mode == WIFI_MODE_APSTA);
+}
+
+static bool has_ap(void) {
+    return state.started && (state.mode == WIFI_MODE_AP || state.mode == WIFI_MODE_APSTA);
+}
+
+static pending_event_t *pending_add(pending_events_t *pending, esp_event_base_t base, int32_t id, size_t size) {
+    pending_event_t *event = &pending->events[pending->count++];
+    memset(event, 0, sizeof(*event));
+    event->base = base;
+    event->id = id;
+    event->size = size;
+    return event;
+}
+
+static void pending_post(pending_events_t *pending) {
+    for (size_t i = 0; i < pending->count; i++) {
+        pending_event_t *event = &pending->events[i];
+        esp_event_post(event->base, event->id, event->size ? &event->data : NULL, event->size, portMAX_DELAY);
+    }
+}
+
+static void sta_disconnected_event(pending_events_t *pending, uint8_t reason) {
+    pending_event_t *event = pending_add(pending, WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED,
+                                         sizeof(wifi_event_sta_disconnected_t));
+    size_t len = strnlen((const char *)sta_config.sta.ssid, sizeof(sta_config.sta.ssid));
+    memcpy(event->data.sta_disconnected.ssid, sta_config.sta.ssid, len);
+    event->data.sta_disconnected.ssid_len = (uint8_t)len;
+    event->data.sta_disconnected.reason = reason;
+    event->data.sta_disconnected.rssi = -90;
+}
+
+/**
+ * @brief Report a driver call to the observer, wifi_lock held by the caller.
+ *
+ * Releases the lock before calling out.
+ */
+static void observe_and_unlock(const char *call) {
+    fake_wifi_observer_t fn = observer;
+    void *ctx = observer_ctx;
+    fake_wifi_state_t snapshot = state;
+    pthread_mutex_unlock(&wifi_lock);
+    if (fn) fn(call, &snapshot, ctx);
+}
+
+static const fake_wifi_network_t *find_network(const char *ssid) {
+    for (size_t i = 0; i < network_count; i++) {
+        if (strcmp(networks[i].ssid, ssid) == 0) return &networks[i];
+    }
+    return NULL;
+}
+
+static void connect_outcome(void *arg) {
+    (void)arg;
+    pending_events_t pending = { 0 };
+    pthread_mutex_lock(&wifi_lock);
+    if (has_sta() && !state.sta_connected) {
+        const fake_wifi_network_t *network = find_network(state.sta_ssid);
+        if (!network) {
+            sta_disconnected_event(&pending, WIFI_REASON_NO_AP_FOUND);
+        } else if (network->authmode != WIFI_AUTH_OPEN &&
+                   strncmp(network->password, (const char *)sta_config.sta.password,
+                           sizeof(sta_config.sta.password)) != 0) {
+            sta_disconnected_event(&pending, WIFI_REASON_AUTH_FAIL);
+        } else {
+            state.sta_connected = true;
+            pending_event_t *event = pending_add(&pending, WIFI_EVENT, WIFI_EVENT_STA_CONNECTED,
+                                                 sizeof(wifi_event_sta_connected_t));
+            size_t len = strlen(network->ssid);
+            memcpy(event->data.sta_connected.ssid, network->ssid, len);
+            event->data.sta_connected.ssid_len = (uint8_t)len;
+            event->data.sta_connected.channel = 6;
+            event->data.sta_connected.authmode = network->authmode;
+            event->data.sta_connected.aid = 1;
+            event = pending_add(&pending, IP_EVENT, IP_EVENT_STA_GOT_IP, sizeof(ip_event_got_ip_t));
+            event->data.got_ip.esp_netif = fake_netif_sta();
+            fake_netif_sta_up(&event->data.got_ip.ip_info);
+            event->data.got_ip.ip_changed = true;
+        }
+    }
+    pthread_mutex_unlock(&wifi_lock);
+    pending_post(&pending);
+}
+
+#pragma endregion
+
+#pragma region Control
+
+void fake_wifi_add_network(const fake_wifi_network_t *network) {
+    pthread_mutex_lock(&wifi_lock);
+    if (network_count < MAX_NETWORKS) networks[network_count++] = *network;
+    pthread_mutex_unlock(&wifi_lock);
+}
+
+void fake_wifi_clear_networks(void) {
+    pthread_mutex_lock(&wifi_lock);
+    network_count = 0;
+    connect_delay_ms = DEFAULT_CONNECT_DELAY_MS;
+    pthread_mutex_unlock(&wifi_lock);
+}
+
+void fake_wifi_set_connect_delay_ms(uint32_t delay_ms) {
+    pthread_mutex_lock(&wifi_lock);
+    connect_delay_ms = delay_ms;
+    pthread_mutex_unlock(&wifi_lock);
+}
+
+void fake_wifi_set_scripted(bool enable) {
+    pthread_mutex_lock(&wifi_lock);
+    scripted = enable;
+    pthread_mutex_unlock(&wifi_lock);
+}
+
+bool fake_wifi_inject(esp_event_base_t base, int32_t id, const void *data, size_t size) {
+    pending_events_t pending = { 0 };
+    bool allowed = false;
+    pthread_mutex_lock(&wifi_lock);
+    if (base == WIFI_EVENT) {
+        switch (id) {
+        case WIFI_EVENT_SCAN_DONE:
+            allowed = has_sta();
+            break;
+        case WIFI_EVENT_STA_CONNECTED:
+            allowed = has_sta() && !state.sta_connected;
+            if (allowed) state.sta_connected = true;
+            break;
+        case WIFI_EVENT_STA_DISCONNECTED:
+            allowed = has_sta();
+            if (allowed) {
+                state.sta_connected = false;
+                fake_netif_sta_down();
+            }
+            break;
+        case WIFI_EVENT_AP_STACONNECTED:
+        case WIFI_EVENT_AP_STADISCONNECTED:
+        case WIFI_EVENT_AP_PROBEREQRECVED:
+            allowed = has_ap();
+            break;
+        case WIFI_EVENT_STA_BSS_RSSI_LOW:
+        case WIFI_EVENT_STA_BEACON_TIMEOUT:
+            allowed = has_sta() && state.sta_connected;
+            break;
+        default:
+            allowed = false;    // START and STOP come from the driver itself
+            break;
+        }
+    } else if (base == IP_EVENT) {
+        switch (id) {
+        case IP_EVENT_STA_GOT_IP:
+            allowed = has_sta() && state.sta_connected;
+            break;
+        case IP_EVENT_STA_LOST_IP:
+            allowed = has_sta();
+            break;
+        case IP_EVENT_AP_STAIPASSIGNED:
+            allowed = has_ap();
+            break;
+        default:
+            allowed = false;
+            break;
+        }
+    }
+    if (!allowed) {
+        dropped_events++;
+    } else if (base == IP_EVENT && id == IP_EVENT_STA_GOT_IP) {
+        // The address is the one the station really got, recorded addresses are only a hint
+        pending_event_t *event = pending_add(&pending, base, id, sizeof(ip_event_got_ip_t));
+        event->data.got_ip.esp_netif = fake_netif_sta();
+        fake_netif_sta_up(&event->data.got_ip.ip_info);
+        event->data.got_ip.ip_changed = true;
+    } else {
+        pending_event_t *event = pending_add(&pending, base, id, 0);
+        if (data && size <= sizeof(event->data)) {
+            memcpy(&event->data, data, size);
+            event->size = size;
+        }
+    }
+    pthread_mutex_unlock(&wifi_lock);
+    pending_post(&pending);
+    return allowed;
+}
+
+int fake_wifi_dropped_events(void) {
+    pthread_mutex_lock(&wifi_lock);
+    int dropped = dropped_events;
+    pthread_mutex_unlock(&wifi_lock);
+    return dropped;
+}
+
+uint32_t fake_wifi_station_join(const uint8_t mac[6]) {
+    pending_events_t pending = { 0 };
+    uint32_t ip = 0;
+    pthread_mutex_lock(&wifi_lock);
+    if (has_ap() && state.stations < ESP_WIFI_MAX_CONN_NUM) {
+        station_t *station = &stations[state.stations++];
+        memcpy(station->mac, mac, 6);
+        station->aid = next_aid++;
+        pending_event_t *event = pending_add(&pending, WIFI_EVENT, WIFI_EVENT_AP_STACONNECTED,
+                                             sizeof(wifi_event_ap_staconnected_t));
+        memcpy(event->data.ap_staconnected.mac, mac, 6);
+        event->data.ap_staconnected.aid = station->aid;
+        ip = fake_netif_ap_lease();
+        event = pending_add(&pending, IP_EVENT, IP_EVENT_AP_STAIPASSIGNED, sizeof(ip_event_ap_staipassigned_t));
+        event->data.ap_staipassigned.esp_netif = fake_netif_ap();
+        event->data.ap_staipassigned.ip.addr = ip;
+        memcpy(event->data.ap_staipassigned.mac, mac, 6);
+    }
+    pthread_mutex_unlock(&wifi_lock);
+    pending_post(&pending);
+    return ip;
+}
+
+void fake_wifi_station_leave(const uint8_t mac[6]) {
+    pending_events_t pending = { 0 };
+    pthread_mutex_lock(&wifi_lock);
+    for (int i = 0; i < state.stations; i++) {
+        if (memcmp(stations[i].mac, mac, 6) == 0) {
+            pending_event_t *event = pending_add(&pending, WIFI_EVENT, WIFI_EVENT_AP_STADISCONNECTED,
+                                                 sizeof(wifi_event_ap_stadisconnected_t));
+            memcpy(event->data.ap_stadisconnected.mac, mac, 6);
+            event->data.ap_stadisconnected.aid = stations[i].aid;
+            event->data.ap_stadisconnected.reason = WIFI_REASON_ASSOC_LEAVE;
+            stations[i] = stations[--state.stations];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&wifi_lock);
+    pending_post(&pending);
+}
+
+void fake_wifi_get_state(fake_wifi_state_t *out) {
+    pthread_mutex_lock(&wifi_lock);
+    *out = state;
+    pthread_mutex_unlock(&wifi_lock);
+}
+
+void fake_wifi_set_observer(fake_wifi_observer_t fn, void *ctx) {
+    pthread_mutex_lock(&wifi_lock);
+    observer = fn;
+    observer_ctx = ctx;
+    pthread_mutex_unlock(&wifi_lock);
+}
+
+#pragma endregion
+
+#pragma region esp_wifi API
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config) {
+    if (!config || config->magic != WIFI_INIT_CONFIG_MAGIC) return ESP_ERR_INVALID_ARG;
+    const esp_timer_create_args_t timer_args = {
+        .callback = connect_outcome,
+        .name = "fake_wifi_connect",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &connect_timer);
+    if (err != ESP_OK) return err;
+    pthread_mutex_lock(&wifi_lock);
+    state.initialized = true;
+    observe_and_unlock("init");
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_deinit(void) {
+    pthread_mutex_lock(&wifi_lock);
+    if (state.started) {
+        pthread_mutex_unlock(&wifi_lock);
+        return ESP_ERR_WIFI_NOT_STOPPED;
+    }
+    state.initialized = false;
+    pthread_mutex_unlock(&wifi_lock);
+    esp_timer_stop(connect_timer);
+    esp_timer_delete(connect_timer);
+    connect_timer = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage) {
+    (void)storage;
+    return state.initialized ? ESP_OK : ESP_ERR_WIFI_NOT_INIT;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) {
+    if (mode >= WIFI_MODE_MAX) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&wifi_lock);
+    if (!state.initialized) {
+        pthread_mutex_unlock(&wifi_lock);
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    state.mode = mode;
+    observe_and_unlock("set_mode");
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mode(wifi_mode_t *mode) {
+    if (!mode) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&wifi_lock);
+    *mode = state.mode;
+    bool initialized = state.initialized;
+    pthread_mutex_unlock(&wifi_lock);
+    return initialized ? ESP_OK : ESP_ERR_WIFI_NOT_INIT;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf) {
+    if (!conf) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&wifi_lock);
+    if (!state.initialized) {
+        pthread_mutex_unlock(&wifi_lock);
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if (interface == WIFI_IF_AP) {
+        ap_config = *conf;
+        size_t len = conf->ap.ssid_len ? conf->ap.ssid_len : strnlen((const char *)conf->ap.ssid, 32);
+        memcpy(state.ap_ssid, conf->ap.ssid, len);
+        state.ap_ssid[len] = '\0';
+    } else {
+        sta_config = *conf;
+        size_t len = strnlen((const char *)conf->sta.ssid, 32);
+        memcpy(state.sta_ssid, conf->sta.ssid, len);
+        state.sta_ssid[len] = '\0';
+    }
+    observe_and_unlock(interface == WIFI_IF_AP ? "set_config_ap" : "set_config_sta");
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf) {
+    if (!conf) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&wifi_lock);
+    *conf = interface == WIFI_IF_AP ? ap_config : sta_config;
+    pthread_mutex_unlock(&wifi_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void) {
+    pending_events_t pending = { 0 };
+    pthread_mutex_lock(&wifi_lock);
+    if (!state.initialized) {
+        pthread_mutex_unlock(&wifi_lock);
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if (!state.started) {
+        state.started = true;
+        state.start_calls++;
+        if (has_sta()) pending_add(&pending, WIFI_EVENT, WIFI_EVENT_STA_START, 0);
+        if (has_ap()) pending_add(&pending, WIFI_EVENT, WIFI_EVENT_AP_START, 0);
+    }
+    observe_and_unlock("start");
+    pending_post(&pending);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_stop(void) {
+    pending_events_t pending = { 0 };
+    pthread_mutex_lock(&wifi_lock);
+    if (!state.initialized) {
+        pthread_mutex_unlock(&wifi_lock);
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if (state.started) {
+        if (has_sta() && state.sta_connected) sta_disconnected_event(&pending, WIFI_REASON_ASSOC_LEAVE);
+        if (has_sta()) pending_add(&pending, WIFI_EVENT, WIFI_EVENT_STA_STOP, 0);
+        if (has_ap()) pending_add(&pending, WIFI_EVENT, WIFI_EVENT_AP_STOP, 0);
+        state.started = false;
+        state.sta_connected = false;
+        state.stations = 0;
+        state.stop_calls++;
+        fake_netif_sta_down();
+    }
+    observe_and_unlock("stop");
+    esp_timer_stop(connect_timer);
+    pending_post(&pending);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void) {
+    pthread_mutex_lock(&wifi_lock);
+    if (!state.initialized) {
+        pthread_mutex_unlock(&wifi_lock);
+        return ESP_ERR_WIFI_NOT_INIT;
+    }
+    if (!has_sta()) {
+        bool started = state.started;
+        pthread_mutex_unlock(&wifi_lock);
+        return started ? ESP_ERR_WIFI_MODE : ESP_ERR_WIFI_NOT_STARTED;
+    }
+    state.connect_calls++;
+    bool run = !scripted;
+    uint32_t delay_ms = connect_delay_ms;
+    observe_and_unlock("connect");
+    if (run) {
+        esp_timer_stop(connect_timer);
+        esp_timer_start_once(connect_timer, (uint64_t)delay_ms * 1000);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_disconnect(void) {
+    pending_events_t pending = { 0 };
+    pthread_mutex_lock(&wifi_lock);
+    if (!has_sta()) {
+        pthread_mutex_unlock(&wifi_lock);
+        return ESP_ERR_WIFI_NOT_STARTED;
+    }
+    if (state.sta_connected) {
+        state.sta_connected = false;
+        fake_netif_sta_down();
+        sta_disconnected_event(&pending, WIFI_REASON_ASSOC_LEAVE);
+    }
+    observe_and_unlock("disconnect");
+    esp_timer_stop(connect_timer);
+    pending_post(&pending);
+    return ESP_OK;
+}
+
+static int compare_rssi(const void *a, const void *b) {
+    return ((const wifi_ap_record_t *)b)->rssi - ((const wifi_ap_record_t *)a)->rssi;
+}
+
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t *config, bool block) {
+    (void)config;
+    pending_events_t pending = { 0 };
+    pthread_mutex_lock(&wifi_lock);
+    if (!has_sta()) {
+        pthread_mutex_unlock(&wifi_lock);
+        return ESP_ERR_WIFI_STATE;
+    }
+    state.scan_calls++;
+    scan_result_count = 0;
+    for (size_t i = 0; i < network_count; i++) {
+        wifi_ap_record_t *record = &scan_results[scan_result_count++];
+        memset(record, 0, sizeof(*record));
+        record->bssid[0] = 0x02;
+        record->bssid[5] = (uint8_t)i;
+        memcpy(record->ssid, networks[i].ssid, strnlen(networks[i].ssid, sizeof(record->ssid) - 1));
+        record->primary = 1 + (uint8_t)(i % 11);
+        record->rssi = networks[i].rssi;
+        record->authmode = networks[i].authmode;
+    }
+    qsort(scan_results, scan_result_count, sizeof(scan_results[0]), compare_rssi);
+    if (!block && !scripted) {
+        pending_event_t *event = pending_add(&pending, WIFI_EVENT, WIFI_EVENT_SCAN_DONE,
+                                             sizeof(wifi_event_sta_scan_done_t));
+        event->data.scan_done.number = (uint8_t)scan_result_count;
+    }
+    observe_and_unlock("scan_start");
+    pending_post(&pending);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_num(uint16_t *number) {
+    if (!number) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&wifi_lock);
+    *number = scan_result_count;
+    pthread_mutex_unlock(&wifi_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t *number, wifi_ap_record_t *ap_records) {
+    if (!number || !ap_records) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&wifi_lock);
+    if (*number > scan_result_count) *number = scan_result_count;
+    memcpy(ap_records, scan_results, *number * sizeof(*ap_records));
+    scan_result_count = 0;      // Like the driver, reading the records frees them
+    pthread_mutex_unlock(&wifi_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info) {
+    if (!ap_info) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&wifi_lock);
+    esp_err_t err = ESP_ERR_WIFI_CONN;
+    if (has_sta() && state.sta_connected) {
+        memset(ap_info, 0, sizeof(*ap_info));
+        memcpy(ap_info->ssid, state.sta_ssid, strnlen(state.sta_ssid, sizeof(ap_info->ssid) - 1));
+        const fake_wifi_network_t *network = find_network(state.sta_ssid);
+        ap_info->rssi = network ? network->rssi : -60;
+        ap_info->authmode = network ? network->authmode : WIFI_AUTH_WPA2_PSK;
+        ap_info->primary = 6;
+        err = ESP_OK;
+    }
+    pthread_mutex_unlock(&wifi_lock);
+    return err;
+}
+
+esp_err_t esp_wifi_ap_get_sta_list(wifi_sta_list_t *sta) {
+    if (!sta) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&wifi_lock);
+    if (!has_ap()) {
+        pthread_mutex_unlock(&wifi_lock);
+        return ESP_ERR_WIFI_MODE;
+    }
+    memset(sta, 0, sizeof(*sta));
+    for (int i = 0; i < state.stations; i++) {
+        memcpy(sta->sta[i].mac, stations[i].mac, 6);
+        sta->sta[i].rssi = -50;
+    }
+    sta->num = state.stations;
+    pthread_mutex_unlock(&wifi_lock);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_max_tx_power(int8_t power) {
+    if (power < 8 || power > 84) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&wifi_lock);
+    if (!state.started) {
+        pthread_mutex_unlock(&wifi_lock);
+        return ESP_ERR_WIFI_NOT_STARTED;
+    }
+    state.max_tx_power = power;
+    observe_and_unlock("set_max_tx_power");
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_max_tx_power(int8_t *power) {
+    if (!power) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&wifi_lock);
+    *power = state.max_tx_power;
+    bool started = state.started;
+    pthread_mutex_unlock(&wifi_lock);
+    return started ? ESP_OK : ESP_ERR_WIFI_NOT_STARTED;
+}
+
+#pragma endregion
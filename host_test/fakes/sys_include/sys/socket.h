@@ -0,0 +1,11 @@
+/**
+ * @file socket.h
+ * @brief <sys/socket.h> as the component sees it: lwIP's socket API, like ESP-IDF's newlib port.
+ *
+ * Only on the component's include path, the fakes use the host header directly.
+ */
+
+#pragma once
+
+#include_next <sys/socket.h>
+#include "lwip/sockets.h"
@@ -0,0 +1,61 @@
+/**
+ * @file fuzz.h
+ * @brief Interface between the fuzz harnesses and their drivers.
+ *
+ * Each harness (fuzz_<target>.c) implements fuzz_run(): it feeds one input to
+ * the code under test, checks invariants with FUZZ_CHECK() and describes the
+ * outcome. The same harness is driven by libFuzzer (fuzz_entry.c), by AFL or
+ * by hand through stdin and files, and by the corpus check (fuzz_main.c),
+ * which compares the descriptions against the expected ones.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Longest outcome description, including the terminator
+#define FUZZ_DESCRIBE_MAX 256
+
+/**
+ * @brief Abort when an invariant does not hold, so every driver reports a crash.
+ */
+#define FUZZ_CHECK(cond)                                                                \
+    do {                                                                                \
+        if (!(cond)) {                                                                  \
+            fprintf(stderr, "%s:%d: FUZZ_CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            abort();                                                                    \
+        }                                                                               \
+    } while (0)
+
+/**
+ * @brief Run one input through the target.
+ *
+ * @param data Input, exactly @p size bytes are readable
+ * @param size Input length
+ * @param out Outcome of the run, a single line that depends on the input only
+ * @param out_size Size of @p out, FUZZ_DESCRIBE_MAX
+ */
+void fuzz_run(const uint8_t *data, size_t size, char *out, size_t out_size);
+
+/**
+ * @brief Append @p len bytes to a description, escaping everything but printable ASCII.
+ *
+ * @return Characters written, the description stays NUL-terminated
+ */
+size_t fuzz_escape(char *out, size_t out_size, const char *data, size_t len);
+
+/**
+ * @brief FNV-1a hash, to describe outputs too long to print.
+ */
+uint32_t fuzz_hash(const void *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
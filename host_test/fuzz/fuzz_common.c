@@ -0,0 +1,46 @@
+/**
+ * @file fuzz_common.c
+ * @brief Helpers shared by the fuzz harnesses and the libFuzzer entry point.
+ */
+
+#include "fuzz.h"
+
+#include "esp_log.h"
+
+size_t fuzz_escape(char *out, size_t out_size, const char *data, size_t len) {
+    size_t used = 0;
+    for (size_t i = 0; i < len && used + 5 < out_size; i++) {
+        uint8_t c = (uint8_t)data[i];
+        if (c >= 0x20 && c < 0x7f && c != '\\') {
+            out[used++] = (char)c;
+        } else {
+            used += (size_t)snprintf(out + used, out_size - used, "\\x%02x", c);
+        }
+    }
+    if (out_size > 0) out[used < out_size ? used : out_size - 1] = '\0';
+    return used;
+}
+
+uint32_t fuzz_hash(const void *data, size_t len) {
+    const uint8_t *p = data;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief libFuzzer entry point; the description is built and dropped.
+ */
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    static int quiet;
+    if (!quiet) {
+        // Malformed input is the normal case here, the warnings would drown the fuzzer output
+        esp_log_level_set("*", ESP_LOG_NONE);
+        quiet = 1;
+    }
+    char out[FUZZ_DESCRIBE_MAX];
+    fuzz_run(data, size, out, sizeof(out));
+    return 0;
+}
@@ -0,0 +1,41 @@
+/**
+ * @file fuzz_dns_name.c
+ * @brief Fuzz harness of parse_dns_name().
+ *
+ * Input: one byte selecting the size of the output buffer (0..129), then the
+ * raw name as it appears in a question. The name is parsed from its own
+ * allocation, so reading past the end of the packet is caught by ASan.
+ */
+
+#include <string.h>
+
+#include "dns_parse.h"
+#include "fuzz.h"
+
+void fuzz_run(const uint8_t *data, size_t size, char *out, size_t out_size) {
+    if (size < 1) {
+        snprintf(out, out_size, "short");
+        return;
+    }
+    size_t name_max = data[0] % 130;
+    size_t raw_len = size - 1;
+    char *raw = malloc(raw_len > 0 ? raw_len : 1);
+    char *name = malloc(name_max > 0 ? name_max : 1);
+    FUZZ_CHECK(raw != NULL && name != NULL);
+    memcpy(raw, data + 1, raw_len);
+
+    char *next = host_parse_dns_name(raw, raw + raw_len, name, name_max);
+    if (next == NULL) {
+        snprintf(out, out_size, "max=%u NULL", (unsigned)name_max);
+    } else {
+        // The name and its terminator were consumed, the rest of the packet was not
+        FUZZ_CHECK(next > raw && next <= raw + raw_len);
+        size_t len = strnlen(name, name_max);
+        FUZZ_CHECK(len < name_max);
+        size_t used = (size_t)snprintf(out, out_size, "max=%u next=+%u name=", (unsigned)name_max,
+                                       (unsigned)(next - raw));
+        fuzz_escape(out + used, out_size - used, name, len);
+    }
+    free(name);
+    free(raw);
+}
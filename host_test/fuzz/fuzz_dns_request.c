@@ -0,0 +1,45 @@
+/**
+ * @file fuzz_dns_request.c
+ * @brief Fuzz harness of parse_dns_request().
+ *
+ * Input: a DNS packet as received on port 53. It is answered with the
+ * captive portal's "*" rule into a reply buffer of DNS_MAX_LEN (256) bytes,
+ * like the server task does.
+ */
+
+#include <string.h>
+
+#include "dns_parse.h"
+#include "fuzz.h"
+#include "lwip/inet.h"
+
+#define REPLY_SIZE 256
+#define HEADER_SIZE 12
+#define ANSWER_SIZE 16
+
+void fuzz_run(const uint8_t *data, size_t size, char *out, size_t out_size) {
+    static dns_server_handle_t handle;
+    if (!handle) handle = host_dns_wildcard_handle(inet_addr("192.168.4.1"));
+
+    char *req = malloc(size > 0 ? size : 1);
+    char *reply = malloc(REPLY_SIZE);
+    FUZZ_CHECK(req != NULL && reply != NULL);
+    memcpy(req, data, size);
+
+    int len = host_parse_dns_request(req, size, reply, REPLY_SIZE, handle, 0);
+    if (len <= 0) {
+        snprintf(out, out_size, "ret=%d", len);
+    } else {
+        // A reply is the request with the answers appended, flagged as a response
+        FUZZ_CHECK(len >= HEADER_SIZE && len <= REPLY_SIZE);
+        FUZZ_CHECK(memcmp(reply, req, 2) == 0);
+        FUZZ_CHECK(((uint8_t)reply[2] & 0x80) != 0);
+        uint16_t an_count;
+        memcpy(&an_count, reply + 6, sizeof(an_count));
+        an_count = ntohs(an_count);
+        FUZZ_CHECK((size_t)len >= HEADER_SIZE + an_count * (size_t)ANSWER_SIZE);
+        snprintf(out, out_size, "ret=%d an=%u reply=%08x", len, an_count, (unsigned)fuzz_hash(reply, (size_t)len));
+    }
+    free(reply);
+    free(req);
+}
@@ -0,0 +1,162 @@
+/**
+ * @file fuzz_form.c
+ * @brief Fuzz harness of the form body parsers.
+ *
+ * Input: a selector byte, a chunk size byte, then the body.
+ *
+ * - Selector even: an application/x-www-form-urlencoded body as the captive
+ *   portal form posts it. Every field captive_post_handler() reads is
+ *   extracted into its 193-byte parameter buffer and URL-decoded where the
+ *   handler decodes it. Bodies of 768 bytes or more are rejected like there.
+ * - Selector odd: a multipart/form-data request for wifi_multipart. The body
+ *   starts with the Content-Type value up to the first newline and is pushed
+ *   into the parser in pieces of the chunk size (1..256).
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_http_server.h"
+#include "fuzz.h"
+#include "wifi_multipart.h"
+#include "wifi_util.h"
+
+#define CAPTIVE_BODY_MAX 768
+#define CAPTIVE_PARAM_SIZE 193
+
+/// Fields of the captive portal form, and whether the handler URL-decodes them
+static const struct {
+    const char *key;
+    bool decode;
+} captive_fields[] = {
+    { "wifi_mode", true },
+    { "ap_ssid", true },
+    { "ap_password", true },
+    { "ssid", true },
+    { "authmode", false },
+    { "password", true },
+    { "use_static_ip", false },
+    { "static_ip", false },
+    { "use_mDNS", false },
+    { "mDNS_hostname", true },
+    { "service_name", true },
+};
+
+static void run_urlencoded(const uint8_t *data, size_t size, char *out, size_t out_size) {
+    size_t len = strnlen((const char *)data, size);
+    if (len >= CAPTIVE_BODY_MAX) {
+        snprintf(out, out_size, "form too large");
+        return;
+    }
+    char *body = malloc(len + 1);
+    char *param = malloc(CAPTIVE_PARAM_SIZE);
+    FUZZ_CHECK(body != NULL && param != NULL);
+    memcpy(body, data, len);
+    body[len] = '\0';
+
+    size_t used = (size_t)snprintf(out, out_size, "form");
+    for (size_t i = 0; i < sizeof(captive_fields) / sizeof(captive_fields[0]); i++) {
+        esp_err_t err = httpd_query_key_value(body, captive_fields[i].key, param, CAPTIVE_PARAM_SIZE);
+        if (err != ESP_OK) continue;
+        FUZZ_CHECK(strnlen(param, CAPTIVE_PARAM_SIZE) < CAPTIVE_PARAM_SIZE);
+        if (captive_fields[i].decode) url_decode(param);
+        if (used < out_size) {
+            used += (size_t)snprintf(out + used, out_size - used, " %s=%u/%04x", captive_fields[i].key,
+                                     (unsigned)strlen(param), (unsigned)(fuzz_hash(param, strlen(param)) & 0xffff));
+        }
+    }
+    free(param);
+    free(body);
+}
+
+typedef struct {
+    unsigned parts;
+    unsigned ends;
+    size_t data_bytes;
+    uint32_t data_hash;
+    bool in_part;
+} multipart_ctx_t;
+
+static void check_part(const wifi_multipart_part_t *part) {
+    FUZZ_CHECK(strnlen(part->name, sizeof(part->name)) < sizeof(part->name));
+    FUZZ_CHECK(strnlen(part->filename, sizeof(part->filename)) < sizeof(part->filename));
+    FUZZ_CHECK(strnlen(part->content_type, sizeof(part->content_type)) < sizeof(part->content_type));
+}
+
+static esp_err_t on_part(const wifi_multipart_part_t *part, void *ctx) {
+    multipart_ctx_t *c = ctx;
+    check_part(part);
+    FUZZ_CHECK(!c->in_part && part->index == c->parts);
+    c->in_part = true;
+    c->parts++;
+    return ESP_OK;
+}
+
+static esp_err_t on_data(const wifi_multipart_part_t *part, const char *data, size_t len, void *ctx) {
+    multipart_ctx_t *c = ctx;
+    FUZZ_CHECK(c->in_part && len > 0);
+    c->data_bytes += len;
+    for (size_t i = 0; i < len; i++) {
+        c->data_hash = (c->data_hash ^ (uint8_t)data[i]) * 16777619u;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t on_part_end(const wifi_multipart_part_t *part, void *ctx) {
+    multipart_ctx_t *c = ctx;
+    check_part(part);
+    FUZZ_CHECK(c->in_part);
+    c->in_part = false;
+    c->ends++;
+    return ESP_OK;
+}
+
+static void run_multipart(const uint8_t *data, size_t size, size_t chunk, char *out, size_t out_size) {
+    const uint8_t *nl = memchr(data, '\n', size);
+    size_t type_len = nl ? (size_t)(nl - data) : size;
+    char *content_type = malloc(type_len + 1);
+    FUZZ_CHECK(content_type != NULL);
+    memcpy(content_type, data, type_len);
+    content_type[type_len] = '\0';
+    const uint8_t *body = nl ? nl + 1 : data + size;
+    size_t body_len = (size_t)(data + size - body);
+
+    static const wifi_multipart_callbacks_t cb = { .on_part = on_part, .on_data = on_data, .on_part_end = on_part_end };
+    multipart_ctx_t ctx = { .data_hash = 2166136261u };
+    wifi_multipart_t *mp = malloc(sizeof(*mp));
+    FUZZ_CHECK(mp != NULL);
+    esp_err_t init = wifi_multipart_init(mp, content_type, &cb, &ctx);
+    esp_err_t feed = ESP_OK;
+    esp_err_t finish = ESP_OK;
+    if (init == ESP_OK) {
+        for (size_t off = 0; off < body_len && feed == ESP_OK; off += chunk) {
+            size_t n = body_len - off < chunk ? body_len - off : chunk;
+            // Each piece gets its own allocation, so reads past the piece are caught
+            char *piece = malloc(n);
+            FUZZ_CHECK(piece != NULL);
+            memcpy(piece, body + off, n);
+            feed = wifi_multipart_feed(mp, piece, n);
+            free(piece);
+        }
+        if (feed == ESP_OK) finish = wifi_multipart_finish(mp);
+    }
+    // Data never exceeds the body, and a completed body closed every part
+    FUZZ_CHECK(ctx.data_bytes <= body_len);
+    FUZZ_CHECK(!(feed == ESP_OK && finish == ESP_OK && init == ESP_OK) || !ctx.in_part);
+    snprintf(out, out_size, "multipart init=%d feed=%d finish=%d parts=%u ends=%u data=%u/%08x", init, feed, finish,
+             ctx.parts, ctx.ends, (unsigned)ctx.data_bytes, (unsigned)ctx.data_hash);
+    free(mp);
+    free(content_type);
+}
+
+void fuzz_run(const uint8_t *data, size_t size, char *out, size_t out_size) {
+    if (size < 2) {
+        snprintf(out, out_size, "short");
+        return;
+    }
+    if (data[0] & 1) {
+        run_multipart(data + 2, size - 2, (size_t)data[1] + 1, out, out_size);
+    } else {
+        run_urlencoded(data + 2, size - 2, out, out_size);
+    }
+}
@@ -0,0 +1,238 @@
+/**
+ * @file fuzz_main.c
+ * @brief Driver of a fuzz harness without libFuzzer: AFL, reproduction and the corpus check.
+ *
+ *   fuzz_<target>                                  one input from stdin (AFL)
+ *   fuzz_<target> FILE...                          run files, print their outcomes
+ *   fuzz_<target> --check DIR EXPECTED [--max-ms N] [--update]
+ *
+ * With AFL, build with afl-clang-fast or afl-gcc as the C compiler and run
+ * `afl-fuzz -i fuzz/corpus/<target> -o findings -- ./fuzz_<target>`; the
+ * persistent loop is used when the compiler provides it.
+ *
+ * --check runs every file of DIR and compares its outcome with the line of
+ * the same name in EXPECTED ("name<TAB>outcome", one per input). It fails
+ * when an outcome differs, an input has no line or a line has no input, or
+ * when an input takes longer than --max-ms (default 20). Slow inputs are
+ * timed three times and the fastest run counts, so a preempted run does not
+ * fail the check. --update writes EXPECTED from the current outcomes.
+ */
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "fuzz.h"
+
+#define MAX_INPUT_SIZE (1024 * 1024)
+#define MAX_CORPUS 256
+#define TIMING_RUNS 3
+
+typedef struct {
+    char name[128];
+    char outcome[FUZZ_DESCRIBE_MAX];
+    bool seen;
+} expected_entry_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Read a whole stream into an exactly sized buffer, so overreads hit the redzone.
+ */
+static uint8_t *read_stream(FILE *f, size_t *size) {
+    uint8_t *buf = malloc(MAX_INPUT_SIZE);
+    if (!buf) return NULL;
+    size_t len = fread(buf, 1, MAX_INPUT_SIZE, f);
+    uint8_t *exact = malloc(len > 0 ? len : 1);
+    if (exact) memcpy(exact, buf, len);
+    free(buf);
+    *size = len;
+    return exact;
+}
+
+static uint8_t *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    uint8_t *data = read_stream(f, size);
+    fclose(f);
+    return data;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int load_expected(const char *path, expected_entry_t *entries, int max) {
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    char line[sizeof(entries[0].name) + FUZZ_DESCRIBE_MAX + 2];
+    int count = 0;
+    while (count < max && fgets(line, sizeof(line), f)) {
+        line[strcspn(line, "\n")] = '\0';
+        char *tab = strchr(line, '\t');
+        if (!tab) continue;
+        *tab = '\0';
+        snprintf(entries[count].name, sizeof(entries[count].name), "%s", line);
+        snprintf(entries[count].outcome, sizeof(entries[count].outcome), "%s", tab + 1);
+        entries[count].seen = false;
+        count++;
+    }
+    fclose(f);
+    return count;
+}
+
+static int check_corpus(const char *dir_path, const char *expected_path, double max_ms, bool update) {
+    DIR *dir = opendir(dir_path);
+    if (!dir) {
+        fprintf(stderr, "Cannot open corpus %s\n", dir_path);
+        return 1;
+    }
+    char *names[MAX_CORPUS];
+    int count = 0;
+    for (struct dirent *e; (e = readdir(dir)) != NULL && count < MAX_CORPUS;) {
+        if (e->d_name[0] != '.') names[count++] = strdup(e->d_name);
+    }
+    closedir(dir);
+    qsort(names, (size_t)count, sizeof(names[0]), compare_names);
+
+    static expected_entry_t expected[MAX_CORPUS];
+    int expected_count = update ? 0 : load_expected(expected_path, expected, MAX_CORPUS);
+    FILE *out = update ? fopen(expected_path, "w") : NULL;
+    if (update && !out) {
+        fprintf(stderr, "Cannot write %s\n", expected_path);
+        return 1;
+    }
+
+    int failures = 0;
+    double slowest_ms = 0;
+    for (int i = 0; i < count; i++) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir_path, names[i]);
+        size_t size;
+        uint8_t *data = read_file(path, &size);
+        if (!data) {
+            fprintf(stderr, "%s: cannot read\n", names[i]);
+            failures++;
+            continue;
+        }
+        char outcome[FUZZ_DESCRIBE_MAX];
+        double best_ms = 0;
+        for (int run = 0; run < TIMING_RUNS; run++) {
+            uint64_t start = now_ns();
+            fuzz_run(data, size, outcome, sizeof(outcome));
+            double ms = (double)(now_ns() - start) / 1e6;
+            if (run == 0 || ms < best_ms) best_ms = ms;
+            if (best_ms <= max_ms) break;
+        }
+        free(data);
+        if (best_ms > slowest_ms) slowest_ms = best_ms;
+        if (best_ms > max_ms) {
+            fprintf(stderr, "%s: %.3f ms, limit %.3f ms\n", names[i], best_ms, max_ms);
+            failures++;
+        }
+
+        if (update) {
+            fprintf(out, "%s\t%s\n", names[i], outcome);
+            continue;
+        }
+        expected_entry_t *entry = NULL;
+        for (int j = 0; j < expected_count && !entry; j++) {
+            if (strcmp(expected[j].name, names[i]) == 0) entry = &expected[j];
+        }
+        if (!entry) {
+            fprintf(stderr, "%s: no expected outcome, got \"%s\"\n", names[i], outcome);
+            failures++;
+        } else {
+            entry->seen = true;
+            if (strcmp(entry->outcome, outcome) != 0) {
+                fprintf(stderr, "%s: outcome \"%s\", expected \"%s\"\n", names[i], outcome, entry->outcome);
+                failures++;
+            }
+        }
+    }
+    for (int j = 0; j < expected_count; j++) {
+        if (!expected[j].seen) {
+            fprintf(stderr, "%s: expected outcome but no input\n", expected[j].name);
+            failures++;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    if (out) fclose(out);
+
+    printf("%d inputs, %d failures, slowest %.3f ms\n", count, failures, slowest_ms);
+    return failures ? 1 : 0;
+}
+
+#ifdef __AFL_FUZZ_TESTCASE_LEN
+__AFL_FUZZ_INIT();
+#endif
+
+int main(int argc, char **argv) {
+    esp_log_level_set("*", ESP_LOG_NONE);
+    char outcome[FUZZ_DESCRIBE_MAX];
+
+    if (argc == 1) {
+#ifdef __AFL_FUZZ_TESTCASE_LEN
+        // Persistent mode of afl-clang-fast: many inputs per process through shared memory
+        __AFL_INIT();
+        const uint8_t *shared = __AFL_FUZZ_TESTCASE_BUF;
+        while (__AFL_LOOP(10000)) {
+            size_t size = (size_t)__AFL_FUZZ_TESTCASE_LEN;
+            uint8_t *data = malloc(size > 0 ? size : 1);
+            memcpy(data, shared, size);
+            fuzz_run(data, size, outcome, sizeof(outcome));
+            free(data);
+        }
+#else
+        size_t size;
+        uint8_t *data = read_stream(stdin, &size);
+        if (!data) return 1;
+        fuzz_run(data, size, outcome, sizeof(outcome));
+        free(data);
+#endif
+        return 0;
+    }
+
+    if (strcmp(argv[1], "--check") == 0) {
+        if (argc < 4) {
+            fprintf(stderr, "Usage: %s --check DIR EXPECTED [--max-ms N] [--update]\n", argv[0]);
+            return 2;
+        }
+        double max_ms = 20;
+        bool update = false;
+        for (int i = 4; i < argc; i++) {
+            if (strcmp(argv[i], "--max-ms") == 0 && i + 1 < argc) {
+                max_ms = atof(argv[++i]);
+            } else if (strcmp(argv[i], "--update") == 0) {
+                update = true;
+            } else {
+                fprintf(stderr, "Unknown option %s\n", argv[i]);
+                return 2;
+            }
+        }
+        return check_corpus(argv[2], argv[3], max_ms, update);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        size_t size;
+        uint8_t *data = read_file(argv[i], &size);
+        if (!data) {
+            fprintf(stderr, "Cannot read %s\n", argv[i]);
+            return 1;
+        }
+        fuzz_run(data, size, outcome, sizeof(outcome));
+        printf("%s\t%s\n", argv[i], outcome);
+        free(data);
+    }
+    return 0;
+}
@@ -0,0 +1,27 @@
+/**
+ * @file fuzz_url_decode.c
+ * @brief Fuzz harness of url_decode().
+ *
+ * Input: the encoded string, up to its first NUL byte.
+ */
+
+#include <string.h>
+
+#include "fuzz.h"
+#include "wifi_util.h"
+
+void fuzz_run(const uint8_t *data, size_t size, char *out, size_t out_size) {
+    size_t in_len = strnlen((const char *)data, size);
+    char *str = malloc(in_len + 1);
+    FUZZ_CHECK(str != NULL);
+    memcpy(str, data, in_len);
+    str[in_len] = '\0';
+
+    url_decode(str);
+    // Decoding only ever shrinks the string
+    size_t len = strlen(str);
+    FUZZ_CHECK(len <= in_len);
+    size_t used = (size_t)snprintf(out, out_size, "len=%u hash=%08x ", (unsigned)len, (unsigned)fuzz_hash(str, len));
+    fuzz_escape(out + used, out_size - used, str, len < 32 ? len : 32);
+    free(str);
+}
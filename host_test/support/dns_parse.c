@@ -0,0 +1,38 @@
+/**
+ * @file dns_parse.c
+ * @brief Compiles dns_server.c once more with its public symbols renamed, so
+ * its static parsers can be called without the socket and task around them.
+ */
+
+#include "dns_parse.h"
+
+#define start_dns_server host_dns_unused_start
+#define stop_dns_server host_dns_unused_stop
+#define dns_server_task host_dns_unused_task
+#define dns_server_get_stats host_dns_unused_get_stats
+#include "dns_server.c"
+#undef start_dns_server
+#undef stop_dns_server
+#undef dns_server_task
+#undef dns_server_get_stats
+
+char *host_parse_dns_name(char *raw_name, const char *end, char *parsed_name, size_t parsed_name_max_len) {
+    return parse_dns_name(raw_name, end, parsed_name, parsed_name_max_len);
+}
+
+int host_parse_dns_request(char *req, size_t req_len, char *dns_reply, size_t dns_reply_max_len,
+                           dns_server_handle_t h, uint32_t src_ip) {
+    return parse_dns_request(req, req_len, dns_reply, dns_reply_max_len, h, src_ip);
+}
+
+dns_server_handle_t host_dns_wildcard_handle(uint32_t ip) {
+    static struct {
+        struct dns_server_handle handle;
+        dns_entry_pair_t entry[1];
+    } wildcard;
+    wildcard.handle.num_of_entries = 1;
+    wildcard.handle.entry[0].name = "*";
+    wildcard.handle.entry[0].if_key = NULL;
+    wildcard.handle.entry[0].ip.addr = ip;
+    return &wildcard.handle;
+}
@@ -0,0 +1,38 @@
+/**
+ * @file dns_parse.h
+ * @brief The static DNS parsers of dns_server.c, for tests, benchmark and fuzzers.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_netif.h"
+#include "dns_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief parse_dns_name() of dns_server.c.
+ */
+char *host_parse_dns_name(char *raw_name, const char *end, char *parsed_name, size_t parsed_name_max_len);
+
+/**
+ * @brief parse_dns_request() of dns_server.c.
+ */
+int host_parse_dns_request(char *req, size_t req_len, char *dns_reply, size_t dns_reply_max_len,
+                           dns_server_handle_t h, uint32_t src_ip);
+
+/**
+ * @brief Handle answering every A question with @p ip, like the captive portal's "*" rule.
+ *
+ * @param ip IPv4 address in network byte order
+ */
+dns_server_handle_t host_dns_wildcard_handle(uint32_t ip);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,81 @@
+/**
+ * @file host_support.c
+ * @brief Setup shared by the host application, the unit tests and the benchmark.
+ */
+
+#include "host_support.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "fake_host.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "sdkconfig.h"
+
+/// Namespace of the component's settings (NVS_NAMESPACE_WIFI in Wifi.c)
+#define HOST_NVS_NAMESPACE "wifi_settings"
+
+static nvs_handle_t open_settings(void) {
+    nvs_handle_t handle;
+    ESP_ERROR_CHECK(nvs_flash_init());
+    ESP_ERROR_CHECK(nvs_open(HOST_NVS_NAMESPACE, NVS_READWRITE, &handle));
+    return handle;
+}
+
+void host_preset_sta(const char *ssid, const char *password) {
+    nvs_handle_t handle = open_settings();
+    ESP_ERROR_CHECK(nvs_set_str(handle, "ssid", ssid));
+    ESP_ERROR_CHECK(nvs_set_str(handle, "password", password));
+    ESP_ERROR_CHECK(nvs_set_u8(handle, "authmode", WIFI_AUTH_WPA2_PSK));
+    ESP_ERROR_CHECK(nvs_commit(handle));
+    nvs_close(handle);
+}
+
+void host_preset_mode(wifi_mode_t mode) {
+    nvs_handle_t handle = open_settings();
+    ESP_ERROR_CHECK(nvs_set_u8(handle, "wifi_mode", (uint8_t)mode));
+    ESP_ERROR_CHECK(nvs_commit(handle));
+    nvs_close(handle);
+}
+
+void host_add_network(const char *ssid, const char *password) {
+    fake_wifi_network_t network = {
+        .authmode = WIFI_AUTH_WPA2_PSK,
+        .rssi = -45,
+    };
+    snprintf(network.ssid, sizeof(network.ssid), "%s", ssid);
+    snprintf(network.password, sizeof(network.password), "%s", password);
+    fake_wifi_add_network(&network);
+}
+
+bool host_add_assets(void) {
+#ifdef WIFI_HOST_ASSETS_IMAGE
+    return fake_partition_add_file(CONFIG_WIFI_ASSETS_PARTITION_LABEL, WIFI_HOST_ASSETS_IMAGE) == ESP_OK;
+#else
+    return false;
+#endif
+}
+
+bool host_wait_until(bool (*done)(void *ctx), void *ctx, uint32_t timeout_ms) {
+    for (uint32_t waited = 0;; waited++) {
+        if (done(ctx)) return true;
+        if (waited >= timeout_ms) return false;
+        nanosleep(&(struct timespec){ .tv_nsec = 1000000 }, NULL);
+    }
+}
+
+bool host_sta_connected(void *ctx) {
+    (void)ctx;
+    fake_wifi_state_t state;
+    fake_wifi_get_state(&state);
+    return state.sta_connected;
+}
+
+bool host_ap_started(void *ctx) {
+    (void)ctx;
+    fake_wifi_state_t state;
+    fake_wifi_get_state(&state);
+    return state.started && (state.mode == WIFI_MODE_AP || state.mode == WIFI_MODE_APSTA);
+}
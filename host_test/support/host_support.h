@@ -0,0 +1,61 @@
+/**
+ * @file host_support.h
+ * @brief Setup shared by the host application, the unit tests and the benchmark.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_wifi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Store STA credentials the way the settings page saves them.
+ *
+ * Call before wifi_init(), which then starts in STA mode.
+ */
+void host_preset_sta(const char *ssid, const char *password);
+
+/**
+ * @brief Store the WiFi mode wifi_init() starts in (WIFI_MODE_AP or WIFI_MODE_STA).
+ */
+void host_preset_mode(wifi_mode_t mode);
+
+/**
+ * @brief Put a network on the simulated air, WPA2 with a strong signal.
+ */
+void host_add_network(const char *ssid, const char *password);
+
+/**
+ * @brief Back the asset partition with the image the build packs from the example web page.
+ *
+ * @return false when the build found no Python to pack it
+ */
+bool host_add_assets(void);
+
+/**
+ * @brief Poll @p done every millisecond for up to @p timeout_ms of real time.
+ *
+ * @return true when @p done returned true in time
+ */
+bool host_wait_until(bool (*done)(void *ctx), void *ctx, uint32_t timeout_ms);
+
+/**
+ * @brief Whether the station has an address.
+ */
+bool host_sta_connected(void *ctx);
+
+/**
+ * @brief Whether the softAP is up.
+ */
+bool host_ap_started(void *ctx);
+
+#ifdef __cplusplus
+}
+#endif
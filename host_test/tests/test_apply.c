@@ -0,0 +1,167 @@
+/**
+ * @file test_apply.c
+ * @brief Portal settings applied in STA mode with the cheapest action: static IP, DHCP, mDNS, reassociation, rejected POST.
+ */
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "Wifi.h"
+#include "esp_netif.h"
+#include "fake_host.h"
+#include "host_support.h"
+#include "unit.h"
+
+UNIT_GLOBALS;
+
+/// Settings a POST carries; absent checkboxes mean false, so every form has all fields
+typedef struct {
+    const char *ssid;
+    const char *password;
+    bool use_static_ip;
+    const char *static_ip;
+    bool use_mDNS;
+    const char *hostname;
+} form_t;
+
+static int post(const form_t *form, int authmode) {
+    char body[256];
+    int len = snprintf(body, sizeof(body),
+                       "wifi_mode=1&ssid=%s&authmode=%d&password=%s%s&static_ip=%s%s&mDNS_hostname=%s&service_name=web",
+                       form->ssid, authmode, form->password, form->use_static_ip ? "&use_static_ip=true" : "",
+                       form->static_ip, form->use_mDNS ? "&use_mDNS=true" : "", form->hostname);
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_POST, "/captive",
+                                   "Content-Type: application/x-www-form-urlencoded\r\n", body, len, &resp), ESP_OK);
+    int status = resp.status;
+    fake_httpd_response_free(&resp);
+    return status;
+}
+
+/// Count of an action after the one at the start of a test
+typedef struct {
+    wifi_apply_t action;
+    uint32_t count;
+} applied_wait_t;
+
+static bool applied(void *ctx) {
+    const applied_wait_t *wait = ctx;
+    wifi_apply_stats_t stats[WIFI_APPLY_COUNT];
+    wifi_get_apply_stats(stats);
+    return stats[wait->action].count >= wait->count;
+}
+
+/// Post a form and wait until the action was applied once more
+static void post_and_wait(const form_t *form, wifi_apply_t action) {
+    wifi_apply_stats_t stats[WIFI_APPLY_COUNT];
+    wifi_get_apply_stats(stats);
+    applied_wait_t wait = { action, stats[action].count + 1 };
+    CHECK_EQ_INT(post(form, WIFI_AUTHMODE_WPA_PSK), 302);
+    CHECK(host_wait_until(applied, &wait, 5000));
+    CHECK(host_wait_until(host_sta_connected, NULL, 5000));
+}
+
+static uint32_t sta_ip(void) {
+    esp_netif_ip_info_t ip_info;
+    esp_netif_get_ip_info(esp_netif_get_handle_from_ifkey("WIFI_STA_DEF"), &ip_info);
+    return ip_info.ip.addr;
+}
+
+static int connect_calls(void) {
+    fake_wifi_state_t state;
+    fake_wifi_get_state(&state);
+    return state.connect_calls;
+}
+
+static form_t form = { "HomeNet", "secret123", false, "", false, "" };
+
+static void test_baseline(void) {
+    // The preset saves another authmode than the portal sends, the first POST reassociates
+    post_and_wait(&form, WIFI_APPLY_REASSOC);
+
+    // The same settings again change nothing
+    wifi_apply_stats_t before[WIFI_APPLY_COUNT], after[WIFI_APPLY_COUNT];
+    wifi_get_apply_stats(before);
+    int calls = connect_calls();
+    CHECK_EQ_INT(post(&form, WIFI_AUTHMODE_WPA_PSK), 302);
+    vTaskDelay(pdMS_TO_TICKS(200));
+    wifi_get_apply_stats(after);
+    CHECK(memcmp(before, after, sizeof(before)) == 0);
+    CHECK_EQ_INT(connect_calls(), calls);
+}
+
+static void test_static_ip(void) {
+    // DHCP to static keeps the association
+    int calls = connect_calls();
+    form.use_static_ip = true;
+    form.static_ip = "192.168.1.50";
+    post_and_wait(&form, WIFI_APPLY_DHCP);
+    CHECK_EQ_INT(sta_ip(), inet_addr("192.168.1.50"));
+
+    // Another static address only sets the interface
+    form.static_ip = "192.168.1.51";
+    post_and_wait(&form, WIFI_APPLY_NETIF);
+    CHECK_EQ_INT(sta_ip(), inet_addr("192.168.1.51"));
+    CHECK_EQ_INT(connect_calls(), calls);
+}
+
+static void test_mdns(void) {
+    int calls = connect_calls();
+    form.use_mDNS = true;
+    form.hostname = "device";
+    post_and_wait(&form, WIFI_APPLY_MDNS);
+    form.hostname = "renamed";
+    post_and_wait(&form, WIFI_APPLY_MDNS);
+    CHECK_EQ_INT(connect_calls(), calls);
+}
+
+static void test_reassoc(void) {
+    // New credentials reassociate, the static address comes along
+    int calls = connect_calls();
+    form.ssid = "OtherNet";
+    form.password = "other-pass";
+    post_and_wait(&form, WIFI_APPLY_REASSOC);
+    fake_wifi_state_t state;
+    fake_wifi_get_state(&state);
+    CHECK_EQ_STR(state.sta_ssid, "OtherNet");
+    CHECK_EQ_INT(state.connect_calls, calls + 1);
+    CHECK_EQ_INT(state.mode, WIFI_MODE_STA);
+    CHECK_EQ_INT(sta_ip(), inet_addr("192.168.1.51"));
+
+    wifi_apply_stats_t stats[WIFI_APPLY_COUNT];
+    wifi_get_apply_stats(stats);
+    CHECK_EQ_INT(stats[WIFI_APPLY_MODE_SWITCH].count, 1);    // The boot only
+    CHECK(stats[WIFI_APPLY_REASSOC].max_ms >= stats[WIFI_APPLY_REASSOC].last_ms);
+}
+
+static void test_rejected(void) {
+    // An unsupported authmode is refused before anything is saved or applied
+    wifi_apply_stats_t before[WIFI_APPLY_COUNT], after[WIFI_APPLY_COUNT];
+    wifi_get_apply_stats(before);
+    form_t other = { "ThirdNet", "third-pass", false, "", false, "" };
+    CHECK_EQ_INT(post(&other, WIFI_AUTHMODE_ENTERPRISE), 400);
+    vTaskDelay(pdMS_TO_TICKS(200));
+    wifi_get_apply_stats(after);
+    CHECK(memcmp(before, after, sizeof(before)) == 0);
+
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, "/captive.json", NULL, NULL, 0, &resp), ESP_OK);
+    CHECK(strstr(resp.body, "OtherNet") != NULL);
+    CHECK(strstr(resp.body, "ThirdNet") == NULL);
+    fake_httpd_response_free(&resp);
+}
+
+int main(void) {
+    host_add_network("HomeNet", "secret123");
+    host_add_network("OtherNet", "other-pass");
+    host_preset_sta("HomeNet", "secret123");
+    CHECK_EQ_INT(wifi_init(), ESP_OK);
+    CHECK(host_wait_until(host_sta_connected, NULL, 5000));
+    RUN_TEST(test_baseline);
+    RUN_TEST(test_static_ip);
+    RUN_TEST(test_mdns);
+    RUN_TEST(test_reassoc);
+    RUN_TEST(test_rejected);
+    UNIT_MAIN_END();
+}
@@ -0,0 +1,299 @@
+/**
+ * @file test_clients.c
+ * @brief Captive portal client table: platform classification, first probe, popups, eviction, stations by MAC.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include "wifi_clients.h"
+#include "unit.h"
+
+UNIT_GLOBALS;
+
+/// 192.168.4.n in network byte order
+#define CLIENT_IP(n) ((uint32_t)(n) << 24 | 0x04a8c0)
+
+/// Station MAC address ending in n
+#define STATION_MAC(n) ((const uint8_t[6]){ 0x02, 0, 0, 0, 0, (n) })
+
+/// A probe URI no platform is recognized by, to read a client's platform without changing it
+#define NEUTRAL_URI "/redirect"
+
+static wifi_client_os_t probe(uint32_t ip, const char *uri, const char *user_agent, bool *first) {
+    bool ignored;
+    return wifi_clients_probe(ip, uri, user_agent, first ? first : &ignored);
+}
+
+static void test_dns_classification(void) {
+    wifi_clients_reset();
+    wifi_clients_dns_query(CLIENT_IP(2), "connectivitycheck.gstatic.com");
+    wifi_clients_dns_query(CLIENT_IP(3), "www.msftconnecttest.com");        // Subdomain
+    wifi_clients_dns_query(CLIENT_IP(4), "evilmsftconnecttest.com");        // Not a subdomain
+    wifi_clients_dns_query(CLIENT_IP(5), "CAPTIVE.APPLE.COM");
+    CHECK_EQ_INT(probe(CLIENT_IP(2), NEUTRAL_URI, "", NULL), WIFI_CLIENT_OS_ANDROID);
+    CHECK_EQ_INT(probe(CLIENT_IP(3), NEUTRAL_URI, "", NULL), WIFI_CLIENT_OS_WINDOWS);
+    CHECK_EQ_INT(probe(CLIENT_IP(4), NEUTRAL_URI, "", NULL), WIFI_CLIENT_OS_UNKNOWN);
+    CHECK_EQ_INT(probe(CLIENT_IP(5), NEUTRAL_URI, "", NULL), WIFI_CLIENT_OS_APPLE);
+
+    // Queries without a source address are not tracked
+    wifi_clients_dns_query(0, "captive.apple.com");
+}
+
+static void test_source_priority(void) {
+    wifi_clients_reset();
+    // The probe URL overrides the looked up host, the User-Agent overrides both
+    wifi_clients_dns_query(CLIENT_IP(2), "nmcheck.gnome.org");
+    CHECK_EQ_INT(probe(CLIENT_IP(2), NEUTRAL_URI, "", NULL), WIFI_CLIENT_OS_LINUX);
+    CHECK_EQ_INT(probe(CLIENT_IP(2), "/hotspot-detect.html", "", NULL), WIFI_CLIENT_OS_APPLE);
+    CHECK_EQ_INT(probe(CLIENT_IP(2), "/generate_204", "Dalvik/2.1.0 (Linux; U; Android 14)", NULL),
+                 WIFI_CLIENT_OS_ANDROID);
+    CHECK_EQ_INT(probe(CLIENT_IP(2), "/ncsi.txt", "", NULL), WIFI_CLIENT_OS_ANDROID);
+    wifi_clients_dns_query(CLIENT_IP(2), "captive.apple.com");
+    CHECK_EQ_INT(probe(CLIENT_IP(2), NEUTRAL_URI, "", NULL), WIFI_CLIENT_OS_ANDROID);
+
+    // A later User-Agent still wins over an earlier one
+    CHECK_EQ_INT(probe(CLIENT_IP(2), NEUTRAL_URI, "CaptiveNetworkSupport-481 wispr", NULL), WIFI_CLIENT_OS_APPLE);
+
+    // Android before Linux, Apple before the rest
+    CHECK_EQ_INT(probe(CLIENT_IP(3), NEUTRAL_URI, "Mozilla/5.0 (Linux; Android 14)", NULL), WIFI_CLIENT_OS_ANDROID);
+    CHECK_EQ_INT(probe(CLIENT_IP(4), NEUTRAL_URI, "Mozilla/5.0 (X11; Linux x86_64)", NULL), WIFI_CLIENT_OS_LINUX);
+    CHECK_EQ_INT(probe(CLIENT_IP(5), NEUTRAL_URI, "Microsoft NCSI", NULL), WIFI_CLIENT_OS_WINDOWS);
+    CHECK_EQ_INT(probe(CLIENT_IP(6), "/check_network_status.txt", "", NULL), WIFI_CLIENT_OS_LINUX);
+}
+
+static void test_first_probe(void) {
+    wifi_clients_reset();
+    bool first;
+    probe(CLIENT_IP(2), "/generate_204", "", &first);
+    CHECK(first);
+    probe(CLIENT_IP(2), "/generate_204", "", &first);
+    CHECK(!first);
+    probe(CLIENT_IP(3), "/generate_204", "", &first);
+    CHECK(first);
+
+    // A DNS query alone does not use up the first probe
+    wifi_clients_dns_query(CLIENT_IP(4), "captive.apple.com");
+    probe(CLIENT_IP(4), "/hotspot-detect.html", "", &first);
+    CHECK(first);
+
+    // Every mode switch starts over
+    wifi_clients_reset();
+    probe(CLIENT_IP(2), "/generate_204", "", &first);
+    CHECK(first);
+
+    // Clients without an address are never redirected, but counted by their User-Agent
+    wifi_client_os_stats_t before[WIFI_CLIENT_OS_COUNT], after[WIFI_CLIENT_OS_COUNT];
+    wifi_get_client_os_stats(before);
+    CHECK_EQ_INT(probe(0, "/generate_204", "Microsoft NCSI", &first), WIFI_CLIENT_OS_WINDOWS);
+    CHECK(!first);
+    CHECK_EQ_INT(probe(0, "/generate_204", "", &first), WIFI_CLIENT_OS_ANDROID);
+    CHECK(!first);
+    wifi_get_client_os_stats(after);
+    CHECK_EQ_INT(after[WIFI_CLIENT_OS_WINDOWS].probes, before[WIFI_CLIENT_OS_WINDOWS].probes + 1);
+    CHECK_EQ_INT(after[WIFI_CLIENT_OS_ANDROID].probes, before[WIFI_CLIENT_OS_ANDROID].probes + 1);
+}
+
+static void test_popups(void) {
+    wifi_clients_reset();
+    wifi_client_os_stats_t before[WIFI_CLIENT_OS_COUNT], after[WIFI_CLIENT_OS_COUNT];
+    wifi_get_client_os_stats(before);
+
+    // Three probes, then the portal; opening it again or without probing is not counted
+    for (int i = 0; i < 3; i++) probe(CLIENT_IP(2), "/hotspot-detect.html", "CaptiveNetworkSupport", NULL);
+    wifi_clients_portal_opened(CLIENT_IP(2));
+    wifi_clients_portal_opened(CLIENT_IP(2));
+    wifi_clients_portal_opened(CLIENT_IP(3));
+    wifi_clients_dns_query(CLIENT_IP(4), "connectivitycheck.gstatic.com");
+    wifi_clients_portal_opened(CLIENT_IP(4));
+
+    wifi_get_client_os_stats(after);
+    CHECK_EQ_INT(after[WIFI_CLIENT_OS_APPLE].probes, before[WIFI_CLIENT_OS_APPLE].probes + 3);
+    CHECK_EQ_INT(after[WIFI_CLIENT_OS_APPLE].popups, before[WIFI_CLIENT_OS_APPLE].popups + 1);
+    CHECK_EQ_INT(after[WIFI_CLIENT_OS_APPLE].probes_before_popup, before[WIFI_CLIENT_OS_APPLE].probes_before_popup + 3);
+    CHECK_EQ_INT(after[WIFI_CLIENT_OS_ANDROID].popups, before[WIFI_CLIENT_OS_ANDROID].popups);
+    CHECK_EQ_INT(after[WIFI_CLIENT_OS_UNKNOWN].popups, before[WIFI_CLIENT_OS_UNKNOWN].popups);
+}
+
+static void test_eviction(void) {
+    wifi_clients_reset();
+    // Fill the table, oldest first; the ticks are milliseconds
+    for (int i = 0; i < WIFI_CLIENTS_MAX; i++) {
+        probe(CLIENT_IP(10 + i), "/generate_204", "", NULL);
+        usleep(2000);
+    }
+    // The oldest one is seen again, so the second oldest makes room for a new client
+    probe(CLIENT_IP(10), "/generate_204", "", NULL);
+    usleep(2000);
+    bool first;
+    probe(CLIENT_IP(100), "/generate_204", "", &first);
+    CHECK(first);
+    probe(CLIENT_IP(10), "/generate_204", "", &first);
+    CHECK(!first);
+    probe(CLIENT_IP(12), "/generate_204", "", &first);
+    CHECK(!first);
+    probe(CLIENT_IP(11), "/generate_204", "", &first);
+    CHECK(first);
+}
+
+/// Entry of a station or client in the table, NULL if not tracked
+static const wifi_station_info_t *find_station(const wifi_station_info_t *stations, size_t count, const uint8_t *mac,
+                                               uint32_t ip) {
+    for (size_t i = 0; i < count; i++) {
+        if (mac ? !memcmp(stations[i].mac, mac, 6) : stations[i].ip == ip) return &stations[i];
+    }
+    return NULL;
+}
+
+static void test_station_merge(void) {
+    wifi_clients_reset();
+    // The station talks before its lease is reported: DNS, HTTP and a probe by address only
+    wifi_clients_station_connected(STATION_MAC(1));
+    wifi_clients_dns_query(CLIENT_IP(20), "captive.apple.com");
+    wifi_clients_dns_query(CLIENT_IP(20), "example.com");
+    wifi_clients_traffic(CLIENT_IP(20), 100, 200, true);
+    bool first;
+    probe(CLIENT_IP(20), "/hotspot-detect.html", "", &first);
+    CHECK(first);
+
+    wifi_station_info_t stations[WIFI_STATIONS_MAX];
+    CHECK_EQ_INT(wifi_get_stations(stations, WIFI_STATIONS_MAX), 2);
+
+    // The lease merges the address-only entry into the station
+    wifi_clients_station_ip(STATION_MAC(1), CLIENT_IP(20));
+    CHECK_EQ_INT(wifi_get_stations(stations, WIFI_STATIONS_MAX), 1);
+    const wifi_station_info_t *station = &stations[0];
+    CHECK(!memcmp(station->mac, STATION_MAC(1), 6));
+    CHECK_EQ_INT(station->ip, CLIENT_IP(20));
+    CHECK(station->connected);
+    CHECK_EQ_INT(station->os, WIFI_CLIENT_OS_APPLE);
+    CHECK_EQ_INT(station->dns_queries, 2);
+    CHECK_EQ_INT(station->http_requests, 1);
+    CHECK_EQ_INT(station->bytes_in, 100);
+    CHECK_EQ_INT(station->bytes_out, 200);
+    CHECK_EQ_INT(station->probes, 1);
+    CHECK(station->redirected);
+
+    // Already redirected before the merge, so not again
+    probe(CLIENT_IP(20), "/hotspot-detect.html", "", &first);
+    CHECK(!first);
+    CHECK_EQ_INT(wifi_get_stations(stations, WIFI_STATIONS_MAX), 1);
+}
+
+static void test_station_reassociation(void) {
+    wifi_clients_reset();
+    wifi_clients_station_connected(STATION_MAC(1));
+    wifi_clients_station_ip(STATION_MAC(1), CLIENT_IP(20));
+    wifi_clients_dns_query(CLIENT_IP(20), "connectivitycheck.gstatic.com");
+    bool first;
+    probe(CLIENT_IP(20), "/generate_204", "", &first);
+    CHECK(first);
+
+    // Leaving keeps the entry and its counters
+    wifi_clients_station_disconnected(STATION_MAC(1));
+    wifi_station_info_t stations[WIFI_STATIONS_MAX];
+    CHECK_EQ_INT(wifi_get_stations(stations, WIFI_STATIONS_MAX), 1);
+    CHECK(!stations[0].connected);
+    CHECK_EQ_INT(stations[0].dns_queries, 1);
+
+    // Coming back is a new portal session with the same counters
+    wifi_clients_station_connected(STATION_MAC(1));
+    probe(CLIENT_IP(20), "/generate_204", "", &first);
+    CHECK(first);
+    CHECK_EQ_INT(wifi_get_stations(stations, WIFI_STATIONS_MAX), 1);
+    CHECK(stations[0].connected);
+    CHECK_EQ_INT(stations[0].probes, 1);
+    CHECK_EQ_INT(stations[0].dns_queries, 1);
+    CHECK_EQ_INT(stations[0].os, WIFI_CLIENT_OS_ANDROID);
+}
+
+static void test_station_address_reuse(void) {
+    wifi_clients_reset();
+    wifi_clients_station_connected(STATION_MAC(1));
+    wifi_clients_station_ip(STATION_MAC(1), CLIENT_IP(20));
+    wifi_clients_station_disconnected(STATION_MAC(1));
+
+    // The lease goes to another station, the one that left keeps its entry without the address
+    wifi_clients_station_connected(STATION_MAC(2));
+    wifi_clients_station_ip(STATION_MAC(2), CLIENT_IP(20));
+    wifi_clients_dns_query(CLIENT_IP(20), "captive.apple.com");
+    wifi_station_info_t stations[WIFI_STATIONS_MAX];
+    size_t count = wifi_get_stations(stations, WIFI_STATIONS_MAX);
+    CHECK_EQ_INT(count, 2);
+    const wifi_station_info_t *old = find_station(stations, count, STATION_MAC(1), 0);
+    const wifi_station_info_t *new = find_station(stations, count, STATION_MAC(2), 0);
+    CHECK(old != NULL && new != NULL);
+    if (old == NULL || new == NULL) return;
+    CHECK_EQ_INT(old->ip, 0);
+    CHECK_EQ_INT(old->dns_queries, 0);
+    CHECK_EQ_INT(new->ip, CLIENT_IP(20));
+    CHECK_EQ_INT(new->dns_queries, 1);
+}
+
+static void test_station_traffic(void) {
+    wifi_clients_reset();
+    // Only bytes that start a response count as a request; clients without an address are not tracked
+    wifi_clients_traffic(CLIENT_IP(30), 10, 20, true);
+    wifi_clients_traffic(CLIENT_IP(31), 1, 2, true);
+    wifi_clients_traffic(CLIENT_IP(31), 1, 2, false);
+    wifi_clients_traffic(0, 1000, 1000, true);
+    wifi_station_info_t stations[WIFI_STATIONS_MAX];
+    size_t count = wifi_get_stations(stations, WIFI_STATIONS_MAX);
+    CHECK_EQ_INT(count, 2);
+    const wifi_station_info_t *first = find_station(stations, count, NULL, CLIENT_IP(30));
+    const wifi_station_info_t *second = find_station(stations, count, NULL, CLIENT_IP(31));
+    CHECK(first != NULL && second != NULL);
+    if (first == NULL || second == NULL) return;
+    CHECK_EQ_INT(first->http_requests, 1);
+    CHECK_EQ_INT(first->bytes_out, 20);
+    CHECK_EQ_INT(second->http_requests, 1);
+    CHECK_EQ_INT(second->bytes_in, 2);
+    CHECK_EQ_INT(second->bytes_out, 4);
+}
+
+static void test_station_eviction(void) {
+    wifi_clients_reset();
+    // A full table of associated stations; one that left goes first, even when it was seen last
+    for (int i = 0; i < WIFI_STATIONS_MAX; i++) {
+        wifi_clients_station_connected(STATION_MAC(i + 1));
+        usleep(2000);
+    }
+    wifi_clients_station_disconnected(STATION_MAC(5));
+    wifi_clients_station_connected(STATION_MAC(100));
+    wifi_station_info_t stations[WIFI_STATIONS_MAX];
+    size_t count = wifi_get_stations(stations, WIFI_STATIONS_MAX);
+    CHECK_EQ_INT(count, WIFI_STATIONS_MAX);
+    CHECK(find_station(stations, count, STATION_MAC(5), 0) == NULL);
+    CHECK(find_station(stations, count, STATION_MAC(1), 0) != NULL);
+    CHECK(find_station(stations, count, STATION_MAC(100), 0) != NULL);
+
+    // Otherwise the least recently seen
+    wifi_clients_station_connected(STATION_MAC(101));
+    count = wifi_get_stations(stations, WIFI_STATIONS_MAX);
+    CHECK(find_station(stations, count, STATION_MAC(1), 0) == NULL);
+    CHECK(find_station(stations, count, STATION_MAC(2), 0) != NULL);
+
+    // A shorter array gets the first entries only
+    CHECK_EQ_INT(wifi_get_stations(stations, 3), 3);
+}
+
+static void test_os_names(void) {
+    CHECK_EQ_STR(wifi_client_os_name(WIFI_CLIENT_OS_UNKNOWN), "unknown");
+    CHECK_EQ_STR(wifi_client_os_name(WIFI_CLIENT_OS_APPLE), "Apple");
+    CHECK_EQ_STR(wifi_client_os_name(WIFI_CLIENT_OS_COUNT), "invalid");
+}
+
+int main(void) {
+    RUN_TEST(test_dns_classification);
+    RUN_TEST(test_source_priority);
+    RUN_TEST(test_first_probe);
+    RUN_TEST(test_popups);
+    RUN_TEST(test_eviction);
+    RUN_TEST(test_station_merge);
+    RUN_TEST(test_station_reassociation);
+    RUN_TEST(test_station_address_reuse);
+    RUN_TEST(test_station_traffic);
+    RUN_TEST(test_station_eviction);
+    RUN_TEST(test_os_names);
+    UNIT_MAIN_END();
+}
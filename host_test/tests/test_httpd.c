@@ -0,0 +1,292 @@
+/**
+ * @file test_httpd.c
+ * @brief The POSIX-socket HTTP server fake, driven over real loopback connections.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "esp_http_server.h"
+#include "fake_host.h"
+#include "unit.h"
+
+UNIT_GLOBALS;
+
+static httpd_handle_t server;
+
+#pragma region Handlers
+
+static esp_err_t hello_handler(httpd_req_t *req) {
+    char query[64], name[16] = "world", body[64];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        httpd_query_key_value(query, "name", name, sizeof(name));
+    }
+    snprintf(body, sizeof(body), "hello %s", name);
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "X-Test", "1");
+    return httpd_resp_sendstr(req, body);
+}
+
+static esp_err_t chunk_handler(httpd_req_t *req) {
+    httpd_resp_sendstr_chunk(req, "one,");
+    httpd_resp_sendstr_chunk(req, "two,");
+    httpd_resp_sendstr_chunk(req, "three");
+    return httpd_resp_sendstr_chunk(req, NULL);
+}
+
+static esp_err_t echo_handler(httpd_req_t *req) {
+    char buf[256];
+    size_t total = 0;
+    while (total < req->content_len && total < sizeof(buf)) {
+        int ret = httpd_req_recv(req, buf + total, sizeof(buf) - total);
+        if (ret <= 0) return ESP_FAIL;
+        total += (size_t)ret;
+    }
+    return httpd_resp_send(req, buf, (ssize_t)total);
+}
+
+static esp_err_t ws_handler(httpd_req_t *req) {
+    if (req->method == HTTP_GET) return ESP_OK;
+    uint8_t payload[128];
+    httpd_ws_frame_t frame = { .payload = payload };
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, sizeof(payload));
+    if (err != ESP_OK) return err;
+    return httpd_ws_send_frame(req, &frame);
+}
+
+static void start_server(void) {
+    static const httpd_uri_t handlers[] = {
+        { .uri = "/hello", .method = HTTP_GET, .handler = hello_handler },
+        { .uri = "/chunk", .method = HTTP_GET, .handler = chunk_handler },
+        { .uri = "/echo/*", .method = HTTP_POST, .handler = echo_handler },
+        { .uri = "/ws", .method = HTTP_GET, .handler = ws_handler, .is_websocket = true },
+    };
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.uri_match_fn = httpd_uri_match_wildcard;
+    fake_httpd_set_port(0);
+    CHECK_EQ_INT(httpd_start(&server, &config), ESP_OK);
+    for (size_t i = 0; i < sizeof(handlers) / sizeof(handlers[0]); i++) {
+        CHECK_EQ_INT(httpd_register_uri_handler(server, &handlers[i]), ESP_OK);
+    }
+}
+
+#pragma endregion
+
+#pragma region Client
+
+static int client_connect(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(fake_httpd_bound_port()),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    struct timeval timeout = { .tv_sec = 5 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void client_send(int fd, const void *buf, size_t len) {
+    CHECK_EQ_INT(send(fd, buf, len, MSG_NOSIGNAL), len);
+}
+
+static bool recv_exact(int fd, void *buf, size_t len) {
+    for (size_t got = 0; got < len;) {
+        ssize_t ret = recv(fd, (char *)buf + got, len - got, 0);
+        if (ret <= 0) return false;
+        got += (size_t)ret;
+    }
+    return true;
+}
+
+/**
+ * @brief Read one response: status code, headers and the body decoded from Content-Length or chunks.
+ *
+ * @return status code, -1 when the connection closed or stalled first
+ */
+static int client_response(int fd, char *headers, size_t headers_size, char *body, size_t body_size) {
+    size_t len = 0;
+    while (len < 4 || memcmp(headers + len - 4, "\r\n\r\n", 4) != 0) {
+        if (len + 1 >= headers_size || recv(fd, headers + len, 1, 0) != 1) return -1;
+        len++;
+    }
+    headers[len] = '\0';
+    body[0] = '\0';
+    const char *length = strstr(headers, "Content-Length: ");
+    if (length) {
+        size_t body_len = strtoul(length + 16, NULL, 10);
+        if (body_len >= body_size || !recv_exact(fd, body, body_len)) return -1;
+        body[body_len] = '\0';
+    } else if (strstr(headers, "Transfer-Encoding: chunked")) {
+        size_t body_len = 0;
+        for (;;) {
+            char line[16];
+            size_t n = 0;
+            while (n < 2 || memcmp(line + n - 2, "\r\n", 2) != 0) {
+                if (n + 1 >= sizeof(line) || recv(fd, line + n, 1, 0) != 1) return -1;
+                n++;
+            }
+            size_t chunk = strtoul(line, NULL, 16);
+            char crlf[2];
+            if (body_len + chunk >= body_size || !recv_exact(fd, body + body_len, chunk) || !recv_exact(fd, crlf, 2)) {
+                return -1;
+            }
+            body_len += chunk;
+            if (chunk == 0) break;
+        }
+        body[body_len] = '\0';
+    }
+    return atoi(headers + 9);
+}
+
+static int client_request(int fd, const char *request, char *body, size_t body_size) {
+    char headers[1024];
+    client_send(fd, request, strlen(request));
+    return client_response(fd, headers, sizeof(headers), body, body_size);
+}
+
+#pragma endregion
+
+static void test_keep_alive_and_query(void) {
+    int fd = client_connect();
+    CHECK(fd >= 0);
+    char headers[1024], body[256];
+    client_send(fd, "GET /hello HTTP/1.1\r\nHost: x\r\n\r\n", 32);
+    CHECK_EQ_INT(client_response(fd, headers, sizeof(headers), body, sizeof(body)), 200);
+    CHECK_EQ_STR(body, "hello world");
+    CHECK(strstr(headers, "Content-Type: text/plain\r\n") != NULL);
+    CHECK(strstr(headers, "X-Test: 1\r\n") != NULL);
+
+    // Second request on the same connection, with a query string
+    CHECK_EQ_INT(client_request(fd, "GET /hello?name=host&x=1 HTTP/1.1\r\nHost: x\r\n\r\n", body, sizeof(body)), 200);
+    CHECK_EQ_STR(body, "hello host");
+    close(fd);
+}
+
+static void test_pipelined_split_request(void) {
+    // Two requests in one segment, then one header split across sends
+    int fd = client_connect();
+    char body[256];
+    const char *two = "GET /hello?name=a HTTP/1.1\r\n\r\nGET /hello?name=b HTTP/1.1\r\n\r\n";
+    client_send(fd, two, strlen(two));
+    char headers[1024];
+    CHECK_EQ_INT(client_response(fd, headers, sizeof(headers), body, sizeof(body)), 200);
+    CHECK_EQ_STR(body, "hello a");
+    CHECK_EQ_INT(client_response(fd, headers, sizeof(headers), body, sizeof(body)), 200);
+    CHECK_EQ_STR(body, "hello b");
+
+    client_send(fd, "GET /hel", 8);
+    usleep(20000);
+    CHECK_EQ_INT(client_request(fd, "lo HTTP/1.1\r\n\r\n", body, sizeof(body)), 200);
+    CHECK_EQ_STR(body, "hello world");
+    close(fd);
+}
+
+static void test_errors(void) {
+    int fd = client_connect();
+    char body[256];
+    CHECK_EQ_INT(client_request(fd, "GET /missing HTTP/1.1\r\n\r\n", body, sizeof(body)), 404);
+    close(fd);
+
+    fd = client_connect();
+    CHECK_EQ_INT(client_request(fd, "POST /hello HTTP/1.1\r\nContent-Length: 0\r\n\r\n", body, sizeof(body)), 405);
+    close(fd);
+
+    fd = client_connect();
+    CHECK_EQ_INT(client_request(fd, "GET /hello HTTP/2.0\r\n\r\n", body, sizeof(body)), 505);
+    close(fd);
+
+    char big[HTTPD_MAX_REQ_HDR_LEN + 64];
+    int n = snprintf(big, sizeof(big), "GET /hello HTTP/1.1\r\nX-Big: ");
+    memset(big + n, 'a', sizeof(big) - (size_t)n - 5);
+    memcpy(big + sizeof(big) - 5, "\r\n\r\n", 5);
+    fd = client_connect();
+    CHECK_EQ_INT(client_request(fd, big, body, sizeof(body)), 431);
+    close(fd);
+}
+
+static void test_chunked_and_body(void) {
+    int fd = client_connect();
+    char body[256];
+    CHECK_EQ_INT(client_request(fd, "GET /chunk HTTP/1.1\r\n\r\n", body, sizeof(body)), 200);
+    CHECK_EQ_STR(body, "one,two,three");
+
+    // Wildcard route, body read in parts
+    const char *post = "POST /echo/any/path HTTP/1.1\r\nContent-Length: 11\r\n\r\n";
+    client_send(fd, post, strlen(post));
+    client_send(fd, "hello", 5);
+    usleep(20000);
+    CHECK_EQ_INT(client_request(fd, " there", body, sizeof(body)), 200);
+    CHECK_EQ_STR(body, "hello there");
+    close(fd);
+}
+
+static void test_websocket_echo(void) {
+    int fd = client_connect();
+    char headers[1024], body[16];
+    const char *upgrade = "GET /ws HTTP/1.1\r\nHost: x\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                          "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+    client_send(fd, upgrade, strlen(upgrade));
+    CHECK_EQ_INT(client_response(fd, headers, sizeof(headers), body, sizeof(body)), 101);
+    // Example key and accept value of RFC 6455
+    CHECK(strstr(headers, "Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != NULL);
+
+    // Masked text frame from the client, unmasked echo from the server
+    const uint8_t mask[4] = { 0x11, 0x22, 0x33, 0x44 };
+    const char *text = "ping";
+    uint8_t frame[10] = { 0x81, 0x80 | 4 };
+    memcpy(frame + 2, mask, 4);
+    for (int i = 0; i < 4; i++) frame[6 + i] = (uint8_t)text[i] ^ mask[i];
+    client_send(fd, frame, sizeof(frame));
+    uint8_t reply[6];
+    CHECK(recv_exact(fd, reply, sizeof(reply)));
+    CHECK_EQ_INT(reply[0], 0x81);
+    CHECK_EQ_INT(reply[1], 4);
+    CHECK(memcmp(reply + 2, "ping", 4) == 0);
+
+    // Close frame is answered by the server itself
+    const uint8_t close_frame[6] = { 0x88, 0x80, 0, 0, 0, 0 };
+    client_send(fd, close_frame, sizeof(close_frame));
+    uint8_t close_reply[2];
+    CHECK(recv_exact(fd, close_reply, sizeof(close_reply)));
+    CHECK_EQ_INT(close_reply[0], 0x88);
+    close(fd);
+}
+
+static void test_invoke(void) {
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(fake_httpd_invoke(server, HTTP_GET, "/hello?name=inv", NULL, NULL, 0, &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 200);
+    CHECK_EQ_STR(resp.content_type, "text/plain");
+    CHECK_EQ_STR(resp.body, "hello inv");
+    fake_httpd_response_free(&resp);
+
+    CHECK_EQ_INT(fake_httpd_invoke(server, HTTP_POST, "/echo/x", NULL, "abc", 3, &resp), ESP_OK);
+    CHECK_EQ_STR(resp.body, "abc");
+    fake_httpd_response_free(&resp);
+
+    CHECK_EQ_INT(fake_httpd_invoke(server, HTTP_GET, "/nope", NULL, NULL, 0, &resp), ESP_ERR_NOT_FOUND);
+    fake_httpd_response_free(&resp);
+}
+
+int main(void) {
+    start_server();
+    RUN_TEST(test_keep_alive_and_query);
+    RUN_TEST(test_pipelined_split_request);
+    RUN_TEST(test_errors);
+    RUN_TEST(test_chunked_and_body);
+    RUN_TEST(test_websocket_echo);
+    RUN_TEST(test_invoke);
+    CHECK_EQ_INT(httpd_stop(server), ESP_OK);
+    CHECK_EQ_INT(fake_httpd_bound_port(), 0);
+    UNIT_MAIN_END();
+}
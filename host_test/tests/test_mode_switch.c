@@ -0,0 +1,137 @@
+/**
+ * @file test_mode_switch.c
+ * @brief Repeated STA/AP mode switches through the settings form: free heap and minimum free heap trend,
+ *        WebSocket value sync flushes while the server stops.
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Wifi.h"
+#include "esp_system.h"
+#include "wifi_ws_sync.h"
+#include "fake_host.h"
+#include "host_support.h"
+#include "unit.h"
+
+UNIT_GLOBALS;
+
+/// STA -> AP -> STA round trips. The free heap drifts down for the first ten
+/// or so while malloc's free lists and the client tables fill, then stays put.
+#define CYCLES 24
+#define WARMUP_CYCLES 12
+
+/// Heap a round trip may lose for good: nothing, apart from malloc bookkeeping
+#define MAX_LEAK_PER_CYCLE 64
+
+/// Round trips after the warm-up that may lower the minimum free heap: a
+/// request that overlaps a switch peaks now and then, a leak lowers it every time
+#define MAX_MIN_FREE_DROPS ((CYCLES - WARMUP_CYCLES - 1) / 2)
+
+/// Round trips with the value sync timer firing throughout
+#define WS_SYNC_CYCLES 8
+
+#define AP_FORM "wifi_mode=2&ap_ssid=Device&ap_password=device-pass"
+#define STA_FORM "wifi_mode=1&ssid=HomeNet&authmode=1&password=secret123"
+
+static esp_err_t post_form(const char *form) {
+    fake_httpd_response_t resp;
+    esp_err_t err = fake_httpd_invoke(wifi_get_http_server(), HTTP_POST, "/captive",
+                                      "Content-Type: application/x-www-form-urlencoded\r\n", form, strlen(form), &resp);
+    if (err == ESP_OK && resp.status != 302) err = ESP_FAIL;
+    fake_httpd_response_free(&resp);
+    return err;
+}
+
+/// Mode a switch ends in and the driver starts before it
+typedef struct {
+    wifi_mode_t mode;
+    int start_calls;
+} switch_wait_t;
+
+/// A switch is over once the driver runs in the new mode, STA has an address
+/// and the new server has its handlers. The STA interface can reconnect during
+/// a switch to AP, and the server handle is set before the handlers are
+/// registered, so neither alone means the switch is over.
+static bool switched(void *ctx) {
+    const switch_wait_t *wait = ctx;
+    fake_wifi_state_t state;
+    fake_wifi_get_state(&state);
+    if (state.start_calls <= wait->start_calls || state.mode != wait->mode || !state.started) return false;
+    if (wait->mode == WIFI_MODE_STA && !state.sta_connected) return false;
+    httpd_handle_t server = wifi_get_http_server();
+    if (server == NULL) return false;
+    fake_httpd_response_t resp;
+    bool up = fake_httpd_invoke(server, HTTP_GET, "/captive.json", NULL, NULL, 0, &resp) == ESP_OK &&
+              resp.status == 200;
+    fake_httpd_response_free(&resp);
+    return up;
+}
+
+/// Post the settings form and wait until the mode switch it starts is done
+static bool switch_mode(const char *form, wifi_mode_t mode) {
+    fake_wifi_state_t state;
+    fake_wifi_get_state(&state);
+    switch_wait_t wait = { .mode = mode, .start_calls = state.start_calls };
+    return post_form(form) == ESP_OK && host_wait_until(switched, &wait, 5000);
+}
+
+static void test_heap_trend(void) {
+    uint32_t free_heap[CYCLES], min_free[CYCLES];
+    switch_wait_t boot = { .mode = WIFI_MODE_STA };     // wifi_init() switches to STA itself
+    CHECK(host_wait_until(switched, &boot, 5000));
+    for (int i = 0; i < CYCLES; i++) {
+        CHECK(switch_mode(AP_FORM, WIFI_MODE_APSTA) && host_ap_started(NULL));
+        CHECK(switch_mode(STA_FORM, WIFI_MODE_STA) && host_sta_connected(NULL));
+        usleep(100 * 1000);   // Let the listener finish the switch
+        free_heap[i] = esp_get_free_heap_size();
+        min_free[i] = esp_get_minimum_free_heap_size();
+        printf("cycle %2d: free %" PRIu32 ", min free %" PRIu32 "\n", i + 1, free_heap[i], min_free[i]);
+    }
+    // After the warm-up, neither the free heap nor its low-water mark keeps falling
+    int64_t lost = (int64_t)free_heap[WARMUP_CYCLES] - free_heap[CYCLES - 1];
+    int64_t min_lost = (int64_t)min_free[WARMUP_CYCLES] - min_free[CYCLES - 1];
+    int min_drops = 0;
+    for (int i = WARMUP_CYCLES + 1; i < CYCLES; i++) {
+        if ((int64_t)min_free[i - 1] - min_free[i] > MAX_LEAK_PER_CYCLE) min_drops++;
+    }
+    printf("after %d cycles: free %+" PRId64 " B, min free %+" PRId64 " B in %d drops\n", CYCLES - WARMUP_CYCLES - 1,
+           -lost, -min_lost, min_drops);
+    CHECK(lost <= MAX_LEAK_PER_CYCLE * (CYCLES - WARMUP_CYCLES - 1));
+    CHECK(min_drops <= MAX_MIN_FREE_DROPS);
+}
+
+static atomic_bool ws_sync_stop;
+
+static void *ws_sync_setter(void *arg) {
+    for (int32_t i = 0; !atomic_load(&ws_sync_stop); i++) {
+        wifi_ws_sync_set_int(1, i);
+        usleep(100);
+    }
+    return NULL;
+}
+
+static void test_ws_sync_during_switches(void) {
+    // The sync timer queues its flush on the server task while stop_servers() stops it
+    pthread_t setter;
+    atomic_store(&ws_sync_stop, false);
+    CHECK(pthread_create(&setter, NULL, ws_sync_setter, NULL) == 0);
+    for (int i = 0; i < WS_SYNC_CYCLES; i++) {
+        CHECK(switch_mode(AP_FORM, WIFI_MODE_APSTA) && host_ap_started(NULL));
+        CHECK(switch_mode(STA_FORM, WIFI_MODE_STA) && host_sta_connected(NULL));
+    }
+    atomic_store(&ws_sync_stop, true);
+    pthread_join(setter, NULL);
+}
+
+int main(void) {
+    host_add_network("HomeNet", "secret123");
+    host_preset_sta("HomeNet", "secret123");
+    CHECK_EQ_INT(wifi_init(), ESP_OK);
+    RUN_TEST(test_heap_trend);
+    RUN_TEST(test_ws_sync_during_switches);
+    UNIT_MAIN_END();
+}
@@ -0,0 +1,192 @@
+/**
+ * @file test_netstats.c
+ * @brief Network statistics: /netstats.json, LRU purges of idle sessions, snapshots on DNS send failures.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "Wifi.h"
+#include "fake_host.h"
+#include "host_support.h"
+#include "unit.h"
+#include "wifi_netstats.h"
+
+UNIT_GLOBALS;
+
+#pragma region Client
+
+/// Connect from 127.0.0.<host>, so each client is its own address for the per-client socket limit
+static int client_connect(int host) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in local = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK + host - 1),
+    };
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(fake_httpd_bound_port()),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    struct timeval timeout = { .tv_sec = 5 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) != 0 ||
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Send a GET and read the response headers, skipping the Content-Length body.
+ *
+ * @return status code, 0 when the server closed the connection first
+ */
+static int client_get(int fd, const char *uri) {
+    char request[128];
+    int len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: test\r\n\r\n", uri);
+    if (send(fd, request, len, MSG_NOSIGNAL) != len) return 0;
+    char headers[1024];
+    size_t got = 0;
+    while (got < 4 || memcmp(headers + got - 4, "\r\n\r\n", 4) != 0) {
+        if (got + 1 >= sizeof(headers) || recv(fd, headers + got, 1, 0) != 1) return 0;
+        got++;
+    }
+    headers[got] = '\0';
+    const char *length = strstr(headers, "Content-Length: ");
+    char body[256];
+    for (size_t left = length ? strtoul(length + 16, NULL, 10) : 0; left > 0;) {
+        ssize_t ret = recv(fd, body, left < sizeof(body) ? left : sizeof(body), 0);
+        if (ret <= 0) return 0;
+        left -= (size_t)ret;
+    }
+    return atoi(headers + 9);
+}
+
+/// Whether the server closed the connection, waiting at most the socket timeout
+static bool client_closed(int fd) {
+    char c;
+    return recv(fd, &c, 1, 0) <= 0;
+}
+
+#pragma endregion
+
+/// Fetch /netstats.json; the caller frees the response
+static void get_netstats(fake_httpd_response_t *resp) {
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, "/netstats.json", NULL, NULL, 0, resp), ESP_OK);
+    CHECK_EQ_INT(resp->status, 200);
+    CHECK_EQ_STR(resp->content_type, "application/json");
+}
+
+static void test_json(void) {
+    fake_httpd_response_t resp;
+    get_netstats(&resp);
+    char sockets[64];
+    snprintf(sockets, sizeof(sockets), "\"max\": %d}", CONFIG_LWIP_MAX_SOCKETS);
+    CHECK(strncmp(resp.body, "{\"now\": {\"time_ms\": ", 20) == 0);
+    CHECK(strstr(resp.body, sockets) != NULL);
+    CHECK(strstr(resp.body, "\"lwip_stats\": true") != NULL);
+    CHECK(strstr(resp.body, "\"pools\": [{\"name\": ") != NULL);
+    CHECK(strstr(resp.body, "\"snapshots\": 0, \"snapshot\": null}") != NULL);
+    fake_httpd_response_free(&resp);
+}
+
+static void test_purged(void) {
+    const httpd_config_t config = HTTPD_DEFAULT_CONFIG();     // The component keeps the default
+    const int max_open = config.max_open_sockets;
+    wifi_session_stats_t before, after;
+    wifi_get_session_stats(&before);
+
+    // Idle keep-alive sessions from as many clients as the server holds
+    int fds[max_open + 1];
+    for (int i = 0; i < max_open; i++) {
+        fds[i] = client_connect(2 + i);
+        CHECK(fds[i] >= 0);
+        CHECK_EQ_INT(client_get(fds[i], "/wifi-status.json"), 200);
+    }
+    wifi_get_session_stats(&after);
+    CHECK_EQ_INT(after.open, max_open);
+    CHECK_EQ_INT(after.purged, before.purged);
+
+    // One more: the least recently used session makes room and counts as purged
+    fds[max_open] = client_connect(2 + max_open);
+    CHECK(fds[max_open] >= 0);
+    CHECK_EQ_INT(client_get(fds[max_open], "/wifi-status.json"), 200);
+    CHECK(client_closed(fds[0]));
+    wifi_get_session_stats(&after);
+    CHECK_EQ_INT(after.purged, before.purged + 1);
+    CHECK_EQ_INT(after.rejected, before.rejected);
+
+    // Sessions the clients close are not purges
+    for (int i = 0; i <= max_open; i++) close(fds[i]);
+    usleep(300 * 1000);
+    wifi_get_session_stats(&after);
+    CHECK_EQ_INT(after.purged, before.purged + 1);
+    CHECK_EQ_INT(after.open, 0);
+
+    fake_httpd_response_t resp;
+    get_netstats(&resp);
+    char purged[32];
+    snprintf(purged, sizeof(purged), "\"purged\": %lu", (unsigned long)after.purged);
+    CHECK(strstr(resp.body, purged) != NULL);
+    fake_httpd_response_free(&resp);
+}
+
+static void test_snapshot(void) {
+    wifi_net_stats_t stats;
+    uint32_t count;
+    CHECK(!wifi_get_net_snapshot(&stats, &count));
+    CHECK_EQ_INT(count, 0);
+
+    wifi_netstats_dns_send_error(ENOBUFS);
+    CHECK(wifi_get_net_snapshot(&stats, &count));
+    CHECK_EQ_INT(count, 1);
+    CHECK_EQ_STR(stats.reason, "dns ENOBUFS");
+    CHECK_EQ_INT(stats.sockets_max, CONFIG_LWIP_MAX_SOCKETS);
+    CHECK(stats.lwip_stats);
+    CHECK(stats.free_heap > 0);
+
+    // At most one a second: a burst of failures keeps the first snapshot
+    wifi_netstats_dns_send_error(ENOMEM);
+    CHECK(wifi_get_net_snapshot(&stats, &count));
+    CHECK_EQ_INT(count, 1);
+    CHECK_EQ_STR(stats.reason, "dns ENOBUFS");
+
+    vTaskDelay(pdMS_TO_TICKS(1100));
+    wifi_netstats_dns_send_error(ENOMEM);
+    CHECK(wifi_get_net_snapshot(&stats, &count));
+    CHECK_EQ_INT(count, 2);
+    CHECK_EQ_STR(stats.reason, "dns ENOMEM");
+
+    fake_httpd_response_t resp;
+    get_netstats(&resp);
+    CHECK(strstr(resp.body, "\"snapshots\": 2, \"snapshot\": {\"time_ms\": ") != NULL);
+    CHECK(strstr(resp.body, "\"reason\": \"dns ENOMEM\"") != NULL);
+    fake_httpd_response_free(&resp);
+}
+
+static bool server_up(void *ctx) {
+    return fake_httpd_bound_port() != 0;
+}
+
+int main(void) {
+    host_add_assets();
+    host_add_network("HomeNet", "secret123");
+    host_preset_sta("HomeNet", "secret123");
+    fake_httpd_set_port(0);
+    CHECK_EQ_INT(wifi_init(), ESP_OK);
+    CHECK(host_wait_until(host_sta_connected, NULL, 5000));
+    CHECK(host_wait_until(server_up, NULL, 5000));
+    RUN_TEST(test_json);
+    RUN_TEST(test_purged);
+    RUN_TEST(test_snapshot);
+    UNIT_MAIN_END();
+}
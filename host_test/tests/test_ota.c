@@ -0,0 +1,257 @@
+/**
+ * @file test_ota.c
+ * @brief Firmware update over loopback connections: token, image check, pipelined write, one update at a time,
+ *        mode switch during an update, restart.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "Wifi.h"
+#include "esp_app_format.h"
+#include "fake_host.h"
+#include "host_support.h"
+#include "unit.h"
+
+UNIT_GLOBALS;
+
+#define AUTH "Authorization: Bearer " CONFIG_WIFI_OTA_TOKEN "\r\n"
+
+#define AP_FORM "wifi_mode=2&ap_ssid=Device&ap_password=device-pass"
+#define STA_FORM "wifi_mode=1&ssid=HomeNet&authmode=1&password=secret123"
+
+/// Larger than both receive buffers together, so the flash writer and the receiver overlap
+#define IMAGE_SIZE (2 * CONFIG_WIFI_OTA_BUFFER_SIZE + 1000)
+
+static uint8_t image[IMAGE_SIZE];
+
+/// An application image for this chip: image header, segment header, app description, filler
+static void build_image(void) {
+    esp_image_header_t header = { .magic = ESP_IMAGE_HEADER_MAGIC, .segment_count = 1,
+                                  .chip_id = CONFIG_IDF_FIRMWARE_CHIP_ID };
+    esp_image_segment_header_t segment = { .data_len = IMAGE_SIZE - sizeof(header) - sizeof(segment) };
+    esp_app_desc_t desc = { .magic_word = ESP_APP_DESC_MAGIC_WORD, .version = "2.0", .project_name = "host" };
+    for (size_t i = 0; i < sizeof(image); i++) image[i] = (uint8_t)(i * 7);
+    memcpy(image, &header, sizeof(header));
+    memcpy(image + sizeof(header), &segment, sizeof(segment));
+    memcpy(image + sizeof(header) + sizeof(segment), &desc, sizeof(desc));
+}
+
+#pragma region Client
+
+static int client_connect(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(fake_httpd_bound_port()),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    struct timeval timeout = { .tv_sec = 5 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void client_send(int fd, const void *buf, size_t len) {
+    CHECK_EQ_INT(send(fd, buf, len, MSG_NOSIGNAL), len);
+}
+
+/// Send the request line and headers of an update with a body of len bytes
+static void send_update_headers(int fd, const char *query, const char *auth, size_t len) {
+    char headers[256];
+    int n = snprintf(headers, sizeof(headers), "POST /update%s HTTP/1.1\r\nHost: test\r\n%sContent-Length: %zu\r\n\r\n",
+                     query, auth, len);
+    client_send(fd, headers, n);
+}
+
+/**
+ * @brief Read one response with a Content-Length body.
+ *
+ * @return status code, -1 when the connection closed or stalled first
+ */
+static int client_response(int fd, char *body, size_t body_size) {
+    char headers[1024];
+    size_t len = 0;
+    while (len < 4 || memcmp(headers + len - 4, "\r\n\r\n", 4) != 0) {
+        if (len + 1 >= sizeof(headers) || recv(fd, headers + len, 1, 0) != 1) return -1;
+        len++;
+    }
+    headers[len] = '\0';
+    const char *length = strstr(headers, "Content-Length: ");
+    size_t body_len = length ? strtoul(length + 16, NULL, 10) : 0;
+    if (body_len >= body_size) return -1;
+    for (size_t got = 0; got < body_len;) {
+        ssize_t ret = recv(fd, body + got, body_len - got, 0);
+        if (ret <= 0) return -1;
+        got += (size_t)ret;
+    }
+    body[body_len] = '\0';
+    return atoi(headers + 9);
+}
+
+/// Run one update request on a new connection
+static int update(const char *query, const char *auth, const void *data, size_t len, char *body, size_t body_size) {
+    int fd = client_connect();
+    CHECK(fd >= 0);
+    if (fd < 0) return -1;
+    send_update_headers(fd, query, auth, len);
+    client_send(fd, data, len);
+    int status = client_response(fd, body, body_size);
+    close(fd);
+    return status;
+}
+
+#pragma endregion
+
+static void test_unauthorized(void) {
+    char body[512];
+    CHECK_EQ_INT(update("", "", image, sizeof(image), body, sizeof(body)), 401);
+    CHECK_EQ_INT(update("", "Authorization: Bearer wrong\r\n", image, sizeof(image), body, sizeof(body)), 401);
+    CHECK_EQ_INT(fake_ota_last_image_size(), 0);
+}
+
+static void test_not_an_image(void) {
+    char body[512];
+    uint8_t garbage[1024];
+    memset(garbage, 0x5a, sizeof(garbage));
+    CHECK_EQ_INT(update("", AUTH, garbage, sizeof(garbage), body, sizeof(body)), 400);
+    CHECK_EQ_STR(body, "Not a firmware image for this device");
+
+    // Right magic, other chip
+    uint8_t other[1024];
+    memcpy(other, image, sizeof(other));
+    ((esp_image_header_t *)other)->chip_id = CONFIG_IDF_FIRMWARE_CHIP_ID + 1;
+    CHECK_EQ_INT(update("", AUTH, other, sizeof(other), body, sizeof(body)), 400);
+    CHECK_EQ_INT(fake_ota_last_image_size(), 0);
+}
+
+static void test_update(void) {
+    char body[512];
+    CHECK_EQ_INT(update("?reboot=0", AUTH, image, sizeof(image), body, sizeof(body)), 200);
+    char bytes[32];
+    snprintf(bytes, sizeof(bytes), "{\"bytes\": %d,", IMAGE_SIZE);
+    CHECK(strncmp(body, bytes, strlen(bytes)) == 0);
+    CHECK(strstr(body, "\"partition\": \"ota_0\"") != NULL);
+    CHECK(strstr(body, "\"reboot\": false") != NULL);
+    CHECK_EQ_INT(fake_ota_last_image_size(), sizeof(image));
+    CHECK_EQ_STR(fake_ota_boot_label(), "ota_0");
+    CHECK_EQ_INT(fake_system_restart_count(), 0);
+}
+
+static void test_one_update_at_a_time(void) {
+    // The first update waits for the rest of its body while a second one comes in
+    int fd = client_connect();
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+    send_update_headers(fd, "?reboot=0", AUTH, sizeof(image));
+    client_send(fd, image, 1000);
+    usleep(200 * 1000);
+
+    char body[512];
+    CHECK_EQ_INT(update("?reboot=0", AUTH, image, sizeof(image), body, sizeof(body)), 409);
+    // Other requests are served meanwhile
+    int other = client_connect();
+    const char *get = "GET /wifi-status.json HTTP/1.1\r\nHost: test\r\n\r\n";
+    client_send(other, get, strlen(get));
+    CHECK_EQ_INT(client_response(other, body, sizeof(body)), 200);
+    close(other);
+
+    client_send(fd, image + 1000, sizeof(image) - 1000);
+    CHECK_EQ_INT(client_response(fd, body, sizeof(body)), 200);
+    CHECK(strstr(body, "\"requestsServed\": 2") != NULL);
+    close(fd);
+}
+
+static esp_err_t post_form(const char *form) {
+    fake_httpd_response_t resp;
+    esp_err_t err = fake_httpd_invoke(wifi_get_http_server(), HTTP_POST, "/captive",
+                                      "Content-Type: application/x-www-form-urlencoded\r\n", form, strlen(form), &resp);
+    if (err == ESP_OK && resp.status != 302) err = ESP_FAIL;
+    fake_httpd_response_free(&resp);
+    return err;
+}
+
+/// The server of the new mode is up with its handlers
+static bool serving(void *ctx) {
+    const wifi_mode_t *mode = ctx;
+    fake_wifi_state_t state;
+    fake_wifi_get_state(&state);
+    httpd_handle_t server = wifi_get_http_server();
+    if (!state.started || state.mode != *mode || server == NULL || fake_httpd_bound_port() == 0) return false;
+    fake_httpd_response_t resp;
+    bool up = fake_httpd_invoke(server, HTTP_GET, "/captive.json", NULL, NULL, 0, &resp) == ESP_OK &&
+              resp.status == 200;
+    fake_httpd_response_free(&resp);
+    return up;
+}
+
+static void test_mode_switch_during_update(void) {
+    // An update waits for the rest of its body when a mode switch comes in
+    int fd = client_connect();
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+    send_update_headers(fd, "?reboot=0", AUTH, sizeof(image));
+    client_send(fd, image, 1000);
+    usleep(200 * 1000);
+    CHECK_EQ_INT(post_form(AP_FORM), ESP_OK);
+
+    // The switch waits for the update instead of stopping the server under it
+    usleep(1000 * 1000);
+    fake_wifi_state_t state;
+    fake_wifi_get_state(&state);
+    CHECK_EQ_INT(state.mode, WIFI_MODE_STA);
+    CHECK(wifi_get_http_server() != NULL);
+
+    char body[512];
+    client_send(fd, image + 1000, sizeof(image) - 1000);
+    CHECK_EQ_INT(client_response(fd, body, sizeof(body)), 200);
+    CHECK(strstr(body, "\"reboot\": false") != NULL);
+    close(fd);
+    CHECK_EQ_INT(fake_ota_last_image_size(), sizeof(image));
+
+    // Then the switch goes ahead, and updates are accepted by the new server
+    wifi_mode_t mode = WIFI_MODE_APSTA;
+    CHECK(host_wait_until(serving, &mode, 5000));
+    CHECK_EQ_INT(post_form(STA_FORM), ESP_OK);
+    mode = WIFI_MODE_STA;
+    CHECK(host_wait_until(serving, &mode, 5000) && host_wait_until(host_sta_connected, NULL, 5000));
+    CHECK_EQ_INT(update("?reboot=0", AUTH, image, sizeof(image), body, sizeof(body)), 200);
+}
+
+static void restart_hook(void) {
+}
+
+static void test_restart(void) {
+    // Without ?reboot=0 the device restarts once the response is out; the restarting task parks in the hook
+    fake_system_set_restart_hook(restart_hook);
+    char body[512];
+    CHECK_EQ_INT(update("", AUTH, image, sizeof(image), body, sizeof(body)), 200);
+    CHECK(strstr(body, "\"reboot\": true") != NULL);
+    for (int i = 0; i < 30 && fake_system_restart_count() == 0; i++) usleep(100 * 1000);
+    CHECK_EQ_INT(fake_system_restart_count(), 1);
+}
+
+int main(void) {
+    build_image();
+    host_add_network("HomeNet", "secret123");
+    host_preset_sta("HomeNet", "secret123");
+    fake_httpd_set_port(0);
+    CHECK_EQ_INT(wifi_init(), ESP_OK);
+    CHECK(host_wait_until(host_sta_connected, NULL, 5000));
+    RUN_TEST(test_unauthorized);
+    RUN_TEST(test_not_an_image);
+    RUN_TEST(test_update);
+    RUN_TEST(test_one_update_at_a_time);
+    RUN_TEST(test_mode_switch_during_update);
+    RUN_TEST(test_restart);
+    UNIT_MAIN_END();
+}
@@ -0,0 +1,131 @@
+/**
+ * @file test_restart.c
+ * @brief Restart from /restart over loopback connections: immediate response, refused connections, drained requests.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "Wifi.h"
+#include "esp_timer.h"
+#include "fake_host.h"
+#include "host_support.h"
+#include "unit.h"
+
+UNIT_GLOBALS;
+
+/// How long the slow handler keeps the server task busy
+#define SLOW_HANDLER_MS 2000
+
+/// esp_timer time of the restart, 0 before it
+static volatile int64_t restart_us;
+
+static void restart_hook(void) {
+    restart_us = esp_timer_get_time();
+}
+
+static esp_err_t slow_handler(httpd_req_t *req) {
+    vTaskDelay(pdMS_TO_TICKS(SLOW_HANDLER_MS));
+    return httpd_resp_sendstr(req, "slow");
+}
+
+#pragma region Client
+
+static int client_connect(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(fake_httpd_bound_port()),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    struct timeval timeout = { .tv_sec = 5 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int client_get(const char *uri) {
+    int fd = client_connect();
+    CHECK(fd >= 0);
+    char request[128];
+    int len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: test\r\n\r\n", uri);
+    CHECK_EQ_INT(send(fd, request, len, MSG_NOSIGNAL), len);
+    return fd;
+}
+
+/**
+ * @brief Read the status line of a response.
+ *
+ * @return status code, 0 when the server closed the connection first
+ */
+static int client_status(int fd) {
+    char line[16];
+    size_t len = 0;
+    while (len < 12) {
+        ssize_t ret = recv(fd, line + len, 12 - len, 0);
+        if (ret <= 0) return 0;
+        len += (size_t)ret;
+    }
+    line[len] = '\0';
+    return atoi(line + 9);
+}
+
+#pragma endregion
+
+static void test_restart_drains(void) {
+    // The response comes right away, the restart only after its delay
+    int64_t start = esp_timer_get_time();
+    int fd = client_get("/restart");
+    CHECK_EQ_INT(client_status(fd), 302);
+    close(fd);
+    CHECK(esp_timer_get_time() - start < 500 * 1000);
+    usleep(100 * 1000);     // The handler schedules the restart after sending the response
+    CHECK_EQ_INT(wifi_request_restart(0, true), ESP_ERR_INVALID_STATE);    // Already scheduled
+
+    // A request in progress when the delay is over holds the restart back
+    int slow = client_get("/slow");
+    usleep(1500 * 1000);
+    CHECK_EQ_INT(restart_us, 0);
+
+    // Meanwhile new connections are closed without an answer
+    int refused = client_get("/wifi-status.json");
+    CHECK_EQ_INT(client_status(refused), 0);
+    close(refused);
+
+    CHECK_EQ_INT(client_status(slow), 200);
+    int64_t answered = esp_timer_get_time();
+    close(slow);
+    for (int i = 0; i < 50 && restart_us == 0; i++) usleep(100 * 1000);
+    CHECK(restart_us != 0);
+    CHECK(restart_us >= answered - 100 * 1000);
+    CHECK(restart_us - start < (int64_t)(SLOW_HANDLER_MS + 1000) * 1000);
+    CHECK_EQ_INT(fake_system_restart_count(), 1);
+}
+
+static bool server_up(void *ctx) {
+    return fake_httpd_bound_port() != 0;
+}
+
+int main(void) {
+    host_add_assets();
+    host_add_network("HomeNet", "secret123");
+    host_preset_sta("HomeNet", "secret123");
+    fake_system_set_restart_hook(restart_hook);
+    httpd_uri_t slow = { .uri = "/slow", .method = HTTP_GET, .handler = slow_handler };
+    CHECK_EQ_INT(wifi_register_http_handler(&slow), ESP_OK);
+    fake_httpd_set_port(0);
+    CHECK_EQ_INT(wifi_init(), ESP_OK);
+    CHECK(host_wait_until(host_sta_connected, NULL, 5000));
+    CHECK(host_wait_until(server_up, NULL, 5000));
+    RUN_TEST(test_restart_drains);
+    UNIT_MAIN_END();
+}
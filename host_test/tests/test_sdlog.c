@@ -0,0 +1,339 @@
+/**
+ * @file test_sdlog.c
+ * @brief SD card log sink on a temporary directory: queue full, ring wraparound, concurrent producers, rotation, flush,
+ *        whole records after write errors.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "sdkconfig.h"
+#include "unit.h"
+#include "wifi_sdlog.h"
+
+UNIT_GLOBALS;
+
+/// Ring capacity in bytes; a record takes ceil(len / slot size) slots
+#define QUEUE_BYTES (CONFIG_WIFI_SDLOG_SLOTS * CONFIG_WIFI_SDLOG_SLOT_SIZE)
+
+/// Longest record the sink accepts: half the queue
+#define MAX_RECORD (QUEUE_BYTES / 2)
+
+#define LOG_FILE_SIZE (CONFIG_WIFI_SDLOG_FILE_SIZE_KB * 1024)
+
+static char mount_point[] = "/tmp/wifi_sdlog_XXXXXX";
+
+/// Everything written so far, in order, to compare the log files against
+static char *expected;
+static size_t expected_len;
+
+static void expect(const void *data, size_t len) {
+    expected = realloc(expected, expected_len + len);
+    memcpy(expected + expected_len, data, len);
+    expected_len += len;
+}
+
+/// Read a log file into a malloc'ed buffer, NULL if it does not exist
+static char *read_log(int index, size_t *len) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s/log%d.txt", mount_point, CONFIG_WIFI_SDLOG_DIR, index);
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return NULL;
+    fseek(f, 0, SEEK_END);
+    *len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc(*len + 1);
+    size_t got = fread(buf, 1, *len, f);
+    fclose(f);
+    buf[got] = '\0';
+    *len = got;
+    return buf;
+}
+
+/// Queue a record, flushing while the queue is full
+static void write_record(const void *data, size_t len) {
+    esp_err_t err;
+    while ((err = wifi_sdlog_write(data, len)) == ESP_ERR_NO_MEM) {
+        wifi_sdlog_flush(1000);
+    }
+    CHECK_EQ_INT(err, ESP_OK);
+}
+
+/// Check that log0.txt, after the older files, holds exactly the expected stream
+static void check_logs(void) {
+    size_t off = 0;
+    for (int i = CONFIG_WIFI_SDLOG_FILE_COUNT - 1; i >= 0; i--) {
+        size_t len;
+        char *log = read_log(i, &len);
+        if (log == NULL) continue;
+        CHECK(off + len <= expected_len);
+        CHECK(off + len <= expected_len && memcmp(log, expected + off, len) == 0);
+        off += len;
+        free(log);
+    }
+    CHECK_EQ_INT(off, expected_len);
+}
+
+static void test_not_running(void) {
+    CHECK_EQ_INT(wifi_sdlog_write("x", 1), ESP_ERR_INVALID_STATE);
+    CHECK_EQ_INT(wifi_sdlog_flush(0), ESP_ERR_INVALID_STATE);
+}
+
+static void test_queue_full(void) {
+    CHECK_EQ_INT(wifi_sdlog_init(mount_point), ESP_OK);
+
+    // Without a card nothing drains: every slot fills, then records are dropped
+    char record[CONFIG_WIFI_SDLOG_SLOT_SIZE];
+    for (int i = 0; i < CONFIG_WIFI_SDLOG_SLOTS; i++) {
+        memset(record, 'a' + i % 26, sizeof(record));
+        record[sizeof(record) - 1] = '\n';
+        CHECK_EQ_INT(wifi_sdlog_write(record, sizeof(record)), ESP_OK);
+        expect(record, sizeof(record));
+    }
+    CHECK_EQ_INT(wifi_sdlog_write("lost\n", 5), ESP_ERR_NO_MEM);
+    CHECK_EQ_INT(wifi_sdlog_flush(50), ESP_ERR_TIMEOUT);
+
+    // Too long for the queue at all
+    static char too_long[MAX_RECORD + 1];
+    CHECK_EQ_INT(wifi_sdlog_write(too_long, sizeof(too_long)), ESP_ERR_INVALID_SIZE);
+
+    wifi_sdlog_stats_t stats;
+    wifi_sdlog_get_stats(&stats);
+    CHECK_EQ_INT(stats.records, CONFIG_WIFI_SDLOG_SLOTS);
+    CHECK_EQ_INT(stats.dropped, 2);
+    CHECK_EQ_INT(stats.queue_slots, CONFIG_WIFI_SDLOG_SLOTS);
+    CHECK_EQ_INT(stats.queue_high_water, CONFIG_WIFI_SDLOG_SLOTS);
+    CHECK_EQ_INT(stats.bytes_written, 0);
+}
+
+static void test_flush(void) {
+    // The queued records reach the card once it is mounted
+    wifi_sdlog_card_changed(true);
+    CHECK_EQ_INT(wifi_sdlog_flush(2000), ESP_OK);
+    check_logs();
+
+    wifi_sdlog_stats_t stats;
+    wifi_sdlog_get_stats(&stats);
+    CHECK_EQ_INT(stats.bytes_written, expected_len);
+    CHECK(stats.syncs >= 1);
+    CHECK_EQ_INT(stats.write_errors, 0);
+
+    // After a remount the unaligned tail is read back and appended to
+    wifi_sdlog_card_changed(false);
+    wifi_sdlog_card_changed(true);
+    CHECK_EQ_INT(wifi_sdlog_printf("after remount %d\n", 42), ESP_OK);
+    expect("after remount 42\n", 17);
+    CHECK_EQ_INT(wifi_sdlog_flush(2000), ESP_OK);
+    check_logs();
+}
+
+static void test_wraparound(void) {
+    // Records of 1 to 5 slots with lengths off the slot size, so they straddle the end of the ring many times
+    char record[5 * CONFIG_WIFI_SDLOG_SLOT_SIZE];
+    for (int i = 0; i < 20 * CONFIG_WIFI_SDLOG_SLOTS; i++) {
+        size_t len = 1 + (size_t)(i * 37) % sizeof(record);
+        int head = snprintf(record, sizeof(record), "%d:", i);
+        for (size_t j = head; j < len; j++) record[j] = 'A' + (i + j) % 26;
+        if (len < (size_t)head) len = head;
+        record[len - 1] = '\n';
+        write_record(record, len);
+        expect(record, len);
+    }
+    CHECK_EQ_INT(wifi_sdlog_flush(2000), ESP_OK);
+    check_logs();
+
+    wifi_sdlog_stats_t stats;
+    wifi_sdlog_get_stats(&stats);
+    CHECK_EQ_INT(stats.bytes_written, expected_len);
+    CHECK(stats.card_bytes >= stats.bytes_written);
+    CHECK(stats.write_amplification_x100 >= 100);
+}
+
+#define PRODUCERS 4
+#define RECORDS_PER_PRODUCER 1000
+
+static void *producer(void *arg) {
+    int id = (int)(intptr_t)arg;
+    char record[3 * CONFIG_WIFI_SDLOG_SLOT_SIZE];
+    for (int i = 0; i < RECORDS_PER_PRODUCER; i++) {
+        // 1 to 3 slots, padded with the producer's letter
+        size_t len = 16 + (size_t)(i * 53 + id * 11) % (sizeof(record) - 16);
+        int head = snprintf(record, sizeof(record), "P%d %05d ", id, i);
+        memset(record + head, 'a' + id, len - head - 1);
+        record[len - 1] = '\n';
+        while (wifi_sdlog_write(record, len) == ESP_ERR_NO_MEM) {
+            usleep(100);
+        }
+    }
+    return NULL;
+}
+
+static void test_concurrent_producers(void) {
+    wifi_sdlog_stats_t stats;
+    wifi_sdlog_get_stats(&stats);
+    uint32_t rotations = stats.rotations;
+    size_t before_len;
+    char *before = read_log(0, &before_len);
+    free(before);
+
+    pthread_t threads[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_create(&threads[i], NULL, producer, (void *)(intptr_t)i);
+    }
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    CHECK_EQ_INT(wifi_sdlog_flush(2000), ESP_OK);
+    wifi_sdlog_get_stats(&stats);
+    CHECK_EQ_INT(stats.rotations, rotations);     // All of it is in log0.txt
+
+    // Every record arrives whole: one line each, in order per producer
+    size_t len;
+    char *log = read_log(0, &len);
+    CHECK(log != NULL && len > before_len);
+    if (log == NULL || len <= before_len) return;
+    int next[PRODUCERS] = {0};
+    char *line = log + before_len;
+    while (line < log + len) {
+        char *end = memchr(line, '\n', log + len - line);
+        CHECK(end != NULL);
+        if (end == NULL) break;
+        int id = -1, seq = -1, head = 0;
+        CHECK(sscanf(line, "P%d %d %n", &id, &seq, &head) == 2);
+        CHECK(id >= 0 && id < PRODUCERS);
+        if (id < 0 || id >= PRODUCERS) break;
+        CHECK_EQ_INT(seq, next[id]);
+        next[id] = seq + 1;
+        for (char *p = line + head; p < end; p++) {
+            if (*p != 'a' + id) {
+                CHECK(*p == 'a' + id);
+                break;
+            }
+        }
+        line = end + 1;
+    }
+    for (int i = 0; i < PRODUCERS; i++) {
+        CHECK_EQ_INT(next[i], RECORDS_PER_PRODUCER);
+    }
+    expect(log + before_len, len - before_len);
+    free(log);
+}
+
+static void test_rotation(void) {
+    // Fill log0.txt past its size limit; it moves to log1.txt at the batch boundary
+    wifi_sdlog_stats_t stats;
+    wifi_sdlog_get_stats(&stats);
+    uint32_t rotations = stats.rotations;
+    char record[MAX_RECORD];
+    for (int i = 0; expected_len < LOG_FILE_SIZE + 3 * CONFIG_WIFI_SDLOG_BATCH_SIZE / 2; i++) {
+        int head = snprintf(record, sizeof(record), "rotate %d ", i);
+        memset(record + head, '.', sizeof(record) - head - 1);
+        record[sizeof(record) - 1] = '\n';
+        write_record(record, sizeof(record));
+        expect(record, sizeof(record));
+    }
+    CHECK_EQ_INT(wifi_sdlog_flush(2000), ESP_OK);
+
+    wifi_sdlog_get_stats(&stats);
+    CHECK_EQ_INT(stats.rotations, rotations + 1);
+    size_t len;
+    char *log = read_log(1, &len);
+    CHECK(log != NULL);
+    CHECK_EQ_INT(len, LOG_FILE_SIZE);
+    free(log);
+    check_logs();
+}
+
+/// Length of the records in test_write_error: three slots, the last one short
+#define ERROR_RECORD_LEN (2 * CONFIG_WIFI_SDLOG_SLOT_SIZE + 10)
+
+/// Records test_write_error queues while the card fails
+#define ERROR_RECORDS 5
+
+/// Build record seq of test_write_error: its number, then its letter
+static void error_record(char record[ERROR_RECORD_LEN], int seq) {
+    int head = snprintf(record, ERROR_RECORD_LEN, "E%d ", seq);
+    memset(record + head, 'a' + seq, ERROR_RECORD_LEN - head - 1);
+    record[ERROR_RECORD_LEN - 1] = '\n';
+}
+
+static void test_write_error(void) {
+    // Pad the log so the batch buffer holds all but 100 bytes of a batch
+    char pad[CONFIG_WIFI_SDLOG_BATCH_SIZE / 4];
+    size_t start;
+    CHECK_EQ_INT(wifi_sdlog_flush(2000), ESP_OK);
+    free(read_log(0, &start));
+    size_t left = (2 * CONFIG_WIFI_SDLOG_BATCH_SIZE - 100 - start % CONFIG_WIFI_SDLOG_BATCH_SIZE) %
+                  CONFIG_WIFI_SDLOG_BATCH_SIZE;
+    while (left > 0) {
+        size_t len = left < sizeof(pad) ? left : sizeof(pad);
+        memset(pad, '-', len);
+        pad[len - 1] = '\n';
+        write_record(pad, len);
+        expect(pad, len);
+        left -= len;
+    }
+    CHECK_EQ_INT(wifi_sdlog_flush(2000), ESP_OK);
+    free(read_log(0, &start));
+    CHECK_EQ_INT(start % CONFIG_WIFI_SDLOG_BATCH_SIZE, CONFIG_WIFI_SDLOG_BATCH_SIZE - 100);
+    wifi_sdlog_stats_t before, after;
+    wifi_sdlog_get_stats(&before);
+
+    // The batch fills up in the second slot of record 0, and its write stops 50 bytes into the record
+    signal(SIGXFSZ, SIG_IGN);
+    struct rlimit limit;
+    getrlimit(RLIMIT_FSIZE, &limit);
+    struct rlimit low = limit;
+    low.rlim_cur = start + 50;
+    CHECK_EQ_INT(setrlimit(RLIMIT_FSIZE, &low), 0);
+    char record[ERROR_RECORD_LEN];
+    wifi_sdlog_card_changed(false);
+    for (int i = 0; i < ERROR_RECORDS; i++) {
+        error_record(record, i);
+        CHECK_EQ_INT(wifi_sdlog_write(record, sizeof(record)), ESP_OK);
+    }
+    wifi_sdlog_card_changed(true);
+    after = before;
+    for (int i = 0; i < 200 && after.write_errors == before.write_errors; i++) {
+        usleep(10 * 1000);
+        wifi_sdlog_get_stats(&after);
+    }
+    CHECK_EQ_INT(after.write_errors, before.write_errors + 1);
+    CHECK_EQ_INT(setrlimit(RLIMIT_FSIZE, &limit), 0);
+
+    // Record 0 is gone whole: neither its start nor its last slot reach the card
+    CHECK_EQ_INT(wifi_sdlog_flush(2000), ESP_OK);
+    for (int i = 1; i < ERROR_RECORDS; i++) {
+        error_record(record, i);
+        expect(record, sizeof(record));
+    }
+    check_logs();
+    wifi_sdlog_get_stats(&after);
+    CHECK_EQ_INT(after.lost_bytes, before.lost_bytes + ERROR_RECORD_LEN);
+    CHECK_EQ_INT(after.bytes_written, before.bytes_written + (ERROR_RECORDS - 1) * ERROR_RECORD_LEN);
+}
+
+int main(void) {
+    if (mkdtemp(mount_point) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    RUN_TEST(test_not_running);
+    RUN_TEST(test_queue_full);
+    RUN_TEST(test_flush);
+    RUN_TEST(test_wraparound);
+    RUN_TEST(test_concurrent_producers);
+    RUN_TEST(test_rotation);
+    RUN_TEST(test_write_error);
+
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", mount_point);
+    if (system(cmd) != 0) fprintf(stderr, "Failed to remove %s\n", mount_point);
+    UNIT_MAIN_END();
+}
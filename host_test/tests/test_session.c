@@ -0,0 +1,259 @@
+/**
+ * @file test_session.c
+ * @brief HTTP session limits over loopback connections: sockets per client, header deadline, body rate, WebSocket exemption.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "Wifi.h"
+#include "esp_timer.h"
+#include "fake_host.h"
+#include "host_support.h"
+#include "unit.h"
+#include "wifi_ws_rx.h"
+
+UNIT_GLOBALS;
+
+#define BODY_WINDOW_BYTES (CONFIG_WIFI_HTTPD_MIN_BODY_RATE * CONFIG_WIFI_HTTPD_BODY_RATE_WINDOW_MS / 1000)
+
+/// Reads the whole request body
+static esp_err_t sink_handler(httpd_req_t *req) {
+    char buf[256];
+    for (size_t left = req->content_len; left > 0;) {
+        int ret = httpd_req_recv(req, buf, left < sizeof(buf) ? left : sizeof(buf));
+        if (ret <= 0) return ESP_FAIL;
+        left -= (size_t)ret;
+    }
+    return httpd_resp_sendstr(req, "done");
+}
+
+static esp_err_t ws_echo_frame(httpd_req_t *req, httpd_ws_frame_t *frame, void *ctx) {
+    if (frame->type != HTTPD_WS_TYPE_TEXT && frame->type != HTTPD_WS_TYPE_BINARY) return ESP_OK;
+    return httpd_ws_send_frame(req, frame);
+}
+
+static esp_err_t ws_echo_handler(httpd_req_t *req) {
+    if (req->method == HTTP_GET) return ESP_OK;     // Upgrade
+    return wifi_ws_recv(req, ws_echo_frame, NULL);
+}
+
+#pragma region Client
+
+static int client_connect(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(fake_httpd_bound_port()),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    struct timeval timeout = { .tv_sec = 15 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void client_send(int fd, const void *buf, size_t len) {
+    CHECK_EQ_INT(send(fd, buf, len, MSG_NOSIGNAL), len);
+}
+
+/**
+ * @brief Read the headers of a response and skip its Content-Length body.
+ *
+ * @return status code, 0 when the server closed the connection first
+ */
+static int client_response(int fd) {
+    char headers[1024];
+    size_t len = 0;
+    while (len < 4 || memcmp(headers + len - 4, "\r\n\r\n", 4) != 0) {
+        if (len + 1 >= sizeof(headers) || recv(fd, headers + len, 1, 0) != 1) return 0;
+        len++;
+    }
+    headers[len] = '\0';
+    const char *length = strstr(headers, "Content-Length: ");
+    char body[256];
+    for (size_t left = length ? strtoul(length + 16, NULL, 10) : 0; left > 0;) {
+        ssize_t ret = recv(fd, body, left < sizeof(body) ? left : sizeof(body), 0);
+        if (ret <= 0) return 0;
+        left -= (size_t)ret;
+    }
+    return atoi(headers + 9);
+}
+
+/// Whether the server closed the connection, waiting at most the socket timeout
+static bool client_closed(int fd) {
+    char c;
+    return recv(fd, &c, 1, 0) <= 0;
+}
+
+static int64_t elapsed_ms(int64_t start_us) {
+    return (esp_timer_get_time() - start_us) / 1000;
+}
+
+#pragma endregion
+
+static void test_sockets_per_client(void) {
+    wifi_session_stats_t before, after;
+    wifi_get_session_stats(&before);
+
+    // Keep-alive sessions up to the limit are served
+    int fds[CONFIG_WIFI_HTTPD_MAX_SOCKETS_PER_CLIENT];
+    const char *get = "GET /wifi-status.json HTTP/1.1\r\nHost: test\r\n\r\n";
+    for (int i = 0; i < CONFIG_WIFI_HTTPD_MAX_SOCKETS_PER_CLIENT; i++) {
+        fds[i] = client_connect();
+        CHECK(fds[i] >= 0);
+        client_send(fds[i], get, strlen(get));
+        CHECK_EQ_INT(client_response(fds[i]), 200);
+    }
+
+    // One more from the same address is closed right after accept
+    int extra = client_connect();
+    CHECK(extra >= 0);
+    CHECK(client_closed(extra));
+    close(extra);
+    wifi_get_session_stats(&after);
+    CHECK_EQ_INT(after.rejected, before.rejected + 1);
+    CHECK_EQ_INT(after.open, before.open + CONFIG_WIFI_HTTPD_MAX_SOCKETS_PER_CLIENT);
+
+    // The sessions held are not disturbed, and a closed one makes room
+    client_send(fds[0], get, strlen(get));
+    CHECK_EQ_INT(client_response(fds[0]), 200);
+    close(fds[0]);
+    usleep(200 * 1000);
+    extra = client_connect();
+    client_send(extra, get, strlen(get));
+    CHECK_EQ_INT(client_response(extra), 200);
+    close(extra);
+    for (int i = 1; i < CONFIG_WIFI_HTTPD_MAX_SOCKETS_PER_CLIENT; i++) close(fds[i]);
+    usleep(200 * 1000);
+}
+
+static void test_slow_header(void) {
+    wifi_session_stats_t before, after;
+    wifi_get_session_stats(&before);
+
+    // The request line, then nothing: 408 once the deadline is over, counted from the first byte
+    int fd = client_connect();
+    CHECK(fd >= 0);
+    int64_t start = esp_timer_get_time();
+    const char *line = "GET /wifi-status.json HTTP/1.1\r\n";
+    client_send(fd, line, strlen(line));
+    usleep(1000 * 1000);
+    client_send(fd, "Host: te", 8);
+    CHECK_EQ_INT(client_response(fd), 408);
+    int64_t ms = elapsed_ms(start);
+    CHECK(ms >= CONFIG_WIFI_HTTPD_HEADER_TIMEOUT_MS - 100 && ms < CONFIG_WIFI_HTTPD_HEADER_TIMEOUT_MS + 1500);
+    CHECK(client_closed(fd));
+    close(fd);
+
+    wifi_get_session_stats(&after);
+    CHECK_EQ_INT(after.header_timeouts, before.header_timeouts + 1);
+}
+
+static void test_slow_body(void) {
+    wifi_session_stats_t before, after;
+    wifi_get_session_stats(&before);
+
+    // A body at full speed is read, even when larger than a rate window
+    char body[4 * BODY_WINDOW_BYTES];
+    memset(body, 'x', sizeof(body));
+    char headers[128];
+    int len = snprintf(headers, sizeof(headers), "POST /sink HTTP/1.1\r\nHost: test\r\nContent-Length: %zu\r\n\r\n",
+                       sizeof(body));
+    int fd = client_connect();
+    CHECK(fd >= 0);
+    client_send(fd, headers, len);
+    client_send(fd, body, sizeof(body));
+    CHECK_EQ_INT(client_response(fd), 200);
+    close(fd);
+
+    // Less than a window's worth, then nothing: closed without a response at the end of the window
+    fd = client_connect();
+    CHECK(fd >= 0);
+    int64_t start = esp_timer_get_time();
+    client_send(fd, headers, len);
+    client_send(fd, body, BODY_WINDOW_BYTES / 2);
+    CHECK_EQ_INT(client_response(fd), 0);
+    int64_t ms = elapsed_ms(start);
+    CHECK(ms >= CONFIG_WIFI_HTTPD_BODY_RATE_WINDOW_MS - 100 && ms < CONFIG_WIFI_HTTPD_BODY_RATE_WINDOW_MS + 1500);
+    close(fd);
+
+    wifi_get_session_stats(&after);
+    CHECK_EQ_INT(after.slow_bodies, before.slow_bodies + 1);
+    CHECK_EQ_INT(after.header_timeouts, before.header_timeouts);
+}
+
+static void test_websocket_trickle(void) {
+    wifi_session_stats_t before, after;
+    wifi_get_session_stats(&before);
+
+    int fd = client_connect();
+    CHECK(fd >= 0);
+    const char *upgrade = "GET /ws HTTP/1.1\r\nHost: test\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                          "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+    client_send(fd, upgrade, strlen(upgrade));
+    CHECK_EQ_INT(client_response(fd), 101);
+
+    // A masked text frame one byte at a time, over more than the header deadline
+    static const char payload[] = "trickled";
+    const uint8_t mask[4] = { 0x12, 0x34, 0x56, 0x78 };
+    uint8_t frame[2 + 4 + sizeof(payload) - 1] = { 0x81, 0x80 | (sizeof(payload) - 1) };
+    memcpy(frame + 2, mask, 4);
+    for (size_t i = 0; i < sizeof(payload) - 1; i++) frame[6 + i] = (uint8_t)payload[i] ^ mask[i % 4];
+    int interval_ms = (CONFIG_WIFI_HTTPD_HEADER_TIMEOUT_MS + 1000) / (int)sizeof(frame);
+    for (size_t i = 0; i < sizeof(frame); i++) {
+        client_send(fd, &frame[i], 1);
+        usleep(interval_ms * 1000);
+    }
+
+    // Echoed back unmasked
+    uint8_t echo[2 + sizeof(payload) - 1];
+    size_t got = 0;
+    while (got < sizeof(echo)) {
+        ssize_t ret = recv(fd, echo + got, sizeof(echo) - got, 0);
+        if (ret <= 0) break;
+        got += (size_t)ret;
+    }
+    CHECK_EQ_INT(got, sizeof(echo));
+    CHECK_EQ_INT(echo[0], 0x81);
+    CHECK_EQ_INT(echo[1], sizeof(payload) - 1);
+    CHECK(memcmp(echo + 2, payload, sizeof(payload) - 1) == 0);
+    close(fd);
+
+    wifi_get_session_stats(&after);
+    CHECK_EQ_INT(after.header_timeouts, before.header_timeouts);
+    CHECK_EQ_INT(after.slow_bodies, before.slow_bodies);
+}
+
+static bool server_up(void *ctx) {
+    return fake_httpd_bound_port() != 0;
+}
+
+int main(void) {
+    host_add_assets();
+    host_add_network("HomeNet", "secret123");
+    host_preset_sta("HomeNet", "secret123");
+    // Before wifi_init(), so the wildcard handler does not shadow them
+    httpd_uri_t sink = { .uri = "/sink", .method = HTTP_POST, .handler = sink_handler };
+    httpd_uri_t ws = { .uri = "/ws", .method = HTTP_GET, .handler = ws_echo_handler, .is_websocket = true };
+    CHECK_EQ_INT(wifi_register_http_handler(&sink), ESP_OK);
+    CHECK_EQ_INT(wifi_register_http_handler(&ws), ESP_OK);
+    fake_httpd_set_port(0);
+    CHECK_EQ_INT(wifi_init(), ESP_OK);
+    CHECK(host_wait_until(host_sta_connected, NULL, 5000));
+    CHECK(host_wait_until(server_up, NULL, 5000));
+    RUN_TEST(test_sockets_per_client);
+    RUN_TEST(test_slow_header);
+    RUN_TEST(test_slow_body);
+    RUN_TEST(test_websocket_trickle);
+    UNIT_MAIN_END();
+}
@@ -0,0 +1,254 @@
+/**
+ * @file test_ssi.c
+ * @brief Server-side includes on a temporary directory: directives across read buffers, escaping, includes, cache.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <utime.h>
+
+#include "esp_http_server.h"
+#include "fake_host.h"
+#include "unit.h"
+#include "wifi_arena.h"
+#include "wifi_ssi.h"
+#include "wifi_upload.h"
+
+UNIT_GLOBALS;
+
+/// The smallest read buffer the component expands templates with
+#define READ_BUF_SIZE 256
+
+/// Temporary directory; pages live in www/ so includes can try to leave it
+static char tmp_dir[] = "/tmp/wifi_ssi_XXXXXX";
+static char root[64];
+
+static httpd_handle_t server;
+
+static bool card_present = true;
+
+#pragma region Files
+
+static void write_file(const char *name, const char *content) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    FILE *f = fopen(path, "wb");
+    CHECK(f != NULL);
+    if (f == NULL) return;
+    fputs(content, f);
+    fclose(f);
+}
+
+/// Set the modification time of a file, seconds since the epoch
+static void set_mtime(const char *name, time_t mtime) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", root, name);
+    struct utimbuf times = { mtime, mtime };
+    CHECK_EQ_INT(utime(path, &times), 0);
+}
+
+#pragma endregion
+
+#pragma region Server
+
+/// The part of the SD card file handler that sends templates, on the temporary root
+static esp_err_t page_handler(httpd_req_t *req) {
+    char path[128];
+    snprintf(path, sizeof(path), "%s%s", root, req->uri);
+    FILE *f = fopen(path, "r");
+    if (f == NULL) return httpd_resp_send_404(req);
+    char buf[READ_BUF_SIZE];
+    esp_err_t ret = wifi_ssi_send(req, f, path, root, buf, sizeof(buf));
+    fclose(f);
+    if (ret != ESP_OK) return ESP_FAIL;
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+static void start_server(void) {
+    static wifi_upload_ctx_t upload_ctx = { .card_present = &card_present };
+    upload_ctx.mount_point = root;
+    httpd_uri_t handlers[] = {
+        { .uri = WIFI_UPLOAD_URI_PREFIX "/*", .method = HTTP_PUT, .handler = wifi_upload_handler,
+          .user_ctx = &upload_ctx },
+        { .uri = "/*", .method = HTTP_GET, .handler = page_handler },
+    };
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.uri_match_fn = httpd_uri_match_wildcard;
+    CHECK_EQ_INT(httpd_start(&server, &config), ESP_OK);
+    for (size_t i = 0; i < sizeof(handlers) / sizeof(handlers[0]); i++) {
+        CHECK_EQ_INT(wifi_arena_register_uri(server, &handlers[i]), ESP_OK);
+    }
+}
+
+/// Fetch a page and compare its body
+static void check_page(const char *uri, const char *expected) {
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(fake_httpd_invoke(server, HTTP_GET, uri, NULL, NULL, 0, &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 200);
+    CHECK_EQ_STR(resp.body, expected);
+    fake_httpd_response_free(&resp);
+}
+
+#pragma endregion
+
+#pragma region Variables
+
+static void var_string(char *buf, size_t size, void *ctx) {
+    snprintf(buf, size, "%s", (const char *)ctx);
+}
+
+/// A value as long as the provider buffer allows, escaping to five times its length
+static void var_ampersands(char *buf, size_t size, void *ctx) {
+    memset(buf, '&', size - 1);
+    buf[size - 1] = '\0';
+}
+
+#pragma endregion
+
+static void test_register(void) {
+    CHECK_EQ_INT(wifi_ssi_register_var("name", var_string, "device"), ESP_OK);
+    CHECK_EQ_INT(wifi_ssi_register_var("markup", var_string, "<a href=\"x\">Tom & Jerry's</a>"), ESP_OK);
+    CHECK_EQ_INT(wifi_ssi_register_var("amps", var_ampersands, NULL), ESP_OK);
+    CHECK_EQ_INT(wifi_ssi_register_var("bad name", var_string, ""), ESP_ERR_INVALID_ARG);
+    CHECK_EQ_INT(wifi_ssi_register_var("", var_string, ""), ESP_ERR_INVALID_ARG);
+    CHECK_EQ_INT(wifi_ssi_register_var("name", NULL, NULL), ESP_ERR_INVALID_ARG);
+    CHECK(wifi_ssi_is_template("/sdcard/index.html"));
+    CHECK(wifi_ssi_is_template("/sdcard/OLD.HTM"));
+    CHECK(!wifi_ssi_is_template("/sdcard/app.js"));
+}
+
+static void test_buffer_boundaries(void) {
+    // Directives starting everywhere around the first and second read buffer ends
+    static const char directive[] = "<!--#var name -->";
+    char filler[2 * READ_BUF_SIZE + 64];
+    char page[sizeof(filler) + 64], expected[sizeof(filler) + 64];
+    for (size_t at = READ_BUF_SIZE - 140; at <= 2 * READ_BUF_SIZE + 8; at += 3) {
+        // A '<' that is not a directive right before it, as in real markup
+        memset(filler, 'x', at);
+        filler[at - 2] = '<';
+        filler[at] = '\0';
+        snprintf(page, sizeof(page), "%s%s<b>end</b>", filler, directive);
+        snprintf(expected, sizeof(expected), "%sdevice<b>end</b>", filler);
+        write_file("edge.html", page);
+        check_page("/edge.html", expected);
+    }
+
+    // Two directives back to back across the boundary, and one cut off by the end of the file
+    memset(filler, 'y', READ_BUF_SIZE - 20);
+    filler[READ_BUF_SIZE - 20] = '\0';
+    snprintf(page, sizeof(page), "%s%s%s<!--#var name", filler, directive, directive);
+    snprintf(expected, sizeof(expected), "%sdevicedevice<!--#var name", filler);
+    write_file("edge.html", page);
+    check_page("/edge.html", expected);
+}
+
+static void test_var_escaping(void) {
+    write_file("vars.html", "<p><!--#var markup --></p><!--#var missing --><!--# echo x --><!-- plain -->");
+    check_page("/vars.html",
+               "<p>&lt;a href=&quot;x&quot;&gt;Tom &amp; Jerry&#39;s&lt;/a&gt;</p><!--# echo x --><!-- plain -->");
+
+    // The escaped text is larger than the read buffer and goes out in several chunks
+    char expected[5 * WIFI_SSI_VALUE_MAX + 8];
+    size_t len = 0;
+    for (int i = 0; i < WIFI_SSI_VALUE_MAX - 1; i++) len += (size_t)snprintf(expected + len, 6, "&amp;");
+    strcpy(expected + len, "!");
+    write_file("amps.html", "<!--#var amps -->!");
+    check_page("/amps.html", expected);
+}
+
+static void test_includes(void) {
+    // Three levels deep: the third is past WIFI_SSI_MAX_DEPTH and sent unchanged
+    write_file("index.html", "[<!--#include virtual=\"/parts/nav.html\" -->]");
+    write_file("parts/nav.html", "nav(<!--#var name -->,<!--#include file=\"item.html\" -->)");
+    write_file("parts/item.html", "item(<!--#include file=\"deep.html\" -->,<!--#include file=\"style.css\" -->)");
+    write_file("parts/deep.html", "deep(<!--#var name -->)");
+    write_file("parts/style.css", "css(<!--#var name -->)");
+    check_page("/index.html", "[nav(device,item(deep(<!--#var name -->),css(<!--#var name -->)))]");
+
+    // Paths that would leave the web root or the page's directory insert nothing
+    char secret[128];
+    snprintf(secret, sizeof(secret), "%s/secret.html", tmp_dir);
+    FILE *f = fopen(secret, "w");
+    CHECK(f != NULL);
+    if (f != NULL) {
+        fputs("secret", f);
+        fclose(f);
+    }
+    write_file("parts/escape.html",
+               "a<!--#include virtual=\"/../secret.html\" -->"
+               "b<!--#include file=\"../../secret.html\" -->"
+               "c<!--#include file=\"./item.html\" -->"
+               "d<!--#include virtual=\"/parts/missing.html\" -->"
+               "e<!--#include file=\"sub//x.html\" -->f");
+    check_page("/parts/escape.html", "abcdef");
+}
+
+static void test_cache(void) {
+    wifi_ssi_stats_t before, after;
+    write_file("cached.html", "<!--#var name -->--");
+    set_mtime("cached.html", 1000000);
+    check_page("/cached.html", "device--");
+    wifi_ssi_get_stats(&before);
+    check_page("/cached.html", "device--");
+    wifi_ssi_get_stats(&after);
+    CHECK_EQ_INT(after.cache_hits, before.cache_hits + 1);
+    CHECK_EQ_INT(after.cache_misses, before.cache_misses);
+
+    // Same size, other directive position: a new modification time is enough to notice
+    write_file("cached.html", "--<!--#var name -->");
+    set_mtime("cached.html", 1000001);
+    check_page("/cached.html", "--device");
+    wifi_ssi_get_stats(&before);
+    CHECK_EQ_INT(before.cache_misses, after.cache_misses + 1);
+
+    // Same size and modification time, as FAT's two-second resolution allows: the stale positions are used...
+    write_file("cached.html", "-<!--#var name -->-");
+    set_mtime("cached.html", 1000001);
+    check_page("/cached.html", "-<device");
+    // ...until the card is mounted again
+    wifi_ssi_card_changed();
+    check_page("/cached.html", "-device-");
+    wifi_ssi_get_stats(&after);
+    CHECK_EQ_INT(after.cache_misses, before.cache_misses + 1);
+
+    // An upload of the same size in the same second rescans as well
+    const char *uploaded = "<!--#var name -->++";
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(fake_httpd_invoke(server, HTTP_PUT, WIFI_UPLOAD_URI_PREFIX "/cached.html",
+                                   "Authorization: Bearer " CONFIG_WIFI_UPLOAD_TOKEN "\r\n", uploaded,
+                                   strlen(uploaded), &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 201);
+    fake_httpd_response_free(&resp);
+    set_mtime("cached.html", 1000001);
+    check_page("/cached.html", "device++");
+    wifi_ssi_get_stats(&before);
+    CHECK_EQ_INT(before.cache_misses, after.cache_misses + 1);
+    CHECK_EQ_INT(before.skipped, 0);
+}
+
+int main(void) {
+    if (mkdtemp(tmp_dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(root, sizeof(root), "%s/www", tmp_dir);
+    char parts[96];
+    snprintf(parts, sizeof(parts), "%s/parts", root);
+    if (mkdir(root, 0755) != 0 || mkdir(parts, 0755) != 0) {
+        perror("mkdir");
+        return 1;
+    }
+    start_server();
+    RUN_TEST(test_register);
+    RUN_TEST(test_buffer_boundaries);
+    RUN_TEST(test_var_escaping);
+    RUN_TEST(test_includes);
+    RUN_TEST(test_cache);
+    CHECK_EQ_INT(httpd_stop(server), ESP_OK);
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", tmp_dir);
+    if (system(cmd) != 0) fprintf(stderr, "Failed to remove %s\n", tmp_dir);
+    UNIT_MAIN_END();
+}
@@ -0,0 +1,209 @@
+/**
+ * @file test_util.c
+ * @brief Parsing and formatting helpers: url_decode, MIME types, Accept-Encoding, captive probe URIs, JSON writer,
+ *        DNS parsing.
+ */
+
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "dns_parse.h"
+#include "unit.h"
+#include "wifi_util.h"
+
+UNIT_GLOBALS;
+
+static void test_url_decode(void) {
+    char plus[] = "my+home+network";
+    url_decode(plus);
+    CHECK_EQ_STR(plus, "my home network");
+
+    char hex[] = "p%40ss%2Fw%C3%B6rd";
+    url_decode(hex);
+    CHECK_EQ_STR(hex, "p@ss/w\xc3\xb6rd");
+
+    char upper[] = "%4a%4B";
+    url_decode(upper);
+    CHECK_EQ_STR(upper, "JK");
+
+    // A '%' without two hex digits stays as is, also at the end of the string
+    char bad[] = "100%zz%4%";
+    url_decode(bad);
+    CHECK_EQ_STR(bad, "100%zz%4%");
+
+    char empty[] = "";
+    url_decode(empty);
+    CHECK_EQ_STR(empty, "");
+}
+
+static void test_mime_types(void) {
+    CHECK_EQ_STR(wifi_mime_type_for_path("/index.html"), "text/html");
+    CHECK_EQ_STR(wifi_mime_type_for_path("/index.htm"), "text/html");
+    CHECK_EQ_STR(wifi_mime_type_for_path("/styles.css"), "text/css");
+    CHECK_EQ_STR(wifi_mime_type_for_path("/ws.js"), "application/javascript");
+    CHECK_EQ_STR(wifi_mime_type_for_path("/img/logo.png"), "image/png");
+    CHECK_EQ_STR(wifi_mime_type_for_path("/favicon.ico"), "image/x-icon");
+    CHECK_EQ_STR(wifi_mime_type_for_path("/notes.txt"), "text/plain");
+    CHECK_EQ_STR(wifi_mime_type_for_path("/archive.tar.gz"), "application/octet-stream");
+    CHECK_EQ_STR(wifi_mime_type_for_path("/dir.d/README"), "application/octet-stream");
+}
+
+static void test_accept_encoding(void) {
+    CHECK(wifi_accepts_encoding("gzip, deflate, br", "gzip"));
+    CHECK(wifi_accepts_encoding("br;q=1.0, GZIP;q=0.5", "gzip"));
+    CHECK(wifi_accepts_encoding("*", "gzip"));
+    CHECK(wifi_accepts_encoding("x-gzip,gzip", "gzip"));
+    CHECK(!wifi_accepts_encoding(NULL, "gzip"));
+    CHECK(!wifi_accepts_encoding("", "gzip"));
+    CHECK(!wifi_accepts_encoding("identity", "gzip"));
+    CHECK(!wifi_accepts_encoding("x-gzip, gzipped", "gzip"));
+    CHECK(!wifi_accepts_encoding("gzip;q=0", "gzip"));
+    CHECK(!wifi_accepts_encoding("deflate, gzip ; q=0.000", "gzip"));
+    CHECK(wifi_accepts_encoding("gzip;q=0.001", "gzip"));
+    // The coding's own entry wins over the wildcard
+    CHECK(!wifi_accepts_encoding("*, gzip;q=0", "gzip"));
+    CHECK(wifi_accepts_encoding("*;q=0, gzip", "gzip"));
+    CHECK(!wifi_accepts_encoding("br, *;q=0", "gzip"));
+}
+
+static void test_captive_probes(void) {
+    CHECK(wifi_is_captive_probe_uri("/generate_204"));
+    CHECK(wifi_is_captive_probe_uri("/hotspot-detect.html"));
+    CHECK(wifi_is_captive_probe_uri("/connecttest.txt"));
+    CHECK(!wifi_is_captive_probe_uri("/index.html"));
+    CHECK(!wifi_is_captive_probe_uri("/generate_2044"));
+}
+
+static void test_safe_file_path(void) {
+#define SAFE(p) wifi_is_safe_file_path(p, strlen(p))
+    CHECK(SAFE("/index.html"));
+    CHECK(SAFE("/img/logo.png"));
+    CHECK(SAFE("/.well-known/x"));
+    CHECK(SAFE("/a..b/c"));
+    CHECK(!SAFE(""));
+    CHECK(!SAFE("/"));
+    CHECK(!SAFE("index.html"));
+    CHECK(!SAFE("/img/"));
+    CHECK(!SAFE("/img//logo.png"));
+    CHECK(!SAFE("/./index.html"));
+    CHECK(!SAFE("/img/../../etc"));
+    CHECK(!SAFE("/.."));
+    CHECK(!SAFE("/a\\b"));
+    CHECK(!SAFE("/c:/x"));
+    CHECK(!SAFE("/a\nb"));
+    CHECK(!SAFE("/a\x7f"));
+#undef SAFE
+    // Only len bytes count: the query string after them is not checked
+    CHECK(wifi_is_safe_file_path("/a.txt?../x", 6));
+    CHECK(!wifi_is_safe_file_path("/a.txt", 1));
+}
+
+static void test_json_writer(void) {
+    char buf[64];
+    wifi_json_t json;
+    wifi_json_init(&json, buf, sizeof(buf));
+    wifi_json_raw(&json, "{\"ssid\":");
+    wifi_json_str(&json, "a\"b\\c\n");
+    wifi_json_raw(&json, ",\"rssi\":");
+    wifi_json_int(&json, -67);
+    wifi_json_raw(&json, ",\"open\":");
+    wifi_json_bool(&json, false);
+    wifi_json_raw(&json, "}");
+    CHECK(!json.overflow);
+    CHECK_EQ_STR(buf, "{\"ssid\":\"a\\\"b\\\\c\\u000a\",\"rssi\":-67,\"open\":false}");
+
+    // Overflow sticks until truncated back to a known length
+    char small[8];
+    wifi_json_init(&json, small, sizeof(small));
+    wifi_json_raw(&json, "[1,");
+    size_t mark = json.len;
+    wifi_json_str(&json, "too long for it");
+    CHECK(json.overflow);
+    wifi_json_int(&json, 2);
+    CHECK(json.overflow);
+    wifi_json_truncate(&json, mark);
+    CHECK(!json.overflow);
+    wifi_json_int(&json, 2);
+    wifi_json_raw(&json, "]");
+    CHECK_EQ_STR(small, "[1,2]");
+}
+
+static size_t build_query(uint8_t *buf, uint16_t flags, const char *const *labels, size_t label_count) {
+    size_t len = 0;
+    const uint16_t header[6] = { htons(0xbeef), htons(flags), htons(1), 0, 0, 0 };
+    memcpy(buf, header, sizeof(header));
+    len = sizeof(header);
+    for (size_t i = 0; i < label_count; i++) {
+        size_t n = strlen(labels[i]);
+        buf[len++] = (uint8_t)n;
+        memcpy(buf + len, labels[i], n);
+        len += n;
+    }
+    buf[len++] = 0;
+    const uint16_t question[2] = { htons(1), htons(1) };   // A, IN
+    memcpy(buf + len, question, sizeof(question));
+    return len + sizeof(question);
+}
+
+static void test_dns_name(void) {
+    char raw[] = "\x03www\x07" "example\x03" "com\x00";
+    char name[64];
+    char *next = host_parse_dns_name(raw, raw + sizeof(raw) - 1, name, sizeof(name));
+    CHECK(next == raw + sizeof(raw) - 1);
+    CHECK_EQ_STR(name, "www.example.com");
+
+    // Root name, truncated packet, label past the end, compression pointer, name too long for the buffer
+    char root[] = "\x00";
+    CHECK(host_parse_dns_name(root, root + 1, name, sizeof(name)) == root + 1);
+    CHECK_EQ_STR(name, "");
+    CHECK(host_parse_dns_name(raw, raw + 5, name, sizeof(name)) == NULL);
+    char past[] = "\x09short";
+    CHECK(host_parse_dns_name(past, past + sizeof(past) - 1, name, sizeof(name)) == NULL);
+    char pointer[] = "\xc0\x0c";
+    CHECK(host_parse_dns_name(pointer, pointer + 2, name, sizeof(name)) == NULL);
+    CHECK(host_parse_dns_name(raw, raw + sizeof(raw) - 1, name, 8) == NULL);
+}
+
+static void test_dns_request(void) {
+    const uint32_t ap_ip = inet_addr("192.168.4.1");
+    dns_server_handle_t handle = host_dns_wildcard_handle(ap_ip);
+    static const char *const labels[] = { "connectivitycheck", "gstatic", "com" };
+    uint8_t query[128];
+    char reply[256];
+    size_t len = build_query(query, 0x0100, labels, 3);
+
+    int reply_len = host_parse_dns_request((char *)query, len, reply, sizeof(reply), handle, 0);
+    CHECK_EQ_INT(reply_len, len + 16);
+    uint16_t flags, an_count;
+    memcpy(&flags, reply + 2, 2);
+    memcpy(&an_count, reply + 6, 2);
+    CHECK_EQ_INT(ntohs(flags), 0x8100);
+    CHECK_EQ_INT(ntohs(an_count), 1);
+    uint32_t answer_ip;
+    memcpy(&answer_ip, reply + reply_len - 4, 4);
+    CHECK_EQ_INT(answer_ip, ap_ip);
+
+    // Responses are never answered, other opcodes are ignored
+    len = build_query(query, 0x8100, labels, 3);
+    CHECK_EQ_INT(host_parse_dns_request((char *)query, len, reply, sizeof(reply), handle, 0), 0);
+    len = build_query(query, 0x2800, labels, 3);
+    CHECK_EQ_INT(host_parse_dns_request((char *)query, len, reply, sizeof(reply), handle, 0), 0);
+
+    // Malformed: shorter than a header, question cut off
+    CHECK_EQ_INT(host_parse_dns_request((char *)query, 6, reply, sizeof(reply), handle, 0), -1);
+    len = build_query(query, 0x0100, labels, 3);
+    CHECK_EQ_INT(host_parse_dns_request((char *)query, len - 3, reply, sizeof(reply), handle, 0), -1);
+}
+
+int main(void) {
+    RUN_TEST(test_url_decode);
+    RUN_TEST(test_mime_types);
+    RUN_TEST(test_accept_encoding);
+    RUN_TEST(test_captive_probes);
+    RUN_TEST(test_safe_file_path);
+    RUN_TEST(test_json_writer);
+    RUN_TEST(test_dns_name);
+    RUN_TEST(test_dns_request);
+    UNIT_MAIN_END();
+}
@@ -0,0 +1,231 @@
+/**
+ * @file test_wifi_captive.c
+ * @brief wifi_init() without credentials: captive portal and its API, station table, task placement, scan, and saving networks from the form.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "Wifi.h"
+#include "fake_host.h"
+#include "host_support.h"
+#include "unit.h"
+
+UNIT_GLOBALS;
+
+static bool portal_up(void *ctx) {
+    // The AP starts before the HTTP server does
+    return host_ap_started(ctx) && wifi_get_http_server() != NULL;
+}
+
+static esp_err_t get(const char *uri, fake_httpd_response_t *resp) {
+    return fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, uri, NULL, NULL, 0, resp);
+}
+
+static esp_err_t post_form(const char *form, fake_httpd_response_t *resp) {
+    return fake_httpd_invoke(wifi_get_http_server(), HTTP_POST, "/captive",
+                             "Content-Type: application/x-www-form-urlencoded\r\n", form, strlen(form), resp);
+}
+
+static bool sta_failed_back_to_ap(void *ctx) {
+    fake_wifi_state_t state;
+    fake_wifi_get_state(&state);
+    return state.connect_calls >= *(int *)ctx && state.mode == WIFI_MODE_APSTA && state.started &&
+           wifi_get_http_server() != NULL;
+}
+
+static void test_portal_up(void) {
+    CHECK(host_wait_until(portal_up, NULL, 5000));
+    fake_wifi_state_t state;
+    fake_wifi_get_state(&state);
+    CHECK_EQ_INT(state.mode, WIFI_MODE_APSTA);
+    CHECK_EQ_INT(state.connect_calls, 0);
+
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(get("/captive", &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 200);
+    CHECK_EQ_STR(resp.content_type, "text/html; charset=utf-8");
+    fake_httpd_response_free(&resp);
+
+    // Probes of the operating systems are sent to the portal by the 404 handler, as a raw probe response
+    CHECK_EQ_INT(get("/generate_204", &resp), ESP_ERR_NOT_FOUND);
+    CHECK_EQ_STR(resp.body, "HTTP/1.1 302 Found\r\nLocation: /captive\r\nContent-Length: 0\r\n"
+                            "Cache-Control: no-store\r\nConnection: close\r\n\r\n");
+    fake_httpd_response_free(&resp);
+
+    // Other unknown URIs take the regular redirect
+    CHECK_EQ_INT(get("/favicon.ico", &resp), ESP_ERR_NOT_FOUND);
+    CHECK_EQ_INT(resp.status, 302);
+    CHECK(strstr(resp.headers, "Location: /captive\r\n") != NULL);
+    fake_httpd_response_free(&resp);
+}
+
+static void test_captive_api(void) {
+    // DHCP option 114 points softAP clients at the API, which points them at the portal
+    esp_netif_t *ap = esp_netif_get_handle_from_ifkey("WIFI_AP_DEF");
+    CHECK(ap != NULL);
+    if (ap == NULL) return;
+    esp_netif_ip_info_t ip_info;
+    esp_netif_get_ip_info(ap, &ip_info);
+    char expected[96];
+    char option[64];
+    snprintf(expected, sizeof(expected), "http://" IPSTR "/captive-api", IP2STR(&ip_info.ip));
+    CHECK_EQ_INT(esp_netif_dhcps_option(ap, ESP_NETIF_OP_GET, ESP_NETIF_CAPTIVEPORTAL_URI, option, sizeof(option)), ESP_OK);
+    CHECK_EQ_STR(option, expected);
+
+    wifi_captive_stats_t before;
+    wifi_get_captive_stats(&before);
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(get("/captive-api", &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 200);
+    CHECK_EQ_STR(resp.content_type, "application/captive+json");
+    snprintf(expected, sizeof(expected), "{\"captive\": true, \"user-portal-url\": \"http://" IPSTR "/captive\"}",
+             IP2STR(&ip_info.ip));
+    CHECK_EQ_STR(resp.body, expected);
+    fake_httpd_response_free(&resp);
+
+    // A probe is counted and redirected, the portal page too
+    CHECK_EQ_INT(get("/hotspot-detect.html", &resp), ESP_ERR_NOT_FOUND);
+    fake_httpd_response_free(&resp);
+    CHECK_EQ_INT(get("/captive", &resp), ESP_OK);
+    fake_httpd_response_free(&resp);
+    wifi_captive_stats_t after;
+    wifi_get_captive_stats(&after);
+    CHECK_EQ_INT(after.api_requests, before.api_requests + 1);
+    CHECK_EQ_INT(after.probe_requests, before.probe_requests + 1);
+    CHECK_EQ_INT(after.redirects, before.redirects + 1);
+    CHECK_EQ_INT(after.portal_pages, before.portal_pages + 1);
+}
+
+static bool station_has_ip(void *ctx) {
+    wifi_station_info_t stations[WIFI_STATIONS_MAX];
+    size_t count = wifi_get_stations(stations, WIFI_STATIONS_MAX);
+    for (size_t i = 0; i < count; i++) {
+        if (!memcmp(stations[i].mac, ctx, 6) && stations[i].ip != 0) return true;
+    }
+    return false;
+}
+
+static void test_stations(void) {
+    // The probes of the earlier tests came from the address the station is given now, they join the station's entry
+    static const uint8_t mac[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0x55 };
+    uint32_t ip = fake_wifi_station_join(mac);
+    CHECK_EQ_INT(ip, 0x0204a8c0);
+    CHECK(host_wait_until(station_has_ip, (void *)mac, 5000));
+
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(get("/stations.json", &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 200);
+    CHECK_EQ_STR(resp.content_type, "application/json");
+    CHECK(strncmp(resp.body, "{\"stations\": [{\"mac\": \"02:11:22:33:44:55\", \"ip\": \"192.168.4.2\", "
+                             "\"connected\": true, ", 80) == 0);
+    CHECK(strstr(resp.body, "\"rssi\": -50, \"os\": \"Apple\"") != NULL);
+    CHECK(strstr(resp.body, "\"probes\": 2, \"redirected\": true, \"portal_opened\": true") != NULL);
+    CHECK(strstr(resp.body, "\"mac\": \"00:00:00:00:00:00\"") == NULL);
+    fake_httpd_response_free(&resp);
+
+    // Leaving keeps the entry
+    fake_wifi_station_leave(mac);
+    vTaskDelay(pdMS_TO_TICKS(100));
+    wifi_station_info_t stations[WIFI_STATIONS_MAX];
+    CHECK_EQ_INT(wifi_get_stations(stations, WIFI_STATIONS_MAX), 1);
+    CHECK(!stations[0].connected);
+    CHECK_EQ_INT(stations[0].rssi, 0);
+}
+
+static void test_task_placement(void) {
+    // Set before wifi_init(), the tasks were created with it
+    int core, priority;
+    CHECK(fake_kernel_task_placement("dns_server", &core, &priority));
+    CHECK_EQ_INT(core, 1);
+    CHECK_EQ_INT(priority, 6);
+    CHECK(fake_kernel_task_placement("httpd", &core, &priority));
+    CHECK_EQ_INT(core, 0);
+    CHECK_EQ_INT(priority, 7);
+    CHECK(fake_kernel_task_placement("wifi_event_group_listener_task", &core, &priority));
+    CHECK_EQ_INT(core, tskNO_AFFINITY);
+    CHECK_EQ_INT(priority, CONFIG_WIFI_LISTENER_TASK_PRIORITY);
+    // The SD card monitor polls the empty slot with the worker placement
+    CHECK(fake_kernel_task_placement("wifi_sd_monitor", &core, &priority));
+    CHECK_EQ_INT(core, tskNO_AFFINITY);
+    CHECK_EQ_INT(priority, CONFIG_WIFI_WORKER_TASK_PRIORITY);
+
+    // The listener takes a new priority right away
+    CHECK_EQ_INT(wifi_set_task_placement(WIFI_TASK_LISTENER, WIFI_TASK_NO_AFFINITY, 3), ESP_OK);
+    CHECK(fake_kernel_task_placement("wifi_event_group_listener_task", NULL, &priority));
+    CHECK_EQ_INT(priority, 3);
+    CHECK_EQ_INT(wifi_get_task_placement(WIFI_TASK_LISTENER, &core, &priority), ESP_OK);
+    CHECK_EQ_INT(core, WIFI_TASK_NO_AFFINITY);
+    CHECK_EQ_INT(priority, 3);
+
+    CHECK_EQ_INT(wifi_set_task_placement(WIFI_TASK_COUNT, 0, 5), ESP_ERR_INVALID_ARG);
+    CHECK_EQ_INT(wifi_set_task_placement(WIFI_TASK_DNS, portNUM_PROCESSORS, 5), ESP_ERR_INVALID_ARG);
+    CHECK_EQ_INT(wifi_set_task_placement(WIFI_TASK_DNS, 0, 0), ESP_ERR_INVALID_ARG);
+    CHECK_EQ_INT(wifi_set_task_placement(WIFI_TASK_DNS, 0, configMAX_PRIORITIES), ESP_ERR_INVALID_ARG);
+}
+
+static void test_scan(void) {
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(get("/scan.json", &resp), ESP_OK);
+    CHECK_EQ_STR(resp.content_type, "application/json");
+    CHECK(strstr(resp.body, "\"ap_count\": 1") != NULL);
+    CHECK(strstr(resp.body, "\"ssid\": \"HomeNet\"") != NULL);
+    fake_httpd_response_free(&resp);
+}
+
+static void test_rejected_forms(void) {
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(post_form("wifi_mode=1&ssid=Corp&authmode=2&password=x", &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 400);
+    fake_httpd_response_free(&resp);
+
+    CHECK_EQ_INT(post_form("wifi_mode=1&ssid=Other&authmode=1&password=", &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 400);
+    fake_httpd_response_free(&resp);
+}
+
+static void test_wrong_password_returns_to_portal(void) {
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(post_form("wifi_mode=1&ssid=HomeNet&authmode=1&password=wrong%21", &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 302);
+    fake_httpd_response_free(&resp);
+
+    // Every attempt fails, after CONFIG_WIFI_MAX_RECONNECTS the portal is back
+    int attempts = CONFIG_WIFI_MAX_RECONNECTS;
+    CHECK(host_wait_until(sta_failed_back_to_ap, &attempts, 10000));
+    CHECK(!host_sta_connected(NULL));
+
+    CHECK_EQ_INT(get("/captive.json", &resp), ESP_OK);
+    CHECK(strstr(resp.body, "\"password\": \"wrong!\"") != NULL);
+    fake_httpd_response_free(&resp);
+}
+
+static void test_correct_password_connects(void) {
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(post_form("wifi_mode=1&ssid=HomeNet&authmode=1&password=secret123", &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 302);
+    fake_httpd_response_free(&resp);
+
+    CHECK(host_wait_until(host_sta_connected, NULL, 5000));
+    fake_wifi_state_t state;
+    fake_wifi_get_state(&state);
+    CHECK_EQ_INT(state.mode, WIFI_MODE_STA);
+    CHECK_EQ_STR(state.sta_ssid, "HomeNet");
+}
+
+int main(void) {
+    host_add_assets();
+    host_add_network("HomeNet", "secret123");
+    CHECK_EQ_INT(wifi_set_task_placement(WIFI_TASK_DNS, 1, 6), ESP_OK);
+    CHECK_EQ_INT(wifi_set_task_placement(WIFI_TASK_HTTPD, 0, 7), ESP_OK);
+    CHECK_EQ_INT(wifi_init(), ESP_OK);
+    RUN_TEST(test_portal_up);
+    RUN_TEST(test_captive_api);
+    RUN_TEST(test_stations);
+    RUN_TEST(test_task_placement);
+    RUN_TEST(test_scan);
+    RUN_TEST(test_rejected_forms);
+    RUN_TEST(test_wrong_password_returns_to_portal);
+    RUN_TEST(test_correct_password_connects);
+    UNIT_MAIN_END();
+}
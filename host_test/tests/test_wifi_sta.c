@@ -0,0 +1,227 @@
+/**
+ * @file test_wifi_sta.c
+ * @brief wifi_init() with saved credentials: connection, web server, LED, scan and custom handlers.
+ */
+
+#include <string.h>
+
+#include "Wifi.h"
+#include "fake_host.h"
+#include "wifi_arena.h"
+#include "host_support.h"
+#include "unit.h"
+
+UNIT_GLOBALS;
+
+/// BLINK_WIFI_CONNECTED in Wifi.c, started once the station has its address
+#define LED_WIFI_CONNECTED 4
+
+static bool led_connected(void *ctx) {
+    return fake_led_pattern(NULL) == LED_WIFI_CONNECTED;
+}
+
+static void test_connects(void) {
+    CHECK(host_wait_until(host_sta_connected, NULL, 5000));
+    CHECK(host_wait_until(led_connected, NULL, 5000));
+    fake_wifi_state_t state;
+    fake_wifi_get_state(&state);
+    CHECK_EQ_INT(state.mode, WIFI_MODE_STA);
+    CHECK_EQ_STR(state.sta_ssid, "HomeNet");
+    CHECK_EQ_INT(state.connect_calls, 1);
+    CHECK(wifi_get_http_server() != NULL);
+}
+
+static void test_status_json(void) {
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, "/wifi-status.json", NULL, NULL, 0, &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 200);
+    CHECK_EQ_STR(resp.content_type, "application/json");
+    const char *prefix = "{\"connected\": true, \"ip\": \"";
+    CHECK(strncmp(resp.body, prefix, strlen(prefix)) == 0);
+    CHECK(strstr(resp.body, "\"0.0.0.0\"") == NULL);
+    fake_httpd_response_free(&resp);
+}
+
+static void test_captive_api_outside_captive_mode(void) {
+    // For clients still holding a lease from the captive session
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, "/captive-api", NULL, NULL, 0, &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 200);
+    CHECK_EQ_STR(resp.content_type, "application/captive+json");
+    CHECK_EQ_STR(resp.body, "{\"captive\": false}");
+    fake_httpd_response_free(&resp);
+}
+
+static void test_probes(void) {
+    // First probe of a client opens the portal, later ones see internet access; all on closed connections
+    fake_httpd_set_invoke_peer(0x0304a8c0);     // 192.168.4.3
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, "/generate_204", NULL, NULL, 0, &resp), ESP_OK);
+    const char *redirect = "HTTP/1.1 302 Found\r\nLocation: http://";
+    CHECK(strncmp(resp.body, redirect, strlen(redirect)) == 0);
+    CHECK(strstr(resp.body, "\r\nConnection: close\r\n\r\n") != NULL);
+    fake_httpd_response_free(&resp);
+
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, "/generate_204", NULL, NULL, 0, &resp), ESP_OK);
+    CHECK_EQ_STR(resp.body, "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\nCache-Control: no-store\r\n"
+                            "Connection: close\r\n\r\n");
+    fake_httpd_response_free(&resp);
+
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, "/ncsi.txt", NULL, NULL, 0, &resp), ESP_OK);
+    const char *ncsi = "\r\n\r\nMicrosoft NCSI";
+    CHECK(resp.body_len > strlen(ncsi) && !strcmp(resp.body + resp.body_len - strlen(ncsi), ncsi));
+    fake_httpd_response_free(&resp);
+
+    // Each probe gets the exact success answer of its platform
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, "/hotspot-detect.html", NULL, NULL, 0, &resp), ESP_OK);
+    const char *apple = "\r\n\r\n<HTML><HEAD><TITLE>Success</TITLE></HEAD><BODY>Success</BODY></HTML>";
+    CHECK(resp.body_len > strlen(apple) && !strcmp(resp.body + resp.body_len - strlen(apple), apple));
+    fake_httpd_response_free(&resp);
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, "/connecttest.txt", NULL, NULL, 0, &resp), ESP_OK);
+    const char *connecttest = "\r\n\r\nMicrosoft Connect Test";
+    CHECK(resp.body_len > strlen(connecttest) && !strcmp(resp.body + resp.body_len - strlen(connecttest), connecttest));
+    fake_httpd_response_free(&resp);
+    fake_httpd_set_invoke_peer(0x0204a8c0);
+}
+
+static void test_assets(void) {
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, "/index.html", NULL, NULL, 0, &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 307);
+    CHECK(strstr(resp.headers, "Location: /\r\n") != NULL);
+    fake_httpd_response_free(&resp);
+
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, "/", NULL, NULL, 0, &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 200);
+    CHECK_EQ_STR(resp.content_type, "text/html");
+    CHECK(resp.body_len > 0);
+    CHECK(strstr(resp.headers, "Content-Encoding") == NULL);
+    CHECK(strstr(resp.headers, "Vary: Accept-Encoding\r\n") != NULL);
+    CHECK(strstr(resp.body, "<html") != NULL);
+    size_t plain_len = resp.body_len;
+    fake_httpd_response_free(&resp);
+
+    // The pre-compressed copy goes only to clients that accept gzip
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, "/", "Accept-Encoding: gzip, deflate\r\n",
+                                   NULL, 0, &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 200);
+    CHECK(strstr(resp.headers, "Content-Encoding: gzip\r\n") != NULL);
+    CHECK(resp.body_len > 2 && (uint8_t)resp.body[0] == 0x1f && (uint8_t)resp.body[1] == 0x8b);
+    fake_httpd_response_free(&resp);
+
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, "/", "Accept-Encoding: GZIP;q=0, *\r\n",
+                                   NULL, 0, &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 200);
+    CHECK(strstr(resp.headers, "Content-Encoding") == NULL);
+    CHECK_EQ_INT(resp.body_len, plain_len);
+    fake_httpd_response_free(&resp);
+
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, "/no-such-file.css", NULL, NULL, 0, &resp), ESP_FAIL);
+    CHECK_EQ_INT(resp.status, 404);
+    fake_httpd_response_free(&resp);
+}
+
+static void test_scan_json(void) {
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, "/scan.json", NULL, NULL, 0, &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 200);
+    CHECK(strstr(resp.body, "\"ap_count\": 2") != NULL);
+    CHECK(strstr(resp.body, "{\"ssid\": \"HomeNet\", \"rssi\": -45, \"authmode\": 1}") != NULL);
+    CHECK(strstr(resp.body, "{\"ssid\": \"Caf\\u00e9\"") == NULL);   // UTF-8 passes through unescaped
+    CHECK(strstr(resp.body, "Caf\xc3\xa9") != NULL);
+    fake_httpd_response_free(&resp);
+}
+
+static esp_err_t custom_handler(httpd_req_t *req) {
+    char *buf = wifi_arena_alloc(req, 32);
+    if (buf == NULL) return httpd_resp_send_500(req);
+    snprintf(buf, 32, "custom %d", *(int *)req->user_ctx);
+    return httpd_resp_sendstr(req, buf);
+}
+
+static int custom_ctx[CONFIG_WIFI_MAX_CUSTOM_HTTP_HANDLERS + 2];
+static char custom_uris[CONFIG_WIFI_MAX_CUSTOM_HTTP_HANDLERS + 2][16];
+
+/// Custom handlers are registered before wifi_init(), so they come before the wildcard
+static void add_custom_handlers(void) {
+    for (int i = 0; i < CONFIG_WIFI_MAX_CUSTOM_HTTP_HANDLERS + 2; i++) {
+        custom_ctx[i] = i;
+        snprintf(custom_uris[i], sizeof(custom_uris[i]), "/custom/%d", i);
+    }
+    for (int i = 0; i < CONFIG_WIFI_MAX_CUSTOM_HTTP_HANDLERS; i++) {
+        httpd_uri_t uri = { .uri = custom_uris[i], .method = HTTP_GET, .handler = custom_handler,
+                            .user_ctx = &custom_ctx[i] };
+        CHECK_EQ_INT(wifi_register_http_handler(&uri), ESP_OK);
+    }
+}
+
+static void test_custom_handlers(void) {
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_GET, "/custom/3", NULL, NULL, 0, &resp), ESP_OK);
+    CHECK_EQ_STR(resp.body, "custom 3");
+    fake_httpd_response_free(&resp);
+
+    // The server's URI table is full now, make room to reach the arena's limit
+    httpd_handle_t server = wifi_get_http_server();
+    CHECK_EQ_INT(httpd_unregister_uri_handler(server, "/custom/0", HTTP_GET), ESP_OK);
+    const int n = CONFIG_WIFI_MAX_CUSTOM_HTTP_HANDLERS;
+    httpd_uri_t spare = { .uri = custom_uris[n], .method = HTTP_GET, .handler = custom_handler,
+                          .user_ctx = &custom_ctx[n] };
+    CHECK_EQ_INT(wifi_arena_register_uri(server, &spare), ESP_OK);   // The entry of the other wildcard handler
+    CHECK_EQ_INT(httpd_unregister_uri_handler(server, custom_uris[n], HTTP_GET), ESP_OK);
+
+    // One more fails and is not registered without the arena
+    httpd_uri_t extra = { .uri = custom_uris[n + 1], .method = HTTP_GET, .handler = custom_handler,
+                          .user_ctx = &custom_ctx[n + 1] };
+    CHECK_EQ_INT(wifi_arena_register_uri(server, &extra), ESP_ERR_NO_MEM);
+    CHECK_EQ_INT(fake_httpd_invoke(server, HTTP_GET, custom_uris[n + 1], NULL, NULL, 0, &resp), ESP_FAIL);
+    CHECK_EQ_INT(resp.status, 404);
+    fake_httpd_response_free(&resp);
+
+    // Registering a wrapped handler again reuses its entry
+    httpd_uri_t again = { .uri = custom_uris[0], .method = HTTP_GET, .handler = custom_handler,
+                          .user_ctx = &custom_ctx[0] };
+    CHECK_EQ_INT(wifi_arena_register_uri(server, &again), ESP_OK);
+}
+
+static void test_upload_without_sd_card(void) {
+    // The upload route stays registered and answers 503 while there is no card
+    fake_httpd_response_t resp;
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_PUT, "/upload/index.html",
+                                   "Authorization: Bearer " CONFIG_WIFI_UPLOAD_TOKEN "\r\n", "<html>", 6, &resp),
+                 ESP_OK);
+    CHECK_EQ_INT(resp.status, 503);
+    fake_httpd_response_free(&resp);
+
+    // The token is checked first
+    CHECK_EQ_INT(fake_httpd_invoke(wifi_get_http_server(), HTTP_PUT, "/upload/index.html",
+                                   "Authorization: Bearer wrong\r\n", "<html>", 6, &resp), ESP_OK);
+    CHECK_EQ_INT(resp.status, 401);
+    fake_httpd_response_free(&resp);
+}
+
+static void test_led(void) {
+    // Scanning does not touch the LED, the connected pattern is still the one playing
+    int changes;
+    CHECK_EQ_INT(fake_led_pattern(&changes), LED_WIFI_CONNECTED);
+    CHECK(changes >= 2);
+}
+
+int main(void) {
+    host_add_assets();
+    host_add_network("HomeNet", "secret123");
+    host_add_network("Caf\xc3\xa9", "espresso");
+    host_preset_sta("HomeNet", "secret123");
+    add_custom_handlers();
+    CHECK_EQ_INT(wifi_init(), ESP_OK);
+    RUN_TEST(test_connects);
+    RUN_TEST(test_status_json);
+    RUN_TEST(test_captive_api_outside_captive_mode);
+    RUN_TEST(test_probes);
+    RUN_TEST(test_assets);
+    RUN_TEST(test_scan_json);
+    RUN_TEST(test_led);
+    RUN_TEST(test_upload_without_sd_card);
+    RUN_TEST(test_custom_handlers);
+    UNIT_MAIN_END();
+}
@@ -0,0 +1,306 @@
+/**
+ * @file test_ws_rx.c
+ * @brief WebSocket receive pool over loopback servers: class selection, fallback to larger classes, exhaustion, oversize.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "esp_http_server.h"
+#include "fake_host.h"
+#include "host_support.h"
+#include "unit.h"
+#include "wifi_arena.h"
+#include "wifi_ws_rx.h"
+
+UNIT_GLOBALS;
+
+/// Enough servers for one frame in every pool buffer at once, plus one
+#define SERVER_COUNT (CONFIG_WIFI_WS_RX_SMALL_COUNT + CONFIG_WIFI_WS_RX_MEDIUM_COUNT + CONFIG_WIFI_WS_RX_LARGE_COUNT + 1)
+
+/// Caller buffer of the /into handler, one byte is the NUL terminator
+#define INTO_BUF_SIZE 16
+
+static httpd_handle_t servers[SERVER_COUNT];
+static uint16_t ports[SERVER_COUNT];
+
+/// Callbacks of frames starting with 'h' hold their buffer until released
+static volatile int held;
+static volatile bool release;
+
+#pragma region Server
+
+/// Echo the frame back; the payload must be NUL-terminated
+static esp_err_t echo_frame(httpd_req_t *req, httpd_ws_frame_t *frame, void *ctx) {
+    if (frame->type != HTTPD_WS_TYPE_TEXT && frame->type != HTTPD_WS_TYPE_BINARY) return ESP_OK;
+    if (frame->payload != NULL && frame->payload[frame->len] != '\0') return ESP_FAIL;
+    if (frame->len > 0 && frame->payload[0] == 'h') {
+        held++;
+        while (!release) vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    return httpd_ws_send_frame(req, frame);
+}
+
+static esp_err_t pool_handler(httpd_req_t *req) {
+    if (req->method == HTTP_GET) return ESP_OK;     // Upgrade
+    return wifi_ws_recv(req, echo_frame, NULL);
+}
+
+static esp_err_t into_handler(httpd_req_t *req) {
+    if (req->method == HTTP_GET) return ESP_OK;
+    uint8_t buf[INTO_BUF_SIZE];
+    return wifi_ws_recv_into(req, buf, sizeof(buf), echo_frame, NULL);
+}
+
+static void start_servers(void) {
+    const httpd_uri_t handlers[] = {
+        { .uri = "/pool", .method = HTTP_GET, .handler = pool_handler, .is_websocket = true },
+        { .uri = "/into", .method = HTTP_GET, .handler = into_handler, .is_websocket = true },
+    };
+    fake_httpd_set_port(0);
+    for (int s = 0; s < SERVER_COUNT; s++) {
+        httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+        CHECK_EQ_INT(httpd_start(&servers[s], &config), ESP_OK);
+        ports[s] = fake_httpd_bound_port();
+        for (size_t i = 0; i < sizeof(handlers) / sizeof(handlers[0]); i++) {
+            CHECK_EQ_INT(wifi_arena_register_uri(servers[s], &handlers[i]), ESP_OK);
+        }
+    }
+}
+
+#pragma endregion
+
+#pragma region Client
+
+/// Connect to a server and upgrade to a WebSocket on uri
+static int client_connect(uint16_t port, const char *uri) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    struct timeval timeout = { .tv_sec = 5 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    char upgrade[256];
+    int len = snprintf(upgrade, sizeof(upgrade),
+                       "GET %s HTTP/1.1\r\nHost: test\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                       "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n", uri);
+    send(fd, upgrade, len, MSG_NOSIGNAL);
+    char headers[512];
+    size_t got = 0;
+    while (got < 4 || memcmp(headers + got - 4, "\r\n\r\n", 4) != 0) {
+        if (got + 1 >= sizeof(headers) || recv(fd, headers + got, 1, 0) != 1) {
+            close(fd);
+            return -1;
+        }
+        got++;
+    }
+    if (strncmp(headers, "HTTP/1.1 101 ", 13) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/// Send a masked binary frame of len bytes, the first one lead and the rest a pattern
+static void client_send_frame(int fd, char lead, size_t len) {
+    static uint8_t frame[4 + 4 + 2048];
+    static const uint8_t mask[4] = { 0x5a, 0xa5, 0x3c, 0xc3 };
+    size_t head = 2;
+    frame[0] = 0x82;
+    if (len < 126) {
+        frame[1] = 0x80 | (uint8_t)len;
+    } else {
+        frame[1] = 0x80 | 126;
+        frame[2] = (uint8_t)(len >> 8);
+        frame[3] = (uint8_t)len;
+        head = 4;
+    }
+    memcpy(frame + head, mask, 4);
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = i == 0 ? (uint8_t)lead : (uint8_t)('a' + i % 26);
+        frame[head + 4 + i] = c ^ mask[i % 4];
+    }
+    CHECK_EQ_INT(send(fd, frame, head + 4 + len, MSG_NOSIGNAL), head + 4 + len);
+}
+
+static bool recv_all(int fd, uint8_t *buf, size_t len) {
+    for (size_t got = 0; got < len;) {
+        ssize_t ret = recv(fd, buf + got, len - got, 0);
+        if (ret <= 0) return false;
+        got += (size_t)ret;
+    }
+    return true;
+}
+
+/// Whether the next frame is the echo of what client_send_frame() sent
+static bool client_echoed(int fd, char lead, size_t len) {
+    uint8_t head[4];
+    if (!recv_all(fd, head, 2) || head[0] != 0x82) return false;
+    size_t got_len = head[1] & 0x7f;
+    if (got_len == 126) {
+        if (!recv_all(fd, head + 2, 2)) return false;
+        got_len = (size_t)head[2] << 8 | head[3];
+    }
+    if (got_len != len) return false;
+    static uint8_t payload[2048];
+    if (!recv_all(fd, payload, len)) return false;
+    for (size_t i = 0; i < len; i++) {
+        if (payload[i] != (i == 0 ? (uint8_t)lead : (uint8_t)('a' + i % 26))) return false;
+    }
+    return true;
+}
+
+/// Whether the server closed the connection, waiting at most the socket timeout
+static bool client_closed(int fd) {
+    char c;
+    return recv(fd, &c, 1, 0) <= 0;
+}
+
+#pragma endregion
+
+static bool held_at_least(void *ctx) {
+    return held >= *(int *)ctx;
+}
+
+static void test_class_selection(void) {
+    wifi_ws_rx_stats_t start, before, after;
+    wifi_ws_rx_get_stats(&start);
+    CHECK_EQ_INT(start.class_size[0], CONFIG_WIFI_WS_RX_SMALL_SIZE);
+    CHECK_EQ_INT(start.class_size[1], CONFIG_WIFI_WS_RX_MEDIUM_SIZE);
+    CHECK_EQ_INT(start.class_size[2], CONFIG_WIFI_WS_RX_LARGE_SIZE);
+
+    // The smallest class a payload fits, up to its exact size
+    static const struct {
+        size_t len;
+        int cls;
+    } frames[] = {
+        { 1, 0 },
+        { CONFIG_WIFI_WS_RX_SMALL_SIZE, 0 },
+        { CONFIG_WIFI_WS_RX_SMALL_SIZE + 1, 1 },
+        { CONFIG_WIFI_WS_RX_MEDIUM_SIZE, 1 },
+        { CONFIG_WIFI_WS_RX_MEDIUM_SIZE + 1, 2 },
+        { CONFIG_WIFI_WS_RX_LARGE_SIZE, 2 },
+    };
+    int fd = client_connect(ports[0], "/pool");
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+        wifi_ws_rx_get_stats(&before);
+        client_send_frame(fd, 'x', frames[i].len);
+        CHECK(client_echoed(fd, 'x', frames[i].len));
+        wifi_ws_rx_get_stats(&after);
+        for (int c = 0; c < WIFI_WS_RX_CLASS_COUNT; c++) {
+            CHECK_EQ_INT(after.class_hits[c], before.class_hits[c] + (c == frames[i].cls));
+        }
+        bytes += frames[i].len;
+    }
+
+    // Empty frames take no buffer
+    wifi_ws_rx_get_stats(&before);
+    client_send_frame(fd, 'x', 0);
+    CHECK(client_echoed(fd, 'x', 0));
+    wifi_ws_rx_get_stats(&after);
+    CHECK(memcmp(after.class_hits, before.class_hits, sizeof(after.class_hits)) == 0);
+    CHECK_EQ_INT(after.frames, start.frames + sizeof(frames) / sizeof(frames[0]));
+    CHECK_EQ_INT(after.bytes, start.bytes + bytes);
+    for (int c = 0; c < WIFI_WS_RX_CLASS_COUNT; c++) CHECK_EQ_INT(after.class_high_water[c], 1);
+    close(fd);
+}
+
+static void test_oversize(void) {
+    wifi_ws_rx_stats_t before, after;
+    wifi_ws_rx_get_stats(&before);
+
+    // Larger than the largest class: rejected and the connection closed
+    int fd = client_connect(ports[0], "/pool");
+    CHECK(fd >= 0);
+    client_send_frame(fd, 'x', CONFIG_WIFI_WS_RX_LARGE_SIZE + 1);
+    CHECK(client_closed(fd));
+    close(fd);
+    wifi_ws_rx_get_stats(&after);
+    CHECK_EQ_INT(after.oversize, before.oversize + 1);
+    CHECK_EQ_INT(after.exhausted, before.exhausted);
+    CHECK_EQ_INT(after.frames, before.frames);
+
+    // A caller buffer keeps one byte for the terminator
+    fd = client_connect(ports[0], "/into");
+    CHECK(fd >= 0);
+    client_send_frame(fd, 'x', INTO_BUF_SIZE - 1);
+    CHECK(client_echoed(fd, 'x', INTO_BUF_SIZE - 1));
+    client_send_frame(fd, 'x', INTO_BUF_SIZE);
+    CHECK(client_closed(fd));
+    close(fd);
+    wifi_ws_rx_get_stats(&before);
+    CHECK_EQ_INT(before.oversize, after.oversize + 1);
+    CHECK_EQ_INT(before.frames, after.frames + 1);
+    CHECK(memcmp(after.class_hits, before.class_hits, sizeof(after.class_hits)) == 0);
+}
+
+static void test_exhaustion(void) {
+    wifi_ws_rx_stats_t before, after;
+    wifi_ws_rx_get_stats(&before);
+    held = 0;
+    release = false;
+
+    // Small frames held on one server each: the small buffers first, then the larger classes
+    int fds[SERVER_COUNT];
+    for (int s = 0; s < SERVER_COUNT - 1; s++) {
+        fds[s] = client_connect(ports[s], "/pool");
+        CHECK(fds[s] >= 0);
+        client_send_frame(fds[s], 'h', 8);
+        int want = s + 1;
+        CHECK(host_wait_until(held_at_least, &want, 2000));
+    }
+    wifi_ws_rx_get_stats(&after);
+    CHECK_EQ_INT(after.class_hits[0], before.class_hits[0] + CONFIG_WIFI_WS_RX_SMALL_COUNT);
+    CHECK_EQ_INT(after.class_hits[1], before.class_hits[1] + CONFIG_WIFI_WS_RX_MEDIUM_COUNT);
+    CHECK_EQ_INT(after.class_hits[2], before.class_hits[2] + CONFIG_WIFI_WS_RX_LARGE_COUNT);
+    CHECK_EQ_INT(after.class_high_water[0], CONFIG_WIFI_WS_RX_SMALL_COUNT);
+    CHECK_EQ_INT(after.class_high_water[1], CONFIG_WIFI_WS_RX_MEDIUM_COUNT);
+    CHECK_EQ_INT(after.class_high_water[2], CONFIG_WIFI_WS_RX_LARGE_COUNT);
+
+    // Every buffer is busy: the next frame is refused and its connection closed
+    int last = SERVER_COUNT - 1;
+    fds[last] = client_connect(ports[last], "/pool");
+    CHECK(fds[last] >= 0);
+    client_send_frame(fds[last], 'x', 8);
+    CHECK(client_closed(fds[last]));
+    close(fds[last]);
+    wifi_ws_rx_get_stats(&after);
+    CHECK_EQ_INT(after.exhausted, before.exhausted + 1);
+    CHECK_EQ_INT(after.oversize, before.oversize);
+
+    // The held frames complete intact, and their buffers are free again
+    release = true;
+    for (int s = 0; s < SERVER_COUNT - 1; s++) {
+        CHECK(client_echoed(fds[s], 'h', 8));
+        client_send_frame(fds[s], 'x', 8);
+        CHECK(client_echoed(fds[s], 'x', 8));
+        close(fds[s]);
+    }
+    wifi_ws_rx_get_stats(&before);
+    CHECK_EQ_INT(before.class_hits[0], after.class_hits[0] + SERVER_COUNT - 1);
+    CHECK_EQ_INT(before.exhausted, after.exhausted);
+}
+
+int main(void) {
+    start_servers();
+    RUN_TEST(test_class_selection);
+    RUN_TEST(test_oversize);
+    RUN_TEST(test_exhaustion);
+    for (int s = 0; s < SERVER_COUNT; s++) CHECK_EQ_INT(httpd_stop(servers[s]), ESP_OK);
+    UNIT_MAIN_END();
+}
@@ -0,0 +1,381 @@
+/**
+ * @file test_ws_sync.c
+ * @brief WebSocket value sync: varint codec, coalesced delta frames, keyframes on resync, frames from clients.
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "Wifi.h"
+#include "fake_host.h"
+#include "host_support.h"
+#include "unit.h"
+#include "wifi_ws_rx.h"
+#include "wifi_ws_sync.h"
+
+UNIT_GLOBALS;
+
+/// Values decoded by the server from client frames
+static wifi_ws_sync_value_t received[8];
+static volatile int received_count;
+
+static void sync_value_cb(const wifi_ws_sync_value_t *value, void *ctx) {
+    if (received_count < (int)(sizeof(received) / sizeof(received[0]))) received[received_count] = *value;
+    received_count++;
+}
+
+static esp_err_t ws_sync_frame_cb(httpd_req_t *req, httpd_ws_frame_t *frame, void *ctx) {
+    if (frame->type != HTTPD_WS_TYPE_BINARY) return ESP_OK;
+    return wifi_ws_sync_decode(frame->payload, frame->len, sync_value_cb, NULL);
+}
+
+static esp_err_t ws_sync_handler(httpd_req_t *req) {
+    if (req->method == HTTP_GET) return ESP_OK;     // Upgrade
+    return wifi_ws_recv(req, ws_sync_frame_cb, NULL);
+}
+
+#pragma region Client
+
+static int client_connect(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(fake_httpd_bound_port()),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    struct timeval timeout = { .tv_sec = 5 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    const char *upgrade = "GET /sync HTTP/1.1\r\nHost: test\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                          "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n";
+    send(fd, upgrade, strlen(upgrade), MSG_NOSIGNAL);
+    char headers[512];
+    size_t len = 0;
+    while (len < 4 || memcmp(headers + len - 4, "\r\n\r\n", 4) != 0) {
+        if (len + 1 >= sizeof(headers) || recv(fd, headers + len, 1, 0) != 1) {
+            close(fd);
+            return -1;
+        }
+        len++;
+    }
+    if (strncmp(headers, "HTTP/1.1 101 ", 13) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/// Send a masked binary frame, as browsers do
+static void client_send_frame(int fd, const uint8_t *payload, size_t len) {
+    uint8_t frame[2 + 4 + 125] = { 0x82, 0x80 | (uint8_t)len, 0x5a, 0xa5, 0x3c, 0xc3 };
+    for (size_t i = 0; i < len; i++) frame[6 + i] = payload[i] ^ frame[2 + i % 4];
+    CHECK_EQ_INT(send(fd, frame, 6 + len, MSG_NOSIGNAL), 6 + len);
+}
+
+static bool recv_all(int fd, uint8_t *buf, size_t len) {
+    for (size_t got = 0; got < len;) {
+        ssize_t ret = recv(fd, buf + got, len - got, 0);
+        if (ret <= 0) return false;
+        got += (size_t)ret;
+    }
+    return true;
+}
+
+/**
+ * @brief Receive the next server frame, which is never masked.
+ *
+ * @return payload length, -1 if no binary frame arrived within timeout_ms
+ */
+static int client_recv_frame(int fd, uint8_t *payload, size_t size, int timeout_ms) {
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    if (poll(&pfd, 1, timeout_ms) != 1) return -1;
+    uint8_t head[4];
+    if (!recv_all(fd, head, 2) || head[0] != 0x82) return -1;
+    size_t len = head[1] & 0x7f;
+    if (len == 126) {
+        if (!recv_all(fd, head + 2, 2)) return -1;
+        len = (size_t)head[2] << 8 | head[3];
+    }
+    if (len > size || !recv_all(fd, payload, len)) return -1;
+    return (int)len;
+}
+
+#pragma endregion
+
+#pragma region Decoding
+
+/// Latest value per key as a dashboard sees it, with deltas applied
+typedef struct {
+    bool known[256];
+    int32_t i[256];
+    float f[256];
+} dashboard_t;
+
+/// Header and entries of the last frame applied
+typedef struct {
+    uint16_t seq;
+    uint8_t count;
+    uint8_t flags;
+    uint8_t keys[CONFIG_WIFI_WS_SYNC_MAX_KEYS];
+} frame_info_t;
+
+/// Zigzag LEB128 decoding the way ws.js does it, independent of the component
+static size_t varint(const uint8_t *in, int32_t *value) {
+    uint32_t zz = 0;
+    size_t n = 0;
+    do {
+        zz |= (uint32_t)(in[n] & 0x7f) << (7 * n);
+    } while (in[n++] & 0x80);
+    *value = (int32_t)(zz >> 1) ^ -(int32_t)(zz & 1);
+    return n;
+}
+
+/// Receive a frame and apply it to the dashboard
+static bool apply_frame(int fd, dashboard_t *dash, frame_info_t *info) {
+    uint8_t frame[256];
+    int len = client_recv_frame(fd, frame, sizeof(frame), 1000);
+    if (len < WIFI_WS_SYNC_HEADER_LEN || frame[0] != WIFI_WS_SYNC_MAGIC || frame[1] != WIFI_WS_SYNC_VERSION) {
+        return false;
+    }
+    info->seq = (uint16_t)(frame[2] | frame[3] << 8);
+    info->count = frame[4];
+    info->flags = frame[5];
+    size_t pos = WIFI_WS_SYNC_HEADER_LEN;
+    for (int i = 0; i < info->count; i++) {
+        uint8_t key = frame[pos++];
+        uint8_t type = frame[pos++];
+        info->keys[i] = key;
+        if (type == WIFI_WS_SYNC_TYPE_INT) {
+            int32_t v;
+            pos += varint(frame + pos, &v);
+            dash->i[key] = (info->flags & WIFI_WS_SYNC_FLAG_DELTA) ? (int32_t)((uint32_t)dash->i[key] + (uint32_t)v) : v;
+        } else {
+            memcpy(&dash->f[key], frame + pos, sizeof(float));
+            pos += sizeof(float);
+        }
+        dash->known[key] = true;
+    }
+    return pos == (size_t)len;
+}
+
+#pragma endregion
+
+static void test_varint_decode(void) {
+    // Zigzag boundaries: each width of the encoding and both ends of the range
+    static const struct {
+        uint8_t bytes[5];
+        size_t len;
+        int32_t value;
+    } cases[] = {
+        { { 0x00 }, 1, 0 },
+        { { 0x01 }, 1, -1 },
+        { { 0x02 }, 1, 1 },
+        { { 0x7e }, 1, 63 },
+        { { 0x7f }, 1, -64 },
+        { { 0x80, 0x01 }, 2, 64 },
+        { { 0xff, 0x7f }, 2, -8192 },
+        { { 0x80, 0x80, 0x01 }, 3, 8192 },
+        { { 0xfe, 0xff, 0xff, 0xff, 0x0f }, 5, INT32_MAX },
+        { { 0xff, 0xff, 0xff, 0xff, 0x0f }, 5, INT32_MIN },
+    };
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        uint8_t frame[WIFI_WS_SYNC_HEADER_LEN + 2 + 5] = { WIFI_WS_SYNC_MAGIC, WIFI_WS_SYNC_VERSION, 0, 0, 1, 0,
+                                                           (uint8_t)c, WIFI_WS_SYNC_TYPE_INT };
+        memcpy(frame + WIFI_WS_SYNC_HEADER_LEN + 2, cases[c].bytes, cases[c].len);
+        received_count = 0;
+        CHECK_EQ_INT(wifi_ws_sync_decode(frame, WIFI_WS_SYNC_HEADER_LEN + 2 + cases[c].len, sync_value_cb, NULL),
+                     ESP_OK);
+        CHECK_EQ_INT(received_count, 1);
+        CHECK_EQ_INT(received[0].key, c);
+        CHECK_EQ_INT(received[0].i, cases[c].value);
+    }
+
+    // Several entries, an int and a float
+    float f = -2.5f;
+    uint8_t frame[32] = { WIFI_WS_SYNC_MAGIC, WIFI_WS_SYNC_VERSION, 0x34, 0x12, 2, 0,
+                          9, WIFI_WS_SYNC_TYPE_INT, 0x80, 0x01,
+                          10, WIFI_WS_SYNC_TYPE_FLOAT };
+    memcpy(frame + 12, &f, sizeof(f));
+    received_count = 0;
+    CHECK_EQ_INT(wifi_ws_sync_decode(frame, 16, sync_value_cb, NULL), ESP_OK);
+    CHECK_EQ_INT(received_count, 2);
+    CHECK_EQ_INT(received[0].i, 64);
+    CHECK_EQ_INT(received[1].type, WIFI_WS_SYNC_TYPE_FLOAT);
+    CHECK(received[1].f == -2.5f);
+}
+
+static void test_malformed(void) {
+    uint8_t frame[16] = { WIFI_WS_SYNC_MAGIC, WIFI_WS_SYNC_VERSION, 0, 0, 1, 0, 1, WIFI_WS_SYNC_TYPE_INT, 0x80 };
+    received_count = 0;
+    // Varint cut off by the end of the frame
+    CHECK_EQ_INT(wifi_ws_sync_decode(frame, 9, sync_value_cb, NULL), ESP_ERR_INVALID_SIZE);
+    // Longer than five bytes
+    memset(frame + 8, 0x80, 5);
+    frame[13] = 0x01;
+    CHECK_EQ_INT(wifi_ws_sync_decode(frame, 14, sync_value_cb, NULL), ESP_ERR_INVALID_SIZE);
+    // More entries announced than present
+    frame[4] = 2;
+    frame[8] = 0x02;
+    CHECK_EQ_INT(wifi_ws_sync_decode(frame, 9, sync_value_cb, NULL), ESP_ERR_INVALID_SIZE);
+    CHECK_EQ_INT(received_count, 1);    // The complete first entry was delivered
+    // Truncated float, unknown type
+    frame[4] = 1;
+    frame[7] = WIFI_WS_SYNC_TYPE_FLOAT;
+    CHECK_EQ_INT(wifi_ws_sync_decode(frame, 11, sync_value_cb, NULL), ESP_ERR_INVALID_SIZE);
+    frame[7] = 7;
+    CHECK_EQ_INT(wifi_ws_sync_decode(frame, 16, sync_value_cb, NULL), ESP_ERR_INVALID_SIZE);
+    // Deltas from clients, other versions, short headers
+    frame[5] = WIFI_WS_SYNC_FLAG_DELTA;
+    CHECK_EQ_INT(wifi_ws_sync_decode(frame, 16, sync_value_cb, NULL), ESP_ERR_NOT_SUPPORTED);
+    frame[1] = WIFI_WS_SYNC_VERSION + 1;
+    CHECK_EQ_INT(wifi_ws_sync_decode(frame, 16, sync_value_cb, NULL), ESP_ERR_INVALID_VERSION);
+    frame[1] = WIFI_WS_SYNC_VERSION;
+    CHECK_EQ_INT(wifi_ws_sync_decode(frame, WIFI_WS_SYNC_HEADER_LEN - 1, sync_value_cb, NULL),
+                 ESP_ERR_INVALID_VERSION);
+    CHECK_EQ_INT(received_count, 1);
+}
+
+static void test_delta_frames(void) {
+    int fd = client_connect();
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+    dashboard_t dash = { 0 };
+    frame_info_t info;
+
+    // The first frame is a keyframe with absolute values
+    CHECK_EQ_INT(wifi_ws_sync_set_int(1, 100000), ESP_OK);
+    CHECK_EQ_INT(wifi_ws_sync_set_float(2, 1.5f), ESP_OK);
+    CHECK_EQ_INT(wifi_ws_sync_set_int(3, -7), ESP_OK);
+    CHECK(apply_frame(fd, &dash, &info));
+    CHECK_EQ_INT(info.flags, 0);
+    CHECK_EQ_INT(info.count, 3);
+    CHECK_EQ_INT(dash.i[1], 100000);
+    CHECK(dash.f[2] == 1.5f);
+    CHECK_EQ_INT(dash.i[3], -7);
+    uint16_t seq = info.seq;
+
+    // Changes within a tick coalesce into one delta entry per key; unchanged keys are left out
+    CHECK_EQ_INT(wifi_ws_sync_set_int(1, 100001), ESP_OK);
+    CHECK_EQ_INT(wifi_ws_sync_set_int(1, 99990), ESP_OK);
+    CHECK_EQ_INT(wifi_ws_sync_set_float(2, 1.5f), ESP_OK);
+    CHECK_EQ_INT(wifi_ws_sync_set_int(3, INT32_MIN), ESP_OK);
+    CHECK(apply_frame(fd, &dash, &info));
+    CHECK_EQ_INT(info.flags, WIFI_WS_SYNC_FLAG_DELTA);
+    CHECK_EQ_INT(info.seq, (uint16_t)(seq + 1));
+    CHECK_EQ_INT(info.count, 2);
+    CHECK_EQ_INT(info.keys[0], 1);
+    CHECK_EQ_INT(info.keys[1], 3);
+    CHECK_EQ_INT(dash.i[1], 99990);
+    CHECK_EQ_INT(dash.i[3], INT32_MIN);
+
+    // A delta across the int32 range wraps, and the dashboard still ends on the value
+    CHECK_EQ_INT(wifi_ws_sync_set_int(3, INT32_MAX), ESP_OK);
+    CHECK(apply_frame(fd, &dash, &info));
+    CHECK_EQ_INT(info.seq, (uint16_t)(seq + 2));
+    CHECK_EQ_INT(dash.i[3], INT32_MAX);
+
+    // Setting the same values again sends nothing
+    CHECK_EQ_INT(wifi_ws_sync_set_int(1, 99990), ESP_OK);
+    CHECK_EQ_INT(wifi_ws_sync_set_float(2, 1.5f), ESP_OK);
+    uint8_t frame[64];
+    CHECK_EQ_INT(client_recv_frame(fd, frame, sizeof(frame), 4 * CONFIG_WIFI_WS_SYNC_TICK_MS), -1);
+
+    // Types are fixed per key
+    CHECK_EQ_INT(wifi_ws_sync_set_float(1, 2.0f), ESP_ERR_INVALID_ARG);
+    CHECK_EQ_INT(wifi_ws_sync_set_int(2, 2), ESP_ERR_INVALID_ARG);
+    close(fd);
+}
+
+static void test_resync(void) {
+    int fd = client_connect();
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+
+    // A late client knows nothing; its resync request brings every value, absolute
+    static const uint8_t resync[] = { WIFI_WS_SYNC_MAGIC, WIFI_WS_SYNC_VERSION, 0, 0, 0, WIFI_WS_SYNC_FLAG_RESYNC };
+    client_send_frame(fd, resync, sizeof(resync));
+    dashboard_t dash = { 0 };
+    frame_info_t info;
+    CHECK(apply_frame(fd, &dash, &info));
+    CHECK_EQ_INT(info.flags, 0);
+    CHECK_EQ_INT(info.count, 3);
+    CHECK_EQ_INT(dash.i[1], 99990);
+    CHECK(dash.f[2] == 1.5f);
+    CHECK_EQ_INT(dash.i[3], INT32_MAX);
+
+    // Deltas continue from the keyframe
+    CHECK_EQ_INT(wifi_ws_sync_set_int(1, 5), ESP_OK);
+    CHECK(apply_frame(fd, &dash, &info));
+    CHECK_EQ_INT(info.flags, WIFI_WS_SYNC_FLAG_DELTA);
+    CHECK_EQ_INT(dash.i[1], 5);
+    close(fd);
+}
+
+static void test_client_values(void) {
+    int fd = client_connect();
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+
+    // A client sets values with absolute entries
+    float f = 0.25f;
+    uint8_t frame[16] = { WIFI_WS_SYNC_MAGIC, WIFI_WS_SYNC_VERSION, 1, 0, 2, 0,
+                          20, WIFI_WS_SYNC_TYPE_INT, 0xe3, 0x0f,
+                          21, WIFI_WS_SYNC_TYPE_FLOAT };
+    memcpy(frame + 12, &f, sizeof(f));
+    received_count = 0;
+    client_send_frame(fd, frame, sizeof(frame));
+    for (int i = 0; i < 100 && received_count < 2; i++) vTaskDelay(pdMS_TO_TICKS(10));
+    CHECK_EQ_INT(received_count, 2);
+    CHECK_EQ_INT(received[0].key, 20);
+    CHECK_EQ_INT(received[0].i, -1010);
+    CHECK_EQ_INT(received[1].key, 21);
+    CHECK(received[1].f == 0.25f);
+
+    // No resync flag, no keyframe
+    uint8_t reply[64];
+    CHECK_EQ_INT(client_recv_frame(fd, reply, sizeof(reply), 4 * CONFIG_WIFI_WS_SYNC_TICK_MS), -1);
+    close(fd);
+}
+
+static void test_key_limit(void) {
+    // Keys 1 to 3 are in use; the table holds CONFIG_WIFI_WS_SYNC_MAX_KEYS
+    for (int key = 100; key < 100 + CONFIG_WIFI_WS_SYNC_MAX_KEYS - 3; key++) {
+        CHECK_EQ_INT(wifi_ws_sync_set_int((uint8_t)key, key), ESP_OK);
+    }
+    CHECK_EQ_INT(wifi_ws_sync_set_int(200, 1), ESP_ERR_NO_MEM);
+    CHECK_EQ_INT(wifi_ws_sync_set_int(1, 6), ESP_OK);
+}
+
+static bool server_up(void *ctx) {
+    return fake_httpd_bound_port() != 0;
+}
+
+int main(void) {
+    host_add_assets();
+    host_add_network("HomeNet", "secret123");
+    host_preset_sta("HomeNet", "secret123");
+    // Before wifi_init(), so the wildcard handler does not shadow it
+    httpd_uri_t sync = { .uri = "/sync", .method = HTTP_GET, .handler = ws_sync_handler, .is_websocket = true };
+    CHECK_EQ_INT(wifi_register_http_handler(&sync), ESP_OK);
+    fake_httpd_set_port(0);
+    CHECK_EQ_INT(wifi_init(), ESP_OK);
+    CHECK(host_wait_until(host_sta_connected, NULL, 5000));
+    CHECK(host_wait_until(server_up, NULL, 5000));
+    RUN_TEST(test_varint_decode);
+    RUN_TEST(test_malformed);
+    RUN_TEST(test_delta_frames);
+    RUN_TEST(test_resync);
+    RUN_TEST(test_client_values);
+    RUN_TEST(test_key_limit);
+    UNIT_MAIN_END();
+}
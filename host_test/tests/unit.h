@@ -0,0 +1,55 @@
+/**
+ * @file unit.h
+ * @brief Minimal test runner for the host tests: one executable per suite.
+ *
+ * Each check prints the failing expression with its location and marks the
+ * running test failed; the test continues so one run reports every failure.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+
+extern int unit_failures;
+extern int unit_test_failed;
+
+#define CHECK(cond)                                                                     \
+    do {                                                                                \
+        if (!(cond)) {                                                                  \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);    \
+            unit_test_failed = 1;                                                       \
+        }                                                                               \
+    } while (0)
+
+#define CHECK_EQ_INT(actual, expected)                                                  \
+    do {                                                                                \
+        long long unit_a = (long long)(actual), unit_e = (long long)(expected);         \
+        if (unit_a != unit_e) {                                                         \
+            fprintf(stderr, "%s:%d: %s == %lld, expected %lld\n", __FILE__, __LINE__,   \
+                    #actual, unit_a, unit_e);                                           \
+            unit_test_failed = 1;                                                       \
+        }                                                                               \
+    } while (0)
+
+#define CHECK_EQ_STR(actual, expected)                                                  \
+    do {                                                                                \
+        const char *unit_a = (actual), *unit_e = (expected);                            \
+        if (!unit_a || strcmp(unit_a, unit_e) != 0) {                                   \
+            fprintf(stderr, "%s:%d: %s == \"%s\", expected \"%s\"\n", __FILE__,         \
+                    __LINE__, #actual, unit_a ? unit_a : "(null)", unit_e);             \
+            unit_test_failed = 1;                                                       \
+        }                                                                               \
+    } while (0)
+
+#define RUN_TEST(fn)                                                                    \
+    do {                                                                                \
+        unit_test_failed = 0;                                                           \
+        fn();                                                                           \
+        printf("%s %s\n", unit_test_failed ? "FAIL" : "ok  ", #fn);                     \
+        unit_failures += unit_test_failed;                                              \
+    } while (0)
+
+#define UNIT_MAIN_END() return unit_failures == 0 ? 0 : 1
+
+#define UNIT_GLOBALS int unit_failures, unit_test_failed
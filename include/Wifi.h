@@ -81,6 +81,225 @@ typedef esp_err_t (*wifi_http_handler_t)(httpd_req_t *r);
  */
 esp_err_t wifi_register_http_handler(httpd_uri_t *uri);
 
+/**
+ * @brief Get the handle of the running HTTP server.
+ * 
+ * The server is restarted on every WiFi mode switch, so the handle should not
+ * be cached by the application.
+ * 
+ * @return HTTP server handle, NULL if the server is not running
+ */
+httpd_handle_t wifi_get_http_server(void);
+
+/**
+ * @brief Restart the device without blocking the caller.
+ * 
+ * Schedules a restart delay_ms from now and returns immediately, so it can be
+ * called from an HTTP handler after sending the response. When the delay has
+ * passed, the mode-switch listener task restarts the device. With drain, it
+ * first refuses new connections and waits up to
+ * CONFIG_WIFI_RESTART_DRAIN_TIMEOUT_MS for requests in progress (SD card
+ * downloads and uploads, an OTA update) to finish, then stops the HTTP server
+ * and unmounts the SD card. Queued SD card log records are written out in
+ * both cases. Settings are committed to NVS when they are saved, so there is
+ * nothing to write back for them.
+ * 
+ * @param delay_ms Time before the restart starts, e.g. for a response to reach the client
+ * @param drain true to let requests in progress finish first
+ * 
+ * @return ESP_OK if the restart is scheduled
+ * @return ESP_ERR_INVALID_STATE if wifi_init() was not called or a restart is already scheduled
+ * @return Error code from esp_timer on failure
+ */
+esp_err_t wifi_request_restart(uint32_t delay_ms, bool drain);
+
+/**
+ * @brief Tasks created by the component.
+ */
+typedef enum {
+    WIFI_TASK_LISTENER = 0,     ///< Mode-switch listener task
+    WIFI_TASK_DNS,              ///< Captive portal DNS server task
+    WIFI_TASK_HTTPD,            ///< HTTP server task, runs all request handlers
+    WIFI_TASK_WORKER,           ///< Background workers, e.g. the SD card upload writer
+    WIFI_TASK_COUNT             ///< Number of configurable tasks
+} wifi_task_t;
+
+#define WIFI_TASK_NO_AFFINITY (-1)  ///< Core value letting the scheduler run the task on any core
+
+/**
+ * @brief Set the core and priority of a component task.
+ * 
+ * Defaults come from the "Task placement" Kconfig menu. Call before wifi_init()
+ * to apply the placement from the start. Later calls change the listener task
+ * priority right away; the DNS and HTTP server tasks pick up the new placement
+ * when they are restarted on the next mode switch, and the listener task core
+ * only changes after a reboot. Worker tasks are created on first use and keep
+ * the placement they were created with.
+ * 
+ * @param task Task to configure
+ * @param core Core to pin the task to, or WIFI_TASK_NO_AFFINITY
+ * @param priority FreeRTOS priority, 1 to configMAX_PRIORITIES - 1
+ * 
+ * @return ESP_OK on success
+ * @return ESP_ERR_INVALID_ARG if task, core or priority is out of range
+ */
+esp_err_t wifi_set_task_placement(wifi_task_t task, int core, int priority);
+
+/**
+ * @brief Get the core and priority configured for a component task.
+ * 
+ * @param task Task to query
+ * @param[out] core Configured core or WIFI_TASK_NO_AFFINITY, may be NULL
+ * @param[out] priority Configured priority, may be NULL
+ * 
+ * @return ESP_OK on success
+ * @return ESP_ERR_INVALID_ARG if task is out of range
+ */
+esp_err_t wifi_get_task_placement(wifi_task_t task, int *core, int *priority);
+
+/**
+ * @brief Captive portal discovery counters, since boot.
+ * 
+ * Compare them across captive portal sessions with and without
+ * CONFIG_WIFI_CAPTIVE_DHCP_URI to see how much probe and DNS traffic clients
+ * save by finding the portal through DHCP option 114.
+ */
+typedef struct {
+    uint32_t dns_queries;       ///< DNS queries received by the captive DNS server
+    uint32_t probe_requests;    ///< Requests to OS connectivity-check URLs (/generate_204, /hotspot-detect.html, ...)
+    uint32_t redirects;         ///< Requests redirected to the portal page in captive mode
+    uint32_t api_requests;      ///< Requests to the captive portal API (RFC 8908)
+    uint32_t portal_pages;      ///< Portal pages served
+} wifi_captive_stats_t;
+
+/**
+ * @brief Get the captive portal discovery counters.
+ * 
+ * @param[out] stats Structure to fill
+ */
+void wifi_get_captive_stats(wifi_captive_stats_t *stats);
+
+/**
+ * @brief Actions applying changed settings, from cheapest to most disruptive.
+ * 
+ * Settings saved through the portal are compared with the previous ones and
+ * only the actions needed for the changed fields are taken.
+ */
+typedef enum {
+    WIFI_APPLY_NETIF = 0,       ///< Static IP address changed, set on the STA interface
+    WIFI_APPLY_DHCP,            ///< Switched between DHCP and a static IP
+    WIFI_APPLY_MDNS,            ///< mDNS enabled, disabled or renamed
+    WIFI_APPLY_REASSOC,         ///< SSID, password or authmode changed, reassociated with the AP
+    WIFI_APPLY_MODE_SWITCH,     ///< WiFi mode, or the settings of the running AP changed
+    WIFI_APPLY_COUNT            ///< Number of actions
+} wifi_apply_t;
+
+/**
+ * @brief Downtime of one kind of settings change, since boot.
+ * 
+ * Downtime runs from the start of the action until the device is reachable
+ * again: until it has an IP address for DHCP changes, reassociation and
+ * switches to STA mode, until the call returns for the others.
+ */
+typedef struct {
+    uint32_t count;             ///< Changes applied
+    uint32_t last_ms;           ///< Downtime of the last change
+    uint32_t max_ms;            ///< Longest downtime
+    uint32_t total_ms;          ///< Sum of all downtimes, total_ms / count is the average
+} wifi_apply_stats_t;
+
+/**
+ * @brief Get the downtime of applied settings changes per action.
+ * 
+ * @param[out] stats Array of WIFI_APPLY_COUNT entries, indexed by wifi_apply_t
+ */
+void wifi_get_apply_stats(wifi_apply_stats_t stats[WIFI_APPLY_COUNT]);
+
+/**
+ * @brief Client platforms recognized by their connectivity probes.
+ */
+typedef enum {
+    WIFI_CLIENT_OS_UNKNOWN = 0,     ///< Not recognized yet
+    WIFI_CLIENT_OS_ANDROID,         ///< Android, ChromeOS
+    WIFI_CLIENT_OS_APPLE,           ///< iOS, iPadOS, macOS
+    WIFI_CLIENT_OS_WINDOWS,         ///< Windows
+    WIFI_CLIENT_OS_LINUX,           ///< Linux with NetworkManager
+    WIFI_CLIENT_OS_COUNT            ///< Number of platforms
+} wifi_client_os_t;
+
+/**
+ * @brief Captive portal counters of one client platform, since boot.
+ * 
+ * probes_before_popup / popups is the average number of probes a client of
+ * the platform sent before it opened the portal page.
+ */
+typedef struct {
+    uint32_t probes;                ///< Probe requests answered
+    uint32_t popups;                ///< Clients that opened the portal page after probing
+    uint32_t probes_before_popup;   ///< Probes sent by these clients before opening the portal page
+} wifi_client_os_stats_t;
+
+/**
+ * @brief Get the captive portal counters per client platform.
+ * 
+ * @param[out] stats Array of WIFI_CLIENT_OS_COUNT entries, indexed by wifi_client_os_t
+ */
+void wifi_get_client_os_stats(wifi_client_os_stats_t stats[WIFI_CLIENT_OS_COUNT]);
+
+#define WIFI_STATIONS_MAX 16    ///< Clients tracked in the station table
+
+/**
+ * @brief One client in the station table.
+ * 
+ * SoftAP stations are identified by MAC address. Clients reaching the device
+ * by other paths, e.g. from the LAN in STA mode, are known by IP address only
+ * and have an all-zero MAC address. Counters run from the first time the
+ * client was seen since the last mode switch.
+ */
+typedef struct {
+    uint8_t mac[6];             ///< Station MAC address, all zero for clients known by IP address only
+    uint32_t ip;                ///< IPv4 address in network byte order, 0 until assigned by DHCP
+    bool connected;             ///< Associated with the softAP now
+    int8_t rssi;                ///< Signal strength of an associated station in dBm, 0 otherwise
+    uint32_t connected_s;       ///< Seconds since the station associated, or since an IP-only client was first seen
+    wifi_client_os_t os;        ///< Platform recognized from DNS queries, probes and User-Agent
+    uint32_t http_requests;     ///< HTTP requests answered
+    uint32_t bytes_in;          ///< HTTP bytes received from the client
+    uint32_t bytes_out;         ///< HTTP bytes sent to the client
+    uint32_t dns_queries;       ///< Queries to the captive DNS server
+    uint16_t probes;            ///< Connectivity probes since the station associated
+    bool redirected;            ///< A probe was redirected to the portal
+    bool portal_opened;         ///< The portal page was opened after probing
+} wifi_station_info_t;
+
+/**
+ * @brief Get the station table.
+ * 
+ * @param[out] stations Array to fill
+ * @param max Number of entries in stations, WIFI_STATIONS_MAX for all
+ * @return Number of entries filled
+ */
+size_t wifi_get_stations(wifi_station_info_t *stations, size_t max);
+
+/**
+ * @brief HTTP session limit counters, see CONFIG_WIFI_HTTPD_MAX_SOCKETS_PER_CLIENT.
+ */
+typedef struct {
+    uint32_t open;              ///< Sessions open now
+    uint32_t max_open;          ///< Most sessions open at once
+    uint32_t rejected;          ///< Connections refused because the client held the maximum number of sessions
+    uint32_t header_timeouts;   ///< Sessions closed because request headers did not arrive in time
+    uint32_t slow_bodies;       ///< Sessions closed because a request body arrived too slowly
+    uint32_t purged;            ///< Idle sessions the server closed while all its sockets were in use (LRU purge)
+} wifi_session_stats_t;
+
+/**
+ * @brief Get the HTTP session limit counters.
+ * 
+ * @param[out] stats Structure to fill
+ */
+void wifi_get_session_stats(wifi_session_stats_t *stats);
+
 /**
  * @brief Manually set the status LED color and brightness.
  * 
@@ -22,9 +22,13 @@
 #define DNS_MAX_LEN (256)
 
 #define OPCODE_MASK (0x7800)
-#define QR_FLAG (1 << 7)
+#define QR_FLAG (0x8000)
 #define QD_TYPE_A (0x0001)
 #define ANS_TTL_SEC (300)
+#define DNS_TASK_STACK_SIZE (4096)
+#define DNS_RECV_TIMEOUT_MS (500)       // How often the task checks whether it should stop
+#define DNS_STOP_TIMEOUT_MS (2000)
+#define DNS_STATIC_MAX_ENTRIES (4)      // Rules supported with CONFIG_WIFI_STATIC_ALLOCATION
 
 static const char *TAG = "dns_redirect_server";
 
@@ -58,48 +62,72 @@ typedef struct __attribute__((__packed__))
 
 // DNS server handle
 struct dns_server_handle {
-    bool started;
+    volatile bool started;
+    volatile bool exited;               // Set by the task when it has closed its socket
+    volatile int sock;                  // Socket of the task, -1 while it has none
     TaskHandle_t task;
+    dns_server_query_cb_t query_cb;
+    dns_server_send_error_cb_t send_error_cb;
     int num_of_entries;
     dns_entry_pair_t entry[];
 };
 
+// Counters of all servers since boot, written by the server task only
+static dns_server_stats_t s_stats;
+
+#ifdef CONFIG_WIFI_STATIC_ALLOCATION
+// Storage for the single DNS server instance, reused across start/stop cycles
+static uint8_t s_handle_storage[sizeof(struct dns_server_handle) + DNS_STATIC_MAX_ENTRIES * sizeof(dns_entry_pair_t)] __attribute__((aligned(8)));
+static bool s_handle_in_use = false;
+static StaticTask_t s_task_tcb;
+static StackType_t s_task_stack[DNS_TASK_STACK_SIZE];
+#endif
+
 /*
     Parse the name from the packet from the DNS name format to a regular .-seperated name
-    returns the pointer to the next part of the packet
+    returns the pointer to the next part of the packet, or NULL if the name is malformed,
+    runs past the end of the packet or does not fit parsed_name
 */
-static char *parse_dns_name(char *raw_name, char *parsed_name, size_t parsed_name_max_len)
+static char *parse_dns_name(char *raw_name, const char *end, char *parsed_name, size_t parsed_name_max_len)
 {
-
     char *label = raw_name;
-    char *name_itr = parsed_name;
-    int name_len = 0;
-
-    do {
-        int sub_name_len = *label;
-        // (len + 1) since we are adding  a '.'
-        name_len += (sub_name_len + 1);
-        if (name_len > parsed_name_max_len) {
+    size_t name_len = 0;
+
+    if (parsed_name_max_len == 0) {
+        return NULL;
+    }
+
+    while (label < end && *label != 0) {
+        uint8_t sub_name_len = (uint8_t)*label;
+        // Labels are at most 63 bytes, larger values are compression pointers which questions do not use
+        if (sub_name_len > 63 || label + 1 + sub_name_len > end) {
+            return NULL;
+        }
+        // (len + 1) since we are adding a '.' or the terminator
+        if (name_len + sub_name_len + 1 > parsed_name_max_len) {
             return NULL;
         }
 
         // Copy the sub name that follows the the label
-        memcpy(name_itr, label + 1, sub_name_len);
-        name_itr[sub_name_len] = '.';
-        name_itr += (sub_name_len + 1);
+        memcpy(parsed_name + name_len, label + 1, sub_name_len);
+        name_len += sub_name_len;
+        parsed_name[name_len++] = '.';
         label += sub_name_len + 1;
-    } while (*label != 0);
+    }
+    if (label >= end) {
+        return NULL;
+    }
 
-    // Terminate the final string, replacing the last '.'
-    parsed_name[name_len - 1] = '\0';
+    // Terminate the final string, replacing the last '.' (root name stays empty)
+    parsed_name[name_len > 0 ? name_len - 1 : 0] = '\0';
     // Return pointer to first char after the name
     return label + 1;
 }
 
 // Parses the DNS request and prepares a DNS response with the IP of the softAP
-static int parse_dns_request(char *req, size_t req_len, char *dns_reply, size_t dns_reply_max_len, dns_server_handle_t h)
+static int parse_dns_request(char *req, size_t req_len, char *dns_reply, size_t dns_reply_max_len, dns_server_handle_t h, uint32_t src_ip)
 {
-    if (req_len > dns_reply_max_len) {
+    if (req_len > dns_reply_max_len || req_len < sizeof(dns_header_t)) {
         return -1;
     }
 
@@ -112,40 +140,51 @@ static int parse_dns_request(char *req, size_t req_len, char *dns_reply, size_t
     ESP_LOGD(TAG, "DNS query with header id: 0x%X, flags: 0x%X, qd_count: %d",
              ntohs(header->id), ntohs(header->flags), ntohs(header->qd_count));
 
-    // Not a standard query
-    if ((header->flags & OPCODE_MASK) != 0) {
+    // Not a standard query, or a response (never answer those, it could loop between servers)
+    if ((ntohs(header->flags) & OPCODE_MASK) != 0 || (ntohs(header->flags) & QR_FLAG) != 0) {
         return 0;
     }
 
     // Set question response flag
-    header->flags |= QR_FLAG;
+    header->flags |= htons(QR_FLAG);
 
     uint16_t qd_count = ntohs(header->qd_count);
-    header->an_count = htons(qd_count);
-
-    int reply_len = qd_count * sizeof(dns_answer_t) + req_len;
-    if (reply_len > dns_reply_max_len) {
-        return -1;
-    }
+    // Answers are appended after the request, drop any records following the questions
+    header->ns_count = 0;
+    header->ar_count = 0;
 
     // Pointer to current answer and question
-    char *cur_ans_ptr = dns_reply + req_len;
+    const char *req_end = dns_reply + req_len;
     char *cur_qd_ptr = dns_reply + sizeof(dns_header_t);
+    size_t an_count = 0;
     char name[128];
 
-    // Respond to all questions based on configured rules
+    // Parse all questions first, the answers start right after the last one
     for (int qd_i = 0; qd_i < qd_count; qd_i++) {
-        char *name_end_ptr = parse_dns_name(cur_qd_ptr, name, sizeof(name));
-        if (name_end_ptr == NULL) {
-            ESP_LOGE(TAG, "Failed to parse DNS question: %s", cur_qd_ptr);
+        char *name_end_ptr = parse_dns_name(cur_qd_ptr, req_end, name, sizeof(name));
+        if (name_end_ptr == NULL || name_end_ptr + sizeof(dns_question_t) > req_end) {
+            ESP_LOGW(TAG, "Malformed DNS question %d", qd_i);
             return -1;
         }
+        cur_qd_ptr = name_end_ptr + sizeof(dns_question_t);
+    }
+    char *cur_ans_ptr = cur_qd_ptr;
+    cur_qd_ptr = dns_reply + sizeof(dns_header_t);
 
-        dns_question_t *question = (dns_question_t *)(name_end_ptr);
-        uint16_t qd_type = ntohs(question->type);
-        uint16_t qd_class = ntohs(question->class);
+    // Respond to all questions based on configured rules
+    for (int qd_i = 0; qd_i < qd_count; qd_i++) {
+        char *qd_start = cur_qd_ptr;
+        char *name_end_ptr = parse_dns_name(cur_qd_ptr, req_end, name, sizeof(name));
+        dns_question_t question;
+        memcpy(&question, name_end_ptr, sizeof(question));     // May be unaligned
+        cur_qd_ptr = name_end_ptr + sizeof(dns_question_t);
+        uint16_t qd_type = ntohs(question.type);
+        uint16_t qd_class = ntohs(question.class);
 
         ESP_LOGD(TAG, "Received type: %d | Class: %d | Question for: %s", qd_type, qd_class, name);
+        if (h->query_cb) {
+            h->query_cb(src_ip, name);
+        }
 
         if (qd_type == QD_TYPE_A) {
             esp_ip4_addr_t ip = { .addr = IPADDR_ANY };
@@ -158,7 +197,7 @@ static int parse_dns_request(char *req, size_t req_len, char *dns_reply, size_t
                         esp_netif_get_ip_info(esp_netif_get_handle_from_ifkey(h->entry[i].if_key), &ip_info);
                         ip.addr = ip_info.ip.addr;
                         break;
-                    } else if (h->entry->ip.addr != IPADDR_ANY) {
+                    } else if (h->entry[i].ip.addr != IPADDR_ANY) {
                         ip.addr = h->entry[i].ip.addr;
                         break;
                     }
@@ -167,9 +206,13 @@ static int parse_dns_request(char *req, size_t req_len, char *dns_reply, size_t
             if (ip.addr == IPADDR_ANY) {    // no rule applies, continue with another question
                 continue;
             }
+            if (cur_ans_ptr + sizeof(dns_answer_t) > dns_reply + dns_reply_max_len) {
+                ESP_LOGW(TAG, "DNS reply full, dropping remaining answers");
+                break;
+            }
             dns_answer_t *answer = (dns_answer_t *)cur_ans_ptr;
 
-            answer->ptr_offset = htons(0xC000 | (cur_qd_ptr - dns_reply));
+            answer->ptr_offset = htons(0xC000 | (qd_start - dns_reply));
             answer->type = htons(qd_type);
             answer->class = htons(qd_class);
             answer->ttl = htonl(ANS_TTL_SEC);
@@ -178,9 +221,12 @@ static int parse_dns_request(char *req, size_t req_len, char *dns_reply, size_t
 
             answer->addr_len = htons(sizeof(ip.addr));
             answer->ip_addr = ip.addr;
+            cur_ans_ptr += sizeof(dns_answer_t);
+            an_count++;
         }
     }
-    return reply_len;
+    header->an_count = htons(an_count);
+    return cur_ans_ptr - dns_reply;
 }
 
 /*
@@ -210,24 +256,39 @@ void dns_server_task(void *pvParameters)
             ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
             break;
         }
+        handle->sock = sock;
         ESP_LOGI(TAG, "Socket created");
 
         int err = bind(sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
         if (err < 0) {
             ESP_LOGE(TAG, "Socket unable to bind: errno %d", errno);
+            handle->sock = -1;
+            close(sock);
+            vTaskDelay(pdMS_TO_TICKS(DNS_RECV_TIMEOUT_MS));
+            continue;
         }
         ESP_LOGI(TAG, "Socket bound, port %d", DNS_PORT);
 
+        // Wake up periodically so stop_dns_server() does not have to kill the task inside recvfrom()
+        struct timeval timeout = { .tv_sec = 0, .tv_usec = DNS_RECV_TIMEOUT_MS * 1000 };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
         while (handle->started) {
-            ESP_LOGI(TAG, "Waiting for data");
+            ESP_LOGV(TAG, "Waiting for data");
             struct sockaddr_in6 source_addr; // Large enough for both IPv4 or IPv6
             socklen_t socklen = sizeof(source_addr);
             int len = recvfrom(sock, rx_buffer, sizeof(rx_buffer) - 1, 0, (struct sockaddr *)&source_addr, &socklen);
 
+            // Receive timeout, check whether to stop
+            if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                continue;
+            }
             // Error occurred during receiving
             if (len < 0) {
                 ESP_LOGE(TAG, "recvfrom failed: errno %d", errno);
+                handle->sock = -1;
                 close(sock);
+                sock = -1;
                 break;
             }
             // Data received
@@ -241,22 +302,32 @@ void dns_server_task(void *pvParameters)
 
                 // Null-terminate whatever we received and treat like a string...
                 rx_buffer[len] = 0;
+                s_stats.queries++;
 
                 char reply[DNS_MAX_LEN];
-                int reply_len = parse_dns_request(rx_buffer, len, reply, DNS_MAX_LEN, handle);
+                uint32_t src_ip = source_addr.sin6_family == PF_INET ? ((struct sockaddr_in *)&source_addr)->sin_addr.s_addr : 0;
+                int reply_len = parse_dns_request(rx_buffer, len, reply, DNS_MAX_LEN, handle, src_ip);
 
                 ESP_LOGI(TAG, "Received %d bytes from %s | DNS reply with len: %d", len, addr_str, reply_len);
                 if (reply_len <= 0) {
                     ESP_LOGE(TAG, "Failed to prepare a DNS reply");
                 } else {
                     int err = sendto(sock, reply, reply_len, 0, (struct sockaddr *)&source_addr, sizeof(source_addr));
-                    if (err < 0) {
-                        ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+                    if (err >= 0) {
+                        s_stats.replies++;
+                    } else {
+                        int send_errno = errno;
+                        s_stats.send_errors++;
+                        ESP_LOGE(TAG, "Error occurred during sending: errno %d", send_errno);
                         // Don't break on ENOMEM (12) or ENOBUFS (105) - these are temporary resource issues
                         // The socket is still valid, so continue processing other requests
-                        if (errno != ENOMEM && errno != ENOBUFS) {
+                        if (send_errno != ENOMEM && send_errno != ENOBUFS) {
                             break;
                         }
+                        s_stats.send_no_mem++;
+                        if (handle->send_error_cb) {
+                            handle->send_error_cb(send_errno);
+                        }
                         // Brief delay to allow memory/buffers to be freed
                         vTaskDelay(pdMS_TO_TICKS(10));
                     }
@@ -265,32 +336,83 @@ void dns_server_task(void *pvParameters)
         }
 
         if (sock != -1) {
-            ESP_LOGE(TAG, "Shutting down socket");
+            ESP_LOGI(TAG, "Shutting down socket");
+            handle->sock = -1;
             shutdown(sock, 0);
             close(sock);
         }
     }
-    vTaskDelete(NULL);
+    // Let stop_dns_server() delete this task, so its stack and TCB can be reused right away
+    handle->exited = true;
+    while (1) {
+        vTaskSuspend(NULL);
+    }
 }
 
 dns_server_handle_t start_dns_server(dns_server_config_t *config)
 {
-    dns_server_handle_t handle = calloc(1, sizeof(struct dns_server_handle) + config->num_of_entries * sizeof(dns_entry_pair_t));
+    size_t handle_size = sizeof(struct dns_server_handle) + config->num_of_entries * sizeof(dns_entry_pair_t);
+#ifdef CONFIG_WIFI_STATIC_ALLOCATION
+    ESP_RETURN_ON_FALSE(config->num_of_entries <= DNS_STATIC_MAX_ENTRIES, NULL, TAG, "Too many DNS rules for static allocation");
+    ESP_RETURN_ON_FALSE(!s_handle_in_use, NULL, TAG, "DNS server already running");
+    s_handle_in_use = true;
+    dns_server_handle_t handle = (dns_server_handle_t)s_handle_storage;
+    memset(handle, 0, handle_size);
+#else
+    dns_server_handle_t handle = calloc(1, handle_size);
     ESP_RETURN_ON_FALSE(handle, NULL, TAG, "Failed to allocate dns server handle");
+#endif
 
     handle->started = true;
+    handle->sock = -1;
     handle->num_of_entries = config->num_of_entries;
+    handle->query_cb = config->query_cb;
+    handle->send_error_cb = config->send_error_cb;
     memcpy(handle->entry, config->item, config->num_of_entries * sizeof(dns_entry_pair_t));
 
-    xTaskCreate(dns_server_task, "dns_server", 4096, handle, 5, &handle->task);
+#ifdef CONFIG_WIFI_STATIC_ALLOCATION
+    handle->task = xTaskCreateStaticPinnedToCore(dns_server_task, "dns_server", DNS_TASK_STACK_SIZE, handle,
+                                                 config->task_priority, s_task_stack, &s_task_tcb, config->task_core_id);
+#else
+    if (xTaskCreatePinnedToCore(dns_server_task, "dns_server", DNS_TASK_STACK_SIZE, handle,
+                                config->task_priority, &handle->task, config->task_core_id) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create DNS server task");
+        free(handle);
+        return NULL;
+    }
+#endif
     return handle;
 }
 
+void dns_server_get_stats(dns_server_stats_t *stats)
+{
+    *stats = s_stats;
+}
+
 void stop_dns_server(dns_server_handle_t handle)
 {
     if (handle) {
         handle->started = false;
+        // Wait for the task to close its socket, it checks the flag at least every DNS_RECV_TIMEOUT_MS
+        for (int waited = 0; !handle->exited && waited < DNS_STOP_TIMEOUT_MS; waited += 50) {
+            vTaskDelay(pdMS_TO_TICKS(50));
+        }
+        if (!handle->exited) {
+            ESP_LOGW(TAG, "DNS server task did not stop in time, deleting it");
+            // Stop the task before taking its socket, so it cannot close it at the same time
+            vTaskSuspend(handle->task);
+            int sock = handle->sock;
+            if (sock != -1) {
+                handle->sock = -1;
+                shutdown(sock, SHUT_RDWR);
+                close(sock);
+            }
+        }
         vTaskDelete(handle->task);
+#ifdef CONFIG_WIFI_STATIC_ALLOCATION
+        s_handle_in_use = false;
+#else
         free(handle);
+#endif
     }
 }
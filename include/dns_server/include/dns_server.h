@@ -6,6 +6,9 @@
 
 #pragma once
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -14,9 +17,17 @@ extern "C" {
 #define DNS_SERVER_MAX_ITEMS 1
 #endif
 
+#ifndef DNS_SERVER_TASK_PRIORITY
+#define DNS_SERVER_TASK_PRIORITY 5
+#endif
+
 #define DNS_SERVER_CONFIG_SINGLE(queried_name, netif_key)  {        \
         .num_of_entries = 1,                                        \
-        .item = { { .name = queried_name, .if_key = netif_key } }   \
+        .item = { { .name = queried_name, .if_key = netif_key } },  \
+        .task_priority = DNS_SERVER_TASK_PRIORITY,                  \
+        .task_core_id = tskNO_AFFINITY,                             \
+        .query_cb = NULL,                                           \
+        .send_error_cb = NULL                                       \
         }
 
 /**
@@ -31,6 +42,24 @@ typedef struct dns_entry_pair {
     esp_ip4_addr_t ip;      /**<! Constant IP address to answer this query, if "if_key==NULL" */
 } dns_entry_pair_t;
 
+/**
+ * @brief Callback for every question received, e.g. to recognize clients by the names they look up
+ *
+ * @param src_ip IPv4 address of the client, network byte order
+ * @param name Queried name
+ */
+typedef void (*dns_server_query_cb_t)(uint32_t src_ip, const char *name);
+
+/**
+ * @brief Callback for replies that could not be sent for lack of memory or buffers
+ *
+ * Called from the server task right after sendto() failed with ENOMEM or
+ * ENOBUFS, before the server pauses briefly and goes on with the next query.
+ *
+ * @param err errno of sendto()
+ */
+typedef void (*dns_server_send_error_cb_t)(int err);
+
 /**
  * @brief DNS server config struct defining the rules for answering DNS (A type) queries
  *
@@ -50,6 +79,10 @@ typedef struct dns_entry_pair {
 typedef struct dns_server_config {
     int num_of_entries;                             /**<! Number of rules specified in the config struct */
     dns_entry_pair_t item[DNS_SERVER_MAX_ITEMS];    /**<! Array of pairs */
+    UBaseType_t task_priority;                      /**<! Priority of the server task */
+    BaseType_t task_core_id;                        /**<! Core to pin the server task to, or tskNO_AFFINITY */
+    dns_server_query_cb_t query_cb;                 /**<! Called from the server task for each question, may be NULL */
+    dns_server_send_error_cb_t send_error_cb;       /**<! Called from the server task when a reply fails with ENOMEM or ENOBUFS, may be NULL */
 } dns_server_config_t;
 
 /**
@@ -57,6 +90,16 @@ typedef struct dns_server_config {
  */
 typedef struct dns_server_handle *dns_server_handle_t;
 
+/**
+ * @brief DNS server counters, summed over all servers since boot
+ */
+typedef struct {
+    uint32_t queries;       /**<! Packets received */
+    uint32_t replies;       /**<! Replies sent */
+    uint32_t send_errors;   /**<! Replies that could not be sent */
+    uint32_t send_no_mem;   /**<! Of send_errors, failed with ENOMEM or ENOBUFS */
+} dns_server_stats_t;
+
 /**
  * @brief Set ups and starts a simple DNS server that will respond to all A queries (IPv4)
  * based on configured rules, pairs of name and either IPv4 address or a netif ID (to respond by it's IPv4 add)
@@ -66,6 +109,12 @@ typedef struct dns_server_handle *dns_server_handle_t;
  */
 dns_server_handle_t start_dns_server(dns_server_config_t *config);
 
+/**
+ * @brief Get the DNS server counters, also while no server is running
+ * @param stats Structure to fill
+ */
+void dns_server_get_stats(dns_server_stats_t *stats);
+
 /**
  * @brief Stops and destroys DNS server's task and structs
  * @param handle DNS server's handle to destroy
@@ -0,0 +1,104 @@
+/**
+ * @file wifi_arena.h
+ * @brief Per-request scratch memory for HTTP handlers
+ *
+ * Handlers registered through the component (built-in handlers, handlers
+ * added with wifi_register_http_handler(), wifi_arena_register_uri() or
+ * wifi_arena_register_err_handler()) can
+ * take scratch buffers from a bump arena instead of the httpd task stack. The
+ * arena is backed by CONFIG_WIFI_ARENA_BLOCKS preallocated blocks of
+ * CONFIG_WIFI_ARENA_BLOCK_SIZE bytes and is reset automatically when the
+ * handler returns, so buffers never have to be freed.
+ *
+ * The arena belongs to the httpd task. Memory from it must not be used after
+ * the handler returns, and it cannot be used from asynchronous handlers
+ * running in other tasks (wifi_arena_alloc() returns NULL there).
+ *
+ * Example:
+ * @code{c}
+ * esp_err_t my_handler(httpd_req_t *req) {
+ *     char *json = wifi_arena_alloc(req, 1024);
+ *     if (json == NULL) return httpd_resp_send_500(req);
+ *     // ... build and send json, no free needed
+ *     return ESP_OK;
+ * }
+ * @endcode
+ */
+
+#ifndef WIFI_ARENA_H
+#define WIFI_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+/**
+ * @brief Arena usage statistics.
+ */
+typedef struct {
+    uint32_t block_size;        ///< Size of one block (CONFIG_WIFI_ARENA_BLOCK_SIZE)
+    uint32_t blocks;            ///< Number of blocks (CONFIG_WIFI_ARENA_BLOCKS)
+    uint32_t calls;             ///< Handler invocations through the wrapper
+    uint32_t requests;          ///< Handler invocations that used the arena
+    uint32_t high_water;        ///< Most bytes used by a single handler invocation
+    uint32_t failures;          ///< Allocations that did not fit
+} wifi_arena_stats_t;
+
+/**
+ * @brief Allocate scratch memory for the current request.
+ *
+ * The memory is 8-byte aligned, not zeroed, and valid until the handler returns.
+ * A single allocation must fit in one block.
+ *
+ * @param req Request being handled
+ * @param size Number of bytes
+ * @return Pointer to the memory, NULL if it does not fit or req is not being
+ *         handled by a wrapped handler in the httpd task
+ */
+void *wifi_arena_alloc(httpd_req_t *req, size_t size);
+
+/**
+ * @brief Register a URI handler wrapped so that the arena is reset after every call.
+ *
+ * Use instead of httpd_register_uri_handler() for handlers registered directly
+ * on wifi_get_http_server() that want to use wifi_arena_alloc(). The handler
+ * still receives its own user_ctx in req->user_ctx.
+ *
+ * At most CONFIG_WIFI_MAX_CUSTOM_HTTP_HANDLERS distinct handlers can be
+ * wrapped besides the built-in ones; registering the same handler and
+ * user_ctx again reuses its entry.
+ *
+ * @param handle Server handle
+ * @param uri URI handler description
+ * @return ESP_OK on success
+ * @return ESP_ERR_NO_MEM if too many handlers are wrapped, the handler is not registered
+ * @return Error code from httpd_register_uri_handler() on failure
+ */
+esp_err_t wifi_arena_register_uri(httpd_handle_t handle, const httpd_uri_t *uri);
+
+/**
+ * @brief Register an error handler wrapped so that it can use the arena.
+ *
+ * Use instead of httpd_register_err_handler(). The server has one handler per
+ * error code, a later registration replaces the earlier one.
+ *
+ * @param handle Server handle
+ * @param error Error code the handler is called for
+ * @param handler Error handler
+ * @return ESP_OK on success
+ * @return ESP_ERR_INVALID_ARG if an argument is invalid
+ * @return Error code from httpd_register_err_handler() on failure
+ */
+esp_err_t wifi_arena_register_err_handler(httpd_handle_t handle, httpd_err_code_t error,
+                                          httpd_err_handler_func_t handler);
+
+/**
+ * @brief Get arena usage statistics.
+ *
+ * @param stats Structure to fill
+ */
+void wifi_arena_get_stats(wifi_arena_stats_t *stats);
+
+#endif
@@ -0,0 +1,136 @@
+/**
+ * @file wifi_assets.h
+ * @brief Read-only web assets served from a memory-mapped flash partition
+ *
+ * With CONFIG_WIFI_ASSETS enabled, wifi_init() maps the partition labelled
+ * CONFIG_WIFI_ASSETS_PARTITION_LABEL. The image is built from a web directory
+ * by tools/pack_assets.py, normally through the CMake function provided by the
+ * component:
+ *
+ * @code{cmake}
+ * # Project CMakeLists.txt, after project()
+ * wifi_assets_create_partition_image(www webpage FLASH_IN_PROJECT GZIP GZIP_PLAIN)
+ * @endcode
+ *
+ * The files are then served by the wildcard file handler together with the SD
+ * card, either as the primary web root or as a fallback
+ * (CONFIG_WIFI_ASSETS_PRIMARY / CONFIG_WIFI_ASSETS_FALLBACK). Asset data stays
+ * in flash and is sent without copying; files stored gzip-compressed are sent
+ * with Content-Encoding: gzip to clients whose Accept-Encoding allows it.
+ * Other clients get the uncompressed copy if the image has one (GZIP_PLAIN),
+ * otherwise the file from the SD card, or 406 Not Acceptable.
+ *
+ * The lookup functions can also be used from custom handlers, e.g. to embed
+ * an asset in another response. They are only available with CONFIG_WIFI_ASSETS.
+ */
+
+#ifndef WIFI_ASSETS_H
+#define WIFI_ASSETS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+/**
+ * @brief One file in the asset image.
+ */
+typedef struct {
+    const char *path;           ///< Path starting with "/", e.g. "/index.html"
+    const uint8_t *data;        ///< File contents in mapped flash
+    size_t size;                ///< Size of data in bytes
+    uint32_t crc;               ///< CRC-32 of data, sent as ETag
+    bool gzip;                  ///< data is gzip-compressed
+} wifi_asset_t;
+
+/**
+ * @brief Map the asset partition.
+ *
+ * Called by wifi_init(). Safe to call again, the partition is mapped once.
+ *
+ * @return ESP_OK on success
+ * @return ESP_ERR_NOT_FOUND if the partition does not exist
+ * @return ESP_ERR_INVALID_STATE if the partition does not hold a valid image
+ * @return Error code from esp_partition_mmap() on failure
+ */
+esp_err_t wifi_assets_init(void);
+
+/**
+ * @brief Check whether an asset image is mapped.
+ *
+ * @return true if assets can be looked up
+ */
+bool wifi_assets_available(void);
+
+/**
+ * @brief Look up a file by exact path.
+ *
+ * @param path Path starting with "/"
+ * @param len Length of path, so a query string can be excluded without copying
+ * @param[out] asset Found file
+ * @return ESP_OK if found, ESP_ERR_NOT_FOUND otherwise
+ */
+esp_err_t wifi_assets_find(const char *path, size_t len, wifi_asset_t *asset);
+
+/**
+ * @brief Look up the file for a request URI.
+ *
+ * Resolves like the SD card handler: the query string is ignored, "/" and
+ * directory paths map to index.html, and extensionless paths are also tried
+ * with ".html" appended. Compressed files are preferred, see
+ * wifi_assets_find_request() to respect the client's Accept-Encoding.
+ *
+ * @param uri Request URI
+ * @param[out] asset Found file
+ * @return ESP_OK if found, ESP_ERR_NOT_FOUND otherwise
+ */
+esp_err_t wifi_assets_find_uri(const char *uri, wifi_asset_t *asset);
+
+/**
+ * @brief Look up the file for a request, in an encoding the client accepts.
+ *
+ * Resolves req->uri like wifi_assets_find_uri(). A compressed file is only
+ * returned if the request's Accept-Encoding allows gzip; otherwise its
+ * uncompressed copy, if the image has one.
+ *
+ * @param req HTTP request handle
+ * @param[out] asset Found file
+ * @return ESP_OK if found
+ * @return ESP_ERR_NOT_SUPPORTED if the file is only stored compressed and the client does not accept gzip
+ * @return ESP_ERR_NOT_FOUND otherwise
+ */
+esp_err_t wifi_assets_find_request(httpd_req_t *req, wifi_asset_t *asset);
+
+/**
+ * @brief Get the number of files in the image.
+ *
+ * @return Number of files, 0 if no image is mapped
+ */
+size_t wifi_assets_count(void);
+
+/**
+ * @brief Get a file by index, for listing or benchmarking.
+ *
+ * @param index Index below wifi_assets_count()
+ * @param[out] asset File at that index
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if index is out of range
+ */
+esp_err_t wifi_assets_get(size_t index, wifi_asset_t *asset);
+
+/**
+ * @brief Send a file as the complete response.
+ *
+ * Sets Content-Type from the path, Content-Encoding for compressed files and
+ * an ETag, and answers If-None-Match revalidation with 304 Not Modified.
+ * Vary: Accept-Encoding is set as well, the image can hold a file in both
+ * encodings.
+ *
+ * @param req HTTP request handle
+ * @param asset File to send
+ * @return ESP_OK on success, error code from httpd_resp_send() otherwise
+ */
+esp_err_t wifi_assets_send(httpd_req_t *req, const wifi_asset_t *asset);
+
+#endif
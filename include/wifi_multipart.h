@@ -0,0 +1,166 @@
+/**
+ * @file wifi_multipart.h
+ * @brief Streaming multipart/form-data parser
+ *
+ * Parses request bodies of HTML forms sent with
+ * enctype="multipart/form-data", such as file uploads, as they arrive: the
+ * body is pushed into the parser in pieces of any size and the parser calls
+ * back with the headers of each part and with its data. Nothing of the body
+ * is buffered, the parser state has a fixed size (sizeof(wifi_multipart_t))
+ * whatever the size of the body or its parts.
+ *
+ * Part data is delivered in pieces as well, a piece never contains any part
+ * of the boundary. Data that looks like the start of a boundary at the end of
+ * one pushed piece is held back and delivered with the next one, so a single
+ * part can produce more callbacks than pieces pushed.
+ *
+ * Example, storing every file field on the SD card:
+ * @code{c}
+ * static esp_err_t on_part(const wifi_multipart_part_t *part, void *ctx) {
+ *     FILE **f = ctx;
+ *     if (part->filename[0] == '\0') return ESP_OK;  // Not a file field
+ *     char path[160];
+ *     snprintf(path, sizeof(path), "/sdcard/%s", part->filename);  // Check the name in real code
+ *     *f = fopen(path, "w");
+ *     return *f ? ESP_OK : ESP_FAIL;
+ * }
+ * static esp_err_t on_data(const wifi_multipart_part_t *part, const char *data, size_t len, void *ctx) {
+ *     FILE **f = ctx;
+ *     return (*f == NULL || fwrite(data, 1, len, *f) == len) ? ESP_OK : ESP_FAIL;
+ * }
+ * static esp_err_t on_part_end(const wifi_multipart_part_t *part, void *ctx) {
+ *     FILE **f = ctx;
+ *     if (*f) fclose(*f);
+ *     *f = NULL;
+ *     return ESP_OK;
+ * }
+ *
+ * esp_err_t upload_handler(httpd_req_t *req) {
+ *     const wifi_multipart_callbacks_t cb = { .on_part = on_part, .on_data = on_data, .on_part_end = on_part_end };
+ *     FILE *f = NULL;
+ *     esp_err_t err = wifi_multipart_recv(req, &cb, &f);
+ *     if (f) fclose(f);   // Body ended inside a part
+ *     if (err != ESP_OK) return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Upload failed");
+ *     return httpd_resp_sendstr(req, "OK");
+ * }
+ * @endcode
+ */
+
+#ifndef WIFI_MULTIPART_H
+#define WIFI_MULTIPART_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#define WIFI_MULTIPART_BOUNDARY_MAX 70      ///< Longest boundary (RFC 2046)
+#define WIFI_MULTIPART_LINE_MAX 256         ///< Longest part header line kept, longer lines are truncated
+#define WIFI_MULTIPART_RECV_SIZE 512        ///< Receive buffer of wifi_multipart_recv()
+
+/**
+ * @brief Headers of one part.
+ *
+ * Values that do not fit are truncated.
+ */
+typedef struct {
+    char name[64];              ///< Form field name from Content-Disposition
+    char filename[96];          ///< File name from Content-Disposition, empty for fields that are not files
+    char content_type[64];      ///< Content-Type of the part, empty if not given
+    uint32_t index;             ///< Number of the part in the body, from 0
+} wifi_multipart_part_t;
+
+/**
+ * @brief Parser callbacks, NULL callbacks are skipped.
+ *
+ * Returning anything but ESP_OK stops the parser, wifi_multipart_feed() and
+ * wifi_multipart_recv() return that value.
+ */
+typedef struct {
+    /** @brief Any header line of a part, before on_part */
+    esp_err_t (*on_header)(const char *name, const char *value, void *ctx);
+    /** @brief Headers of a part are complete */
+    esp_err_t (*on_part)(const wifi_multipart_part_t *part, void *ctx);
+    /** @brief Data of the current part, len > 0 */
+    esp_err_t (*on_data)(const wifi_multipart_part_t *part, const char *data, size_t len, void *ctx);
+    /** @brief The current part is complete */
+    esp_err_t (*on_part_end)(const wifi_multipart_part_t *part, void *ctx);
+} wifi_multipart_callbacks_t;
+
+/**
+ * @brief Parser state.
+ *
+ * Allocate it anywhere (static, wifi_arena_alloc(), the stack of a task with
+ * room for it) and set it up with wifi_multipart_init(). The fields are
+ * private.
+ */
+typedef struct {
+    const wifi_multipart_callbacks_t *cb;
+    void *ctx;
+    uint8_t state;
+    uint8_t after;              ///< Last byte seen after a delimiter
+    uint8_t delim_len;          ///< Length of delim
+    uint8_t match;              ///< Bytes of delim matched at the end of the last piece
+    uint16_t line_len;          ///< Bytes in line
+    char delim[4 + WIFI_MULTIPART_BOUNDARY_MAX];    ///< "\r\n--" and the boundary
+    char line[WIFI_MULTIPART_LINE_MAX];             ///< Header line being received
+    wifi_multipart_part_t part;
+} wifi_multipart_t;
+
+/**
+ * @brief Set up a parser for one body.
+ *
+ * @param mp Parser
+ * @param content_type Content-Type header of the request, e.g. "multipart/form-data; boundary=xyz"
+ * @param cb Callbacks, must stay valid while the parser is used
+ * @param ctx Passed to the callbacks
+ * @return ESP_OK
+ * @return ESP_ERR_INVALID_ARG if the content type is not multipart or has no valid boundary
+ */
+esp_err_t wifi_multipart_init(wifi_multipart_t *mp, const char *content_type,
+                              const wifi_multipart_callbacks_t *cb, void *ctx);
+
+/**
+ * @brief Parse the next piece of the body.
+ *
+ * @param mp Parser
+ * @param data Body bytes
+ * @param len Length of data, any size
+ * @return ESP_OK
+ * @return ESP_ERR_INVALID_ARG if the body is malformed, the parser stops
+ * @return Error returned from a callback
+ */
+esp_err_t wifi_multipart_feed(wifi_multipart_t *mp, const char *data, size_t len);
+
+/**
+ * @brief Check that the body was complete.
+ *
+ * @param mp Parser
+ * @return ESP_OK if the closing boundary was parsed
+ * @return ESP_ERR_INVALID_SIZE if the body ended early
+ */
+esp_err_t wifi_multipart_finish(wifi_multipart_t *mp);
+
+/**
+ * @brief Receive and parse the body of a request.
+ *
+ * Reads the Content-Type header and the whole body in pieces of
+ * WIFI_MULTIPART_RECV_SIZE bytes. The parser and the receive buffer come from
+ * the request arena (wifi_arena.h), so the handler must be registered through
+ * the component. No response is sent.
+ *
+ * @param req Request being handled
+ * @param cb Callbacks
+ * @param ctx Passed to the callbacks
+ * @return ESP_OK when the whole body was parsed
+ * @return ESP_ERR_INVALID_ARG if the request is not multipart or the body is malformed
+ * @return ESP_ERR_INVALID_SIZE if the body ended before the closing boundary
+ * @return ESP_ERR_NO_MEM if the arena has no room
+ * @return ESP_FAIL if receiving failed, the connection should be closed
+ * @return Error returned from a callback
+ */
+esp_err_t wifi_multipart_recv(httpd_req_t *req, const wifi_multipart_callbacks_t *cb, void *ctx);
+
+#endif
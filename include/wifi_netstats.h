@@ -0,0 +1,132 @@
+/**
+ * @file wifi_netstats.h
+ * @brief lwIP, TCP and socket statistics of the HTTP and DNS paths
+ *
+ * Collects what decides whether the portal keeps up under load: lwIP memory
+ * pool usage and allocation failures, TCP and UDP counters, TCP connections
+ * that are retransmitting, the accept backlog of the HTTP server's listening
+ * socket, lwIP socket usage, HTTP session counters and DNS server counters.
+ *
+ * Pool, TCP and UDP counters need CONFIG_LWIP_STATS ("Enable LWIP
+ * statistics" in the LWIP menu); without it they read 0 and
+ * wifi_net_stats_t.lwip_stats is false. Everything else is always filled.
+ * lwIP does not count datagrams dropped because a socket's receive queue was
+ * full, so drops on the DNS socket show up as the global UDP drop counter
+ * together with send failures of the DNS server.
+ *
+ * When the DNS server fails to send a reply with ENOMEM or ENOBUFS, a
+ * snapshot is taken at that moment and kept for wifi_get_net_snapshot(), at
+ * most one per second. GET /netstats.json serves the current statistics and
+ * the last snapshot.
+ */
+
+#ifndef WIFI_NETSTATS_H
+#define WIFI_NETSTATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+#include "Wifi.h"
+#include "dns_server.h"
+
+#define WIFI_NETSTATS_MAX_POOLS 24  ///< lwIP memory pools reported, lwIP has fewer in typical configurations
+
+/**
+ * @brief Usage of one lwIP memory pool.
+ */
+typedef struct {
+    const char *name;           ///< Pool name, e.g. "TCP_PCB" or "PBUF_POOL"
+    uint32_t used;              ///< Elements in use
+    uint32_t max;               ///< Most elements in use at once
+    uint32_t avail;             ///< Elements available in total
+    uint32_t err;               ///< Failed allocations
+} wifi_netstats_pool_t;
+
+/**
+ * @brief lwIP counters of one protocol, see struct stats_proto.
+ */
+typedef struct {
+    uint32_t xmit;              ///< Packets sent
+    uint32_t recv;              ///< Packets received
+    uint32_t drop;              ///< Packets dropped
+    uint32_t memerr;            ///< Out of memory errors
+    uint32_t err;               ///< Other errors
+} wifi_netstats_proto_t;
+
+/**
+ * @brief Network statistics at one moment.
+ */
+typedef struct {
+    int64_t time_us;            ///< esp_timer_get_time() when taken
+    char reason[16];            ///< Why a snapshot was taken, e.g. "dns ENOMEM"; empty for wifi_get_net_stats()
+    uint32_t free_heap;         ///< Free internal heap, lwIP allocates pbufs from it
+    uint32_t min_free_heap;     ///< Lowest free internal heap since boot
+    uint32_t largest_free_block; ///< Largest free internal heap block
+    uint16_t sockets_used;      ///< lwIP sockets open
+    uint16_t sockets_max;       ///< CONFIG_LWIP_MAX_SOCKETS
+    uint16_t tcp_active;        ///< TCP connections not in TIME-WAIT or listening
+    uint16_t tcp_time_wait;     ///< TCP connections in TIME-WAIT
+    uint16_t tcp_retransmitting; ///< Active connections with unacknowledged data retransmitted
+    uint16_t tcp_retransmits;   ///< Retransmissions of the oldest unacknowledged segment, summed over active connections
+    uint16_t tcp_queued;        ///< pbufs queued for sending, summed over active connections
+    uint16_t http_backlog;      ///< Connections accepted by TCP but not yet by the HTTP server
+    uint16_t http_backlog_max;  ///< Accept backlog of the HTTP server; new connections are dropped while it is full
+    bool lwip_stats;            ///< CONFIG_LWIP_STATS is enabled, pools, tcp and udp are valid
+    uint8_t pool_count;         ///< Entries in pools
+    wifi_netstats_pool_t pools[WIFI_NETSTATS_MAX_POOLS];
+    wifi_netstats_proto_t tcp;  ///< lwIP TCP counters since boot
+    wifi_netstats_proto_t udp;  ///< lwIP UDP counters since boot
+    wifi_session_stats_t http;  ///< HTTP session counters, open and purged sockets
+    dns_server_stats_t dns;     ///< DNS server counters
+} wifi_net_stats_t;
+
+/**
+ * @brief Get the current network statistics.
+ *
+ * Walks the TCP connection lists in the TCP/IP task, so it must not be
+ * called from there.
+ *
+ * @param[out] stats Structure to fill
+ */
+void wifi_get_net_stats(wifi_net_stats_t *stats);
+
+/**
+ * @brief Get the last snapshot taken on a DNS send failure.
+ *
+ * @param[out] stats Structure to fill
+ * @param[out] count Snapshots taken since boot, may be NULL
+ * @return true if a snapshot was taken, false if there was none yet
+ */
+bool wifi_get_net_snapshot(wifi_net_stats_t *stats, uint32_t *count);
+
+/**
+ * @brief Record the port of the HTTP server for the accept backlog.
+ *
+ * Called by the component when it configures the server.
+ *
+ * @param port Listening port of the HTTP server
+ */
+void wifi_netstats_init(uint16_t port);
+
+/**
+ * @brief Take a snapshot after a DNS reply failed with ENOMEM or ENOBUFS.
+ *
+ * Called by the DNS server task, see dns_server_config_t.send_error_cb.
+ *
+ * @param err errno of the failed send
+ */
+void wifi_netstats_dns_send_error(int err);
+
+/**
+ * @brief HTTP GET handler for /netstats.json.
+ *
+ * Registered by the component through the request arena.
+ *
+ * @param req HTTP request handle
+ * @return ESP_OK on success
+ */
+esp_err_t wifi_netstats_http_handler(httpd_req_t *req);
+
+#endif
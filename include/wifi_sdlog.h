@@ -0,0 +1,130 @@
+/**
+ * @file wifi_sdlog.h
+ * @brief Non-blocking log and data sink on the SD card
+ *
+ * With CONFIG_WIFI_SDLOG enabled, records written with wifi_sdlog_write() or
+ * wifi_sdlog_printf() are copied into a lock-free multi-producer queue and
+ * return immediately; they never wait for the SD card. A writer task drains
+ * the queue into a batch buffer and writes it to the card in whole,
+ * sector-aligned batches, calling fsync() every CONFIG_WIFI_SDLOG_SYNC_INTERVAL_MS.
+ *
+ * Records are appended byte for byte, so text lines need their own '\n'.
+ * They go to <mount point>/CONFIG_WIFI_SDLOG_DIR/log0.txt. When it reaches
+ * CONFIG_WIFI_SDLOG_FILE_SIZE_KB, it is renamed to log1.txt and so on, keeping
+ * CONFIG_WIFI_SDLOG_FILE_COUNT files. Files are rotated at a batch boundary,
+ * so a record can continue in the next file. The files are served by the SD card file
+ * handler, e.g. GET /logs/log0.txt, with buffered records written out first.
+ *
+ * When the queue is full, records are dropped and counted rather than
+ * blocking the caller. While no SD card is mounted, records stay queued until
+ * the queue fills up. After a failed write or a card removal a record is
+ * either on the card whole or lost whole and counted in lost_bytes.
+ *
+ * The write functions can be called from any task and from ISRs.
+ */
+
+#ifndef WIFI_SDLOG_H
+#define WIFI_SDLOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/**
+ * @brief Log sink statistics.
+ */
+typedef struct {
+    uint32_t records;           ///< Records accepted into the queue
+    uint32_t dropped;           ///< Records dropped because the queue was full or the record too long
+    uint64_t bytes_written;     ///< Record bytes written to the card
+    uint64_t card_bytes;        ///< Bytes passed to write(), including partial batches written again after a sync
+    uint32_t writes;            ///< write() calls
+    uint32_t syncs;             ///< fsync() calls
+    uint32_t rotations;         ///< Files rotated
+    uint32_t write_errors;      ///< Failed writes, the batch was discarded
+    uint32_t lost_bytes;        ///< Bytes of the records discarded after write errors or card removal
+    uint32_t write_amplification_x100; ///< card_bytes / bytes_written * 100, 100 is none
+    uint16_t queue_slots;       ///< Queue capacity in slots of CONFIG_WIFI_SDLOG_SLOT_SIZE bytes
+    uint16_t queue_high_water;  ///< Most slots in use at once
+} wifi_sdlog_stats_t;
+
+/**
+ * @brief Start the writer task.
+ *
+ * Called by wifi_init() with the SD card mount point. Safe to call again.
+ *
+ * @param mount_point SD card mount point, e.g. "/sdcard"
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the task or buffer cannot be created
+ */
+esp_err_t wifi_sdlog_init(const char *mount_point);
+
+/**
+ * @brief Tell the writer whether the SD card is mounted.
+ *
+ * Called by the component when the card is mounted or before it is unmounted.
+ * Unmounting waits for a write in progress and closes the log file.
+ *
+ * @param mounted true after mounting, false before unmounting
+ */
+void wifi_sdlog_card_changed(bool mounted);
+
+/**
+ * @brief Queue one record.
+ *
+ * The data is copied, longer records take several queue slots. A record is
+ * written contiguously even when other tasks write at the same time.
+ *
+ * @param data Record bytes
+ * @param len Length of data, at most half the queue capacity
+ * @return ESP_OK if queued
+ * @return ESP_ERR_INVALID_STATE if the sink is not running
+ * @return ESP_ERR_INVALID_SIZE if the record is longer than half the queue
+ * @return ESP_ERR_NO_MEM if the queue is full, the record is dropped
+ */
+esp_err_t wifi_sdlog_write(const void *data, size_t len);
+
+/**
+ * @brief Format and queue one record.
+ *
+ * Formats into a stack buffer of WIFI_SDLOG_PRINTF_MAX bytes, longer output
+ * is truncated.
+ *
+ * @param fmt printf format
+ * @return Same as wifi_sdlog_write()
+ */
+esp_err_t wifi_sdlog_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/** @brief Longest record produced by wifi_sdlog_printf(), including the terminator */
+#define WIFI_SDLOG_PRINTF_MAX 192
+
+/**
+ * @brief Write out queued records and fsync.
+ *
+ * Does not wait when called from the writer task itself.
+ *
+ * @param timeout_ms Longest time to wait
+ * @return ESP_OK when everything queued before the call is on the card
+ * @return ESP_ERR_TIMEOUT if the writer did not finish in time, e.g. without SD card
+ */
+esp_err_t wifi_sdlog_flush(uint32_t timeout_ms);
+
+/**
+ * @brief Also send ESP_LOG output to the sink.
+ *
+ * Installs a vprintf hook that queues each log line and passes it on to the
+ * previous hook, so the console output is unchanged.
+ *
+ * @param enable true to install, false to restore the previous hook
+ */
+void wifi_sdlog_capture_esp_log(bool enable);
+
+/**
+ * @brief Get sink statistics.
+ *
+ * @param stats Structure to fill
+ */
+void wifi_sdlog_get_stats(wifi_sdlog_stats_t *stats);
+
+#endif
@@ -0,0 +1,124 @@
+/**
+ * @file wifi_ssi.h
+ * @brief Server-side includes in SD card HTML pages
+ *
+ * With CONFIG_WIFI_SSI enabled, .html and .htm files served from the SD card
+ * are expanded while they are sent:
+ * - <!--#include virtual="/nav.html" --> inserts a file from the web root,
+ *   <!--#include file="nav.html" --> a file next to the page. Included HTML
+ *   files are expanded as well, down to WIFI_SSI_MAX_DEPTH levels of
+ *   includes; deeper ones are sent as they are.
+ * - <!--#var name --> inserts the value of a variable registered with
+ *   wifi_ssi_register_var(), HTML-escaped. Unknown variables insert nothing.
+ *
+ * Other comments and directives the component does not know are sent
+ * unchanged. The page is streamed with the file, no part of it is held in
+ * memory but the 512-byte read buffer the SD card handler already uses.
+ *
+ * The first request for a file scans it for directives and keeps their
+ * positions in a cache of CONFIG_WIFI_SSI_CACHE_ENTRIES files. Later requests
+ * only send the text between the cached positions. An entry is scanned again
+ * when the file's size or modification time changed, after any upload and
+ * after the card was mounted again.
+ *
+ * Files from the flash asset image are always sent unchanged.
+ *
+ * Built-in variables:
+ * - ip: IP address in the current network, the AP address while not connected
+ * - ssid: Configured network
+ * - ap_ssid: SSID of the device's own access point
+ * - hostname: mDNS hostname
+ */
+
+#ifndef WIFI_SSI_H
+#define WIFI_SSI_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#define WIFI_SSI_MAX_DEPTH 2        ///< Levels of nested includes that are expanded
+#define WIFI_SSI_NAME_MAX 24        ///< Longest variable name, including the terminator
+#define WIFI_SSI_VALUE_MAX 128      ///< Size of the buffer a variable is written to
+
+/**
+ * @brief Variable provider.
+ *
+ * Called in the HTTP server task for every <!--#var --> of the variable in a
+ * page being sent, so it should be quick and must not block.
+ *
+ * @param buf Buffer for the value, an empty string when called
+ * @param size Size of buf, WIFI_SSI_VALUE_MAX
+ * @param ctx Pointer given to wifi_ssi_register_var()
+ */
+typedef void (*wifi_ssi_var_fn_t)(char *buf, size_t size, void *ctx);
+
+/**
+ * @brief Template statistics.
+ */
+typedef struct {
+    uint32_t pages;             ///< Files expanded, including included ones
+    uint32_t cache_hits;        ///< Files sent with cached directive positions
+    uint32_t cache_misses;      ///< Files scanned for directives
+    uint32_t scan_us;           ///< Time spent scanning, microseconds
+    uint32_t skipped;           ///< Directives sent unchanged because the cache entry was full
+} wifi_ssi_stats_t;
+
+/**
+ * @brief Register a variable for <!--#var name -->.
+ *
+ * Can be called before or after wifi_init(). Registering a name again
+ * replaces its provider.
+ *
+ * @param name Name, letters, digits, '_', '-' and '.', shorter than WIFI_SSI_NAME_MAX
+ * @param fn Provider
+ * @param ctx Passed to the provider
+ * @return ESP_OK
+ * @return ESP_ERR_INVALID_ARG if the name is invalid or fn is NULL
+ * @return ESP_ERR_NO_MEM if CONFIG_WIFI_SSI_MAX_VARS variables are registered
+ */
+esp_err_t wifi_ssi_register_var(const char *name, wifi_ssi_var_fn_t fn, void *ctx);
+
+/**
+ * @brief Get template statistics.
+ *
+ * @param[out] stats Filled with the current counters
+ */
+void wifi_ssi_get_stats(wifi_ssi_stats_t *stats);
+
+/**
+ * @brief Check whether a file is expanded, by its extension.
+ *
+ * @param path File path
+ * @return true for .html and .htm files
+ */
+bool wifi_ssi_is_template(const char *path);
+
+/**
+ * @brief Send an open template file as chunks of the response.
+ *
+ * Called by the SD card file handler, which sends the final empty chunk.
+ *
+ * @param req Request being handled
+ * @param f File, opened for reading
+ * @param path Full path of the file, e.g. "/sdcard/index.html"
+ * @param root Mount point the file was found under, included files stay below it
+ * @param buf Read buffer, at least 256 bytes
+ * @param buf_size Size of buf
+ * @return ESP_OK
+ * @return ESP_FAIL if sending failed
+ */
+esp_err_t wifi_ssi_send(httpd_req_t *req, FILE *f, const char *path, const char *root, char *buf, size_t buf_size);
+
+/**
+ * @brief Drop all cached directive positions.
+ *
+ * Called by the component when the SD card is mounted or unmounted.
+ */
+void wifi_ssi_card_changed(void);
+
+#endif
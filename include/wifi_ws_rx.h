@@ -0,0 +1,96 @@
+/**
+ * @file wifi_ws_rx.h
+ * @brief Allocation-free WebSocket frame reception
+ *
+ * Reads incoming WebSocket frames into a fixed pool of size-classed buffers
+ * (or into a caller-supplied buffer) instead of allocating per frame from the
+ * heap. The buffer is handed to a callback and returned to the pool as soon as
+ * the callback returns.
+ *
+ * Fragmented WebSocket messages are delivered fragment by fragment: the first
+ * callback has the message type and `final == false`, the following ones have
+ * type HTTPD_WS_TYPE_CONTINUE, and the last one has `final == true`. Large
+ * payloads should therefore be sent fragmented by the client. A single frame
+ * larger than the largest buffer class cannot be received and is rejected with
+ * ESP_ERR_INVALID_SIZE, which closes the connection when returned from the
+ * WebSocket handler.
+ *
+ * @note Requires CONFIG_HTTPD_WS_SUPPORT.
+ */
+
+#ifndef WIFI_WS_RX_H
+#define WIFI_WS_RX_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+/** @brief Number of buffer size classes in the receive pool */
+#define WIFI_WS_RX_CLASS_COUNT 3
+
+/**
+ * @brief Callback invoked with a received frame.
+ *
+ * The payload is NUL-terminated one byte past `frame->len`, so text frames can
+ * be used as C strings. It is only valid during the call. `frame->payload` is
+ * NULL for frames without payload (e.g. an empty close frame).
+ *
+ * @param req WebSocket request handle
+ * @param frame Received frame
+ * @param ctx User context
+ * @return Value returned from wifi_ws_recv() / wifi_ws_recv_into()
+ */
+typedef esp_err_t (*wifi_ws_rx_cb_t)(httpd_req_t *req, httpd_ws_frame_t *frame, void *ctx);
+
+/**
+ * @brief Receive pool statistics.
+ */
+typedef struct {
+    uint32_t frames;                                ///< Frames received through the helpers
+    uint64_t bytes;                                 ///< Payload bytes received
+    uint32_t oversize;                              ///< Frames rejected as larger than the largest class / caller buffer
+    uint32_t exhausted;                             ///< Frames rejected because no buffer was free
+    uint32_t class_size[WIFI_WS_RX_CLASS_COUNT];    ///< Payload capacity of each class
+    uint32_t class_hits[WIFI_WS_RX_CLASS_COUNT];    ///< Frames served from each class
+    uint8_t class_high_water[WIFI_WS_RX_CLASS_COUNT]; ///< Most buffers of each class in use at once
+} wifi_ws_rx_stats_t;
+
+/**
+ * @brief Receive one WebSocket frame into a pooled buffer.
+ *
+ * Call from a WebSocket URI handler instead of httpd_ws_recv_frame().
+ * The smallest free buffer that fits the payload is used; if every buffer of
+ * that class is busy, the next larger class is tried.
+ *
+ * @param req WebSocket request handle
+ * @param cb Callback receiving the frame
+ * @param ctx User context passed to the callback
+ * @return Return value of the callback
+ * @return ESP_ERR_INVALID_SIZE if the frame is larger than the largest class
+ * @return ESP_ERR_NO_MEM if no buffer large enough is free
+ * @return Error code from httpd_ws_recv_frame() on receive failure
+ */
+esp_err_t wifi_ws_recv(httpd_req_t *req, wifi_ws_rx_cb_t cb, void *ctx);
+
+/**
+ * @brief Receive one WebSocket frame into a caller-supplied buffer.
+ *
+ * @param req WebSocket request handle
+ * @param buf Buffer for the payload, one byte is reserved for the NUL terminator
+ * @param buf_len Size of the buffer
+ * @param cb Callback receiving the frame
+ * @param ctx User context passed to the callback
+ * @return Same as wifi_ws_recv()
+ */
+esp_err_t wifi_ws_recv_into(httpd_req_t *req, uint8_t *buf, size_t buf_len, wifi_ws_rx_cb_t cb, void *ctx);
+
+/**
+ * @brief Get receive pool statistics.
+ *
+ * @param stats Structure to fill
+ */
+void wifi_ws_rx_get_stats(wifi_ws_rx_stats_t *stats);
+
+#endif
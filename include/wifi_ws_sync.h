@@ -0,0 +1,142 @@
+/**
+ * @file wifi_ws_sync.h
+ * @brief Coalescing binary value-sync protocol for WebSocket dashboards
+ *
+ * Batches many typed values into a single binary WebSocket frame. Values set
+ * from the application are coalesced per key and flushed by a send-side timer,
+ * so only the latest value of each key goes out in every tick.
+ *
+ * Frame layout (all multi-byte fields little-endian):
+ *
+ * | Offset | Size | Field                                        |
+ * |--------|------|----------------------------------------------|
+ * | 0      | 1    | Magic byte, WIFI_WS_SYNC_MAGIC               |
+ * | 1      | 1    | Protocol version, WIFI_WS_SYNC_VERSION       |
+ * | 2      | 2    | Sequence number (wraps around)               |
+ * | 4      | 1    | Number of entries                            |
+ * | 5      | 1    | Flags (WIFI_WS_SYNC_FLAG_*)                  |
+ * | 6      | ...  | Entries                                      |
+ *
+ * Each entry is a key byte, a type byte (wifi_ws_sync_type_t) and the value:
+ * - WIFI_WS_SYNC_TYPE_INT: zigzag LEB128 varint (1-5 bytes). When the frame
+ *   has WIFI_WS_SYNC_FLAG_DELTA set, the value is the difference to the value
+ *   sent for the same key in the previous frame.
+ * - WIFI_WS_SYNC_TYPE_FLOAT: IEEE-754 float32 (4 bytes), always absolute.
+ *
+ * Delta frames are only sent server -> client. A client that connects late or
+ * detects a gap in the sequence numbers sends an empty frame with
+ * WIFI_WS_SYNC_FLAG_RESYNC set, and the next tick carries a full keyframe.
+ * Frames from clients must carry absolute values.
+ *
+ * @note Requires CONFIG_HTTPD_WS_SUPPORT. The matching JavaScript helpers are in
+ *       examples/full/webpage/ws.js.
+ */
+
+#ifndef WIFI_WS_SYNC_H
+#define WIFI_WS_SYNC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#define WIFI_WS_SYNC_MAGIC        0xB5    ///< First byte of every sync frame
+#define WIFI_WS_SYNC_VERSION      1       ///< Current protocol version
+#define WIFI_WS_SYNC_HEADER_LEN   6       ///< Length of the frame header in bytes
+
+#define WIFI_WS_SYNC_FLAG_DELTA   0x01    ///< Integer values are deltas against the previous frame
+#define WIFI_WS_SYNC_FLAG_RESYNC  0x02    ///< Sender asks for a full keyframe
+
+/**
+ * @brief Type of a synchronized value.
+ */
+typedef enum {
+    WIFI_WS_SYNC_TYPE_INT = 0,      ///< Signed 32-bit integer, delta-encodable
+    WIFI_WS_SYNC_TYPE_FLOAT = 1,    ///< 32-bit float, always sent absolute
+} wifi_ws_sync_type_t;
+
+/**
+ * @brief One decoded key/value pair.
+ */
+typedef struct {
+    uint8_t key;                ///< Application-defined key
+    wifi_ws_sync_type_t type;   ///< Type of the value
+    union {
+        int32_t i;              ///< Value if type is WIFI_WS_SYNC_TYPE_INT
+        float f;                ///< Value if type is WIFI_WS_SYNC_TYPE_FLOAT
+    };
+} wifi_ws_sync_value_t;
+
+/**
+ * @brief Callback invoked for every value decoded from an incoming frame.
+ *
+ * @param value Decoded value, only valid during the call
+ * @param ctx User context passed to wifi_ws_sync_decode()
+ */
+typedef void (*wifi_ws_sync_value_cb_t)(const wifi_ws_sync_value_t *value, void *ctx);
+
+/**
+ * @brief Create the coalescing timer.
+ *
+ * Called by wifi_init(). Values set before this are kept and sent on the first tick.
+ *
+ * @return ESP_OK on success, error code from esp_timer_create otherwise
+ */
+esp_err_t wifi_ws_sync_init(void);
+
+/**
+ * @brief Publish an integer value to all connected WebSocket clients.
+ *
+ * Only the latest value per key is sent in the next tick
+ * (CONFIG_WIFI_WS_SYNC_TICK_MS).
+ *
+ * @param key Application-defined key
+ * @param value New value
+ * @return ESP_OK on success
+ * @return ESP_ERR_NO_MEM if CONFIG_WIFI_WS_SYNC_MAX_KEYS keys are already in use
+ * @return ESP_ERR_INVALID_ARG if the key is already used with another type
+ */
+esp_err_t wifi_ws_sync_set_int(uint8_t key, int32_t value);
+
+/**
+ * @brief Publish a float value to all connected WebSocket clients.
+ *
+ * @param key Application-defined key
+ * @param value New value
+ * @return Same as wifi_ws_sync_set_int()
+ */
+esp_err_t wifi_ws_sync_set_float(uint8_t key, float value);
+
+/**
+ * @brief Send all known values as absolute values in the next tick.
+ */
+void wifi_ws_sync_request_keyframe(void);
+
+/**
+ * @brief Check whether a binary WebSocket payload is a sync frame.
+ *
+ * @param payload Frame payload
+ * @param len Payload length
+ * @return true if the payload starts with a sync header of a supported version
+ */
+bool wifi_ws_sync_is_frame(const uint8_t *payload, size_t len);
+
+/**
+ * @brief Decode a sync frame received from a client.
+ *
+ * Invokes the callback for every entry. A frame with WIFI_WS_SYNC_FLAG_RESYNC
+ * set schedules a keyframe.
+ *
+ * @param payload Frame payload
+ * @param len Payload length
+ * @param cb Callback for decoded values, may be NULL
+ * @param ctx User context passed to the callback
+ * @return ESP_OK on success
+ * @return ESP_ERR_INVALID_VERSION if the header is not a supported sync header
+ * @return ESP_ERR_NOT_SUPPORTED if the frame carries delta values
+ * @return ESP_ERR_INVALID_SIZE if the frame is truncated
+ */
+esp_err_t wifi_ws_sync_decode(const uint8_t *payload, size_t len, wifi_ws_sync_value_cb_t cb, void *ctx);
+
+#endif
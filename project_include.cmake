@@ -0,0 +1,64 @@
+# wifi_assets_create_partition_image
+#
+# Pack a web directory into a read-only asset image (see tools/pack_assets.py and
+# wifi_assets.h) for the given data partition and add a <partition>-flash target.
+#
+# wifi_assets_create_partition_image(<partition> <base_dir> [FLASH_IN_PROJECT] [GZIP] [GZIP_PLAIN]
+#                                    [DEPENDS dep dep dep...])
+#
+# FLASH_IN_PROJECT also writes the image with "idf.py flash", GZIP stores compressible
+# files pre-compressed, GZIP_PLAIN keeps an uncompressed copy of them for clients that
+# do not accept gzip. DEPENDS lists targets that generate files in base_dir.
+
+# Remembered here, the function runs later from the project's CMakeLists.txt
+set(WIFI_ASSETS_PACK_TOOL ${CMAKE_CURRENT_LIST_DIR}/tools/pack_assets.py CACHE INTERNAL "")
+
+function(wifi_assets_create_partition_image partition base_dir)
+    set(options FLASH_IN_PROJECT GZIP GZIP_PLAIN)
+    set(multi DEPENDS)
+    cmake_parse_arguments(arg "${options}" "" "${multi}" "${ARGN}")
+
+    idf_build_get_property(python PYTHON)
+    set(pack_assets ${WIFI_ASSETS_PACK_TOOL})
+    get_filename_component(base_dir_full_path ${base_dir} ABSOLUTE)
+
+    partition_table_get_partition_info(size "--partition-name ${partition}" "size")
+    partition_table_get_partition_info(offset "--partition-name ${partition}" "offset")
+
+    if("${size}" AND "${offset}")
+        set(image_file ${CMAKE_BINARY_DIR}/${partition}.bin)
+        set(gzip_flag)
+        if(arg_GZIP)
+            set(gzip_flag --gzip)
+            if(arg_GZIP_PLAIN)
+                list(APPEND gzip_flag --gzip-plain)
+            endif()
+        endif()
+
+        file(GLOB_RECURSE asset_files CONFIGURE_DEPENDS ${base_dir_full_path}/*)
+
+        add_custom_command(OUTPUT ${image_file}
+            COMMAND ${python} ${pack_assets} pack ${base_dir_full_path} ${image_file} --size ${size} ${gzip_flag}
+            DEPENDS ${asset_files} ${pack_assets} ${arg_DEPENDS}
+            COMMENT "Packing web assets from ${base_dir} into ${partition}.bin"
+            VERBATIM)
+        add_custom_target(wifi_assets_${partition}_bin ALL DEPENDS ${image_file})
+
+        set_property(DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}" APPEND PROPERTY
+            ADDITIONAL_CLEAN_FILES ${image_file})
+
+        idf_component_get_property(main_args esptool_py FLASH_ARGS)
+        idf_component_get_property(sub_args esptool_py FLASH_SUB_ARGS)
+        esptool_py_flash_target(${partition}-flash "${main_args}" "${sub_args}")
+        esptool_py_flash_target_image(${partition}-flash "${partition}" "${offset}" "${image_file}")
+        add_dependencies(${partition}-flash wifi_assets_${partition}_bin)
+
+        if(arg_FLASH_IN_PROJECT)
+            esptool_py_flash_target_image(flash "${partition}" "${offset}" "${image_file}")
+            add_dependencies(flash wifi_assets_${partition}_bin)
+        endif()
+    else()
+        message(FATAL_ERROR "Failed to create asset image for partition '${partition}', "
+                            "check that it exists in the partition table")
+    endif()
+endfunction()
@@ -16,17 +16,37 @@
 #include "lwip/inet.h"
 #include "mdns.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "sdkconfig.h"
 #include "led_indicator.h"
 #include "driver/sdspi_host.h"
 #include "driver/spi_common.h"
+#include "driver/gpio.h"
 #include "sdmmc_cmd.h"
 #include "esp_vfs_fat.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "wifi_ws_sync.h"
+#include "wifi_util.h"
+#include "wifi_trace.h"
+#include "wifi_arena.h"
+#include "wifi_handlers.h"
+#include "wifi_server.h"
+#include "wifi_assets.h"
+#include "wifi_upload.h"
+#include "wifi_sdlog.h"
+#include "wifi_ota.h"
+#include "wifi_probe.h"
+#include "wifi_clients.h"
+#include "wifi_session.h"
+#include "wifi_ssi.h"
+#include "wifi_netstats.h"
 
 #include <dirent.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 
@@ -53,18 +73,66 @@ static httpd_uri_t custom_handlers[CONFIG_WIFI_MAX_CUSTOM_HTTP_HANDLERS];
 /** @brief Count of currently registered custom HTTP handlers */
 static size_t custom_handler_count = 0;
 
-/** @brief Maximum number of client IPs to track for captive portal redirect */
-#define MAX_REDIRECTED_IPS 10
+/** @brief Built-in URI handlers registered on the running server, at most WIFI_BUILTIN_HTTP_HANDLERS */
+static int builtin_handler_count = 0;
 
-/** @brief Array tracking IPs that have already been redirected to prevent redirect loops */
-static uint32_t redirected_ips[MAX_REDIRECTED_IPS];
+/** @brief Receive timeouts in a row before a captive portal POST is abandoned */
+#define CAPTIVE_POST_MAX_TIMEOUTS 3
 
-/** @brief Number of IPs currently tracked in redirected_ips array */
-static int redirected_count = 0;
+/** @brief Captive portal API (RFC 8908), advertised in DHCP option 114 with CONFIG_WIFI_CAPTIVE_DHCP_URI */
+#define CAPTIVE_API_URI "/captive-api"
+
+/** @brief Captive portal discovery counters, DNS queries are kept by the DNS server */
+static wifi_captive_stats_t captive_stats = { 0 };
+
+/** @brief Counters at the start of the current captive portal session */
+static wifi_captive_stats_t captive_session_start = { 0 };
+
+/** @brief Per-platform counters at the start of the current captive portal session */
+static wifi_client_os_stats_t captive_session_os_start[WIFI_CLIENT_OS_COUNT];
 
 /** @brief FreeRTOS event group for WiFi state management and mode switching */
 static EventGroupHandle_t wifi_event_group;
 
+/** @brief Stack size of the mode switch listener task */
+#define LISTENER_TASK_STACK_SIZE 4096
+
+#ifdef CONFIG_WIFI_STATIC_ALLOCATION
+/** @brief Storage of the event group, see CONFIG_WIFI_STATIC_ALLOCATION */
+static StaticEventGroup_t wifi_event_group_storage;
+
+/** @brief Control block of the mode switch listener task */
+static StaticTask_t listener_task_tcb;
+
+/** @brief Stack of the mode switch listener task */
+static StackType_t listener_task_stack[LISTENER_TASK_STACK_SIZE];
+
+/** @brief Storage of the HTTP server lock */
+static StaticSemaphore_t server_lock_storage;
+#endif
+
+/** @brief Running captive DNS server, NULL when stopped */
+static dns_server_handle_t dns_server = NULL;
+
+/** @brief Mode switch listener task handle */
+static TaskHandle_t listener_task = NULL;
+
+/**
+ * @brief Core and priority of a component task.
+ */
+typedef struct {
+    int core;       ///< Core to pin the task to, WIFI_TASK_NO_AFFINITY for any
+    int priority;   ///< FreeRTOS priority
+} task_placement_t;
+
+/** @brief Placement of the component tasks, see wifi_set_task_placement() */
+static task_placement_t task_placement[WIFI_TASK_COUNT] = {
+    [WIFI_TASK_LISTENER] = { CONFIG_WIFI_LISTENER_TASK_CORE, CONFIG_WIFI_LISTENER_TASK_PRIORITY },
+    [WIFI_TASK_DNS] = { CONFIG_WIFI_DNS_TASK_CORE, CONFIG_WIFI_DNS_TASK_PRIORITY },
+    [WIFI_TASK_HTTPD] = { CONFIG_WIFI_HTTPD_TASK_CORE, CONFIG_WIFI_HTTPD_TASK_PRIORITY },
+    [WIFI_TASK_WORKER] = { CONFIG_WIFI_WORKER_TASK_CORE, CONFIG_WIFI_WORKER_TASK_PRIORITY },
+};
+
 /** @brief Event bit indicating WiFi is connected to an AP (STA mode) */
 static const int CONNECTED_BIT = BIT0;
 
@@ -83,15 +151,133 @@ static const int RECONECT_BIT = BIT4;
 /** @brief Event bit to trigger mDNS configuration update */
 static const int mDNS_CHANGE_BIT = BIT5;
 
+/** @brief Event bit set by the SD card monitor when the card was inserted or removed */
+static const int SD_CARD_CHANGE_BIT = BIT6;
+
+/** @brief Event bit set by the restart timer, see wifi_request_restart() */
+static const int RESTART_BIT = BIT7;
+
+/** @brief Event bit to set a changed static IP address on the STA interface */
+static const int NETIF_CHANGE_BIT = BIT8;
+
+/** @brief Event bit to switch the STA interface between DHCP and a static IP */
+static const int DHCP_CHANGE_BIT = BIT9;
+
 /** @brief HTTP server handle, NULL when server is not running */
 httpd_handle_t server = NULL;
 
+/** @brief Held while the HTTP server stops, see wifi_queue_http_work() */
+static SemaphoreHandle_t server_lock = NULL;
+
 /** @brief Counter for consecutive STA connection failures */
 static int sta_fails_count = 0;
 
 /** @brief Flag indicating whether SD card is mounted and available */
 bool SD_card_present = false;
 
+/** @brief Mounted SD card, NULL when no card is mounted */
+static sdmmc_card_t *sd_card = NULL;
+
+/** @brief SPI bus of the SD card is initialized, it stays initialized across remounts */
+static bool sd_spi_bus_ready = false;
+
+/** @brief Card state reported by the SD card monitor, applied by the listener task */
+static volatile bool sd_card_inserted = false;
+
+/** @brief Handler currently registered for the wildcard URI in STA/AP mode, NULL in captive mode or while stopped */
+static esp_err_t (*web_root_handler)(httpd_req_t *req) = NULL;
+
+/** @brief Custom handlers are registered on the running server */
+static bool custom_handlers_registered = false;
+
+#ifdef CONFIG_WIFI_SD_HOTPLUG
+/** @brief SD card monitor task stack size */
+#define SD_MONITOR_TASK_STACK_SIZE 3072
+
+/** @brief Time for card detect contacts to settle after an edge */
+#define SD_CD_DEBOUNCE_MS 200
+
+/** @brief Longest interval between mount attempts while no card is inserted */
+#define SD_PROBE_MAX_INTERVAL_MS (16 * CONFIG_WIFI_SD_PROBE_INTERVAL_MS)
+
+/** @brief SD card monitor task handle */
+static TaskHandle_t sd_monitor_task_handle = NULL;
+
+#ifdef CONFIG_WIFI_STATIC_ALLOCATION
+/** @brief Control block of the SD card monitor task */
+static StaticTask_t sd_monitor_task_tcb;
+
+/** @brief Stack of the SD card monitor task */
+static StackType_t sd_monitor_task_stack[SD_MONITOR_TASK_STACK_SIZE];
+#endif
+#endif
+
+/** @brief Longest wait of the listener task for the HTTP server to apply an SD card change */
+#define SD_APPLY_TIMEOUT_MS 5000
+
+#ifdef CONFIG_WIFI_SDLOG
+/** @brief URI prefix of the SD card log files */
+#define SDLOG_URI_PREFIX "/" CONFIG_WIFI_SDLOG_DIR "/"
+
+/** @brief Longest wait for queued log records before a log file is sent */
+#define SDLOG_DOWNLOAD_FLUSH_TIMEOUT_MS 1000
+#endif
+
+/** @brief Poll interval while waiting for an OTA update before a restart */
+#define RESTART_POLL_MS 100
+
+/** @brief Shortest wait for queued SD card log records before a restart */
+#define RESTART_MIN_FLUSH_MS 200
+
+/** @brief Time for the /restart response to reach the client */
+#define RESTART_RESPONSE_DELAY_MS 1000
+
+/** @brief One-shot timer setting RESTART_BIT, created on first use */
+static esp_timer_handle_t restart_timer = NULL;
+
+/** @brief A restart is scheduled */
+static bool restart_pending = false;
+
+/** @brief Let requests in progress finish before the scheduled restart */
+static bool restart_drain = false;
+
+/** @brief Set while requests are drained before a restart, new connections are refused */
+static volatile bool restart_draining = false;
+
+/** @brief Protects restart_pending */
+static portMUX_TYPE restart_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief Mask bit of a wifi_apply_t action */
+#define APPLY_BIT(action) (1u << (action))
+
+/** @brief Longest wait for the old connection to drop before reassociating */
+#define REASSOC_DISCONNECT_TIMEOUT_MS 2000
+
+/** @brief Poll interval while waiting for the old connection to drop */
+#define REASSOC_POLL_MS 10
+
+/** @brief Names of the wifi_apply_t actions, for logs */
+static const char *const apply_names[WIFI_APPLY_COUNT] = { "netif", "DHCP", "mDNS", "reassociation", "mode switch" };
+
+/** @brief Downtime per settings change action */
+static wifi_apply_stats_t apply_stats[WIFI_APPLY_COUNT];
+
+/** @brief Action that ends when the STA interface gets an IP address, WIFI_APPLY_COUNT for none */
+static wifi_apply_t apply_waiting = WIFI_APPLY_COUNT;
+
+/** @brief Start of the action in apply_waiting */
+static int64_t apply_wait_start_us = 0;
+
+/** @brief Protects apply_stats, apply_waiting and apply_wait_start_us */
+static portMUX_TYPE apply_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief mDNS settings in effect, compared with captive_cfg so that only changed ones are set */
+static struct {
+    bool running;
+    char hostname[sizeof(((captive_portal_config *)0)->mDNS_hostname)];
+    char service_name[sizeof(((captive_portal_config *)0)->service_name)];
+} mdns_applied = { 0 };
+
 /** @brief HTTP server configuration structure */
 static httpd_config_t httpd_config = HTTPD_DEFAULT_CONFIG();
 
@@ -234,6 +420,18 @@ const blink_step_t *led_blink_list[BLINK_MAX] = {
  */
 esp_err_t mount_sd_card();
 
+/**
+ * @brief Unmount the SD card, the SPI bus stays initialized for a later mount.
+ */
+void unmount_sd_card(void);
+
+#ifdef CONFIG_WIFI_SSI
+/**
+ * @brief Register the built-in template variables ip, ssid, ap_ssid and hostname.
+ */
+void register_ssi_vars(void);
+#endif
+
 /**
  * @brief Initialize WiFi in captive portal AP mode.
  * 
@@ -280,6 +478,65 @@ void set_nvs_wifi_settings(captive_portal_config *cfg);
  */
 void fill_captive_portal_config_struct(captive_portal_config *cfg);
 
+/**
+ * @brief Classify changed settings by the actions that apply them.
+ * 
+ * Settings of a mode that is not running are only saved, they take effect
+ * with the next switch to that mode. The captive portal runs in place of STA
+ * mode when it could not connect, so changed STA credentials switch back to
+ * STA mode there.
+ * 
+ * @param old Settings in effect
+ * @param cfg New settings
+ * @param mode Current WiFi mode
+ * @return Mask of APPLY_BIT() of the actions needed, 0 for none
+ */
+static uint32_t settings_diff(const captive_portal_config *old, const captive_portal_config *cfg, wifi_mode_t mode);
+
+/**
+ * @brief Describe a mask of actions for logs.
+ * 
+ * @param actions Mask of APPLY_BIT()
+ * @param buf Buffer for the text
+ * @param size Size of buf
+ * @return buf
+ */
+static const char *apply_describe(uint32_t actions, char *buf, size_t size);
+
+/**
+ * @brief Record the downtime of an applied change and log it.
+ * 
+ * @param action Action taken
+ * @param start_us esp_timer time the action started
+ */
+static void apply_record(wifi_apply_t action, int64_t start_us);
+
+/**
+ * @brief Record an action when the STA interface gets its next IP address.
+ * 
+ * @param action Action being taken
+ * @param start_us esp_timer time the action started
+ */
+static void apply_wait_for_ip(wifi_apply_t action, int64_t start_us);
+
+/**
+ * @brief Set the STA interface to the static IP address or DHCP of captive_cfg.
+ */
+static void apply_sta_ip_config(void);
+
+/**
+ * @brief Start, stop or rename mDNS to match captive_cfg.
+ * 
+ * Only the settings that differ from the ones in effect are set, so a new
+ * service name does not announce the hostname again.
+ */
+static void mdns_apply(void);
+
+/**
+ * @brief Stop mDNS if it is running.
+ */
+static void mdns_stop(void);
+
 // WiFi configuration helpers
 
 /**
@@ -320,6 +577,55 @@ wifi_config_t captive_ap_wifi_config(captive_portal_config *cfg);
  */
 void wifi_event_group_listener_task(void *pvParameter);
 
+/**
+ * @brief HTTP server session open callback.
+ * 
+ * Refuses new connections while requests are drained before a restart, and
+ * otherwise sets up the session limits and counters, see wifi_session.h.
+ * 
+ * @param hd Server handle
+ * @param sockfd Socket of the new connection
+ * @return ESP_OK to accept the connection, ESP_FAIL to close it
+ */
+static esp_err_t http_session_open(httpd_handle_t hd, int sockfd);
+
+/**
+ * @brief Restart timer callback, hands the restart to the listener task.
+ * 
+ * @param arg Unused
+ */
+static void restart_timer_cb(void *arg);
+
+/**
+ * @brief Restart the device as scheduled by wifi_request_restart().
+ * 
+ * Runs in the listener task and does not return.
+ */
+static void restart_now(void);
+
+#ifdef CONFIG_WIFI_SD_HOTPLUG
+/**
+ * @brief FreeRTOS task that mounts and unmounts the SD card when it is inserted or removed.
+ * 
+ * @param pvParameter Unused task parameter
+ */
+void sd_monitor_task(void *pvParameter);
+
+#if CONFIG_WIFI_SD_CD_PIN >= 0
+/**
+ * @brief Read the card detect switch.
+ * 
+ * @return true if a card is in the slot
+ */
+bool sd_card_detected(void);
+
+/**
+ * @brief Card detect GPIO interrupt, wakes the SD card monitor task.
+ */
+void sd_card_detect_isr(void *arg);
+#endif
+#endif
+
 // HTTP handler registration helpers
 
 /**
@@ -336,6 +642,61 @@ void register_custom_http_handlers(void);
  */
 void register_captive_portal_handlers(void);
 
+/**
+ * @brief Register diagnostic HTTP handlers (event trace dump, station table) in every mode.
+ */
+void register_diagnostic_handlers(void);
+
+/**
+ * @brief Register the SD card upload handler (CONFIG_WIFI_UPLOAD) in STA/AP modes.
+ */
+void register_upload_handler(void);
+
+/**
+ * @brief Register the firmware update handler (CONFIG_WIFI_OTA) in STA/AP modes.
+ */
+void register_ota_handler(void);
+
+/**
+ * @brief Register the wildcard handler in STA/AP modes, with the custom handlers when web files can be served.
+ */
+void register_web_root_handler(void);
+
+/**
+ * @brief Swap the wildcard handler after the web root became available or unavailable.
+ * 
+ * Must run in the HTTP server task (see httpd_queue_work()) or while the server is stopped.
+ */
+void update_web_root_handler(void);
+
+/**
+ * @brief Get the FreeRTOS core ID a component task should be created on.
+ * 
+ * @param task Component task
+ * @return Core ID, tskNO_AFFINITY if the task is not pinned or the core does not exist on this chip
+ */
+BaseType_t task_core_id(wifi_task_t task);
+
+/**
+ * @brief Start the HTTP server with the configured task placement.
+ */
+void start_http_server(void);
+
+/**
+ * @brief Register a built-in URI handler in the slots reserved for built-in handlers.
+ * 
+ * @param uri URI handler to register
+ * @return ESP_OK on success
+ * @return ESP_ERR_NO_MEM if WIFI_BUILTIN_HTTP_HANDLERS are already registered
+ * @return Error code from wifi_arena_register_uri on registration failure
+ */
+static esp_err_t register_builtin_uri(const httpd_uri_t *uri);
+
+/**
+ * @brief Start the captive portal DNS server with the configured task placement.
+ */
+void start_captive_dns_server(void);
+
 // HTTP request handlers
 
 /**
@@ -347,6 +708,53 @@ void register_captive_portal_handlers(void);
  */
 esp_err_t captive_error_redirect(httpd_req_t* req, httpd_err_code_t error);
 
+/**
+ * @brief HTTP GET handler for the captive portal API (RFC 8908).
+ * 
+ * @param req HTTP request handle
+ * @return ESP_OK on success
+ */
+esp_err_t captive_api_handler(httpd_req_t *req);
+
+/**
+ * @brief Update the probe redirect after the portal location changed.
+ * 
+ * @param arg Unused
+ */
+static void update_probe_location(void *arg);
+
+/**
+ * @brief Get the address of the client that sent a request.
+ * 
+ * @param req HTTP request handle
+ * @return Client address, 0 if unknown
+ */
+static uint32_t get_client_ip(httpd_req_t *req);
+
+/**
+ * @brief Get the address of the peer of a socket.
+ * 
+ * @param sockfd Connected socket
+ * @return Same as get_client_ip()
+ */
+static uint32_t get_socket_ip(int sockfd);
+
+/**
+ * @brief Record a probe in the client table.
+ * 
+ * @param req HTTP request handle of the probe
+ * @param[out] first Set to true for the first probe of the client, may be NULL
+ * @return Platform of the client
+ */
+static wifi_client_os_t note_probe(httpd_req_t *req, bool *first);
+
+/**
+ * @brief Advertise the captive portal API in DHCP option 114 (RFC 8910).
+ * 
+ * Must be called while the softAP DHCP server is stopped.
+ */
+static void set_captive_dhcp_uri(void);
+
 /**
  * @brief HTTP GET handler for captive portal page.
  * 
@@ -405,13 +813,37 @@ esp_err_t index_html_get_handler(httpd_req_t* req);
 esp_err_t wifi_status_json_handler(httpd_req_t* req);
 
 /**
- * @brief HTTP GET handler for serving files from SD card.
+ * @brief HTTP GET handler for the station table JSON.
+ * 
+ * @param req HTTP request handle
+ * @return ESP_OK on success
+ */
+esp_err_t stations_json_handler(httpd_req_t* req);
+
+/**
+ * @brief HTTP GET handler for serving files from SD card and flash assets.
  * 
  * @param req HTTP request handle
  * @return ESP_OK on success, error code on failure
  */
 esp_err_t sd_file_handler(httpd_req_t* req);
 
+/**
+ * @brief Send a file from the SD card as the response.
+ * 
+ * @param req HTTP request handle
+ * @return ESP_OK on success
+ * @return ESP_ERR_NOT_FOUND if the file does not exist, nothing has been sent
+ */
+esp_err_t send_sd_file(httpd_req_t* req);
+
+/**
+ * @brief Check whether web files can be served from the SD card or the flash asset image.
+ * 
+ * @return true if the file handler should be registered
+ */
+bool web_root_available(void);
+
 /**
  * @brief HTTP GET handler for /restart endpoint (reboots device).
  * 
@@ -457,6 +889,18 @@ esp_err_t wifi_init() {
     esp_log_level_set(TAG, CONFIG_LOG_LEVEL_WIFI); // Set log level for WiFi component
     esp_log_level_set(TAG_CAPTIVE, CONFIG_LOG_LEVEL_WIFI); // Set log level for captive portal
     esp_log_level_set(TAG_SD, CONFIG_LOG_LEVEL_WIFI); // Set log level for SD card component
+    esp_log_level_set("Wifi-WS_sync", CONFIG_LOG_LEVEL_WIFI); // Set log level for WebSocket value sync
+    esp_log_level_set("Wifi-Trace", CONFIG_LOG_LEVEL_WIFI); // Set log level for event trace
+    esp_log_level_set("Wifi-Arena", CONFIG_LOG_LEVEL_WIFI); // Set log level for request scratch arena
+    esp_log_level_set("Wifi-Assets", CONFIG_LOG_LEVEL_WIFI); // Set log level for flash assets
+    esp_log_level_set("Wifi-Upload", CONFIG_LOG_LEVEL_WIFI); // Set log level for SD card uploads
+    esp_log_level_set("Wifi-SD_Log", CONFIG_LOG_LEVEL_WIFI); // Set log level for SD card log sink
+    esp_log_level_set("Wifi-OTA", CONFIG_LOG_LEVEL_WIFI); // Set log level for firmware updates
+    esp_log_level_set("Wifi-Probe", CONFIG_LOG_LEVEL_WIFI); // Set log level for probe responses
+    esp_log_level_set("Wifi-Clients", CONFIG_LOG_LEVEL_WIFI); // Set log level for client tracking
+    esp_log_level_set("Wifi-Session", CONFIG_LOG_LEVEL_WIFI); // Set log level for session limits
+    esp_log_level_set("Wifi-SSI", CONFIG_LOG_LEVEL_WIFI); // Set log level for server-side includes
+    esp_log_level_set("Wifi-Netstats", CONFIG_LOG_LEVEL_WIFI); // Set log level for network statistics
     esp_log_level_set("dns_redirect_server", CONFIG_LOG_LEVEL_WIFI < ESP_LOG_WARN ? CONFIG_LOG_LEVEL_WIFI : ESP_LOG_WARN); // Set log level for this module
 
     ESP_LOGI(TAG, "Initializing WiFi...");
@@ -490,15 +934,55 @@ esp_err_t wifi_init() {
     
     led_indicator_start(led_handle, BLINK_LOADING); // Start LED indicator with loading animation
 
-    if (mount_sd_card() == ESP_OK) {
+#if CONFIG_WIFI_SD_HOTPLUG && CONFIG_WIFI_SD_CD_PIN >= 0
+    gpio_config_t cd_cfg = {
+        .pin_bit_mask = 1ULL << CONFIG_WIFI_SD_CD_PIN,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .intr_type = GPIO_INTR_ANYEDGE,
+    };
+    ESP_ERROR_CHECK(gpio_config(&cd_cfg));
+    bool try_mount = sd_card_detected();
+    if (!try_mount) {
+        ESP_LOGI(TAG_SD, "No SD card in the slot");
+    }
+#else
+    bool try_mount = true;
+#endif
+    if (try_mount && mount_sd_card() == ESP_OK) {
         ESP_LOGI(TAG_SD, "SD card mounted successfully");
         SD_card_present = true;
     } else {
-        ESP_LOGW(TAG_SD, "Falling back to basic server, running without SD card support");
+#ifdef CONFIG_WIFI_SD_HOTPLUG
+        ESP_LOGW(TAG_SD, "Running without SD card, it is mounted when inserted");
+#else
+        ESP_LOGW(TAG_SD, "Running without SD card support");
+#endif
         SD_card_present = false;
     }
+    sd_card_inserted = SD_card_present;
+
+#ifdef CONFIG_WIFI_SDLOG
+    // Start the SD card log writer, records are queued until a card is mounted
+    wifi_sdlog_init(SD_CARD_MOUNT_POINT);
+    wifi_sdlog_card_changed(SD_card_present);
+#endif
+
+#ifdef CONFIG_WIFI_ASSETS
+    // Map the flash asset image, serves web files with or without SD card
+    wifi_assets_init();
+#endif
+    if (!web_root_available()) {
+        ESP_LOGW(TAG, "No SD card and no flash assets, falling back to basic server");
+    }
 
+#ifdef CONFIG_WIFI_STATIC_ALLOCATION
+    wifi_event_group = xEventGroupCreateStatic(&wifi_event_group_storage);
+    server_lock = xSemaphoreCreateMutexStatic(&server_lock_storage);
+#else
     wifi_event_group = xEventGroupCreate();
+    server_lock = xSemaphoreCreateMutex();
+#endif
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     
@@ -508,9 +992,13 @@ esp_err_t wifi_init() {
 
     // Configure HTTP server
     httpd_config.lru_purge_enable = true;
-    httpd_config.max_uri_handlers = CONFIG_WIFI_MAX_CUSTOM_HTTP_HANDLERS + 8;
+    httpd_config.max_uri_handlers = CONFIG_WIFI_MAX_CUSTOM_HTTP_HANDLERS + WIFI_BUILTIN_HTTP_HANDLERS;
     httpd_config.uri_match_fn = httpd_uri_match_wildcard;
-    httpd_config.stack_size = 6144;  // Increase from default 4096 to handle captive portal detection bursts
+    httpd_config.stack_size = CONFIG_WIFI_HTTPD_STACK_SIZE;  // Handler buffers come from the request arena, not the stack
+    httpd_config.open_fn = http_session_open;
+    httpd_config.close_fn = wifi_session_close;
+    wifi_session_set_capacity(httpd_config.max_open_sockets);
+    wifi_netstats_init(httpd_config.server_port);
     
     // Set up default HTTP server configuration
     ap_netif = esp_netif_create_default_wifi_ap();
@@ -539,6 +1027,11 @@ esp_err_t wifi_init() {
     get_nvs_wifi_settings(&captive_cfg);
     ESP_LOGI(TAG, "STA SSID: %s, password: %s", captive_cfg.ssid, captive_cfg.password);
     ESP_LOGI(TAG, "AP SSID: %s, password: %s", captive_cfg.ap_ssid, captive_cfg.ap_password);
+#ifdef CONFIG_WIFI_SSI
+    register_ssi_vars();
+#endif
+
+    wifi_trace_action(WIFI_TRACE_ACTION_BOOT, captive_cfg.wifi_mode, 0, 0);
 
     // Decide startup mode based on saved wifi_mode and STA config
     if (captive_cfg.wifi_mode == WIFI_MODE_AP) {
@@ -552,8 +1045,40 @@ esp_err_t wifi_init() {
         xEventGroupSetBits(wifi_event_group, SWITCH_TO_STA_BIT);
     }
 
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    // Create the WebSocket value sync coalescing timer
+    wifi_ws_sync_init();
+#endif
+
     // Start WiFi mode switch task
-    xTaskCreate(wifi_event_group_listener_task, "wifi_event_group_listener_task", 4096, NULL, 4, NULL);
+#ifdef CONFIG_WIFI_STATIC_ALLOCATION
+    listener_task = xTaskCreateStaticPinnedToCore(wifi_event_group_listener_task, "wifi_event_group_listener_task", LISTENER_TASK_STACK_SIZE, NULL,
+                                                  task_placement[WIFI_TASK_LISTENER].priority, listener_task_stack, &listener_task_tcb, task_core_id(WIFI_TASK_LISTENER));
+#else
+    xTaskCreatePinnedToCore(wifi_event_group_listener_task, "wifi_event_group_listener_task", LISTENER_TASK_STACK_SIZE, NULL,
+                            task_placement[WIFI_TASK_LISTENER].priority, &listener_task, task_core_id(WIFI_TASK_LISTENER));
+#endif
+
+#ifdef CONFIG_WIFI_SD_HOTPLUG
+    // Start SD card monitor task
+#ifdef CONFIG_WIFI_STATIC_ALLOCATION
+    sd_monitor_task_handle = xTaskCreateStaticPinnedToCore(sd_monitor_task, "wifi_sd_monitor", SD_MONITOR_TASK_STACK_SIZE,
+                                                           NULL, task_placement[WIFI_TASK_WORKER].priority,
+                                                           sd_monitor_task_stack, &sd_monitor_task_tcb,
+                                                           task_core_id(WIFI_TASK_WORKER));
+#else
+    xTaskCreatePinnedToCore(sd_monitor_task, "wifi_sd_monitor", SD_MONITOR_TASK_STACK_SIZE, NULL,
+                            task_placement[WIFI_TASK_WORKER].priority, &sd_monitor_task_handle, task_core_id(WIFI_TASK_WORKER));
+#endif
+#if CONFIG_WIFI_SD_CD_PIN >= 0
+    esp_err_t isr_ret = gpio_install_isr_service(0);
+    if (isr_ret != ESP_OK && isr_ret != ESP_ERR_INVALID_STATE) {  // Already installed by the application
+        ESP_LOGE(TAG_SD, "Failed to install GPIO ISR service: %s", esp_err_to_name(isr_ret));
+    } else {
+        gpio_isr_handler_add(CONFIG_WIFI_SD_CD_PIN, sd_card_detect_isr, NULL);
+    }
+#endif
+#endif
 
     return ESP_OK;
 }
@@ -568,11 +1093,12 @@ esp_err_t wifi_init() {
  * @return Error code from SPI initialization or filesystem mount failure
  */
 esp_err_t mount_sd_card() {
-    ESP_LOGI(TAG_SD, "Mounting SD card...");
+    ESP_LOGD(TAG_SD, "Mounting SD card...");
 
     sdmmc_card_t *card;
     sdmmc_host_t host = SDSPI_HOST_DEFAULT();
     host.slot = SPI2_HOST;
+    host.max_freq_khz = CONFIG_WIFI_SD_SPI_FREQ_KHZ;
     spi_bus_config_t bus_cfg = {
         .mosi_io_num = CONFIG_PIN_WIFI_SD_MOSI,
         .miso_io_num = CONFIG_PIN_WIFI_SD_MISO,
@@ -581,10 +1107,14 @@ esp_err_t mount_sd_card() {
         .quadhd_io_num = -1,
         .max_transfer_sz = 4096,  // Default transfer size
     };
-    esp_err_t ret = spi_bus_initialize(host.slot, &bus_cfg, SPI_DMA_CH_AUTO);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG_SD, "Failed to initialize SPI bus: %s", esp_err_to_name(ret));
-        return ret;
+    esp_err_t ret;
+    if (!sd_spi_bus_ready) {
+        ret = spi_bus_initialize(host.slot, &bus_cfg, SPI_DMA_CH_AUTO);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG_SD, "Failed to initialize SPI bus: %s", esp_err_to_name(ret));
+            return ret;
+        }
+        sd_spi_bus_ready = true;
     }
 
     sdspi_device_config_t slot_config = SDSPI_DEVICE_CONFIG_DEFAULT();
@@ -606,7 +1136,16 @@ esp_err_t mount_sd_card() {
         return ret;
     }
 
+    sd_card = card;
     SD_card_present = true;
+#ifdef CONFIG_WIFI_SDLOG
+    wifi_sdlog_card_changed(true);
+#endif
+#ifdef CONFIG_WIFI_SSI
+    wifi_ssi_card_changed();
+#endif
+    ESP_LOGI(TAG_SD, "SD card %s, %" PRIu64 " MB, SPI %d kHz", card->cid.name,
+             ((uint64_t)card->csd.capacity * card->csd.sector_size) >> 20, card->real_freq_khz);
 
     DIR *dir = opendir(SD_CARD_MOUNT_POINT);
     if (!dir) {
@@ -623,6 +1162,29 @@ esp_err_t mount_sd_card() {
     return ESP_OK;
 }
 
+/**
+ * @brief Unmount the SD card.
+ * 
+ * Clears SD_card_present first so handlers stop using the card. The SPI bus
+ * stays initialized, mount_sd_card() reuses it.
+ */
+void unmount_sd_card(void) {
+    SD_card_present = false;
+    if (sd_card == NULL) return;
+#ifdef CONFIG_WIFI_SDLOG
+    wifi_sdlog_card_changed(false);   // Closes the log file
+#endif
+#ifdef CONFIG_WIFI_SSI
+    wifi_ssi_card_changed();
+#endif
+    esp_err_t ret = esp_vfs_fat_sdcard_unmount(SD_CARD_MOUNT_POINT, sd_card);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG_SD, "Failed to unmount SD card: %s", esp_err_to_name(ret));
+    }
+    sd_card = NULL;
+    ESP_LOGI(TAG_SD, "SD card unmounted");
+}
+
 /**
  * @brief Initialize WiFi in captive portal AP mode.
  * 
@@ -650,6 +1212,12 @@ void wifi_init_captive() {
     inet_ntoa_r(ip_info.ip.addr, ip_addr, 16);
     ESP_LOGI(TAG_CAPTIVE, "Set up softAP with IP: %s", ip_addr);
 
+    esp_netif_dhcps_stop(ap_netif);
+    set_captive_dhcp_uri();
+    esp_netif_dhcps_start(ap_netif);
+    wifi_get_captive_stats(&captive_session_start);
+    wifi_get_client_os_stats(captive_session_os_start);
+
     if (wifi_cfg.ap.authmode != WIFI_AUTH_OPEN) {
         ESP_LOGI(TAG_CAPTIVE, "SoftAP started: SSID:' %s' Password: '%s'", wifi_cfg.ap.ssid, wifi_cfg.ap.password);
     } else {
@@ -657,16 +1225,17 @@ void wifi_init_captive() {
     }
 
     // Start HTTP server and register handlers
+    update_probe_location(NULL);
     ESP_LOGD(TAG_CAPTIVE, "Starting web server on port: %d", httpd_config.server_port);
-    ESP_ERROR_CHECK(httpd_start(&server, &httpd_config));
+    start_http_server();
 
     register_captive_portal_handlers();
+    register_diagnostic_handlers();
 
-    ESP_ERROR_CHECK(httpd_register_err_handler(server, HTTPD_404_NOT_FOUND, captive_error_redirect));
+    ESP_ERROR_CHECK(wifi_arena_register_err_handler(server, HTTPD_404_NOT_FOUND, captive_error_redirect));
 
     // Start DNS server for captive portal redirection (highjack all DNS queries)
-    dns_server_config_t dns_config = DNS_SERVER_CONFIG_SINGLE("*" /* all A queries */, "WIFI_AP_DEF" /* softAP netif ID */);
-    start_dns_server(&dns_config);
+    start_captive_dns_server();
 }
 
 /**
@@ -684,83 +1253,54 @@ void wifi_init_sta() {
     ESP_ERROR_CHECK(esp_wifi_start());
     
     // Set static IP if requested
-    
-    esp_netif_ip_info_t ip_info = {0};
-    esp_netif_dhcpc_stop(sta_netif);
-    if (captive_cfg.use_static_ip) {
-        uint32_t new_ip = ntohl(captive_cfg.static_ip.addr);
-        ip_info.ip.addr = captive_cfg.static_ip.addr;
-        ip_info.gw.addr = htonl((new_ip & 0xFFFFFF00)|0x01);    // x.x.x.1
-        ip_info.netmask.addr = htonl((255 << 24) | (255 << 16) | (255 << 8) | 0);   // 255.255.255.0
-        esp_netif_set_ip_info(sta_netif, &ip_info);
-    } else {
-        esp_netif_dhcpc_start(sta_netif);
-    }
+    apply_sta_ip_config();
     
     // Log IP address
+    esp_netif_ip_info_t ip_info;
     esp_netif_get_ip_info(sta_netif, &ip_info);
     char ip_addr[16];
     inet_ntoa_r(ip_info.ip.addr, ip_addr, 16);
     ESP_LOGD(TAG, "Set up STA with IP: %s", ip_addr);
 
+    update_probe_location(NULL);
     ESP_LOGD(TAG, "Starting web server on port: %d", httpd_config.server_port);
-    ESP_ERROR_CHECK(httpd_start(&server, &httpd_config));
+    start_http_server();
 
-    httpd_register_err_handler(server, HTTPD_404_NOT_FOUND, not_found_handler);
+    wifi_arena_register_err_handler(server, HTTPD_404_NOT_FOUND, not_found_handler);
 
     // Register captive portal HTTP handlers (on /captive_portal for STA mode)
     register_captive_portal_handlers();
+    register_diagnostic_handlers();
+    register_upload_handler();
+    register_ota_handler();
 
     httpd_uri_t index_html_uri = {
         .uri = "/index.html",
         .method = HTTP_GET,
         .handler = index_html_get_handler
     };
-    httpd_register_uri_handler(server, &index_html_uri);
+    register_builtin_uri(&index_html_uri);
 
     httpd_uri_t wifi_status_json_uri = {
         .uri = "/wifi-status.json",
         .method = HTTP_GET,
         .handler = wifi_status_json_handler,
     };
-    httpd_register_uri_handler(server, &wifi_status_json_uri);
+    register_builtin_uri(&wifi_status_json_uri);
 
     httpd_uri_t restart_uri = {
         .uri = "/restart",
         .method = HTTP_GET,
         .handler = restart_handler
     };
-    httpd_register_uri_handler(server, &restart_uri);
+    register_builtin_uri(&restart_uri);
 
-    if (SD_card_present) {
-        // Register custom handlers
-        register_custom_http_handlers();
-
-        httpd_uri_t sd_file_uri = {
-            .uri = "/*",
-            .method = HTTP_GET,
-            .handler = sd_file_handler
-        };
-        httpd_register_uri_handler(server, &sd_file_uri);
-    } else {
-        httpd_uri_t no_sd_card_uri = {
-            .uri = "/*",
-            .method = HTTP_GET,
-            .handler = no_sd_card_handler
-        };
-        httpd_register_uri_handler(server, &no_sd_card_uri);
-    }
+    // Custom handlers and SD card / flash files, or the no SD card page
+    register_web_root_handler();
 
 
     // Start mDNS if enabled
-    if (captive_cfg.use_mDNS) {
-        ESP_ERROR_CHECK(mdns_init());
-        ESP_ERROR_CHECK(mdns_hostname_set(captive_cfg.mDNS_hostname));
-        ESP_ERROR_CHECK(mdns_instance_name_set(captive_cfg.service_name));
-        ESP_LOGI(TAG, "mDNS started: http://%s.local", captive_cfg.mDNS_hostname);
-        ESP_LOGI(TAG, "mDNS service started: %s", captive_cfg.service_name);
-        mdns_service_add(NULL, "_http", "_tcp", 80, NULL, 0);
-    }
+    mdns_apply();
 }
 
 /**
@@ -798,6 +1338,7 @@ void wifi_init_ap() {
     }
     
     ESP_ERROR_CHECK(esp_netif_set_ip_info(ap_netif, &ip_info));
+    set_captive_dhcp_uri();     // Clients that keep their lease learn from the API that the portal is gone
     ESP_ERROR_CHECK(esp_netif_dhcps_start(ap_netif));  // Start DHCP SERVER
     
     // Log IP address
@@ -805,69 +1346,48 @@ void wifi_init_ap() {
     inet_ntoa_r(ip_info.ip.addr, ip_addr, 16);
     ESP_LOGD(TAG, "Set up AP with IP: %s", ip_addr);
 
+    update_probe_location(NULL);
     ESP_LOGD(TAG, "Starting web server on port: %d", httpd_config.server_port);
-    ESP_ERROR_CHECK(httpd_start(&server, &httpd_config));
+    start_http_server();
 
-    ESP_ERROR_CHECK(httpd_register_err_handler(server, HTTPD_404_NOT_FOUND, not_found_handler));
+    ESP_ERROR_CHECK(wifi_arena_register_err_handler(server, HTTPD_404_NOT_FOUND, not_found_handler));
 
     // Register captive portal HTTP handlers (on /captive_portal for STA mode)
     register_captive_portal_handlers();
+    register_diagnostic_handlers();
+    register_upload_handler();
+    register_ota_handler();
 
     httpd_uri_t index_html_uri = {
         .uri = "/index.html",
         .method = HTTP_GET,
         .handler = index_html_get_handler
     };
-    httpd_register_uri_handler(server, &index_html_uri);
+    register_builtin_uri(&index_html_uri);
 
     httpd_uri_t wifi_status_json_uri = {
         .uri = "/wifi-status.json",
         .method = HTTP_GET,
         .handler = wifi_status_json_handler,
     };
-    httpd_register_uri_handler(server, &wifi_status_json_uri);
+    register_builtin_uri(&wifi_status_json_uri);
 
     httpd_uri_t restart_uri = {
         .uri = "/restart",
         .method = HTTP_GET,
         .handler = restart_handler
     };
-    httpd_register_uri_handler(server, &restart_uri);
-
-    if (SD_card_present) {
-        // Register custom handlers
-        register_custom_http_handlers();
+    register_builtin_uri(&restart_uri);
 
-        httpd_uri_t sd_file_uri = {
-            .uri = "/*",
-            .method = HTTP_GET,
-            .handler = sd_file_handler
-        };
-        httpd_register_uri_handler(server, &sd_file_uri);
-    } else {
-        // need to run wildcard handler even if no SD card to have captive redirect in AP mode
-        httpd_uri_t no_sd_card_uri = {
-            .uri = "/*",
-            .method = HTTP_GET,
-            .handler = no_sd_card_handler
-        };
-        httpd_register_uri_handler(server, &no_sd_card_uri);
-    }
+    // Wildcard handler is registered even without web files to have captive redirect in AP mode
+    register_web_root_handler();
 
 
     // Start mDNS if enabled
-    if (captive_cfg.use_mDNS) {
-        ESP_ERROR_CHECK(mdns_init());
-        ESP_ERROR_CHECK(mdns_hostname_set(captive_cfg.mDNS_hostname));
-        ESP_ERROR_CHECK(mdns_instance_name_set(captive_cfg.service_name));
-        ESP_LOGI(TAG, "mDNS started: http://%s.local", captive_cfg.mDNS_hostname);
-        ESP_LOGI(TAG, "mDNS service started: %s", captive_cfg.service_name);
-        mdns_service_add(NULL, "_http", "_tcp", 80, NULL, 0);
-    }
+    mdns_apply();
     
     // Start DNS server for captive portal redirection (highjack all DNS queries)
-    dns_server_config_t dns_config = DNS_SERVER_CONFIG_SINGLE("*" /* all A queries */, "WIFI_AP_DEF" /* softAP netif ID */);
-    start_dns_server(&dns_config);
+    start_captive_dns_server();
 }
 
 /**
@@ -878,6 +1398,7 @@ void wifi_init_ap() {
  * - POST /captive - Configuration submission handler
  * - GET /captive.json - Current configuration as JSON
  * - GET /scan.json - WiFi network scan results
+ * - GET /captive-api - Captive portal API (RFC 8908)
  * 
  * @note Only registers if server handle is not NULL
  */
@@ -889,41 +1410,125 @@ void register_captive_portal_handlers(void) {
         .method = HTTP_GET,
         .handler = captive_handler
     };
-    httpd_register_uri_handler(server, &captive_uri);
+    register_builtin_uri(&captive_uri);
 
     httpd_uri_t captive_post_uri = {
         .uri = "/captive",
         .method = HTTP_POST,
         .handler = captive_post_handler
     };
-    httpd_register_uri_handler(server, &captive_post_uri);
+    register_builtin_uri(&captive_post_uri);
 
     httpd_uri_t captive_json_uri = {
         .uri = "/captive.json",
         .method = HTTP_GET,
         .handler = captive_json_handler
     };
-    httpd_register_uri_handler(server, &captive_json_uri);
+    register_builtin_uri(&captive_json_uri);
 
     httpd_uri_t scan_json_uri = {
         .uri = "/scan.json",
         .method = HTTP_GET,
         .handler = scan_json_handler
     };
-    httpd_register_uri_handler(server, &scan_json_uri);
+    register_builtin_uri(&scan_json_uri);
+
+    httpd_uri_t captive_api_uri = {
+        .uri = CAPTIVE_API_URI,
+        .method = HTTP_GET,
+        .handler = captive_api_handler
+    };
+    register_builtin_uri(&captive_api_uri);
 }
 
 /**
- * @brief Register a custom HTTP handler for use in STA/AP modes.
+ * @brief Register diagnostic HTTP handlers with the web server.
  * 
- * Stores the handler in a registry and registers it immediately if the server
- * is running in STA or AP mode (not captive portal mode). Handlers are
- * re-registered automatically when switching modes.
+ * Registers the following endpoints:
+ * - GET /wifi-trace.bin - WiFi event trace dump (CONFIG_WIFI_EVENT_TRACE)
+ * - GET /stations.json - Station table and HTTP session counters
+ * - GET /netstats.json - lwIP, TCP, socket and DNS statistics with the last snapshot
  * 
- * @param uri Pointer to httpd_uri_t structure defining the handler
- * @return ESP_OK on success
- * @return ESP_ERR_INVALID_ARG if uri or handler is NULL
- * @return ESP_ERR_NO_MEM if maximum handlers exceeded
+ * @note Only registers if server handle is not NULL
+ */
+void register_diagnostic_handlers(void) {
+    if (server == NULL) return;
+
+#ifdef CONFIG_WIFI_EVENT_TRACE
+    httpd_uri_t trace_uri = {
+        .uri = "/wifi-trace.bin",
+        .method = HTTP_GET,
+        .handler = wifi_trace_http_handler
+    };
+    register_builtin_uri(&trace_uri);
+#endif
+
+    httpd_uri_t stations_uri = {
+        .uri = "/stations.json",
+        .method = HTTP_GET,
+        .handler = stations_json_handler
+    };
+    register_builtin_uri(&stations_uri);
+
+    httpd_uri_t netstats_uri = {
+        .uri = "/netstats.json",
+        .method = HTTP_GET,
+        .handler = wifi_netstats_http_handler
+    };
+    register_builtin_uri(&netstats_uri);
+}
+
+void register_upload_handler(void) {
+#ifdef CONFIG_WIFI_UPLOAD
+    static wifi_upload_ctx_t upload_ctx;
+    if (server == NULL) return;
+    if (strlen(CONFIG_WIFI_UPLOAD_TOKEN) == 0) {
+        ESP_LOGW(TAG, "Upload endpoint disabled, no upload token configured");
+        return;
+    }
+
+    upload_ctx.mount_point = SD_CARD_MOUNT_POINT;
+    upload_ctx.spi_freq_khz = CONFIG_WIFI_SD_SPI_FREQ_KHZ;
+    upload_ctx.card_present = &SD_card_present;
+    httpd_uri_t upload_uri = {
+        .uri = WIFI_UPLOAD_URI_PREFIX "/*",
+        .method = HTTP_PUT,
+        .handler = wifi_upload_handler,
+        .user_ctx = (void *)&upload_ctx,
+    };
+    register_builtin_uri(&upload_uri);
+#endif
+}
+
+void register_ota_handler(void) {
+#ifdef CONFIG_WIFI_OTA
+    if (server == NULL) return;
+    if (strlen(CONFIG_WIFI_OTA_TOKEN) == 0) {
+        ESP_LOGW(TAG, "Firmware update endpoint disabled, no update token configured");
+        return;
+    }
+
+    httpd_uri_t ota_uri = {
+        .uri = WIFI_OTA_URI,
+        .method = HTTP_POST,
+        .handler = wifi_ota_handler,
+        .user_ctx = NULL,
+    };
+    register_builtin_uri(&ota_uri);
+#endif
+}
+
+/**
+ * @brief Register a custom HTTP handler for use in STA/AP modes.
+ * 
+ * Stores the handler in a registry and registers it immediately if the server
+ * is running in STA or AP mode (not captive portal mode). Handlers are
+ * re-registered automatically when switching modes.
+ * 
+ * @param uri Pointer to httpd_uri_t structure defining the handler
+ * @return ESP_OK on success
+ * @return ESP_ERR_INVALID_ARG if uri or handler is NULL
+ * @return ESP_ERR_NO_MEM if maximum handlers exceeded
  * @return Error code from httpd_register_uri_handler on registration failure
  */
 esp_err_t wifi_register_http_handler(httpd_uri_t *uri) {
@@ -951,7 +1556,7 @@ esp_err_t wifi_register_http_handler(httpd_uri_t *uri) {
         }
         
         if (!is_captive_mode) {
-            esp_err_t err = httpd_register_uri_handler(server, uri);
+            esp_err_t err = wifi_arena_register_uri(server, uri);
             if (err != ESP_OK) {
                 ESP_LOGE(TAG, "Failed to register custom handler for %s: %s", uri->uri, esp_err_to_name(err));
             }
@@ -963,6 +1568,154 @@ esp_err_t wifi_register_http_handler(httpd_uri_t *uri) {
     return ESP_OK;
 }
 
+/**
+ * @brief Get the handle of the running HTTP server.
+ * 
+ * @return HTTP server handle, NULL if the server is not running
+ */
+httpd_handle_t wifi_get_http_server(void) {
+    return server;
+}
+
+esp_err_t wifi_queue_http_work(httpd_work_fn_t work) {
+    // Never wait: the caller may be the esp_timer task, and a stopping server takes no work anyway
+    if (server_lock == NULL || xSemaphoreTake(server_lock, 0) != pdTRUE) return ESP_ERR_INVALID_STATE;
+    esp_err_t err = server ? httpd_queue_work(server, work, server) : ESP_ERR_INVALID_STATE;
+    xSemaphoreGive(server_lock);
+    return err;
+}
+
+/**
+ * @brief Get the captive portal discovery counters.
+ * 
+ * @param stats Structure to fill
+ */
+void wifi_get_captive_stats(wifi_captive_stats_t *stats) {
+    dns_server_stats_t dns_stats;
+    dns_server_get_stats(&dns_stats);
+    *stats = captive_stats;
+    stats->dns_queries = dns_stats.queries;
+}
+
+/**
+ * @brief Set the core and priority of a component task.
+ * 
+ * @param task Task to configure
+ * @param core Core to pin the task to, or WIFI_TASK_NO_AFFINITY
+ * @param priority FreeRTOS priority
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if out of range
+ */
+esp_err_t wifi_set_task_placement(wifi_task_t task, int core, int priority) {
+    if (task < 0 || task >= WIFI_TASK_COUNT) return ESP_ERR_INVALID_ARG;
+    if (core != WIFI_TASK_NO_AFFINITY && (core < 0 || core >= portNUM_PROCESSORS)) return ESP_ERR_INVALID_ARG;
+    if (priority < 1 || priority >= configMAX_PRIORITIES) return ESP_ERR_INVALID_ARG;
+
+    task_placement[task].core = core;
+    task_placement[task].priority = priority;
+    ESP_LOGI(TAG, "Task %d placement: core %d, priority %d", task, core, priority);
+
+    if (task == WIFI_TASK_LISTENER && listener_task != NULL) {
+        vTaskPrioritySet(listener_task, priority);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Get the core and priority configured for a component task.
+ * 
+ * @param task Task to query
+ * @param core Configured core, may be NULL
+ * @param priority Configured priority, may be NULL
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if task is out of range
+ */
+esp_err_t wifi_get_task_placement(wifi_task_t task, int *core, int *priority) {
+    if (task < 0 || task >= WIFI_TASK_COUNT) return ESP_ERR_INVALID_ARG;
+    if (core) *core = task_placement[task].core;
+    if (priority) *priority = task_placement[task].priority;
+    return ESP_OK;
+}
+
+/**
+ * @brief Restart the device without blocking the caller.
+ * 
+ * @param delay_ms Time before the restart starts
+ * @param drain true to let requests in progress finish first
+ * @return ESP_OK if scheduled, ESP_ERR_INVALID_STATE if not initialized or already scheduled
+ */
+esp_err_t wifi_request_restart(uint32_t delay_ms, bool drain) {
+    if (wifi_event_group == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    portENTER_CRITICAL(&restart_lock);
+    bool already = restart_pending;
+    restart_pending = true;
+    portEXIT_CRITICAL(&restart_lock);
+    if (already) {
+        ESP_LOGD(TAG, "Restart already scheduled");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    restart_drain = drain;
+    esp_err_t err = ESP_OK;
+    if (restart_timer == NULL) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = restart_timer_cb,
+            .name = "wifi_restart",
+        };
+        err = esp_timer_create(&timer_args, &restart_timer);
+    }
+    if (err == ESP_OK) {
+        err = esp_timer_start_once(restart_timer, (uint64_t)delay_ms * 1000);
+    }
+    if (err != ESP_OK) {
+        restart_pending = false;
+        return err;
+    }
+    ESP_LOGI(TAG, "Restart in %lu ms%s", (unsigned long)delay_ms, drain ? ", draining requests first" : "");
+    return ESP_OK;
+}
+
+BaseType_t task_core_id(wifi_task_t task) {
+    int core = task_placement[task].core;
+    if (core < 0 || core >= portNUM_PROCESSORS) {
+        return tskNO_AFFINITY;
+    }
+    return core;
+}
+
+void start_http_server(void) {
+    httpd_config.task_priority = task_placement[WIFI_TASK_HTTPD].priority;
+    httpd_config.core_id = task_core_id(WIFI_TASK_HTTPD);
+    ESP_ERROR_CHECK(httpd_start(&server, &httpd_config));
+    builtin_handler_count = 0;
+}
+
+static esp_err_t register_builtin_uri(const httpd_uri_t *uri) {
+    // The handler table has room for WIFI_BUILTIN_HTTP_HANDLERS plus the custom handlers,
+    // one built-in handler more would take the slot of a custom handler
+    if (builtin_handler_count >= WIFI_BUILTIN_HTTP_HANDLERS) {
+        ESP_LOGE(TAG, "More than WIFI_BUILTIN_HTTP_HANDLERS (%d) built-in handlers, %s not registered",
+                 WIFI_BUILTIN_HTTP_HANDLERS, uri->uri);
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = wifi_arena_register_uri(server, uri);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to register handler for %s: %s", uri->uri, esp_err_to_name(err));
+        return err;
+    }
+    builtin_handler_count++;
+    return ESP_OK;
+}
+
+void start_captive_dns_server(void) {
+    dns_server_config_t dns_config = DNS_SERVER_CONFIG_SINGLE("*" /* all A queries */, "WIFI_AP_DEF" /* softAP netif ID */);
+    dns_config.task_priority = task_placement[WIFI_TASK_DNS].priority;
+    dns_config.task_core_id = task_core_id(WIFI_TASK_DNS);
+    dns_config.query_cb = wifi_clients_dns_query;
+    dns_config.send_error_cb = wifi_netstats_dns_send_error;
+    dns_server = start_dns_server(&dns_config);
+}
+
 /**
  * @brief Register all stored custom HTTP handlers with the server.
  * 
@@ -974,7 +1727,7 @@ esp_err_t wifi_register_http_handler(httpd_uri_t *uri) {
 void register_custom_http_handlers(void) {
     if (server == NULL) return;
     for (size_t i = 0; i < custom_handler_count; ++i) {
-        esp_err_t err = httpd_register_uri_handler(server, &custom_handlers[i]);
+        esp_err_t err = wifi_arena_register_uri(server, &custom_handlers[i]);
         if (err != ESP_OK) {
             ESP_LOGE(TAG, "Failed to register custom handler for %s: %s", custom_handlers[i].uri, esp_err_to_name(err));
         }
@@ -1208,8 +1961,322 @@ void fill_captive_portal_config_struct(captive_portal_config *cfg) {
 
 #pragma endregion
 
+#pragma region Settings apply
+
+static uint32_t settings_diff(const captive_portal_config *old, const captive_portal_config *cfg, wifi_mode_t mode) {
+    bool sta_changed = strcmp(old->ssid, cfg->ssid) != 0 || strcmp(old->password, cfg->password) != 0 ||
+                       old->authmode != cfg->authmode;
+    if (old->wifi_mode != cfg->wifi_mode) {
+        return APPLY_BIT(WIFI_APPLY_MODE_SWITCH);
+    }
+    if (cfg->wifi_mode == WIFI_MODE_AP) {
+        bool ap_changed = strcmp(old->ap_ssid, cfg->ap_ssid) != 0 || strcmp(old->ap_password, cfg->ap_password) != 0;
+        return ap_changed ? APPLY_BIT(WIFI_APPLY_MODE_SWITCH) : 0;
+    }
+    if (mode != WIFI_MODE_STA) {
+        return sta_changed ? APPLY_BIT(WIFI_APPLY_MODE_SWITCH) : 0;
+    }
+
+    uint32_t actions = 0;
+    if (sta_changed) {
+        actions |= APPLY_BIT(WIFI_APPLY_REASSOC);
+    }
+    if (old->use_static_ip != cfg->use_static_ip) {
+        actions |= APPLY_BIT(WIFI_APPLY_DHCP);
+    } else if (cfg->use_static_ip && old->static_ip.addr != cfg->static_ip.addr) {
+        actions |= APPLY_BIT(WIFI_APPLY_NETIF);
+    }
+    if (old->use_mDNS != cfg->use_mDNS ||
+        (cfg->use_mDNS && (strcmp(old->mDNS_hostname, cfg->mDNS_hostname) != 0 ||
+                           strcmp(old->service_name, cfg->service_name) != 0))) {
+        actions |= APPLY_BIT(WIFI_APPLY_MDNS);
+    }
+    return actions;
+}
+
+static const char *apply_describe(uint32_t actions, char *buf, size_t size) {
+    size_t len = 0;
+    buf[0] = '\0';
+    for (int action = 0; action < WIFI_APPLY_COUNT && len < size; action++) {
+        if (actions & APPLY_BIT(action)) {
+            len += snprintf(buf + len, size - len, "%s%s", len ? ", " : "", apply_names[action]);
+        }
+    }
+    if (actions == 0) {
+        strlcpy(buf, "nothing, saved only", size);
+    }
+    return buf;
+}
+
+static void apply_record(wifi_apply_t action, int64_t start_us) {
+    uint32_t ms = (uint32_t)((esp_timer_get_time() - start_us) / 1000);
+    portENTER_CRITICAL(&apply_lock);
+    wifi_apply_stats_t *stats = &apply_stats[action];
+    stats->count++;
+    stats->last_ms = ms;
+    stats->total_ms += ms;
+    if (ms > stats->max_ms) {
+        stats->max_ms = ms;
+    }
+    portEXIT_CRITICAL(&apply_lock);
+    ESP_LOGI(TAG, "Applied %s, %lu ms downtime", apply_names[action], (unsigned long)ms);
+}
+
+static void apply_wait_for_ip(wifi_apply_t action, int64_t start_us) {
+    portENTER_CRITICAL(&apply_lock);
+    apply_waiting = action;
+    apply_wait_start_us = start_us;
+    portEXIT_CRITICAL(&apply_lock);
+}
+
+/**
+ * @brief Finish the action waiting for an IP address, called on IP_EVENT_STA_GOT_IP.
+ */
+static void apply_ip_ready(void) {
+    portENTER_CRITICAL(&apply_lock);
+    wifi_apply_t action = apply_waiting;
+    int64_t start_us = apply_wait_start_us;
+    apply_waiting = WIFI_APPLY_COUNT;
+    portEXIT_CRITICAL(&apply_lock);
+    if (action != WIFI_APPLY_COUNT) {
+        apply_record(action, start_us);
+    }
+}
+
+/**
+ * @brief Get the downtime of applied settings changes per action.
+ * 
+ * @param stats Array of WIFI_APPLY_COUNT entries to fill
+ */
+void wifi_get_apply_stats(wifi_apply_stats_t stats[WIFI_APPLY_COUNT]) {
+    portENTER_CRITICAL(&apply_lock);
+    memcpy(stats, apply_stats, sizeof(apply_stats));
+    portEXIT_CRITICAL(&apply_lock);
+}
+
+static void apply_sta_ip_config(void) {
+    esp_netif_ip_info_t ip_info = { 0 };
+    esp_netif_dhcpc_stop(sta_netif);
+    if (captive_cfg.use_static_ip) {
+        uint32_t new_ip = ntohl(captive_cfg.static_ip.addr);
+        ip_info.ip.addr = captive_cfg.static_ip.addr;
+        ip_info.gw.addr = htonl((new_ip & 0xFFFFFF00)|0x01);    // x.x.x.1
+        ip_info.netmask.addr = htonl((255 << 24) | (255 << 16) | (255 << 8) | 0);   // 255.255.255.0
+        esp_netif_set_ip_info(sta_netif, &ip_info);
+    } else {
+        esp_netif_set_ip_info(sta_netif, &ip_info);
+        esp_netif_dhcpc_start(sta_netif);
+    }
+}
+
+static void mdns_apply(void) {
+    if (!captive_cfg.use_mDNS) {
+        mdns_stop();
+        return;
+    }
+    bool starting = !mdns_applied.running;
+    if (starting) {
+        ESP_ERROR_CHECK(mdns_init());
+        mdns_applied.running = true;
+        mdns_applied.hostname[0] = '\0';
+        mdns_applied.service_name[0] = '\0';
+    }
+    if (strcmp(mdns_applied.hostname, captive_cfg.mDNS_hostname) != 0) {
+        ESP_ERROR_CHECK(mdns_hostname_set(captive_cfg.mDNS_hostname));
+        strlcpy(mdns_applied.hostname, captive_cfg.mDNS_hostname, sizeof(mdns_applied.hostname));
+        ESP_LOGI(TAG, "mDNS hostname: http://%s.local", captive_cfg.mDNS_hostname);
+    }
+    if (strcmp(mdns_applied.service_name, captive_cfg.service_name) != 0) {
+        ESP_ERROR_CHECK(mdns_instance_name_set(captive_cfg.service_name));
+        strlcpy(mdns_applied.service_name, captive_cfg.service_name, sizeof(mdns_applied.service_name));
+        ESP_LOGI(TAG, "mDNS service name: %s", captive_cfg.service_name);
+    }
+    if (starting) {
+        mdns_service_add(NULL, "_http", "_tcp", 80, NULL, 0);
+    }
+}
+
+static void mdns_stop(void) {
+    mdns_free();    // Does nothing if mDNS is not running
+    if (mdns_applied.running) {
+        mdns_applied.running = false;
+        ESP_LOGI(TAG, "mDNS stopped");
+    }
+}
+
+#pragma endregion
+
 #pragma region FreeRTOS Tasks
 
+/**
+ * @brief Stop the HTTP and DNS servers before a mode switch.
+ */
+static void stop_servers(void) {
+    if (server) {
+        // A firmware update answers on a request detached from the server, which httpd_stop() frees
+        wifi_ota_suspend();
+        // Other tasks queue work through wifi_queue_http_work(), not on the handle being freed
+        xSemaphoreTake(server_lock, portMAX_DELAY);
+        httpd_stop(server);
+        server = NULL;
+        xSemaphoreGive(server_lock);
+        wifi_ota_resume();
+    }
+    web_root_handler = NULL;
+    custom_handlers_registered = false;
+    wifi_clients_reset();
+    if (dns_server) {
+        stop_dns_server(dns_server);
+        dns_server = NULL;
+
+        // The DNS server only runs in captive mode
+        wifi_captive_stats_t now;
+        wifi_get_captive_stats(&now);
+        ESP_LOGI(TAG_CAPTIVE, "Captive portal session: %lu DNS queries, %lu probe requests, %lu redirects, %lu API requests, %lu portal pages",
+                 (unsigned long)(now.dns_queries - captive_session_start.dns_queries),
+                 (unsigned long)(now.probe_requests - captive_session_start.probe_requests),
+                 (unsigned long)(now.redirects - captive_session_start.redirects),
+                 (unsigned long)(now.api_requests - captive_session_start.api_requests),
+                 (unsigned long)(now.portal_pages - captive_session_start.portal_pages));
+        wifi_client_os_stats_t os_now[WIFI_CLIENT_OS_COUNT];
+        wifi_get_client_os_stats(os_now);
+        for (int os = 0; os < WIFI_CLIENT_OS_COUNT; os++) {
+            uint32_t popups = os_now[os].popups - captive_session_os_start[os].popups;
+            uint32_t probes = os_now[os].probes_before_popup - captive_session_os_start[os].probes_before_popup;
+            if (popups > 0) {
+                ESP_LOGI(TAG_CAPTIVE, "  %s: %lu popups, %lu.%lu probes before the popup on average", wifi_client_os_name(os),
+                         (unsigned long)popups, (unsigned long)(probes / popups), (unsigned long)(probes * 10 / popups % 10));
+            }
+        }
+    }
+}
+
+/**
+ * @brief Apply the card state reported by the SD card monitor.
+ * 
+ * Runs in the HTTP server task through httpd_queue_work() while the server is
+ * running, so the card is never unmounted under a request. A removed card is
+ * unmounted, then the wildcard handler is swapped if the web root changed.
+ * 
+ * @param arg Task to notify when done, NULL for none
+ */
+static void apply_sd_card_state(void *arg) {
+    if (!sd_card_inserted && sd_card != NULL) {
+        unmount_sd_card();
+    }
+    update_web_root_handler();
+    if (arg) {
+        xTaskNotifyGive((TaskHandle_t)arg);
+    }
+}
+
+/**
+ * @brief Log heap state after a mode switch.
+ * 
+ * A minimum free heap that keeps falling or a largest free block that keeps
+ * shrinking across switches points to a leak or fragmentation.
+ */
+static void log_heap_after_switch(void) {
+    ESP_LOGI(TAG, "Mode switch done, free heap %u, min free %u, largest block %u",
+             (unsigned)heap_caps_get_free_size(MALLOC_CAP_DEFAULT),
+             (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT),
+             (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT));
+}
+
+static void restart_timer_cb(void *arg) {
+    xEventGroupSetBits(wifi_event_group, RESTART_BIT);
+}
+
+/**
+ * @brief Notify the listener task from the HTTP server task.
+ * 
+ * Queued with httpd_queue_work(), it runs once the handler in progress has
+ * returned.
+ * 
+ * @param arg Task to notify
+ */
+static void restart_drain_barrier(void *arg) {
+    xTaskNotifyGive((TaskHandle_t)arg);
+}
+
+static esp_err_t http_session_open(httpd_handle_t hd, int sockfd) {
+    if (restart_draining) {
+        ESP_LOGD(TAG, "Restarting, refusing connection on socket %d", sockfd);
+        return ESP_FAIL;
+    }
+    return wifi_session_open(hd, sockfd, get_socket_ip(sockfd));
+}
+
+/**
+ * @brief Wait until no request is being handled, or until the deadline.
+ * 
+ * The HTTP server runs handlers one at a time, so a barrier queued with
+ * httpd_queue_work() runs when no handler is in progress. Requests already
+ * waiting on other connections are served before it or right after it, so
+ * barriers are repeated until one passes without any handler having run
+ * since the previous one. An OTA update runs outside the server task and is
+ * waited for separately.
+ * 
+ * @param deadline_us esp_timer time to give up at
+ * @return true if drained, false if the deadline passed
+ */
+static bool restart_wait_idle(int64_t deadline_us) {
+    wifi_arena_stats_t arena;
+    wifi_arena_get_stats(&arena);
+    uint32_t calls = arena.calls;
+    while (1) {
+        int64_t left_ms = (deadline_us - esp_timer_get_time()) / 1000;
+        if (left_ms <= 0) {
+            return false;
+        }
+        if (wifi_ota_in_progress()) {
+            vTaskDelay(pdMS_TO_TICKS(RESTART_POLL_MS));
+            continue;
+        }
+        if (httpd_queue_work(server, restart_drain_barrier, xTaskGetCurrentTaskHandle()) != ESP_OK ||
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(left_ms)) == 0) {
+            return false;
+        }
+        wifi_arena_get_stats(&arena);
+        if (arena.calls == calls && !wifi_ota_in_progress()) {
+            return true;
+        }
+        calls = arena.calls;
+    }
+}
+
+static void restart_now(void) {
+    int64_t start = esp_timer_get_time();
+    int64_t deadline = start + (int64_t)CONFIG_WIFI_RESTART_DRAIN_TIMEOUT_MS * 1000;
+    wifi_trace_action(WIFI_TRACE_ACTION_RESTART, restart_drain, xEventGroupGetBits(wifi_event_group), sta_fails_count);
+
+    bool drained = false;
+    if (restart_drain && server) {
+        restart_draining = true;
+        drained = restart_wait_idle(deadline);
+        if (drained) {
+            stop_servers();     // Closes idle keep-alive connections
+            ESP_LOGI(TAG, "Requests drained in %" PRId64 " ms", (esp_timer_get_time() - start) / 1000);
+        } else {
+            ESP_LOGW(TAG, "Requests still in progress after %d ms, restarting anyway", CONFIG_WIFI_RESTART_DRAIN_TIMEOUT_MS);
+        }
+    }
+
+#ifdef CONFIG_WIFI_SDLOG
+    // Without a card the records cannot be written, do not wait for them
+    int64_t left_ms = (deadline - esp_timer_get_time()) / 1000;
+    if (sd_card != NULL && wifi_sdlog_flush(left_ms > RESTART_MIN_FLUSH_MS ? left_ms : RESTART_MIN_FLUSH_MS) != ESP_OK) {
+        ESP_LOGW(TAG_SD, "Log records still queued at restart");
+    }
+#endif
+    // A handler may still be using the card unless the server was stopped
+    if (drained || server == NULL) {
+        unmount_sd_card();
+    }
+    ESP_LOGI(TAG, "Restarting");
+    esp_restart();
+}
+
 /**
  * @brief FreeRTOS task to handle WiFi mode switching and related events.
  * 
@@ -1224,7 +2291,8 @@ void wifi_event_group_listener_task(void *pvParameter) {
         // Wait for any relevant event bit
         EventBits_t eventBits = xEventGroupWaitBits(
             wifi_event_group,
-            SWITCH_TO_STA_BIT | SWITCH_TO_AP_BIT | SWITCH_TO_CAPTIVE_AP_BIT | RECONECT_BIT | mDNS_CHANGE_BIT,
+            SWITCH_TO_STA_BIT | SWITCH_TO_AP_BIT | SWITCH_TO_CAPTIVE_AP_BIT | RECONECT_BIT | mDNS_CHANGE_BIT | SD_CARD_CHANGE_BIT | RESTART_BIT |
+            NETIF_CHANGE_BIT | DHCP_CHANGE_BIT,
             pdFALSE, pdFALSE, portMAX_DELAY);
         ESP_LOGD(TAG, "Received event bits: %s%s%s%s%s%s%s%s%s%s",
             eventBits & BIT9 ? "1" : "0",
@@ -1239,6 +2307,11 @@ void wifi_event_group_listener_task(void *pvParameter) {
             eventBits & BIT0 ? "1" : "0");
         vTaskDelay(100 / portTICK_PERIOD_MS);
 
+        // Scheduled restart, takes precedence over pending mode switches
+        if (eventBits & RESTART_BIT) {
+            restart_now();
+        }
+
         wifi_mode_t mode;
         if (esp_wifi_get_mode(&mode) == ESP_ERR_WIFI_NOT_INIT) {
             mode = WIFI_MODE_NULL;
@@ -1247,62 +2320,71 @@ void wifi_event_group_listener_task(void *pvParameter) {
         // Switch to STA mode
         if (eventBits & SWITCH_TO_STA_BIT) {
             ESP_LOGI(TAG, "Switching to STA mode...");
+            int64_t switch_start = esp_timer_get_time();
+            wifi_trace_action(WIFI_TRACE_ACTION_SWITCH_STA, 0, eventBits, sta_fails_count);
             led_indicator_stop(led_handle, BLINK_LOADING);
             led_indicator_start(led_handle, BLINK_WIFI_CONNECTING);
-            if (server) {
-                httpd_stop(server);
-                server = NULL;
-            }
+            stop_servers();
             if (eventBits & CONNECTED_BIT) {
                 ESP_LOGW(TAG, "Already connected to AP, no need to switch.");
                 xEventGroupClearBits(wifi_event_group, SWITCH_TO_STA_BIT);
                 continue;
             }
             esp_wifi_stop();
-            mdns_free(); // Free mDNS if exists
+            mdns_stop();
             xEventGroupClearBits(wifi_event_group, SWITCH_TO_STA_BIT);
+            apply_wait_for_ip(WIFI_APPLY_MODE_SWITCH, switch_start);
             wifi_init_sta();
+            log_heap_after_switch();
+            wifi_ota_confirm_running_app();
         }
 
         // Switch to AP mode (no captive hijack)
         if (eventBits & SWITCH_TO_AP_BIT) {
             ESP_LOGI(TAG, "Switching to AP mode...");
+            int64_t switch_start = esp_timer_get_time();
+            wifi_trace_action(WIFI_TRACE_ACTION_SWITCH_AP, 0, eventBits, sta_fails_count);
             led_indicator_stop(led_handle, BLINK_LOADING);
             led_indicator_start(led_handle, BLINK_WIFI_AP_STARTING);
-            if (server) {
-                httpd_stop(server);
-                server = NULL;
-            }
+            stop_servers();
             esp_wifi_disconnect();
             esp_wifi_stop();
-            mdns_free(); // Free mDNS if exists
+            mdns_stop();
             wifi_init_ap();
+            apply_record(WIFI_APPLY_MODE_SWITCH, switch_start);
+            log_heap_after_switch();
+            wifi_ota_confirm_running_app();
             xEventGroupClearBits(wifi_event_group, SWITCH_TO_AP_BIT);
         }
 
         // Switch to captive AP mode
         if (eventBits & SWITCH_TO_CAPTIVE_AP_BIT) {
             ESP_LOGI(TAG, "Switching to AP captive portal mode...");
+            int64_t switch_start = esp_timer_get_time();
+            wifi_trace_action(WIFI_TRACE_ACTION_SWITCH_CAPTIVE, 0, eventBits, sta_fails_count);
             led_indicator_stop(led_handle, BLINK_LOADING);
             led_indicator_start(led_handle, BLINK_WIFI_AP_STARTING);
-            if (server) {
-                httpd_stop(server);
-                server = NULL;
-            }
+            stop_servers();
             esp_wifi_disconnect();
             esp_wifi_stop();
-            mdns_free(); // Free mDNS if exists
+            mdns_stop();
             wifi_init_captive();
+            apply_record(WIFI_APPLY_MODE_SWITCH, switch_start);
+            log_heap_after_switch();
+            wifi_ota_confirm_running_app();
             xEventGroupClearBits(wifi_event_group, SWITCH_TO_CAPTIVE_AP_BIT);
         }
 
         // Reconnect in STA mode
         if (eventBits & RECONECT_BIT && mode == WIFI_MODE_STA) {
             ESP_LOGD(TAG, "Reconnecting to AP...");
+            wifi_trace_action(WIFI_TRACE_ACTION_RECONNECT, 0, eventBits, sta_fails_count);
+            apply_wait_for_ip(WIFI_APPLY_REASSOC, esp_timer_get_time());
             esp_wifi_disconnect();
             ESP_LOGD(TAG, "Waiting for disconnect...");
-            while (xEventGroupGetBits(wifi_event_group) & CONNECTED_BIT) {
-                vTaskDelay(100 / portTICK_PERIOD_MS);
+            for (int waited = 0; (xEventGroupGetBits(wifi_event_group) & CONNECTED_BIT) && waited < REASSOC_DISCONNECT_TIMEOUT_MS;
+                 waited += REASSOC_POLL_MS) {
+                vTaskDelay(pdMS_TO_TICKS(REASSOC_POLL_MS));
             }
             led_indicator_start(led_handle, BLINK_WIFI_CONNECTING);
 
@@ -1312,40 +2394,141 @@ void wifi_event_group_listener_task(void *pvParameter) {
             esp_wifi_set_config(WIFI_IF_STA, &wifi_cfg);
 
             // Set static or dynamic IP
-            esp_netif_dhcpc_stop(sta_netif);
-            if (captive_cfg.use_static_ip) {
-                uint32_t new_ip = ntohl(captive_cfg.static_ip.addr);
-                esp_netif_ip_info_t ip_info;
-                ip_info.ip.addr = captive_cfg.static_ip.addr;
-                ip_info.gw.addr = htonl((new_ip & 0xFFFFFF00)|0x01);    // x.x.x.1
-                ip_info.netmask.addr = htonl((255 << 24) | (255 << 16) | (255 << 8) | 0);   // 255.255.255.0
-                esp_netif_set_ip_info(sta_netif, &ip_info);
-            } else {
-                esp_netif_ip_info_t ip_info = {0};
-                esp_netif_set_ip_info(sta_netif, &ip_info);
-                esp_netif_dhcpc_start(sta_netif);
-            }
+            apply_sta_ip_config();
             esp_wifi_connect();
         }
 
+        // New static IP address, the association is kept
+        if (eventBits & NETIF_CHANGE_BIT) {
+            xEventGroupClearBits(wifi_event_group, NETIF_CHANGE_BIT);
+            if (mode == WIFI_MODE_STA) {
+                wifi_trace_action(WIFI_TRACE_ACTION_NETIF_UPDATE, 0, eventBits, sta_fails_count);
+                int64_t start = esp_timer_get_time();
+                apply_sta_ip_config();
+                apply_record(WIFI_APPLY_NETIF, start);
+                if (server) {
+                    httpd_queue_work(server, update_probe_location, NULL);
+                }
+            }
+        }
+
+        // Switch between DHCP and static IP, the association is kept
+        if (eventBits & DHCP_CHANGE_BIT) {
+            xEventGroupClearBits(wifi_event_group, DHCP_CHANGE_BIT);
+            if (mode == WIFI_MODE_STA) {
+                wifi_trace_action(WIFI_TRACE_ACTION_DHCP_UPDATE, captive_cfg.use_static_ip, eventBits, sta_fails_count);
+                int64_t start = esp_timer_get_time();
+                if (captive_cfg.use_static_ip) {
+                    apply_sta_ip_config();
+                    apply_record(WIFI_APPLY_DHCP, start);
+                } else {
+                    apply_wait_for_ip(WIFI_APPLY_DHCP, start);
+                    apply_sta_ip_config();
+                }
+                if (server) {
+                    httpd_queue_work(server, update_probe_location, NULL);
+                }
+            }
+        }
+
         // Update mDNS settings
         if (eventBits & mDNS_CHANGE_BIT && mode == WIFI_MODE_STA) {
-            if (captive_cfg.use_mDNS) {
-                mdns_init(); // Initialize mDNS if not already done
-                ESP_ERROR_CHECK(mdns_hostname_set(captive_cfg.mDNS_hostname));
-                ESP_ERROR_CHECK(mdns_instance_name_set(captive_cfg.service_name));
-                ESP_LOGI(TAG, "mDNS hostname updated: %s", captive_cfg.mDNS_hostname);
-                ESP_LOGI(TAG, "mDNS service name updated: %s", captive_cfg.service_name);
-                mdns_service_add(NULL, "_http", "_tcp", 80, NULL, 0); // Add mDNS service if not already done
-            } else {
-                mdns_free(); // Free mDNS if exists
-                ESP_LOGI(TAG, "mDNS removed");
+            wifi_trace_action(WIFI_TRACE_ACTION_MDNS_UPDATE, captive_cfg.use_mDNS, eventBits, sta_fails_count);
+            int64_t start = esp_timer_get_time();
+            mdns_apply();
+            apply_record(WIFI_APPLY_MDNS, start);
+            if (server) {
+                httpd_queue_work(server, update_probe_location, NULL);
             }
             xEventGroupClearBits(wifi_event_group, mDNS_CHANGE_BIT);
         }
+
+        // SD card inserted or removed
+        if (eventBits & SD_CARD_CHANGE_BIT) {
+            xEventGroupClearBits(wifi_event_group, SD_CARD_CHANGE_BIT);
+            if (server == NULL || httpd_queue_work(server, apply_sd_card_state, xTaskGetCurrentTaskHandle()) != ESP_OK) {
+                apply_sd_card_state(NULL);
+            } else if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SD_APPLY_TIMEOUT_MS)) == 0) {
+                ESP_LOGW(TAG_SD, "HTTP server did not apply the SD card change in time");
+            }
+        }
     }
 } 
 
+#ifdef CONFIG_WIFI_SD_HOTPLUG
+#if CONFIG_WIFI_SD_CD_PIN >= 0
+bool sd_card_detected(void) {
+#ifdef CONFIG_WIFI_SD_CD_ACTIVE_LOW
+    return gpio_get_level(CONFIG_WIFI_SD_CD_PIN) == 0;
+#else
+    return gpio_get_level(CONFIG_WIFI_SD_CD_PIN) != 0;
+#endif
+}
+
+void IRAM_ATTR sd_card_detect_isr(void *arg) {
+    BaseType_t woken = pdFALSE;
+    if (sd_monitor_task_handle) {
+        vTaskNotifyGiveFromISR(sd_monitor_task_handle, &woken);
+    }
+    if (woken) {
+        portYIELD_FROM_ISR();
+    }
+}
+#endif
+
+/**
+ * @brief FreeRTOS task that mounts and unmounts the SD card at runtime.
+ * 
+ * With a card detect pin it sleeps until the switch changes. Without one it
+ * checks a mounted card with a status request every
+ * CONFIG_WIFI_SD_PROBE_INTERVAL_MS and tries to mount a missing card, backing
+ * off up to SD_PROBE_MAX_INTERVAL_MS while the slot stays empty. Mounting
+ * happens here; unmounting and the handler swap are left to the listener task
+ * so they are serialized with mode switches.
+ * 
+ * @param pvParameter Unused.
+ */
+void sd_monitor_task(void *pvParameter) {
+    uint32_t interval_ms = CONFIG_WIFI_SD_PROBE_INTERVAL_MS;
+    while (1) {
+#if CONFIG_WIFI_SD_CD_PIN >= 0
+        // Wait for a card detect edge, retry the mount while a card sits in the slot unmounted
+        TickType_t wait = (sd_card == NULL && sd_card_detected()) ? pdMS_TO_TICKS(interval_ms) : portMAX_DELAY;
+        if (ulTaskNotifyTake(pdTRUE, wait) > 0) {
+            // Let the contacts settle and drop the bounces
+            vTaskDelay(pdMS_TO_TICKS(SD_CD_DEBOUNCE_MS));
+            ulTaskNotifyTake(pdTRUE, 0);
+        }
+        bool detected = sd_card_detected();
+#else
+        vTaskDelay(pdMS_TO_TICKS(interval_ms));
+        bool detected = true;   // Unknown without a switch, found out by the status request or mount below
+#endif
+
+        if (!sd_card_inserted && sd_card != NULL) {
+            continue;   // Removal not applied yet
+        }
+
+        if (sd_card != NULL) {
+            // A card that stops answering status requests has been removed
+            if (detected && sdmmc_get_status(sd_card) == ESP_OK) continue;
+            ESP_LOGW(TAG_SD, "SD card removed");
+            sd_card_inserted = false;
+            xEventGroupSetBits(wifi_event_group, SD_CARD_CHANGE_BIT);
+        } else if (detected) {
+            if (mount_sd_card() == ESP_OK) {
+                ESP_LOGI(TAG_SD, "SD card inserted and mounted");
+                interval_ms = CONFIG_WIFI_SD_PROBE_INTERVAL_MS;
+                sd_card_inserted = true;
+                xEventGroupSetBits(wifi_event_group, SD_CARD_CHANGE_BIT);
+            } else if (interval_ms < SD_PROBE_MAX_INTERVAL_MS) {
+                interval_ms *= 2;
+            }
+        }
+    }
+}
+#endif
+
 #pragma endregion
 
 #pragma region Captive Portal Handlers
@@ -1354,6 +2537,8 @@ void wifi_event_group_listener_task(void *pvParameter) {
  * @brief HTTP handler for serving the captive portal HTML page.
  */
 esp_err_t captive_handler(httpd_req_t *req) {
+    captive_stats.portal_pages++;
+    wifi_clients_portal_opened(get_client_ip(req));
     httpd_resp_set_type(req, "text/html; charset=utf-8");
     const uint32_t captive_html_len = captive_html_end - captive_html_start;
     httpd_resp_send(req, (const char *)captive_html_start, captive_html_len);
@@ -1365,6 +2550,12 @@ esp_err_t captive_handler(httpd_req_t *req) {
  * @brief HTTP error handler for redirecting to the captive portal.
  */
 esp_err_t captive_error_redirect(httpd_req_t *req, httpd_err_code_t error) {
+    captive_stats.redirects++;
+    if (wifi_is_captive_probe_uri(req->uri)) {
+        captive_stats.probe_requests++;
+        note_probe(req, NULL);
+        return wifi_probe_send(req, WIFI_PROBE_CAPTIVE_REDIRECT);
+    }
     httpd_resp_set_status(req, "302 Temporary Redirect");
     ESP_LOGD(TAG_CAPTIVE, "Redirecting to captive portal URI: /captive");
     httpd_resp_set_hdr(req, "Location", "/captive");
@@ -1372,12 +2563,67 @@ esp_err_t captive_error_redirect(httpd_req_t *req, httpd_err_code_t error) {
     return ESP_OK;
 }
 
+/** @brief Size of the /scan.json response buffer */
+#define SCAN_JSON_SIZE 700
+
+/** @brief Round up to the arena's 8-byte allocation granularity */
+#define SCAN_ARENA_ROUND(size) (((size) + 7) & ~(size_t)7)
+
+// Both scan buffers come from the arena and have to fit one block together
+_Static_assert(SCAN_ARENA_ROUND(SCAN_JSON_SIZE) + SCAN_ARENA_ROUND(CONFIG_WIFI_SCAN_MAX_APS * sizeof(wifi_ap_record_t)) <=
+                   CONFIG_WIFI_ARENA_BLOCK_SIZE,
+               "CONFIG_WIFI_ARENA_BLOCK_SIZE too small for CONFIG_WIFI_SCAN_MAX_APS scan results");
+
+/**
+ * @brief HTTP handler for the captive portal API (RFC 8908).
+ * 
+ * Clients that got the API URI through DHCP option 114 ask here instead of
+ * probing. Outside captive mode the portal is reported as gone, for clients
+ * still holding a lease from the captive session.
+ */
+esp_err_t captive_api_handler(httpd_req_t *req) {
+    captive_stats.api_requests++;
+    char json[96];
+    if (dns_server != NULL) {
+        esp_netif_ip_info_t ip_info;
+        esp_netif_get_ip_info(ap_netif, &ip_info);
+        snprintf(json, sizeof(json), "{\"captive\": true, \"user-portal-url\": \"http://" IPSTR "/captive\"}", IP2STR(&ip_info.ip));
+    } else {
+        strcpy(json, "{\"captive\": false}");
+    }
+    httpd_resp_set_type(req, "application/captive+json");
+    httpd_resp_set_hdr(req, "Cache-Control", "private");
+    httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
+    ESP_LOGD(TAG_CAPTIVE, "Captive portal API: %s", json);
+    return ESP_OK;
+}
+
+static void set_captive_dhcp_uri(void) {
+#ifdef CONFIG_WIFI_CAPTIVE_DHCP_URI
+    static char uri[40];    // The DHCP server keeps the pointer, not a copy
+    esp_netif_ip_info_t ip_info;
+    esp_netif_get_ip_info(ap_netif, &ip_info);
+    snprintf(uri, sizeof(uri), "http://" IPSTR CAPTIVE_API_URI, IP2STR(&ip_info.ip));
+    esp_err_t err = esp_netif_dhcps_option(ap_netif, ESP_NETIF_OP_SET, ESP_NETIF_CAPTIVEPORTAL_URI, uri, strlen(uri));
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG_CAPTIVE, "Failed to set DHCP captive portal option: %s", esp_err_to_name(err));
+    } else {
+        ESP_LOGD(TAG_CAPTIVE, "DHCP option 114: %s", uri);
+    }
+#endif
+}
+
 /**
  * @brief HTTP handler for scanning available WiFi networks and returning JSON results.
  */
 esp_err_t scan_json_handler(httpd_req_t *req) {
     ESP_LOGD(TAG_CAPTIVE, "Scan request received, starting WiFi scan...");
-    char json[700];
+    const size_t json_size = SCAN_JSON_SIZE;
+    char *json = wifi_arena_alloc(req, json_size);
+    wifi_ap_record_t *ap_records = wifi_arena_alloc(req, CONFIG_WIFI_SCAN_MAX_APS * sizeof(wifi_ap_record_t));
+    if (json == NULL || ap_records == NULL) {
+        return httpd_resp_send_500(req);
+    }
     uint16_t ap_count = 0;
     wifi_scan_config_t scan_config = {
         .show_hidden = true,
@@ -1392,14 +2638,15 @@ esp_err_t scan_json_handler(httpd_req_t *req) {
         ap_count = CONFIG_WIFI_SCAN_MAX_APS;
         ESP_LOGD(TAG_CAPTIVE, "Limiting to %d access points", ap_count);
     }
-    wifi_ap_record_t ap_records[CONFIG_WIFI_SCAN_MAX_APS];
     ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&ap_count, ap_records));
 
-    int len = snprintf(json, sizeof(json), "{\"ap_count\": %d, \"aps\": [", ap_count);
+    wifi_json_t out;
+    wifi_json_init(&out, json, json_size - 2);     // Keep room for the closing "]}"
+    wifi_json_raw(&out, "{\"ap_count\": ");
+    wifi_json_int(&out, ap_count);
+    wifi_json_raw(&out, ", \"aps\": [");
     for (int i = 0; i < ap_count; i++) {
-        char ssid[33];
         uint8_t authmode;
-        snprintf(ssid, sizeof(ssid), "%s", ap_records[i].ssid);
         if (ap_records[i].authmode == WIFI_AUTH_OPEN || ap_records[i].authmode == WIFI_AUTH_OWE || ap_records[i].authmode == WIFI_AUTH_DPP) {
             authmode = WIFI_AUTHMODE_OPEN;
         } else if (ap_records[i].authmode == WIFI_AUTH_ENTERPRISE || ap_records[i].authmode == WIFI_AUTH_WPA2_ENTERPRISE || ap_records[i].authmode == WIFI_AUTH_WPA3_ENTERPRISE || ap_records[i].authmode == WIFI_AUTH_WPA2_WPA3_ENTERPRISE || ap_records[i].authmode == WIFI_AUTH_WPA3_ENT_192 || ap_records[i].authmode == WIFI_AUTH_WPA_ENTERPRISE) {
@@ -1407,28 +2654,30 @@ esp_err_t scan_json_handler(httpd_req_t *req) {
         } else {
             authmode = WIFI_AUTHMODE_WPA_PSK;
         }
-        len += snprintf(json + len, sizeof(json) - len,
-        "%s{\"ssid\": \"%s\", \"rssi\": %d, \"authmode\": %d}",
-            (i > 0) ? "," : "",
-            ssid,
-            ap_records[i].rssi,
-            authmode);
-        if (len < 0 || len >= sizeof(json)) {
-            // Buffer full, truncate
+        // ssid is a 33 byte array, NUL-terminated by the driver only if shorter than 32 bytes
+        char ssid[33];
+        memcpy(ssid, ap_records[i].ssid, 32);
+        ssid[32] = '\0';
+
+        size_t mark = out.len;
+        if (i > 0) wifi_json_raw(&out, ",");
+        wifi_json_raw(&out, "{\"ssid\": ");
+        wifi_json_str(&out, ssid);
+        wifi_json_raw(&out, ", \"rssi\": ");
+        wifi_json_int(&out, ap_records[i].rssi);
+        wifi_json_raw(&out, ", \"authmode\": ");
+        wifi_json_int(&out, authmode);
+        wifi_json_raw(&out, "}");
+        if (out.overflow) {
+            // Buffer full, drop the partial entry to keep the JSON valid
+            wifi_json_truncate(&out, mark);
             break;
         }
     }
-    if ((len + 2) < sizeof(json)) {
-        json[len++] = ']';
-        json[len++] = '}';
-        json[len] = '\0';
-    } else {
-        // Buffer full, ensure valid JSON
-        strncpy(json + sizeof(json) - 3, "]}", 3);
-        json[sizeof(json) - 1] = '\0';
-    }
+    out.size = json_size;
+    wifi_json_raw(&out, "]}");
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, json, strlen(json));
+    httpd_resp_send(req, json, out.len);
     ESP_LOGD(TAG_CAPTIVE, "Scan results sent: %d APs; JSON: %s", ap_count, json);
     return ESP_OK;
 }
@@ -1437,23 +2686,46 @@ esp_err_t scan_json_handler(httpd_req_t *req) {
  * @brief HTTP handler for returning saved captive portal configuration as JSON.
  */
 esp_err_t captive_json_handler(httpd_req_t *req) {
-    char json[512];
-    snprintf(json, sizeof(json),
-        "{\"ssid\": \"%s\", \"authmode\": %d, \"password\": \"%s\", \"use_static_ip\": %s, \"static_ip\": \"%s\", \"use_mDNS\": %s, \"mDNS_hostname\": \"%s\", \"service_name\": \"%s\", \"wifi_mode\": %d, \"ap_ssid\": \"%s\", \"ap_password\": \"%s\"}",
-        captive_cfg.ssid,
-        captive_cfg.authmode,
-        captive_cfg.password,
-        captive_cfg.use_static_ip ? "true" : "false",
-        inet_ntoa(captive_cfg.static_ip.addr),
-        captive_cfg.use_mDNS ? "true" : "false",
-        captive_cfg.mDNS_hostname,
-        captive_cfg.service_name,
-        captive_cfg.wifi_mode,
-        captive_cfg.ap_ssid,
-        captive_cfg.ap_password
-    );
+    const size_t json_size = 640;     // Fits every field at maximum length, escaping can still overflow
+    char *json = wifi_arena_alloc(req, json_size);
+    if (json == NULL) {
+        return httpd_resp_send_500(req);
+    }
+    char static_ip[16];
+    inet_ntoa_r(captive_cfg.static_ip.addr, static_ip, sizeof(static_ip));
+
+    wifi_json_t out;
+    wifi_json_init(&out, json, json_size);
+    wifi_json_raw(&out, "{\"ssid\": ");
+    wifi_json_str(&out, captive_cfg.ssid);
+    wifi_json_raw(&out, ", \"authmode\": ");
+    wifi_json_int(&out, captive_cfg.authmode);
+    wifi_json_raw(&out, ", \"password\": ");
+    wifi_json_str(&out, captive_cfg.password);
+    wifi_json_raw(&out, ", \"use_static_ip\": ");
+    wifi_json_bool(&out, captive_cfg.use_static_ip);
+    wifi_json_raw(&out, ", \"static_ip\": \"");
+    wifi_json_raw(&out, static_ip);
+    wifi_json_raw(&out, "\", \"use_mDNS\": ");
+    wifi_json_bool(&out, captive_cfg.use_mDNS);
+    wifi_json_raw(&out, ", \"mDNS_hostname\": ");
+    wifi_json_str(&out, captive_cfg.mDNS_hostname);
+    wifi_json_raw(&out, ", \"service_name\": ");
+    wifi_json_str(&out, captive_cfg.service_name);
+    wifi_json_raw(&out, ", \"wifi_mode\": ");
+    wifi_json_int(&out, captive_cfg.wifi_mode);
+    wifi_json_raw(&out, ", \"ap_ssid\": ");
+    wifi_json_str(&out, captive_cfg.ap_ssid);
+    wifi_json_raw(&out, ", \"ap_password\": ");
+    wifi_json_str(&out, captive_cfg.ap_password);
+    wifi_json_raw(&out, "}");
+    if (out.overflow) {
+        ESP_LOGE(TAG_CAPTIVE, "Captive portal JSON does not fit %d byte buffer", (int)json_size);
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_send(req, json, strlen(json));
+    httpd_resp_send(req, json, out.len);
     ESP_LOGD(TAG_CAPTIVE, "Captive portal JSON data sent: %s", json);
     return ESP_OK;
 }
@@ -1461,72 +2733,79 @@ esp_err_t captive_json_handler(httpd_req_t *req) {
 /**
  * @brief HTTP POST handler for updating captive portal configuration.
  * 
- * Parses POST data, updates config, and triggers reconnect or mDNS update as needed.
+ * Parses POST data, updates config, and triggers only the actions needed to
+ * apply the fields that changed, see settings_diff().
  */
 esp_err_t captive_post_handler(httpd_req_t *req) {
-    char buf[256];
-    int len = httpd_req_recv(req, buf, MIN(req->content_len, sizeof(buf) - 1));
-    bool need_reconnect = false;
-    bool need_mdns_update = false;
+    const size_t buf_size = 768;     // Fits every field at maximum length, URL-encoded
+    const size_t param_size = 193;   // Largest field (64 bytes) fully percent-encoded, plus terminator
+    if (req->content_len >= buf_size) {
+        ESP_LOGW(TAG_CAPTIVE, "POST body too large: %u bytes", (unsigned)req->content_len);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Request too large");
+        return ESP_FAIL;
+    }
+    char *buf = wifi_arena_alloc(req, buf_size);
+    char *param = wifi_arena_alloc(req, param_size);
+    captive_portal_config *old_cfg = wifi_arena_alloc(req, sizeof(*old_cfg));
+    if (buf == NULL || param == NULL || old_cfg == NULL) {
+        return httpd_resp_send_500(req);
+    }
+    // httpd_req_recv may return less than requested, read until the whole body is in
+    int len = 0;
+    int timeouts = 0;
+    while (len < (int)req->content_len) {
+        int ret = httpd_req_recv(req, buf + len, req->content_len - len);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < CAPTIVE_POST_MAX_TIMEOUTS) continue;
+        if (ret <= 0) {
+            ESP_LOGW(TAG_CAPTIVE, "Failed to receive POST body: %d", ret);
+            return ESP_FAIL;
+        }
+        timeouts = 0;
+        len += ret;
+    }
+    *old_cfg = captive_cfg;
     bool ssid_changed = false;
-    bool mode_changed = false;
     wifi_mode_t mode;
     ESP_ERROR_CHECK(esp_wifi_get_mode(&mode));
     ESP_LOGD(TAG_CAPTIVE, "Received POST: len=%d, mode=%d", len, mode);
     if (len > 0) {
         buf[len] = '\0';
         ESP_LOGV(TAG_CAPTIVE, "POST data: %s", buf);
-        char param[32];
         
         // Parse wifi_mode first
-        if (httpd_query_key_value(buf, "wifi_mode", param, sizeof(param)) == ESP_OK) {
+        if (httpd_query_key_value(buf, "wifi_mode", param, param_size) == ESP_OK) {
             url_decode(param);
             ESP_LOGD(TAG_CAPTIVE, "Parsed WiFi Mode: %s", param);
             int mode_val = atoi(param);
             wifi_mode_t new_mode = (mode_val == WIFI_MODE_AP) ? WIFI_MODE_AP : WIFI_MODE_STA;
-            if (captive_cfg.wifi_mode != new_mode) {
-                mode_changed = true;
-                captive_cfg.wifi_mode = new_mode;
-            }
+            captive_cfg.wifi_mode = new_mode;
         }
         
         // Parse AP settings
-        if (httpd_query_key_value(buf, "ap_ssid", param, sizeof(param)) == ESP_OK) {
+        if (httpd_query_key_value(buf, "ap_ssid", param, param_size) == ESP_OK) {
             url_decode(param);
             ESP_LOGD(TAG_CAPTIVE, "Parsed AP SSID: %s", param);
-            if (strcmp(captive_cfg.ap_ssid, param) != 0) {
-                strcpy(captive_cfg.ap_ssid, param);
-                if (captive_cfg.wifi_mode == WIFI_MODE_AP) {
-                    mode_changed = true;
-                }
-            }
+            strlcpy(captive_cfg.ap_ssid, param, sizeof(captive_cfg.ap_ssid));
         }
         
-        if (httpd_query_key_value(buf, "ap_password", param, sizeof(param)) == ESP_OK) {
+        if (httpd_query_key_value(buf, "ap_password", param, param_size) == ESP_OK) {
             url_decode(param);
             ESP_LOGD(TAG_CAPTIVE, "Parsed AP Password: %s", param);
             // Only update if not empty (empty = unchanged)
-            if (strlen(param) > 0 && strcmp(captive_cfg.ap_password, param) != 0) {
-                strcpy(captive_cfg.ap_password, param);
-                if (captive_cfg.wifi_mode == WIFI_MODE_AP) {
-                    mode_changed = true;
-                }
+            if (strlen(param) > 0) {
+                strlcpy(captive_cfg.ap_password, param, sizeof(captive_cfg.ap_password));
             }
         }
         
-        if (httpd_query_key_value(buf, "ssid", param, sizeof(param)) == ESP_OK) {
+        if (httpd_query_key_value(buf, "ssid", param, param_size) == ESP_OK) {
             url_decode(param);
             ESP_LOGD(TAG_CAPTIVE, "Parsed SSID: %s", param);
             if (strcmp((char*)&captive_cfg.ssid, param) != 0) {
                 ssid_changed = true;  // Mark SSID as changed
-                if (mode == WIFI_MODE_STA) {
-                    need_reconnect = true;
-                    ESP_LOGD(TAG_CAPTIVE, "SSID changed, reconnecting...");
-                }
-                strcpy((char*)&captive_cfg.ssid, param);
+                strlcpy(captive_cfg.ssid, param, sizeof(captive_cfg.ssid));
             }
         }
-        if (httpd_query_key_value(buf, "authmode", param, sizeof(param)) == ESP_OK) {
+        if (httpd_query_key_value(buf, "authmode", param, param_size) == ESP_OK) {
             if (strcmp(param, "") == 0) {
                 ESP_LOGD(TAG_CAPTIVE, "Authmode empty");
                 captive_cfg.authmode = WIFI_AUTHMODE_INVALID;
@@ -1535,6 +2814,7 @@ esp_err_t captive_post_handler(httpd_req_t *req) {
                 ESP_LOGD(TAG_CAPTIVE, "Parsed Authmode: %d", new_authmode);
                 if (new_authmode == WIFI_AUTHMODE_ENTERPRISE) {
                     ESP_LOGW(TAG_CAPTIVE, "Enterprise networks (authmode 2) rejected");
+                    captive_cfg = *old_cfg;     // Nothing is applied from a rejected request
                     httpd_resp_set_status(req, "400 Bad Request");
                     httpd_resp_send(req, "Enterprise networks not supported", HTTPD_RESP_USE_STRLEN);
                     return ESP_OK;
@@ -1543,33 +2823,24 @@ esp_err_t captive_post_handler(httpd_req_t *req) {
                     new_authmode = WIFI_AUTHMODE_WPA_PSK; // default to WPA/WPA2-PSK
                     ESP_LOGD(TAG_CAPTIVE, "Authmode out of range, defaulting to WPA/WPA2-Personal");
                 }
-                if (captive_cfg.authmode != new_authmode) {
-                    if (mode == WIFI_MODE_STA) {
-                        need_reconnect = true;
-                        ESP_LOGD(TAG_CAPTIVE, "Authmode changed, reconnecting...");
-                    }
-                }
                 captive_cfg.authmode = new_authmode;
             }
         }
-        if (httpd_query_key_value(buf, "password", param, sizeof(param)) == ESP_OK) {
+        if (httpd_query_key_value(buf, "password", param, param_size) == ESP_OK) {
             url_decode(param);
             ESP_LOGD(TAG_CAPTIVE, "Parsed Password: %s", param);
             
             // Safety: If SSID changed and password is empty, reject the request
             if (ssid_changed && strlen(param) == 0 && captive_cfg.authmode == WIFI_AUTHMODE_WPA_PSK) {
                 ESP_LOGW(TAG_CAPTIVE, "SSID changed but no password provided for WPA network");
+                captive_cfg = *old_cfg;     // Nothing is applied from a rejected request
                 httpd_resp_set_status(req, "400 Bad Request");
                 httpd_resp_send(req, "Password required for new network", HTTPD_RESP_USE_STRLEN);
                 return ESP_OK;
             }
             
             if ((captive_cfg.authmode != WIFI_AUTHMODE_OPEN && strlen(param) != 0 && strcmp((char*)&captive_cfg.password, param) != 0) || captive_cfg.authmode == WIFI_AUTHMODE_INVALID) {
-                if (mode == WIFI_MODE_STA) {
-                    need_reconnect = true;
-                    ESP_LOGD(TAG_CAPTIVE, "Password changed, reconnecting...");
-                }
-                strcpy((char*)&captive_cfg.password, param);
+                strlcpy(captive_cfg.password, param, sizeof(captive_cfg.password));
             } else if (captive_cfg.authmode == WIFI_AUTHMODE_OPEN && captive_cfg.authmode != WIFI_AUTHMODE_INVALID) {
                 strcpy((char*)&captive_cfg.password, "");
             }
@@ -1577,92 +2848,37 @@ esp_err_t captive_post_handler(httpd_req_t *req) {
         if (captive_cfg.authmode == WIFI_AUTHMODE_INVALID) {
             if (captive_cfg.password[0] != 0) {
                 captive_cfg.authmode = WIFI_AUTHMODE_WPA_PSK; // WPA/WPA2-PSK
-                if (mode == WIFI_MODE_STA) {
-                    need_reconnect = true;
-                    ESP_LOGD(TAG_CAPTIVE, "Invalid authmode corrected to WPA/WPA2-Personal, password is not empty, reconnecting...");
-                }
+                ESP_LOGD(TAG_CAPTIVE, "Invalid authmode corrected to WPA/WPA2-Personal, password is not empty");
             } else {
                 captive_cfg.authmode = WIFI_AUTHMODE_OPEN; // Open
-                if (mode == WIFI_MODE_STA) {
-                    need_reconnect = true;
-                    ESP_LOGD(TAG_CAPTIVE, "Invalid authmode corrected to Open, password is empty, reconnecting...");
-                }
+                ESP_LOGD(TAG_CAPTIVE, "Invalid authmode corrected to Open, password is empty");
             }
         }
-        if (httpd_query_key_value(buf, "use_static_ip", param, sizeof(param)) == ESP_OK) {
-            bool new_use_static_ip = strcmp(param, "true") == 0;
+        if (httpd_query_key_value(buf, "use_static_ip", param, param_size) == ESP_OK) {
             ESP_LOGD(TAG_CAPTIVE, "Parsed Use Static IP: %s", param);
-            if (captive_cfg.use_static_ip != new_use_static_ip) {
-                if (mode == WIFI_MODE_STA) {
-                    need_reconnect = true;
-                    ESP_LOGD(TAG_CAPTIVE, "Static IP usage changed, reconnecting...");
-                }
-            }
-            captive_cfg.use_static_ip = new_use_static_ip;
+            captive_cfg.use_static_ip = strcmp(param, "true") == 0;
         } else {
-            if (captive_cfg.use_static_ip) {
-                if (mode == WIFI_MODE_STA) {
-                    need_reconnect = true;
-                    ESP_LOGD(TAG_CAPTIVE, "Static IP usage disabled, reconnecting...");
-                }
-            }
             captive_cfg.use_static_ip = false;
         }
-        if (httpd_query_key_value(buf, "static_ip", param, sizeof(param)) == ESP_OK) {
-            uint32_t new_ip = inet_addr(param);
+        if (httpd_query_key_value(buf, "static_ip", param, param_size) == ESP_OK) {
             ESP_LOGD(TAG_CAPTIVE, "Parsed Static IP: %s", param);
-            if (captive_cfg.static_ip.addr != new_ip && captive_cfg.use_static_ip) {
-                if (mode == WIFI_MODE_STA) {
-                    need_reconnect = true;
-                    ESP_LOGD(TAG_CAPTIVE, "Static IP changed, reconnecting...");
-                }
-            }
-            captive_cfg.static_ip.addr = new_ip;
+            captive_cfg.static_ip.addr = inet_addr(param);
         }
-        if (httpd_query_key_value(buf, "use_mDNS", param, sizeof(param)) == ESP_OK) {
-            bool new_use_mdns = strcmp(param, "true") == 0;
+        if (httpd_query_key_value(buf, "use_mDNS", param, param_size) == ESP_OK) {
             ESP_LOGD(TAG_CAPTIVE, "Parsed Use mDNS: %s", param);
-            if (captive_cfg.use_mDNS != new_use_mdns) {
-                if (mode == WIFI_MODE_STA) {
-                    need_mdns_update = true;
-                    ESP_LOGD(TAG_CAPTIVE, "mDNS usage changed, updating...");
-                }
-            }
-            captive_cfg.use_mDNS = new_use_mdns;
+            captive_cfg.use_mDNS = strcmp(param, "true") == 0;
         } else {
-            if (captive_cfg.use_mDNS) {
-                if (mode == WIFI_MODE_STA) {
-                    need_mdns_update = true;
-                    ESP_LOGD(TAG_CAPTIVE, "mDNS usage disabled, updating...");
-                }
-            }
             captive_cfg.use_mDNS = false;
         }
-        if (httpd_query_key_value(buf, "mDNS_hostname", param, sizeof(param)) == ESP_OK) {
+        if (httpd_query_key_value(buf, "mDNS_hostname", param, param_size) == ESP_OK) {
             url_decode(param);
             ESP_LOGD(TAG_CAPTIVE, "Parsed mDNS Hostname: %s", param);
-            if ((strcmp(captive_cfg.mDNS_hostname, param) != 0)) {
-                if (captive_cfg.use_mDNS) {
-                    if (mode == WIFI_MODE_STA) {
-                        need_mdns_update = true;
-                        ESP_LOGD(TAG_CAPTIVE, "mDNS hostname changed, updating...");
-                    }
-                }
-                strcpy(captive_cfg.mDNS_hostname, param);
-            }
+            strlcpy(captive_cfg.mDNS_hostname, param, sizeof(captive_cfg.mDNS_hostname));
         }
-        if (httpd_query_key_value(buf, "service_name", param, sizeof(param)) == ESP_OK) {
+        if (httpd_query_key_value(buf, "service_name", param, param_size) == ESP_OK) {
             url_decode(param);
             ESP_LOGD(TAG_CAPTIVE, "Parsed Service Name: %s", param);
-            if ((strcmp(captive_cfg.service_name, param) != 0)) {
-                if (captive_cfg.use_mDNS) {
-                    if (mode == WIFI_MODE_STA) {
-                        need_mdns_update = true;
-                        ESP_LOGD(TAG_CAPTIVE, "mDNS service name changed, updating...");
-                    }
-                }
-                strcpy(captive_cfg.service_name, param);
-            }
+            strlcpy(captive_cfg.service_name, param, sizeof(captive_cfg.service_name));
         }
     }
 
@@ -1673,19 +2889,26 @@ esp_err_t captive_post_handler(httpd_req_t *req) {
     // Save settings to NVS
     set_nvs_wifi_settings(&captive_cfg);
 
-    // Determine action based on mode
-    if (mode_changed) {
-        ESP_LOGI(TAG_CAPTIVE, "WiFi mode changed to: %d", captive_cfg.wifi_mode);
+    // Apply only what changed, with the cheapest action that applies it
+    uint32_t actions = settings_diff(old_cfg, &captive_cfg, mode);
+    char action_list[64];
+    ESP_LOGI(TAG_CAPTIVE, "Applying: %s", apply_describe(actions, action_list, sizeof(action_list)));
+    if (actions & APPLY_BIT(WIFI_APPLY_MODE_SWITCH)) {
         if (captive_cfg.wifi_mode == WIFI_MODE_STA) {
             xEventGroupSetBits(wifi_event_group, SWITCH_TO_STA_BIT);
         } else {
             xEventGroupSetBits(wifi_event_group, SWITCH_TO_AP_BIT);
         }
-    } else if (mode == WIFI_MODE_STA) {
-        if (need_reconnect) {
+    } else {
+        // Reassociating applies the IP settings too
+        if (actions & APPLY_BIT(WIFI_APPLY_REASSOC)) {
             xEventGroupSetBits(wifi_event_group, RECONECT_BIT);
+        } else if (actions & APPLY_BIT(WIFI_APPLY_DHCP)) {
+            xEventGroupSetBits(wifi_event_group, DHCP_CHANGE_BIT);
+        } else if (actions & APPLY_BIT(WIFI_APPLY_NETIF)) {
+            xEventGroupSetBits(wifi_event_group, NETIF_CHANGE_BIT);
         }
-        if (need_mdns_update) {
+        if (actions & APPLY_BIT(WIFI_APPLY_MDNS)) {
             xEventGroupSetBits(wifi_event_group, mDNS_CHANGE_BIT);
         }
     }
@@ -1698,68 +2921,99 @@ esp_err_t captive_post_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+#pragma endregion
+
+#pragma region STA handlers
 
 /**
- * @brief Decode a URL-encoded string in place.
- * 
- * @param str The URL-encoded string to decode.
+ * @brief Get the address of the client that sent a request.
  * 
- * This function modifies the input string directly to decode it.
+ * @param req HTTP request handle
+ * @return IPv4 address in network byte order, the last 4 bytes of an IPv6 address, or 0 if unknown
  */
-void url_decode(char *str) {
-    char *src = str, *dst = str;
-    while (*src) {
-        if (*src == '+') {
-            *dst++ = ' ';
-            src++;
-        } else if (*src == '%' && src[1] && src[2]) {
-            int hi = src[1], lo = src[2];
-            hi = (hi >= 'A') ? (hi & ~0x20) - 'A' + 10 : hi - '0';
-            lo = (lo >= 'A') ? (lo & ~0x20) - 'A' + 10 : lo - '0';
-            *dst++ = (char)((hi << 4) | lo);
-            src += 3;
-        } else {
-            *dst++ = *src++;
-        }
-    }
-    *dst = '\0';
+static uint32_t get_client_ip(httpd_req_t *req) {
+    return get_socket_ip(httpd_req_to_sockfd(req));
 }
 
-#pragma endregion
+static uint32_t get_socket_ip(int sockfd) {
+    uint32_t client_ip = 0;
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    if (sockfd < 0 || getpeername(sockfd, (struct sockaddr *)&addr, &addr_len) != 0) {
+        ESP_LOGW(TAG, "getpeername failed: errno=%d (%s)", errno, strerror(errno));
+        return 0;
+    }
+    if (addr.ss_family == AF_INET) {
+        client_ip = ((struct sockaddr_in *)&addr)->sin_addr.s_addr;
+    } else if (addr.ss_family == AF_INET6) {
+        // IPv6 - use the last 4 bytes as identifier
+        memcpy(&client_ip, &((struct sockaddr_in6 *)&addr)->sin6_addr.s6_addr[12], 4);
+    } else {
+        ESP_LOGW(TAG, "Unknown address family: %d", addr.ss_family);
+    }
+    return client_ip;
+}
 
-#pragma region STA handlers
+/**
+ * @brief Record a probe in the client table.
+ * 
+ * @param req HTTP request handle of the probe
+ * @param[out] first Set to true for the first probe of the client, may be NULL
+ * @return Platform of the client
+ */
+static wifi_client_os_t note_probe(httpd_req_t *req, bool *first) {
+    const size_t user_agent_size = 128;
+    char *user_agent = wifi_arena_alloc(req, user_agent_size);
+    if (user_agent != NULL) {
+        user_agent[0] = '\0';
+        httpd_req_get_hdr_value_str(req, "User-Agent", user_agent, user_agent_size);   // Truncated is good enough
+    }
+    bool is_first;
+    wifi_client_os_t os = wifi_clients_probe(get_client_ip(req), req->uri, user_agent ? user_agent : "", &is_first);
+    if (first) *first = is_first;
+    return os;
+}
 
 /**
- * @brief Check if a client IP has already been redirected to the captive portal.
+ * @brief Build the URL probes are redirected to in STA/AP mode.
  * 
- * @param ip Client IP address to check
- * @return true if IP has been redirected previously, false otherwise
+ * @param location Buffer for the URL
+ * @param size Size of the buffer
  */
-static bool is_ip_redirected(uint32_t ip) {
-    for (int i = 0; i < redirected_count; i++) {
-        if (redirected_ips[i] == ip) return true;
+static void get_portal_location(char *location, size_t size) {
+    if (captive_cfg.use_mDNS) {
+        snprintf(location, size, "http://%s.local/", captive_cfg.mDNS_hostname);
+    } else {
+        esp_netif_ip_info_t ip_info;
+        esp_netif_get_ip_info(ap_netif, &ip_info);
+        char ip_addr[16];
+        inet_ntoa_r(ip_info.ip.addr, ip_addr, 16);
+        snprintf(location, size, "http://%s/", ip_addr);
     }
-    return false;
 }
 
 /**
- * @brief Mark a client IP as having been redirected to the captive portal.
+ * @brief Update the probe redirect after the portal location changed.
  * 
- * Adds the IP to the redirected IPs list to prevent redirect loops.
+ * Called before the web server starts in every mode, which builds the raw
+ * probe responses, and through httpd_queue_work() when the mDNS hostname
+ * changes.
  * 
- * @param ip Client IP address to mark
+ * @param arg Unused
  */
-static void mark_ip_redirected(uint32_t ip) {
-    if (redirected_count < MAX_REDIRECTED_IPS) {
-        redirected_ips[redirected_count++] = ip;
-    }
+static void update_probe_location(void *arg) {
+    char location[64];
+    get_portal_location(location, sizeof(location));
+    wifi_probe_set_location(location);
 }
 
 /**
  * @brief HTTP handler for when SD card is not present.
  * 
  * Returns a 503 Service Unavailable status with a message prompting
- * the user to insert an SD card and restart.
+ * the user to insert an SD card. With CONFIG_WIFI_SD_HOTPLUG the card is
+ * mounted when inserted and the page reloads itself, otherwise the device
+ * has to be restarted.
  * 
  * @param req HTTP request handle
  * @return ESP_OK always
@@ -1767,7 +3021,12 @@ static void mark_ip_redirected(uint32_t ip) {
 esp_err_t no_sd_card_handler(httpd_req_t *req) {
     httpd_resp_set_status(req, "503 Service Unavailable");
     httpd_resp_set_type(req, "text/html");
+#ifdef CONFIG_WIFI_SD_HOTPLUG
+    httpd_resp_set_hdr(req, "Refresh", "5");
+    httpd_resp_send(req, "<h2>SD card not detected</h2>\n<p>Please insert an SD card, this page reloads when it is ready</p>", HTTPD_RESP_USE_STRLEN);
+#else
     httpd_resp_send(req, "<h2>SD card not detected</h2>\n<p>Please insert an SD card and <a href=\"/restart\">restart</a> the device</p>", HTTPD_RESP_USE_STRLEN);
+#endif
     return ESP_OK;
 }
 
@@ -1794,8 +3053,10 @@ esp_err_t restart_handler(httpd_req_t *req) {
     httpd_resp_set_status(req, "302 Temporary Redirect");
     httpd_resp_set_hdr(req, "Location", "/");
     httpd_resp_send(req, "Restarting...", HTTPD_RESP_USE_STRLEN);
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
-    esp_restart();
+    esp_err_t err = wifi_request_restart(RESTART_RESPONSE_DELAY_MS, true);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {     // INVALID_STATE: already scheduled
+        ESP_LOGE(TAG, "Cannot schedule restart: %s", esp_err_to_name(err));
+    }
     return ESP_OK;
 }
 
@@ -1839,14 +3100,96 @@ esp_err_t wifi_status_json_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+/**
+ * @brief HTTP GET handler for /stations.json (station table and session counters).
+ * 
+ * Sent in chunks of one station each, so the table size does not depend on
+ * the arena block size.
+ */
+esp_err_t stations_json_handler(httpd_req_t *req) {
+    const size_t json_size = 384;
+    char *json = wifi_arena_alloc(req, json_size);
+    wifi_station_info_t *stations = wifi_arena_alloc(req, WIFI_STATIONS_MAX * sizeof(wifi_station_info_t));
+    if (json == NULL || stations == NULL) {
+        return httpd_resp_send_500(req);
+    }
+    size_t count = wifi_get_stations(stations, WIFI_STATIONS_MAX);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    wifi_json_t out;
+    wifi_json_init(&out, json, json_size);
+    wifi_json_raw(&out, "{\"stations\": [");
+    for (size_t i = 0; i < count; i++) {
+        const wifi_station_info_t *sta = &stations[i];
+        char text[18];
+        if (i > 0) wifi_json_raw(&out, ",");
+        snprintf(text, sizeof(text), MACSTR, MAC2STR(sta->mac));
+        wifi_json_raw(&out, "{\"mac\": ");
+        wifi_json_str(&out, text);
+        inet_ntoa_r(sta->ip, text, sizeof(text));
+        wifi_json_raw(&out, ", \"ip\": ");
+        wifi_json_str(&out, sta->ip ? text : "");
+        wifi_json_raw(&out, ", \"connected\": ");
+        wifi_json_bool(&out, sta->connected);
+        wifi_json_raw(&out, ", \"connected_s\": ");
+        wifi_json_int(&out, sta->connected_s);
+        wifi_json_raw(&out, ", \"rssi\": ");
+        wifi_json_int(&out, sta->rssi);
+        wifi_json_raw(&out, ", \"os\": ");
+        wifi_json_str(&out, wifi_client_os_name(sta->os));
+        wifi_json_raw(&out, ", \"http_requests\": ");
+        wifi_json_int(&out, sta->http_requests);
+        wifi_json_raw(&out, ", \"bytes_in\": ");
+        wifi_json_int(&out, sta->bytes_in);
+        wifi_json_raw(&out, ", \"bytes_out\": ");
+        wifi_json_int(&out, sta->bytes_out);
+        wifi_json_raw(&out, ", \"dns_queries\": ");
+        wifi_json_int(&out, sta->dns_queries);
+        wifi_json_raw(&out, ", \"probes\": ");
+        wifi_json_int(&out, sta->probes);
+        wifi_json_raw(&out, ", \"redirected\": ");
+        wifi_json_bool(&out, sta->redirected);
+        wifi_json_raw(&out, ", \"portal_opened\": ");
+        wifi_json_bool(&out, sta->portal_opened);
+        wifi_json_raw(&out, "}");
+        if (out.overflow || httpd_resp_send_chunk(req, json, out.len) != ESP_OK) {
+            ESP_LOGW(TAG, "Station table response failed");
+            return ESP_FAIL;
+        }
+        wifi_json_init(&out, json, json_size);
+    }
+    wifi_session_stats_t sessions;
+    wifi_get_session_stats(&sessions);
+    wifi_json_raw(&out, "], \"sessions\": {\"open\": ");
+    wifi_json_int(&out, sessions.open);
+    wifi_json_raw(&out, ", \"max_open\": ");
+    wifi_json_int(&out, sessions.max_open);
+    wifi_json_raw(&out, ", \"rejected\": ");
+    wifi_json_int(&out, sessions.rejected);
+    wifi_json_raw(&out, ", \"header_timeouts\": ");
+    wifi_json_int(&out, sessions.header_timeouts);
+    wifi_json_raw(&out, ", \"slow_bodies\": ");
+    wifi_json_int(&out, sessions.slow_bodies);
+    wifi_json_raw(&out, ", \"purged\": ");
+    wifi_json_int(&out, sessions.purged);
+    wifi_json_raw(&out, "}}");
+    httpd_resp_send_chunk(req, json, out.len);
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
 /**
  * @brief HTTP handler for serving files from the SD card.
  * 
- * This handler serves files from the SD card mounted at /sdcard. It performs:
+ * This handler serves files from the SD card mounted at /sdcard and, with
+ * CONFIG_WIFI_ASSETS, from the flash asset image (before or after the SD card,
+ * see CONFIG_WIFI_ASSETS_PRIMARY). It performs:
  * - Captive portal detection URL handling (redirects first request, returns 204 for subsequent)
  * - Directory index handling (serves index.html for directories)
  * - File extension-based content type detection
  * - Automatic .html extension appending for extensionless paths
+ * - Compressed flash assets only for clients accepting gzip, the uncompressed
+ *   copy or the SD card file otherwise
  * 
  * Supported file types include HTML, CSS, JS, JSON, images, fonts, video, and more.
  * 
@@ -1856,95 +3199,75 @@ esp_err_t wifi_status_json_handler(httpd_req_t *req) {
  */
 esp_err_t sd_file_handler(httpd_req_t *req) {
     // Handle captive portal detection URLs from various operating systems
-    // Android: /generate_204, /gen_204
-    // iOS: /hotspot-detect.html
-    // Windows: /ncsi.txt, /connecttest.txt
-    // Generic: /success.txt, /redirect, /204
-    if (!strcmp(req->uri, "/generate_204") ||
-        !strcmp(req->uri, "/gen_204") ||
-        !strcmp(req->uri, "/ncsi.txt") ||
-        !strcmp(req->uri, "/connecttest.txt") ||
-        !strcmp(req->uri, "/hotspot-detect.html") ||
-        !strcmp(req->uri, "/success.txt") ||
-        !strcmp(req->uri, "/redirect") ||
-        !strcmp(req->uri, "/204") ||
-        !strcmp(req->uri, "/ipv6check")) {
-        
+    if (wifi_is_captive_probe_uri(req->uri)) {
+        captive_stats.probe_requests++;
         ESP_LOGV(TAG, "Captive portal detection request: %s", req->uri);
-        
-        // Extract client IP address from socket for redirect tracking
-        uint32_t client_ip = 0;
-        int sockfd = httpd_req_to_sockfd(req);
-        
-        if (sockfd >= 0) {
-            struct sockaddr_storage addr;
-            socklen_t addr_len = sizeof(addr);
-            
-            if (getpeername(sockfd, (struct sockaddr *)&addr, &addr_len) == 0) {
-                if (addr.ss_family == AF_INET) {
-                    // IPv4
-                    struct sockaddr_in *addr_in = (struct sockaddr_in *)&addr;
-                    client_ip = addr_in->sin_addr.s_addr;
-                    char ip_str[INET_ADDRSTRLEN];
-                    inet_ntop(AF_INET, &(addr_in->sin_addr), ip_str, INET_ADDRSTRLEN);
-                    ESP_LOGV(TAG, "Client IPv4 obtained: %s (0x%08X)", ip_str, (unsigned int)client_ip);
-                } else if (addr.ss_family == AF_INET6) {
-                    // IPv6 - use hash of last 4 bytes as identifier
-                    struct sockaddr_in6 *addr_in6 = (struct sockaddr_in6 *)&addr;
-                    memcpy(&client_ip, &addr_in6->sin6_addr.s6_addr[12], 4);
-                    char ip_str[INET6_ADDRSTRLEN];
-                    inet_ntop(AF_INET6, &(addr_in6->sin6_addr), ip_str, INET6_ADDRSTRLEN);
-                    ESP_LOGV(TAG, "Client IPv6 obtained: %s (hash: 0x%08X)", ip_str, (unsigned int)client_ip);
-                } else {
-                    ESP_LOGW(TAG, "Unknown address family: %d", addr.ss_family);
-                }
-            } else {
-                ESP_LOGW(TAG, "getpeername failed: errno=%d (%s)", errno, strerror(errno));
-            }
-        } else {
-            ESP_LOGW(TAG, "Invalid socket fd: %d", sockfd);
-        }
-        
-        // Determine response based on request type and redirect tracking
-        // For Microsoft NCSI (Windows) - return the exact expected content
-        if (!strcmp(req->uri, "/ncsi.txt") || !strcmp(req->uri, "/connecttest.txt")) {
-            httpd_resp_set_type(req, "text/plain");
-            httpd_resp_send(req, "Microsoft NCSI", HTTPD_RESP_USE_STRLEN);
-            return ESP_OK;
+
+        // First probe of a client: redirect to the portal to open the popup
+        // Later probes: the platform's exact "internet available" response, anything else makes it probe again
+        bool first;
+        wifi_client_os_t os = note_probe(req, &first);
+        if (first || !strcmp(req->uri, "/redirect")) {
+            ESP_LOGI(TAG, "First captive detection (%s), redirecting to the portal", wifi_client_os_name(os));
+            return wifi_probe_send(req, WIFI_PROBE_PORTAL_REDIRECT);
         }
-        
-        // First request from this IP: redirect to portal to open popup/browser
-        // Subsequent requests from same IP: return 204 to indicate internet connectivity
-        if ((client_ip != 0 && !is_ip_redirected(client_ip))||!strcmp(req->uri, "/redirect")) {
-            mark_ip_redirected(client_ip);
-            
-            char location[64];
-            if (captive_cfg.use_mDNS) {
-                snprintf(location, sizeof(location), "http://%s.local/", captive_cfg.mDNS_hostname);
-            } else {
-                esp_netif_ip_info_t ip_info;
-                esp_netif_get_ip_info(ap_netif, &ip_info);
-                char ip_addr[16];
-                inet_ntoa_r(ip_info.ip.addr, ip_addr, 16);
-                snprintf(location, sizeof(location), "http://%s/", ip_addr);
-            }
-            
-            httpd_resp_set_status(req, "302 Found");
-            httpd_resp_set_hdr(req, "Location", location);
-            httpd_resp_send(req, NULL, 0);
-            ESP_LOGI(TAG, "First captive detection, redirecting to %s", location);
-            return ESP_OK;
+        return wifi_probe_send(req, wifi_probe_success_response(req->uri));
+    }
+    if (!strcmp(req->uri, "/")) {
+        wifi_clients_portal_opened(get_client_ip(req));
+    }
+
+#ifdef CONFIG_WIFI_ASSETS
+    wifi_asset_t asset;
+    esp_err_t asset_err = ESP_ERR_NOT_FOUND;
+#endif
+#ifdef CONFIG_WIFI_ASSETS_PRIMARY
+    asset_err = wifi_assets_find_request(req, &asset);
+    if (asset_err == ESP_OK) {
+        return wifi_assets_send(req, &asset);
+    }
+#endif
+    if (SD_card_present) {
+        esp_err_t ret = send_sd_file(req);
+        if (ret != ESP_ERR_NOT_FOUND) {
+            return ret;
         }
-        
-        // Subsequent requests: return 204
-        httpd_resp_set_status(req, "204 No Content");
-        httpd_resp_send(req, NULL, 0);
-        return ESP_OK;
     }
+#ifdef CONFIG_WIFI_ASSETS_FALLBACK
+    asset_err = wifi_assets_find_request(req, &asset);
+    if (asset_err == ESP_OK) {
+        return wifi_assets_send(req, &asset);
+    }
+#endif
+#ifdef CONFIG_WIFI_ASSETS
+    if (asset_err == ESP_ERR_NOT_SUPPORTED) {
+        // Only stored gzip-compressed, and not on the SD card either
+        httpd_resp_set_status(req, "406 Not Acceptable");
+        return httpd_resp_sendstr(req, "This file is only available gzip-compressed");
+    }
+#endif
+    return not_found_handler(req, HTTPD_404_NOT_FOUND);
+}
 
+/**
+ * @brief Send a file from the SD card as the response.
+ * 
+ * Handles directory index and extensionless paths like sd_file_handler().
+ * 
+ * @param req HTTP request handle
+ * @return ESP_OK on success
+ * @return ESP_ERR_NOT_FOUND if the file does not exist, nothing has been sent
+ */
+esp_err_t send_sd_file(httpd_req_t *req) {
     // Construct full filesystem path from URI
-    char filepath[530];
-    snprintf(filepath, sizeof(filepath), "%s%s", SD_CARD_MOUNT_POINT, req->uri);
+    const size_t filepath_size = 530;     // Mount point, longest URI and "/index.html"
+    const size_t buf_size = 512;
+    char *filepath = wifi_arena_alloc(req, filepath_size);
+    char *buf = wifi_arena_alloc(req, buf_size);
+    if (filepath == NULL || buf == NULL) {
+        return httpd_resp_send_500(req);
+    }
+    snprintf(filepath, filepath_size, "%s%s", SD_CARD_MOUNT_POINT, req->uri);
 
     // Handle directory requests by appending index.html
     struct stat st;
@@ -1963,53 +3286,38 @@ esp_err_t sd_file_handler(httpd_req_t *req) {
     // Open and read the requested file
     FILE *f = fopen(filepath, "r");
     if (!f) {
-        ESP_LOGE(TAG, "Failed to open file: %s (%s)", filepath, strerror(errno));
-        return not_found_handler(req, HTTPD_404_NOT_FOUND);
+        ESP_LOGD(TAG, "Failed to open file: %s (%s)", filepath, strerror(errno));
+        return ESP_ERR_NOT_FOUND;
     }
 
     // Set appropriate Content-Type header based on file extension
-    if (strstr(filepath, ".html") || strstr(filepath, ".htm")) {
-        httpd_resp_set_type(req, "text/html");
-    } else if (strstr(filepath, ".css")) {
-        httpd_resp_set_type(req, "text/css");
-    } else if (strstr(filepath, ".js")) {
-        httpd_resp_set_type(req, "application/javascript");
-    } else if (strstr(filepath, ".json")) {
-        httpd_resp_set_type(req, "application/json");
-    } else if (strstr(filepath, ".png")) {
-        httpd_resp_set_type(req, "image/png");
-    } else if (strstr(filepath, ".jpg") || strstr(filepath, ".jpeg")) {
-        httpd_resp_set_type(req, "image/jpeg");
-    } else if (strstr(filepath, ".gif")) {
-        httpd_resp_set_type(req, "image/gif");
-    } else if (strstr(filepath, ".svg")) {
-        httpd_resp_set_type(req, "image/svg+xml");
-    } else if (strstr(filepath, ".ico")) {
-        httpd_resp_set_type(req, "image/x-icon");
-    } else if (strstr(filepath, ".woff")) {
-        httpd_resp_set_type(req, "font/woff");
-    } else if (strstr(filepath, ".woff2")) {
-        httpd_resp_set_type(req, "font/woff2");
-    } else if (strstr(filepath, ".ttf")) {
-        httpd_resp_set_type(req, "font/ttf");
-    } else if (strstr(filepath, ".otf")) {
-        httpd_resp_set_type(req, "font/otf");
-    } else if (strstr(filepath, ".eot")) {
-        httpd_resp_set_type(req, "application/vnd.ms-fontobject");
-    } else if (strstr(filepath, ".mp4")) {
-        httpd_resp_set_type(req, "video/mp4");
-    } else if (strstr(filepath, ".webm")) {
-        httpd_resp_set_type(req, "video/webm");
-    } else if (strstr(filepath, ".txt")) {
-        httpd_resp_set_type(req, "text/plain");
-    } else {
-        httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_type(req, wifi_mime_type_for_path(filepath));
+
+#ifdef CONFIG_WIFI_SDLOG
+    // Log files: write out queued records first and offer them as a download
+    if (!strncmp(req->uri, SDLOG_URI_PREFIX, strlen(SDLOG_URI_PREFIX))) {
+        wifi_sdlog_flush(SDLOG_DOWNLOAD_FLUSH_TIMEOUT_MS);
+        httpd_resp_set_hdr(req, "Content-Disposition", "attachment");
+    }
+#endif
+
+#ifdef CONFIG_WIFI_SSI
+    // HTML pages: expand server-side includes while streaming
+    if (wifi_ssi_is_template(filepath)) {
+        esp_err_t ret = wifi_ssi_send(req, f, filepath, SD_CARD_MOUNT_POINT, buf, buf_size);
+        fclose(f);
+        if (ret != ESP_OK) {
+            return ESP_FAIL;
+        }
+        httpd_resp_send_chunk(req, NULL, 0);
+        ESP_LOGD(TAG, "Serving SD template: %s", filepath);
+        return ESP_OK;
     }
+#endif
 
     // Stream file contents to client in chunks
-    char buf[512];
     size_t read_bytes;
-    while ((read_bytes = fread(buf, 1, sizeof(buf), f)) > 0) {
+    while ((read_bytes = fread(buf, 1, buf_size, f)) > 0) {
         httpd_resp_send_chunk(req, buf, read_bytes);
     }
     fclose(f);
@@ -2018,6 +3326,86 @@ esp_err_t sd_file_handler(httpd_req_t *req) {
     return ESP_OK;
 }
 
+/**
+ * @brief Check whether web files can be served from the SD card or the flash asset image.
+ */
+bool web_root_available(void) {
+#ifdef CONFIG_WIFI_ASSETS
+    if (wifi_assets_available()) return true;
+#endif
+    return SD_card_present;
+}
+
+/**
+ * @brief Register the wildcard handler for STA/AP mode.
+ * 
+ * Serves web files with sd_file_handler() and registers the custom handlers
+ * when web files are available, otherwise answers with no_sd_card_handler().
+ * The wildcard is registered last so it does not shadow other handlers.
+ */
+void register_web_root_handler(void) {
+    if (server == NULL) return;
+
+    web_root_handler = web_root_available() ? sd_file_handler : no_sd_card_handler;
+    if (web_root_handler == sd_file_handler && !custom_handlers_registered) {
+        register_custom_http_handlers();
+        custom_handlers_registered = true;
+    }
+
+    httpd_uri_t web_root_uri = {
+        .uri = "/*",
+        .method = HTTP_GET,
+        .handler = web_root_handler
+    };
+    register_builtin_uri(&web_root_uri);
+}
+
+/**
+ * @brief Swap the wildcard handler when the web root changed.
+ * 
+ * Runs in the HTTP server task, so no request is using the SD card while the
+ * handlers change. Does nothing in captive portal mode.
+ */
+void update_web_root_handler(void) {
+    if (server == NULL || web_root_handler == NULL) return;
+    if ((web_root_handler == sd_file_handler) == web_root_available()) return;
+
+    if (httpd_unregister_uri_handler(server, "/*", HTTP_GET) == ESP_OK) {
+        builtin_handler_count--;
+    }
+    register_web_root_handler();
+    ESP_LOGI(TAG_SD, "Web root %s", web_root_handler == sd_file_handler ? "available" : "unavailable");
+}
+
+#ifdef CONFIG_WIFI_SSI
+/**
+ * @brief Template variable "ip": STA address while connected, AP address otherwise.
+ */
+static void ssi_var_ip(char *buf, size_t size, void *ctx) {
+    bool connected = (xEventGroupGetBits(wifi_event_group) & CONNECTED_BIT) != 0;
+    esp_netif_ip_info_t ip_info = { 0 };
+    esp_netif_get_ip_info(connected ? sta_netif : ap_netif, &ip_info);
+    esp_ip4addr_ntoa(&ip_info.ip, buf, size);
+}
+
+/**
+ * @brief Template variable holding a string of captive_cfg, ctx points to it.
+ */
+static void ssi_var_config(char *buf, size_t size, void *ctx) {
+    strlcpy(buf, (const char *)ctx, size);
+}
+
+/**
+ * @brief Register the built-in template variables.
+ */
+void register_ssi_vars(void) {
+    wifi_ssi_register_var("ip", ssi_var_ip, NULL);
+    wifi_ssi_register_var("ssid", ssi_var_config, captive_cfg.ssid);
+    wifi_ssi_register_var("ap_ssid", ssi_var_config, captive_cfg.ap_ssid);
+    wifi_ssi_register_var("hostname", ssi_var_config, captive_cfg.mDNS_hostname);
+}
+#endif
+
 #pragma endregion
 
 #pragma region Wifi Event Handler
@@ -2029,6 +3417,7 @@ esp_err_t sd_file_handler(httpd_req_t *req) {
  */
 void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
     EventBits_t bits = xEventGroupGetBits(wifi_event_group);
+    wifi_trace_event(event_base, event_id, event_data, bits, sta_fails_count);
     wifi_mode_t mode;
     ESP_ERROR_CHECK(esp_wifi_get_mode(&mode));
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_AP_START) {
@@ -2039,10 +3428,16 @@ void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id
         wifi_event_ap_staconnected_t *event = (wifi_event_ap_staconnected_t *)event_data;
         ESP_LOGD(TAG, "station " MACSTR " join, AID=%d",
                  MAC2STR(event->mac), event->aid);
+        wifi_clients_station_connected(event->mac);
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_AP_STADISCONNECTED) {
         wifi_event_ap_stadisconnected_t *event = (wifi_event_ap_stadisconnected_t *)event_data;
         ESP_LOGD(TAG, "station " MACSTR " leave, AID=%d, reason=%d",
                  MAC2STR(event->mac), event->aid, event->reason);
+        wifi_clients_station_disconnected(event->mac);
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_AP_STAIPASSIGNED) {
+        ip_event_ap_staipassigned_t *event = (ip_event_ap_staipassigned_t *)event_data;
+        ESP_LOGD(TAG, "station " MACSTR " got IP " IPSTR, MAC2STR(event->mac), IP2STR(&event->ip));
+        wifi_clients_station_ip(event->mac, event->ip.addr);
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START && mode == WIFI_MODE_STA) {
         ESP_LOGI(TAG, "Wi-Fi STA started, connecting...");
         esp_wifi_connect();
@@ -2078,6 +3473,7 @@ void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id
         char ip_str[IP4ADDR_STRLEN_MAX];
         esp_ip4addr_ntoa(&event->ip_info.ip, ip_str, IP4ADDR_STRLEN_MAX);
         ESP_LOGI(TAG, "Got IP: %s", ip_str);
+        apply_ip_ready();
         sta_fails_count = 0;
         led_indicator_stop(led_handle, BLINK_WIFI_CONNECTING);
         led_indicator_start(led_handle, BLINK_WIFI_CONNECTED);
@@ -0,0 +1,218 @@
+/**
+ * @file wifi_arena.c
+ * @brief Per-request scratch memory for HTTP handlers.
+ *
+ * Wrapped handlers are registered with a trampoline as their handler and a
+ * pointer to a {handler, user_ctx} pair as their user_ctx. The trampoline
+ * restores the original user_ctx, marks the arena as owned by the request,
+ * calls the handler and resets the arena afterwards. Error handlers have no
+ * user_ctx, their trampoline looks the handler up by error code.
+ */
+
+#include "wifi_arena.h"
+#include "wifi_handlers.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#include <string.h>
+
+/** @brief Log tag for arena messages */
+static const char *TAG_ARENA = "Wifi-Arena";
+
+/** @brief Allocation alignment */
+#define ARENA_ALIGN 8
+
+/** @brief Number of distinct handlers that can be wrapped (built-ins plus custom handlers) */
+#define ARENA_MAX_WRAPPED WIFI_MAX_WRAPPED_HANDLERS
+
+/**
+ * @brief Original handler and context of a wrapped URI handler.
+ */
+typedef struct {
+    esp_err_t (*handler)(httpd_req_t *req);
+    void *user_ctx;
+} arena_wrap_t;
+
+/** @brief Wrapped handlers, entries are reused when the same handler is registered again after a mode switch */
+static arena_wrap_t arena_wraps[ARENA_MAX_WRAPPED];
+
+/** @brief Number of used entries in arena_wraps */
+static size_t arena_wrap_count = 0;
+
+/** @brief Wrapped error handlers by error code */
+static httpd_err_handler_func_t arena_err_handlers[HTTPD_ERR_CODE_MAX];
+
+/** @brief Arena memory */
+static uint8_t arena_blocks[CONFIG_WIFI_ARENA_BLOCKS][CONFIG_WIFI_ARENA_BLOCK_SIZE] __attribute__((aligned(ARENA_ALIGN)));
+
+/** @brief Block the next allocation is taken from */
+static size_t arena_block = 0;
+
+/** @brief Offset of the next allocation within arena_block */
+static size_t arena_offset = 0;
+
+/** @brief Bytes handed out to the current request, including alignment padding */
+static size_t arena_used = 0;
+
+/** @brief Request that owns the arena, NULL outside wrapped handlers */
+static httpd_req_t *arena_req = NULL;
+
+/** @brief Task running the owning request */
+static TaskHandle_t arena_task = NULL;
+
+/** @brief Usage statistics */
+static wifi_arena_stats_t arena_stats;
+
+/** @brief Spinlock guarding arena_wraps and arena_stats */
+static portMUX_TYPE arena_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void *wifi_arena_alloc(httpd_req_t *req, size_t size) {
+    if (req == NULL || req != arena_req || xTaskGetCurrentTaskHandle() != arena_task) {
+        ESP_LOGW(TAG_ARENA, "Arena used outside of a wrapped handler");
+        return NULL;
+    }
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size == 0) size = ARENA_ALIGN;
+
+    if (size <= CONFIG_WIFI_ARENA_BLOCK_SIZE && arena_offset + size > CONFIG_WIFI_ARENA_BLOCK_SIZE) {
+        // Does not fit the rest of this block, continue in the next one
+        arena_used += CONFIG_WIFI_ARENA_BLOCK_SIZE - arena_offset;
+        arena_block++;
+        arena_offset = 0;
+    }
+    if (size > CONFIG_WIFI_ARENA_BLOCK_SIZE || arena_block >= CONFIG_WIFI_ARENA_BLOCKS) {
+        ESP_LOGW(TAG_ARENA, "No arena space for %u bytes (%s)", (unsigned)size, req->uri);
+        taskENTER_CRITICAL(&arena_lock);
+        arena_stats.failures++;
+        taskEXIT_CRITICAL(&arena_lock);
+        return NULL;
+    }
+
+    void *ptr = &arena_blocks[arena_block][arena_offset];
+    arena_offset += size;
+    arena_used += size;
+    return ptr;
+}
+
+/**
+ * @brief Make req the owner of the arena.
+ *
+ * @param req Request about to be handled
+ * @param[out] outer_req Previous owner, restored by arena_leave()
+ * @param[out] outer_task Task of the previous owner
+ */
+static void arena_enter(httpd_req_t *req, httpd_req_t **outer_req, TaskHandle_t *outer_task) {
+    *outer_req = arena_req;
+    *outer_task = arena_task;
+    arena_req = req;
+    arena_task = xTaskGetCurrentTaskHandle();
+}
+
+/**
+ * @brief Account the request's arena use and reset the arena.
+ *
+ * @param outer_req Owner before arena_enter()
+ * @param outer_task Task of that owner
+ */
+static void arena_leave(httpd_req_t *outer_req, TaskHandle_t outer_task) {
+    if (outer_req != NULL) {
+        // Called from within another wrapped handler, the outer one still owns the arena contents
+        arena_req = outer_req;
+        arena_task = outer_task;
+        return;
+    }
+    taskENTER_CRITICAL(&arena_lock);
+    arena_stats.calls++;
+    if (arena_used > 0) {
+        arena_stats.requests++;
+        if (arena_used > arena_stats.high_water) {
+            arena_stats.high_water = arena_used;
+        }
+    }
+    taskEXIT_CRITICAL(&arena_lock);
+    arena_block = 0;
+    arena_offset = 0;
+    arena_used = 0;
+    arena_req = NULL;
+    arena_task = NULL;
+}
+
+/**
+ * @brief Handler registered for every wrapped URI.
+ */
+static esp_err_t arena_trampoline(httpd_req_t *req) {
+    const arena_wrap_t *wrap = req->user_ctx;
+    req->user_ctx = wrap->user_ctx;
+
+    httpd_req_t *outer_req;
+    TaskHandle_t outer_task;
+    arena_enter(req, &outer_req, &outer_task);
+    esp_err_t ret = wrap->handler(req);
+    arena_leave(outer_req, outer_task);
+
+    req->user_ctx = (void *)wrap;
+    return ret;
+}
+
+/**
+ * @brief Handler registered for every wrapped error code.
+ */
+static esp_err_t arena_err_trampoline(httpd_req_t *req, httpd_err_code_t error) {
+    httpd_err_handler_func_t handler = arena_err_handlers[error];
+    if (handler == NULL) return ESP_FAIL;
+
+    httpd_req_t *outer_req;
+    TaskHandle_t outer_task;
+    arena_enter(req, &outer_req, &outer_task);
+    esp_err_t ret = handler(req, error);
+    arena_leave(outer_req, outer_task);
+    return ret;
+}
+
+esp_err_t wifi_arena_register_uri(httpd_handle_t handle, const httpd_uri_t *uri) {
+    if (handle == NULL || uri == NULL || uri->handler == NULL) return ESP_ERR_INVALID_ARG;
+
+    arena_wrap_t *wrap = NULL;
+    taskENTER_CRITICAL(&arena_lock);
+    for (size_t i = 0; i < arena_wrap_count; i++) {
+        if (arena_wraps[i].handler == uri->handler && arena_wraps[i].user_ctx == uri->user_ctx) {
+            wrap = &arena_wraps[i];
+            break;
+        }
+    }
+    if (wrap == NULL && arena_wrap_count < ARENA_MAX_WRAPPED) {
+        wrap = &arena_wraps[arena_wrap_count++];
+        wrap->handler = uri->handler;
+        wrap->user_ctx = uri->user_ctx;
+    }
+    taskEXIT_CRITICAL(&arena_lock);
+
+    if (wrap == NULL) {
+        ESP_LOGE(TAG_ARENA, "Too many wrapped handlers (%d), %s not registered", ARENA_MAX_WRAPPED, uri->uri);
+        return ESP_ERR_NO_MEM;
+    }
+
+    httpd_uri_t wrapped = *uri;
+    wrapped.handler = arena_trampoline;
+    wrapped.user_ctx = wrap;
+    return httpd_register_uri_handler(handle, &wrapped);
+}
+
+esp_err_t wifi_arena_register_err_handler(httpd_handle_t handle, httpd_err_code_t error,
+                                          httpd_err_handler_func_t handler) {
+    if (handle == NULL || handler == NULL || error < 0 || error >= HTTPD_ERR_CODE_MAX) return ESP_ERR_INVALID_ARG;
+    arena_err_handlers[error] = handler;
+    return httpd_register_err_handler(handle, error, arena_err_trampoline);
+}
+
+void wifi_arena_get_stats(wifi_arena_stats_t *stats) {
+    if (stats == NULL) return;
+    taskENTER_CRITICAL(&arena_lock);
+    *stats = arena_stats;
+    taskEXIT_CRITICAL(&arena_lock);
+    stats->block_size = CONFIG_WIFI_ARENA_BLOCK_SIZE;
+    stats->blocks = CONFIG_WIFI_ARENA_BLOCKS;
+}
@@ -0,0 +1,286 @@
+/**
+ * @file wifi_assets.c
+ * @brief Read-only web assets served from a memory-mapped flash partition.
+ *
+ * The image format is described in tools/pack_assets.py. The index is sorted
+ * by FNV-1a hash of the path, so a lookup is one hash over the URI and a
+ * binary search, without touching the SD card or copying file data. A file
+ * can be stored twice, compressed and uncompressed, with the compressed entry
+ * first.
+ */
+
+#include "sdkconfig.h"
+
+#ifdef CONFIG_WIFI_ASSETS
+
+#include "wifi_assets.h"
+#include "wifi_util.h"
+
+#include "esp_log.h"
+#include "esp_partition.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+/** @brief Longest Accept-Encoding value looked at, codings listed later are not seen */
+#define ASSETS_ACCEPT_ENCODING_MAX 128
+
+/** @brief Log tag for asset messages */
+static const char *TAG_ASSETS = "Wifi-Assets";
+
+#define ASSETS_MAGIC "WAST"     ///< Image magic
+#define ASSETS_VERSION 1        ///< Supported image format version
+#define ASSETS_FLAG_GZIP 0x0001 ///< Entry data is gzip-compressed
+
+/**
+ * @brief Image header.
+ */
+typedef struct __attribute__((packed)) {
+    char magic[4];
+    uint8_t version;
+    uint8_t reserved0;
+    uint16_t count;
+    uint32_t size;
+    uint32_t reserved1;
+} assets_header_t;
+
+/**
+ * @brief Index entry.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t hash;
+    uint32_t path_offset;
+    uint32_t data_offset;
+    uint32_t size;
+    uint32_t crc;
+    uint16_t flags;
+    uint16_t path_len;
+} assets_entry_t;
+
+/** @brief Start of the mapped image, NULL if not mapped */
+static const uint8_t *assets_image = NULL;
+
+/** @brief Index of the mapped image */
+static const assets_entry_t *assets_index = NULL;
+
+/** @brief Number of index entries */
+static size_t assets_count = 0;
+
+/** @brief Handle of the partition mapping */
+static esp_partition_mmap_handle_t assets_mmap_handle;
+
+/**
+ * @brief Continue an FNV-1a hash over len bytes.
+ */
+static uint32_t fnv1a(uint32_t hash, const char *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)data[i];
+        hash *= 0x01000193;
+    }
+    return hash;
+}
+
+/**
+ * @brief Fill an asset from an index entry.
+ */
+static void fill_asset(const assets_entry_t *e, wifi_asset_t *asset) {
+    asset->path = (const char *)assets_image + e->path_offset;
+    asset->data = assets_image + e->data_offset;
+    asset->size = e->size;
+    asset->crc = e->crc;
+    asset->gzip = (e->flags & ASSETS_FLAG_GZIP) != 0;
+}
+
+/**
+ * @brief Look up the path formed by prefix and suffix without joining them.
+ *
+ * @param gzip_ok Compressed entries may be returned, otherwise only an uncompressed one
+ * @param[out] gzip_only Set if the path exists but only compressed, may be NULL
+ */
+static const assets_entry_t *find_joined(const char *prefix, size_t prefix_len, const char *suffix, bool gzip_ok,
+                                         bool *gzip_only) {
+    if (assets_count == 0) return NULL;
+    size_t suffix_len = strlen(suffix);
+    uint32_t hash = fnv1a(fnv1a(0x811C9DC5, prefix, prefix_len), suffix, suffix_len);
+
+    // First entry with this hash
+    size_t lo = 0, hi = assets_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (assets_index[mid].hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    for (; lo < assets_count && assets_index[lo].hash == hash; lo++) {
+        const assets_entry_t *e = &assets_index[lo];
+        const char *path = (const char *)assets_image + e->path_offset;
+        if (e->path_len == prefix_len + suffix_len &&
+            memcmp(path, prefix, prefix_len) == 0 &&
+            memcmp(path + prefix_len, suffix, suffix_len) == 0) {
+            if (gzip_ok || !(e->flags & ASSETS_FLAG_GZIP)) return e;
+            if (gzip_only != NULL) *gzip_only = true;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Check the header and every index entry of a mapped image.
+ */
+static bool validate_image(const uint8_t *image, size_t size) {
+    const assets_header_t *h = (const assets_header_t *)image;
+    if (size < sizeof(*h) || h->size > size || sizeof(*h) + (size_t)h->count * sizeof(assets_entry_t) > h->size) {
+        return false;
+    }
+    const assets_entry_t *index = (const assets_entry_t *)(image + sizeof(*h));
+    for (size_t i = 0; i < h->count; i++) {
+        const assets_entry_t *e = &index[i];
+        if ((uint64_t)e->path_offset + e->path_len >= h->size || image[e->path_offset + e->path_len] != '\0' ||
+            (uint64_t)e->data_offset + e->size > h->size || (i > 0 && index[i - 1].hash > e->hash)) {
+            ESP_LOGE(TAG_ASSETS, "Asset entry %u is invalid", (unsigned)i);
+            return false;
+        }
+    }
+    return true;
+}
+
+esp_err_t wifi_assets_init(void) {
+    if (assets_image != NULL) return ESP_OK;
+
+    const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                           CONFIG_WIFI_ASSETS_PARTITION_LABEL);
+    if (part == NULL) {
+        ESP_LOGW(TAG_ASSETS, "No \"%s\" partition, flash assets disabled", CONFIG_WIFI_ASSETS_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    assets_header_t header;
+    esp_err_t err = esp_partition_read(part, 0, &header, sizeof(header));
+    if (err != ESP_OK) return err;
+    if (memcmp(header.magic, ASSETS_MAGIC, 4) != 0 || header.version != ASSETS_VERSION || header.size > part->size) {
+        ESP_LOGW(TAG_ASSETS, "Partition \"%s\" holds no asset image, flash it with the <partition>-flash target",
+                 part->label);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    const void *ptr;
+    err = esp_partition_mmap(part, 0, header.size, ESP_PARTITION_MMAP_DATA, &ptr, &assets_mmap_handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_ASSETS, "Failed to map asset partition: %s", esp_err_to_name(err));
+        return err;
+    }
+    if (!validate_image(ptr, header.size)) {
+        esp_partition_munmap(assets_mmap_handle);
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    assets_image = ptr;
+    assets_index = (const assets_entry_t *)(assets_image + sizeof(assets_header_t));
+    assets_count = header.count;
+    ESP_LOGI(TAG_ASSETS, "Mapped %u assets (%lu bytes) from partition \"%s\"",
+             (unsigned)assets_count, (unsigned long)header.size, part->label);
+    return ESP_OK;
+}
+
+bool wifi_assets_available(void) {
+    return assets_image != NULL;
+}
+
+esp_err_t wifi_assets_find(const char *path, size_t len, wifi_asset_t *asset) {
+    if (path == NULL || asset == NULL) return ESP_ERR_INVALID_ARG;
+    const assets_entry_t *e = find_joined(path, len, "", true, NULL);
+    if (e == NULL) return ESP_ERR_NOT_FOUND;
+    fill_asset(e, asset);
+    return ESP_OK;
+}
+
+/**
+ * @brief Look up the entry for a request URI, see wifi_assets_find_uri().
+ */
+static const assets_entry_t *find_uri(const char *uri, bool gzip_ok, bool *gzip_only) {
+    size_t len = strcspn(uri, "?#");
+    const assets_entry_t *e = NULL;
+
+    if (len > 0 && uri[len - 1] == '/') {
+        e = find_joined(uri, len, "index.html", gzip_ok, gzip_only);
+    } else {
+        e = find_joined(uri, len, "", gzip_ok, gzip_only);
+        if (e == NULL) e = find_joined(uri, len, "/index.html", gzip_ok, gzip_only);
+        if (e == NULL) {
+            // Extensionless path, try the .html file
+            const char *last_segment = uri;
+            for (size_t i = 0; i < len; i++) {
+                if (uri[i] == '/') last_segment = &uri[i];
+            }
+            if (memchr(last_segment, '.', len - (last_segment - uri)) == NULL) {
+                e = find_joined(uri, len, ".html", gzip_ok, gzip_only);
+            }
+        }
+    }
+    return e;
+}
+
+esp_err_t wifi_assets_find_uri(const char *uri, wifi_asset_t *asset) {
+    if (uri == NULL || asset == NULL) return ESP_ERR_INVALID_ARG;
+    const assets_entry_t *e = find_uri(uri, true, NULL);
+    if (e == NULL) return ESP_ERR_NOT_FOUND;
+    fill_asset(e, asset);
+    return ESP_OK;
+}
+
+esp_err_t wifi_assets_find_request(httpd_req_t *req, wifi_asset_t *asset) {
+    if (req == NULL || asset == NULL) return ESP_ERR_INVALID_ARG;
+    char accept[ASSETS_ACCEPT_ENCODING_MAX];
+    esp_err_t err = httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept, sizeof(accept));
+    bool gzip_ok = (err == ESP_OK || err == ESP_ERR_HTTPD_RESULT_TRUNC) && wifi_accepts_encoding(accept, "gzip");
+
+    bool gzip_only = false;
+    const assets_entry_t *e = find_uri(req->uri, gzip_ok, &gzip_only);
+    if (e == NULL) {
+        if (gzip_only) {
+            ESP_LOGD(TAG_ASSETS, "%s is only stored compressed, the client does not accept gzip", req->uri);
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        return ESP_ERR_NOT_FOUND;
+    }
+    fill_asset(e, asset);
+    return ESP_OK;
+}
+
+size_t wifi_assets_count(void) {
+    return assets_count;
+}
+
+esp_err_t wifi_assets_get(size_t index, wifi_asset_t *asset) {
+    if (index >= assets_count || asset == NULL) return ESP_ERR_INVALID_ARG;
+    fill_asset(&assets_index[index], asset);
+    return ESP_OK;
+}
+
+esp_err_t wifi_assets_send(httpd_req_t *req, const wifi_asset_t *asset) {
+    char etag[12];
+    snprintf(etag, sizeof(etag), "\"%08" PRIx32 "\"", asset->crc);
+    httpd_resp_set_hdr(req, "ETag", etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+
+    char if_none_match[12];
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match", if_none_match, sizeof(if_none_match)) == ESP_OK &&
+        strcmp(if_none_match, etag) == 0) {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    httpd_resp_set_type(req, wifi_mime_type_for_path(asset->path));
+    if (asset->gzip) {
+        httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    }
+    ESP_LOGD(TAG_ASSETS, "Serving flash asset: %s (%u bytes%s)", asset->path, (unsigned)asset->size, asset->gzip ? ", gzip" : "");
+    // Sent straight from mapped flash
+    return httpd_resp_send(req, (const char *)asset->data, asset->size);
+}
+
+#endif // CONFIG_WIFI_ASSETS
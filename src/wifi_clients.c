@@ -0,0 +1,391 @@
+/**
+ * @file wifi_clients.c
+ * @brief Station table and per-client captive portal state.
+ */
+
+#include "wifi_clients.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <string.h>
+#include <strings.h>
+
+/** @brief Log tag for client tracking */
+static const char *TAG_CLIENTS = "Wifi-Clients";
+
+/** @brief How a client was classified, a higher value overrides a lower one */
+typedef enum {
+    CLASSIFIED_NONE = 0,
+    CLASSIFIED_DNS,         ///< Looked up a platform's probe host
+    CLASSIFIED_URI,         ///< Requested a platform's probe URL
+    CLASSIFIED_USER_AGENT,  ///< Sent a platform's User-Agent
+} classified_by_t;
+
+/**
+ * @brief One tracked client.
+ */
+typedef struct {
+    bool in_use;            ///< Entry holds a client
+    bool connected;         ///< Associated with the softAP
+    bool redirected;        ///< First probe was answered
+    bool popup;             ///< Portal page was opened
+    uint8_t mac[6];         ///< Station MAC, all zero for clients known by IP only
+    uint8_t os;             ///< wifi_client_os_t
+    uint8_t classified_by;  ///< classified_by_t
+    uint32_t ip;            ///< Client address, 0 until known
+    int64_t since_us;       ///< esp_timer time of the association or first sighting
+    TickType_t last_seen;   ///< Tick of the last activity
+    uint32_t http_requests; ///< Responses sent
+    uint32_t bytes_in;      ///< HTTP bytes received
+    uint32_t bytes_out;     ///< HTTP bytes sent
+    uint32_t dns_queries;   ///< Captive DNS queries
+    uint16_t probes;        ///< Probes since the association or the last mode switch
+} client_t;
+
+/**
+ * @brief Pattern identifying a platform.
+ */
+typedef struct {
+    const char *pattern;
+    wifi_client_os_t os;
+} os_pattern_t;
+
+/** @brief Probe hosts, matched as name suffix */
+static const os_pattern_t dns_patterns[] = {
+    { "connectivitycheck.gstatic.com", WIFI_CLIENT_OS_ANDROID },
+    { "connectivitycheck.android.com", WIFI_CLIENT_OS_ANDROID },
+    { "clients1.google.com", WIFI_CLIENT_OS_ANDROID },
+    { "clients3.google.com", WIFI_CLIENT_OS_ANDROID },
+    { "captive.apple.com", WIFI_CLIENT_OS_APPLE },
+    { "msftconnecttest.com", WIFI_CLIENT_OS_WINDOWS },
+    { "msftncsi.com", WIFI_CLIENT_OS_WINDOWS },
+    { "nmcheck.gnome.org", WIFI_CLIENT_OS_LINUX },
+    { "connectivity-check.ubuntu.com", WIFI_CLIENT_OS_LINUX },
+    { "network-test.debian.org", WIFI_CLIENT_OS_LINUX },
+};
+
+/** @brief Probe URIs, matched exactly; /success.txt is sent by Firefox on any platform */
+static const os_pattern_t uri_patterns[] = {
+    { "/generate_204", WIFI_CLIENT_OS_ANDROID },
+    { "/gen_204", WIFI_CLIENT_OS_ANDROID },
+    { "/hotspot-detect.html", WIFI_CLIENT_OS_APPLE },
+    { "/ncsi.txt", WIFI_CLIENT_OS_WINDOWS },
+    { "/connecttest.txt", WIFI_CLIENT_OS_WINDOWS },
+    { "/check_network_status.txt", WIFI_CLIENT_OS_LINUX },
+};
+
+/** @brief User-Agent substrings, first match wins, Android before Linux */
+static const os_pattern_t user_agent_patterns[] = {
+    { "CaptiveNetworkSupport", WIFI_CLIENT_OS_APPLE },
+    { "iPhone", WIFI_CLIENT_OS_APPLE },
+    { "iPad", WIFI_CLIENT_OS_APPLE },
+    { "Macintosh", WIFI_CLIENT_OS_APPLE },
+    { "Android", WIFI_CLIENT_OS_ANDROID },
+    { "Dalvik", WIFI_CLIENT_OS_ANDROID },
+    { "CrOS", WIFI_CLIENT_OS_ANDROID },
+    { "Microsoft NCSI", WIFI_CLIENT_OS_WINDOWS },
+    { "Windows", WIFI_CLIENT_OS_WINDOWS },
+    { "NetworkManager", WIFI_CLIENT_OS_LINUX },
+    { "Linux", WIFI_CLIENT_OS_LINUX },
+};
+
+/** @brief Platform names, indexed by wifi_client_os_t */
+static const char *const os_names[WIFI_CLIENT_OS_COUNT] = {
+    [WIFI_CLIENT_OS_UNKNOWN] = "unknown",
+    [WIFI_CLIENT_OS_ANDROID] = "Android",
+    [WIFI_CLIENT_OS_APPLE] = "Apple",
+    [WIFI_CLIENT_OS_WINDOWS] = "Windows",
+    [WIFI_CLIENT_OS_LINUX] = "Linux",
+};
+
+/** @brief Tracked clients */
+static client_t clients[WIFI_CLIENTS_MAX];
+
+/** @brief Counters per platform */
+static wifi_client_os_stats_t os_stats[WIFI_CLIENT_OS_COUNT];
+
+/** @brief MAC address of clients known by IP only */
+static const uint8_t no_mac[6] = { 0 };
+
+/** @brief Protects clients and os_stats, used from the DNS and HTTP server tasks and the event loop */
+static portMUX_TYPE clients_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Check whether a host name is a pattern or a subdomain of it.
+ */
+static bool name_matches(const char *name, const char *suffix) {
+    size_t name_len = strlen(name);
+    size_t suffix_len = strlen(suffix);
+    if (name_len < suffix_len || strcasecmp(name + name_len - suffix_len, suffix) != 0) return false;
+    return name_len == suffix_len || name[name_len - suffix_len - 1] == '.';
+}
+
+/**
+ * @brief Take a free entry, or replace the least recently seen client, preferring ones not associated. Call with clients_lock held.
+ */
+static client_t *new_client(void) {
+    TickType_t now = xTaskGetTickCount();
+    client_t *victim = &clients[0];
+    for (int i = 0; i < WIFI_CLIENTS_MAX; i++) {
+        client_t *client = &clients[i];
+        if (!client->in_use) {
+            victim = client;
+            break;
+        }
+        if ((victim->connected && !client->connected) ||
+            (victim->connected == client->connected && now - client->last_seen > now - victim->last_seen)) {
+            victim = client;
+        }
+    }
+    memset(victim, 0, sizeof(*victim));
+    victim->in_use = true;
+    victim->since_us = esp_timer_get_time();
+    victim->last_seen = now;
+    return victim;
+}
+
+/**
+ * @brief Find a client by address. Call with clients_lock held.
+ *
+ * @return Client, NULL if not tracked
+ */
+static client_t *find_client_by_ip(uint32_t ip) {
+    for (int i = 0; i < WIFI_CLIENTS_MAX; i++) {
+        if (clients[i].in_use && clients[i].ip == ip) return &clients[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Find a client by address, or start tracking it by address alone. Call with clients_lock held.
+ */
+static client_t *get_client(uint32_t ip) {
+    client_t *client = find_client_by_ip(ip);
+    if (client == NULL) {
+        client = new_client();
+        client->ip = ip;
+    }
+    return client;
+}
+
+/**
+ * @brief Find a station by MAC address, or start tracking it. Call with clients_lock held.
+ */
+static client_t *get_station(const uint8_t mac[6]) {
+    for (int i = 0; i < WIFI_CLIENTS_MAX; i++) {
+        if (clients[i].in_use && !memcmp(clients[i].mac, mac, 6)) return &clients[i];
+    }
+    client_t *client = new_client();
+    memcpy(client->mac, mac, 6);
+    return client;
+}
+
+/**
+ * @brief Set the platform of a client unless a more reliable source already did. Call with clients_lock held.
+ */
+static void classify(client_t *client, wifi_client_os_t os, classified_by_t by) {
+    if (os == WIFI_CLIENT_OS_UNKNOWN || by < client->classified_by) return;
+    client->os = os;
+    client->classified_by = by;
+}
+
+void wifi_clients_station_connected(const uint8_t mac[6]) {
+    taskENTER_CRITICAL(&clients_lock);
+    client_t *client = get_station(mac);
+    client->connected = true;
+    client->since_us = esp_timer_get_time();
+    client->last_seen = xTaskGetTickCount();
+    // A new association is a new captive portal session for the device
+    client->probes = 0;
+    client->redirected = false;
+    client->popup = false;
+    taskEXIT_CRITICAL(&clients_lock);
+}
+
+void wifi_clients_station_disconnected(const uint8_t mac[6]) {
+    taskENTER_CRITICAL(&clients_lock);
+    for (int i = 0; i < WIFI_CLIENTS_MAX; i++) {
+        if (clients[i].in_use && !memcmp(clients[i].mac, mac, 6)) {
+            clients[i].connected = false;
+            clients[i].last_seen = xTaskGetTickCount();
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&clients_lock);
+}
+
+void wifi_clients_station_ip(const uint8_t mac[6], uint32_t ip) {
+    taskENTER_CRITICAL(&clients_lock);
+    client_t *station = get_station(mac);
+    for (int i = 0; i < WIFI_CLIENTS_MAX; i++) {
+        client_t *client = &clients[i];
+        if (client == station || !client->in_use || client->ip != ip) continue;
+        if (!memcmp(client->mac, no_mac, 6)) {
+            // Seen by address before the lease was reported, same device
+            station->dns_queries += client->dns_queries;
+            station->http_requests += client->http_requests;
+            station->bytes_in += client->bytes_in;
+            station->bytes_out += client->bytes_out;
+            station->probes += client->probes;
+            station->redirected |= client->redirected;
+            station->popup |= client->popup;
+            classify(station, client->os, client->classified_by);
+            memset(client, 0, sizeof(*client));
+        } else {
+            client->ip = 0;     // Address reused from a station that left
+        }
+    }
+    station->ip = ip;
+    station->last_seen = xTaskGetTickCount();
+    taskEXIT_CRITICAL(&clients_lock);
+}
+
+void wifi_clients_traffic(uint32_t ip, size_t bytes_in, size_t bytes_out, bool response) {
+    if (ip == 0) return;
+    taskENTER_CRITICAL(&clients_lock);
+    client_t *client = get_client(ip);
+    client->bytes_in += bytes_in;
+    client->bytes_out += bytes_out;
+    client->http_requests += response;
+    client->last_seen = xTaskGetTickCount();
+    taskEXIT_CRITICAL(&clients_lock);
+}
+
+void wifi_clients_dns_query(uint32_t ip, const char *name) {
+    if (ip == 0) return;
+    wifi_client_os_t os = WIFI_CLIENT_OS_UNKNOWN;
+    for (size_t i = 0; i < sizeof(dns_patterns) / sizeof(dns_patterns[0]); i++) {
+        if (name_matches(name, dns_patterns[i].pattern)) {
+            os = dns_patterns[i].os;
+            break;
+        }
+    }
+
+    taskENTER_CRITICAL(&clients_lock);
+    client_t *client = get_client(ip);
+    client->last_seen = xTaskGetTickCount();
+    client->dns_queries++;
+    classify(client, os, CLASSIFIED_DNS);
+    taskEXIT_CRITICAL(&clients_lock);
+}
+
+wifi_client_os_t wifi_clients_probe(uint32_t ip, const char *uri, const char *user_agent, bool *first) {
+    wifi_client_os_t uri_os = WIFI_CLIENT_OS_UNKNOWN;
+    for (size_t i = 0; i < sizeof(uri_patterns) / sizeof(uri_patterns[0]); i++) {
+        if (!strcmp(uri, uri_patterns[i].pattern)) {
+            uri_os = uri_patterns[i].os;
+            break;
+        }
+    }
+    wifi_client_os_t ua_os = WIFI_CLIENT_OS_UNKNOWN;
+    for (size_t i = 0; i < sizeof(user_agent_patterns) / sizeof(user_agent_patterns[0]); i++) {
+        if (strstr(user_agent, user_agent_patterns[i].pattern)) {
+            ua_os = user_agent_patterns[i].os;
+            break;
+        }
+    }
+
+    *first = false;
+    if (ip == 0) {
+        wifi_client_os_t os = ua_os != WIFI_CLIENT_OS_UNKNOWN ? ua_os : uri_os;
+        taskENTER_CRITICAL(&clients_lock);
+        os_stats[os].probes++;
+        taskEXIT_CRITICAL(&clients_lock);
+        return os;
+    }
+
+    taskENTER_CRITICAL(&clients_lock);
+    client_t *client = get_client(ip);
+    client->last_seen = xTaskGetTickCount();
+    classify(client, uri_os, CLASSIFIED_URI);
+    classify(client, ua_os, CLASSIFIED_USER_AGENT);
+    if (client->probes < UINT16_MAX) client->probes++;
+    *first = !client->redirected;
+    client->redirected = true;
+    wifi_client_os_t os = client->os;
+    os_stats[os].probes++;
+    taskEXIT_CRITICAL(&clients_lock);
+
+    ESP_LOGD(TAG_CLIENTS, "Probe %s from " IPSTR " (%s)%s", uri, IP2STR((esp_ip4_addr_t *)&ip), os_names[os], *first ? ", first" : "");
+    return os;
+}
+
+void wifi_clients_portal_opened(uint32_t ip) {
+    if (ip == 0) return;
+    wifi_client_os_t os = WIFI_CLIENT_OS_UNKNOWN;
+    uint16_t probes = 0;
+    taskENTER_CRITICAL(&clients_lock);
+    client_t *client = find_client_by_ip(ip);
+    if (client != NULL && !client->popup && client->probes > 0) {
+        client->popup = true;
+        os = client->os;
+        probes = client->probes;
+        os_stats[os].popups++;
+        os_stats[os].probes_before_popup += probes;
+    }
+    taskEXIT_CRITICAL(&clients_lock);
+
+    if (probes > 0) {
+        ESP_LOGI(TAG_CLIENTS, "Portal opened by " IPSTR " (%s) after %u probes", IP2STR((esp_ip4_addr_t *)&ip), os_names[os], probes);
+    }
+}
+
+void wifi_clients_reset(void) {
+    taskENTER_CRITICAL(&clients_lock);
+    memset(clients, 0, sizeof(clients));
+    taskEXIT_CRITICAL(&clients_lock);
+}
+
+size_t wifi_get_stations(wifi_station_info_t *stations, size_t max) {
+    wifi_sta_list_t sta_list = { 0 };
+    if (esp_wifi_ap_get_sta_list(&sta_list) != ESP_OK) {
+        sta_list.num = 0;   // No softAP running
+    }
+    int64_t now_us = esp_timer_get_time();
+
+    size_t count = 0;
+    taskENTER_CRITICAL(&clients_lock);
+    for (int i = 0; i < WIFI_CLIENTS_MAX && count < max; i++) {
+        const client_t *client = &clients[i];
+        if (!client->in_use) continue;
+        wifi_station_info_t *info = &stations[count++];
+        memcpy(info->mac, client->mac, 6);
+        info->ip = client->ip;
+        info->connected = client->connected;
+        info->rssi = 0;
+        info->connected_s = (uint32_t)((now_us - client->since_us) / 1000000);
+        info->os = client->os;
+        info->http_requests = client->http_requests;
+        info->bytes_in = client->bytes_in;
+        info->bytes_out = client->bytes_out;
+        info->dns_queries = client->dns_queries;
+        info->probes = client->probes;
+        info->redirected = client->redirected;
+        info->portal_opened = client->popup;
+    }
+    taskEXIT_CRITICAL(&clients_lock);
+
+    for (size_t i = 0; i < count; i++) {
+        for (int j = 0; j < sta_list.num; j++) {
+            if (stations[i].connected && !memcmp(stations[i].mac, sta_list.sta[j].mac, 6)) {
+                stations[i].rssi = sta_list.sta[j].rssi;
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+void wifi_get_client_os_stats(wifi_client_os_stats_t stats[WIFI_CLIENT_OS_COUNT]) {
+    taskENTER_CRITICAL(&clients_lock);
+    memcpy(stats, os_stats, sizeof(os_stats));
+    taskEXIT_CRITICAL(&clients_lock);
+}
+
+const char *wifi_client_os_name(wifi_client_os_t os) {
+    return os < WIFI_CLIENT_OS_COUNT ? os_names[os] : "invalid";
+}
@@ -0,0 +1,109 @@
+/**
+ * @file wifi_clients.h
+ * @brief Station table and per-client captive portal state (private).
+ *
+ * SoftAP stations are tracked by MAC address from their association until
+ * the next mode switch, together with the IP address the DHCP server gave
+ * them. Clients that are not softAP stations, such as LAN clients in STA
+ * mode, are tracked by IP address alone. Each entry counts the client's HTTP
+ * requests and bytes, its DNS queries to the captive DNS server and its
+ * connectivity probes.
+ *
+ * Clients are classified by the platform they run, from the host names they
+ * look up on the captive DNS server, the probe URLs they request and their
+ * User-Agent, the latter being the most reliable. The table decides whether a
+ * probe is the first one of its client, which is redirected to the portal,
+ * and counts per platform how many probes clients send before they open the
+ * portal page.
+ *
+ * The table holds WIFI_CLIENTS_MAX clients. When it is full, the least
+ * recently seen client that is not associated is replaced first. It is
+ * cleared on every mode switch.
+ */
+
+#ifndef WIFI_CLIENTS_H
+#define WIFI_CLIENTS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Wifi.h"
+
+/** @brief Clients tracked at once */
+#define WIFI_CLIENTS_MAX WIFI_STATIONS_MAX
+
+/**
+ * @brief Note a station associating with the softAP.
+ *
+ * @param mac Station MAC address
+ */
+void wifi_clients_station_connected(const uint8_t mac[6]);
+
+/**
+ * @brief Note a station leaving the softAP; its entry and counters are kept.
+ *
+ * @param mac Station MAC address
+ */
+void wifi_clients_station_disconnected(const uint8_t mac[6]);
+
+/**
+ * @brief Note the IP address the DHCP server assigned to a station.
+ *
+ * @param mac Station MAC address
+ * @param ip IPv4 address, network byte order
+ */
+void wifi_clients_station_ip(const uint8_t mac[6], uint32_t ip);
+
+/**
+ * @brief Note a DNS question, called from the DNS server task.
+ *
+ * @param ip Client IPv4 address, network byte order
+ * @param name Queried name
+ */
+void wifi_clients_dns_query(uint32_t ip, const char *name);
+
+/**
+ * @brief Count HTTP traffic of a client.
+ *
+ * @param ip Client address, 0 if unknown; unknown clients are not tracked
+ * @param bytes_in Bytes received
+ * @param bytes_out Bytes sent
+ * @param response true if the bytes sent start a response, counted as one request
+ */
+void wifi_clients_traffic(uint32_t ip, size_t bytes_in, size_t bytes_out, bool response);
+
+/**
+ * @brief Note a probe request and classify its client.
+ *
+ * @param ip Client address, 0 if unknown; unknown clients are not tracked
+ * @param uri Probe URI
+ * @param user_agent User-Agent header, empty if missing
+ * @param[out] first true if this is the first probe of the client since it associated or since the last mode switch
+ * @return Platform of the client so far
+ */
+wifi_client_os_t wifi_clients_probe(uint32_t ip, const char *uri, const char *user_agent, bool *first);
+
+/**
+ * @brief Note that a client opened the portal page.
+ *
+ * Counted once per client, and only for clients that probed before.
+ *
+ * @param ip Client address
+ */
+void wifi_clients_portal_opened(uint32_t ip);
+
+/**
+ * @brief Forget all clients, the per-platform counters are kept.
+ */
+void wifi_clients_reset(void);
+
+/**
+ * @brief Get a printable platform name.
+ *
+ * @param os Platform
+ * @return Name such as "Android"
+ */
+const char *wifi_client_os_name(wifi_client_os_t os);
+
+#endif
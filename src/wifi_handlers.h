@@ -0,0 +1,36 @@
+/**
+ * @file wifi_handlers.h
+ * @brief Number of HTTP handlers registered by the component (private).
+ *
+ * Shared by the server configuration in Wifi.c, which sizes the URI handler
+ * table, and wifi_arena.c, which sizes its table of wrapped handlers. Update
+ * the counts when adding a built-in handler: built-in handlers past
+ * WIFI_BUILTIN_HTTP_HANDLERS are refused with an error instead of taking the
+ * slots of custom handlers.
+ */
+
+#ifndef WIFI_HANDLERS_H
+#define WIFI_HANDLERS_H
+
+#include "sdkconfig.h"
+
+/**
+ * @brief Most built-in URI handlers registered at the same time (STA/AP mode)
+ *
+ * /captive (GET and POST), /captive.json, /scan.json, /captive-api, /wifi-trace.bin, /stations.json,
+ * /index.html, /wifi-status.json, /netstats.json, /restart, the /upload/ prefix, /update and the wildcard.
+ */
+#define WIFI_BUILTIN_HTTP_HANDLERS 14
+
+/**
+ * @brief Distinct built-in handler functions wrapped by the arena over the lifetime of the server
+ *
+ * The registered handlers plus the second wildcard handler: sd_file_handler()
+ * and no_sd_card_handler() are swapped when the web root appears or goes away.
+ */
+#define WIFI_BUILTIN_WRAPPED_HANDLERS (WIFI_BUILTIN_HTTP_HANDLERS + 1)
+
+/** @brief Handlers the arena can wrap: built-ins plus custom handlers */
+#define WIFI_MAX_WRAPPED_HANDLERS (WIFI_BUILTIN_WRAPPED_HANDLERS + CONFIG_WIFI_MAX_CUSTOM_HTTP_HANDLERS)
+
+#endif
@@ -0,0 +1,336 @@
+/**
+ * @file wifi_multipart.c
+ * @brief Streaming multipart/form-data parser.
+ *
+ * Part data is scanned for the delimiter "\r\n--<boundary>" with memchr() for
+ * its first byte, which newlib implements a word at a time, and memcmp() at
+ * each carriage return. Boundaries cannot contain a carriage return, so a
+ * failed partial match never hides the start of another one, and the bytes
+ * of a partial match held back at the end of a piece are always a prefix of
+ * the delimiter: they are delivered from the delimiter itself and need no
+ * buffer.
+ */
+
+#include "wifi_multipart.h"
+#include "wifi_arena.h"
+
+#include "esp_log.h"
+
+#include <string.h>
+#include <strings.h>
+
+/** @brief Log tag for multipart parsing */
+static const char *TAG_MULTIPART = "Wifi-Multipart";
+
+/** @brief Receive timeouts in a row before wifi_multipart_recv() gives up */
+#define MULTIPART_MAX_TIMEOUTS 3
+
+/** @brief Parser states */
+typedef enum {
+    MP_PREAMBLE = 0,    ///< Before the first delimiter, discarded
+    MP_DELIMITER,       ///< After a delimiter: "--" ends the body, CRLF starts a part
+    MP_HEADERS,         ///< Part header lines
+    MP_DATA,            ///< Part data
+    MP_EPILOGUE,        ///< After the closing delimiter, discarded
+    MP_ERROR,           ///< Malformed body or a callback failed
+} mp_state_t;
+
+/**
+ * @brief Copy a parameter value of a header, such as boundary=... or name="...".
+ *
+ * @param header Header value, parameters separated by ';'
+ * @param key Parameter name
+ * @param out Buffer for the value, unquoted
+ * @param out_size Size of out
+ * @return true if the parameter was found
+ */
+static bool header_param(const char *header, const char *key, char *out, size_t out_size) {
+    size_t key_len = strlen(key);
+    const char *p = strchr(header, ';');
+    while (p != NULL) {
+        p++;
+        while (*p == ' ' || *p == '\t') p++;
+        if (strncasecmp(p, key, key_len) == 0 && p[key_len] == '=') {
+            p += key_len + 1;
+            size_t len = 0;
+            if (*p == '"') {
+                for (p++; *p && *p != '"'; p++) {
+                    if (*p == '\\' && p[1]) p++;
+                    if (len + 1 < out_size) out[len++] = *p;
+                }
+            } else {
+                for (; *p && *p != ';' && *p != ' ' && *p != '\t'; p++) {
+                    if (len + 1 < out_size) out[len++] = *p;
+                }
+            }
+            out[len] = '\0';
+            return true;
+        }
+        // Skip the value, a quoted one can contain ';'
+        bool quoted = false;
+        for (; *p && (quoted || *p != ';'); p++) {
+            if (*p == '"') quoted = !quoted;
+            else if (*p == '\\' && quoted && p[1]) p++;
+        }
+        p = *p ? p : NULL;
+    }
+    return false;
+}
+
+esp_err_t wifi_multipart_init(wifi_multipart_t *mp, const char *content_type,
+                              const wifi_multipart_callbacks_t *cb, void *ctx) {
+    memset(mp, 0, sizeof(*mp));
+    mp->cb = cb;
+    mp->ctx = ctx;
+    mp->state = MP_ERROR;
+    if (content_type == NULL || strncasecmp(content_type, "multipart/", 10) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    char boundary[WIFI_MULTIPART_BOUNDARY_MAX + 2];
+    if (!header_param(content_type, "boundary", boundary, sizeof(boundary))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t len = strlen(boundary);
+    if (len == 0 || len > WIFI_MULTIPART_BOUNDARY_MAX || strpbrk(boundary, "\r\n")) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(mp->delim, "\r\n--", 4);
+    memcpy(mp->delim + 4, boundary, len);
+    mp->delim_len = 4 + len;
+    // The first delimiter has no CRLF before it, start as if the body did
+    mp->match = 2;
+    mp->state = MP_PREAMBLE;
+    return ESP_OK;
+}
+
+/**
+ * @brief Deliver part data.
+ */
+static esp_err_t deliver(wifi_multipart_t *mp, const char *data, size_t len) {
+    if (len == 0 || mp->state != MP_DATA || mp->cb->on_data == NULL) return ESP_OK;
+    return mp->cb->on_data(&mp->part, data, len, mp->ctx);
+}
+
+/**
+ * @brief A delimiter was matched, end the part in progress.
+ */
+static esp_err_t delimiter_found(wifi_multipart_t *mp) {
+    esp_err_t err = ESP_OK;
+    if (mp->state == MP_DATA && mp->cb->on_part_end != NULL) {
+        err = mp->cb->on_part_end(&mp->part, mp->ctx);
+    }
+    if (mp->state == MP_DATA) {
+        mp->part.index++;
+    }
+    mp->state = MP_DELIMITER;
+    mp->after = 0;
+    mp->match = 0;
+    return err;
+}
+
+/**
+ * @brief Scan part data or the preamble for the delimiter.
+ *
+ * @param[in,out] pp Next byte, advanced past the delimiter if found
+ * @return ESP_OK, also when the piece ends first
+ */
+static esp_err_t scan_data(wifi_multipart_t *mp, const char **pp, const char *end) {
+    const char *p = *pp;
+    esp_err_t err;
+
+    // Continue a partial match from the previous piece
+    if (mp->match > 0) {
+        while (p < end && mp->match < mp->delim_len && *p == mp->delim[mp->match]) {
+            p++;
+            mp->match++;
+        }
+        if (mp->match == mp->delim_len) {
+            *pp = p;
+            return delimiter_found(mp);
+        }
+        if (p == end) {
+            *pp = p;
+            return ESP_OK;
+        }
+        // Not a delimiter after all, the held back bytes were data
+        err = deliver(mp, mp->delim, mp->match);
+        mp->match = 0;
+        if (err != ESP_OK) return err;
+    }
+
+    const char *data = p;
+    while (p < end) {
+        const char *cr = memchr(p, '\r', end - p);
+        if (cr == NULL) {
+            p = end;
+            break;
+        }
+        size_t avail = end - cr;
+        size_t n = avail < mp->delim_len ? avail : mp->delim_len;
+        if (memcmp(cr, mp->delim, n) != 0) {
+            p = cr + 1;
+            continue;
+        }
+        err = deliver(mp, data, cr - data);
+        if (err != ESP_OK) return err;
+        p = cr + n;
+        *pp = p;
+        if (n == mp->delim_len) {
+            return delimiter_found(mp);
+        }
+        mp->match = n;      // Runs to the end of the piece
+        return ESP_OK;
+    }
+    *pp = p;
+    return deliver(mp, data, p - data);
+}
+
+/**
+ * @brief Handle one complete header line, or the empty line ending the headers.
+ */
+static esp_err_t header_line(wifi_multipart_t *mp) {
+    char *line = mp->line;
+    size_t len = mp->line_len;
+    mp->line_len = 0;
+    if (len > 0 && line[len - 1] == '\r') len--;
+    line[len] = '\0';
+
+    if (len == 0) {
+        mp->state = MP_DATA;
+        mp->match = 0;
+        return mp->cb->on_part ? mp->cb->on_part(&mp->part, mp->ctx) : ESP_OK;
+    }
+
+    char *colon = strchr(line, ':');
+    if (colon == NULL) {
+        ESP_LOGD(TAG_MULTIPART, "Part header without ':' ignored");
+        return ESP_OK;
+    }
+    *colon = '\0';
+    char *value = colon + 1;
+    while (*value == ' ' || *value == '\t') value++;
+
+    if (strcasecmp(line, "Content-Disposition") == 0) {
+        header_param(value, "name", mp->part.name, sizeof(mp->part.name));
+        header_param(value, "filename", mp->part.filename, sizeof(mp->part.filename));
+    } else if (strcasecmp(line, "Content-Type") == 0) {
+        strlcpy(mp->part.content_type, value, sizeof(mp->part.content_type));
+    }
+    return mp->cb->on_header ? mp->cb->on_header(line, value, mp->ctx) : ESP_OK;
+}
+
+/**
+ * @brief Collect header lines.
+ */
+static esp_err_t scan_headers(wifi_multipart_t *mp, const char **pp, const char *end) {
+    const char *p = *pp;
+    const char *nl = memchr(p, '\n', end - p);
+    const char *stop = nl ? nl : end;
+    // Keep room for the terminator, the rest of an overlong line is dropped
+    size_t room = WIFI_MULTIPART_LINE_MAX - 1 - mp->line_len;
+    size_t n = (size_t)(stop - p) < room ? (size_t)(stop - p) : room;
+    memcpy(mp->line + mp->line_len, p, n);
+    mp->line_len += n;
+    if (nl == NULL) {
+        *pp = end;
+        return ESP_OK;
+    }
+    *pp = nl + 1;
+    return header_line(mp);
+}
+
+esp_err_t wifi_multipart_feed(wifi_multipart_t *mp, const char *data, size_t len) {
+    const char *p = data;
+    const char *end = data + len;
+    esp_err_t err = ESP_OK;
+
+    while (p < end && err == ESP_OK) {
+        switch (mp->state) {
+        case MP_PREAMBLE:
+        case MP_DATA:
+            err = scan_data(mp, &p, end);
+            break;
+
+        case MP_DELIMITER: {
+            char c = *p++;
+            if (c == '-') {
+                if (mp->after == '-') {
+                    mp->state = MP_EPILOGUE;
+                }
+                mp->after = c;
+            } else if (mp->after == '-') {
+                err = ESP_ERR_INVALID_ARG;
+            } else if (c == '\r') {
+                mp->after = c;
+            } else if (c == '\n') {
+                // New part, a bare LF is accepted like most parsers do
+                uint32_t index = mp->part.index;
+                memset(&mp->part, 0, sizeof(mp->part));
+                mp->part.index = index;
+                mp->line_len = 0;
+                mp->state = MP_HEADERS;
+            } else if (c != ' ' && c != '\t') {
+                err = ESP_ERR_INVALID_ARG;      // Only padding may follow a delimiter
+            }
+            break;
+        }
+
+        case MP_HEADERS:
+            err = scan_headers(mp, &p, end);
+            break;
+
+        case MP_EPILOGUE:
+            p = end;
+            break;
+
+        default:
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    if (err != ESP_OK) {
+        if (err == ESP_ERR_INVALID_ARG) {
+            ESP_LOGW(TAG_MULTIPART, "Malformed multipart body");
+        }
+        mp->state = MP_ERROR;
+    }
+    return err;
+}
+
+esp_err_t wifi_multipart_finish(wifi_multipart_t *mp) {
+    return mp->state == MP_EPILOGUE ? ESP_OK : ESP_ERR_INVALID_SIZE;
+}
+
+esp_err_t wifi_multipart_recv(httpd_req_t *req, const wifi_multipart_callbacks_t *cb, void *ctx) {
+    char content_type[128];
+    if (httpd_req_get_hdr_value_str(req, "Content-Type", content_type, sizeof(content_type)) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    wifi_multipart_t *mp = wifi_arena_alloc(req, sizeof(*mp));
+    char *buf = wifi_arena_alloc(req, WIFI_MULTIPART_RECV_SIZE);
+    if (mp == NULL || buf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = wifi_multipart_init(mp, content_type, cb, ctx);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    size_t remaining = req->content_len;
+    int timeouts = 0;
+    while (remaining > 0) {
+        int ret = httpd_req_recv(req, buf, remaining < WIFI_MULTIPART_RECV_SIZE ? remaining : WIFI_MULTIPART_RECV_SIZE);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < MULTIPART_MAX_TIMEOUTS) continue;
+        if (ret <= 0) {
+            ESP_LOGW(TAG_MULTIPART, "Receive failed with %u bytes left", (unsigned)remaining);
+            return ESP_FAIL;
+        }
+        timeouts = 0;
+        remaining -= ret;
+        err = wifi_multipart_feed(mp, buf, ret);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return wifi_multipart_finish(mp);
+}
@@ -0,0 +1,299 @@
+/**
+ * @file wifi_netstats.c
+ * @brief lwIP, TCP and socket statistics of the HTTP and DNS paths.
+ *
+ * The TCP connection lists belong to the TCP/IP task and change under any
+ * other task, so they are walked in the TCP/IP task with
+ * esp_netif_tcpip_exec(). Socket usage is found by asking lwIP for the flags
+ * of every socket number.
+ */
+
+#include "wifi_netstats.h"
+#include "wifi_arena.h"
+#include "wifi_session.h"
+#include "wifi_util.h"
+#include "sdkconfig.h"
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/memp.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/sockets.h"
+#include "lwip/stats.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+/** @brief Log tag for network statistics */
+static const char *TAG_NETSTATS = "Wifi-Netstats";
+
+/** @brief Longest JSON of one pool */
+#define NETSTATS_POOL_JSON_MAX 128
+
+/** @brief Shortest time between two snapshots */
+#define NETSTATS_SNAPSHOT_INTERVAL_US (1000 * 1000LL)
+
+#if LWIP_STATS && MEMP_STATS
+/** @brief Pool names in the order of the memp_t enum, built like lwIP builds the enum */
+static const char *const pool_names[] = {
+#define LWIP_MEMPOOL(name, num, size, desc) #name,
+#include "lwip/priv/memp_std.h"
+};
+#endif
+
+/** @brief Listening port of the HTTP server */
+static uint16_t http_port = 80;
+
+/** @brief Last snapshot, valid when snapshot_count > 0 */
+static wifi_net_stats_t snapshot;
+static uint32_t snapshot_count;
+
+/** @brief Snapshot being taken, only used by the DNS server task */
+static wifi_net_stats_t snapshot_scratch;
+
+/** @brief Protects snapshot and snapshot_count */
+static portMUX_TYPE snapshot_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void wifi_netstats_init(uint16_t port) {
+    http_port = port;
+}
+
+/**
+ * @brief Walk the TCP connection lists, runs in the TCP/IP task.
+ */
+static esp_err_t read_tcp_pcbs(void *ctx) {
+    wifi_net_stats_t *stats = ctx;
+    for (struct tcp_pcb *pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+        stats->tcp_active++;
+        stats->tcp_queued += pcb->snd_queuelen;
+        if (pcb->nrtx > 0) {
+            stats->tcp_retransmitting++;
+            stats->tcp_retransmits += pcb->nrtx;
+        }
+    }
+    for (struct tcp_pcb *pcb = tcp_tw_pcbs; pcb != NULL; pcb = pcb->next) {
+        stats->tcp_time_wait++;
+    }
+#if TCP_LISTEN_BACKLOG
+    for (struct tcp_pcb_listen *lpcb = tcp_listen_pcbs.listen_pcbs; lpcb != NULL; lpcb = lpcb->next) {
+        if (lpcb->local_port == http_port) {
+            stats->http_backlog = lpcb->accepts_pending;
+            stats->http_backlog_max = lpcb->backlog;
+        }
+    }
+#endif
+    return ESP_OK;
+}
+
+#if LWIP_STATS
+static void copy_proto(wifi_netstats_proto_t *out, const struct stats_proto *proto) {
+    out->xmit = proto->xmit;
+    out->recv = proto->recv;
+    out->drop = proto->drop;
+    out->memerr = proto->memerr;
+    out->err = proto->err;
+}
+#endif
+
+void wifi_get_net_stats(wifi_net_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->time_us = esp_timer_get_time();
+    stats->free_heap = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    stats->min_free_heap = heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL);
+    stats->largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+
+    stats->sockets_max = CONFIG_LWIP_MAX_SOCKETS;
+    for (int fd = LWIP_SOCKET_OFFSET; fd < LWIP_SOCKET_OFFSET + CONFIG_LWIP_MAX_SOCKETS; fd++) {
+        if (lwip_fcntl(fd, F_GETFL, 0) >= 0) {
+            stats->sockets_used++;
+        }
+    }
+
+    esp_netif_tcpip_exec(read_tcp_pcbs, stats);
+
+#if LWIP_STATS
+    stats->lwip_stats = true;
+#if MEMP_STATS
+    for (int i = 0; i < MEMP_MAX && stats->pool_count < WIFI_NETSTATS_MAX_POOLS; i++) {
+        const struct stats_mem *mem = lwip_stats.memp[i];
+        if (mem == NULL) continue;
+        wifi_netstats_pool_t *pool = &stats->pools[stats->pool_count++];
+        pool->name = pool_names[i];
+        pool->used = mem->used;
+        pool->max = mem->max;
+        pool->avail = mem->avail;
+        pool->err = mem->err;
+    }
+#endif
+#if TCP_STATS
+    copy_proto(&stats->tcp, &lwip_stats.tcp);
+#endif
+#if UDP_STATS
+    copy_proto(&stats->udp, &lwip_stats.udp);
+#endif
+#endif
+
+    wifi_get_session_stats(&stats->http);
+    dns_server_get_stats(&stats->dns);
+}
+
+bool wifi_get_net_snapshot(wifi_net_stats_t *stats, uint32_t *count) {
+    taskENTER_CRITICAL(&snapshot_lock);
+    uint32_t taken = snapshot_count;
+    if (taken > 0) {
+        *stats = snapshot;
+    }
+    taskEXIT_CRITICAL(&snapshot_lock);
+    if (count != NULL) {
+        *count = taken;
+    }
+    return taken > 0;
+}
+
+void wifi_netstats_dns_send_error(int err) {
+    static int64_t last_us;
+    int64_t now = esp_timer_get_time();
+    if (snapshot_count > 0 && now - last_us < NETSTATS_SNAPSHOT_INTERVAL_US) return;
+    last_us = now;
+
+    wifi_net_stats_t *stats = &snapshot_scratch;
+    wifi_get_net_stats(stats);
+    snprintf(stats->reason, sizeof(stats->reason), "dns %s", err == ENOMEM ? "ENOMEM" : "ENOBUFS");
+
+    uint32_t pool_errors = 0;
+    for (int i = 0; i < stats->pool_count; i++) {
+        pool_errors += stats->pools[i].err;
+    }
+    ESP_LOGW(TAG_NETSTATS, "Snapshot on %s: heap %lu free, %lu largest; sockets %u/%u; tcp %u active, %u retransmitting, "
+             "%u queued; backlog %u/%u; pool errors %lu; udp drops %lu",
+             stats->reason, (unsigned long)stats->free_heap, (unsigned long)stats->largest_free_block,
+             stats->sockets_used, stats->sockets_max, stats->tcp_active, stats->tcp_retransmitting,
+             stats->tcp_queued, stats->http_backlog, stats->http_backlog_max,
+             (unsigned long)pool_errors, (unsigned long)stats->udp.drop);
+
+    taskENTER_CRITICAL(&snapshot_lock);
+    snapshot = *stats;
+    snapshot_count++;
+    taskEXIT_CRITICAL(&snapshot_lock);
+}
+
+#pragma region HTTP
+
+static void json_key_int(wifi_json_t *out, const char *key, long value) {
+    wifi_json_raw(out, key);
+    wifi_json_int(out, value);
+}
+
+static void json_proto(wifi_json_t *out, const char *key, const wifi_netstats_proto_t *proto) {
+    wifi_json_raw(out, key);
+    json_key_int(out, "{\"xmit\": ", proto->xmit);
+    json_key_int(out, ", \"recv\": ", proto->recv);
+    json_key_int(out, ", \"drop\": ", proto->drop);
+    json_key_int(out, ", \"memerr\": ", proto->memerr);
+    json_key_int(out, ", \"err\": ", proto->err);
+    wifi_json_raw(out, "}");
+}
+
+/**
+ * @brief Send the buffered JSON as a chunk and start over.
+ */
+static esp_err_t json_flush(httpd_req_t *req, wifi_json_t *out, char *buf, size_t size) {
+    if (out->overflow || httpd_resp_send_chunk(req, buf, out->len) != ESP_OK) {
+        ESP_LOGW(TAG_NETSTATS, "Statistics response failed");
+        return ESP_FAIL;
+    }
+    wifi_json_init(out, buf, size);
+    return ESP_OK;
+}
+
+/**
+ * @brief Send one wifi_net_stats_t as a JSON object, in chunks.
+ */
+static esp_err_t send_stats(httpd_req_t *req, wifi_json_t *out, char *buf, size_t size, const wifi_net_stats_t *stats) {
+    json_key_int(out, "{\"time_ms\": ", (long)(stats->time_us / 1000));
+    wifi_json_raw(out, ", \"reason\": ");
+    wifi_json_str(out, stats->reason);
+    json_key_int(out, ", \"heap\": {\"free\": ", stats->free_heap);
+    json_key_int(out, ", \"min_free\": ", stats->min_free_heap);
+    json_key_int(out, ", \"largest_block\": ", stats->largest_free_block);
+    json_key_int(out, "}, \"sockets\": {\"used\": ", stats->sockets_used);
+    json_key_int(out, ", \"max\": ", stats->sockets_max);
+    json_key_int(out, "}, \"tcp\": {\"active\": ", stats->tcp_active);
+    json_key_int(out, ", \"time_wait\": ", stats->tcp_time_wait);
+    json_key_int(out, ", \"retransmitting\": ", stats->tcp_retransmitting);
+    json_key_int(out, ", \"retransmits\": ", stats->tcp_retransmits);
+    json_key_int(out, ", \"queued\": ", stats->tcp_queued);
+    json_key_int(out, ", \"http_backlog\": ", stats->http_backlog);
+    json_key_int(out, ", \"http_backlog_max\": ", stats->http_backlog_max);
+    wifi_json_raw(out, "}");
+    if (json_flush(req, out, buf, size) != ESP_OK) return ESP_FAIL;
+
+    json_key_int(out, ", \"http\": {\"open\": ", stats->http.open);
+    json_key_int(out, ", \"max_open\": ", stats->http.max_open);
+    json_key_int(out, ", \"rejected\": ", stats->http.rejected);
+    json_key_int(out, ", \"purged\": ", stats->http.purged);
+    json_key_int(out, ", \"header_timeouts\": ", stats->http.header_timeouts);
+    json_key_int(out, ", \"slow_bodies\": ", stats->http.slow_bodies);
+    json_key_int(out, "}, \"dns\": {\"queries\": ", stats->dns.queries);
+    json_key_int(out, ", \"replies\": ", stats->dns.replies);
+    json_key_int(out, ", \"send_errors\": ", stats->dns.send_errors);
+    json_key_int(out, ", \"send_no_mem\": ", stats->dns.send_no_mem);
+    wifi_json_raw(out, "}, \"lwip_stats\": ");
+    wifi_json_bool(out, stats->lwip_stats);
+    json_proto(out, ", \"tcp_counters\": ", &stats->tcp);
+    json_proto(out, ", \"udp\": ", &stats->udp);
+    wifi_json_raw(out, ", \"pools\": [");
+    if (json_flush(req, out, buf, size) != ESP_OK) return ESP_FAIL;
+
+    for (int i = 0; i < stats->pool_count; i++) {
+        const wifi_netstats_pool_t *pool = &stats->pools[i];
+        if (out->len > size - NETSTATS_POOL_JSON_MAX && json_flush(req, out, buf, size) != ESP_OK) return ESP_FAIL;
+        wifi_json_raw(out, i > 0 ? ", {\"name\": " : "{\"name\": ");
+        wifi_json_str(out, pool->name);
+        json_key_int(out, ", \"used\": ", pool->used);
+        json_key_int(out, ", \"max\": ", pool->max);
+        json_key_int(out, ", \"avail\": ", pool->avail);
+        json_key_int(out, ", \"err\": ", pool->err);
+        wifi_json_raw(out, "}");
+    }
+    wifi_json_raw(out, "]}");
+    return json_flush(req, out, buf, size);
+}
+
+esp_err_t wifi_netstats_http_handler(httpd_req_t *req) {
+    const size_t json_size = 512;
+    char *json = wifi_arena_alloc(req, json_size);
+    wifi_net_stats_t *stats = wifi_arena_alloc(req, sizeof(wifi_net_stats_t));
+    if (json == NULL || stats == NULL) {
+        return httpd_resp_send_500(req);
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    wifi_json_t out;
+    wifi_json_init(&out, json, json_size);
+
+    wifi_get_net_stats(stats);
+    wifi_json_raw(&out, "{\"now\": ");
+    if (send_stats(req, &out, json, json_size, stats) != ESP_OK) return ESP_FAIL;
+
+    uint32_t count;
+    bool taken = wifi_get_net_snapshot(stats, &count);
+    json_key_int(&out, ", \"snapshots\": ", count);
+    wifi_json_raw(&out, ", \"snapshot\": ");
+    if (taken) {
+        if (send_stats(req, &out, json, json_size, stats) != ESP_OK) return ESP_FAIL;
+    } else {
+        wifi_json_raw(&out, "null");
+    }
+    wifi_json_raw(&out, "}");
+    if (json_flush(req, &out, json, json_size) != ESP_OK) return ESP_FAIL;
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+#pragma endregion
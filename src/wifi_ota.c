@@ -0,0 +1,524 @@
+/**
+ * @file wifi_ota.c
+ * @brief Firmware update over HTTP.
+ *
+ * The HTTP handler only checks the request and hands it to the update task.
+ * The update task receives into buffer A while the flash writer task writes
+ * buffer B with esp_ota_write(), then they swap. Both tasks and their queues
+ * are created by the first update and wait for the next one afterwards.
+ * Flash is erased sector by sector as it is written
+ * (OTA_WITH_SEQUENTIAL_WRITES) instead of erasing the whole partition up
+ * front, so erase time overlaps with receiving too.
+ */
+
+#include "sdkconfig.h"
+
+#ifdef CONFIG_WIFI_OTA
+
+#include "wifi_ota.h"
+#include "wifi_util.h"
+#include "wifi_arena.h"
+#include "Wifi.h"
+
+#include "esp_app_desc.h"
+#include "esp_app_format.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** @brief Log tag for firmware update messages */
+static const char *TAG_OTA = "Wifi-OTA";
+
+/** @brief Update task stack size */
+#define OTA_TASK_STACK_SIZE 4096
+
+/** @brief Flash writer task stack size */
+#define OTA_WRITER_STACK_SIZE 3072
+
+/** @brief Receive timeouts in a row before the update is abandoned */
+#define OTA_MAX_TIMEOUTS 3
+
+/** @brief Time for the response to reach the client before restarting */
+#define OTA_RESTART_DELAY_MS 1000
+
+/** @brief Poll interval while wifi_ota_suspend() waits for the running update */
+#define OTA_SUSPEND_POLL_MS 50
+
+/** @brief Bytes needed to check the image: image header, first segment header and app description */
+#define OTA_HEADER_SIZE (sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t))
+
+_Static_assert(CONFIG_WIFI_OTA_BUFFER_SIZE >= OTA_HEADER_SIZE, "CONFIG_WIFI_OTA_BUFFER_SIZE too small for the image header");
+
+/**
+ * @brief One update, from the HTTP handler to the update task.
+ */
+typedef struct {
+    httpd_req_t *req;                   ///< Request detached with httpd_req_async_handler_begin()
+    const esp_partition_t *partition;   ///< Partition to write
+    bool reboot;                        ///< Restart into the new firmware when done
+    int64_t start_us;                   ///< Handler entry
+    int64_t httpd_blocked_us;           ///< Time the handler kept the HTTP server task busy
+    uint32_t calls_at_start;            ///< Handler invocations before this one, see wifi_arena_stats_t
+} ota_job_t;
+
+/**
+ * @brief One buffer handed to the flash writer task.
+ */
+typedef struct {
+    const uint8_t *data;
+    size_t len;
+} ota_chunk_t;
+
+/** @brief An update is running, or was written and the device restarts into it */
+static volatile bool ota_running = false;
+
+/** @brief The written update's response is out and the restart is requested, see wifi_ota_in_progress() */
+static volatile bool ota_restarting = false;
+
+/** @brief Requests detached from the HTTP server and not completed yet, see wifi_ota_suspend() */
+static int ota_detached = 0;
+
+/** @brief New updates are refused while the HTTP server stops */
+static bool ota_suspended = false;
+
+/** @brief Protects ota_running, ota_detached and ota_suspended, used from the server and update tasks */
+static portMUX_TYPE ota_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief The running update, there is only ever one */
+static ota_job_t ota_job;
+
+/** @brief Update task, waits for a notification for every job */
+static TaskHandle_t ota_task = NULL;
+
+/** @brief Handle of the running update */
+static esp_ota_handle_t ota_handle;
+
+/** @brief Chunks for the flash writer task */
+static QueueHandle_t ota_write_queue = NULL;
+
+/** @brief Results from the flash writer task */
+static QueueHandle_t ota_done_queue = NULL;
+
+/** @brief Time spent in esp_ota_write() during the running update */
+static int64_t ota_flash_us = 0;
+
+#ifdef CONFIG_WIFI_STATIC_ALLOCATION
+/** @brief Storage of the write queue, see CONFIG_WIFI_STATIC_ALLOCATION */
+static StaticQueue_t ota_write_queue_storage;
+
+/** @brief Item of the write queue */
+static uint8_t ota_write_queue_items[sizeof(ota_chunk_t)];
+
+/** @brief Storage of the result queue */
+static StaticQueue_t ota_done_queue_storage;
+
+/** @brief Item of the result queue */
+static uint8_t ota_done_queue_items[sizeof(esp_err_t)];
+
+/** @brief Control block of the update task */
+static StaticTask_t ota_task_tcb;
+
+/** @brief Stack of the update task */
+static StackType_t ota_task_stack[OTA_TASK_STACK_SIZE];
+
+/** @brief Control block of the flash writer task */
+static StaticTask_t ota_writer_tcb;
+
+/** @brief Stack of the flash writer task */
+static StackType_t ota_writer_stack[OTA_WRITER_STACK_SIZE];
+
+/** @brief Receive buffers of the update */
+static WORD_ALIGNED_ATTR uint8_t ota_buffers[2 * CONFIG_WIFI_OTA_BUFFER_SIZE];
+#endif
+
+/**
+ * @brief Write chunks of the running update.
+ */
+static void ota_writer_task(void *arg) {
+    ota_chunk_t chunk;
+    while (1) {
+        xQueueReceive(ota_write_queue, &chunk, portMAX_DELAY);
+        int64_t start = esp_timer_get_time();
+        esp_err_t err = esp_ota_write(ota_handle, chunk.data, chunk.len);
+        ota_flash_us += esp_timer_get_time() - start;
+        xQueueSend(ota_done_queue, &err, portMAX_DELAY);
+    }
+}
+
+/**
+ * @brief Check that the first bytes of the body are an application image for this chip.
+ */
+static bool ota_check_image(const uint8_t *data, size_t len) {
+    if (len < OTA_HEADER_SIZE) return false;
+    const esp_image_header_t *header = (const esp_image_header_t *)data;
+    if (header->magic != ESP_IMAGE_HEADER_MAGIC) {
+        ESP_LOGE(TAG_OTA, "Not an application image (magic 0x%02x)", header->magic);
+        return false;
+    }
+    if (header->chip_id != CONFIG_IDF_FIRMWARE_CHIP_ID) {
+        ESP_LOGE(TAG_OTA, "Image is for chip id %d, this is %d", header->chip_id, CONFIG_IDF_FIRMWARE_CHIP_ID);
+        return false;
+    }
+    esp_app_desc_t desc;
+    memcpy(&desc, data + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(desc));
+    if (desc.magic_word != ESP_APP_DESC_MAGIC_WORD) {
+        ESP_LOGE(TAG_OTA, "Image has no application description");
+        return false;
+    }
+    const esp_app_desc_t *running = esp_app_get_description();
+    ESP_LOGI(TAG_OTA, "Updating %s %s to %s %s", running->project_name, running->version, desc.project_name, desc.version);
+    return true;
+}
+
+/**
+ * @brief Send an error status with a short plain-text message.
+ */
+static esp_err_t ota_error(httpd_req_t *req, const char *status, const char *msg) {
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "text/plain");
+    return httpd_resp_send(req, msg, HTTPD_RESP_USE_STRLEN);
+}
+
+/**
+ * @brief Receive the image, write it through the flash writer task and switch the boot partition.
+ */
+static void ota_run(ota_job_t *job) {
+    httpd_req_t *req = job->req;
+    const char *status = "500 Internal Server Error";
+    const char *msg = "Update failed";
+    bool begun = false;
+    bool ok = false;
+    size_t remaining = req->content_len;
+    int64_t recv_us = 0, flash_wait_us = 0;
+
+    ota_flash_us = 0;
+#ifdef CONFIG_WIFI_STATIC_ALLOCATION
+    uint8_t *buffers = ota_buffers;
+#else
+    uint8_t *buffers = heap_caps_malloc(2 * CONFIG_WIFI_OTA_BUFFER_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+#endif
+    if (buffers == NULL) {
+        ESP_LOGE(TAG_OTA, "No memory for the update");
+        status = "503 Service Unavailable";
+        msg = "Out of memory";
+        goto cleanup;
+    }
+
+    ESP_LOGI(TAG_OTA, "Receiving %u bytes into partition %s", (unsigned)req->content_len, job->partition->label);
+    int current = 0;
+    bool pending = false;
+    bool receive_failed = false;
+    esp_err_t err = ESP_OK;
+    while (remaining > 0) {
+        uint8_t *buf = buffers + current * CONFIG_WIFI_OTA_BUFFER_SIZE;
+        size_t want = remaining < CONFIG_WIFI_OTA_BUFFER_SIZE ? remaining : CONFIG_WIFI_OTA_BUFFER_SIZE;
+        size_t len = 0;
+        int timeouts = 0;
+        int64_t recv_start = esp_timer_get_time();
+        while (len < want) {
+            int ret = httpd_req_recv(req, (char *)buf + len, want - len);
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < OTA_MAX_TIMEOUTS) continue;
+            if (ret <= 0) {
+                receive_failed = true;
+                break;
+            }
+            timeouts = 0;
+            len += ret;
+        }
+        recv_us += esp_timer_get_time() - recv_start;
+        if (receive_failed) break;
+        remaining -= len;
+
+        if (!begun) {
+            // Reject anything that is not an image for this chip before touching flash
+            if (!ota_check_image(buf, len)) {
+                status = "400 Bad Request";
+                msg = "Not a firmware image for this device";
+                break;
+            }
+            err = esp_ota_begin(job->partition, OTA_WITH_SEQUENTIAL_WRITES, &ota_handle);
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG_OTA, "esp_ota_begin failed: %s", esp_err_to_name(err));
+                break;
+            }
+            begun = true;
+        }
+
+        // Wait for the other buffer before handing this one over
+        if (pending) {
+            int64_t wait_start = esp_timer_get_time();
+            xQueueReceive(ota_done_queue, &err, portMAX_DELAY);
+            flash_wait_us += esp_timer_get_time() - wait_start;
+            pending = false;
+            if (err != ESP_OK) break;
+        }
+        ota_chunk_t chunk = { .data = buf, .len = len };
+        xQueueSend(ota_write_queue, &chunk, portMAX_DELAY);
+        pending = true;
+        current ^= 1;
+    }
+    if (pending) {
+        esp_err_t last_err;
+        int64_t wait_start = esp_timer_get_time();
+        xQueueReceive(ota_done_queue, &last_err, portMAX_DELAY);
+        flash_wait_us += esp_timer_get_time() - wait_start;
+        if (err == ESP_OK) err = last_err;
+    }
+
+    if (receive_failed) {
+        ESP_LOGE(TAG_OTA, "Receive failed after %u bytes", (unsigned)(req->content_len - remaining));
+        msg = NULL;     // The connection is most likely gone, close it instead of answering
+    } else if (begun && err != ESP_OK) {
+        ESP_LOGE(TAG_OTA, "Flash write failed: %s", esp_err_to_name(err));
+    } else if (begun) {
+        // Checks the image hash, and the signature with secure boot
+        err = esp_ota_end(ota_handle);
+        begun = false;
+        if (err == ESP_ERR_OTA_VALIDATE_FAILED) {
+            ESP_LOGE(TAG_OTA, "Image validation failed");
+            status = "400 Bad Request";
+            msg = "Image validation failed";
+        } else if (err != ESP_OK) {
+            ESP_LOGE(TAG_OTA, "esp_ota_end failed: %s", esp_err_to_name(err));
+        } else if ((err = esp_ota_set_boot_partition(job->partition)) != ESP_OK) {
+            ESP_LOGE(TAG_OTA, "Failed to set boot partition: %s", esp_err_to_name(err));
+        } else {
+            ok = true;
+        }
+    }
+    if (begun) {
+        esp_ota_abort(ota_handle);
+    }
+
+cleanup:
+#ifndef CONFIG_WIFI_STATIC_ALLOCATION
+    free(buffers);
+#endif
+
+    // The next update may be started as soon as the client has this one's response, which ends the
+    // use of the job; while the device restarts into the new firmware no other update is accepted
+    bool reboot = ok && job->reboot;
+    char json[384];     // Every field at its longest
+    if (ok) {
+        int64_t elapsed_us = esp_timer_get_time() - job->start_us;
+        if (elapsed_us < 1) elapsed_us = 1;
+        unsigned long kbps = (unsigned long)((uint64_t)req->content_len * 1000000 / 1024 / elapsed_us);
+        wifi_arena_stats_t arena_stats;
+        wifi_arena_get_stats(&arena_stats);
+        unsigned long served = arena_stats.calls - job->calls_at_start - 1;     // Without the update request itself
+        ESP_LOGI(TAG_OTA, "Update written: %u bytes in %" PRId64 " ms, %lu kB/s (receive %" PRId64 " ms, flash %" PRId64
+                 " ms, waited for flash %" PRId64 " ms), HTTP server blocked %" PRId64 " ms, %lu other requests served "
+                 "meanwhile",
+                 (unsigned)req->content_len, elapsed_us / 1000, kbps, recv_us / 1000, ota_flash_us / 1000, flash_wait_us / 1000,
+                 job->httpd_blocked_us / 1000, served);
+
+        snprintf(json, sizeof(json), "{\"bytes\": %u, \"ms\": %" PRId64 ", \"kBps\": %lu, \"recvMs\": %" PRId64
+                 ", \"flashMs\": %" PRId64 ", \"flashWaitMs\": %" PRId64 ", \"httpdBlockedMs\": %" PRId64
+                 ", \"requestsServed\": %lu, \"partition\": \"%s\", \"reboot\": %s}",
+                 (unsigned)req->content_len, elapsed_us / 1000, kbps, recv_us / 1000, ota_flash_us / 1000, flash_wait_us / 1000,
+                 job->httpd_blocked_us / 1000, served, job->partition->label, job->reboot ? "true" : "false");
+    }
+    taskENTER_CRITICAL(&ota_lock);
+    if (!reboot) {
+        ota_running = false;
+    }
+    taskEXIT_CRITICAL(&ota_lock);
+    if (ok) {
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req, json, strlen(json));
+    } else if (msg != NULL) {
+        ota_error(req, status, msg);
+    }
+    httpd_req_async_handler_complete(req);
+    taskENTER_CRITICAL(&ota_lock);
+    ota_detached--;
+    taskEXIT_CRITICAL(&ota_lock);
+
+    if (reboot) {
+        ESP_LOGI(TAG_OTA, "Restarting into the new firmware");
+        ota_restarting = true;
+        err = wifi_request_restart(OTA_RESTART_DELAY_MS, true);
+        if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {     // INVALID_STATE: already scheduled
+            vTaskDelay(pdMS_TO_TICKS(OTA_RESTART_DELAY_MS));
+            esp_restart();
+        }
+    }
+}
+
+/**
+ * @brief Run every update the handler hands over.
+ */
+static void ota_update_task(void *arg) {
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        ota_run(&ota_job);
+    }
+}
+
+/**
+ * @brief Create the update and flash writer tasks and their queues on first use.
+ */
+static esp_err_t ota_start_tasks(void) {
+    if (ota_task != NULL) return ESP_OK;
+
+    int core, priority;
+    wifi_get_task_placement(WIFI_TASK_WORKER, &core, &priority);
+    BaseType_t core_id = (core < 0 || core >= portNUM_PROCESSORS) ? tskNO_AFFINITY : core;
+#ifdef CONFIG_WIFI_STATIC_ALLOCATION
+    ota_write_queue = xQueueCreateStatic(1, sizeof(ota_chunk_t), ota_write_queue_items, &ota_write_queue_storage);
+    ota_done_queue = xQueueCreateStatic(1, sizeof(esp_err_t), ota_done_queue_items, &ota_done_queue_storage);
+    xTaskCreateStaticPinnedToCore(ota_writer_task, "wifi_ota_write", OTA_WRITER_STACK_SIZE, NULL, priority,
+                                  ota_writer_stack, &ota_writer_tcb, core_id);
+    ota_task = xTaskCreateStaticPinnedToCore(ota_update_task, "wifi_ota", OTA_TASK_STACK_SIZE, NULL, priority,
+                                             ota_task_stack, &ota_task_tcb, core_id);
+    return ESP_OK;
+#else
+    TaskHandle_t writer = NULL;
+    ota_write_queue = xQueueCreate(1, sizeof(ota_chunk_t));
+    ota_done_queue = xQueueCreate(1, sizeof(esp_err_t));
+    if (ota_write_queue == NULL || ota_done_queue == NULL) goto fail;
+    if (xTaskCreatePinnedToCore(ota_writer_task, "wifi_ota_write", OTA_WRITER_STACK_SIZE, NULL, priority, &writer,
+                                core_id) != pdPASS) {
+        goto fail;
+    }
+    if (xTaskCreatePinnedToCore(ota_update_task, "wifi_ota", OTA_TASK_STACK_SIZE, NULL, priority, &ota_task,
+                                core_id) == pdPASS) {
+        return ESP_OK;
+    }
+    vTaskDelete(writer);
+
+fail:
+    if (ota_write_queue) vQueueDelete(ota_write_queue);
+    if (ota_done_queue) vQueueDelete(ota_done_queue);
+    ota_write_queue = ota_done_queue = NULL;
+    ota_task = NULL;
+    return ESP_ERR_NO_MEM;
+#endif
+}
+
+esp_err_t wifi_ota_handler(httpd_req_t *req) {
+    int64_t start = esp_timer_get_time();
+
+    static const char expected[] = "Bearer " CONFIG_WIFI_OTA_TOKEN;
+    char auth[sizeof(expected) + 1];
+    if (httpd_req_get_hdr_value_str(req, "Authorization", auth, sizeof(auth)) != ESP_OK ||
+        !wifi_secret_equal(auth, expected)) {
+        ESP_LOGW(TAG_OTA, "Unauthorized update request");
+        httpd_resp_set_hdr(req, "WWW-Authenticate", "Bearer");
+        return ota_error(req, "401 Unauthorized", "Unauthorized");
+    }
+    if (req->content_len == 0) {
+        return ota_error(req, "411 Length Required", "Content-Length required");
+    }
+    const esp_partition_t *partition = esp_ota_get_next_update_partition(NULL);
+    if (partition == NULL) {
+        return ota_error(req, "500 Internal Server Error", "No OTA partition");
+    }
+    if (req->content_len > partition->size) {
+        return ota_error(req, "413 Payload Too Large", "Image larger than the OTA partition");
+    }
+
+    if (ota_start_tasks() != ESP_OK) {
+        ESP_LOGE(TAG_OTA, "Failed to start the update tasks");
+        return ota_error(req, "503 Service Unavailable", "Out of memory");
+    }
+
+    // Checked and claimed together, so wifi_ota_suspend() either waits for this update or it is refused
+    taskENTER_CRITICAL(&ota_lock);
+    bool busy = ota_running;
+    bool suspended = ota_suspended;
+    if (!busy && !suspended) {
+        ota_running = true;
+        ota_detached++;
+    }
+    taskEXIT_CRITICAL(&ota_lock);
+    if (busy) {
+        return ota_error(req, "409 Conflict", "Update already running");
+    }
+    if (suspended) {
+        return ota_error(req, "503 Service Unavailable", "Server is stopping");
+    }
+    ota_job_t *job = &ota_job;
+    memset(job, 0, sizeof(*job));
+    job->partition = partition;
+    job->reboot = true;
+    job->start_us = start;
+    wifi_arena_stats_t arena_stats;
+    wifi_arena_get_stats(&arena_stats);
+    job->calls_at_start = arena_stats.calls;
+
+    char query[32];
+    char value[4];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "reboot", value, sizeof(value)) == ESP_OK && !strcmp(value, "0")) {
+        job->reboot = false;
+    }
+
+    // Detach the request, the HTTP server task returns to other clients
+    if (httpd_req_async_handler_begin(req, &job->req) != ESP_OK) {
+        taskENTER_CRITICAL(&ota_lock);
+        ota_running = false;
+        ota_detached--;
+        taskEXIT_CRITICAL(&ota_lock);
+        return ota_error(req, "500 Internal Server Error", "Failed to start update");
+    }
+    job->httpd_blocked_us = esp_timer_get_time() - start;
+    xTaskNotifyGive(ota_task);
+    return ESP_OK;
+}
+
+void wifi_ota_confirm_running_app(void) {
+    static bool confirmed = false;
+    if (confirmed) return;
+    confirmed = true;
+
+    esp_ota_img_states_t state;
+    if (esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK &&
+        state == ESP_OTA_IMG_PENDING_VERIFY) {
+        if (esp_ota_mark_app_valid_cancel_rollback() == ESP_OK) {
+            ESP_LOGI(TAG_OTA, "New firmware confirmed, rollback cancelled");
+        }
+    }
+}
+
+bool wifi_ota_in_progress(void) {
+    return ota_running && !ota_restarting;
+}
+
+void wifi_ota_suspend(void) {
+    taskENTER_CRITICAL(&ota_lock);
+    ota_suspended = true;
+    bool waiting = ota_detached > 0;
+    taskEXIT_CRITICAL(&ota_lock);
+    if (!waiting) return;
+
+    // The update task gives up on a stalled client after OTA_MAX_TIMEOUTS receive timeouts
+    ESP_LOGI(TAG_OTA, "Waiting for the running update before stopping the server");
+    int64_t start = esp_timer_get_time();
+    while (waiting) {
+        vTaskDelay(pdMS_TO_TICKS(OTA_SUSPEND_POLL_MS));
+        taskENTER_CRITICAL(&ota_lock);
+        waiting = ota_detached > 0;
+        taskEXIT_CRITICAL(&ota_lock);
+    }
+    ESP_LOGI(TAG_OTA, "Update answered after %" PRId64 " ms", (esp_timer_get_time() - start) / 1000);
+}
+
+void wifi_ota_resume(void) {
+    taskENTER_CRITICAL(&ota_lock);
+    ota_suspended = false;
+    taskEXIT_CRITICAL(&ota_lock);
+}
+
+#endif // CONFIG_WIFI_OTA
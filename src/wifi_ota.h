@@ -0,0 +1,77 @@
+/**
+ * @file wifi_ota.h
+ * @brief Firmware update over HTTP (private).
+ *
+ * POST /update with "Authorization: Bearer <CONFIG_WIFI_OTA_TOKEN>" and the
+ * application binary (build/<project>.bin) as body writes it to the next OTA
+ * partition, validates it and makes it the boot partition. The request is
+ * handed off to an update task with httpd_req_async_handler_begin(), so the
+ * HTTP server keeps serving other requests during the update. The update task
+ * receives into one of two buffers while a flash writer task writes the other
+ * one with esp_ota_write(), so network receive and flash erase/write overlap.
+ *
+ * The device restarts into the new firmware after the response, unless the
+ * request has the query "reboot=0".
+ */
+
+#ifndef WIFI_OTA_H
+#define WIFI_OTA_H
+
+#include <stdbool.h>
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#define WIFI_OTA_URI "/update"      ///< Update route
+
+#ifdef CONFIG_WIFI_OTA
+
+/**
+ * @brief HTTP POST handler for WIFI_OTA_URI.
+ *
+ * @param req HTTP request handle
+ * @return ESP_OK when the request was handed to the update task or a response was sent
+ */
+esp_err_t wifi_ota_handler(httpd_req_t *req);
+
+/**
+ * @brief Mark the running firmware as good if it still waits for confirmation.
+ *
+ * With CONFIG_BOOTLOADER_APP_ROLLBACK_ENABLE, the bootloader returns to the
+ * previous firmware unless the new one confirms itself. Called after the first
+ * successful mode switch, when the web server runs again.
+ */
+void wifi_ota_confirm_running_app(void);
+
+/**
+ * @brief Check whether an update is being received or written.
+ *
+ * @return true from the accepted request until its response is sent
+ */
+bool wifi_ota_in_progress(void);
+
+/**
+ * @brief Refuse new updates and wait until the running one has sent its response.
+ *
+ * The update task answers on a request detached from the HTTP server, which
+ * httpd_stop() would free under it. Called by the component before it stops
+ * the server; updates arriving meanwhile get 503.
+ */
+void wifi_ota_suspend(void);
+
+/**
+ * @brief Accept updates again after wifi_ota_suspend().
+ */
+void wifi_ota_resume(void);
+
+#else
+
+static inline void wifi_ota_confirm_running_app(void) {}
+static inline bool wifi_ota_in_progress(void) { return false; }
+static inline void wifi_ota_suspend(void) {}
+static inline void wifi_ota_resume(void) {}
+
+#endif // CONFIG_WIFI_OTA
+
+#endif
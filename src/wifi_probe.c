@@ -0,0 +1,162 @@
+/**
+ * @file wifi_probe.c
+ * @brief Responses to OS connectivity probes.
+ */
+
+#include "wifi_probe.h"
+
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/** @brief Log tag for probe responses */
+static const char *TAG_PROBE = "Wifi-Probe";
+
+/**
+ * @brief Status and body of a probe response.
+ */
+typedef struct {
+    const char *status;     ///< Status line without "HTTP/1.1 "
+    const char *type;       ///< Content-Type, NULL without body
+    const char *body;       ///< Body, NULL for redirects and 204
+} probe_def_t;
+
+/** @brief Responses, indexed by wifi_probe_response_t; redirects take their Location from probe_location() */
+static const probe_def_t probe_defs[WIFI_PROBE_RESPONSE_COUNT] = {
+    [WIFI_PROBE_CAPTIVE_REDIRECT] = { "302 Found", NULL, NULL },
+    [WIFI_PROBE_PORTAL_REDIRECT] = { "302 Found", NULL, NULL },
+    [WIFI_PROBE_NO_CONTENT] = { "204 No Content", NULL, NULL },
+    [WIFI_PROBE_APPLE_SUCCESS] = { "200 OK", "text/html", "<HTML><HEAD><TITLE>Success</TITLE></HEAD><BODY>Success</BODY></HTML>" },
+    [WIFI_PROBE_NCSI] = { "200 OK", "text/plain", "Microsoft NCSI" },
+    [WIFI_PROBE_CONNECTTEST] = { "200 OK", "text/plain", "Microsoft Connect Test" },
+    [WIFI_PROBE_FIREFOX_SUCCESS] = { "200 OK", "text/plain", "success\n" },
+    [WIFI_PROBE_NM_SUCCESS] = { "200 OK", "text/plain", "NetworkManager is online\n" },
+};
+
+/**
+ * @brief Probe URI and its success response.
+ */
+typedef struct {
+    const char *uri;
+    wifi_probe_response_t success;
+} probe_uri_t;
+
+/** @brief URIs with a body other than 204 as success response */
+static const probe_uri_t probe_uris[] = {
+    { "/hotspot-detect.html", WIFI_PROBE_APPLE_SUCCESS },
+    { "/ncsi.txt", WIFI_PROBE_NCSI },
+    { "/connecttest.txt", WIFI_PROBE_CONNECTTEST },
+    { "/success.txt", WIFI_PROBE_FIREFOX_SUCCESS },
+    { "/check_network_status.txt", WIFI_PROBE_NM_SUCCESS },
+};
+
+/** @brief Target of WIFI_PROBE_PORTAL_REDIRECT */
+static char portal_location[64] = "/";
+
+#ifdef CONFIG_WIFI_PROBE_RAW_RESPONSE
+/** @brief Longest raw response */
+#define PROBE_RAW_MAX 192
+
+/** @brief Raw responses, status line to body, indexed by wifi_probe_response_t */
+static char probe_raw[WIFI_PROBE_RESPONSE_COUNT][PROBE_RAW_MAX];
+
+/** @brief Lengths of probe_raw entries, 0 until built or if too long */
+static size_t probe_raw_len[WIFI_PROBE_RESPONSE_COUNT];
+#endif
+
+/**
+ * @brief Location header of a redirect response.
+ */
+static const char *probe_location(wifi_probe_response_t response) {
+    return response == WIFI_PROBE_CAPTIVE_REDIRECT ? "/captive" : portal_location;
+}
+
+#ifdef CONFIG_WIFI_PROBE_RAW_RESPONSE
+/**
+ * @brief Format one response into probe_raw.
+ */
+static void build_raw(wifi_probe_response_t response) {
+    const probe_def_t *def = &probe_defs[response];
+    char *raw = probe_raw[response];
+    int len;
+    if (def->body != NULL) {
+        len = snprintf(raw, PROBE_RAW_MAX, "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %u\r\n"
+                       "Cache-Control: no-store\r\nConnection: close\r\n\r\n%s",
+                       def->status, def->type, (unsigned)strlen(def->body), def->body);
+    } else if (response == WIFI_PROBE_CAPTIVE_REDIRECT || response == WIFI_PROBE_PORTAL_REDIRECT) {
+        len = snprintf(raw, PROBE_RAW_MAX, "HTTP/1.1 %s\r\nLocation: %s\r\nContent-Length: 0\r\n"
+                       "Cache-Control: no-store\r\nConnection: close\r\n\r\n", def->status, probe_location(response));
+    } else {
+        len = snprintf(raw, PROBE_RAW_MAX, "HTTP/1.1 %s\r\nContent-Length: 0\r\n"
+                       "Cache-Control: no-store\r\nConnection: close\r\n\r\n", def->status);
+    }
+    probe_raw_len[response] = (len > 0 && len < PROBE_RAW_MAX) ? (size_t)len : 0;
+}
+#endif
+
+wifi_probe_response_t wifi_probe_success_response(const char *uri) {
+    for (size_t i = 0; i < sizeof(probe_uris) / sizeof(probe_uris[0]); i++) {
+        if (!strcmp(uri, probe_uris[i].uri)) return probe_uris[i].success;
+    }
+    return WIFI_PROBE_NO_CONTENT;
+}
+
+void wifi_probe_set_location(const char *location) {
+    if (strlen(location) >= sizeof(portal_location)) {
+        ESP_LOGE(TAG_PROBE, "Portal location too long: %s", location);
+        location = "/";
+    }
+    strcpy(portal_location, location);
+#ifdef CONFIG_WIFI_PROBE_RAW_RESPONSE
+    for (int i = 0; i < WIFI_PROBE_RESPONSE_COUNT; i++) {
+        build_raw(i);
+    }
+#endif
+    ESP_LOGD(TAG_PROBE, "Probe redirect location: %s", portal_location);
+}
+
+#ifdef CONFIG_WIFI_PROBE_RAW_RESPONSE
+/**
+ * @brief Write a raw response to the socket and close the connection.
+ */
+static esp_err_t send_raw(httpd_req_t *req, wifi_probe_response_t response) {
+    const char *data = probe_raw[response];
+    size_t len = probe_raw_len[response];
+
+    esp_err_t ret = ESP_OK;
+    while (len > 0) {
+        int sent = httpd_send(req, data, len);
+        if (sent <= 0) {
+            ESP_LOGD(TAG_PROBE, "Failed to send probe response: %d", sent);
+            ret = ESP_FAIL;
+            break;
+        }
+        data += sent;
+        len -= sent;
+    }
+    // Free the socket for page loads right away instead of keeping it alive
+    httpd_sess_trigger_close(req->handle, httpd_req_to_sockfd(req));
+    return ret;
+}
+#endif
+
+esp_err_t wifi_probe_send(httpd_req_t *req, wifi_probe_response_t response) {
+#ifdef CONFIG_WIFI_PROBE_RAW_RESPONSE
+    if (probe_raw_len[response] > 0) {
+        return send_raw(req, response);
+    }
+#endif
+    const probe_def_t *def = &probe_defs[response];
+    httpd_resp_set_status(req, def->status);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    if (response == WIFI_PROBE_CAPTIVE_REDIRECT || response == WIFI_PROBE_PORTAL_REDIRECT) {
+        httpd_resp_set_hdr(req, "Location", probe_location(response));
+    }
+    if (def->body == NULL) {
+        return httpd_resp_send(req, NULL, 0);
+    }
+    httpd_resp_set_type(req, def->type);
+    return httpd_resp_send(req, def->body, HTTPD_RESP_USE_STRLEN);
+}
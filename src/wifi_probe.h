@@ -0,0 +1,72 @@
+/**
+ * @file wifi_probe.h
+ * @brief Responses to OS connectivity probes (private).
+ *
+ * Phones and laptops send probes such as /generate_204 or
+ * /hotspot-detect.html when they join a network, often several at once and
+ * again after every network change. Each platform expects its own exact
+ * response for "internet available", anything else opens the captive popup
+ * or makes it probe again.
+ *
+ * With CONFIG_WIFI_PROBE_RAW_RESPONSE the responses are raw byte strings,
+ * built by wifi_probe_set_location() before the web server starts and written
+ * to the socket with httpd_send(), and the connection is closed. The probe
+ * requests themselves are parsed and dispatched by esp_http_server like any
+ * other, it has no hook before that; only the response skips httpd_resp_*.
+ * A response that was not built is sent with httpd_resp_*. Probe daemons
+ * open a new connection per check anyway, so an idle keep-alive socket would
+ * only sit in the pool until lru_purge_enable evicts the oldest session,
+ * which can be a browser loading the portal page.
+ */
+
+#ifndef WIFI_PROBE_H
+#define WIFI_PROBE_H
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+/**
+ * @brief Probe responses.
+ */
+typedef enum {
+    WIFI_PROBE_CAPTIVE_REDIRECT = 0,    ///< 302 to /captive, captive portal mode
+    WIFI_PROBE_PORTAL_REDIRECT,         ///< 302 to the location set with wifi_probe_set_location(), STA/AP mode
+    WIFI_PROBE_NO_CONTENT,              ///< 204, success for Android, ChromeOS and generic probes
+    WIFI_PROBE_APPLE_SUCCESS,           ///< Success page expected from /hotspot-detect.html
+    WIFI_PROBE_NCSI,                    ///< Body expected from /ncsi.txt
+    WIFI_PROBE_CONNECTTEST,             ///< Body expected from /connecttest.txt
+    WIFI_PROBE_FIREFOX_SUCCESS,         ///< Body expected from /success.txt
+    WIFI_PROBE_NM_SUCCESS,              ///< Body expected from NetworkManager's /check_network_status.txt
+    WIFI_PROBE_RESPONSE_COUNT
+} wifi_probe_response_t;
+
+/**
+ * @brief Get the response that tells the prober the network has internet access.
+ *
+ * @param uri Probe URI, see wifi_is_captive_probe_uri()
+ * @return Success response for the URI
+ */
+wifi_probe_response_t wifi_probe_success_response(const char *uri);
+
+/**
+ * @brief Set the target of WIFI_PROBE_PORTAL_REDIRECT and build the raw responses.
+ *
+ * Called from the HTTP server task or before the server starts.
+ *
+ * @param location Absolute URL of the portal, e.g. "http://esp32.local/"
+ */
+void wifi_probe_set_location(const char *location);
+
+/**
+ * @brief Send a probe response.
+ *
+ * Replaces the httpd_resp_* calls of the handler, nothing else may be sent.
+ * A raw response closes the connection afterwards.
+ *
+ * @param req HTTP request handle
+ * @param response Response to send
+ * @return ESP_OK when sent, ESP_FAIL on socket errors
+ */
+esp_err_t wifi_probe_send(httpd_req_t *req, wifi_probe_response_t response);
+
+#endif
@@ -0,0 +1,604 @@
+/**
+ * @file wifi_sdlog.c
+ * @brief Non-blocking log and data sink on the SD card.
+ *
+ * The queue is a bounded ring of fixed-size slots, each with a sequence
+ * number (Vyukov's bounded queue, extended to claim several consecutive
+ * slots at once). A slot at position p is free while its sequence is p,
+ * filled when it is p + 1, and freed by the writer by setting it to
+ * p + SDLOG_SLOTS. Producers claim all slots of a record with one
+ * compare-and-swap of the enqueue position, so records of different tasks
+ * never interleave. The writer task is the only consumer.
+ *
+ * The writer copies records into a batch buffer and writes only whole
+ * batches at batch-aligned file offsets. A sync writes the partial batch too
+ * and keeps it in the buffer; the next write of that batch starts at the same
+ * offset again, so writes stay sector-aligned at the cost of rewriting the
+ * partial batch (counted as write amplification).
+ *
+ * Records reach the card whole or not at all. After a failed write or a
+ * card removal the file is cut back to the end of the last whole record on
+ * the card, and the rest of the record the batch ended in is dropped from the
+ * queue. If the file cannot be cut, the next open starts a new file rather
+ * than appending to a record that was cut short.
+ */
+
+#include "sdkconfig.h"
+
+#ifdef CONFIG_WIFI_SDLOG
+
+#include "wifi_sdlog.h"
+#include "Wifi.h"
+
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** @brief Log tag for log sink messages */
+static const char *TAG_SDLOG = "Wifi-SD_Log";
+
+/** @brief Number of queue slots */
+#define SDLOG_SLOTS CONFIG_WIFI_SDLOG_SLOTS
+
+/** @brief Mask from position to slot index */
+#define SDLOG_SLOT_MASK (SDLOG_SLOTS - 1)
+
+/** @brief Payload bytes per slot */
+#define SDLOG_SLOT_SIZE CONFIG_WIFI_SDLOG_SLOT_SIZE
+
+/** @brief Batch size, the unit of writes to the card */
+#define SDLOG_BATCH_SIZE CONFIG_WIFI_SDLOG_BATCH_SIZE
+
+/** @brief File size at which the log file is rotated */
+#define SDLOG_FILE_SIZE ((off_t)CONFIG_WIFI_SDLOG_FILE_SIZE_KB * 1024)
+
+/** @brief Size of file path buffers */
+#define SDLOG_PATH_SIZE 96
+
+/** @brief Writer task stack size */
+#define SDLOG_TASK_STACK_SIZE 3072
+
+/** @brief Polling interval of wifi_sdlog_flush() */
+#define SDLOG_FLUSH_POLL_MS 10
+
+_Static_assert((SDLOG_SLOTS & SDLOG_SLOT_MASK) == 0, "CONFIG_WIFI_SDLOG_SLOTS must be a power of two");
+_Static_assert(SDLOG_BATCH_SIZE % 512 == 0, "CONFIG_WIFI_SDLOG_BATCH_SIZE must be a multiple of 512");
+
+/**
+ * @brief One queue slot.
+ */
+typedef struct {
+    _Atomic uint32_t seq;               ///< Position this slot is free (seq == pos) or filled (seq == pos + 1) for
+    uint16_t len;                       ///< Payload bytes in data
+    bool more;                          ///< The record continues in the next slot
+    uint8_t data[SDLOG_SLOT_SIZE];      ///< Part of a record
+} sdlog_slot_t;
+
+/** @brief Queue slots */
+static sdlog_slot_t sdlog_slots[SDLOG_SLOTS];
+
+/** @brief Next position claimed by producers */
+static _Atomic uint32_t sdlog_enqueue_pos = 0;
+
+/** @brief Next position read by the writer */
+static _Atomic uint32_t sdlog_dequeue_pos = 0;
+
+/** @brief Producer-side counters */
+static _Atomic uint32_t sdlog_records = 0;
+static _Atomic uint32_t sdlog_dropped = 0;
+static _Atomic uint32_t sdlog_high_water = 0;
+
+/** @brief Flush requests and the last request completed by the writer */
+static _Atomic uint32_t sdlog_flush_request = 0;
+static _Atomic uint32_t sdlog_flush_done = 0;
+
+/** @brief Writer-side counters, see wifi_sdlog_stats_t */
+static wifi_sdlog_stats_t sdlog_stats;
+
+/** @brief Writer task handle, NULL until wifi_sdlog_init() */
+static TaskHandle_t sdlog_task = NULL;
+
+/** @brief Held by the writer while it uses the file, and while the card is unmounted */
+static SemaphoreHandle_t sdlog_file_lock = NULL;
+
+/** @brief SD card mount point */
+static const char *sdlog_mount_point = NULL;
+
+/** @brief SD card is mounted */
+static volatile bool sdlog_card_mounted = false;
+
+/** @brief Batch buffer, DMA-capable so the SD driver can write it without copying */
+static uint8_t *sdlog_batch = NULL;
+
+#ifdef CONFIG_WIFI_STATIC_ALLOCATION
+/** @brief Storage of the batch buffer, see CONFIG_WIFI_STATIC_ALLOCATION */
+static DMA_ATTR uint8_t sdlog_batch_storage[SDLOG_BATCH_SIZE];
+
+/** @brief Storage of sdlog_file_lock */
+static StaticSemaphore_t sdlog_file_lock_storage;
+
+/** @brief Control block of the writer task */
+static StaticTask_t sdlog_task_tcb;
+
+/** @brief Stack of the writer task */
+static StackType_t sdlog_task_stack[SDLOG_TASK_STACK_SIZE];
+#endif
+
+/** @brief Bytes in sdlog_batch */
+static size_t sdlog_fill = 0;
+
+/** @brief Bytes of sdlog_batch already counted in bytes_written by a sync */
+static size_t sdlog_counted = 0;
+
+/** @brief File offset of sdlog_batch[0], a multiple of SDLOG_BATCH_SIZE */
+static off_t sdlog_file_off = 0;
+
+/** @brief File offset after the last record completely in the batch or on the card */
+static off_t sdlog_record_end = 0;
+
+/** @brief File offset after the last record completely on the card, the file is cut back here after a failure */
+static off_t sdlog_durable_end = 0;
+
+/** @brief The batch ends inside a record */
+static bool sdlog_in_record = false;
+
+/** @brief The start of the record being drained was lost, its remaining slots are dropped */
+static bool sdlog_drop_record = false;
+
+/** @brief The log file could not be cut back after a failure, the next open starts a new file */
+static bool sdlog_torn = false;
+
+/** @brief Open log file, -1 if closed */
+static int sdlog_fd = -1;
+
+/** @brief Data was written since the last fsync() */
+static bool sdlog_dirty = false;
+
+/** @brief vprintf hook replaced by wifi_sdlog_capture_esp_log() */
+static vprintf_like_t sdlog_prev_vprintf = NULL;
+
+/**
+ * @brief Wake the writer task from a task or an ISR.
+ */
+static void sdlog_wake_writer(void) {
+    if (xPortInIsrContext()) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(sdlog_task, &woken);
+        if (woken) {
+            portYIELD_FROM_ISR();
+        }
+    } else {
+        xTaskNotifyGive(sdlog_task);
+    }
+}
+
+esp_err_t wifi_sdlog_write(const void *data, size_t len) {
+    if (sdlog_task == NULL) return ESP_ERR_INVALID_STATE;
+    if (len == 0) return ESP_OK;
+
+    uint32_t count = (len + SDLOG_SLOT_SIZE - 1) / SDLOG_SLOT_SIZE;
+    if (count > SDLOG_SLOTS / 2) {
+        atomic_fetch_add_explicit(&sdlog_dropped, 1, memory_order_relaxed);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Claim count consecutive free slots
+    uint32_t pos = atomic_load_explicit(&sdlog_enqueue_pos, memory_order_relaxed);
+    while (1) {
+        uint32_t i;
+        int32_t diff = 0;
+        for (i = 0; i < count; i++) {
+            uint32_t seq = atomic_load_explicit(&sdlog_slots[(pos + i) & SDLOG_SLOT_MASK].seq, memory_order_acquire);
+            diff = (int32_t)(seq - (pos + i));
+            if (diff != 0) break;
+        }
+        if (i == count) {
+            if (atomic_compare_exchange_weak_explicit(&sdlog_enqueue_pos, &pos, pos + count,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Slot still holds data from the previous lap, the queue is full
+            atomic_fetch_add_explicit(&sdlog_dropped, 1, memory_order_relaxed);
+            return ESP_ERR_NO_MEM;
+        } else {
+            // Another producer claimed this position first
+            pos = atomic_load_explicit(&sdlog_enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    // Fill and publish the slots
+    const uint8_t *src = data;
+    for (uint32_t i = 0; i < count; i++) {
+        sdlog_slot_t *slot = &sdlog_slots[(pos + i) & SDLOG_SLOT_MASK];
+        size_t n = len < SDLOG_SLOT_SIZE ? len : SDLOG_SLOT_SIZE;
+        memcpy(slot->data, src, n);
+        slot->len = n;
+        slot->more = i + 1 < count;
+        src += n;
+        len -= n;
+        atomic_store_explicit(&slot->seq, pos + i + 1, memory_order_release);
+    }
+    atomic_fetch_add_explicit(&sdlog_records, 1, memory_order_relaxed);
+
+    // The writer may already be past this record, then the difference is negative
+    int32_t used = (int32_t)(pos + count - atomic_load_explicit(&sdlog_dequeue_pos, memory_order_relaxed));
+    uint32_t high_water = atomic_load_explicit(&sdlog_high_water, memory_order_relaxed);
+    while (used > (int32_t)high_water &&
+           !atomic_compare_exchange_weak_explicit(&sdlog_high_water, &high_water, used,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+    if (used >= SDLOG_SLOTS / 2) {
+        sdlog_wake_writer();
+    }
+    return ESP_OK;
+}
+
+esp_err_t wifi_sdlog_printf(const char *fmt, ...) {
+    char line[WIFI_SDLOG_PRINTF_MAX];
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (len < 0) return ESP_ERR_INVALID_ARG;
+    if (len >= (int)sizeof(line)) len = sizeof(line) - 1;
+    return wifi_sdlog_write(line, len);
+}
+
+/**
+ * @brief Build the path of log file index.
+ */
+static void sdlog_path(char *path, int index) {
+    snprintf(path, SDLOG_PATH_SIZE, "%s/%s/log%d.txt", sdlog_mount_point, CONFIG_WIFI_SDLOG_DIR, index);
+}
+
+/**
+ * @brief Close the log file and discard the buffered bytes not yet on the card.
+ */
+static void sdlog_close(bool discard) {
+    if (sdlog_fd >= 0) {
+        close(sdlog_fd);
+        sdlog_fd = -1;
+    }
+    if (discard) {
+        sdlog_stats.lost_bytes += sdlog_fill - sdlog_counted;
+        // The rest of the record the batch ended in is still queued, and useless without its start
+        sdlog_drop_record |= sdlog_in_record;
+        sdlog_in_record = false;
+    }
+    sdlog_fill = 0;
+    sdlog_counted = 0;
+    sdlog_dirty = false;
+}
+
+/**
+ * @brief Close the log file after a failed write or before card removal, leaving only whole records on the card.
+ *
+ * @param failed A write or fsync failed, the file may also hold part of the batch
+ */
+static void sdlog_discard(bool failed) {
+    if (sdlog_fd < 0) return;
+
+    off_t on_card = sdlog_file_off + sdlog_counted;
+    if (failed || on_card > sdlog_durable_end) {
+        if (ftruncate(sdlog_fd, sdlog_durable_end) == 0) {
+            if (on_card > sdlog_durable_end) {
+                sdlog_stats.bytes_written -= on_card - sdlog_durable_end;
+                sdlog_stats.lost_bytes += on_card - sdlog_durable_end;
+            }
+        } else {
+            ESP_LOGE(TAG_SDLOG, "Failed to cut the log file back to offset %ld: %s", (long)sdlog_durable_end,
+                     strerror(errno));
+            sdlog_torn = true;
+        }
+    }
+    sdlog_close(true);
+}
+
+/**
+ * @brief Write the first len bytes of the batch at its file offset.
+ */
+static bool sdlog_write_batch(size_t len) {
+    if (lseek(sdlog_fd, sdlog_file_off, SEEK_SET) != sdlog_file_off) goto fail;
+    size_t off = 0;
+    while (off < len) {
+        ssize_t written = write(sdlog_fd, sdlog_batch + off, len - off);
+        if (written <= 0) goto fail;
+        off += written;
+    }
+    sdlog_stats.writes++;
+    sdlog_stats.card_bytes += len;
+    sdlog_stats.bytes_written += len - sdlog_counted;
+    sdlog_counted = len;
+    sdlog_durable_end = sdlog_record_end;
+    sdlog_dirty = true;
+    return true;
+
+fail:
+    ESP_LOGE(TAG_SDLOG, "Write failed: %s", strerror(errno));
+    sdlog_stats.write_errors++;
+    sdlog_discard(true);
+    return false;
+}
+
+static void sdlog_rotate(void);
+
+/**
+ * @brief Open the current log file for appending.
+ *
+ * The tail after the last batch boundary is read back into the batch buffer,
+ * so appending continues at an aligned offset. A file that could not be cut
+ * back after a failure is left as it is and a new one started.
+ */
+static bool sdlog_open(void) {
+    if (sdlog_fd >= 0) return true;
+
+    char path[SDLOG_PATH_SIZE];
+    snprintf(path, sizeof(path), "%s/%s", sdlog_mount_point, CONFIG_WIFI_SDLOG_DIR);
+    if (mkdir(path, 0775) != 0 && errno != EEXIST) {
+        ESP_LOGE(TAG_SDLOG, "Failed to create %s: %s", path, strerror(errno));
+        return false;
+    }
+    sdlog_path(path, 0);
+    sdlog_fd = open(path, O_RDWR | O_CREAT, 0664);
+    if (sdlog_fd < 0) {
+        ESP_LOGE(TAG_SDLOG, "Failed to open %s: %s", path, strerror(errno));
+        return false;
+    }
+    if (sdlog_torn) {
+        sdlog_torn = false;
+        sdlog_rotate();
+        return sdlog_fd >= 0;
+    }
+
+    off_t size = lseek(sdlog_fd, 0, SEEK_END);
+    if (size < 0) size = 0;
+    sdlog_file_off = size - size % SDLOG_BATCH_SIZE;
+    sdlog_fill = size - sdlog_file_off;
+    if (sdlog_fill > 0 && (lseek(sdlog_fd, sdlog_file_off, SEEK_SET) != sdlog_file_off ||
+                           read(sdlog_fd, sdlog_batch, sdlog_fill) != (ssize_t)sdlog_fill)) {
+        ESP_LOGE(TAG_SDLOG, "Failed to read back %s: %s", path, strerror(errno));
+        sdlog_close(false);
+        return false;
+    }
+    sdlog_counted = sdlog_fill;
+    sdlog_record_end = size;
+    sdlog_durable_end = size;
+    ESP_LOGI(TAG_SDLOG, "Logging to %s from offset %ld", path, (long)size);
+    return true;
+}
+
+/**
+ * @brief Start a new log file, shifting the old ones to higher indices.
+ *
+ * Called with an empty batch buffer.
+ */
+static void sdlog_rotate(void) {
+    if (sdlog_dirty) {
+        fsync(sdlog_fd);
+        sdlog_stats.syncs++;
+    }
+    sdlog_close(false);
+
+    char from[SDLOG_PATH_SIZE], to[SDLOG_PATH_SIZE];
+    for (int i = CONFIG_WIFI_SDLOG_FILE_COUNT - 1; i > 0; i--) {
+        sdlog_path(from, i - 1);
+        sdlog_path(to, i);
+        // FAT cannot rename over an existing file
+        unlink(to);
+        if (rename(from, to) != 0 && errno != ENOENT) {
+            ESP_LOGW(TAG_SDLOG, "Failed to rename %s: %s", from, strerror(errno));
+        }
+    }
+    sdlog_stats.rotations++;
+    sdlog_file_off = 0;
+    sdlog_open();
+}
+
+/**
+ * @brief Move filled slots into the batch buffer, writing every full batch.
+ */
+static void sdlog_drain(void) {
+    uint32_t pos = atomic_load_explicit(&sdlog_dequeue_pos, memory_order_relaxed);
+    while (sdlog_fd >= 0) {
+        sdlog_slot_t *slot = &sdlog_slots[pos & SDLOG_SLOT_MASK];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != pos + 1) break;   // Empty or still being filled
+
+        const uint8_t *src = slot->data;
+        size_t len = slot->len;
+        if (sdlog_drop_record) {
+            sdlog_stats.lost_bytes += len;
+            len = 0;
+        } else {
+            sdlog_in_record = true;
+        }
+        while (len > 0) {
+            size_t n = SDLOG_BATCH_SIZE - sdlog_fill;
+            if (n > len) n = len;
+            memcpy(sdlog_batch + sdlog_fill, src, n);
+            sdlog_fill += n;
+            src += n;
+            len -= n;
+            if (len == 0 && !slot->more) {
+                sdlog_record_end = sdlog_file_off + sdlog_fill;
+            }
+            if (sdlog_fill == SDLOG_BATCH_SIZE) {
+                if (!sdlog_write_batch(SDLOG_BATCH_SIZE)) {
+                    sdlog_stats.lost_bytes += len;
+                    break;
+                }
+                sdlog_file_off += SDLOG_BATCH_SIZE;
+                sdlog_fill = 0;
+                sdlog_counted = 0;
+                if (sdlog_file_off >= SDLOG_FILE_SIZE) {
+                    sdlog_rotate();
+                }
+            }
+        }
+        if (!slot->more) {
+            sdlog_in_record = false;
+            sdlog_drop_record = false;
+        }
+
+        atomic_store_explicit(&slot->seq, pos + SDLOG_SLOTS, memory_order_release);
+        pos++;
+        atomic_store_explicit(&sdlog_dequeue_pos, pos, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Put the partial batch on the card and fsync.
+ */
+static bool sdlog_sync(void) {
+    if (sdlog_fd < 0) return false;
+    if (sdlog_fill > sdlog_counted && !sdlog_write_batch(sdlog_fill)) return false;
+    if (!sdlog_dirty) return true;
+    if (fsync(sdlog_fd) != 0) {
+        ESP_LOGE(TAG_SDLOG, "fsync failed: %s", strerror(errno));
+        sdlog_stats.write_errors++;
+        sdlog_discard(true);
+        return false;
+    }
+    sdlog_stats.syncs++;
+    sdlog_dirty = false;
+    return true;
+}
+
+/**
+ * @brief Drain the queue when woken or every sync interval, and sync when due.
+ */
+static void sdlog_writer_task(void *arg) {
+    TickType_t last_sync = xTaskGetTickCount();
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_WIFI_SDLOG_SYNC_INTERVAL_MS));
+        uint32_t flush_request = atomic_load(&sdlog_flush_request);
+
+        xSemaphoreTake(sdlog_file_lock, portMAX_DELAY);
+        if (sdlog_card_mounted && sdlog_open()) {
+            sdlog_drain();
+            bool flush = flush_request != atomic_load(&sdlog_flush_done);
+            if (flush || xTaskGetTickCount() - last_sync >= pdMS_TO_TICKS(CONFIG_WIFI_SDLOG_SYNC_INTERVAL_MS)) {
+                if (sdlog_sync()) {
+                    atomic_store(&sdlog_flush_done, flush_request);
+                }
+                last_sync = xTaskGetTickCount();
+            }
+        }
+        xSemaphoreGive(sdlog_file_lock);
+    }
+}
+
+esp_err_t wifi_sdlog_init(const char *mount_point) {
+    if (sdlog_task != NULL) return ESP_OK;
+
+    for (uint32_t i = 0; i < SDLOG_SLOTS; i++) {
+        atomic_init(&sdlog_slots[i].seq, i);
+    }
+    sdlog_mount_point = mount_point;
+    int core, priority;
+    wifi_get_task_placement(WIFI_TASK_WORKER, &core, &priority);
+#ifdef CONFIG_WIFI_STATIC_ALLOCATION
+    sdlog_batch = sdlog_batch_storage;
+    sdlog_file_lock = xSemaphoreCreateMutexStatic(&sdlog_file_lock_storage);
+    sdlog_task = xTaskCreateStaticPinnedToCore(sdlog_writer_task, "wifi_sdlog", SDLOG_TASK_STACK_SIZE, NULL, priority,
+                                               sdlog_task_stack, &sdlog_task_tcb,
+                                               (core < 0 || core >= portNUM_PROCESSORS) ? tskNO_AFFINITY : core);
+    return ESP_OK;
+#else
+    sdlog_batch = heap_caps_malloc(SDLOG_BATCH_SIZE, MALLOC_CAP_DMA);
+    sdlog_file_lock = xSemaphoreCreateMutex();
+    if (sdlog_batch == NULL || sdlog_file_lock == NULL) goto fail;
+
+    if (xTaskCreatePinnedToCore(sdlog_writer_task, "wifi_sdlog", SDLOG_TASK_STACK_SIZE, NULL, priority, &sdlog_task,
+                                (core < 0 || core >= portNUM_PROCESSORS) ? tskNO_AFFINITY : core) == pdPASS) {
+        return ESP_OK;
+    }
+
+fail:
+    ESP_LOGE(TAG_SDLOG, "Failed to start SD card log");
+    free(sdlog_batch);
+    sdlog_batch = NULL;
+    if (sdlog_file_lock) vSemaphoreDelete(sdlog_file_lock);
+    sdlog_file_lock = NULL;
+    sdlog_task = NULL;
+    return ESP_ERR_NO_MEM;
+#endif
+}
+
+void wifi_sdlog_card_changed(bool mounted) {
+    if (sdlog_task == NULL) return;
+    if (mounted) {
+        sdlog_card_mounted = true;
+        xTaskNotifyGive(sdlog_task);
+        return;
+    }
+    // Wait for a write in progress, the file must be closed before the card goes away
+    xSemaphoreTake(sdlog_file_lock, portMAX_DELAY);
+    sdlog_card_mounted = false;
+    sdlog_discard(false);
+    xSemaphoreGive(sdlog_file_lock);
+}
+
+esp_err_t wifi_sdlog_flush(uint32_t timeout_ms) {
+    if (sdlog_task == NULL) return ESP_ERR_INVALID_STATE;
+    if (xTaskGetCurrentTaskHandle() == sdlog_task) return ESP_OK;
+
+    uint32_t target = atomic_fetch_add(&sdlog_flush_request, 1) + 1;
+    xTaskNotifyGive(sdlog_task);
+    TickType_t start = xTaskGetTickCount();
+    while ((int32_t)(atomic_load(&sdlog_flush_done) - target) < 0) {
+        if (xTaskGetTickCount() - start >= pdMS_TO_TICKS(timeout_ms)) return ESP_ERR_TIMEOUT;
+        vTaskDelay(pdMS_TO_TICKS(SDLOG_FLUSH_POLL_MS));
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief vprintf hook queueing ESP_LOG output.
+ */
+static int sdlog_vprintf(const char *fmt, va_list args) {
+    char line[WIFI_SDLOG_PRINTF_MAX];
+    va_list copy;
+    va_copy(copy, args);
+    int len = vsnprintf(line, sizeof(line), fmt, copy);
+    va_end(copy);
+    if (len > 0) {
+        wifi_sdlog_write(line, len < (int)sizeof(line) ? (size_t)len : sizeof(line) - 1);
+    }
+    return sdlog_prev_vprintf ? sdlog_prev_vprintf(fmt, args) : vprintf(fmt, args);
+}
+
+void wifi_sdlog_capture_esp_log(bool enable) {
+    if (enable && sdlog_prev_vprintf == NULL) {
+        sdlog_prev_vprintf = esp_log_set_vprintf(sdlog_vprintf);
+    } else if (!enable && sdlog_prev_vprintf != NULL) {
+        esp_log_set_vprintf(sdlog_prev_vprintf);
+        sdlog_prev_vprintf = NULL;
+    }
+}
+
+void wifi_sdlog_get_stats(wifi_sdlog_stats_t *stats) {
+    if (stats == NULL) return;
+    *stats = sdlog_stats;
+    stats->records = atomic_load_explicit(&sdlog_records, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&sdlog_dropped, memory_order_relaxed);
+    stats->write_amplification_x100 =
+        stats->bytes_written ? (uint32_t)(stats->card_bytes * 100 / stats->bytes_written) : 100;
+    stats->queue_slots = SDLOG_SLOTS;
+    stats->queue_high_water = atomic_load_explicit(&sdlog_high_water, memory_order_relaxed);
+}
+
+#endif // CONFIG_WIFI_SDLOG
@@ -0,0 +1,28 @@
+/**
+ * @file wifi_server.h
+ * @brief Work for the HTTP server task from other tasks (private).
+ *
+ * The server is stopped and started again on every mode switch, so a handle
+ * read from wifi_get_http_server() on another task may be freed before it is
+ * used. wifi_queue_http_work() checks and uses the handle under the lock
+ * stop_servers() holds while the server stops.
+ */
+
+#ifndef WIFI_SERVER_H
+#define WIFI_SERVER_H
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+/**
+ * @brief Queue work on the running HTTP server task.
+ *
+ * Does not block: while the server is being stopped the work is not queued.
+ *
+ * @param work Work function, called on the server task with the server handle as argument
+ * @return ESP_OK, ESP_ERR_INVALID_STATE if the server is not running or being stopped,
+ *         or the error of httpd_queue_work()
+ */
+esp_err_t wifi_queue_http_work(httpd_work_fn_t work);
+
+#endif
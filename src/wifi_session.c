@@ -0,0 +1,282 @@
+/**
+ * @file wifi_session.c
+ * @brief HTTP session limits and traffic accounting.
+ */
+
+#include "wifi_session.h"
+#include "wifi_clients.h"
+#include "sdkconfig.h"
+
+#include "esp_log.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+
+/** @brief Log tag for session limits */
+static const char *TAG_SESSION = "Wifi-Session";
+
+/** @brief Body bytes a session must receive in each rate window */
+#define BODY_WINDOW_BYTES ((uint32_t)((uint64_t)CONFIG_WIFI_HTTPD_MIN_BODY_RATE * CONFIG_WIFI_HTTPD_BODY_RATE_WINDOW_MS / 1000))
+
+/** @brief What the server reads from a session */
+typedef enum {
+    SESSION_HEADERS = 0,    ///< Request line and headers, or nothing between requests
+    SESSION_BODY,           ///< Body, or nothing while the handler runs
+} session_phase_t;
+
+/**
+ * @brief One open session.
+ *
+ * in_use, sockfd and ip are protected by sessions_lock. The other fields are
+ * only used by the task doing the session's I/O, which is the server task or
+ * the task of an async handler, never both at once.
+ */
+typedef struct {
+    bool in_use;            ///< Slot holds a session
+    bool newline;           ///< Last header byte received ended a line
+    bool websocket;         ///< Switched to WebSocket (101 sent), frames are not held to the HTTP deadlines
+    bool ended;             ///< The client closed the connection or receiving failed
+    uint8_t phase;          ///< session_phase_t
+    int sockfd;             ///< Socket
+    uint32_t ip;            ///< Client address, 0 if unknown
+    int64_t start_us;       ///< SESSION_HEADERS: first byte of the request, 0 before; SESSION_BODY: start of the rate window
+    uint32_t window_bytes;  ///< Body bytes received in the rate window
+} session_t;
+
+/** @brief Open sessions, the server never has more than CONFIG_LWIP_MAX_SOCKETS */
+static session_t sessions[CONFIG_LWIP_MAX_SOCKETS];
+
+/** @brief Session counters */
+static wifi_session_stats_t session_stats;
+
+/** @brief Sessions the server keeps open, see wifi_session_set_capacity() */
+static int session_capacity = CONFIG_LWIP_MAX_SOCKETS;
+
+/** @brief Protects sessions and session_stats, used from the server task and async handler tasks */
+static portMUX_TYPE sessions_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Find the session of a socket.
+ *
+ * @return Session, NULL if it is not tracked
+ */
+static session_t *find_session(int sockfd) {
+    session_t *session = NULL;
+    taskENTER_CRITICAL(&sessions_lock);
+    for (int i = 0; i < CONFIG_LWIP_MAX_SOCKETS; i++) {
+        if (sessions[i].in_use && sessions[i].sockfd == sockfd) {
+            session = &sessions[i];
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&sessions_lock);
+    return session;
+}
+
+/**
+ * @brief Wait until a socket has data to read.
+ *
+ * @param sockfd Socket
+ * @param timeout_us Longest wait, 0 or less to only check
+ * @return false if nothing arrived in time; select() errors return true, so recv() reports them
+ */
+static bool wait_readable(int sockfd, int64_t timeout_us) {
+    if (timeout_us < 0) timeout_us = 0;
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(sockfd, &readable);
+    struct timeval tv = {
+        .tv_sec = timeout_us / 1000000,
+        .tv_usec = timeout_us % 1000000,
+    };
+    return select(sockfd + 1, &readable, NULL, NULL, &tv) != 0;
+}
+
+/**
+ * @brief Wait for data until the deadline of the session's phase.
+ *
+ * @return 0 to receive, HTTPD_SOCK_ERR_TIMEOUT (the server answers 408) or HTTPD_SOCK_ERR_FAIL to end the session
+ */
+static int session_wait(session_t *session) {
+    if (session->websocket) return 0;
+    int64_t now = esp_timer_get_time();
+    int64_t deadline;
+    bool headers = session->phase == SESSION_HEADERS;
+    if (headers) {
+        if (CONFIG_WIFI_HTTPD_HEADER_TIMEOUT_MS == 0) return 0;
+        if (session->start_us == 0) {
+            session->start_us = now;    // The server only reads once select() saw the first byte
+        }
+        deadline = session->start_us + CONFIG_WIFI_HTTPD_HEADER_TIMEOUT_MS * 1000LL;
+    } else {
+        if (CONFIG_WIFI_HTTPD_MIN_BODY_RATE == 0) return 0;
+        if (session->window_bytes >= BODY_WINDOW_BYTES) {
+            if (now - session->start_us < CONFIG_WIFI_HTTPD_BODY_RATE_WINDOW_MS * 1000LL) return 0;
+            session->start_us = now;
+            session->window_bytes = 0;
+        }
+        deadline = session->start_us + CONFIG_WIFI_HTTPD_BODY_RATE_WINDOW_MS * 1000LL;
+    }
+    if (wait_readable(session->sockfd, deadline - now)) return 0;
+
+    taskENTER_CRITICAL(&sessions_lock);
+    if (headers) {
+        session_stats.header_timeouts++;
+    } else {
+        session_stats.slow_bodies++;
+    }
+    taskEXIT_CRITICAL(&sessions_lock);
+    if (headers) {
+        ESP_LOGW(TAG_SESSION, "Request headers from " IPSTR " incomplete after %d ms, closing",
+                 IP2STR((esp_ip4_addr_t *)&session->ip), CONFIG_WIFI_HTTPD_HEADER_TIMEOUT_MS);
+        return HTTPD_SOCK_ERR_TIMEOUT;
+    }
+    ESP_LOGW(TAG_SESSION, "Request body from " IPSTR " slower than %d bytes/s, closing",
+             IP2STR((esp_ip4_addr_t *)&session->ip), CONFIG_WIFI_HTTPD_MIN_BODY_RATE);
+    return HTTPD_SOCK_ERR_FAIL;
+}
+
+/**
+ * @brief Follow the request through received bytes, the headers end with an empty line.
+ */
+static void session_received(session_t *session, const char *buf, int len) {
+    if (session->websocket) return;
+    if (session->phase == SESSION_BODY) {
+        session->window_bytes += len;
+        return;
+    }
+    for (int i = 0; i < len; i++) {
+        if (buf[i] == '\n') {
+            if (session->newline) {
+                session->phase = SESSION_BODY;
+                session->start_us = esp_timer_get_time();
+                session->window_bytes = len - i - 1;
+                return;
+            }
+            session->newline = true;
+        } else if (buf[i] != '\r') {
+            session->newline = false;
+        }
+    }
+}
+
+// Same as the server's default send and receive functions, plus limits and counting
+static int session_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags) {
+    if (buf == NULL) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    int ret = send(sockfd, buf, buf_len, flags);
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EINTR) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+    session_t *session = find_session(sockfd);
+    if (session == NULL) return ret;
+    // Every response, including raw ones, starts with its status line in one send
+    bool response = buf_len >= 9 && memcmp(buf, "HTTP/1.1 ", 9) == 0;
+    if (response) {
+        // The next bytes are the next request; a body the handler left unread is discarded under the header deadline
+        session->phase = SESSION_HEADERS;
+        session->newline = false;
+        session->start_us = 0;
+        // After 101 Switching Protocols the session carries WebSocket frames until it closes
+        if (buf_len >= 12 && memcmp(buf + 9, "101", 3) == 0) {
+            session->websocket = true;
+        }
+    }
+    wifi_clients_traffic(session->ip, 0, ret, response);
+    return ret;
+}
+
+static int session_recv(httpd_handle_t hd, int sockfd, char *buf, size_t buf_len, int flags) {
+    if (buf == NULL) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    session_t *session = find_session(sockfd);
+    if (session != NULL) {
+        int err = session_wait(session);
+        if (err != 0) return err;
+    }
+    int ret = recv(sockfd, buf, buf_len, flags);
+    if (ret <= 0 && session != NULL && !(ret < 0 && (errno == EAGAIN || errno == EINTR))) {
+        session->ended = true;
+    }
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EINTR) ? HTTPD_SOCK_ERR_TIMEOUT : HTTPD_SOCK_ERR_FAIL;
+    }
+    if (session != NULL) {
+        session_received(session, buf, ret);
+        wifi_clients_traffic(session->ip, ret, 0, false);
+    }
+    return ret;
+}
+
+esp_err_t wifi_session_open(httpd_handle_t hd, int sockfd, uint32_t ip) {
+    session_t *session = NULL;
+    int held = 0;
+    taskENTER_CRITICAL(&sessions_lock);
+    for (int i = 0; i < CONFIG_LWIP_MAX_SOCKETS; i++) {
+        if (!sessions[i].in_use) {
+            if (session == NULL) session = &sessions[i];
+        } else if (ip != 0 && sessions[i].ip == ip) {
+            held++;
+        }
+    }
+    bool rejected = CONFIG_WIFI_HTTPD_MAX_SOCKETS_PER_CLIENT > 0 && held >= CONFIG_WIFI_HTTPD_MAX_SOCKETS_PER_CLIENT;
+    if (rejected) {
+        session_stats.rejected++;
+    } else if (session != NULL) {
+        memset(session, 0, sizeof(*session));
+        session->in_use = true;
+        session->sockfd = sockfd;
+        session->ip = ip;
+        session_stats.open++;
+        if (session_stats.open > session_stats.max_open) {
+            session_stats.max_open = session_stats.open;
+        }
+    }
+    taskEXIT_CRITICAL(&sessions_lock);
+
+    if (rejected) {
+        ESP_LOGW(TAG_SESSION, "Refusing connection from " IPSTR ", it holds %d already",
+                 IP2STR((esp_ip4_addr_t *)&ip), held);
+        return ESP_FAIL;
+    }
+    httpd_sess_set_send_override(hd, sockfd, session_send);
+    httpd_sess_set_recv_override(hd, sockfd, session_recv);
+    return ESP_OK;
+}
+
+void wifi_session_close(httpd_handle_t hd, int sockfd) {
+    taskENTER_CRITICAL(&sessions_lock);
+    for (int i = 0; i < CONFIG_LWIP_MAX_SOCKETS; i++) {
+        if (sessions[i].in_use && sessions[i].sockfd == sockfd) {
+            // Only the LRU purge closes a session waiting for its next request while all are in use
+            const session_t *session = &sessions[i];
+            if (!session->ended && session->phase == SESSION_HEADERS && session->start_us == 0 &&
+                session_stats.open >= session_capacity) {
+                session_stats.purged++;
+            }
+            sessions[i].in_use = false;
+            session_stats.open--;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&sessions_lock);
+    close(sockfd);      // With a close_fn the server leaves this to us
+}
+
+void wifi_session_set_capacity(int max_open_sockets) {
+    session_capacity = max_open_sockets;
+}
+
+void wifi_get_session_stats(wifi_session_stats_t *stats) {
+    taskENTER_CRITICAL(&sessions_lock);
+    *stats = session_stats;
+    taskEXIT_CRITICAL(&sessions_lock);
+}
@@ -0,0 +1,60 @@
+/**
+ * @file wifi_session.h
+ * @brief HTTP session limits and traffic accounting (private).
+ *
+ * The HTTP server handles all sessions in one task, so a single client can
+ * hold it up: by keeping many keep-alive sockets open, which makes the LRU
+ * purge close other clients' sessions, or by sending its request slowly,
+ * which blocks the task in recv() for every byte.
+ *
+ * Every session gets send and receive functions that enforce
+ * - at most CONFIG_WIFI_HTTPD_MAX_SOCKETS_PER_CLIENT sessions per client
+ *   address, further connections are closed right after accept,
+ * - CONFIG_WIFI_HTTPD_HEADER_TIMEOUT_MS from the first byte of a request
+ *   until the end of its headers, answered with 408 and closed,
+ * - on average CONFIG_WIFI_HTTPD_MIN_BODY_RATE bytes/s of request body over
+ *   each CONFIG_WIFI_HTTPD_BODY_RATE_WINDOW_MS, closed otherwise.
+ *
+ * WebSocket sessions are exempt from the deadlines once the server has
+ * answered the upgrade with 101, an idle dashboard is not a slow request.
+ *
+ * Deadlines only end a session while the server waits for the client; data
+ * the client has already sent is always read. Bytes and responses are counted
+ * per client in the station table. Idle sessions closed by the server while
+ * all its sockets are in use are counted as purged.
+ */
+
+#ifndef WIFI_SESSION_H
+#define WIFI_SESSION_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+/**
+ * @brief Start tracking a new session, used from the server's open_fn.
+ *
+ * @param hd Server handle
+ * @param sockfd Socket of the session
+ * @param ip Client address, 0 if unknown; unknown clients are not limited
+ * @return ESP_OK, ESP_FAIL if the client already holds the maximum number of sessions
+ */
+esp_err_t wifi_session_open(httpd_handle_t hd, int sockfd, uint32_t ip);
+
+/**
+ * @brief Set the number of sessions the server keeps open, for counting LRU purges.
+ *
+ * @param max_open_sockets max_open_sockets of the server config
+ */
+void wifi_session_set_capacity(int max_open_sockets);
+
+/**
+ * @brief Stop tracking a session and close its socket, the server's close_fn.
+ *
+ * @param hd Server handle
+ * @param sockfd Socket of the session
+ */
+void wifi_session_close(httpd_handle_t hd, int sockfd);
+
+#endif
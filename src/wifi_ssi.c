@@ -0,0 +1,468 @@
+/**
+ * @file wifi_ssi.c
+ * @brief Server-side includes in SD card HTML pages.
+ *
+ * A cache entry holds the positions of the directives in one file and their
+ * arguments. Sending a cached file is a series of fseek()/fread() calls for
+ * the text between directives, so a page costs about as much as sending it
+ * unchanged. Scanning looks for '<' with memchr() and only compares the text
+ * after it; a '<' close to the end of the read buffer is read again at the
+ * start of the next one, so a directive is never split.
+ *
+ * The cache is only used by the HTTP server task. Entries in use by the
+ * pages an include is nested in are never evicted.
+ */
+
+#include "sdkconfig.h"
+
+#ifdef CONFIG_WIFI_SSI
+
+#include "wifi_ssi.h"
+#include "wifi_upload.h"
+#include "wifi_util.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+/** @brief Log tag for server-side includes */
+static const char *TAG_SSI = "Wifi-SSI";
+
+#define SSI_DIRECTIVE_MAX 128       ///< Longest directive from "<!--#" to "-->", longer ones are sent unchanged
+#define SSI_ARGS_SIZE 192           ///< Argument bytes per cache entry
+#define SSI_PATH_MAX 96             ///< Longest full path of a template, longer ones are sent unchanged
+#define SSI_MIN_BUF_SIZE (2 * SSI_DIRECTIVE_MAX)
+
+/** @brief Directive types */
+typedef enum {
+    SSI_VAR = 0,                ///< <!--#var name -->
+    SSI_INCLUDE_VIRTUAL,        ///< <!--#include virtual="/path" -->, below the mount point
+    SSI_INCLUDE_FILE,           ///< <!--#include file="path" -->, below the directory of the page
+} ssi_type_t;
+
+/** @brief Position of one directive */
+typedef struct {
+    uint32_t offset;            ///< Position of "<!--#" in the file
+    uint8_t len;                ///< Length up to and including "-->"
+    uint8_t type;               ///< ssi_type_t
+    uint8_t arg;                ///< Offset of the NUL-terminated argument in args
+} ssi_directive_t;
+
+/** @brief Directives of one file */
+typedef struct {
+    char path[SSI_PATH_MAX];    ///< Full path, empty for a free entry
+    off_t size;                 ///< File size when scanned
+    time_t mtime;               ///< Modification time when scanned
+    uint32_t upload_gen;        ///< wifi_upload_generation() when scanned
+    uint32_t card_gen;          ///< card_generation when scanned
+    uint32_t last_used;         ///< use_counter at the last use, for eviction
+    uint8_t busy;               ///< Pages being sent with this entry
+    uint8_t count;              ///< Directives in directives
+    uint8_t args_len;           ///< Bytes used in args
+    ssi_directive_t directives[CONFIG_WIFI_SSI_MAX_DIRECTIVES];
+    char args[SSI_ARGS_SIZE];
+} ssi_entry_t;
+
+/** @brief Registered variable */
+typedef struct {
+    char name[WIFI_SSI_NAME_MAX];
+    wifi_ssi_var_fn_t fn;
+    void *ctx;
+} ssi_var_t;
+
+/** @brief State of one response */
+typedef struct {
+    httpd_req_t *req;
+    const char *root;
+    char *buf;
+    size_t buf_size;
+} ssi_send_t;
+
+static ssi_entry_t ssi_cache[CONFIG_WIFI_SSI_CACHE_ENTRIES];
+static uint32_t use_counter;
+static wifi_ssi_stats_t ssi_stats;
+
+/** @brief Incremented when the card changes, entries of an older generation are stale */
+static volatile uint32_t card_generation;
+
+static ssi_var_t ssi_vars[CONFIG_WIFI_SSI_MAX_VARS];
+
+/** @brief Protects ssi_vars, registration can happen from any task */
+static portMUX_TYPE ssi_vars_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static bool is_name_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '_' || c == '-' || c == '.';
+}
+
+esp_err_t wifi_ssi_register_var(const char *name, wifi_ssi_var_fn_t fn, void *ctx) {
+    size_t len = name ? strlen(name) : 0;
+    if (fn == NULL || len == 0 || len >= WIFI_SSI_NAME_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (!is_name_char(name[i])) return ESP_ERR_INVALID_ARG;
+    }
+
+    ssi_var_t *slot = NULL;
+    taskENTER_CRITICAL(&ssi_vars_lock);
+    for (int i = 0; i < CONFIG_WIFI_SSI_MAX_VARS; i++) {
+        if (ssi_vars[i].fn != NULL && strcmp(ssi_vars[i].name, name) == 0) {
+            slot = &ssi_vars[i];
+            break;
+        }
+        if (ssi_vars[i].fn == NULL && slot == NULL) {
+            slot = &ssi_vars[i];
+        }
+    }
+    if (slot != NULL) {
+        strlcpy(slot->name, name, sizeof(slot->name));
+        slot->fn = fn;
+        slot->ctx = ctx;
+    }
+    taskEXIT_CRITICAL(&ssi_vars_lock);
+
+    if (slot == NULL) {
+        ESP_LOGE(TAG_SSI, "No room for variable %s, increase CONFIG_WIFI_SSI_MAX_VARS", name);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+void wifi_ssi_get_stats(wifi_ssi_stats_t *stats) {
+    *stats = ssi_stats;
+}
+
+void wifi_ssi_card_changed(void) {
+    card_generation++;
+}
+
+bool wifi_ssi_is_template(const char *path) {
+    const char *dot = strrchr(path, '.');
+    return dot != NULL && (strcasecmp(dot, ".html") == 0 || strcasecmp(dot, ".htm") == 0);
+}
+
+#pragma region Scanning
+
+/**
+ * @brief Skip a word and the blanks after it.
+ *
+ * @return true if the text at *s starts with word
+ */
+static bool take(const char **s, const char *end, const char *word) {
+    size_t len = strlen(word);
+    if ((size_t)(end - *s) < len || memcmp(*s, word, len) != 0) return false;
+    *s += len;
+    while (*s < end && (**s == ' ' || **s == '\t')) (*s)++;
+    return true;
+}
+
+/**
+ * @brief Check for a directive and add it to the entry.
+ *
+ * @param p Text starting with '<'
+ * @param avail Bytes available at p
+ * @param offset File position of p
+ * @return Length of a complete "<!--#...-->" comment, 0 if p does not start one.
+ *         Comments that are not a known directive are skipped and sent unchanged.
+ */
+static size_t scan_directive(ssi_entry_t *entry, const char *p, size_t avail, uint32_t offset) {
+    size_t limit = avail < SSI_DIRECTIVE_MAX ? avail : SSI_DIRECTIVE_MAX;
+    if (limit < 5 || memcmp(p, "<!--#", 5) != 0) return 0;
+    size_t close = 5;
+    while (close + 3 <= limit && memcmp(p + close, "-->", 3) != 0) close++;
+    if (close + 3 > limit) return 0;
+    size_t len = close + 3;
+
+    const char *s = p + 5;
+    const char *end = p + close;
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t')) end--;
+
+    uint8_t type;
+    const char *arg;
+    size_t arg_len = 0;
+    if (take(&s, end, "include ")) {
+        if (take(&s, end, "virtual=\"")) {
+            type = SSI_INCLUDE_VIRTUAL;
+        } else if (take(&s, end, "file=\"")) {
+            type = SSI_INCLUDE_FILE;
+        } else {
+            return len;
+        }
+        arg = s;
+        while (s < end && *s != '"') s++;
+        if (s + 1 != end) return len;  // Unterminated or followed by something else
+        arg_len = s - arg;
+    } else if (take(&s, end, "var ")) {
+        type = SSI_VAR;
+        arg = s;
+        while (s < end && is_name_char(*s)) s++;
+        if (s != end) return len;
+        arg_len = s - arg;
+    } else {
+        return len;
+    }
+    if (arg_len == 0) return len;
+
+    if (entry->count >= CONFIG_WIFI_SSI_MAX_DIRECTIVES || entry->args_len + arg_len + 1 > SSI_ARGS_SIZE) {
+        ESP_LOGW(TAG_SSI, "%s: directive at %lu sent unchanged, increase CONFIG_WIFI_SSI_MAX_DIRECTIVES",
+                 entry->path, (unsigned long)offset);
+        ssi_stats.skipped++;
+        return len;
+    }
+    ssi_directive_t *d = &entry->directives[entry->count++];
+    d->offset = offset;
+    d->len = len;
+    d->type = type;
+    d->arg = entry->args_len;
+    memcpy(entry->args + entry->args_len, arg, arg_len);
+    entry->args[entry->args_len + arg_len] = '\0';
+    entry->args_len += arg_len + 1;
+    return len;
+}
+
+/**
+ * @brief Find the directives of a file.
+ *
+ * @return true if the whole file was read
+ */
+static bool scan_file(ssi_entry_t *entry, FILE *f, char *buf, size_t buf_size) {
+    uint32_t base = 0;
+    if (fseek(f, 0, SEEK_SET) != 0) return false;
+    for (;;) {
+        size_t len = fread(buf, 1, buf_size, f);
+        if (len == 0) break;
+        bool last = len < buf_size;
+        size_t next = len;
+        size_t i = 0;
+        while (i < len) {
+            const char *lt = memchr(buf + i, '<', len - i);
+            if (lt == NULL) break;
+            size_t at = lt - buf;
+            if (!last && len - at < SSI_DIRECTIVE_MAX) {
+                next = at;      // May be cut off, read again from here
+                break;
+            }
+            size_t dlen = scan_directive(entry, lt, len - at, base + at);
+            i = dlen ? at + dlen : at + 1;
+        }
+        base += next;
+        if (last) break;
+        if (next != len && fseek(f, base, SEEK_SET) != 0) return false;
+    }
+    return !ferror(f);
+}
+
+/**
+ * @brief Get the cache entry of a file, scanning it if needed.
+ *
+ * @return Entry, NULL if every entry is in use or the file could not be read
+ */
+static ssi_entry_t *lookup(FILE *f, const char *path, const struct stat *st, char *buf, size_t buf_size) {
+    uint32_t upload_gen = wifi_upload_generation();
+    uint32_t card_gen = card_generation;
+    ssi_entry_t *victim = NULL;
+    for (int i = 0; i < CONFIG_WIFI_SSI_CACHE_ENTRIES; i++) {
+        ssi_entry_t *entry = &ssi_cache[i];
+        if (entry->path[0] != '\0' && strcmp(entry->path, path) == 0 &&
+            entry->size == st->st_size && entry->mtime == st->st_mtime &&
+            entry->upload_gen == upload_gen && entry->card_gen == card_gen) {
+            entry->last_used = ++use_counter;
+            ssi_stats.cache_hits++;
+            return entry;
+        }
+        if (entry->busy == 0 && (victim == NULL || entry->last_used < victim->last_used)) {
+            victim = entry;
+        }
+    }
+    if (victim == NULL) return NULL;
+
+    int64_t start = esp_timer_get_time();
+    memset(victim, 0, sizeof(*victim));
+    strlcpy(victim->path, path, sizeof(victim->path));
+    bool ok = scan_file(victim, f, buf, buf_size);
+    ssi_stats.cache_misses++;
+    ssi_stats.scan_us += (uint32_t)(esp_timer_get_time() - start);
+    if (!ok) {
+        ESP_LOGW(TAG_SSI, "Failed to scan %s", path);
+        victim->path[0] = '\0';
+        return NULL;
+    }
+    victim->size = st->st_size;
+    victim->mtime = st->st_mtime;
+    victim->upload_gen = upload_gen;
+    victim->card_gen = card_gen;
+    victim->last_used = ++use_counter;
+    ESP_LOGD(TAG_SSI, "Scanned %s: %d directives", path, victim->count);
+    return victim;
+}
+
+#pragma endregion
+
+#pragma region Sending
+
+/**
+ * @brief Send the file from one position to another, or to the end.
+ */
+static esp_err_t send_range(ssi_send_t *out, FILE *f, uint32_t from, uint32_t to) {
+    if (fseek(f, from, SEEK_SET) != 0) return ESP_OK;   // File shrank, nothing to send
+    while (from < to) {
+        size_t want = to - from < out->buf_size ? to - from : out->buf_size;
+        size_t n = fread(out->buf, 1, want, f);
+        if (n == 0) break;
+        if (httpd_resp_send_chunk(out->req, out->buf, n) != ESP_OK) return ESP_FAIL;
+        from += n;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Send the value of a variable, HTML-escaped.
+ */
+static esp_err_t send_var(ssi_send_t *out, const char *name) {
+    wifi_ssi_var_fn_t fn = NULL;
+    void *ctx = NULL;
+    taskENTER_CRITICAL(&ssi_vars_lock);
+    for (int i = 0; i < CONFIG_WIFI_SSI_MAX_VARS; i++) {
+        if (ssi_vars[i].fn != NULL && strcmp(ssi_vars[i].name, name) == 0) {
+            fn = ssi_vars[i].fn;
+            ctx = ssi_vars[i].ctx;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&ssi_vars_lock);
+    if (fn == NULL) {
+        ESP_LOGD(TAG_SSI, "Unknown variable %s", name);
+        return ESP_OK;
+    }
+
+    // Value in the start of the buffer, escaped text after it
+    char *value = out->buf;
+    value[0] = '\0';
+    fn(value, WIFI_SSI_VALUE_MAX, ctx);
+    value[WIFI_SSI_VALUE_MAX - 1] = '\0';
+    char *text = out->buf + WIFI_SSI_VALUE_MAX;
+    size_t text_size = out->buf_size - WIFI_SSI_VALUE_MAX;
+    size_t len = 0;
+    for (const char *p = value; *p; p++) {
+        if (len + 6 > text_size) {
+            if (httpd_resp_send_chunk(out->req, text, len) != ESP_OK) return ESP_FAIL;
+            len = 0;
+        }
+        const char *esc;
+        switch (*p) {
+        case '&': esc = "&amp;"; break;
+        case '<': esc = "&lt;"; break;
+        case '>': esc = "&gt;"; break;
+        case '"': esc = "&quot;"; break;
+        case '\'': esc = "&#39;"; break;
+        default: text[len++] = *p; continue;
+        }
+        size_t esc_len = strlen(esc);
+        memcpy(text + len, esc, esc_len);
+        len += esc_len;
+    }
+    if (len > 0 && httpd_resp_send_chunk(out->req, text, len) != ESP_OK) return ESP_FAIL;
+    return ESP_OK;
+}
+
+static esp_err_t send_file(ssi_send_t *out, FILE *f, const char *path, int depth);
+
+/**
+ * @brief Send an included file.
+ *
+ * @param parent Full path of the including file
+ */
+static esp_err_t send_include(ssi_send_t *out, const char *parent, uint8_t type, const char *arg, int depth) {
+    char path[SSI_PATH_MAX];
+    size_t prefix;
+    int n;
+    if (type == SSI_INCLUDE_VIRTUAL) {
+        prefix = strlen(out->root);
+        n = snprintf(path, sizeof(path), "%s%s", out->root, arg);
+    } else {
+        prefix = strrchr(parent, '/') - parent;
+        n = snprintf(path, sizeof(path), "%.*s/%s", (int)prefix, parent, arg);
+    }
+    // Same rules as request paths, so includes cannot leave the directory
+    if (n < 0 || (size_t)n >= sizeof(path) || !wifi_is_safe_file_path(path + prefix, n - prefix)) {
+        ESP_LOGW(TAG_SSI, "%s: invalid include \"%s\"", parent, arg);
+        return ESP_OK;
+    }
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        ESP_LOGW(TAG_SSI, "%s: included file %s not found", parent, path);
+        return ESP_OK;
+    }
+    esp_err_t err;
+    if (wifi_ssi_is_template(path)) {
+        err = send_file(out, f, path, depth);
+    } else {
+        err = send_range(out, f, 0, UINT32_MAX);
+    }
+    fclose(f);
+    return err;
+}
+
+/**
+ * @brief Send a template file with its directives expanded.
+ *
+ * @param depth Levels of includes the file is nested in
+ */
+static esp_err_t send_file(ssi_send_t *out, FILE *f, const char *path, int depth) {
+    struct stat st;
+    ssi_entry_t *entry = NULL;
+    if (depth <= WIFI_SSI_MAX_DEPTH && strlen(path) < SSI_PATH_MAX && fstat(fileno(f), &st) == 0) {
+        entry = lookup(f, path, &st, out->buf, out->buf_size);
+    }
+    if (entry == NULL) {
+        return send_range(out, f, 0, UINT32_MAX);
+    }
+
+    ssi_stats.pages++;
+    entry->busy++;
+    esp_err_t err = ESP_OK;
+    uint32_t pos = 0;
+    for (int i = 0; i < entry->count && err == ESP_OK; i++) {
+        const ssi_directive_t *d = &entry->directives[i];
+        const char *arg = entry->args + d->arg;
+        err = send_range(out, f, pos, d->offset);
+        if (err != ESP_OK) break;
+        pos = d->offset + d->len;
+        if (d->type == SSI_VAR) {
+            err = send_var(out, arg);
+        } else {
+            err = send_include(out, path, d->type, arg, depth + 1);
+        }
+    }
+    if (err == ESP_OK) {
+        err = send_range(out, f, pos, UINT32_MAX);
+    }
+    entry->busy--;
+    return err;
+}
+
+esp_err_t wifi_ssi_send(httpd_req_t *req, FILE *f, const char *path, const char *root, char *buf, size_t buf_size) {
+    ssi_send_t out = {
+        .req = req,
+        .root = root,
+        .buf = buf,
+        .buf_size = buf_size,
+    };
+    if (buf_size < SSI_MIN_BUF_SIZE) {
+        return send_range(&out, f, 0, UINT32_MAX);
+    }
+    return send_file(&out, f, path, 0);
+}
+
+#pragma endregion
+
+#endif // CONFIG_WIFI_SSI
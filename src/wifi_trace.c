@@ -0,0 +1,157 @@
+/**
+ * @file wifi_trace.c
+ * @brief WiFi event trace recorder.
+ *
+ * Records are written into a static ring buffer under a spinlock, so recording
+ * is a 16-byte copy and safe from the event loop and the listener task alike.
+ * The HTTP dump copies a few records at a time under the lock and sends them
+ * with the lock released.
+ */
+
+#include "sdkconfig.h"
+
+#ifdef CONFIG_WIFI_EVENT_TRACE
+
+#include "wifi_trace.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+
+#include <string.h>
+
+/** @brief Log tag for trace messages */
+static const char *TAG_TRACE = "Wifi-Trace";
+
+/** @brief Number of records copied per HTTP chunk */
+#define TRACE_CHUNK_RECORDS 8
+
+/** @brief Ring buffer of records */
+static wifi_trace_record_t trace_ring[CONFIG_WIFI_EVENT_TRACE_ENTRIES];
+
+/** @brief Total number of records ever written, the next one goes to trace_written % entries */
+static uint32_t trace_written = 0;
+
+/** @brief Spinlock guarding the ring buffer */
+static portMUX_TYPE trace_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Append a record to the ring, overwriting the oldest one when full.
+ */
+static void trace_put(const wifi_trace_record_t *rec) {
+    taskENTER_CRITICAL(&trace_lock);
+    trace_ring[trace_written % CONFIG_WIFI_EVENT_TRACE_ENTRIES] = *rec;
+    trace_written++;
+    taskEXIT_CRITICAL(&trace_lock);
+}
+
+/**
+ * @brief Fill in the common header fields of a record.
+ */
+static void trace_init_record(wifi_trace_record_t *rec, uint8_t source, uint8_t id, uint32_t bits, int sta_fails) {
+    memset(rec, 0, sizeof(*rec));
+    rec->time_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    rec->source = source;
+    rec->id = id;
+    rec->bits = (uint16_t)bits;
+    rec->sta_fails = sta_fails > 255 ? 255 : (uint8_t)sta_fails;
+}
+
+void wifi_trace_event(esp_event_base_t event_base, int32_t event_id, const void *event_data, uint32_t bits, int sta_fails) {
+    wifi_trace_record_t rec;
+    if (event_base == WIFI_EVENT) {
+        trace_init_record(&rec, WIFI_TRACE_SOURCE_WIFI, (uint8_t)event_id, bits, sta_fails);
+        if (event_data == NULL) {
+            // No payload
+        } else if (event_id == WIFI_EVENT_STA_DISCONNECTED) {
+            const wifi_event_sta_disconnected_t *e = event_data;
+            uint16_t reason = e->reason;
+            memcpy(&rec.payload[0], &reason, sizeof(reason));
+            rec.payload[2] = (uint8_t)e->rssi;
+        } else if (event_id == WIFI_EVENT_STA_CONNECTED) {
+            const wifi_event_sta_connected_t *e = event_data;
+            rec.payload[0] = e->channel;
+            rec.payload[1] = (uint8_t)e->authmode;
+        } else if (event_id == WIFI_EVENT_AP_STACONNECTED) {
+            const wifi_event_ap_staconnected_t *e = event_data;
+            memcpy(&rec.payload[0], e->mac, 6);
+            rec.payload[6] = (uint8_t)e->aid;
+        } else if (event_id == WIFI_EVENT_AP_STADISCONNECTED) {
+            const wifi_event_ap_stadisconnected_t *e = event_data;
+            uint16_t reason = e->reason;
+            memcpy(&rec.payload[0], e->mac, 6);
+            memcpy(&rec.payload[6], &reason, sizeof(reason));
+        }
+    } else if (event_base == IP_EVENT) {
+        trace_init_record(&rec, WIFI_TRACE_SOURCE_IP, (uint8_t)event_id, bits, sta_fails);
+        if (event_data == NULL) {
+            // No payload
+        } else if (event_id == IP_EVENT_STA_GOT_IP) {
+            const ip_event_got_ip_t *e = event_data;
+            memcpy(&rec.payload[0], &e->ip_info.ip.addr, 4);
+        } else if (event_id == IP_EVENT_AP_STAIPASSIGNED) {
+            const ip_event_ap_staipassigned_t *e = event_data;
+            memcpy(&rec.payload[0], &e->ip.addr, 4);
+        }
+    } else {
+        return;
+    }
+    trace_put(&rec);
+}
+
+void wifi_trace_action(wifi_trace_action_t action, uint8_t arg, uint32_t bits, int sta_fails) {
+    wifi_trace_record_t rec;
+    trace_init_record(&rec, WIFI_TRACE_SOURCE_ACTION, (uint8_t)action, bits, sta_fails);
+    rec.payload[0] = arg;
+    // Heap state in kB, to follow leaks and fragmentation across mode switches
+    uint16_t heap_kb[3] = {
+        (uint16_t)(heap_caps_get_free_size(MALLOC_CAP_DEFAULT) / 1024),
+        (uint16_t)(heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT) / 1024),
+        (uint16_t)(heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT) / 1024),
+    };
+    memcpy(&rec.payload[2], heap_kb, sizeof(heap_kb));
+    trace_put(&rec);
+}
+
+esp_err_t wifi_trace_http_handler(httpd_req_t *req) {
+    taskENTER_CRITICAL(&trace_lock);
+    uint32_t end = trace_written;
+    taskEXIT_CRITICAL(&trace_lock);
+    uint32_t start = end > CONFIG_WIFI_EVENT_TRACE_ENTRIES ? end - CONFIG_WIFI_EVENT_TRACE_ENTRIES : 0;
+
+    uint8_t header[16] = { 'W', 'T', 'R', 'C', WIFI_TRACE_VERSION, sizeof(wifi_trace_record_t) };
+    uint16_t count = (uint16_t)(end - start);
+    uint32_t lost = start;
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    memcpy(&header[6], &count, sizeof(count));
+    memcpy(&header[8], &lost, sizeof(lost));
+    memcpy(&header[12], &now_ms, sizeof(now_ms));
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    if (httpd_resp_send_chunk(req, (const char *)header, sizeof(header)) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    wifi_trace_record_t chunk[TRACE_CHUNK_RECORDS];
+    for (uint32_t i = start; i < end; ) {
+        size_t n = 0;
+        taskENTER_CRITICAL(&trace_lock);
+        // Records overwritten since the dump started are repeated as the newest ones, skip them
+        uint32_t oldest = trace_written > CONFIG_WIFI_EVENT_TRACE_ENTRIES ? trace_written - CONFIG_WIFI_EVENT_TRACE_ENTRIES : 0;
+        for (; i < end && n < TRACE_CHUNK_RECORDS; i++) {
+            if (i < oldest) continue;
+            chunk[n++] = trace_ring[i % CONFIG_WIFI_EVENT_TRACE_ENTRIES];
+        }
+        taskEXIT_CRITICAL(&trace_lock);
+        if (n > 0 && httpd_resp_send_chunk(req, (const char *)chunk, n * sizeof(wifi_trace_record_t)) != ESP_OK) {
+            ESP_LOGW(TAG_TRACE, "Failed to send trace dump");
+            return ESP_FAIL;
+        }
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+#endif // CONFIG_WIFI_EVENT_TRACE
@@ -0,0 +1,132 @@
+/**
+ * @file wifi_trace.h
+ * @brief WiFi event trace recorder (private).
+ *
+ * Keeps the last CONFIG_WIFI_EVENT_TRACE_ENTRIES events seen by
+ * wifi_event_handler and the mode switches done by the listener task in a ring
+ * buffer of fixed-size binary records. The buffer is served at
+ * GET /wifi-trace.bin and decoded / replayed on a host with tools/wifi_trace.py.
+ *
+ * Dump layout (all multi-byte fields little-endian):
+ *
+ * | Offset | Size | Field                                          |
+ * |--------|------|------------------------------------------------|
+ * | 0      | 4    | Magic "WTRC"                                   |
+ * | 4      | 1    | Format version, WIFI_TRACE_VERSION             |
+ * | 5      | 1    | Record size in bytes                           |
+ * | 6      | 2    | Number of records (fewer follow if overwritten |
+ * |        |      | while the dump was being sent)                 |
+ * | 8      | 4    | Records lost because the ring wrapped          |
+ * | 12     | 4    | Uptime at dump time (ms)                       |
+ * | 16     | ...  | Records, oldest first                          |
+ *
+ * Record layout (wifi_trace_record_t, 18 bytes):
+ *
+ * | Offset | Size | Field                                          |
+ * |--------|------|------------------------------------------------|
+ * | 0      | 4    | Uptime (ms)                                    |
+ * | 4      | 1    | Source, wifi_trace_source_t                    |
+ * | 5      | 1    | Event ID (or wifi_trace_action_t for actions)  |
+ * | 6      | 2    | Event group bits when the event was recorded   |
+ * | 8      | 1    | Consecutive STA failures at that time          |
+ * | 9      | 1    | Reserved, 0                                    |
+ * | 10     | 8    | Event-specific payload, see wifi_trace_record  |
+ *
+ * Version 1 dumps had 16-byte records with only the low 8 event group bits.
+ */
+
+#ifndef WIFI_TRACE_H
+#define WIFI_TRACE_H
+
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_event.h"
+#include "esp_http_server.h"
+
+#define WIFI_TRACE_VERSION 2    ///< Current dump format version
+
+/**
+ * @brief Origin of a trace record.
+ */
+typedef enum {
+    WIFI_TRACE_SOURCE_WIFI = 0,     ///< WIFI_EVENT, id is a wifi_event_t
+    WIFI_TRACE_SOURCE_IP = 1,       ///< IP_EVENT, id is an ip_event_t
+    WIFI_TRACE_SOURCE_ACTION = 2,   ///< Listener task action, id is a wifi_trace_action_t
+} wifi_trace_source_t;
+
+/**
+ * @brief Actions taken by the mode-switch listener task.
+ */
+typedef enum {
+    WIFI_TRACE_ACTION_BOOT = 0,         ///< wifi_init() called, payload byte 0 is the saved wifi_mode
+    WIFI_TRACE_ACTION_SWITCH_STA = 1,   ///< Switching to STA mode
+    WIFI_TRACE_ACTION_SWITCH_AP = 2,    ///< Switching to AP mode
+    WIFI_TRACE_ACTION_SWITCH_CAPTIVE = 3, ///< Switching to captive portal AP mode
+    WIFI_TRACE_ACTION_RECONNECT = 4,    ///< Reconnecting with new STA settings
+    WIFI_TRACE_ACTION_MDNS_UPDATE = 5,  ///< Restarting mDNS with new settings
+    WIFI_TRACE_ACTION_RESTART = 6,      ///< Scheduled device restart, payload byte 0 is 1 when draining requests
+    WIFI_TRACE_ACTION_NETIF_UPDATE = 7, ///< New static IP address set without reassociating
+    WIFI_TRACE_ACTION_DHCP_UPDATE = 8,  ///< Switched between DHCP and static IP, payload byte 0 is 1 for static
+} wifi_trace_action_t;
+
+/**
+ * @brief One trace record.
+ */
+typedef struct __attribute__((packed)) {
+    uint32_t time_ms;       ///< Uptime when the event was recorded
+    uint8_t source;         ///< wifi_trace_source_t
+    uint8_t id;             ///< Event ID or wifi_trace_action_t
+    uint16_t bits;          ///< Event group bits (CONNECTED, SWITCH_TO_*, ...) at record time
+    uint8_t sta_fails;      ///< Consecutive STA connection failures at record time
+    uint8_t reserved;       ///< Always 0
+    uint8_t payload[8];     ///< STA_DISCONNECTED: reason (u16), rssi (i8);
+                            ///< STA_CONNECTED: channel, authmode;
+                            ///< AP_STACONNECTED: MAC (6), AID;
+                            ///< AP_STADISCONNECTED: MAC (6), reason (u16);
+                            ///< STA_GOT_IP / AP_STAIPASSIGNED: IPv4 address (4);
+                            ///< actions: argument, unused, free / minimum free / largest free heap block in kB (3 x u16)
+} wifi_trace_record_t;
+
+_Static_assert(sizeof(wifi_trace_record_t) == 18, "wifi_trace_record_t must match the documented record layout");
+
+#ifdef CONFIG_WIFI_EVENT_TRACE
+
+/**
+ * @brief Record an event delivered to wifi_event_handler.
+ *
+ * @param event_base WIFI_EVENT or IP_EVENT
+ * @param event_id Event ID
+ * @param event_data Event payload, may be NULL
+ * @param bits Event group bits at the time of the event
+ * @param sta_fails Consecutive STA failures at the time of the event
+ */
+void wifi_trace_event(esp_event_base_t event_base, int32_t event_id, const void *event_data, uint32_t bits, int sta_fails);
+
+/**
+ * @brief Record an action of the mode-switch listener task.
+ *
+ * @param action Action taken
+ * @param arg Action argument stored in payload byte 0
+ * @param bits Event group bits at the time of the action
+ * @param sta_fails Consecutive STA failures at the time of the action
+ */
+void wifi_trace_action(wifi_trace_action_t action, uint8_t arg, uint32_t bits, int sta_fails);
+
+/**
+ * @brief HTTP GET handler streaming the trace buffer as application/octet-stream.
+ *
+ * @param req HTTP request handle
+ * @return ESP_OK on success
+ */
+esp_err_t wifi_trace_http_handler(httpd_req_t *req);
+
+#else
+
+static inline void wifi_trace_event(esp_event_base_t event_base, int32_t event_id, const void *event_data, uint32_t bits, int sta_fails) {}
+static inline void wifi_trace_action(wifi_trace_action_t action, uint8_t arg, uint32_t bits, int sta_fails) {}
+
+#endif // CONFIG_WIFI_EVENT_TRACE
+
+#endif
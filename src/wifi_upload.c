@@ -0,0 +1,337 @@
+/**
+ * @file wifi_upload.c
+ * @brief Streaming file upload to the SD card.
+ *
+ * The httpd task receives into buffer A while the writer task writes buffer
+ * B, then they swap. Only one write is ever outstanding, so the handler waits
+ * for it before refilling the buffer it used.
+ */
+
+#include "sdkconfig.h"
+
+#ifdef CONFIG_WIFI_UPLOAD
+
+#include "wifi_upload.h"
+#include "wifi_util.h"
+#include "wifi_arena.h"
+#include "Wifi.h"
+
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_vfs_fat.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** @brief Log tag for upload messages */
+static const char *TAG_UPLOAD = "Wifi-Upload";
+
+/** @brief Suffix of the temporary file next to the target */
+#define UPLOAD_TMP_SUFFIX ".upl"
+
+/** @brief Size of the path buffers: mount point, longest URI and the temporary suffix */
+#define UPLOAD_PATH_SIZE (16 + CONFIG_HTTPD_MAX_URI_LEN + sizeof(UPLOAD_TMP_SUFFIX))
+
+/** @brief Receive timeouts in a row before the upload is abandoned */
+#define UPLOAD_MAX_TIMEOUTS 3
+
+/** @brief Writer task stack size */
+#define UPLOAD_WRITER_STACK_SIZE 3072
+
+/**
+ * @brief One buffer handed to the writer task.
+ */
+typedef struct {
+    int fd;
+    const uint8_t *data;
+    size_t len;
+} upload_chunk_t;
+
+/** @brief Chunks for the writer task */
+static QueueHandle_t upload_write_queue = NULL;
+
+/** @brief Write results from the writer task, true on success */
+static QueueHandle_t upload_done_queue = NULL;
+
+#ifdef CONFIG_WIFI_STATIC_ALLOCATION
+/** @brief Storage of the write queue, see CONFIG_WIFI_STATIC_ALLOCATION */
+static StaticQueue_t upload_write_queue_storage;
+
+/** @brief Item of the write queue */
+static uint8_t upload_write_queue_items[sizeof(upload_chunk_t)];
+
+/** @brief Storage of the result queue */
+static StaticQueue_t upload_done_queue_storage;
+
+/** @brief Item of the result queue */
+static uint8_t upload_done_queue_items[sizeof(bool)];
+
+/** @brief Control block of the writer task */
+static StaticTask_t upload_writer_tcb;
+
+/** @brief Stack of the writer task */
+static StackType_t upload_writer_stack[UPLOAD_WRITER_STACK_SIZE];
+
+/** @brief Receive buffers; uploads run one at a time in the httpd task */
+static DMA_ATTR uint8_t upload_buffers[2 * CONFIG_WIFI_UPLOAD_BUFFER_SIZE];
+#endif
+
+/** @brief Content generation, see wifi_upload_generation() */
+static volatile uint32_t upload_generation = 0;
+
+/**
+ * @brief Write chunks until the handler stops sending them.
+ */
+static void upload_writer_task(void *arg) {
+    upload_chunk_t chunk;
+    while (1) {
+        xQueueReceive(upload_write_queue, &chunk, portMAX_DELAY);
+        bool ok = true;
+        size_t off = 0;
+        while (off < chunk.len) {
+            ssize_t written = write(chunk.fd, chunk.data + off, chunk.len - off);
+            if (written <= 0) {
+                ESP_LOGE(TAG_UPLOAD, "Write failed: %s", strerror(errno));
+                ok = false;
+                break;
+            }
+            off += written;
+        }
+        xQueueSend(upload_done_queue, &ok, portMAX_DELAY);
+    }
+}
+
+/**
+ * @brief Create the writer task and its queues on first use.
+ */
+static esp_err_t upload_start_writer(void) {
+    if (upload_write_queue != NULL) return ESP_OK;
+
+    int core, priority;
+    wifi_get_task_placement(WIFI_TASK_WORKER, &core, &priority);
+#ifdef CONFIG_WIFI_STATIC_ALLOCATION
+    upload_write_queue = xQueueCreateStatic(1, sizeof(upload_chunk_t), upload_write_queue_items,
+                                            &upload_write_queue_storage);
+    upload_done_queue = xQueueCreateStatic(1, sizeof(bool), upload_done_queue_items, &upload_done_queue_storage);
+    xTaskCreateStaticPinnedToCore(upload_writer_task, "wifi_upload", UPLOAD_WRITER_STACK_SIZE, NULL, priority,
+                                  upload_writer_stack, &upload_writer_tcb,
+                                  (core < 0 || core >= portNUM_PROCESSORS) ? tskNO_AFFINITY : core);
+    return ESP_OK;
+#else
+    upload_write_queue = xQueueCreate(1, sizeof(upload_chunk_t));
+    upload_done_queue = xQueueCreate(1, sizeof(bool));
+    if (upload_write_queue == NULL || upload_done_queue == NULL) goto fail;
+
+    if (xTaskCreatePinnedToCore(upload_writer_task, "wifi_upload", UPLOAD_WRITER_STACK_SIZE, NULL, priority, NULL,
+                                (core < 0 || core >= portNUM_PROCESSORS) ? tskNO_AFFINITY : core) == pdPASS) {
+        return ESP_OK;
+    }
+
+fail:
+    if (upload_write_queue) vQueueDelete(upload_write_queue);
+    if (upload_done_queue) vQueueDelete(upload_done_queue);
+    upload_write_queue = upload_done_queue = NULL;
+    return ESP_ERR_NO_MEM;
+#endif
+}
+
+/**
+ * @brief Release the receive buffers of an upload.
+ */
+static void upload_free_buffers(uint8_t *buffers) {
+#ifndef CONFIG_WIFI_STATIC_ALLOCATION
+    free(buffers);
+#endif
+}
+
+/**
+ * @brief Compare the Authorization header with the configured token in constant time.
+ */
+static bool upload_authorized(httpd_req_t *req) {
+    static const char expected[] = "Bearer " CONFIG_WIFI_UPLOAD_TOKEN;
+    char auth[sizeof(expected) + 1];
+    if (httpd_req_get_hdr_value_str(req, "Authorization", auth, sizeof(auth)) != ESP_OK) return false;
+    return wifi_secret_equal(auth, expected);
+}
+
+/**
+ * @brief Create the parent directories of a path below the mount point.
+ */
+static void upload_make_dirs(char *path, size_t mount_len) {
+    for (char *p = path + mount_len + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(path, 0775) != 0 && errno != EEXIST) {
+            ESP_LOGW(TAG_UPLOAD, "Failed to create %s: %s", path, strerror(errno));
+        }
+        *p = '/';
+    }
+}
+
+/**
+ * @brief Send an error status with a short plain-text message.
+ */
+static esp_err_t upload_error(httpd_req_t *req, const char *status, const char *msg) {
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "text/plain");
+    return httpd_resp_send(req, msg, HTTPD_RESP_USE_STRLEN);
+}
+
+uint32_t wifi_upload_generation(void) {
+    return upload_generation;
+}
+
+esp_err_t wifi_upload_handler(httpd_req_t *req) {
+    const wifi_upload_ctx_t *ctx = req->user_ctx;
+
+    if (!upload_authorized(req)) {
+        ESP_LOGW(TAG_UPLOAD, "Unauthorized upload to %s", req->uri);
+        httpd_resp_set_hdr(req, "WWW-Authenticate", "Bearer");
+        return upload_error(req, "401 Unauthorized", "Unauthorized");
+    }
+
+    if (!*ctx->card_present) {
+        return upload_error(req, "503 Service Unavailable", "No SD card");
+    }
+
+    const char *path = req->uri + strlen(WIFI_UPLOAD_URI_PREFIX);
+    size_t path_len = strcspn(path, "?#");
+    if (!wifi_is_safe_file_path(path, path_len)) {
+        return upload_error(req, "400 Bad Request", "Invalid path");
+    }
+
+    uint64_t total_bytes = 0, free_bytes = 0;
+    if (esp_vfs_fat_info(ctx->mount_point, &total_bytes, &free_bytes) == ESP_OK && req->content_len > free_bytes) {
+        return upload_error(req, "507 Insufficient Storage", "Not enough space on SD card");
+    }
+
+    char *target = wifi_arena_alloc(req, UPLOAD_PATH_SIZE);
+    char *tmp = wifi_arena_alloc(req, UPLOAD_PATH_SIZE);
+    if (target == NULL || tmp == NULL) {
+        return httpd_resp_send_500(req);
+    }
+    size_t mount_len = strlen(ctx->mount_point);
+    snprintf(target, UPLOAD_PATH_SIZE, "%s%.*s", ctx->mount_point, (int)path_len, path);
+    snprintf(tmp, UPLOAD_PATH_SIZE, "%s" UPLOAD_TMP_SUFFIX, target);
+
+    if (upload_start_writer() != ESP_OK) {
+        ESP_LOGE(TAG_UPLOAD, "Failed to start upload writer");
+        return httpd_resp_send_500(req);
+    }
+#ifdef CONFIG_WIFI_STATIC_ALLOCATION
+    uint8_t *buffers = upload_buffers;
+#else
+    uint8_t *buffers = heap_caps_malloc(2 * CONFIG_WIFI_UPLOAD_BUFFER_SIZE, MALLOC_CAP_DMA);
+#endif
+    if (buffers == NULL) {
+        ESP_LOGE(TAG_UPLOAD, "No memory for upload buffers");
+        return upload_error(req, "503 Service Unavailable", "Out of memory");
+    }
+
+    upload_make_dirs(target, mount_len);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+    if (fd < 0) {
+        ESP_LOGE(TAG_UPLOAD, "Failed to create %s: %s", tmp, strerror(errno));
+        upload_free_buffers(buffers);
+        return httpd_resp_send_500(req);
+    }
+
+    ESP_LOGI(TAG_UPLOAD, "Receiving %s (%u bytes)", target, (unsigned)req->content_len);
+    int64_t start = esp_timer_get_time();
+    size_t remaining = req->content_len;
+    int current = 0;
+    bool pending = false;
+    bool ok = true;
+    bool receive_failed = false;
+
+    while (remaining > 0) {
+        // Fill the current buffer completely, so every write but the last is a whole number of sectors
+        uint8_t *buf = buffers + current * CONFIG_WIFI_UPLOAD_BUFFER_SIZE;
+        size_t want = remaining < CONFIG_WIFI_UPLOAD_BUFFER_SIZE ? remaining : CONFIG_WIFI_UPLOAD_BUFFER_SIZE;
+        size_t len = 0;
+        int timeouts = 0;
+        while (len < want) {
+            int ret = httpd_req_recv(req, (char *)buf + len, want - len);
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < UPLOAD_MAX_TIMEOUTS) continue;
+            if (ret <= 0) {
+                receive_failed = true;
+                break;
+            }
+            timeouts = 0;
+            len += ret;
+        }
+        if (receive_failed) break;
+        remaining -= len;
+
+        // Wait for the other buffer before handing this one over
+        if (pending) {
+            xQueueReceive(upload_done_queue, &ok, portMAX_DELAY);
+            pending = false;
+            if (!ok) break;
+        }
+        upload_chunk_t chunk = { .fd = fd, .data = buf, .len = len };
+        xQueueSend(upload_write_queue, &chunk, portMAX_DELAY);
+        pending = true;
+        current ^= 1;
+    }
+    if (pending) {
+        bool last_ok;
+        xQueueReceive(upload_done_queue, &last_ok, portMAX_DELAY);
+        ok = ok && last_ok;
+    }
+    upload_free_buffers(buffers);
+
+    if (ok && !receive_failed && fsync(fd) != 0) {
+        ok = false;
+    }
+    if (close(fd) != 0) {
+        ok = false;
+    }
+    if (!ok || receive_failed) {
+        unlink(tmp);
+        ESP_LOGE(TAG_UPLOAD, "Upload of %s failed after %u bytes", target, (unsigned)(req->content_len - remaining));
+        if (receive_failed) {
+            // The connection is most likely gone, close it instead of answering
+            return ESP_FAIL;
+        }
+        return upload_error(req, "500 Internal Server Error", "Write to SD card failed");
+    }
+
+    // FAT cannot rename over an existing file; the target is missing only between these two calls
+    if (unlink(target) != 0 && errno != ENOENT) {
+        ESP_LOGW(TAG_UPLOAD, "Failed to remove old %s: %s", target, strerror(errno));
+    }
+    if (rename(tmp, target) != 0) {
+        ESP_LOGE(TAG_UPLOAD, "Failed to rename %s: %s", tmp, strerror(errno));
+        unlink(tmp);
+        return httpd_resp_send_500(req);
+    }
+    upload_generation++;
+
+    int64_t elapsed_us = esp_timer_get_time() - start;
+    if (elapsed_us < 1) elapsed_us = 1;
+    unsigned long kbps = (unsigned long)((uint64_t)req->content_len * 1000000 / 1024 / elapsed_us);
+    ESP_LOGI(TAG_UPLOAD, "Stored %s: %u bytes in %" PRId64 " ms, %lu kB/s (SPI %d kHz, %d B buffers)", target,
+             (unsigned)req->content_len, elapsed_us / 1000, kbps, ctx->spi_freq_khz, CONFIG_WIFI_UPLOAD_BUFFER_SIZE);
+
+    char json[128];
+    snprintf(json, sizeof(json),
+             "{\"bytes\": %u, \"ms\": %" PRId64 ", \"kBps\": %lu, \"spiKHz\": %d, \"generation\": %lu}",
+             (unsigned)req->content_len, elapsed_us / 1000, kbps, ctx->spi_freq_khz, (unsigned long)upload_generation);
+    httpd_resp_set_status(req, "201 Created");
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, strlen(json));
+}
+
+#endif // CONFIG_WIFI_UPLOAD
@@ -0,0 +1,61 @@
+/**
+ * @file wifi_upload.h
+ * @brief Streaming file upload to the SD card (private).
+ *
+ * PUT /upload/<path> with "Authorization: Bearer <CONFIG_WIFI_UPLOAD_TOKEN>"
+ * stores the request body as <mount point>/<path>. The body is received into
+ * one of two DMA-capable buffers while a writer task writes the other one to
+ * a temporary file, so network receive and FAT writes overlap. Buffers are
+ * written whole, which keeps writes sector-aligned. When the body is
+ * complete the temporary file replaces the target and the content
+ * generation counter is incremented.
+ */
+
+#ifndef WIFI_UPLOAD_H
+#define WIFI_UPLOAD_H
+
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#define WIFI_UPLOAD_URI_PREFIX "/upload"    ///< Upload route prefix, the rest of the URI is the file path
+
+/**
+ * @brief Context passed as user_ctx of the upload handler.
+ */
+typedef struct {
+    const char *mount_point;    ///< SD card mount point, e.g. "/sdcard"
+    int spi_freq_khz;           ///< SD card SPI clock, reported with the upload throughput
+    const volatile bool *card_present;  ///< True while the card is mounted
+} wifi_upload_ctx_t;
+
+#ifdef CONFIG_WIFI_UPLOAD
+
+/**
+ * @brief HTTP PUT handler for WIFI_UPLOAD_URI_PREFIX followed by the file path.
+ *
+ * @param req HTTP request handle, user_ctx is a wifi_upload_ctx_t
+ * @return ESP_OK when a response was sent
+ */
+esp_err_t wifi_upload_handler(httpd_req_t *req);
+
+/**
+ * @brief Get the content generation counter.
+ *
+ * Incremented after every file replaced on the SD card. Anything caching SD
+ * card paths or contents compares it with the value seen when filling the
+ * cache.
+ *
+ * @return Current generation
+ */
+uint32_t wifi_upload_generation(void);
+
+#else
+
+static inline uint32_t wifi_upload_generation(void) { return 0; }
+
+#endif // CONFIG_WIFI_UPLOAD
+
+#endif
@@ -0,0 +1,258 @@
+/**
+ * @file wifi_util.c
+ * @brief Hardware-independent helpers of the WiFi component.
+ * 
+ * Parsing and formatting kernels used by the HTTP handlers. This file must
+ * only depend on the C standard library so it can be built on a host.
+ */
+
+#include "wifi_util.h"
+
+#include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief Value of a hexadecimal digit, -1 if the character is not one.
+ */
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+/**
+ * @brief Decode a URL-encoded string in place.
+ * 
+ * @param str The URL-encoded string to decode.
+ * 
+ * This function modifies the input string directly to decode it. A '%' that
+ * is not followed by two hexadecimal digits is kept as is.
+ */
+void url_decode(char *str) {
+    char *src = str, *dst = str;
+    while (*src) {
+        if (*src == '+') {
+            *dst++ = ' ';
+            src++;
+        } else if (*src == '%' && hex_value(src[1]) >= 0 && hex_value(src[2]) >= 0) {
+            *dst++ = (char)((hex_value(src[1]) << 4) | hex_value(src[2]));
+            src += 3;
+        } else {
+            *dst++ = *src++;
+        }
+    }
+    *dst = '\0';
+}
+
+/**
+ * @brief Extension to Content-Type mapping, extensions without the leading dot.
+ *
+ * The order is the one the lookup used to test the extensions in, see
+ * wifi_mime_type_for_path().
+ */
+static const struct {
+    const char *ext;
+    uint8_t len;
+    const char *type;
+} mime_types[] = {
+    { "html",  4, "text/html" },
+    { "htm",   3, "text/html" },
+    { "css",   3, "text/css" },
+    { "js",    2, "application/javascript" },
+    { "json",  4, "application/json" },
+    { "png",   3, "image/png" },
+    { "jpg",   3, "image/jpeg" },
+    { "jpeg",  4, "image/jpeg" },
+    { "gif",   3, "image/gif" },
+    { "svg",   3, "image/svg+xml" },
+    { "ico",   3, "image/x-icon" },
+    { "woff",  4, "font/woff" },
+    { "woff2", 5, "font/woff2" },
+    { "ttf",   3, "font/ttf" },
+    { "otf",   3, "font/otf" },
+    { "eot",   3, "application/vnd.ms-fontobject" },
+    { "mp4",   3, "video/mp4" },
+    { "webm",  4, "video/webm" },
+    { "txt",   3, "text/plain" },
+};
+
+/**
+ * @brief Get the Content-Type for a file path based on its extension.
+ * 
+ * Gives the same result as testing strstr(path, ".html"), strstr(path, ".htm"),
+ * ... in table order: the first entry that follows any dot of the path wins.
+ * Only the dots are visited, instead of scanning the whole path per entry.
+ */
+const char *wifi_mime_type_for_path(const char *path) {
+    const size_t count = sizeof(mime_types) / sizeof(mime_types[0]);
+    size_t best = count;
+    for (const char *dot = strchr(path, '.'); dot != NULL && best > 0; dot = strchr(dot + 1, '.')) {
+        for (size_t i = 0; i < best; i++) {
+            if (strncmp(dot + 1, mime_types[i].ext, mime_types[i].len) == 0) {
+                best = i;
+                break;
+            }
+        }
+    }
+    return best < count ? mime_types[best].type : "application/octet-stream";
+}
+
+/**
+ * @brief Check whether the parameters of an Accept-Encoding element, up to end, set q=0.
+ */
+static bool encoding_refused(const char *params, const char *end) {
+    for (const char *p = params; p < end; p++) {
+        if (*p != ';') continue;
+        for (p++; p < end && (*p == ' ' || *p == '\t'); p++) {}
+        if (end - p < 2 || (*p != 'q' && *p != 'Q') || p[1] != '=') continue;
+        p += 2;
+        if (p == end || *p != '0') return false;
+        for (p++; p < end && (*p == '.' || *p == '0'); p++) {}
+        return p == end || *p == ' ' || *p == '\t' || *p == ';';
+    }
+    return false;
+}
+
+bool wifi_accepts_encoding(const char *accept_encoding, const char *coding) {
+    if (accept_encoding == NULL) return false;
+    size_t coding_len = strlen(coding);
+    bool wildcard = false;
+    const char *p = accept_encoding;
+    while (*p != '\0') {
+        const char *end = p + strcspn(p, ",");
+        for (; p < end && (*p == ' ' || *p == '\t'); p++) {}
+        size_t len = strcspn(p, " \t;,");
+        bool refused = encoding_refused(p + len, end);
+        if (len == coding_len) {
+            size_t i = 0;
+            while (i < len && tolower((unsigned char)p[i]) == tolower((unsigned char)coding[i])) i++;
+            if (i == len) return !refused;
+        }
+        if (len == 1 && *p == '*') wildcard = !refused;
+        p = *end == ',' ? end + 1 : end;
+    }
+    return wildcard;
+}
+
+/**
+ * @brief Check that a client-supplied path stays below the directory it is appended to.
+ */
+bool wifi_is_safe_file_path(const char *path, size_t len) {
+    if (len < 2 || path[0] != '/' || path[len - 1] == '/') return false;
+    size_t segment = 1;     // Start of the current segment
+    for (size_t i = 1; i <= len; i++) {
+        if (i == len || path[i] == '/') {
+            size_t seg_len = i - segment;
+            if (seg_len == 0) return false;
+            if (path[segment] == '.' && (seg_len == 1 || (seg_len == 2 && path[segment + 1] == '.'))) return false;
+            segment = i + 1;
+            continue;
+        }
+        unsigned char c = (unsigned char)path[i];
+        if (c < 0x20 || c == 0x7f || c == '\\' || c == ':') return false;
+    }
+    return true;
+}
+
+bool wifi_secret_equal(const char *given, const char *expected) {
+    unsigned char diff = 0;
+    for (; *expected; expected++) {
+        diff |= (unsigned char)(*given ^ *expected);
+        if (*given) given++;    // Stay on the terminator of a shorter string
+    }
+    diff |= (unsigned char)*given;  // Longer than expected
+    return diff == 0;
+}
+
+/**
+ * @brief Check whether a URI is a known OS captive portal detection probe.
+ * 
+ * Android: /generate_204, /gen_204
+ * iOS: /hotspot-detect.html
+ * Windows: /ncsi.txt, /connecttest.txt
+ * Generic: /success.txt, /redirect, /204, /ipv6check
+ */
+bool wifi_is_captive_probe_uri(const char *uri) {
+    return !strcmp(uri, "/generate_204") ||
+           !strcmp(uri, "/gen_204") ||
+           !strcmp(uri, "/ncsi.txt") ||
+           !strcmp(uri, "/connecttest.txt") ||
+           !strcmp(uri, "/hotspot-detect.html") ||
+           !strcmp(uri, "/success.txt") ||
+           !strcmp(uri, "/check_network_status.txt") ||
+           !strcmp(uri, "/redirect") ||
+           !strcmp(uri, "/204") ||
+           !strcmp(uri, "/ipv6check");
+}
+
+void wifi_json_init(wifi_json_t *json, char *buf, size_t size) {
+    json->buf = buf;
+    json->size = size;
+    json->len = 0;
+    json->overflow = false;
+    if (size > 0) buf[0] = '\0';
+}
+
+/**
+ * @brief Append raw bytes, marking the writer as overflowed if they do not fit.
+ */
+static void json_put(wifi_json_t *json, const char *src, size_t n) {
+    if (json->overflow || json->len + n >= json->size) {
+        json->overflow = true;
+        return;
+    }
+    memcpy(json->buf + json->len, src, n);
+    json->len += n;
+    json->buf[json->len] = '\0';
+}
+
+void wifi_json_raw(wifi_json_t *json, const char *str) {
+    json_put(json, str, strlen(str));
+}
+
+void wifi_json_str(wifi_json_t *json, const char *str) {
+    static const char hex[] = "0123456789abcdef";
+    json_put(json, "\"", 1);
+    const char *run = str;     // Start of the current run of bytes that need no escaping
+    for (const char *p = str; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        json_put(json, run, (size_t)(p - run));
+        if (c == '"' || c == '\\') {
+            char esc[2] = { '\\', (char)c };
+            json_put(json, esc, 2);
+        } else {
+            char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0F] };
+            json_put(json, esc, 6);
+        }
+        run = p + 1;
+    }
+    json_put(json, run, strlen(run));
+    json_put(json, "\"", 1);
+}
+
+void wifi_json_int(wifi_json_t *json, long value) {
+    char digits[24];
+    char *p = digits + sizeof(digits);
+    unsigned long v = value < 0 ? 0UL - (unsigned long)value : (unsigned long)value;
+    do {
+        *--p = (char)('0' + v % 10);
+        v /= 10;
+    } while (v);
+    if (value < 0) *--p = '-';
+    json_put(json, p, (size_t)(digits + sizeof(digits) - p));
+}
+
+void wifi_json_bool(wifi_json_t *json, bool value) {
+    if (value) json_put(json, "true", 4);
+    else json_put(json, "false", 5);
+}
+
+void wifi_json_truncate(wifi_json_t *json, size_t len) {
+    if (len > json->len) return;
+    json->len = len;
+    json->buf[len] = '\0';
+    json->overflow = false;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file wifi_util.h
+ * @brief Hardware-independent helpers of the WiFi component (private).
+ * 
+ * Everything declared here depends only on the C standard library, so the
+ * translation unit can be compiled and exercised on a host machine without
+ * ESP-IDF.
+ */
+
+#ifndef WIFI_UTIL_H
+#define WIFI_UTIL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Decode a URL-encoded string in place (public, also declared in Wifi.h).
+ * 
+ * @param str Pointer to null-terminated string to decode (modified in place)
+ */
+void url_decode(char *str);
+
+/**
+ * @brief Get the Content-Type for a file path based on its extension.
+ * 
+ * @param path File path or URI
+ * @return MIME type string, "application/octet-stream" if the extension is unknown
+ */
+const char *wifi_mime_type_for_path(const char *path);
+
+/**
+ * @brief Check whether a URI is a known OS captive portal detection probe.
+ * 
+ * @param uri Request URI (path only)
+ * @return true for probe URIs such as /generate_204 or /hotspot-detect.html
+ */
+bool wifi_is_captive_probe_uri(const char *uri);
+
+/**
+ * @brief Check whether an Accept-Encoding header value allows a content coding.
+ * 
+ * The coding is acceptable when it or "*" is listed without q=0; an entry for
+ * the coding itself takes precedence over "*". Codings compare case-insensitively.
+ * 
+ * @param accept_encoding Header value, NULL if the request has none (only identity is acceptable then)
+ * @param coding Content coding, e.g. "gzip"
+ * @return true if the client accepts the coding
+ */
+bool wifi_accepts_encoding(const char *accept_encoding, const char *coding);
+
+/**
+ * @brief Check that a client-supplied path stays below the directory it is appended to.
+ * 
+ * Accepts "/dir/file.ext"-style paths; rejects empty, relative and directory
+ * paths, "." and ".." segments, empty segments, backslashes, colons and
+ * control characters.
+ * 
+ * @param path Path, not necessarily NUL-terminated
+ * @param len Length of path
+ * @return true if the path is safe to append to a mount point
+ */
+bool wifi_is_safe_file_path(const char *path, size_t len);
+
+/**
+ * @brief Compare a client-supplied secret with the expected one in constant time.
+ * 
+ * The time taken depends only on the length of expected, not on where the
+ * strings differ.
+ * 
+ * @param given NUL-terminated string from the client
+ * @param expected NUL-terminated secret
+ * @return true if both strings are equal
+ */
+bool wifi_secret_equal(const char *given, const char *expected);
+
+/**
+ * @brief Bounded JSON writer over a caller-supplied buffer.
+ * 
+ * Appends never write past the buffer; once something does not fit the writer
+ * is marked as overflowed and ignores further appends. The buffer is always
+ * NUL-terminated.
+ */
+typedef struct {
+    char *buf;          ///< Output buffer
+    size_t size;        ///< Size of the buffer
+    size_t len;         ///< Bytes written, excluding the NUL terminator
+    bool overflow;      ///< Set once an append did not fit
+} wifi_json_t;
+
+/**
+ * @brief Start writing into a buffer.
+ * 
+ * @param json Writer
+ * @param buf Output buffer
+ * @param size Size of the buffer, must be at least 1
+ */
+void wifi_json_init(wifi_json_t *json, char *buf, size_t size);
+
+/**
+ * @brief Append a string verbatim (punctuation, keys known to need no escaping).
+ */
+void wifi_json_raw(wifi_json_t *json, const char *str);
+
+/**
+ * @brief Append a string as a quoted, escaped JSON string.
+ */
+void wifi_json_str(wifi_json_t *json, const char *str);
+
+/**
+ * @brief Append a decimal integer.
+ */
+void wifi_json_int(wifi_json_t *json, long value);
+
+/**
+ * @brief Append `true` or `false`.
+ */
+void wifi_json_bool(wifi_json_t *json, bool value);
+
+/**
+ * @brief Roll the writer back to an earlier length and clear the overflow flag.
+ * 
+ * Used to drop a partially written element that did not fit.
+ * 
+ * @param json Writer
+ * @param len Length saved from `json->len` before the element was written
+ */
+void wifi_json_truncate(wifi_json_t *json, size_t len);
+
+#endif
@@ -0,0 +1,183 @@
+/**
+ * @file wifi_ws_rx.c
+ * @brief Allocation-free WebSocket frame reception.
+ *
+ * Implements a static pool of three buffer size classes. Each class keeps a
+ * bitmask of buffers in use, so taking and returning a buffer is a few
+ * instructions under a spinlock and never touches the heap.
+ */
+
+#include "sdkconfig.h"
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+
+#include "wifi_ws_rx.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+
+#include <string.h>
+
+/** @brief Log tag for WebSocket receive messages */
+static const char *TAG_WS_RX = "Wifi-WS_rx";
+
+/**
+ * @brief One buffer size class of the pool.
+ */
+typedef struct {
+    uint8_t *storage;       ///< Buffers, each (size + 1) bytes for the NUL terminator
+    size_t size;            ///< Payload capacity of one buffer
+    uint8_t count;          ///< Number of buffers
+    uint32_t in_use;        ///< Bitmask of buffers in use
+} ws_rx_class_t;
+
+// Buffer storage, one extra byte per buffer for the NUL terminator
+static uint8_t ws_rx_small[CONFIG_WIFI_WS_RX_SMALL_COUNT][CONFIG_WIFI_WS_RX_SMALL_SIZE + 1];
+static uint8_t ws_rx_medium[CONFIG_WIFI_WS_RX_MEDIUM_COUNT][CONFIG_WIFI_WS_RX_MEDIUM_SIZE + 1];
+static uint8_t ws_rx_large[CONFIG_WIFI_WS_RX_LARGE_COUNT][CONFIG_WIFI_WS_RX_LARGE_SIZE + 1];
+
+/** @brief Size classes, ordered from smallest to largest */
+static ws_rx_class_t ws_rx_classes[WIFI_WS_RX_CLASS_COUNT] = {
+    { .storage = &ws_rx_small[0][0],  .size = CONFIG_WIFI_WS_RX_SMALL_SIZE,  .count = CONFIG_WIFI_WS_RX_SMALL_COUNT },
+    { .storage = &ws_rx_medium[0][0], .size = CONFIG_WIFI_WS_RX_MEDIUM_SIZE, .count = CONFIG_WIFI_WS_RX_MEDIUM_COUNT },
+    { .storage = &ws_rx_large[0][0],  .size = CONFIG_WIFI_WS_RX_LARGE_SIZE,  .count = CONFIG_WIFI_WS_RX_LARGE_COUNT },
+};
+
+/** @brief Receive statistics */
+static wifi_ws_rx_stats_t ws_rx_stats;
+
+/** @brief Spinlock guarding the pool bitmasks and statistics */
+static portMUX_TYPE ws_rx_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Take the smallest free buffer that fits the payload.
+ *
+ * @param len Payload length
+ * @param class_idx Class of the returned buffer
+ * @param slot_idx Slot of the returned buffer within the class
+ * @return Buffer, NULL if none is free or the payload is too large
+ */
+static uint8_t *ws_rx_take(size_t len, int *class_idx, int *slot_idx) {
+    uint8_t *buf = NULL;
+    taskENTER_CRITICAL(&ws_rx_lock);
+    for (int c = 0; c < WIFI_WS_RX_CLASS_COUNT && buf == NULL; c++) {
+        ws_rx_class_t *cls = &ws_rx_classes[c];
+        if (len > cls->size) continue;
+        for (int s = 0; s < cls->count; s++) {
+            if ((cls->in_use & (1UL << s)) == 0) {
+                cls->in_use |= (1UL << s);
+                buf = cls->storage + (size_t)s * (cls->size + 1);
+                *class_idx = c;
+                *slot_idx = s;
+
+                uint8_t busy = (uint8_t)__builtin_popcount(cls->in_use);
+                if (busy > ws_rx_stats.class_high_water[c]) {
+                    ws_rx_stats.class_high_water[c] = busy;
+                }
+                ws_rx_stats.class_hits[c]++;
+                break;
+            }
+        }
+    }
+    if (buf == NULL) {
+        if (len > ws_rx_classes[WIFI_WS_RX_CLASS_COUNT - 1].size) {
+            ws_rx_stats.oversize++;
+        } else {
+            ws_rx_stats.exhausted++;
+        }
+    }
+    taskEXIT_CRITICAL(&ws_rx_lock);
+    return buf;
+}
+
+/**
+ * @brief Return a buffer to the pool.
+ */
+static void ws_rx_give(int class_idx, int slot_idx) {
+    taskENTER_CRITICAL(&ws_rx_lock);
+    ws_rx_classes[class_idx].in_use &= ~(1UL << slot_idx);
+    taskEXIT_CRITICAL(&ws_rx_lock);
+}
+
+/**
+ * @brief Read the payload of a frame whose header has already been received and run the callback.
+ */
+static esp_err_t ws_rx_finish(httpd_req_t *req, httpd_ws_frame_t *frame, uint8_t *buf, wifi_ws_rx_cb_t cb, void *ctx) {
+    frame->payload = buf;
+    esp_err_t err = httpd_ws_recv_frame(req, frame, frame->len);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG_WS_RX, "Failed to receive WebSocket payload: %s", esp_err_to_name(err));
+        return err;
+    }
+    buf[frame->len] = '\0';
+
+    taskENTER_CRITICAL(&ws_rx_lock);
+    ws_rx_stats.frames++;
+    ws_rx_stats.bytes += frame->len;
+    taskEXIT_CRITICAL(&ws_rx_lock);
+
+    return cb(req, frame, ctx);
+}
+
+esp_err_t wifi_ws_recv(httpd_req_t *req, wifi_ws_rx_cb_t cb, void *ctx) {
+    if (req == NULL || cb == NULL) return ESP_ERR_INVALID_ARG;
+
+    httpd_ws_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);     // Header only, fills in type and len
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG_WS_RX, "Failed to receive WebSocket frame header: %s", esp_err_to_name(err));
+        return err;
+    }
+    if (frame.len == 0) {
+        frame.payload = NULL;
+        return cb(req, &frame, ctx);
+    }
+
+    int class_idx, slot_idx;
+    uint8_t *buf = ws_rx_take(frame.len, &class_idx, &slot_idx);
+    if (buf == NULL) {
+        bool oversize = frame.len > ws_rx_classes[WIFI_WS_RX_CLASS_COUNT - 1].size;
+        ESP_LOGW(TAG_WS_RX, "No receive buffer for %u byte frame (%s)", (unsigned)frame.len, oversize ? "too large" : "pool exhausted");
+        return oversize ? ESP_ERR_INVALID_SIZE : ESP_ERR_NO_MEM;
+    }
+    err = ws_rx_finish(req, &frame, buf, cb, ctx);
+    ws_rx_give(class_idx, slot_idx);
+    return err;
+}
+
+esp_err_t wifi_ws_recv_into(httpd_req_t *req, uint8_t *buf, size_t buf_len, wifi_ws_rx_cb_t cb, void *ctx) {
+    if (req == NULL || buf == NULL || buf_len == 0 || cb == NULL) return ESP_ERR_INVALID_ARG;
+
+    httpd_ws_frame_t frame;
+    memset(&frame, 0, sizeof(frame));
+    esp_err_t err = httpd_ws_recv_frame(req, &frame, 0);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG_WS_RX, "Failed to receive WebSocket frame header: %s", esp_err_to_name(err));
+        return err;
+    }
+    if (frame.len == 0) {
+        frame.payload = NULL;
+        return cb(req, &frame, ctx);
+    }
+    if (frame.len > buf_len - 1) {
+        taskENTER_CRITICAL(&ws_rx_lock);
+        ws_rx_stats.oversize++;
+        taskEXIT_CRITICAL(&ws_rx_lock);
+        ESP_LOGW(TAG_WS_RX, "Frame of %u bytes does not fit %u byte buffer", (unsigned)frame.len, (unsigned)buf_len);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ws_rx_finish(req, &frame, buf, cb, ctx);
+}
+
+void wifi_ws_rx_get_stats(wifi_ws_rx_stats_t *stats) {
+    if (stats == NULL) return;
+    taskENTER_CRITICAL(&ws_rx_lock);
+    *stats = ws_rx_stats;
+    taskEXIT_CRITICAL(&ws_rx_lock);
+    for (int c = 0; c < WIFI_WS_RX_CLASS_COUNT; c++) {
+        stats->class_size[c] = ws_rx_classes[c].size;
+    }
+}
+
+#endif // CONFIG_HTTPD_WS_SUPPORT
@@ -0,0 +1,316 @@
+/**
+ * @file wifi_ws_sync.c
+ * @brief Coalescing binary value-sync protocol for WebSocket dashboards.
+ *
+ * Keeps a small table of the latest value per key. Setters only update the
+ * table and arm a one-shot timer; when the timer fires, a single frame with
+ * every changed key is built on the HTTP server task and sent to all
+ * WebSocket clients.
+ */
+
+#include "sdkconfig.h"
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+
+#include "wifi_ws_sync.h"
+#include "wifi_server.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#include <string.h>
+
+/** @brief Log tag for WebSocket value sync messages */
+static const char *TAG_WS_SYNC = "Wifi-WS_sync";
+
+/** @brief Largest encoded size of one entry: key + type + 5-byte varint */
+#define WS_SYNC_MAX_ENTRY_LEN 7
+
+/** @brief Largest frame the server sends */
+#define WS_SYNC_MAX_FRAME_LEN (WIFI_WS_SYNC_HEADER_LEN + CONFIG_WIFI_WS_SYNC_MAX_KEYS * WS_SYNC_MAX_ENTRY_LEN)
+
+/**
+ * @brief One slot of the value table.
+ */
+typedef struct {
+    bool used;                  ///< Slot holds a key
+    bool dirty;                 ///< Value changed since the last frame
+    bool sent;                  ///< Value was sent at least once (delta base is valid)
+    uint8_t key;                ///< Application-defined key
+    wifi_ws_sync_type_t type;   ///< Value type
+    int32_t value_i;            ///< Latest integer value
+    float value_f;              ///< Latest float value
+    int32_t sent_i;             ///< Integer value sent in the last frame (delta base)
+} ws_sync_slot_t;
+
+/** @brief Table of synchronized values */
+static ws_sync_slot_t ws_sync_slots[CONFIG_WIFI_WS_SYNC_MAX_KEYS];
+
+/** @brief Next keyframe sends all values as absolute values */
+static bool ws_sync_keyframe_pending = true;
+
+/** @brief Sequence number of the next frame */
+static uint16_t ws_sync_seq = 0;
+
+/** @brief Spinlock guarding the value table, setters may run on any task */
+static portMUX_TYPE ws_sync_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/** @brief One-shot coalescing timer */
+static esp_timer_handle_t ws_sync_timer = NULL;
+
+/** @brief Frame buffer, only touched by the HTTP server task */
+static uint8_t ws_sync_frame[WS_SYNC_MAX_FRAME_LEN];
+
+/**
+ * @brief Encode a signed integer as zigzag LEB128 varint.
+ *
+ * @param out Output buffer, at least 5 bytes
+ * @param value Value to encode
+ * @return Number of bytes written
+ */
+static size_t ws_sync_put_varint(uint8_t *out, int32_t value) {
+    uint32_t zz = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+    size_t n = 0;
+    while (zz >= 0x80) {
+        out[n++] = (uint8_t)(zz | 0x80);
+        zz >>= 7;
+    }
+    out[n++] = (uint8_t)zz;
+    return n;
+}
+
+/**
+ * @brief Decode a zigzag LEB128 varint.
+ *
+ * @param in Input buffer
+ * @param len Bytes available in the input buffer
+ * @param value Decoded value
+ * @return Number of bytes consumed, 0 if truncated or longer than 5 bytes
+ */
+static size_t ws_sync_get_varint(const uint8_t *in, size_t len, int32_t *value) {
+    uint32_t zz = 0;
+    for (size_t n = 0; n < len && n < 5; n++) {
+        zz |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+        if ((in[n] & 0x80) == 0) {
+            *value = (int32_t)((zz >> 1) ^ (~(zz & 1) + 1));
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Build the next frame from the value table.
+ *
+ * @return Frame length, 0 if there is nothing to send
+ */
+static size_t ws_sync_build_frame(void) {
+    size_t len = WIFI_WS_SYNC_HEADER_LEN;
+    uint8_t count = 0;
+
+    taskENTER_CRITICAL(&ws_sync_lock);
+    bool keyframe = ws_sync_keyframe_pending;
+    for (int i = 0; i < CONFIG_WIFI_WS_SYNC_MAX_KEYS; i++) {
+        ws_sync_slot_t *slot = &ws_sync_slots[i];
+        if (!slot->used || !(slot->dirty || keyframe)) continue;
+
+        ws_sync_frame[len++] = slot->key;
+        ws_sync_frame[len++] = (uint8_t)slot->type;
+        if (slot->type == WIFI_WS_SYNC_TYPE_INT) {
+            int32_t v = keyframe ? slot->value_i : (int32_t)((uint32_t)slot->value_i - (uint32_t)slot->sent_i);
+            len += ws_sync_put_varint(ws_sync_frame + len, v);
+            slot->sent_i = slot->value_i;
+        } else {
+            memcpy(ws_sync_frame + len, &slot->value_f, sizeof(float));
+            len += sizeof(float);
+        }
+        slot->dirty = false;
+        slot->sent = true;
+        count++;
+    }
+    ws_sync_keyframe_pending = false;
+    uint16_t seq = ws_sync_seq;
+    if (count > 0) ws_sync_seq++;
+    taskEXIT_CRITICAL(&ws_sync_lock);
+
+    if (count == 0) return 0;
+
+    ws_sync_frame[0] = WIFI_WS_SYNC_MAGIC;
+    ws_sync_frame[1] = WIFI_WS_SYNC_VERSION;
+    ws_sync_frame[2] = (uint8_t)(seq & 0xFF);
+    ws_sync_frame[3] = (uint8_t)(seq >> 8);
+    ws_sync_frame[4] = count;
+    ws_sync_frame[5] = keyframe ? 0 : WIFI_WS_SYNC_FLAG_DELTA;
+    return len;
+}
+
+/**
+ * @brief HTTP server work item: build one frame and send it to all WebSocket clients.
+ *
+ * @param arg Server handle the work was queued on
+ */
+static void ws_sync_flush_work(void *arg) {
+    httpd_handle_t hd = (httpd_handle_t)arg;
+    size_t len = ws_sync_build_frame();
+    if (len == 0) return;
+
+    int fds[CONFIG_LWIP_MAX_SOCKETS];
+    size_t fd_count = CONFIG_LWIP_MAX_SOCKETS;
+    if (httpd_get_client_list(hd, &fd_count, fds) != ESP_OK) return;
+
+    httpd_ws_frame_t ws_frame = {
+        .type = HTTPD_WS_TYPE_BINARY,
+        .payload = ws_sync_frame,
+        .len = len,
+    };
+    for (size_t i = 0; i < fd_count; i++) {
+        if (httpd_ws_get_fd_info(hd, fds[i]) == HTTPD_WS_CLIENT_WEBSOCKET) {
+            esp_err_t err = httpd_ws_send_frame_async(hd, fds[i], &ws_frame);
+            if (err != ESP_OK) {
+                ESP_LOGD(TAG_WS_SYNC, "Failed to send sync frame to fd %d: %s", fds[i], esp_err_to_name(err));
+            }
+        }
+    }
+    ESP_LOGV(TAG_WS_SYNC, "Sync frame sent: %u bytes, %u entries", (unsigned)len, ws_sync_frame[4]);
+}
+
+/**
+ * @brief Coalescing timer callback, hands the flush over to the HTTP server task.
+ */
+static void ws_sync_timer_cb(void *arg) {
+    // Without a running server the values stay dirty and go out once it runs and a value changes
+    esp_err_t err = wifi_queue_http_work(ws_sync_flush_work);
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
+        ESP_LOGD(TAG_WS_SYNC, "Failed to queue sync flush: %s", esp_err_to_name(err));
+    }
+}
+
+/**
+ * @brief Arm the one-shot coalescing timer if it is not already running.
+ */
+static void ws_sync_arm_timer(void) {
+    if (ws_sync_timer && !esp_timer_is_active(ws_sync_timer)) {
+        esp_timer_start_once(ws_sync_timer, CONFIG_WIFI_WS_SYNC_TICK_MS * 1000ULL);
+    }
+}
+
+/**
+ * @brief Store a value in the table and arm the timer.
+ */
+static esp_err_t ws_sync_set(uint8_t key, wifi_ws_sync_type_t type, int32_t value_i, float value_f) {
+    esp_err_t ret = ESP_OK;
+    taskENTER_CRITICAL(&ws_sync_lock);
+    ws_sync_slot_t *slot = NULL;
+    ws_sync_slot_t *free_slot = NULL;
+    for (int i = 0; i < CONFIG_WIFI_WS_SYNC_MAX_KEYS; i++) {
+        if (ws_sync_slots[i].used && ws_sync_slots[i].key == key) {
+            slot = &ws_sync_slots[i];
+            break;
+        }
+        if (!ws_sync_slots[i].used && free_slot == NULL) {
+            free_slot = &ws_sync_slots[i];
+        }
+    }
+    if (slot == NULL && free_slot != NULL) {
+        slot = free_slot;
+        memset(slot, 0, sizeof(*slot));
+        slot->used = true;
+        slot->key = key;
+        slot->type = type;
+    }
+    if (slot == NULL) {
+        ret = ESP_ERR_NO_MEM;
+    } else if (slot->type != type) {
+        ret = ESP_ERR_INVALID_ARG;
+    } else if (type == WIFI_WS_SYNC_TYPE_INT) {
+        slot->dirty |= !slot->sent || slot->value_i != value_i;
+        slot->value_i = value_i;
+    } else {
+        slot->dirty |= !slot->sent || slot->value_f != value_f;
+        slot->value_f = value_f;
+    }
+    taskEXIT_CRITICAL(&ws_sync_lock);
+
+    if (ret == ESP_OK) {
+        ws_sync_arm_timer();
+    } else {
+        ESP_LOGW(TAG_WS_SYNC, "Cannot set key %u: %s", key, esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+esp_err_t wifi_ws_sync_init(void) {
+    if (ws_sync_timer) return ESP_OK;
+    const esp_timer_create_args_t timer_args = {
+        .callback = ws_sync_timer_cb,
+        .name = "ws_sync",
+    };
+    esp_err_t err = esp_timer_create(&timer_args, &ws_sync_timer);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_WS_SYNC, "Failed to create sync timer: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+esp_err_t wifi_ws_sync_set_int(uint8_t key, int32_t value) {
+    return ws_sync_set(key, WIFI_WS_SYNC_TYPE_INT, value, 0.0f);
+}
+
+esp_err_t wifi_ws_sync_set_float(uint8_t key, float value) {
+    return ws_sync_set(key, WIFI_WS_SYNC_TYPE_FLOAT, 0, value);
+}
+
+void wifi_ws_sync_request_keyframe(void) {
+    taskENTER_CRITICAL(&ws_sync_lock);
+    ws_sync_keyframe_pending = true;
+    taskEXIT_CRITICAL(&ws_sync_lock);
+    ws_sync_arm_timer();
+}
+
+bool wifi_ws_sync_is_frame(const uint8_t *payload, size_t len) {
+    return payload != NULL && len >= WIFI_WS_SYNC_HEADER_LEN &&
+           payload[0] == WIFI_WS_SYNC_MAGIC && payload[1] == WIFI_WS_SYNC_VERSION;
+}
+
+esp_err_t wifi_ws_sync_decode(const uint8_t *payload, size_t len, wifi_ws_sync_value_cb_t cb, void *ctx) {
+    if (!wifi_ws_sync_is_frame(payload, len)) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    uint8_t count = payload[4];
+    uint8_t flags = payload[5];
+    if (flags & WIFI_WS_SYNC_FLAG_DELTA) {
+        ESP_LOGW(TAG_WS_SYNC, "Delta frames from clients are not supported");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if (flags & WIFI_WS_SYNC_FLAG_RESYNC) {
+        ESP_LOGD(TAG_WS_SYNC, "Client requested keyframe");
+        wifi_ws_sync_request_keyframe();
+    }
+
+    size_t pos = WIFI_WS_SYNC_HEADER_LEN;
+    for (uint8_t i = 0; i < count; i++) {
+        if (len - pos < 2) return ESP_ERR_INVALID_SIZE;
+        wifi_ws_sync_value_t value = {
+            .key = payload[pos],
+            .type = (wifi_ws_sync_type_t)payload[pos + 1],
+        };
+        pos += 2;
+        if (value.type == WIFI_WS_SYNC_TYPE_INT) {
+            size_t n = ws_sync_get_varint(payload + pos, len - pos, &value.i);
+            if (n == 0) return ESP_ERR_INVALID_SIZE;
+            pos += n;
+        } else if (value.type == WIFI_WS_SYNC_TYPE_FLOAT) {
+            if (len - pos < sizeof(float)) return ESP_ERR_INVALID_SIZE;
+            memcpy(&value.f, payload + pos, sizeof(float));
+            pos += sizeof(float);
+        } else {
+            ESP_LOGW(TAG_WS_SYNC, "Unknown value type %d for key %u", value.type, value.key);
+            return ESP_ERR_INVALID_SIZE;    // Unknown type has unknown length, rest of the frame is lost
+        }
+        if (cb) cb(&value, ctx);
+    }
+    return ESP_OK;
+}
+
+#endif // CONFIG_HTTPD_WS_SUPPORT
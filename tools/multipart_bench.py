@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+"""Benchmark the streaming multipart/form-data parser against buffering.
+
+Sends the same multipart/form-data upload (a few form fields and one file of
+random data) to the full example's /multipart-bench endpoint twice: with
+mode=stream the device parses the body with wifi_multipart_feed() while it
+arrives, with mode=buffer it first receives the whole body into one heap
+buffer and parses it afterwards. Reports the device's total and parse time,
+parse throughput and memory used for the body, and checks that both modes
+delivered exactly the bytes that were sent.
+
+Buffering needs a free heap block as large as the body, so large uploads
+only work in stream mode; the device answers 413 otherwise.
+
+Usage:
+    python3 tools/multipart_bench.py --host 192.168.4.1 --size 1
+    python3 tools/multipart_bench.py --host 192.168.4.1 --size 0.1 --rounds 5 --json
+
+Only the Python standard library is required.
+"""
+
+import argparse
+import http.client
+import json
+import os
+import sys
+import time
+
+CHUNK = 16 * 1024
+
+
+def build_body(size, fields):
+    """Return (boundary, body, data_bytes, sum) for one file part of size bytes and the given fields."""
+    boundary = "----wifiMultipartBench" + os.urandom(8).hex()
+    parts = []
+    data_bytes = 0
+    data_sum = 0
+    for i in range(fields):
+        value = f"value {i}".encode()
+        parts.append(f'--{boundary}\r\nContent-Disposition: form-data; name="field{i}"\r\n\r\n'.encode() + value + b"\r\n")
+        data_bytes += len(value)
+        data_sum += sum(value)
+    data = os.urandom(size)
+    parts.append(f'--{boundary}\r\nContent-Disposition: form-data; name="file"; filename="bench.bin"\r\n'
+                 f"Content-Type: application/octet-stream\r\n\r\n".encode() + data + b"\r\n")
+    data_bytes += len(data)
+    data_sum += sum(data)
+    parts.append(f"--{boundary}--\r\n".encode())
+    return boundary, b"".join(parts), data_bytes, data_sum & 0xFFFFFFFF
+
+
+def post(args, mode, boundary, body):
+    """POST the body, return (status, device result or error text, client seconds)."""
+    conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+    start = time.monotonic()
+    conn.putrequest("POST", f"/multipart-bench?mode={mode}")
+    conn.putheader("Content-Type", f"multipart/form-data; boundary={boundary}")
+    conn.putheader("Content-Length", str(len(body)))
+    conn.endheaders()
+    for off in range(0, len(body), CHUNK):
+        conn.send(body[off:off + CHUNK])
+    resp = conn.getresponse()
+    text = resp.read()
+    elapsed = time.monotonic() - start
+    conn.close()
+    if resp.status != 200:
+        return resp.status, text.decode(errors="replace"), elapsed
+    return resp.status, json.loads(text), elapsed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="192.168.4.1", help="device IP (default: %(default)s)")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--size", type=float, default=1.0, metavar="MB", help="size of the file part (default: %(default)s)")
+    parser.add_argument("--fields", type=int, default=3, help="form fields before the file (default: %(default)s)")
+    parser.add_argument("--rounds", type=int, default=3, help="uploads per mode (default: %(default)s)")
+    parser.add_argument("--timeout", type=float, default=60.0)
+    parser.add_argument("--json", action="store_true", help="print machine-readable JSON")
+    args = parser.parse_args()
+
+    boundary, body, data_bytes, data_sum = build_body(int(args.size * 1024 * 1024), args.fields)
+    results = {}
+    ok = True
+    for mode in ("stream", "buffer"):
+        runs = []
+        for _ in range(args.rounds):
+            status, result, elapsed = post(args, mode, boundary, body)
+            if status != 200:
+                runs.append({"status": status, "error": result.strip()})
+                break
+            if result["dataBytes"] != data_bytes or result["sum"] != data_sum or result["parts"] != args.fields + 1:
+                print(f"{mode}: device parsed {result['parts']} parts, {result['dataBytes']} bytes, sum {result['sum']}; "
+                      f"expected {args.fields + 1}, {data_bytes}, {data_sum}", file=sys.stderr)
+                ok = False
+            result["clientMs"] = round(elapsed * 1000, 1)
+            runs.append(result)
+        results[mode] = runs
+
+    if args.json:
+        json.dump({"bodyBytes": len(body), "results": results}, sys.stdout, indent=2)
+        print()
+    else:
+        print(f"Body {len(body)} bytes, {args.fields + 1} parts, {args.rounds} rounds per mode")
+        for mode, runs in results.items():
+            for run in runs:
+                if "error" in run:
+                    print(f"  {mode:6}  HTTP {run['status']}: {run['error']}")
+                    continue
+                print(f"  {mode:6}  total {run['totalMs']} ms, parse {run['parseUs']} us ({run['parseKBps']} kB/s), "
+                      f"body memory {run['bufferBytes']} B, client {run['clientMs']} ms")
+    sys.exit(0 if ok else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,248 @@
+#!/usr/bin/env python3
+"""Pack a web directory into a read-only asset image for a flash partition.
+
+The image is mapped into the address space at runtime (CONFIG_WIFI_ASSETS) and
+files are served straight from flash, either as the primary web root or as a
+fallback under the SD card. The build normally runs this tool through the
+wifi_assets_create_partition_image() CMake function, but it can also be used
+directly:
+
+    python3 tools/pack_assets.py pack examples/full/webpage www.bin --gzip --gzip-plain --size 0x60000
+    python3 tools/pack_assets.py list www.bin
+    python3 tools/pack_assets.py bench www.bin
+
+Image layout (all multi-byte fields little-endian):
+
+    Header, 16 bytes:
+        0   4   Magic "WAST"
+        4   1   Format version (1)
+        5   1   Reserved (0)
+        6   2   Number of entries
+        8   4   Image size in bytes
+        12  4   Reserved (0)
+    Entries, 24 bytes each, sorted by (hash, path):
+        0   4   FNV-1a hash of the path
+        4   4   Path offset from image start (NUL-terminated, starts with "/")
+        8   4   Data offset from image start (4-byte aligned)
+        12  4   Data size in bytes
+        16  4   CRC-32 of the stored data, used as ETag
+        20  2   Flags, bit 0: data is gzip-compressed
+        22  2   Path length without NUL
+    Path strings, then file data.
+
+With --gzip, files of compressible types are stored gzip-compressed when that
+saves at least --gzip-min-saving of their size; they are served with
+"Content-Encoding: gzip" to clients that accept it. With --gzip-plain, such
+files are also stored uncompressed under the same path, right after the
+compressed entry, for clients that do not. Without it, those clients get the
+file from the SD card or 406 Not Acceptable.
+
+"bench" times the same hash + binary search lookup the device does, in Python,
+for every path and for misses. It checks the index and gives a relative
+figure; absolute numbers on the device are much lower.
+
+Only the Python standard library is required.
+"""
+
+import argparse
+import fnmatch
+import gzip
+import os
+import struct
+import sys
+import time
+import zlib
+
+MAGIC = b"WAST"
+VERSION = 1
+HEADER = struct.Struct("<4sBBHII")
+ENTRY = struct.Struct("<IIIIIHH")
+FLAG_GZIP = 0x0001
+ALIGN = 4
+
+COMPRESSIBLE = {".html", ".htm", ".css", ".js", ".json", ".svg", ".txt", ".xml", ".ico", ".map", ".csv"}
+DEFAULT_EXCLUDES = [".*", "*~", "*.swp", "Thumbs.db"]
+
+
+def fnv1a(data):
+    h = 0x811C9DC5
+    for b in data:
+        h ^= b
+        h = (h * 0x01000193) & 0xFFFFFFFF
+    return h
+
+
+def align(n):
+    return (n + ALIGN - 1) & ~(ALIGN - 1)
+
+
+def collect(src, excludes):
+    """Return sorted list of (url path, file path) below src."""
+    files = []
+    for root, dirs, names in os.walk(src):
+        dirs[:] = sorted(d for d in dirs if not any(fnmatch.fnmatch(d, p) for p in excludes))
+        for name in sorted(names):
+            if any(fnmatch.fnmatch(name, p) for p in excludes):
+                continue
+            full = os.path.join(root, name)
+            rel = os.path.relpath(full, src).replace(os.sep, "/")
+            files.append(("/" + rel, full))
+    return files
+
+
+def pack(files, use_gzip, min_saving, keep_plain=False):
+    entries = []
+    for path, full in files:
+        with open(full, "rb") as f:
+            data = f.read()
+        raw_path = path.encode("utf-8")
+        if len(raw_path) > 0xFFFF:
+            raise ValueError(f"path too long: {path}")
+        entry = {"path": path, "raw_path": raw_path, "hash": fnv1a(raw_path), "data": data, "flags": 0,
+                 "orig_size": os.path.getsize(full)}
+        if use_gzip and os.path.splitext(path)[1].lower() in COMPRESSIBLE:
+            packed = gzip.compress(data, compresslevel=9, mtime=0)
+            if len(packed) <= len(data) * (1 - min_saving):
+                if keep_plain:
+                    entries.append(dict(entry, orig_size=0))
+                entry.update(data=packed, flags=FLAG_GZIP)
+        entries.append(entry)
+    # The compressed entry of a path comes first, lookups that accept gzip stop there
+    entries.sort(key=lambda e: (e["hash"], e["raw_path"], -e["flags"]))
+
+    offset = HEADER.size + ENTRY.size * len(entries)
+    for e in entries:
+        e["path_offset"] = offset
+        offset += len(e["raw_path"]) + 1
+    for e in entries:
+        offset = align(offset)
+        e["data_offset"] = offset
+        offset += len(e["data"])
+    size = align(offset)
+
+    image = bytearray(size)
+    HEADER.pack_into(image, 0, MAGIC, VERSION, 0, len(entries), size, 0)
+    for i, e in enumerate(entries):
+        ENTRY.pack_into(image, HEADER.size + i * ENTRY.size, e["hash"], e["path_offset"], e["data_offset"],
+                        len(e["data"]), zlib.crc32(e["data"]) & 0xFFFFFFFF, e["flags"], len(e["raw_path"]))
+        image[e["path_offset"]:e["path_offset"] + len(e["raw_path"])] = e["raw_path"]
+        image[e["data_offset"]:e["data_offset"] + len(e["data"])] = e["data"]
+    return bytes(image), entries
+
+
+def parse(image):
+    """Return list of entry dicts from an image, validating bounds like the device does."""
+    if len(image) < HEADER.size:
+        raise ValueError("image too short")
+    magic, version, _, count, size, _ = HEADER.unpack_from(image)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not an asset image or unsupported version")
+    if size > len(image) or HEADER.size + count * ENTRY.size > size:
+        raise ValueError("truncated image")
+    entries = []
+    for i in range(count):
+        h, path_off, data_off, data_size, crc, flags, path_len = ENTRY.unpack_from(image, HEADER.size + i * ENTRY.size)
+        if path_off + path_len >= size or data_off + data_size > size:
+            raise ValueError(f"entry {i} out of bounds")
+        raw_path = bytes(image[path_off:path_off + path_len])
+        entries.append({"hash": h, "raw_path": raw_path, "path": raw_path.decode("utf-8", "replace"),
+                        "data_offset": data_off, "size": data_size, "crc": crc, "flags": flags})
+    return entries
+
+
+def lookup(entries, raw_path):
+    """Binary search on hash, then compare paths, as wifi_assets.c does."""
+    h = fnv1a(raw_path)
+    lo, hi = 0, len(entries)
+    while lo < hi:
+        mid = (lo + hi) // 2
+        if entries[mid]["hash"] < h:
+            lo = mid + 1
+        else:
+            hi = mid
+    while lo < len(entries) and entries[lo]["hash"] == h:
+        if entries[lo]["raw_path"] == raw_path:
+            return entries[lo]
+        lo += 1
+    return None
+
+
+def cmd_pack(args):
+    if not os.path.isdir(args.src):
+        sys.exit(f"error: {args.src} is not a directory")
+    files = collect(args.src, DEFAULT_EXCLUDES + (args.exclude or []))
+    image, entries = pack(files, args.gzip, args.gzip_min_saving, args.gzip_plain)
+    if args.size is not None and len(image) > args.size:
+        sys.exit(f"error: image is {len(image)} bytes, partition is only {args.size} bytes")
+    with open(args.output, "wb") as f:
+        f.write(image)
+    if not args.quiet:
+        orig = sum(e["orig_size"] for e in entries)
+        print(f"Packed {len(files)} files, {orig} bytes -> {len(image)} byte image {args.output}"
+              + (f" ({100 * len(image) / args.size:.0f} % of partition)" if args.size else ""))
+
+
+def cmd_list(args):
+    with open(args.image, "rb") as f:
+        entries = parse(f.read())
+    for e in sorted(entries, key=lambda e: e["path"]):
+        gz = "gzip" if e["flags"] & FLAG_GZIP else ""
+        print(f"{e['size']:8}  {e['crc']:08x}  {gz:4}  {e['path']}")
+    print(f"{len(entries)} files")
+
+
+def cmd_bench(args):
+    with open(args.image, "rb") as f:
+        entries = parse(f.read())
+    paths = [e["raw_path"] for e in entries]
+    misses = [p + b".missing" for p in paths] or [b"/missing"]
+    for e in entries:
+        found = lookup(entries, e["raw_path"])
+        if found is None or found["raw_path"] != e["raw_path"]:
+            sys.exit(f"error: lookup of {e['path']} failed")
+    for name, keys in (("hit", paths), ("miss", misses)):
+        if not keys:
+            continue
+        n = 0
+        start = time.perf_counter()
+        while n < args.iterations:
+            for k in keys:
+                lookup(entries, k)
+            n += len(keys)
+        elapsed = time.perf_counter() - start
+        print(f"{name:4}: {n} lookups in {len(entries)} entries, {1e6 * elapsed / n:.2f} us per lookup")
+
+
+def parse_size(text):
+    return int(text, 0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="cmd", required=True)
+
+    p = sub.add_parser("pack", help="pack a directory into an image")
+    p.add_argument("src", help="web root directory")
+    p.add_argument("output", help="image file to write")
+    p.add_argument("--gzip", action="store_true", help="store compressible files gzip-compressed")
+    p.add_argument("--gzip-min-saving", type=float, default=0.1,
+                   help="minimum size reduction for storing a file compressed (default: %(default)s)")
+    p.add_argument("--gzip-plain", action="store_true",
+                   help="also store compressed files uncompressed, for clients that do not accept gzip")
+    p.add_argument("--size", type=parse_size, help="partition size, fail if the image does not fit")
+    p.add_argument("--exclude", action="append", help="file name pattern to skip (repeatable)")
+    p.add_argument("--quiet", action="store_true")
+
+    p = sub.add_parser("list", help="list the files in an image")
+    p.add_argument("image")
+
+    p = sub.add_parser("bench", help="verify and time index lookups")
+    p.add_argument("image")
+    p.add_argument("--iterations", type=int, default=200000)
+
+    args = parser.parse_args()
+    {"pack": cmd_pack, "list": cmd_list, "bench": cmd_bench}[args.cmd](args)
+
+
+if __name__ == "__main__":
+    main()
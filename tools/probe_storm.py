@@ -0,0 +1,679 @@
+#!/usr/bin/env python3
+"""Captive-probe storm load generator.
+
+Replays the DNS queries and connectivity probes that phones and laptops fire
+right after joining the device's access point, for many clients at once, and
+reports how long it takes until each client would show the captive portal
+popup.
+
+Each simulated client:
+  1. resolves its OS's probe host names over DNS (in parallel),
+  2. fires its OS's probe requests (in parallel, over keep-alive connections),
+  3. if a probe is redirected, follows the redirect and loads the portal page
+     and its assets, like the popup browser does.
+
+"Popup latency" is the time from the client joining until the portal page and
+all assets are loaded. Clients whose probes all look like "internet available"
+never show a popup and are reported separately.
+
+Usage:
+    python3 tools/probe_storm.py --host 192.168.4.1 --clients 30 --ramp 2
+    python3 tools/probe_storm.py --host 192.168.4.1 --os ios --json > result.json
+    python3 tools/probe_storm.py --host 127.0.0.1 --http-port 8080 --dns-port 5353   # wifi_host serve
+
+With --jitter-path, the tool also reads application jitter statistics from
+the device (the full example serves them at /jitter.json): once after an idle
+baseline period and once after the storm, so portal latency and the jitter of
+the application's real-time work can be compared across task placements:
+    python3 tools/probe_storm.py --host 192.168.4.1 --jitter-path /jitter.json
+
+With --capport, a share of the Android and iOS clients behaves like clients
+that got the captive portal API URI in DHCP option 114 (RFC 8910): they ask
+the API once and open the portal URL it returns, without DNS lookups or
+probes. Comparing runs with and without it, together with the device's
+captive portal session log, shows how much probe and DNS traffic the option
+saves:
+    python3 tools/probe_storm.py --host 192.168.4.1 --capport 1.0
+
+With --probe-repeat N, each client keeps sending its probes N more times
+on separate connections while its popup loads the portal, like OSes that
+re-check after every network change. Comparing popup latency with the
+device's raw probe responses (CONFIG_WIFI_PROBE_RAW_RESPONSE) on and off shows how
+much probe bursts slow down real page loads:
+    python3 tools/probe_storm.py --host 192.168.4.1 --clients 30 --probe-repeat 5
+
+With --slow-clients N, N misbehaving clients run during the storm: "hold"
+clients open --slow-sockets keep-alive connections each and leave them idle,
+"headers" clients send their request headers one byte per --slow-interval,
+and "body" clients send a settings POST body that way (it is rejected by the
+device if it ever completes). "ws" clients open a WebSocket at --ws-path and
+send small frames one byte per --slow-interval, like a dashboard on a weak
+link; the device must keep them open past its request header deadline and
+echo or otherwise answer at its own pace. The report shows how long the device let each
+slow connection live and how many it refused, next to the popup latency of
+the regular clients. Bind the slow clients to their own address with
+--slow-source-ip, so the device's per-client connection limit
+(CONFIG_WIFI_HTTPD_MAX_SOCKETS_PER_CLIENT) sees them as a separate client:
+    python3 tools/probe_storm.py --host 192.168.4.1 --slow-clients 4 --slow-mode headers
+
+With --netstats, the tool reads the device's /netstats.json before and after
+the storm and reports what changed: lwIP pool allocation failures, TCP and
+UDP drops, HTTP sessions rejected and purged, DNS replies that failed for
+lack of memory and whether the device took a snapshot of that moment. Pool
+and protocol counters need CONFIG_LWIP_STATS on the device:
+    python3 tools/probe_storm.py --host 192.168.4.1 --clients 40 --netstats
+
+Note: all clients share the source IP of this machine, so the device's
+per-client captive state sees them as one client unless --source-ip is given
+several times with addresses configured on this machine.
+
+Only the Python standard library is required.
+"""
+
+import argparse
+import asyncio
+import base64
+import errno
+import json
+import os
+import random
+import socket
+import struct
+import sys
+import time
+import urllib.request
+
+# Probe sequences per OS: DNS names resolved on join and probe requests sent
+# in parallel. "success" describes the response that means "internet
+# available" (no popup) for that probe.
+OS_PROFILES = {
+    "android": {
+        "dns": ["connectivitycheck.gstatic.com", "www.google.com", "clients3.google.com"],
+        "probes": [
+            ("connectivitycheck.gstatic.com", "/generate_204"),
+            ("www.google.com", "/gen_204"),
+        ],
+        "user_agent": "Dalvik/2.1.0 (Linux; U; Android 14; Pixel 8 Build/AP2A)",
+        "success": {"status": 204},
+    },
+    "ios": {
+        "dns": ["captive.apple.com", "www.apple.com"],
+        "probes": [
+            ("captive.apple.com", "/hotspot-detect.html"),
+        ],
+        "user_agent": "CaptiveNetworkSupport-481.0.1 wispr",
+        "success": {"status": 200, "body_contains": b"Success"},
+    },
+    "windows": {
+        "dns": ["www.msftconnecttest.com", "dns.msftncsi.com", "ipv6.msftconnecttest.com"],
+        "probes": [
+            ("www.msftconnecttest.com", "/connecttest.txt"),
+            ("www.msftncsi.com", "/ncsi.txt"),
+        ],
+        "user_agent": "Microsoft NCSI",
+        "success": {"status": 200, "body_contains": b"Microsoft"},
+    },
+    "linux": {
+        "dns": ["nmcheck.gnome.org", "detectportal.firefox.com"],
+        "probes": [
+            ("detectportal.firefox.com", "/success.txt"),
+        ],
+        "user_agent": "NetworkManager/1.46",
+        "success": {"status": 200, "body_contains": b"success"},
+    },
+}
+
+# Platforms that read the captive portal API advertised in DHCP option 114
+CAPPORT_OS = {"android", "ios"}
+
+# Captive portal API path on the device (RFC 8908)
+CAPPORT_API_PATH = "/captive-api"
+
+# Default mix of client platforms, roughly a classroom of phones
+DEFAULT_MIX = {"android": 0.5, "ios": 0.4, "windows": 0.05, "linux": 0.05}
+
+# Socket errors that indicate the device ran out of sockets or purged ours
+EXHAUSTION_ERRNOS = {errno.ECONNREFUSED, errno.ECONNRESET, errno.EPIPE, errno.ECONNABORTED}
+
+
+class Stats:
+    """Counters shared by all clients."""
+
+    def __init__(self):
+        self.popup_latencies = []
+        self.no_popup = 0
+        self.failed_clients = 0
+        self.requests = 0
+        self.http_errors = 0
+        self.timeouts = 0
+        self.socket_exhaustion = 0
+        self.connections_opened = 0
+        self.keepalive_reuses = 0
+        self.dns_queries = 0
+        self.dns_failures = 0
+        self.capport_clients = 0
+        self.request_latencies = []
+        self.slow_connections = 0
+        self.slow_refused = 0
+        self.slow_closed = 0
+        self.slow_lifetimes = []
+        self.slow_ws_answers = 0
+
+
+class HttpConnection:
+    """Minimal HTTP/1.1 keep-alive client connection."""
+
+    def __init__(self, args, stats):
+        self.args = args
+        self.stats = stats
+        self.reader = None
+        self.writer = None
+
+    async def _connect(self):
+        local = (random.choice(self.args.source_ip), 0) if self.args.source_ip else None
+        self.reader, self.writer = await asyncio.wait_for(
+            asyncio.open_connection(self.args.host, self.args.http_port, local_addr=local),
+            self.args.timeout)
+        self.stats.connections_opened += 1
+
+    def close(self):
+        if self.writer:
+            self.writer.close()
+        self.reader = self.writer = None
+
+    async def request(self, host, path, user_agent):
+        """Send a GET and return (status, headers, body). Retries once on a stale keep-alive socket."""
+        for attempt in range(2):
+            reused = self.writer is not None
+            if not reused:
+                await self._connect()
+            else:
+                self.stats.keepalive_reuses += 1
+            try:
+                req = (f"GET {path} HTTP/1.1\r\nHost: {host}\r\nUser-Agent: {user_agent}\r\n"
+                       f"Accept: */*\r\nConnection: keep-alive\r\n\r\n")
+                self.writer.write(req.encode())
+                await self.writer.drain()
+                return await asyncio.wait_for(self._read_response(), self.args.timeout)
+            except (ConnectionError, asyncio.IncompleteReadError) as e:
+                self.close()
+                if reused and attempt == 0:
+                    # Server closed our idle keep-alive socket (e.g. LRU purge), count and retry fresh
+                    self.stats.socket_exhaustion += 1
+                    continue
+                raise e
+
+    async def _read_response(self):
+        status_line = await self.reader.readuntil(b"\r\n")
+        status = int(status_line.split()[1])
+        headers = {}
+        while True:
+            line = await self.reader.readuntil(b"\r\n")
+            if line == b"\r\n":
+                break
+            k, _, v = line.decode(errors="replace").partition(":")
+            headers[k.strip().lower()] = v.strip()
+        body = b""
+        if headers.get("transfer-encoding", "").lower() == "chunked":
+            while True:
+                size = int((await self.reader.readuntil(b"\r\n")).split(b";")[0], 16)
+                chunk = await self.reader.readexactly(size + 2)
+                if size == 0:
+                    break
+                body += chunk[:-2]
+        elif "content-length" in headers:
+            body = await self.reader.readexactly(int(headers["content-length"]))
+        if headers.get("connection", "").lower() == "close":
+            self.close()
+        return status, headers, body
+
+
+def build_dns_query(name, qid):
+    header = struct.pack("!HHHHHH", qid, 0x0100, 1, 0, 0, 0)
+    qname = b"".join(bytes([len(p)]) + p.encode() for p in name.split(".")) + b"\0"
+    return header + qname + struct.pack("!HH", 1, 1)
+
+
+async def dns_lookup(args, stats, name):
+    loop = asyncio.get_running_loop()
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setblocking(False)
+    try:
+        if args.source_ip:
+            sock.bind((random.choice(args.source_ip), 0))
+        qid = random.randint(0, 0xFFFF)
+        stats.dns_queries += 1
+        await loop.sock_sendto(sock, build_dns_query(name, qid), (args.host, args.dns_port))
+        data = await asyncio.wait_for(loop.sock_recv(sock, 512), args.timeout)
+        if len(data) < 12 or struct.unpack("!H", data[:2])[0] != qid or struct.unpack("!H", data[6:8])[0] == 0:
+            stats.dns_failures += 1
+    except (asyncio.TimeoutError, OSError):
+        stats.dns_failures += 1
+    finally:
+        sock.close()
+
+
+def is_success(profile, status, body):
+    success = profile["success"]
+    if status != success["status"]:
+        return False
+    return success.get("body_contains", b"") in body
+
+
+async def timed_request(args, stats, conn, host, path, user_agent):
+    start = time.monotonic()
+    stats.requests += 1
+    try:
+        status, headers, body = await conn.request(host, path, user_agent)
+    except asyncio.TimeoutError:
+        stats.timeouts += 1
+        conn.close()
+        return None
+    except OSError as e:
+        if e.errno in EXHAUSTION_ERRNOS or isinstance(e, ConnectionError):
+            stats.socket_exhaustion += 1
+        else:
+            stats.http_errors += 1
+        conn.close()
+        return None
+    except (asyncio.IncompleteReadError, ValueError, IndexError):
+        stats.http_errors += 1
+        conn.close()
+        return None
+    stats.request_latencies.append(time.monotonic() - start)
+    if status >= 500:
+        stats.http_errors += 1
+    return status, headers, body
+
+
+async def find_portal_by_probes(args, stats, conns, profile):
+    """Resolve and probe like the OS does. Returns the portal location, "" for no popup, None on failure."""
+    ua = profile["user_agent"]
+    dns = [dns_lookup(args, stats, n) for n in profile["dns"]]
+    probes = [timed_request(args, stats, conns[i % len(conns)], host, path, ua)
+              for i, (host, path) in enumerate(profile["probes"])]
+    results = await asyncio.gather(*dns, *probes)
+    probe_results = results[len(dns):]
+
+    if any(r is None for r in probe_results):
+        return None
+    redirect = next((r for r in probe_results if not is_success(profile, r[0], r[2])), None)
+    if redirect is None:
+        return ""
+    return redirect[1].get("location", "/captive")
+
+
+async def find_portal_by_api(args, stats, conns, profile):
+    """Ask the captive portal API (RFC 8908). Returns like find_portal_by_probes()."""
+    api = await timed_request(args, stats, conns[0], args.host, CAPPORT_API_PATH, profile["user_agent"])
+    if api is None or api[0] != 200:
+        return None
+    try:
+        info = json.loads(api[2])
+    except ValueError:
+        return None
+    stats.capport_clients += 1
+    if not info.get("captive"):
+        return ""
+    return info.get("user-portal-url", "/captive")
+
+
+async def repeat_probes(args, stats, profile):
+    """Send the profile's probes args.probe_repeat more times, each on a fresh connection."""
+    for _ in range(args.probe_repeat):
+        conn = HttpConnection(args, stats)
+        try:
+            for host, path in profile["probes"]:
+                await timed_request(args, stats, conn, host, path, profile["user_agent"])
+        finally:
+            conn.close()
+
+
+async def run_client(args, stats, os_name, join_delay, capport):
+    await asyncio.sleep(join_delay)
+    profile = OS_PROFILES[os_name]
+    ua = profile["user_agent"]
+    joined = time.monotonic()
+    conns = [HttpConnection(args, stats) for _ in range(args.connections)]
+    try:
+        if capport:
+            location = await find_portal_by_api(args, stats, conns, profile)
+        else:
+            location = await find_portal_by_probes(args, stats, conns, profile)
+        if location is None:
+            stats.failed_clients += 1
+            return
+        if not location:
+            stats.no_popup += 1
+            return
+
+        # Background probes competing with the popup for sockets
+        background = asyncio.ensure_future(repeat_probes(args, stats, profile)) if args.probe_repeat else None
+
+        # Popup browser: load the portal page and the assets
+        path = "/" + location.split("://", 1)[-1].split("/", 1)[1] if "://" in location else location
+        page = await timed_request(args, stats, conns[0], args.host, path, "Mozilla/5.0 " + ua)
+        if page is None or page[0] >= 400:
+            stats.failed_clients += 1
+            return
+        assets = [timed_request(args, stats, conns[i % len(conns)], args.host, a, "Mozilla/5.0 " + ua)
+                  for i, a in enumerate(args.asset)]
+        if any(r is None for r in await asyncio.gather(*assets)):
+            stats.failed_clients += 1
+            return
+        stats.popup_latencies.append(time.monotonic() - joined)
+        if background:
+            await background
+    finally:
+        for c in conns:
+            c.close()
+
+
+# Body of slow "body" clients: rejected by the settings handler (enterprise networks are not supported)
+SLOW_BODY = b"authmode=2&pad=" + b"x" * 600
+
+
+def ws_frame(payload):
+    """A masked text frame, as clients must send them."""
+    mask = os.urandom(4)
+    masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+    return bytes([0x81, 0x80 | len(payload)]) + mask + masked
+
+
+async def ws_upgrade(args, reader, writer):
+    """Send the WebSocket handshake; True if the device switched protocols."""
+    key = base64.b64encode(os.urandom(16)).decode()
+    writer.write((f"GET {args.ws_path} HTTP/1.1\r\nHost: {args.host}\r\nUpgrade: websocket\r\n"
+                  f"Connection: Upgrade\r\nSec-WebSocket-Key: {key}\r\nSec-WebSocket-Version: 13\r\n\r\n").encode())
+    await writer.drain()
+    head = await asyncio.wait_for(reader.readuntil(b"\r\n\r\n"), args.timeout)
+    return head.startswith(b"HTTP/1.1 101")
+
+
+async def slow_connection(args, stats, done):
+    """One slow connection; records how long the device kept it open."""
+    local = (args.slow_source_ip, 0) if args.slow_source_ip else None
+    try:
+        reader, writer = await asyncio.wait_for(
+            asyncio.open_connection(args.host, args.http_port, local_addr=local), args.timeout)
+    except (OSError, asyncio.TimeoutError):
+        stats.slow_refused += 1
+        return
+    opened = time.monotonic()
+    if args.slow_mode == "ws":
+        try:
+            if not await ws_upgrade(args, reader, writer):
+                stats.slow_refused += 1
+                writer.close()
+                return
+        except (OSError, asyncio.TimeoutError, asyncio.IncompleteReadError):
+            stats.slow_refused += 1
+            writer.close()
+            return
+    stats.slow_connections += 1
+    if args.slow_mode == "body":
+        data = (f"POST /captive HTTP/1.1\r\nHost: {args.host}\r\nContent-Type: application/x-www-form-urlencoded\r\n"
+                f"Content-Length: {len(SLOW_BODY)}\r\n\r\n").encode()
+        head, trickle = data, SLOW_BODY
+    elif args.slow_mode == "headers":
+        head, trickle = b"", f"GET /captive HTTP/1.1\r\nHost: {args.host}\r\nX-Pad: {'x' * 200}\r\n\r\n".encode()
+    elif args.slow_mode == "ws":
+        # Frames keep coming for as long as the storm runs
+        head, trickle = b"", b"".join(ws_frame(f"slow {i}".encode()) for i in range(1000))
+    else:
+        head, trickle = b"", b""
+    try:
+        writer.write(head)
+        await writer.drain()
+        # The device closes the connection or answers (408) when it gives up
+        eof = asyncio.ensure_future(reader.read(1))
+        for i in range(len(trickle)):
+            if args.slow_mode == "ws" and eof.done() and eof.result():
+                # Frames from the device are answers, not a close; count them and keep listening
+                stats.slow_ws_answers += 1
+                await reader.read(4096)
+                eof = asyncio.ensure_future(reader.read(1))
+            if eof.done() or done.is_set():
+                break
+            writer.write(trickle[i:i + 1])
+            await writer.drain()
+            await asyncio.sleep(args.slow_interval)
+        if not trickle:
+            await asyncio.wait([eof, asyncio.ensure_future(done.wait())], return_when=asyncio.FIRST_COMPLETED)
+        if eof.done():
+            stats.slow_closed += 1
+            stats.slow_lifetimes.append(time.monotonic() - opened)
+        eof.cancel()
+    except OSError:
+        stats.slow_closed += 1
+        stats.slow_lifetimes.append(time.monotonic() - opened)
+    finally:
+        writer.close()
+
+
+async def run_slow_client(args, stats, done):
+    sockets = args.slow_sockets if args.slow_mode == "hold" else 1
+    while not done.is_set():
+        await asyncio.gather(*[slow_connection(args, stats, done) for _ in range(sockets)])
+        await asyncio.sleep(0.5)   # Come back after the device closed us, like a leaky client
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    values = sorted(values)
+    k = min(len(values) - 1, max(0, round(p / 100 * (len(values) - 1))))
+    return values[k]
+
+
+def pick_os(args, rng):
+    if args.os != "mix":
+        return args.os
+    r = rng.random()
+    for name, share in DEFAULT_MIX.items():
+        r -= share
+        if r <= 0:
+            return name
+    return "android"
+
+
+async def main_async(args):
+    rng = random.Random(args.seed)
+    stats = Stats()
+    clients = []
+    for _ in range(args.clients):
+        os_name = pick_os(args, rng)
+        capport = os_name in CAPPORT_OS and rng.random() < args.capport
+        clients.append(run_client(args, stats, os_name, rng.uniform(0, args.ramp), capport))
+    done = asyncio.Event()
+    slow = [asyncio.ensure_future(run_slow_client(args, stats, done)) for _ in range(args.slow_clients)]
+    if slow:
+        await asyncio.sleep(1.0)    # Let the slow clients take their sockets first
+    start = time.monotonic()
+    await asyncio.gather(*clients)
+    duration = time.monotonic() - start
+    done.set()
+    await asyncio.gather(*slow)
+    return stats, duration
+
+
+def fetch_jitter(args):
+    """GET the device's jitter statistics, which also resets them."""
+    url = f"http://{args.host}:{args.http_port}{args.jitter_path}"
+    with urllib.request.urlopen(url, timeout=args.timeout) as resp:
+        return json.loads(resp.read())
+
+
+def fetch_netstats(args):
+    """GET the device's network statistics from /netstats.json."""
+    url = f"http://{args.host}:{args.http_port}/netstats.json"
+    with urllib.request.urlopen(url, timeout=args.timeout) as resp:
+        return json.loads(resp.read())
+
+
+def netstats_delta(before, after):
+    """Summarize what the storm changed in the device's network statistics."""
+    b, a = before["now"], after["now"]
+    pools_before = {p["name"]: p for p in b.get("pools", [])}
+    pool_errors = {}
+    for p in a.get("pools", []):
+        err = p["err"] - pools_before.get(p["name"], {}).get("err", 0)
+        if err:
+            pool_errors[p["name"]] = err
+    delta = lambda group, key: a[group][key] - b[group][key]
+    return {
+        "lwip_stats": a["lwip_stats"],
+        "min_free_heap": a["heap"]["min_free"],
+        "sockets_used": a["sockets"]["used"],
+        "sockets_max": a["sockets"]["max"],
+        "tcp_time_wait": a["tcp"]["time_wait"],
+        "http_backlog_max": a["tcp"]["http_backlog_max"],
+        "pool_errors": pool_errors,
+        "tcp_drops": delta("tcp_counters", "drop"),
+        "tcp_memerr": delta("tcp_counters", "memerr"),
+        "udp_drops": delta("udp", "drop"),
+        "udp_memerr": delta("udp", "memerr"),
+        "http_rejected": delta("http", "rejected"),
+        "http_purged": delta("http", "purged"),
+        "dns_send_errors": delta("dns", "send_errors"),
+        "dns_send_no_mem": delta("dns", "send_no_mem"),
+        "snapshots": after["snapshots"] - before["snapshots"],
+        "snapshot": after["snapshot"] if after["snapshots"] != before["snapshots"] else None,
+    }
+
+
+def report(args, stats, duration, jitter=None, netstats=None):
+    ms = lambda v: None if v is None else round(v * 1000, 1)
+    result = {
+        "clients": args.clients,
+        "duration_s": round(duration, 2),
+        "popup": {
+            "count": len(stats.popup_latencies),
+            "p50_ms": ms(percentile(stats.popup_latencies, 50)),
+            "p90_ms": ms(percentile(stats.popup_latencies, 90)),
+            "p99_ms": ms(percentile(stats.popup_latencies, 99)),
+            "max_ms": ms(max(stats.popup_latencies, default=None)),
+        },
+        "no_popup_clients": stats.no_popup,
+        "failed_clients": stats.failed_clients,
+        "requests": stats.requests,
+        "request_p50_ms": ms(percentile(stats.request_latencies, 50)),
+        "request_p99_ms": ms(percentile(stats.request_latencies, 99)),
+        "http_errors": stats.http_errors,
+        "timeouts": stats.timeouts,
+        "error_rate": round((stats.http_errors + stats.timeouts + stats.socket_exhaustion) / max(1, stats.requests), 4),
+        "socket_exhaustion_events": stats.socket_exhaustion,
+        "connections_opened": stats.connections_opened,
+        "keepalive_reuses": stats.keepalive_reuses,
+        "dns_queries": stats.dns_queries,
+        "dns_failures": stats.dns_failures,
+        "capport_clients": stats.capport_clients,
+    }
+    if args.slow_clients:
+        result["slow"] = {
+            "mode": args.slow_mode,
+            "connections": stats.slow_connections,
+            "refused": stats.slow_refused,
+            "closed_by_device": stats.slow_closed,
+            "lifetime_p50_ms": ms(percentile(stats.slow_lifetimes, 50)),
+            "lifetime_max_ms": ms(max(stats.slow_lifetimes, default=None)),
+        }
+        if args.slow_mode == "ws":
+            result["slow"]["ws_answers"] = stats.slow_ws_answers
+    if jitter:
+        result["app_jitter"] = jitter
+    if netstats:
+        result["netstats"] = netstats
+    if args.json:
+        json.dump(result, sys.stdout, indent=2)
+        print()
+        return
+    p = result["popup"]
+    print(f"{args.clients} clients in {result['duration_s']} s")
+    print(f"  popup latency   p50 {p['p50_ms']} ms, p90 {p['p90_ms']} ms, p99 {p['p99_ms']} ms, max {p['max_ms']} ms ({p['count']} clients)")
+    print(f"  no popup        {stats.no_popup} clients")
+    print(f"  failed          {stats.failed_clients} clients")
+    print(f"  requests        {stats.requests}, p50 {result['request_p50_ms']} ms, p99 {result['request_p99_ms']} ms")
+    print(f"  errors          {stats.http_errors} HTTP, {stats.timeouts} timeouts, rate {result['error_rate']:.2%}")
+    print(f"  socket exhaustion events {stats.socket_exhaustion}")
+    print(f"  connections     {stats.connections_opened} opened, {stats.keepalive_reuses} keep-alive reuses")
+    print(f"  DNS             {stats.dns_queries} queries, {stats.dns_failures} failures")
+    if args.capport:
+        print(f"  captive API     {stats.capport_clients} clients found the portal through {CAPPORT_API_PATH}")
+    if args.slow_clients:
+        s = result["slow"]
+        print(f"  slow clients    {args.slow_clients} ({s['mode']}), {s['connections']} connections, {s['refused']} refused, "
+              f"{s['closed_by_device']} closed by device after p50 {s['lifetime_p50_ms']} ms, max {s['lifetime_max_ms']} ms")
+        if args.slow_mode == "ws":
+            print(f"  slow WebSocket  {s['ws_answers']} answers from the device")
+    if jitter:
+        for phase in ("baseline", "storm"):
+            j = jitter[phase]
+            print(f"  app jitter {phase:9} avg {j.get('avgUs')} us, max {j.get('maxUs')} us, "
+                  f"{j.get('late')} late of {j.get('cycles')} cycles")
+    if netstats:
+        n = netstats
+        pools = ", ".join(f"{name} {err}" for name, err in n["pool_errors"].items()) or "none"
+        print(f"  device heap     min free {n['min_free_heap']} B, sockets {n['sockets_used']}/{n['sockets_max']}, "
+              f"{n['tcp_time_wait']} in TIME-WAIT")
+        print(f"  device HTTP     {n['http_rejected']} rejected, {n['http_purged']} purged")
+        print(f"  device DNS      {n['dns_send_errors']} send errors, {n['dns_send_no_mem']} out of memory, "
+              f"{n['snapshots']} snapshots")
+        if n["lwip_stats"]:
+            print(f"  device lwIP     pool errors: {pools}; TCP {n['tcp_drops']} drops, {n['tcp_memerr']} mem errors; "
+                  f"UDP {n['udp_drops']} drops, {n['udp_memerr']} mem errors")
+        else:
+            print("  device lwIP     counters unavailable, enable CONFIG_LWIP_STATS")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--host", default="192.168.4.1", help="device IP (default: %(default)s)")
+    parser.add_argument("--http-port", type=int, default=80)
+    parser.add_argument("--dns-port", type=int, default=53)
+    parser.add_argument("--clients", type=int, default=30, help="number of simulated clients (default: %(default)s)")
+    parser.add_argument("--ramp", type=float, default=2.0, help="clients join uniformly within this many seconds (default: %(default)s)")
+    parser.add_argument("--os", choices=["mix"] + sorted(OS_PROFILES), default="mix", help="client platform (default: %(default)s)")
+    parser.add_argument("--connections", type=int, default=2, help="keep-alive connections per client (default: %(default)s)")
+    parser.add_argument("--asset", action="append", help="asset loaded by the popup browser after the portal page (repeatable)")
+    parser.add_argument("--timeout", type=float, default=10.0, help="per-request timeout in seconds (default: %(default)s)")
+    parser.add_argument("--source-ip", action="append", help="local address to bind clients to (repeatable)")
+    parser.add_argument("--seed", type=int, default=1, help="random seed for the OS mix and join times")
+    parser.add_argument("--jitter-path", help="device path returning and resetting application jitter statistics, e.g. /jitter.json")
+    parser.add_argument("--baseline", type=float, default=5.0, help="idle seconds measured as jitter baseline before the storm (default: %(default)s)")
+    parser.add_argument("--capport", type=float, default=0.0, metavar="SHARE",
+                        help="share of Android/iOS clients using the captive portal API from DHCP option 114, 0 to 1 (default: %(default)s)")
+    parser.add_argument("--probe-repeat", type=int, default=0, metavar="N",
+                        help="probe N more times per client while the popup loads (default: %(default)s)")
+    parser.add_argument("--slow-clients", type=int, default=0, metavar="N",
+                        help="misbehaving clients running during the storm (default: %(default)s)")
+    parser.add_argument("--slow-mode", choices=["hold", "headers", "body", "ws"], default="headers",
+                        help="hold idle sockets, trickle request headers, a request body or WebSocket frames "
+                             "(default: %(default)s)")
+    parser.add_argument("--slow-sockets", type=int, default=8, help="sockets per slow client in hold mode (default: %(default)s)")
+    parser.add_argument("--slow-interval", type=float, default=1.0, help="seconds between trickled bytes (default: %(default)s)")
+    parser.add_argument("--ws-path", default="/ws", help="WebSocket URI for --slow-mode ws (default: %(default)s)")
+    parser.add_argument("--slow-source-ip", help="local address to bind the slow clients to")
+    parser.add_argument("--netstats", action="store_true",
+                        help="read the device's /netstats.json before and after the storm and report the changes")
+    parser.add_argument("--json", action="store_true", help="print machine-readable JSON")
+    args = parser.parse_args()
+    if args.asset is None:
+        args.asset = []
+
+    jitter = None
+    if args.jitter_path:
+        fetch_jitter(args)  # Reset
+        time.sleep(args.baseline)
+        jitter = {"baseline": fetch_jitter(args)}
+    netstats = fetch_netstats(args) if args.netstats else None
+    stats, duration = asyncio.run(main_async(args))
+    if args.jitter_path:
+        jitter["storm"] = fetch_jitter(args)
+    if args.netstats:
+        netstats = netstats_delta(netstats, fetch_netstats(args))
+    report(args, stats, duration, jitter, netstats)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""Push files to the device's SD card over the upload endpoint.
+
+Uploads every file below a directory (or single files) with
+PUT /upload/<path> (CONFIG_WIFI_UPLOAD) and reports the throughput seen by
+this machine and the throughput the device measured for receiving and
+writing each file, together with its SD card SPI clock.
+
+Usage:
+    python3 tools/upload_assets.py --host 192.168.4.1 --token secret examples/full/webpage
+    python3 tools/upload_assets.py --host 192.168.4.1 --token secret big.bin --prefix /test
+    python3 tools/upload_assets.py --host 192.168.4.1 --token secret --bench 4
+
+--bench N uploads an N MB file of random data to /bench.bin (and nothing
+else) to measure sustained throughput.
+
+Only the Python standard library is required.
+"""
+
+import argparse
+import http.client
+import json
+import os
+import sys
+import time
+import urllib.parse
+
+CHUNK = 16 * 1024
+
+
+def put_file(args, remote_path, size, chunks):
+    conn = http.client.HTTPConnection(args.host, args.port, timeout=args.timeout)
+    start = time.monotonic()
+    conn.putrequest("PUT", "/upload" + urllib.parse.quote(remote_path))
+    conn.putheader("Authorization", f"Bearer {args.token}")
+    conn.putheader("Content-Type", "application/octet-stream")
+    conn.putheader("Content-Length", str(size))
+    conn.endheaders()
+    for chunk in chunks:
+        conn.send(chunk)
+    resp = conn.getresponse()
+    body = resp.read()
+    elapsed = time.monotonic() - start
+    conn.close()
+    if resp.status != 201:
+        raise RuntimeError(f"{remote_path}: HTTP {resp.status} {body.decode(errors='replace').strip()}")
+    return elapsed, json.loads(body)
+
+
+def file_chunks(path):
+    with open(path, "rb") as f:
+        while True:
+            chunk = f.read(CHUNK)
+            if not chunk:
+                return
+            yield chunk
+
+
+def random_chunks(size):
+    sent = 0
+    while sent < size:
+        n = min(CHUNK, size - sent)
+        yield os.urandom(n)
+        sent += n
+
+
+def collect(paths, prefix):
+    """Return list of (local file, remote path)."""
+    files = []
+    for path in paths:
+        if os.path.isdir(path):
+            for root, dirs, names in os.walk(path):
+                dirs[:] = sorted(d for d in dirs if not d.startswith("."))
+                for name in sorted(names):
+                    if name.startswith("."):
+                        continue
+                    full = os.path.join(root, name)
+                    rel = os.path.relpath(full, path).replace(os.sep, "/")
+                    files.append((full, f"{prefix}/{rel}"))
+        else:
+            files.append((path, f"{prefix}/{os.path.basename(path)}"))
+    return files
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("paths", nargs="*", help="files or directories to upload")
+    parser.add_argument("--host", default="192.168.4.1", help="device IP (default: %(default)s)")
+    parser.add_argument("--port", type=int, default=80)
+    parser.add_argument("--token", required=True, help="CONFIG_WIFI_UPLOAD_TOKEN of the device")
+    parser.add_argument("--prefix", default="", help="remote directory, e.g. /www")
+    parser.add_argument("--bench", type=float, metavar="MB", help="upload MB of random data to /bench.bin instead")
+    parser.add_argument("--timeout", type=float, default=30.0)
+    args = parser.parse_args()
+    prefix = "/" + args.prefix.strip("/") if args.prefix.strip("/") else ""
+
+    if args.bench:
+        size = int(args.bench * 1024 * 1024)
+        jobs = [(None, f"{prefix}/bench.bin", size)]
+    else:
+        if not args.paths:
+            parser.error("nothing to upload")
+        jobs = [(full, remote, os.path.getsize(full)) for full, remote in collect(args.paths, prefix)]
+
+    total_bytes = 0
+    total_time = 0.0
+    for full, remote, size in jobs:
+        chunks = random_chunks(size) if full is None else file_chunks(full)
+        try:
+            elapsed, result = put_file(args, remote, size, chunks)
+        except (OSError, RuntimeError) as e:
+            sys.exit(f"error: {e}")
+        total_bytes += size
+        total_time += elapsed
+        print(f"{remote:40} {size:10} B  {size / 1024 / max(elapsed, 1e-6):8.1f} kB/s here, "
+              f"{result.get('kBps')} kB/s on device (SPI {result.get('spiKHz')} kHz)")
+    if total_time > 0:
+        print(f"{len(jobs)} files, {total_bytes} bytes in {total_time:.2f} s, "
+              f"{total_bytes / 1024 / 1024 / total_time:.3f} MB/s sustained")
+
+
+if __name__ == "__main__":
+    main()
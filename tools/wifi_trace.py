@@ -0,0 +1,360 @@
+#!/usr/bin/env python3
+"""Decode WiFi event traces recorded by the component and model them.
+
+The device keeps its most recent WiFi/IP events and mode switches in a ring
+buffer (CONFIG_WIFI_EVENT_TRACE) served at GET /wifi-trace.bin. This tool
+fetches or reads such a dump and either prints it or runs it through an
+approximate Python model of the component's mode-switch logic.
+
+Usage:
+    python3 tools/wifi_trace.py fetch 192.168.4.1 -o trace.bin
+    python3 tools/wifi_trace.py dump trace.bin
+    python3 tools/wifi_trace.py model trace.bin --max-reconnects 5
+    python3 tools/wifi_trace.py model trace.bin --max-reconnects 10 --json
+
+The model reports the time spent in each state, every state transition with
+its cause, STA reconnect latency, disconnect reason counts and AP station
+join bursts, and the heap state at every mode switch so leaks and
+fragmentation across many switches show up as a falling minimum free heap or
+largest free block. It re-implements only the "switch to captive portal
+after N consecutive STA failures" decision (--max-reconnects,
+CONFIG_WIFI_MAX_RECONNECTS on the device) and can drift from the firmware
+when that logic changes. To run a trace through the component's own code,
+use the host build instead: host_test/build/wifi_host replay trace.bin.
+
+Only the Python standard library is required.
+"""
+
+import argparse
+import json
+import struct
+import sys
+import urllib.request
+
+HEADER = struct.Struct("<4sBBHII")
+RECORD = struct.Struct("<IBBHBx8s")
+
+SOURCE_WIFI, SOURCE_IP, SOURCE_ACTION = 0, 1, 2
+
+WIFI_EVENTS = {
+    0: "WIFI_READY", 1: "SCAN_DONE", 2: "STA_START", 3: "STA_STOP", 4: "STA_CONNECTED",
+    5: "STA_DISCONNECTED", 6: "STA_AUTHMODE_CHANGE", 12: "AP_START", 13: "AP_STOP",
+    14: "AP_STACONNECTED", 15: "AP_STADISCONNECTED", 16: "AP_PROBEREQRECVED",
+    18: "STA_BSS_RSSI_LOW", 21: "STA_BEACON_TIMEOUT",
+}
+IP_EVENTS = {0: "STA_GOT_IP", 1: "STA_LOST_IP", 2: "AP_STAIPASSIGNED", 3: "GOT_IP6"}
+ACTIONS = {0: "BOOT", 1: "SWITCH_STA", 2: "SWITCH_AP", 3: "SWITCH_CAPTIVE", 4: "RECONNECT", 5: "MDNS_UPDATE", 6: "RESTART",
+           7: "NETIF_UPDATE", 8: "DHCP_UPDATE"}
+
+# Common wifi_err_reason_t values
+DISCONNECT_REASONS = {
+    1: "UNSPECIFIED", 2: "AUTH_EXPIRE", 3: "AUTH_LEAVE", 4: "ASSOC_EXPIRE", 8: "ASSOC_LEAVE",
+    15: "4WAY_HANDSHAKE_TIMEOUT", 200: "BEACON_TIMEOUT", 201: "NO_AP_FOUND", 202: "AUTH_FAIL",
+    203: "ASSOC_FAIL", 204: "HANDSHAKE_TIMEOUT", 205: "CONNECTION_FAIL", 206: "AP_TSF_RESET",
+    207: "ROAMING", 210: "NO_AP_FOUND_W_COMPATIBLE_SECURITY", 211: "NO_AP_FOUND_IN_AUTHMODE_THRESHOLD",
+    212: "NO_AP_FOUND_IN_RSSI_THRESHOLD",
+}
+
+# Event group bits, see Wifi.c
+BITS = ["CONNECTED", "SWITCH_TO_STA", "SWITCH_TO_AP", "SWITCH_TO_CAPTIVE_AP", "RECONNECT", "MDNS_CHANGE",
+        "SD_CARD_CHANGE", "RESTART", "NETIF_CHANGE", "DHCP_CHANGE"]
+
+
+def parse(data):
+    """Return (header dict, list of record dicts) from a dump."""
+    if len(data) < HEADER.size:
+        raise ValueError("dump too short")
+    magic, version, rec_size, count, lost, now_ms = HEADER.unpack_from(data)
+    if magic != b"WTRC":
+        raise ValueError("not a WiFi trace dump")
+    if version != 2 or rec_size != RECORD.size:
+        raise ValueError(f"unsupported trace format {version} / record size {rec_size}")
+    records = []
+    for off in range(HEADER.size, len(data) - RECORD.size + 1, RECORD.size):
+        t, source, ev, bits, fails, payload = RECORD.unpack_from(data, off)
+        records.append(decode_record(t, source, ev, bits, fails, payload))
+    header = {"count": count, "lost": lost, "uptime_ms": now_ms}
+    return header, records
+
+
+def mac(b):
+    return ":".join(f"{x:02x}" for x in b)
+
+
+def ip(b):
+    return ".".join(str(x) for x in b[:4])
+
+
+def decode_record(t, source, ev, bits, fails, payload):
+    rec = {"t": t, "bits": bits, "sta_fails": fails}
+    if source == SOURCE_WIFI:
+        rec["kind"] = "wifi"
+        rec["name"] = WIFI_EVENTS.get(ev, f"WIFI_EVENT_{ev}")
+        if rec["name"] == "STA_DISCONNECTED":
+            reason, rssi = struct.unpack_from("<Hb", payload)
+            rec["reason"] = reason
+            rec["reason_name"] = DISCONNECT_REASONS.get(reason, str(reason))
+            rec["rssi"] = rssi
+        elif rec["name"] == "STA_CONNECTED":
+            rec["channel"], rec["authmode"] = payload[0], payload[1]
+        elif rec["name"] == "AP_STACONNECTED":
+            rec["mac"], rec["aid"] = mac(payload[:6]), payload[6]
+        elif rec["name"] == "AP_STADISCONNECTED":
+            rec["mac"] = mac(payload[:6])
+            rec["reason"] = struct.unpack_from("<H", payload, 6)[0]
+    elif source == SOURCE_IP:
+        rec["kind"] = "ip"
+        rec["name"] = IP_EVENTS.get(ev, f"IP_EVENT_{ev}")
+        if rec["name"] in ("STA_GOT_IP", "AP_STAIPASSIGNED"):
+            rec["ip"] = ip(payload)
+    elif source == SOURCE_ACTION:
+        rec["kind"] = "action"
+        rec["name"] = ACTIONS.get(ev, f"ACTION_{ev}")
+        rec["arg"] = payload[0]
+        rec["heap_free_kb"], rec["heap_min_free_kb"], rec["heap_largest_kb"] = struct.unpack_from("<HHH", payload, 2)
+    else:
+        rec["kind"] = "unknown"
+        rec["name"] = f"SOURCE_{source}_{ev}"
+    return rec
+
+
+def describe(rec):
+    extra = {k: v for k, v in rec.items() if k not in ("t", "bits", "sta_fails", "kind", "name")}
+    bits = "|".join(n for i, n in enumerate(BITS) if rec["bits"] & (1 << i)) or "-"
+    args = " ".join(f"{k}={v}" for k, v in extra.items())
+    return f"{rec['t'] / 1000:10.3f}s  {rec['kind']:6} {rec['name']:22} fails={rec['sta_fails']:<3} bits={bits:30} {args}"
+
+
+class Model:
+    """Approximate model of wifi_event_handler and wifi_event_group_listener_task."""
+
+    def __init__(self, max_reconnects):
+        self.max_reconnects = max_reconnects
+        self.state = "boot"
+        self.state_since = None
+        self.mode = None            # "sta", "ap" or "captive"
+        self.fails = 0
+        self.reconnecting = False
+        self.pending_captive = None  # Time the model decided to switch to captive
+        self.time_in_state = {}
+        self.transitions = []
+        self.divergences = []
+        self.sta_start = None
+        self.reconnect_latencies = []
+
+    def enter(self, t, state, cause):
+        if state == self.state:
+            return
+        if self.state_since is not None:
+            self.time_in_state[self.state] = self.time_in_state.get(self.state, 0) + t - self.state_since
+        self.transitions.append({"t": t, "from": self.state, "to": state, "cause": cause})
+        self.state = state
+        self.state_since = t
+
+    def feed(self, rec):
+        t, name = rec["t"], rec["name"]
+        if self.state_since is None:
+            self.state_since = t
+
+        if rec["kind"] == "action":
+            if name == "SWITCH_CAPTIVE":
+                if self.pending_captive is None and self.mode == "sta":
+                    self.divergences.append({"t": t, "what": "recording switched to captive portal, model did not"})
+                self.pending_captive = None
+                self.mode = "captive"
+                self.enter(t, "captive", name)
+            elif name == "SWITCH_STA":
+                self.mode = "sta"
+                self.sta_start = t
+                self.enter(t, "sta_connecting", name)
+            elif name == "SWITCH_AP":
+                self.mode = "ap"
+                self.enter(t, "ap", name)
+            elif name == "RECONNECT":
+                self.reconnecting = True
+                self.sta_start = t
+                self.enter(t, "sta_connecting", name)
+            return
+
+        if self.mode != "sta" or self.pending_captive is not None:
+            return
+        if name == "STA_CONNECTED":
+            self.fails = 0
+            self.enter(t, "sta_associated", name)
+        elif name == "STA_GOT_IP":
+            self.fails = 0
+            if self.sta_start is not None:
+                self.reconnect_latencies.append(t - self.sta_start)
+                self.sta_start = None
+            self.enter(t, "sta_online", name)
+        elif name == "STA_DISCONNECTED":
+            cause = f"{name} ({rec.get('reason_name')})"
+            if self.state == "sta_online":
+                self.sta_start = t
+            if self.reconnecting:
+                self.reconnecting = False
+                self.enter(t, "sta_connecting", cause)
+                return
+            self.fails += 1
+            if self.fails >= self.max_reconnects:
+                self.fails = 0
+                self.pending_captive = t
+                self.enter(t, "switching_to_captive", cause)
+            else:
+                self.enter(t, "sta_retrying", cause)
+
+    def finish(self, end_t):
+        if self.state_since is not None:
+            self.time_in_state[self.state] = self.time_in_state.get(self.state, 0) + end_t - self.state_since
+            self.state_since = end_t
+        if self.pending_captive is not None:
+            self.divergences.append({"t": self.pending_captive, "what": "model switched to captive portal, recording did not"})
+
+
+def percentile(values, p):
+    if not values:
+        return None
+    values = sorted(values)
+    return values[min(len(values) - 1, round(p / 100 * (len(values) - 1)))]
+
+
+def max_burst(times, window_ms):
+    best, lo = 0, 0
+    for hi, t in enumerate(times):
+        while t - times[lo] > window_ms:
+            lo += 1
+        best = max(best, hi - lo + 1)
+    return best
+
+
+def heap_trend(records):
+    """Heap state recorded with each listener action, first vs. last."""
+    actions = [r for r in records if r["kind"] == "action"]
+    if not actions:
+        return None
+    first, last = actions[0], actions[-1]
+    steps = max(len(actions) - 1, 1)
+    return {
+        "samples": len(actions),
+        "free_kb": {"first": first["heap_free_kb"], "last": last["heap_free_kb"],
+                    "min": min(r["heap_free_kb"] for r in actions)},
+        "min_free_kb": {"first": first["heap_min_free_kb"], "last": last["heap_min_free_kb"]},
+        "largest_block_kb": {"first": first["heap_largest_kb"], "last": last["heap_largest_kb"],
+                             "min": min(r["heap_largest_kb"] for r in actions)},
+        "free_kb_per_action": round((last["heap_free_kb"] - first["heap_free_kb"]) / steps, 2),
+    }
+
+
+def run_model(header, records, args):
+    model = Model(args.max_reconnects)
+    for rec in records:
+        model.feed(rec)
+    end_t = max(header["uptime_ms"], records[-1]["t"]) if records else header["uptime_ms"]
+    model.finish(end_t)
+
+    reasons = {}
+    for r in records:
+        if r["name"] == "STA_DISCONNECTED":
+            reasons[r["reason_name"]] = reasons.get(r["reason_name"], 0) + 1
+    joins = [r["t"] for r in records if r["name"] == "AP_STACONNECTED"]
+    total = sum(model.time_in_state.values()) or 1
+    return {
+        "records": len(records),
+        "lost_records": header["lost"],
+        "span_ms": (end_t - records[0]["t"]) if records else 0,
+        "time_in_state_ms": model.time_in_state,
+        "time_in_state_pct": {k: round(100 * v / total, 1) for k, v in model.time_in_state.items()},
+        "transitions": model.transitions,
+        "divergences": model.divergences,
+        "reconnect_latency_ms": {
+            "count": len(model.reconnect_latencies),
+            "p50": percentile(model.reconnect_latencies, 50),
+            "p90": percentile(model.reconnect_latencies, 90),
+            "max": max(model.reconnect_latencies, default=None),
+        },
+        "disconnect_reasons": reasons,
+        "ap_station_joins": len(joins),
+        "ap_max_joins_per_window": max_burst(joins, args.burst_window),
+        "heap": heap_trend(records),
+    }
+
+
+def print_model(result, args):
+    print(f"{result['records']} records over {result['span_ms'] / 1000:.1f} s ({result['lost_records']} older records lost)")
+    print("\nTime in state:")
+    for state, ms in sorted(result["time_in_state_ms"].items(), key=lambda kv: -kv[1]):
+        print(f"  {state:22} {ms / 1000:10.3f} s  {result['time_in_state_pct'][state]:5.1f} %")
+    print("\nTransitions:")
+    for tr in result["transitions"]:
+        print(f"  {tr['t'] / 1000:10.3f}s  {tr['from']:22} -> {tr['to']:22} {tr['cause']}")
+    lat = result["reconnect_latency_ms"]
+    print(f"\nSTA connect latency: {lat['count']} connects, p50 {lat['p50']} ms, p90 {lat['p90']} ms, max {lat['max']} ms")
+    if result["disconnect_reasons"]:
+        print("Disconnect reasons: " + ", ".join(f"{k} x{v}" for k, v in result["disconnect_reasons"].items()))
+    print(f"AP station joins: {result['ap_station_joins']}, at most {result['ap_max_joins_per_window']} within {args.burst_window} ms")
+    heap = result["heap"]
+    if heap:
+        print(f"Heap over {heap['samples']} actions: free {heap['free_kb']['first']} -> {heap['free_kb']['last']} kB "
+              f"({heap['free_kb_per_action']:+} kB per action), min free {heap['min_free_kb']['first']} -> "
+              f"{heap['min_free_kb']['last']} kB, largest block {heap['largest_block_kb']['first']} -> "
+              f"{heap['largest_block_kb']['last']} kB (lowest {heap['largest_block_kb']['min']} kB)")
+    if result["divergences"]:
+        print(f"\nDivergences from the recording (--max-reconnects {args.max_reconnects}):")
+        for d in result["divergences"]:
+            print(f"  {d['t'] / 1000:10.3f}s  {d['what']}")
+
+
+def load(path):
+    with open(path, "rb") as f:
+        return parse(f.read())
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="cmd", required=True)
+
+    p = sub.add_parser("fetch", help="download the trace from a device")
+    p.add_argument("host", help="device IP or hostname")
+    p.add_argument("-o", "--output", default="wifi-trace.bin")
+
+    p = sub.add_parser("dump", help="print every record")
+    p.add_argument("file")
+    p.add_argument("--json", action="store_true", help="print machine-readable JSON")
+
+    p = sub.add_parser("model", help="run the trace through an approximate model of the mode-switch logic")
+    p.add_argument("file")
+    p.add_argument("--max-reconnects", type=int, default=5, help="CONFIG_WIFI_MAX_RECONNECTS to model (default: %(default)s)")
+    p.add_argument("--burst-window", type=int, default=1000, help="window for AP join bursts in ms (default: %(default)s)")
+    p.add_argument("--json", action="store_true", help="print machine-readable JSON")
+
+    args = parser.parse_args()
+
+    if args.cmd == "fetch":
+        with urllib.request.urlopen(f"http://{args.host}/wifi-trace.bin", timeout=10) as resp:
+            data = resp.read()
+        parse(data)  # Validate before saving
+        with open(args.output, "wb") as f:
+            f.write(data)
+        print(f"Saved {len(data)} bytes to {args.output}")
+        return
+
+    header, records = load(args.file)
+    if args.cmd == "dump":
+        if args.json:
+            json.dump({"header": header, "records": records}, sys.stdout, indent=2)
+            print()
+        else:
+            print(f"{len(records)} records, {header['lost']} lost, uptime {header['uptime_ms'] / 1000:.3f} s")
+            for rec in records:
+                print(describe(rec))
+    else:
+        result = run_model(header, records, args)
+        if args.json:
+            json.dump(result, sys.stdout, indent=2)
+            print()
+        else:
+            print_model(result, args)
+
+
+if __name__ == "__main__":
+    main()